@@ -12,6 +12,15 @@
 #include "lauxlib.h"
 #include "mimi_config.h"
 
+static lua_modulo_ble_listener_t s_listener = NULL;
+static void *s_listener_arg = NULL;
+
+void lua_modulo_ble_set_listener(lua_modulo_ble_listener_t cb, void *arg)
+{
+    s_listener_arg = arg;
+    s_listener = cb;
+}
+
 #if CONFIG_MIMI_TOOL_BLE_ENABLED && defined(CONFIG_BT_NIMBLE_ENABLED)
 #include "host/ble_gap.h"
 #include "host/ble_hs.h"
@@ -178,6 +187,10 @@ static int bthome_gap_event(struct ble_gap_event *event, void *arg)
                     s_latest = parsed;
                     s_has_data = true;
                     portEXIT_CRITICAL(&s_lock);
+
+                    if (s_listener) {
+                        s_listener(s_listener_arg);
+                    }
                 }
             }
 
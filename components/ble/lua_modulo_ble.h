@@ -4,3 +4,7 @@
 
 int luaopen_modulo_ble(lua_State *L);
 void lua_register_modulo_ble_lib(lua_State *L);
+
+/* Called from the NimBLE host task after each new BTHome reading. */
+typedef void (*lua_modulo_ble_listener_t)(void *arg);
+void lua_modulo_ble_set_listener(lua_modulo_ble_listener_t cb, void *arg);
@@ -786,6 +786,52 @@ static int lua_camera_capture(lua_State *L)
     return 1;
 }
 
+int lua_modulo_camera_push_frame(lua_State *L)
+{
+    // Leave the camera running: daemons sample it periodically
+    if (!s_camera_initialized) {
+        esp_err_t init_err = camera_core_init();
+        if (init_err != ESP_OK) {
+            return luaL_error(L, "camera_core.init failed: %s", esp_err_to_name(init_err));
+        }
+    }
+
+    camera_fb_t *fb = NULL;
+    esp_err_t acq = camera_core_acquire_fb_latest(&fb, pdMS_TO_TICKS(1500));
+    if (acq != ESP_OK || fb == NULL) {
+        return luaL_error(L, "camera frame failed: %s", esp_err_to_name(acq));
+    }
+
+    uint8_t *jpg_buf = fb->buf;
+    size_t jpg_len = fb->len;
+    bool converted = false;
+    if (fb->format != PIXFORMAT_JPEG) {
+        if (!fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, 80, &jpg_buf, &jpg_len)) {
+            camera_core_release_fb(fb);
+            return luaL_error(L, "camera frame: jpeg encode failed");
+        }
+        converted = true;
+    }
+
+    int width = fb->width;
+    int height = fb->height;
+    lua_createtable(L, 0, 4);
+    lua_pushlstring(L, (const char *)jpg_buf, jpg_len);
+    if (converted) {
+        free(jpg_buf);
+    }
+    camera_core_release_fb(fb);
+
+    lua_setfield(L, -2, "data");
+    lua_pushinteger(L, (lua_Integer)jpg_len);
+    lua_setfield(L, -2, "jpeg_bytes");
+    lua_pushinteger(L, width);
+    lua_setfield(L, -2, "width");
+    lua_pushinteger(L, height);
+    lua_setfield(L, -2, "height");
+    return 1;
+}
+
 int luaopen_camera(lua_State *L)
 {
     static const luaL_Reg funcs[] = {
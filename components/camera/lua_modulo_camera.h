@@ -4,3 +4,10 @@
 
 int luaopen_modulo_camera(lua_State *L);
 void lua_register_modulo_camera_lib(lua_State *L);
+
+/*
+ * Push the latest frame as {data = <jpeg bytes>, jpeg_bytes, width, height},
+ * initialising the camera if needed and leaving it running. Nothing is
+ * written to SPIFFS. Raises a Lua error on failure.
+ */
+int lua_modulo_camera_push_frame(lua_State *L);
@@ -1,7 +1,7 @@
 #include "agent_loop.h"
 #include "agent/context_builder.h"
 #include "mimi_config.h"
-#include "nvs.h"
+#include "config/config_registry.h"
 #include "bus/message_bus.h"
 #include "llm/llm_proxy.h"
 #include "wifi/wifi_manager.h"
@@ -9,6 +9,11 @@
 #include "tools/tool_registry.h"
 #include "bus/message_bus.h"
 #include "tools/tool_get_time.h"
+#include "gateway/ws_server.h"
+#include "trace/trace.h"
+#include "arena/turn_arena.h"
+#include "heapprof/heap_prof.h"
+#include "offline/offline_queue.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -23,10 +28,51 @@
 static const char *TAG = "agent";
 
 #define TOOL_OUTPUT_SIZE  (500 * 1024)
+#define PROGRESS_BUF_SIZE (4 * 1024)
+#define WORKING_STATUS_TEXT "\xF0\x9F\x90\x9Dswarm is working..."
 
 /* Last agent loop execution time for context */
 static uint64_t s_last_execution_time = 0;
 
+/* Turn counter, used to correlate agent events */
+static uint32_t s_turn_seq = 0;
+
+/* Cumulative turn statistics, read by agent_loop_get_stats() */
+static agent_stats_t s_stats = {0};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *s_phase_names[AGENT_PHASE_COUNT] = {
+    "context_build", "session_history", "llm_chat", "tools", "session_save",
+};
+
+/* Close a phase: one trace span plus its share of the cumulative stats */
+static void phase_end(agent_phase_t phase, int64_t start_us)
+{
+    int64_t end_us = esp_timer_get_time();
+    trace_record(s_phase_names[phase], NULL, start_us, end_us);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.phase_us[phase] += (uint64_t)(end_us - start_us);
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static void stats_turn_done(int64_t turn_start_us, int llm_calls, int tool_calls)
+{
+    int64_t dur_us = esp_timer_get_time() - turn_start_us;
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.turns++;
+    s_stats.llm_calls += llm_calls;
+    s_stats.tool_calls += tool_calls;
+    s_stats.turn_us += (uint64_t)dur_us;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void agent_loop_get_stats(agent_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
 static bool is_image_path(const char *path)
 {
     if (!path) {
@@ -85,6 +131,45 @@ static cJSON *build_assistant_content(const llm_response_t *resp)
     return content;
 }
 
+/* Channels that render in-progress replies by editing a placeholder message */
+static bool channel_streams_replies(const char *channel)
+{
+    return strcmp(channel, MIMI_CHAN_TELEGRAM) == 0 ||
+           strcmp(channel, MIMI_CHAN_FEISHU) == 0 ||
+           strcmp(channel, MIMI_CHAN_OPENAI) == 0 ||  /* snapshots act as SSE keepalives */
+           strcmp(channel, MIMI_CHAN_BENCH) == 0;     /* same reply path as chat channels */
+}
+
+/* Append text to a fixed buffer, truncating on a UTF-8 boundary */
+static void progress_append(char *buf, size_t size, const char *text)
+{
+    size_t off = strnlen(buf, size - 1);
+    size_t room = size - 1 - off;
+    size_t n = strlen(text);
+    if (n > room) {
+        n = room;
+        while (n > 0 && ((unsigned char)text[n] & 0xC0) == 0x80) n--;
+    }
+    memcpy(buf + off, text, n);
+    buf[off + n] = '\0';
+}
+
+/* Push a reply for the source chat; takes ownership of text */
+static void push_reply(const mimi_msg_t *src, const char *type, char *text)
+{
+    if (!text) return;
+    mimi_msg_t out = {0};
+    strncpy(out.channel, src->channel, sizeof(out.channel) - 1);
+    strncpy(out.chat_id, src->chat_id, sizeof(out.chat_id) - 1);
+    strncpy(out.type, type, sizeof(out.type) - 1);
+    out.seq = src->seq;
+    out.payload.text = text;
+    if (message_bus_push_outbound(&out) != ESP_OK) {
+        ESP_LOGW(TAG, "Outbound queue full, drop %s message", type);
+        free(text);
+    }
+}
+
 static void json_set_string(cJSON *obj, const char *key, const char *value)
 {
     if (!obj || !key || !value) {
@@ -191,8 +276,79 @@ static char *patch_tool_input_with_context(const llm_tool_call_t *call, const mi
     return patched;
 }
 
-/* Build the user message with tool_result blocks */
+/* Start an agent event for the current turn, or NULL if no WebSocket
+ * client subscribed. Callers add fields and hand it to ws_server_publish_event(). */
+static cJSON *turn_event(const char *name, const mimi_msg_t *msg)
+{
+    if (!ws_server_has_subscribers()) return NULL;
+
+    cJSON *evt = cJSON_CreateObject();
+    if (!evt) return NULL;
+    cJSON_AddStringToObject(evt, "type", "event");
+    cJSON_AddStringToObject(evt, "event", name);
+    cJSON_AddNumberToObject(evt, "turn", s_turn_seq);
+    cJSON_AddStringToObject(evt, "channel", msg->channel);
+    cJSON_AddStringToObject(evt, "chat_id", msg->chat_id);
+    cJSON_AddNumberToObject(evt, "t_ms", (double)(esp_timer_get_time() / 1000));
+    return evt;
+}
+
+/* Partial output of the tool being executed (tool_registry_progress) */
+typedef struct {
+    const mimi_msg_t      *msg;
+    const llm_tool_call_t *call;
+    const char            *progress;    /* placeholder text so far; NULL: not streaming */
+    char                   tail[MIMI_AGENT_TOOL_TAIL + 1];
+    size_t                 tail_len;
+} tool_progress_t;
+
+static tool_progress_t s_tool_progress;
+
+/* Keep the last MIMI_AGENT_TOOL_TAIL bytes of the tool's output */
+static void tool_tail_append(tool_progress_t *tp, const char *text, size_t len)
+{
+    if (len >= MIMI_AGENT_TOOL_TAIL) {
+        memcpy(tp->tail, text + len - MIMI_AGENT_TOOL_TAIL, MIMI_AGENT_TOOL_TAIL);
+        tp->tail_len = MIMI_AGENT_TOOL_TAIL;
+    } else {
+        size_t drop = tp->tail_len + len > MIMI_AGENT_TOOL_TAIL
+                      ? tp->tail_len + len - MIMI_AGENT_TOOL_TAIL : 0;
+        memmove(tp->tail, tp->tail + drop, tp->tail_len - drop);
+        memcpy(tp->tail + tp->tail_len - drop, text, len);
+        tp->tail_len = tp->tail_len - drop + len;
+    }
+    tp->tail[tp->tail_len] = '\0';
+}
+
+/* Show it as a tool_output event and, on streaming channels, in the placeholder */
+static void on_tool_progress(const char *text, size_t len, void *arg)
+{
+    tool_progress_t *tp = (tool_progress_t *)arg;
+
+    cJSON *evt = turn_event("tool_output", tp->msg);
+    if (evt) {
+        cJSON_AddStringToObject(evt, "name", tp->call->name);
+        cJSON_AddStringToObject(evt, "id", tp->call->id);
+        cJSON_AddStringToObject(evt, "text", text);
+        ws_server_publish_event(evt);
+    }
+
+    if (!tp->progress) return;
+    tool_tail_append(tp, text, len);
+    const char *tail = tp->tail;
+    while (((unsigned char)*tail & 0xC0) == 0x80) tail++;   /* UTF-8 boundary */
+
+    size_t size = strlen(tp->progress) + strlen(tp->call->name) + strlen(tail) + 16;
+    char *snapshot = malloc(size);
+    if (!snapshot) return;
+    snprintf(snapshot, size, "%s\n\xF0\x9F\x94\xA7 %s\n%s", tp->progress, tp->call->name, tail);
+    push_reply(tp->msg, "stream", snapshot);
+}
+
+/* Build the user message with tool_result blocks; progress is the
+ * placeholder text on streaming channels, else NULL */
 static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *msg,
+                                 const char *progress,
                                  char *tool_output, size_t tool_output_size)
 {
     cJSON *content = cJSON_CreateArray();
@@ -206,13 +362,38 @@ static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *m
             tool_input = patched_input;
         }
 
+        cJSON *evt = turn_event("tool_start", msg);
+        if (evt) {
+            cJSON_AddStringToObject(evt, "name", call->name);
+            cJSON_AddStringToObject(evt, "id", call->id);
+            cJSON_AddNumberToObject(evt, "input_bytes", strlen(tool_input));
+            ws_server_publish_event(evt);
+        }
+
         /* Execute tool */
+        int64_t tool_start_us = esp_timer_get_time();
         tool_output[0] = '\0';
+        s_tool_progress.msg = msg;
+        s_tool_progress.call = call;
+        s_tool_progress.progress = progress;
+        s_tool_progress.tail_len = 0;
+        tool_registry_set_progress(on_tool_progress, &s_tool_progress);
         tool_registry_execute(call->name, tool_input, tool_output, tool_output_size);
-        free(patched_input);
+        tool_registry_set_progress(NULL, NULL);
+        cJSON_free(patched_input);
 
         ESP_LOGI(TAG, "Tool %s result: %d bytes", call->name, (int)strlen(tool_output));
 
+        evt = turn_event("tool_end", msg);
+        if (evt) {
+            cJSON_AddStringToObject(evt, "name", call->name);
+            cJSON_AddStringToObject(evt, "id", call->id);
+            cJSON_AddNumberToObject(evt, "duration_ms",
+                                    (double)((esp_timer_get_time() - tool_start_us) / 1000));
+            cJSON_AddNumberToObject(evt, "bytes", strlen(tool_output));
+            ws_server_publish_event(evt);
+        }
+
         /* Determine if this tool result is an image for LLM vision */
         bool is_image_result = false;
         char media_type[64] = "image/jpeg";
@@ -281,7 +462,7 @@ static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *m
             size_t prefix_len = strlen(prefix);
             size_t b64_len = strlen(image_b64);
             size_t url_len = prefix_len + b64_len;
-            char *url_buf = malloc(url_len + 1);
+            char *url_buf = turn_arena_alloc(url_len + 1);
             if (url_buf) {
                 memcpy(url_buf, prefix, prefix_len);
                 memcpy(url_buf + prefix_len, image_b64, b64_len);
@@ -291,7 +472,7 @@ static cJSON *build_tool_results(const llm_response_t *resp, const mimi_msg_t *m
                 cJSON_AddStringToObject(img_block, "type", "image_url");
                 cJSON *image_url = cJSON_CreateObject();
                 cJSON_AddStringToObject(image_url, "url", url_buf);
-                free(url_buf); /* cJSON_AddStringToObject copied the string */
+                turn_arena_free(url_buf); /* cJSON_AddStringToObject copied the string */
                 cJSON_AddItemToObject(img_block, "image_url", image_url);
                 cJSON_AddItemToArray(content_array, img_block);
                 cJSON_AddItemToObject(result_block, "content", content_array);
@@ -320,8 +501,9 @@ static void agent_loop_task(void *arg)
     char *system_prompt = heap_caps_calloc(1, MIMI_CONTEXT_BUF_SIZE, MALLOC_CAP_SPIRAM);
     char *history_json = heap_caps_calloc(1, MIMI_LLM_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM);
     char *tool_output = heap_caps_calloc(1, TOOL_OUTPUT_SIZE, MALLOC_CAP_SPIRAM);
+    char *progress = heap_caps_calloc(1, PROGRESS_BUF_SIZE, MALLOC_CAP_SPIRAM);
 
-    if (!system_prompt || !history_json || !tool_output) {
+    if (!system_prompt || !history_json || !tool_output || !progress) {
         ESP_LOGE(TAG, "Failed to allocate PSRAM buffers");
         vTaskDelete(NULL);
         return;
@@ -333,18 +515,42 @@ static void agent_loop_task(void *arg)
         mimi_msg_t msg;
         esp_err_t err = message_bus_pop_inbound(&msg, UINT32_MAX);
         if (err != ESP_OK) continue;
+
+        /* No link: journal the turn for replay instead of failing it */
+        if (!offline_queue_link_up() && offline_queue_defer(OFFLINE_INBOUND, &msg) == ESP_OK) {
+            ESP_LOGW(TAG, "Offline, turn from %s:%s deferred", msg.channel, msg.chat_id);
+            mimi_msg_free(&msg);
+            continue;
+        }
         ESP_LOGI(TAG, "Processing message from %s:%s", msg.channel, msg.chat_id);
 
+        s_turn_seq++;
+        int64_t turn_start_us = esp_timer_get_time();
+        /* cJSON trees and turn-scoped strings from here on live in the
+         * arena; outbound payloads are escaped to the heap */
+        turn_arena_begin();
+        trace_span_t turn_span = trace_begin("turn", NULL);
+        int usage_in = 0, usage_out = 0, llm_calls = 0;
+        cJSON *evt = turn_event("turn_start", &msg);
+        if (evt) {
+            cJSON_AddNumberToObject(evt, "bytes", msg.payload.text ? strlen(msg.payload.text) : 0);
+            ws_server_publish_event(evt);
+        }
+
         /* 1. Build system prompt */
+        int64_t phase_start = esp_timer_get_time();
         context_build_system_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE);
         append_turn_context_prompt(system_prompt, MIMI_CONTEXT_BUF_SIZE, &msg);
+        phase_end(AGENT_PHASE_CONTEXT, phase_start);
         ESP_LOGI(TAG, "LLM turn context: channel=%s chat_id=%s", msg.channel, msg.chat_id);
 
         /* 2. Load session history into cJSON array */
+        phase_start = esp_timer_get_time();
         session_get_history_json(msg.chat_id, history_json,
                                  MIMI_LLM_STREAM_BUF_SIZE, MIMI_AGENT_MAX_HISTORY);
 
         cJSON *messages = cJSON_Parse(history_json);
+        phase_end(AGENT_PHASE_HISTORY, phase_start);
         if (!messages) {
             ESP_LOGW(TAG, "History parse failed for chat_id=%s, fallback to empty history", msg.chat_id);
             messages = cJSON_CreateArray();
@@ -364,39 +570,70 @@ static void agent_loop_task(void *arg)
         int tool_calls_total = 0;
         char tool_name_buf[MIMI_AGENT_MAX_TOOL_ITER*MIMI_MAX_TOOL_CALLS][32] = {{0}};
         bool sent_working_status = false;
+        bool llm_failed = false;
+
+        /* Telegram/Feishu: the working status becomes a placeholder that is
+         * edited with progress and finally replaced by the answer. */
+        bool streaming = MIMI_AGENT_SEND_WORKING_STATUS && channel_streams_replies(msg.channel);
+        progress[0] = '\0';
+        progress_append(progress, PROGRESS_BUF_SIZE, WORKING_STATUS_TEXT);
 
         while (iteration < MIMI_AGENT_MAX_TOOL_ITER) {
             /* Send "working" indicator before each API call */
 #if MIMI_AGENT_SEND_WORKING_STATUS
             if (!sent_working_status && strcmp(msg.channel, MIMI_CHAN_SYSTEM) != 0) {
-                mimi_msg_t status = {0};
-                strncpy(status.channel, msg.channel, sizeof(status.channel) - 1);
-                strncpy(status.chat_id, msg.chat_id, sizeof(status.chat_id) - 1);
-                strncpy(status.type, "text", sizeof(status.type) - 1);
-                status.payload.text = strdup("\xF0\x9F\x90\x9Dswarm is working...");
-                if (status.payload.text) {
-                    if (message_bus_push_outbound(&status) != ESP_OK) {
-                        ESP_LOGW(TAG, "Outbound queue full, drop working status");
-                        free(status.payload.text);
-                    } else {
-                        sent_working_status = true;
-                    }
-                }
+                push_reply(&msg, streaming ? "stream" : "text", turn_arena_escape(WORKING_STATUS_TEXT));
+                sent_working_status = true;
             }
 #endif
 
+            evt = turn_event("llm_request", &msg);
+            if (evt) {
+                cJSON_AddNumberToObject(evt, "iteration", iteration);
+                cJSON_AddNumberToObject(evt, "messages", cJSON_GetArraySize(messages));
+                ws_server_publish_event(evt);
+            }
+
             llm_response_t resp;
+            int64_t llm_start_us = esp_timer_get_time();
+            llm_calls++;
+            heap_tag_t heap_prev = heap_prof_scope_begin(HEAP_TAG_LLM);
             err = llm_chat_tools(system_prompt, messages, tools_json, &resp);
+            heap_prof_scope_end(heap_prev);
+            phase_end(AGENT_PHASE_LLM, llm_start_us);
 
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "LLM call failed: %s", esp_err_to_name(err));
+                llm_failed = true;
                 break;
             }
+            usage_in += resp.input_tokens;
+            usage_out += resp.output_tokens;
+
+            /* Non-streaming API: "first token" is the first response byte,
+             * the whole text block arrives as a single delta */
+            evt = turn_event("first_token", &msg);
+            if (evt) {
+                int64_t first_us = resp.first_byte_us ? resp.first_byte_us : esp_timer_get_time();
+                cJSON_AddNumberToObject(evt, "iteration", iteration);
+                cJSON_AddNumberToObject(evt, "ttfb_ms", (double)((first_us - llm_start_us) / 1000));
+                cJSON_AddNumberToObject(evt, "llm_ms",
+                                        (double)((esp_timer_get_time() - llm_start_us) / 1000));
+                ws_server_publish_event(evt);
+            }
+            if (resp.text && resp.text_len > 0) {
+                evt = turn_event("text_delta", &msg);
+                if (evt) {
+                    cJSON_AddNumberToObject(evt, "iteration", iteration);
+                    cJSON_AddStringToObject(evt, "text", resp.text);
+                    ws_server_publish_event(evt);
+                }
+            }
 
             if (!resp.tool_use) {
                 /* Normal completion — save final text and break */
                 if (resp.text && resp.text_len > 0) {
-                    final_text = strdup(resp.text);
+                    final_text = turn_arena_escape(resp.text);
                 }
                 llm_response_free(&resp);
                 break;
@@ -415,20 +652,73 @@ static void agent_loop_task(void *arg)
             cJSON_AddItemToArray(messages, asst_msg);
 
             /* Execute tools and append results */
-            cJSON *tool_results = build_tool_results(&resp, &msg, tool_output, TOOL_OUTPUT_SIZE);
+            phase_start = esp_timer_get_time();
+            cJSON *tool_results = build_tool_results(&resp, &msg, streaming ? progress : NULL,
+                                                     tool_output, TOOL_OUTPUT_SIZE);
+            phase_end(AGENT_PHASE_TOOLS, phase_start);
             cJSON *result_msg = cJSON_CreateObject();
             cJSON_AddStringToObject(result_msg, "role", "user");
             cJSON_AddItemToObject(result_msg, "content", tool_results);
             cJSON_AddItemToArray(messages, result_msg);
 
+            /* Show intermediate text and tool names in the placeholder */
+            if (streaming) {
+                if (resp.text && resp.text_len > 0) {
+                    progress_append(progress, PROGRESS_BUF_SIZE, "\n\n");
+                    progress_append(progress, PROGRESS_BUF_SIZE, resp.text);
+                }
+                progress_append(progress, PROGRESS_BUF_SIZE, "\n\xF0\x9F\x94\xA7");
+                for (int i = 0; i < resp.call_count; i++) {
+                    progress_append(progress, PROGRESS_BUF_SIZE, i ? ", " : " ");
+                    progress_append(progress, PROGRESS_BUF_SIZE, resp.calls[i].name);
+                }
+                push_reply(&msg, "stream", turn_arena_escape(progress));
+            }
+
             llm_response_free(&resp);
             iteration++;
         }
 
         cJSON_Delete(messages);
 
+        evt = turn_event("turn_end", &msg);
+        if (evt) {
+            cJSON_AddBoolToObject(evt, "ok", final_text && final_text[0]);
+            cJSON_AddNumberToObject(evt, "llm_calls", llm_calls);
+            cJSON_AddNumberToObject(evt, "tool_calls", tool_calls_total);
+            cJSON_AddNumberToObject(evt, "duration_ms",
+                                    (double)((esp_timer_get_time() - turn_start_us) / 1000));
+            cJSON *usage = cJSON_AddObjectToObject(evt, "usage");
+            cJSON_AddNumberToObject(usage, "input_tokens", usage_in);
+            cJSON_AddNumberToObject(usage, "output_tokens", usage_out);
+            ws_server_publish_event(evt);
+        }
+
         /* 5. Send response */
+        const char *final_type = streaming ? "stream_end" : "text";
+        bool deferred = false;
         if (final_text && final_text[0]) {
+            /* Save to session (only user text + final assistant text) */
+            phase_start = esp_timer_get_time();
+            esp_err_t save_user = session_append(msg.chat_id, "user", msg.payload.text);
+            esp_err_t save_asst = session_append(msg.chat_id, "assistant", final_text);
+            phase_end(AGENT_PHASE_SAVE, phase_start);
+            if (save_user != ESP_OK || save_asst != ESP_OK) {
+                ESP_LOGW(TAG, "Session save failed for chat %s (user=%s, assistant=%s)",
+                         msg.chat_id,
+                         esp_err_to_name(save_user),
+                         esp_err_to_name(save_asst));
+            } else {
+                ESP_LOGI(TAG, "Session saved for chat %s", msg.chat_id);
+            }
+
+            /* Push response to outbound (replaces the streamed placeholder) */
+            ESP_LOGI(TAG, "Queue final response to %s:%s (%d bytes)",
+                     msg.channel, msg.chat_id, (int)strlen(final_text));
+            push_reply(&msg, final_type, final_text);  /* transfer ownership */
+            final_text = NULL;
+
+            /* Tool summary goes after the answer so the placeholder stays on top */
             if (tool_calls_total > 0 &&
                 (strcmp(msg.channel, MIMI_CHAN_FEISHU) == 0 ||
                  strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0)) {
@@ -445,70 +735,45 @@ static void agent_loop_task(void *arg)
                     strncpy(tool_msg.channel, msg.channel, sizeof(tool_msg.channel) - 1);
                     strncpy(tool_msg.chat_id, msg.chat_id, sizeof(tool_msg.chat_id) - 1);
                     strncpy(tool_msg.type, "collapsible", sizeof(tool_msg.type) - 1);
-                    tool_msg.payload.collapsible.title = strdup(summary);
-                    tool_msg.payload.collapsible.body = strdup(tool_list);
+                    tool_msg.seq = msg.seq;
+                    tool_msg.payload.collapsible.title = turn_arena_escape(summary);
+                    tool_msg.payload.collapsible.body = turn_arena_escape(tool_list);
                     if (message_bus_push_outbound(&tool_msg) != ESP_OK) {
                         ESP_LOGW(TAG, "Outbound queue full, drop tool summary message");
                         mimi_msg_free(&tool_msg);
                     }
                 }
             }
-
-            /* Save to session (only user text + final assistant text) */
-            esp_err_t save_user = session_append(msg.chat_id, "user", msg.payload.text);
-            esp_err_t save_asst = session_append(msg.chat_id, "assistant", final_text);
-            if (save_user != ESP_OK || save_asst != ESP_OK) {
-                ESP_LOGW(TAG, "Session save failed for chat %s (user=%s, assistant=%s)",
-                         msg.chat_id,
-                         esp_err_to_name(save_user),
-                         esp_err_to_name(save_asst));
-            } else {
-                ESP_LOGI(TAG, "Session saved for chat %s", msg.chat_id);
-            }
-
-            /* Push response to outbound */
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            strncpy(out.type, "text", sizeof(out.type) - 1);
-            out.payload.text = final_text;  /* transfer ownership */
-            ESP_LOGI(TAG, "Queue final response to %s:%s (%d bytes)",
-                     out.channel, out.chat_id, (int)strlen(final_text));
-            if (message_bus_push_outbound(&out) != ESP_OK) {
-                ESP_LOGW(TAG, "Outbound queue full, drop final response");
-                free(final_text);
-            } else {
-                final_text = NULL;
-            }
         } else {
             /* Error or empty response */
             free(final_text);
-            mimi_msg_t out = {0};
-            strncpy(out.channel, msg.channel, sizeof(out.channel) - 1);
-            strncpy(out.chat_id, msg.chat_id, sizeof(out.chat_id) - 1);
-            strncpy(out.type, "text", sizeof(out.type) - 1);
-            out.payload.text = strdup("Sorry, I encountered an error.");
-            if (out.payload.text) {
-                if (message_bus_push_outbound(&out) != ESP_OK) {
-                    ESP_LOGW(TAG, "Outbound queue full, drop error response");
-                    free(out.payload.text);
-                }
+            if (llm_failed && !offline_queue_link_up() &&
+                offline_queue_defer(OFFLINE_INBOUND, &msg) == ESP_OK) {
+                /* The link dropped mid-turn: replay it later instead of an error reply */
+                ESP_LOGW(TAG, "Link lost, turn from %s:%s deferred", msg.channel, msg.chat_id);
+                deferred = true;
+            } else {
+                push_reply(&msg, final_type, turn_arena_escape("Sorry, I encountered an error."));
             }
         }
+        if (!deferred) {
+            offline_queue_settle(OFFLINE_INBOUND, &msg);    /* a replayed turn is done */
+        }
 
         /* Save source channel/chat_id for buddy notification config */
-        if (msg.channel[0] && strcmp(msg.channel, MIMI_CHAN_SYSTEM) != 0 && msg.chat_id[0]) {
-            nvs_handle_t nvs;
-            if (nvs_open(MIMI_NVS_FEATURE, NVS_READWRITE, &nvs) == ESP_OK) {
-                nvs_set_str(nvs, MIMI_NVS_KEY_LAST_SRC_CHANNEL, msg.channel);
-                nvs_set_str(nvs, MIMI_NVS_KEY_LAST_SRC_CHAT_ID, msg.chat_id);
-                nvs_commit(nvs);
-                nvs_close(nvs);
-            }
+        if (msg.channel[0] && strcmp(msg.channel, MIMI_CHAN_SYSTEM) != 0 &&
+            strcmp(msg.channel, MIMI_CHAN_OPENAI) != 0 &&
+            strcmp(msg.channel, MIMI_CHAN_BENCH) != 0 && msg.chat_id[0]) {
+            /* Registry write-behind: unchanged values cost nothing */
+            config_set_str(MIMI_NVS_FEATURE, MIMI_NVS_KEY_LAST_SRC_CHANNEL, msg.channel);
+            config_set_str(MIMI_NVS_FEATURE, MIMI_NVS_KEY_LAST_SRC_CHAT_ID, msg.chat_id);
         }
 
         /* Free inbound message content */
         mimi_msg_free(&msg);
+        turn_arena_end();
+        trace_end(&turn_span);
+        stats_turn_done(turn_start_us, llm_calls, tool_calls_total);
 
         /* Log memory status */
         ESP_LOGI(TAG, "Free PSRAM: %d bytes",
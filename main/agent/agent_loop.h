@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include "esp_err.h"
 
 /**
@@ -12,3 +13,27 @@ esp_err_t agent_loop_init(void);
  * Consumes from inbound queue, calls Claude API, pushes to outbound queue.
  */
 esp_err_t agent_loop_start(void);
+
+/* Turn phases, timed for tracing and for agent_loop_get_stats() */
+typedef enum {
+    AGENT_PHASE_CONTEXT = 0,    /* system prompt build */
+    AGENT_PHASE_HISTORY,        /* session history load + parse */
+    AGENT_PHASE_LLM,            /* LLM round trips */
+    AGENT_PHASE_TOOLS,          /* tool execution */
+    AGENT_PHASE_SAVE,           /* session append */
+    AGENT_PHASE_COUNT,
+} agent_phase_t;
+
+typedef struct {
+    uint32_t turns;             /* completed turns */
+    uint32_t llm_calls;
+    uint32_t tool_calls;
+    uint64_t turn_us;           /* total wall time in turns */
+    uint64_t phase_us[AGENT_PHASE_COUNT];
+} agent_stats_t;
+
+/**
+ * Cumulative counters since boot. Callers diff two snapshots to get the
+ * figures for an interval (see bench_run()).
+ */
+void agent_loop_get_stats(agent_stats_t *out);
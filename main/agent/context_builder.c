@@ -2,11 +2,11 @@
 #include "mimi_config.h"
 #include "memory/memory_store.h"
 #include "skills/skill_loader.h"
+#include "config/config_registry.h"
 
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
-#include "nvs.h"
 #include "cJSON.h"
 
 static const char *TAG = "context";
@@ -38,13 +38,9 @@ esp_err_t context_build_system_prompt(char *buf, size_t size)
     size_t off = 0;
 
     char identity_prompt[1024] = {0};
-    size_t id_len = sizeof(identity_prompt);
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_LLM, NVS_READONLY, &nvs) == ESP_OK) {
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_SYSTEM_PROMPT, identity_prompt, &id_len) != ESP_OK) {
-            identity_prompt[0] = '\0';
-        }
-        nvs_close(nvs);
+    if (config_get_str(MIMI_NVS_LLM, MIMI_NVS_KEY_SYSTEM_PROMPT,
+                       identity_prompt, sizeof(identity_prompt)) != ESP_OK) {
+        identity_prompt[0] = '\0';
     }
 
     const char *identity = identity_prompt[0] ? identity_prompt : DEFAULT_IDENTITY_PROMPT;
@@ -123,7 +119,7 @@ esp_err_t context_build_messages(const char *history_json, const char *user_mess
     if (json_str) {
         strncpy(buf, json_str, size - 1);
         buf[size - 1] = '\0';
-        free(json_str);
+        cJSON_free(json_str);
     } else {
         snprintf(buf, size, "[{\"role\":\"user\",\"content\":\"%s\"}]", user_message);
     }
@@ -0,0 +1,178 @@
+#include "turn_arena.h"
+#include "mimi_config.h"
+#include "metrics/metrics.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+
+static const char *TAG = "turn_arena";
+
+#define ARENA_ALIGN 8
+
+/* Blocks are only ever appended, so turn_arena_owns() can run from any task */
+static uint8_t *s_blocks[MIMI_TURN_ARENA_MAX_BLOCKS];
+static volatile int s_block_count = 0;
+
+/* Bump state, touched only by the owning task */
+static TaskHandle_t s_owner = NULL;
+static int s_cur = 0;               /* block being carved */
+static size_t s_used = 0;           /* bytes used in s_blocks[s_cur] */
+static uint32_t s_turn_fallbacks = 0;
+static uint64_t s_turn_fallback_bytes = 0;
+
+static turn_arena_stats_t s_stats = {0};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static metric_t *s_m_peak;
+static metric_t *s_m_blocks;
+static metric_t *s_m_fallbacks;
+
+static bool add_block(void)
+{
+    if (s_block_count >= MIMI_TURN_ARENA_MAX_BLOCKS) return false;
+    uint8_t *block = heap_caps_malloc(MIMI_TURN_ARENA_BLOCK_SIZE, MALLOC_CAP_SPIRAM);
+    if (!block) return false;
+    s_blocks[s_block_count] = block;
+    s_block_count++;
+    metric_set(s_m_blocks, s_block_count);
+    return true;
+}
+
+static inline bool in_turn(void)
+{
+    return s_owner && s_owner == xTaskGetCurrentTaskHandle();
+}
+
+/* ── Allocation ────────────────────────────────────────────── */
+
+void *turn_arena_alloc(size_t size)
+{
+    if (!in_turn()) return malloc(size);
+
+    size_t need = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (need == 0) need = ARENA_ALIGN;
+
+    if (need <= MIMI_TURN_ARENA_MAX_ALLOC) {
+        if (s_used + need > MIMI_TURN_ARENA_BLOCK_SIZE) {
+            if (s_cur + 1 < s_block_count || add_block()) {
+                s_cur++;
+                s_used = 0;
+            }
+        }
+        if (s_used + need <= MIMI_TURN_ARENA_BLOCK_SIZE) {
+            void *ptr = s_blocks[s_cur] + s_used;
+            s_used += need;
+            return ptr;
+        }
+    }
+
+    /* Oversized, or every block is full: this one comes from the heap */
+    s_turn_fallbacks++;
+    s_turn_fallback_bytes += size;
+    return malloc(size);
+}
+
+char *turn_arena_strdup(const char *s)
+{
+    if (!s) return NULL;
+    size_t len = strlen(s);
+    char *copy = turn_arena_alloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+bool turn_arena_owns(const void *ptr)
+{
+    const uint8_t *p = ptr;
+    int count = s_block_count;
+    for (int i = 0; i < count; i++) {
+        if (p >= s_blocks[i] && p < s_blocks[i] + MIMI_TURN_ARENA_BLOCK_SIZE) return true;
+    }
+    return false;
+}
+
+void turn_arena_free(void *ptr)
+{
+    if (!ptr || turn_arena_owns(ptr)) return;   /* arena memory goes at turn end */
+    free(ptr);
+}
+
+char *turn_arena_escape(const char *s)
+{
+    return s ? strdup(s) : NULL;
+}
+
+/* ── Turn lifecycle ────────────────────────────────────────── */
+
+void turn_arena_begin(void)
+{
+    s_cur = 0;
+    s_used = 0;
+    s_turn_fallbacks = 0;
+    s_turn_fallback_bytes = 0;
+    s_owner = s_block_count > 0 ? xTaskGetCurrentTaskHandle() : NULL;
+}
+
+void turn_arena_end(void)
+{
+    if (!s_owner) return;
+    s_owner = NULL;
+
+    uint32_t used = (uint32_t)(s_cur * MIMI_TURN_ARENA_BLOCK_SIZE + s_used);
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.turns++;
+    s_stats.blocks = s_block_count;
+    s_stats.last_bytes = used;
+    if (used > s_stats.peak_bytes) s_stats.peak_bytes = used;
+    s_stats.fallback_allocs += s_turn_fallbacks;
+    s_stats.fallback_bytes += s_turn_fallback_bytes;
+    uint32_t peak = s_stats.peak_bytes;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    metric_set(s_m_peak, (int32_t)peak);
+    metric_add(s_m_fallbacks, s_turn_fallbacks);
+
+    /* Everything carved this turn is released by rewinding */
+    s_cur = 0;
+    s_used = 0;
+}
+
+void turn_arena_get_stats(turn_arena_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    out->blocks = s_block_count;
+}
+
+/* ── Init ──────────────────────────────────────────────────── */
+
+esp_err_t turn_arena_init(void)
+{
+    if (s_block_count > 0) return ESP_OK;
+
+    s_m_peak = metrics_gauge("mimi_turn_arena_peak_bytes", "Largest per-turn arena use", NULL);
+    s_m_blocks = metrics_gauge("mimi_turn_arena_blocks", "Turn arena blocks allocated", NULL);
+    s_m_fallbacks = metrics_counter("mimi_turn_arena_fallbacks_total",
+                                    "In-turn allocations served by the heap", NULL);
+
+    if (!add_block()) {
+        ESP_LOGE(TAG, "No PSRAM for the turn arena");
+        return ESP_ERR_NO_MEM;
+    }
+
+    cJSON_Hooks hooks = {
+        .malloc_fn = turn_arena_alloc,
+        .free_fn = turn_arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+
+    ESP_LOGI(TAG, "Turn arena: %d KB blocks, up to %d", MIMI_TURN_ARENA_BLOCK_SIZE / 1024,
+             MIMI_TURN_ARENA_MAX_BLOCKS);
+    return ESP_OK;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Per-turn bump arena in PSRAM.
+ *
+ * Between turn_arena_begin() and turn_arena_end(), allocations made by the
+ * task that called begin (the agent loop) through cJSON or turn_arena_alloc()
+ * are carved from a few long-lived PSRAM blocks and released together at
+ * turn end, instead of churning the heap with thousands of short-lived
+ * nodes and strings. Other tasks, requests over MIMI_TURN_ARENA_MAX_ALLOC
+ * and allocations once every block is full fall through to the heap.
+ *
+ * Rules for code that runs inside a turn:
+ *   - free cJSON_Print*() output with cJSON_free(), and turn_arena_alloc()
+ *     memory with turn_arena_free(), never with free();
+ *   - anything that outlives the turn or crosses to another task (outbound
+ *     payloads, cached state) must come from turn_arena_escape() or plain
+ *     malloc/strdup, never from the arena or from a cJSON tree built in it.
+ */
+
+/**
+ * Allocate the first block and route cJSON allocations through the arena
+ * (cJSON_InitHooks). Call once, before other tasks start using cJSON.
+ */
+esp_err_t turn_arena_init(void);
+
+/** Start a turn: bind the arena to the calling task. */
+void turn_arena_begin(void);
+
+/** End the turn: unbind and reset every block in one step. */
+void turn_arena_end(void);
+
+/** Turn-scoped allocation (heap when called outside the owning turn). */
+void *turn_arena_alloc(size_t size);
+
+/** Turn-scoped copy of s. */
+char *turn_arena_strdup(const char *s);
+
+/** Release memory from turn_arena_alloc(): a no-op for arena memory. */
+void turn_arena_free(void *ptr);
+
+/** True if ptr lies inside an arena block. */
+bool turn_arena_owns(const void *ptr);
+
+/**
+ * Heap copy of s that survives turn_arena_end(); release with free().
+ * Use for outbound message payloads and anything handed to another task.
+ */
+char *turn_arena_escape(const char *s);
+
+typedef struct {
+    uint32_t turns;
+    uint32_t blocks;            /* blocks allocated (kept across turns) */
+    uint32_t last_bytes;        /* arena bytes used by the last turn */
+    uint32_t peak_bytes;        /* largest turn so far */
+    uint32_t fallback_allocs;   /* in-turn allocations served by the heap */
+    uint64_t fallback_bytes;
+} turn_arena_stats_t;
+
+void turn_arena_get_stats(turn_arena_stats_t *out);
@@ -0,0 +1,306 @@
+#include "bench.h"
+#include "mimi_config.h"
+#include "agent/agent_loop.h"
+#include "llm/llm_proxy.h"
+#include "memory/session_mgr.h"
+#include "heapprof/heap_prof.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "bench";
+
+#define BENCH_POLL_MS  200
+
+typedef struct {
+    char chat_id[16];
+    bool in_flight;
+    bool dead;              /* timed out: a late reply may still arrive */
+    int64_t start_us;
+} bench_slot_t;
+
+static bench_slot_t s_slots[MIMI_BENCH_MAX_CONCURRENCY];
+static int s_slot_count = 0;
+static uint32_t *s_lat_us = NULL;     /* completed turn latencies */
+static int s_lat_count = 0;
+static int s_lat_cap = 0;
+static SemaphoreHandle_t s_done = NULL;
+static bool s_running = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void bench_deliver(const mimi_msg_t *msg)
+{
+    if (strcmp(msg->type, "stream") == 0 || strcmp(msg->type, "collapsible") == 0) return;
+
+    int64_t now = esp_timer_get_time();
+    bool completed = false;
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; s_running && i < s_slot_count; i++) {
+        bench_slot_t *slot = &s_slots[i];
+        if (strcmp(slot->chat_id, msg->chat_id) != 0) continue;
+        if (slot->in_flight && !slot->dead) {
+            slot->in_flight = false;
+            if (s_lat_count < s_lat_cap) {
+                s_lat_us[s_lat_count++] = (uint32_t)(now - slot->start_us);
+            }
+            completed = true;
+        }
+        break;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (completed) xSemaphoreGive(s_done);
+}
+
+/* Queue one turn on a slot; false if the inbound queue stayed full */
+static bool issue_turn(bench_slot_t *slot, int seq)
+{
+    char text[96];
+    snprintf(text, sizeof(text), "Benchmark turn %d: what time is it?", seq);
+
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, MIMI_CHAN_BENCH, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, slot->chat_id, sizeof(msg.chat_id) - 1);
+    strncpy(msg.type, "text", sizeof(msg.type) - 1);
+
+    portENTER_CRITICAL(&s_lock);
+    slot->in_flight = true;
+    slot->start_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_lock);
+
+    for (int attempt = 0; attempt < 10; attempt++) {
+        msg.payload.text = strdup(text);
+        if (msg.payload.text && message_bus_push_inbound(&msg) == ESP_OK) return true;
+        free(msg.payload.text);
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    slot->in_flight = false;
+    portEXIT_CRITICAL(&s_lock);
+    return false;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_ms(const uint32_t *sorted, int n, int pct)
+{
+    if (n == 0) return 0;
+    return sorted[(n - 1) * pct / 100] / 1000.0;
+}
+
+static void clear_sessions(void)
+{
+    for (int i = 0; i < s_slot_count; i++) {
+        session_clear(s_slots[i].chat_id);
+    }
+}
+
+/* Live bytes per heap tag, both regions */
+static void heap_live(int64_t live[HEAP_TAG_COUNT])
+{
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        heap_tag_stats_t st;
+        heap_prof_get_tag((heap_tag_t)t, &st);
+        live[t] = (int64_t)st.live_bytes[0] + st.live_bytes[1];
+    }
+}
+
+/* ── Report ────────────────────────────────────────────────── */
+
+static char *build_report(int turns, int concurrency, int timeouts, int64_t duration_us,
+                          const agent_stats_t *a0, const agent_stats_t *a1,
+                          const llm_stats_t *l0, const llm_stats_t *l1,
+                          size_t min_internal, size_t min_psram, size_t largest_psram,
+                          const int64_t *heap0, const int64_t *heap1)
+{
+    static const char *phase_keys[AGENT_PHASE_COUNT] = {
+        "context", "history", "llm", "tools", "save",
+    };
+
+    int n = s_lat_count;
+    qsort(s_lat_us, n, sizeof(uint32_t), cmp_u32);
+    uint64_t sum = 0;
+    for (int i = 0; i < n; i++) sum += s_lat_us[i];
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "turns", turns);
+    cJSON_AddNumberToObject(root, "completed", n);
+    cJSON_AddNumberToObject(root, "timeouts", timeouts);
+    cJSON_AddNumberToObject(root, "concurrency", concurrency);
+    cJSON_AddNumberToObject(root, "duration_ms", (double)(duration_us / 1000));
+    cJSON_AddNumberToObject(root, "turns_per_s",
+                            duration_us > 0 ? n * 1000000.0 / duration_us : 0);
+
+    cJSON *lat = cJSON_AddObjectToObject(root, "latency_ms");
+    cJSON_AddNumberToObject(lat, "p50", percentile_ms(s_lat_us, n, 50));
+    cJSON_AddNumberToObject(lat, "p95", percentile_ms(s_lat_us, n, 95));
+    cJSON_AddNumberToObject(lat, "p99", percentile_ms(s_lat_us, n, 99));
+    cJSON_AddNumberToObject(lat, "max", n ? s_lat_us[n - 1] / 1000.0 : 0);
+    cJSON_AddNumberToObject(lat, "mean", n ? sum / 1000.0 / n : 0);
+
+    /* Agent counters cover every turn the loop finished during the run */
+    uint32_t agent_turns = a1->turns - a0->turns;
+    uint32_t div = agent_turns ? agent_turns : 1;
+    cJSON *phases = cJSON_AddObjectToObject(root, "phase_ms_per_turn");
+    for (int i = 0; i < AGENT_PHASE_COUNT; i++) {
+        cJSON_AddNumberToObject(phases, phase_keys[i],
+                                (double)(a1->phase_us[i] - a0->phase_us[i]) / 1000.0 / div);
+    }
+
+    cJSON *llm = cJSON_AddObjectToObject(root, "llm");
+    cJSON_AddNumberToObject(llm, "calls_per_turn", (double)(a1->llm_calls - a0->llm_calls) / div);
+    cJSON_AddNumberToObject(llm, "tool_calls_per_turn", (double)(a1->tool_calls - a0->tool_calls) / div);
+    cJSON_AddNumberToObject(llm, "requests", l1->requests - l0->requests);
+    cJSON_AddNumberToObject(llm, "errors", l1->errors - l0->errors);
+    cJSON_AddNumberToObject(llm, "req_bytes_per_turn", (double)(l1->req_bytes - l0->req_bytes) / div);
+    cJSON_AddNumberToObject(llm, "resp_bytes_per_turn", (double)(l1->resp_bytes - l0->resp_bytes) / div);
+    cJSON_AddStringToObject(llm, "provider", l1->provider);
+    cJSON_AddStringToObject(llm, "url", l1->url);
+
+    cJSON *heap = cJSON_AddObjectToObject(root, "heap_min_free");
+    cJSON_AddNumberToObject(heap, "internal", (double)min_internal);
+    cJSON_AddNumberToObject(heap, "psram", (double)min_psram);
+    cJSON_AddNumberToObject(root, "psram_largest_free_block", (double)largest_psram);
+
+    /* Growth that survived the run, by subsystem: non-zero after a warm run is a leak suspect */
+    if (heap_prof_is_enabled()) {
+        cJSON *delta = cJSON_AddObjectToObject(root, "heap_live_delta");
+        for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+            if (heap1[t] != heap0[t]) {
+                cJSON_AddNumberToObject(delta, heap_prof_tag_name((heap_tag_t)t),
+                                        (double)(heap1[t] - heap0[t]));
+            }
+        }
+    }
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return json_str;
+}
+
+/* ── Run ───────────────────────────────────────────────────── */
+
+esp_err_t bench_run(int turns, int concurrency, int timeout_ms, char **report_json)
+{
+    *report_json = NULL;
+    if (turns < 1 || turns > MIMI_BENCH_MAX_TURNS ||
+        concurrency < 1 || concurrency > MIMI_BENCH_MAX_CONCURRENCY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timeout_ms <= 0) timeout_ms = MIMI_BENCH_TURN_TIMEOUT_MS;
+    if (s_running) return ESP_ERR_INVALID_STATE;
+
+    if (!s_done) {
+        s_done = xSemaphoreCreateCounting(MIMI_BENCH_MAX_CONCURRENCY, 0);
+        if (!s_done) return ESP_ERR_NO_MEM;
+    }
+    s_lat_us = heap_caps_calloc(turns, sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+    if (!s_lat_us) return ESP_ERR_NO_MEM;
+    s_lat_cap = turns;
+    s_lat_count = 0;
+    while (xSemaphoreTake(s_done, 0) == pdTRUE) {}
+
+    memset(s_slots, 0, sizeof(s_slots));
+    s_slot_count = concurrency;
+    for (int i = 0; i < concurrency; i++) {
+        snprintf(s_slots[i].chat_id, sizeof(s_slots[i].chat_id), "bench_%d", i);
+    }
+    clear_sessions();
+
+    agent_stats_t a0, a1;
+    llm_stats_t l0, l1;
+    int64_t heap0[HEAP_TAG_COUNT], heap1[HEAP_TAG_COUNT];
+    agent_loop_get_stats(&a0);
+    llm_get_stats(&l0);
+    heap_live(heap0);
+#if !CONFIG_IDF_TARGET_LINUX
+    heap_caps_monitor_local_minimum_free_size_start();
+#endif
+
+    ESP_LOGI(TAG, "Running %d turns, concurrency %d", turns, concurrency);
+    s_running = true;
+    int64_t start_us = esp_timer_get_time();
+    int64_t timeout_us = (int64_t)timeout_ms * 1000;
+    int issued = 0, timeouts = 0, push_failures = 0;
+
+    while (1) {
+        /* Refill idle slots, then wait for a completion or the next poll */
+        int in_flight = 0;
+        for (int i = 0; i < concurrency; i++) {
+            bench_slot_t *slot = &s_slots[i];
+            if (slot->dead) continue;
+            if (!slot->in_flight && issued < turns) {
+                if (issue_turn(slot, issued)) {
+                    issued++;
+                } else {
+                    push_failures++;
+                    slot->dead = true;
+                    continue;
+                }
+            }
+            if (slot->in_flight) in_flight++;
+        }
+        if (in_flight == 0) break;
+
+        xSemaphoreTake(s_done, pdMS_TO_TICKS(BENCH_POLL_MS));
+
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&s_lock);
+        for (int i = 0; i < concurrency; i++) {
+            bench_slot_t *slot = &s_slots[i];
+            if (slot->in_flight && !slot->dead && now - slot->start_us > timeout_us) {
+                slot->dead = true;
+                timeouts++;
+            }
+        }
+        portEXIT_CRITICAL(&s_lock);
+    }
+
+    int64_t duration_us = esp_timer_get_time() - start_us;
+    portENTER_CRITICAL(&s_lock);
+    s_running = false;      /* late replies are ignored from here on */
+    portEXIT_CRITICAL(&s_lock);
+
+    /* Low-water marks over the run only (no heap regions on the host build) */
+    size_t min_internal = 0, min_psram = 0, largest_psram = 0;
+#if !CONFIG_IDF_TARGET_LINUX
+    largest_psram = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    min_internal = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    min_psram = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+    heap_caps_monitor_local_minimum_free_size_stop();
+#endif
+    agent_loop_get_stats(&a1);
+    llm_get_stats(&l1);
+
+    if (timeouts > 0 || push_failures > 0) {
+        ESP_LOGW(TAG, "%d turns timed out, %d could not be queued", timeouts, push_failures);
+    }
+    /* A timed-out turn may still be running; its session write can land after this */
+    clear_sessions();
+    heap_live(heap1);
+
+    *report_json = build_report(turns, concurrency, timeouts, duration_us,
+                                &a0, &a1, &l0, &l1, min_internal, min_psram, largest_psram,
+                                heap0, heap1);
+    free(s_lat_us);
+    s_lat_us = NULL;
+    s_lat_cap = 0;
+
+    if (!*report_json) return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Done: %s", *report_json);
+    return ESP_OK;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "esp_err.h"
+#include "bus/message_bus.h"
+
+/**
+ * Drive `turns` synthetic agent turns through the inbound bus and report
+ * end-to-end latency. Blocks until every turn finished or timed out.
+ *
+ * Turns run on channel "bench" with chat_ids bench_0..bench_<concurrency-1>;
+ * up to `concurrency` turns are queued at once, one per chat_id. Those
+ * sessions are cleared before and after the run. Latency is measured from
+ * the inbound push to the final outbound reply, so it includes queueing,
+ * context build, every LLM round trip, tools and the session save.
+ *
+ * Run it against the mock provider (llm_mock.h) to get stable numbers
+ * that isolate the device from provider and network variance.
+ *
+ * @param turns        number of turns, 1..MIMI_BENCH_MAX_TURNS
+ * @param concurrency  turns in flight, 1..MIMI_BENCH_MAX_CONCURRENCY
+ * @param timeout_ms   per-turn timeout, 0 for MIMI_BENCH_TURN_TIMEOUT_MS
+ * @param report_json  out: single-line JSON report, caller frees
+ */
+esp_err_t bench_run(int turns, int concurrency, int timeout_ms, char **report_json);
+
+/**
+ * Hand an outbound "bench" message to the running benchmark.
+ * In-progress snapshots are ignored; the final reply completes a turn.
+ */
+void bench_deliver(const mimi_msg_t *msg);
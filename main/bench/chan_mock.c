@@ -0,0 +1,354 @@
+#include "chan_mock.h"
+#include "mimi_config.h"
+#include "bus/message_bus.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "cJSON.h"
+
+static const char *TAG = "chan_mock";
+
+#define MOCK_POLL_MS    20
+
+static httpd_handle_t s_server = NULL;
+static SemaphoreHandle_t s_log_lock = NULL;
+static chan_mock_call_t *s_calls = NULL;    /* MIMI_CHAN_MOCK_MAX_CALLS, PSRAM */
+static int s_ncalls = 0;
+static uint32_t s_next_id = 0;
+
+/* ── Call log ──────────────────────────────────────────────── */
+
+static void log_reset(void)
+{
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    s_ncalls = 0;
+    xSemaphoreGive(s_log_lock);
+}
+
+static void log_call(chan_mock_op_t op, const char *chat_id, const char *message_id,
+                     const char *body)
+{
+    int64_t now = esp_timer_get_time();
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    if (s_ncalls < MIMI_CHAN_MOCK_MAX_CALLS) {
+        chan_mock_call_t *c = &s_calls[s_ncalls++];
+        memset(c, 0, sizeof(*c));
+        c->op = op;
+        c->t_us = now;
+        strncpy(c->chat_id, chat_id ? chat_id : "", sizeof(c->chat_id) - 1);
+        strncpy(c->message_id, message_id ? message_id : "", sizeof(c->message_id) - 1);
+        c->final = body && strstr(body, CHAN_MOCK_FINAL_MARK) != NULL;
+    }
+    xSemaphoreGive(s_log_lock);
+}
+
+int chan_mock_get_calls(chan_mock_call_t *out, int max)
+{
+    if (!s_log_lock) return 0;
+    xSemaphoreTake(s_log_lock, portMAX_DELAY);
+    int n = s_ncalls < max ? s_ncalls : max;
+    memcpy(out, s_calls, n * sizeof(*out));
+    xSemaphoreGive(s_log_lock);
+    return n;
+}
+
+/* ── Handlers ──────────────────────────────────────────────── */
+
+static char *read_body(httpd_req_t *req)
+{
+    if (req->content_len > MIMI_CHAN_MOCK_MAX_BODY) return NULL;
+
+    char *buf = malloc(req->content_len + 1);
+    if (!buf) return NULL;
+
+    size_t received = 0;
+    while (received < req->content_len) {
+        int n = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            free(buf);
+            return NULL;
+        }
+        received += n;
+    }
+    buf[received] = '\0';
+    return buf;
+}
+
+static esp_err_t send_json(httpd_req_t *req, const char *json)
+{
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, json);
+}
+
+/* Telegram chat_id / Feishu receive_id may be a string or a number */
+static void json_id(cJSON *root, const char *key, char *out, size_t out_size)
+{
+    cJSON *v = root ? cJSON_GetObjectItem(root, key) : NULL;
+    if (cJSON_IsString(v)) {
+        snprintf(out, out_size, "%s", v->valuestring);
+    } else if (cJSON_IsNumber(v)) {
+        snprintf(out, out_size, "%lld", (long long)v->valuedouble);
+    } else {
+        out[0] = '\0';
+    }
+}
+
+/* POST /bot<token>/<method> */
+static esp_err_t tg_handler(httpd_req_t *req)
+{
+    char *body = read_body(req);
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad body");
+        return ESP_FAIL;
+    }
+    const char *method = strrchr(req->uri, '/') + 1;
+    cJSON *root = cJSON_Parse(body);
+    char chat_id[48], message_id[48];
+    json_id(root, "chat_id", chat_id, sizeof(chat_id));
+    json_id(root, "message_id", message_id, sizeof(message_id));
+    cJSON_Delete(root);
+
+    char resp[96];
+    if (strncmp(method, "sendMessage", 11) == 0) {
+        snprintf(message_id, sizeof(message_id), "%u", (unsigned)++s_next_id);
+        log_call(CHAN_MOCK_SEND, chat_id, message_id, body);
+        snprintf(resp, sizeof(resp), "{\"ok\":true,\"result\":{\"message_id\":%s}}", message_id);
+    } else {
+        if (strncmp(method, "editMessageText", 15) == 0) {
+            log_call(CHAN_MOCK_EDIT, chat_id, message_id, body);
+        }
+        snprintf(resp, sizeof(resp), "{\"ok\":true,\"result\":true}");
+    }
+    free(body);
+    return send_json(req, resp);
+}
+
+/* POST /open-apis/...: tenant token, send (?receive_id_type=) or reply */
+static esp_err_t feishu_post_handler(httpd_req_t *req)
+{
+    if (strstr(req->uri, "/tenant_access_token/")) {
+        return send_json(req, "{\"code\":0,\"msg\":\"ok\","
+                              "\"tenant_access_token\":\"t-mock\",\"expire\":7200}");
+    }
+
+    char *body = read_body(req);
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad body");
+        return ESP_FAIL;
+    }
+    cJSON *root = cJSON_Parse(body);
+    char chat_id[48], message_id[48];
+    json_id(root, "receive_id", chat_id, sizeof(chat_id));
+    cJSON_Delete(root);
+
+    snprintf(message_id, sizeof(message_id), "om_mock_%u", (unsigned)++s_next_id);
+    log_call(CHAN_MOCK_SEND, chat_id, message_id, body);
+    free(body);
+
+    char resp[128];
+    snprintf(resp, sizeof(resp),
+             "{\"code\":0,\"msg\":\"success\",\"data\":{\"message_id\":\"%s\"}}", message_id);
+    return send_json(req, resp);
+}
+
+/* PATCH /open-apis/im/v1/messages/<id> */
+static esp_err_t feishu_patch_handler(httpd_req_t *req)
+{
+    char *body = read_body(req);
+    if (!body) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Bad body");
+        return ESP_FAIL;
+    }
+    char message_id[48];
+    snprintf(message_id, sizeof(message_id), "%s", strrchr(req->uri, '/') + 1);
+    char *query = strchr(message_id, '?');
+    if (query) *query = '\0';
+
+    log_call(CHAN_MOCK_EDIT, "", message_id, body);
+    free(body);
+    return send_json(req, "{\"code\":0,\"msg\":\"success\"}");
+}
+
+/* ── Server ────────────────────────────────────────────────── */
+
+esp_err_t chan_mock_start(void)
+{
+    if (!s_log_lock) {
+        s_log_lock = xSemaphoreCreateMutex();
+        s_calls = heap_caps_calloc(MIMI_CHAN_MOCK_MAX_CALLS, sizeof(*s_calls), MALLOC_CAP_SPIRAM);
+        if (!s_log_lock || !s_calls) return ESP_ERR_NO_MEM;
+    }
+    log_reset();
+    if (s_server) return ESP_OK;
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = MIMI_CHAN_MOCK_PORT;
+    config.ctrl_port = MIMI_CHAN_MOCK_PORT + 1;
+    config.stack_size = MIMI_CHAN_MOCK_STACK;
+    config.max_open_sockets = 3;
+    config.lru_purge_enable = true;
+    config.uri_match_fn = httpd_uri_match_wildcard;
+
+    esp_err_t ret = httpd_start(&s_server, &config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start mock server: %s", esp_err_to_name(ret));
+        s_server = NULL;
+        return ret;
+    }
+
+    httpd_uri_t tg_uri = {
+        .uri = "/bot*",
+        .method = HTTP_POST,
+        .handler = tg_handler,
+    };
+    httpd_register_uri_handler(s_server, &tg_uri);
+
+    httpd_uri_t feishu_post_uri = {
+        .uri = "/open-apis/*",
+        .method = HTTP_POST,
+        .handler = feishu_post_handler,
+    };
+    httpd_register_uri_handler(s_server, &feishu_post_uri);
+
+    httpd_uri_t feishu_patch_uri = {
+        .uri = "/open-apis/im/v1/messages/*",
+        .method = HTTP_PATCH,
+        .handler = feishu_patch_handler,
+    };
+    httpd_register_uri_handler(s_server, &feishu_patch_uri);
+
+    ESP_LOGI(TAG, "Mock chat APIs on port %d (/bot*, /open-apis/*)", MIMI_CHAN_MOCK_PORT);
+    return ESP_OK;
+}
+
+void chan_mock_stop(void)
+{
+    if (!s_server) return;
+    httpd_stop(s_server);
+    s_server = NULL;
+    ESP_LOGI(TAG, "Mock chat APIs stopped");
+}
+
+/* ── Stream benchmark ──────────────────────────────────────── */
+
+static esp_err_t push_outbound(const char *channel, const char *chat_id,
+                               const char *type, const char *text)
+{
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, channel, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
+    strncpy(msg.type, type, sizeof(msg.type) - 1);
+    msg.payload.text = strdup(text);
+    if (!msg.payload.text) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = message_bus_push_outbound(&msg);
+    if (err != ESP_OK) free(msg.payload.text);
+    return err;
+}
+
+esp_err_t chan_mock_stream_bench(const char *channel, int snapshots, int gap_ms,
+                                 char **report_json)
+{
+    *report_json = NULL;
+
+    int interval_ms;
+    const char *chat_a, *chat_b;
+    if (strcmp(channel, MIMI_CHAN_TELEGRAM) == 0) {
+        interval_ms = MIMI_TG_STREAM_EDIT_INTERVAL_MS;
+        chat_a = "1001";
+        chat_b = "1002";
+    } else if (strcmp(channel, MIMI_CHAN_FEISHU) == 0) {
+        interval_ms = MIMI_FEISHU_STREAM_EDIT_INTERVAL_MS;
+        chat_a = "oc_mock_stream_a";
+        chat_b = "oc_mock_stream_b";
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (snapshots < 0 || snapshots > MIMI_CHAN_MOCK_MAX_SNAPSHOTS || gap_ms < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_server) return ESP_ERR_INVALID_STATE;
+
+    chan_mock_call_t *calls = heap_caps_malloc(MIMI_CHAN_MOCK_MAX_CALLS * sizeof(*calls),
+                                               MALLOC_CAP_SPIRAM);
+    if (!calls) return ESP_ERR_NO_MEM;
+    log_reset();
+
+    /* The reply grows a line per snapshot, like an agent turn with tools */
+    char text[96];
+    for (int i = 0; i < snapshots; i++) {
+        snprintf(text, sizeof(text), "Working... step %d of %d", i + 1, snapshots);
+        push_outbound(channel, chat_a, "stream", text);
+        vTaskDelay(pdMS_TO_TICKS(gap_ms));
+    }
+    int64_t end_us = esp_timer_get_time();
+    push_outbound(channel, chat_a, "stream_end", "Done after every step. " CHAN_MOCK_FINAL_MARK);
+    push_outbound(channel, chat_b, "text", "Reply for another chat.");
+
+    /* Wait for chat A's final reply and chat B's message */
+    int n = 0;
+    int64_t final_us = -1, other_us = -1;
+    int64_t deadline = end_us + (int64_t)MIMI_CHAN_MOCK_WAIT_MS * 1000;
+    while (esp_timer_get_time() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(MOCK_POLL_MS));
+        n = chan_mock_get_calls(calls, MIMI_CHAN_MOCK_MAX_CALLS);
+        final_us = other_us = -1;
+        for (int i = 0; i < n; i++) {
+            if (calls[i].final && final_us < 0) final_us = calls[i].t_us;
+            if (calls[i].op == CHAN_MOCK_SEND && strcmp(calls[i].chat_id, chat_b) == 0 &&
+                other_us < 0) {
+                other_us = calls[i].t_us;
+            }
+        }
+        if (final_us >= 0 && other_us >= 0) break;
+    }
+
+    /* Chat A's placeholder, then every edit of it */
+    const char *a_id = NULL;
+    int sends = 0, edits = 0;
+    int64_t prev_us = -1, min_gap_us = -1;
+    for (int i = 0; i < n; i++) {
+        bool is_a;
+        if (calls[i].op == CHAN_MOCK_SEND) {
+            is_a = strcmp(calls[i].chat_id, chat_a) == 0;
+            if (is_a && !a_id) a_id = calls[i].message_id;
+            sends += is_a;
+        } else {
+            is_a = a_id && strcmp(calls[i].message_id, a_id) == 0;
+            edits += is_a;
+        }
+        if (!is_a) continue;
+        if (prev_us >= 0 && (min_gap_us < 0 || calls[i].t_us - prev_us < min_gap_us)) {
+            min_gap_us = calls[i].t_us - prev_us;
+        }
+        prev_us = calls[i].t_us;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "channel", channel);
+    cJSON_AddNumberToObject(root, "snapshots", snapshots);
+    cJSON_AddNumberToObject(root, "gap_ms", gap_ms);
+    cJSON_AddNumberToObject(root, "edit_interval_ms", interval_ms);
+    cJSON_AddNumberToObject(root, "sends", sends);
+    cJSON_AddNumberToObject(root, "edits", edits);
+    cJSON_AddNumberToObject(root, "min_edit_gap_ms", min_gap_us < 0 ? -1 : min_gap_us / 1000.0);
+    cJSON_AddNumberToObject(root, "final_after_end_ms",
+                            final_us < 0 ? -1 : (final_us - end_us) / 1000.0);
+    cJSON_AddNumberToObject(root, "other_after_end_ms",
+                            other_us < 0 ? -1 : (other_us - end_us) / 1000.0);
+    *report_json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    free(calls);
+
+    if (!*report_json) return ESP_ERR_NO_MEM;
+    return (final_us < 0 || other_us < 0) ? ESP_ERR_TIMEOUT : ESP_OK;
+}
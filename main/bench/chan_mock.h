@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Local stand-in for the chat APIs behind streamed replies, served on
+ * MIMI_CHAN_MOCK_PORT:
+ *
+ *   POST  /bot<token>/sendMessage                          Telegram
+ *   POST  /bot<token>/editMessageText                      Telegram
+ *   POST  /bot<token>/<other>                              Telegram, answers ok
+ *   POST  /open-apis/auth/v3/tenant_access_token/internal  Feishu token
+ *   POST  /open-apis/im/v1/messages[/<id>/reply]           Feishu send / reply
+ *   PATCH /open-apis/im/v1/messages/<id>                   Feishu card patch
+ *
+ * Point a channel at it with telegram_set_api_base("http://127.0.0.1:18784")
+ * or feishu_set_api_base("http://127.0.0.1:18784/open-apis"). Every send
+ * answers a fresh message id, and sends and edits are logged with their
+ * arrival time so edit pacing can be checked.
+ */
+
+#define CHAN_MOCK_FINAL_MARK  "mock-final-reply"
+
+typedef enum {
+    CHAN_MOCK_SEND,         /* sendMessage, or Feishu send / reply */
+    CHAN_MOCK_EDIT,         /* editMessageText, or Feishu patch */
+} chan_mock_op_t;
+
+typedef struct {
+    chan_mock_op_t op;
+    int64_t t_us;           /* esp_timer time the request arrived */
+    char chat_id[48];       /* Telegram chat_id / Feishu receive_id, "" on a patch */
+    char message_id[48];    /* message created or edited */
+    bool final;             /* body carried CHAN_MOCK_FINAL_MARK */
+} chan_mock_call_t;
+
+/** Start the mock server (no-op if running) and clear the call log. */
+esp_err_t chan_mock_start(void);
+
+/** Stop the mock server. */
+void chan_mock_stop(void);
+
+/**
+ * Copy the logged sends and edits, oldest first, up to max.
+ * Returns the number copied; the log keeps the first MIMI_CHAN_MOCK_MAX_CALLS.
+ */
+int chan_mock_get_calls(chan_mock_call_t *out, int max);
+
+/**
+ * Stream a reply to the mock through the outbound bus and time it.
+ *
+ * Pushes `snapshots` "stream" messages `gap_ms` apart to chat A, then its
+ * "stream_end" (text containing CHAN_MOCK_FINAL_MARK) and right behind it
+ * a plain message to chat B, and waits for both to reach the mock. The
+ * channel must already point at the mock and have credentials set.
+ *
+ * The single-line JSON report gives the placeholder sends and edits of
+ * chat A, the smallest gap between them next to the channel's edit
+ * interval, and how long after "stream_end" the final edit and chat B's
+ * message arrived (B first means the final was held without stalling the
+ * dispatcher).
+ *
+ * @param channel      MIMI_CHAN_TELEGRAM or MIMI_CHAN_FEISHU
+ * @param report_json  out: caller frees; also set on ESP_ERR_TIMEOUT, when
+ *                     either message had not arrived after MIMI_CHAN_MOCK_WAIT_MS
+ */
+esp_err_t chan_mock_stream_bench(const char *channel, int snapshots, int gap_ms,
+                                 char **report_json);
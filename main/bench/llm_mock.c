@@ -0,0 +1,348 @@
+#include "llm_mock.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "cJSON.h"
+
+static const char *TAG = "llm_mock";
+
+#define MOCK_MAX_REPLY_BYTES  (32 * 1024)
+#define MOCK_MAX_CHUNKS       64
+
+static httpd_handle_t s_server = NULL;
+static llm_mock_config_t s_cfg;
+static uint32_t s_requests = 0;
+static uint32_t s_errors = 0;
+static uint32_t s_call_seq = 0;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void llm_mock_default_config(llm_mock_config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->chunks = 1;
+    cfg->tool_rounds = 1;
+    cfg->reply_bytes = 256;
+    strncpy(cfg->tool_name, "get_current_time", sizeof(cfg->tool_name) - 1);
+    strncpy(cfg->tool_input, "{}", sizeof(cfg->tool_input) - 1);
+}
+
+/* ── Request parsing ───────────────────────────────────────── */
+
+static char *read_body(httpd_req_t *req)
+{
+    if (req->content_len == 0 || req->content_len > MIMI_LLM_MOCK_MAX_BODY) {
+        return NULL;
+    }
+
+    char *buf = heap_caps_malloc(req->content_len + 1, MALLOC_CAP_SPIRAM);
+    if (!buf) return NULL;
+
+    size_t received = 0;
+    while (received < req->content_len) {
+        int n = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            free(buf);
+            return NULL;
+        }
+        received += n;
+    }
+    buf[received] = '\0';
+    return buf;
+}
+
+/* Assistant tool calls already in the conversation = rounds answered so far */
+static int count_tool_rounds(cJSON *messages, bool anthropic)
+{
+    int rounds = 0;
+    cJSON *m;
+    cJSON_ArrayForEach(m, messages) {
+        cJSON *role = cJSON_GetObjectItem(m, "role");
+        if (!cJSON_IsString(role) || strcmp(role->valuestring, "assistant") != 0) continue;
+
+        if (!anthropic) {
+            if (cJSON_IsArray(cJSON_GetObjectItem(m, "tool_calls"))) rounds++;
+            continue;
+        }
+        cJSON *content = cJSON_GetObjectItem(m, "content");
+        cJSON *block;
+        cJSON_ArrayForEach(block, content) {
+            cJSON *type = cJSON_GetObjectItem(block, "type");
+            if (cJSON_IsString(type) && strcmp(type->valuestring, "tool_use") == 0) {
+                rounds++;
+                break;
+            }
+        }
+    }
+    return rounds;
+}
+
+/* ── Response building ─────────────────────────────────────── */
+
+static char *make_reply_text(uint32_t len)
+{
+    static const char pattern[] = "The quick brown fox jumps over the lazy dog. ";
+    if (len > MOCK_MAX_REPLY_BYTES) len = MOCK_MAX_REPLY_BYTES;
+    if (len == 0) len = 1;
+
+    char *text = heap_caps_malloc(len + 1, MALLOC_CAP_SPIRAM);
+    if (!text) return NULL;
+    for (uint32_t i = 0; i < len; i++) {
+        text[i] = pattern[i % (sizeof(pattern) - 1)];
+    }
+    text[len] = '\0';
+    return text;
+}
+
+static cJSON *anthropic_response(const llm_mock_config_t *cfg, bool tool_round,
+                                 const char *text, uint32_t seq)
+{
+    char id[32];
+    cJSON *root = cJSON_CreateObject();
+    snprintf(id, sizeof(id), "msg_mock_%lu", (unsigned long)seq);
+    cJSON_AddStringToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "type", "message");
+    cJSON_AddStringToObject(root, "role", "assistant");
+    cJSON_AddStringToObject(root, "model", "mock");
+
+    cJSON *content = cJSON_AddArrayToObject(root, "content");
+    cJSON *block = cJSON_CreateObject();
+    if (tool_round) {
+        snprintf(id, sizeof(id), "toolu_mock_%lu", (unsigned long)seq);
+        cJSON_AddStringToObject(block, "type", "tool_use");
+        cJSON_AddStringToObject(block, "id", id);
+        cJSON_AddStringToObject(block, "name", cfg->tool_name);
+        cJSON *input = cJSON_Parse(cfg->tool_input);
+        if (!cJSON_IsObject(input)) {
+            cJSON_Delete(input);
+            input = cJSON_CreateObject();
+        }
+        cJSON_AddItemToObject(block, "input", input);
+    } else {
+        cJSON_AddStringToObject(block, "type", "text");
+        cJSON_AddStringToObject(block, "text", text);
+    }
+    cJSON_AddItemToArray(content, block);
+    cJSON_AddStringToObject(root, "stop_reason", tool_round ? "tool_use" : "end_turn");
+
+    cJSON *usage = cJSON_AddObjectToObject(root, "usage");
+    cJSON_AddNumberToObject(usage, "input_tokens", 100);
+    cJSON_AddNumberToObject(usage, "output_tokens", tool_round ? 20 : (strlen(text) + 3) / 4);
+    return root;
+}
+
+static cJSON *openai_response(const llm_mock_config_t *cfg, bool tool_round,
+                              const char *text, uint32_t seq)
+{
+    char id[32];
+    cJSON *root = cJSON_CreateObject();
+    snprintf(id, sizeof(id), "chatcmpl-mock-%lu", (unsigned long)seq);
+    cJSON_AddStringToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "object", "chat.completion");
+    cJSON_AddStringToObject(root, "model", "mock");
+
+    cJSON *choices = cJSON_AddArrayToObject(root, "choices");
+    cJSON *choice = cJSON_CreateObject();
+    cJSON_AddNumberToObject(choice, "index", 0);
+    cJSON *message = cJSON_AddObjectToObject(choice, "message");
+    cJSON_AddStringToObject(message, "role", "assistant");
+    if (tool_round) {
+        cJSON_AddNullToObject(message, "content");
+        cJSON *calls = cJSON_AddArrayToObject(message, "tool_calls");
+        cJSON *call = cJSON_CreateObject();
+        snprintf(id, sizeof(id), "call_mock_%lu", (unsigned long)seq);
+        cJSON_AddStringToObject(call, "id", id);
+        cJSON_AddStringToObject(call, "type", "function");
+        cJSON *func = cJSON_AddObjectToObject(call, "function");
+        cJSON_AddStringToObject(func, "name", cfg->tool_name);
+        cJSON_AddStringToObject(func, "arguments", cfg->tool_input);
+        cJSON_AddItemToArray(calls, call);
+    } else {
+        cJSON_AddStringToObject(message, "content", text);
+    }
+    cJSON_AddStringToObject(choice, "finish_reason", tool_round ? "tool_calls" : "stop");
+    cJSON_AddItemToArray(choices, choice);
+
+    cJSON *usage = cJSON_AddObjectToObject(root, "usage");
+    cJSON_AddNumberToObject(usage, "prompt_tokens", 100);
+    cJSON_AddNumberToObject(usage, "completion_tokens", tool_round ? 20 : (strlen(text) + 3) / 4);
+    return root;
+}
+
+/* Send body as `chunks` chunked-encoding pieces spaced chunk_ms apart,
+ * approximating a provider that trickles its response */
+static void send_paced(httpd_req_t *req, const char *body, const llm_mock_config_t *cfg)
+{
+    size_t len = strlen(body);
+    uint32_t chunks = cfg->chunks ? cfg->chunks : 1;
+    if (chunks > MOCK_MAX_CHUNKS) chunks = MOCK_MAX_CHUNKS;
+    if (chunks > len) chunks = len ? len : 1;
+
+    size_t piece = (len + chunks - 1) / chunks;
+    for (size_t off = 0; off < len; off += piece) {
+        if (off > 0 && cfg->chunk_ms) vTaskDelay(pdMS_TO_TICKS(cfg->chunk_ms));
+        size_t n = len - off < piece ? len - off : piece;
+        if (httpd_resp_send_chunk(req, body + off, n) != ESP_OK) return;
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static void send_error(httpd_req_t *req, bool anthropic)
+{
+    httpd_resp_set_type(req, "application/json");
+    if (anthropic) {
+        httpd_resp_set_status(req, "529 Overloaded");
+        httpd_resp_sendstr(req, "{\"type\":\"error\",\"error\":{\"type\":\"overloaded_error\","
+                                "\"message\":\"mock: injected error\"}}");
+    } else {
+        httpd_resp_set_status(req, "429 Too Many Requests");
+        httpd_resp_sendstr(req, "{\"error\":{\"type\":\"rate_limit_error\","
+                                "\"message\":\"mock: injected error\"}}");
+    }
+}
+
+static esp_err_t handle_request(httpd_req_t *req, bool anthropic)
+{
+    llm_mock_config_t cfg;
+    portENTER_CRITICAL(&s_lock);
+    cfg = s_cfg;
+    uint32_t seq = ++s_call_seq;
+    s_requests++;
+    portEXIT_CRITICAL(&s_lock);
+
+    char *body = read_body(req);
+    cJSON *root = body ? cJSON_Parse(body) : NULL;
+    free(body);
+    cJSON *messages = root ? cJSON_GetObjectItem(root, "messages") : NULL;
+    if (!cJSON_IsArray(messages)) {
+        cJSON_Delete(root);
+        portENTER_CRITICAL(&s_lock);
+        s_errors++;
+        portEXIT_CRITICAL(&s_lock);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "messages array required");
+        return ESP_OK;
+    }
+    int rounds = count_tool_rounds(messages, anthropic);
+    cJSON_Delete(root);
+
+    if (cfg.latency_ms) vTaskDelay(pdMS_TO_TICKS(cfg.latency_ms));
+
+    if (cfg.error_pct && esp_random() % 100 < cfg.error_pct) {
+        portENTER_CRITICAL(&s_lock);
+        s_errors++;
+        portEXIT_CRITICAL(&s_lock);
+        send_error(req, anthropic);
+        return ESP_OK;
+    }
+
+    bool tool_round = (uint32_t)rounds < cfg.tool_rounds && cfg.tool_name[0];
+    char *text = tool_round ? NULL : make_reply_text(cfg.reply_bytes);
+    if (!tool_round && !text) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+        return ESP_OK;
+    }
+
+    cJSON *resp = anthropic ? anthropic_response(&cfg, tool_round, text, seq)
+                            : openai_response(&cfg, tool_round, text, seq);
+    free(text);
+    char *json_str = cJSON_PrintUnformatted(resp);
+    cJSON_Delete(resp);
+    if (!json_str) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "out of memory");
+        return ESP_OK;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    send_paced(req, json_str, &cfg);
+    free(json_str);
+    return ESP_OK;
+}
+
+static esp_err_t messages_handler(httpd_req_t *req)
+{
+    return handle_request(req, true);
+}
+
+static esp_err_t completions_handler(httpd_req_t *req)
+{
+    return handle_request(req, false);
+}
+
+/* ── Public API ────────────────────────────────────────────── */
+
+esp_err_t llm_mock_start(const llm_mock_config_t *cfg)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_cfg = *cfg;
+    s_cfg.tool_name[sizeof(s_cfg.tool_name) - 1] = '\0';
+    s_cfg.tool_input[sizeof(s_cfg.tool_input) - 1] = '\0';
+    if (s_cfg.error_pct > 100) s_cfg.error_pct = 100;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (s_server) {
+        ESP_LOGI(TAG, "Mock reconfigured");
+        return ESP_OK;
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = MIMI_LLM_MOCK_PORT;
+    config.ctrl_port = MIMI_LLM_MOCK_PORT + 1;
+    config.stack_size = MIMI_LLM_MOCK_STACK;
+    config.max_open_sockets = 3;
+    config.lru_purge_enable = true;
+
+    esp_err_t ret = httpd_start(&s_server, &config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start mock server: %s", esp_err_to_name(ret));
+        s_server = NULL;
+        return ret;
+    }
+
+    httpd_uri_t messages_uri = {
+        .uri = "/v1/messages",
+        .method = HTTP_POST,
+        .handler = messages_handler,
+    };
+    httpd_register_uri_handler(s_server, &messages_uri);
+
+    httpd_uri_t completions_uri = {
+        .uri = "/v1/chat/completions",
+        .method = HTTP_POST,
+        .handler = completions_handler,
+    };
+    httpd_register_uri_handler(s_server, &completions_uri);
+
+    portENTER_CRITICAL(&s_lock);
+    s_requests = 0;
+    s_errors = 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Mock LLM on port %d (/v1/messages, /v1/chat/completions)", MIMI_LLM_MOCK_PORT);
+    return ESP_OK;
+}
+
+void llm_mock_stop(void)
+{
+    if (!s_server) return;
+    httpd_stop(s_server);
+    s_server = NULL;
+    ESP_LOGI(TAG, "Mock LLM stopped");
+}
+
+bool llm_mock_get_status(llm_mock_config_t *cfg, uint32_t *requests, uint32_t *errors)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (cfg) *cfg = s_cfg;
+    if (requests) *requests = s_requests;
+    if (errors) *errors = s_errors;
+    portEXIT_CRITICAL(&s_lock);
+    return s_server != NULL;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Local stand-in for an LLM provider, served on MIMI_LLM_MOCK_PORT:
+ *
+ *   POST /v1/messages          Anthropic messages dialect
+ *   POST /v1/chat/completions  OpenAI chat completions dialect
+ *
+ * Point the agent at it with `set_api_url http://127.0.0.1:18782/v1/messages`
+ * (provider anthropic) or `.../v1/chat/completions` (provider openai).
+ *
+ * Each request answers with tool calls until the conversation already holds
+ * tool_rounds assistant tool calls, then with a final text reply, so one
+ * agent turn makes tool_rounds + 1 LLM calls. Responses are deterministic
+ * apart from injected errors.
+ */
+
+typedef struct {
+    uint32_t latency_ms;        /* delay before the response headers */
+    uint32_t chunks;            /* body sent in this many chunked-encoding pieces */
+    uint32_t chunk_ms;          /* delay between pieces */
+    uint32_t tool_rounds;       /* tool-call responses before the final text */
+    uint32_t error_pct;         /* 0-100: answer 529 (Anthropic) / 429 (OpenAI) */
+    uint32_t reply_bytes;       /* length of the final text reply */
+    char tool_name[32];         /* tool to call, must be registered */
+    char tool_input[128];       /* JSON input for the tool call */
+} llm_mock_config_t;
+
+/** Defaults: no delay, one chunk, one tool round (get_current_time), 256-byte reply. */
+void llm_mock_default_config(llm_mock_config_t *cfg);
+
+/**
+ * Start the mock server, or apply cfg to the running one.
+ */
+esp_err_t llm_mock_start(const llm_mock_config_t *cfg);
+
+/** Stop the mock server. */
+void llm_mock_stop(void);
+
+/**
+ * Running state, active config and request counters since start.
+ * Any pointer may be NULL.
+ */
+bool llm_mock_get_status(llm_mock_config_t *cfg, uint32_t *requests, uint32_t *errors);
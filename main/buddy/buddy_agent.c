@@ -8,6 +8,7 @@
 #include "bus/message_bus.h"
 #include "llm/llm_proxy.h"
 #include "wifi/wifi_manager.h"
+#include "config/config_registry.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -19,7 +20,6 @@
 #include "led_strip.h"
 #include "esp_timer.h"
 #include "esp_heap_caps.h"
-#include "nvs.h"
 
 static const char *TAG = "buddy_agent";
 
@@ -282,31 +282,17 @@ static void buddy_contact_task(void *arg)
             char notify_chat_id[96];
             strncpy(notify_channel, MIMI_CHAN_SYSTEM, sizeof(notify_channel) - 1);
             strncpy(notify_chat_id, "buddy", sizeof(notify_chat_id) - 1);
-            {
-                nvs_handle_t nvs;
-                if (nvs_open(MIMI_NVS_FEATURE, NVS_READONLY, &nvs) == ESP_OK) {
-                    size_t len = sizeof(notify_channel);
-                    esp_err_t ch_err = nvs_get_str(nvs, MIMI_NVS_KEY_BUDDY_NOTIFY_CHANNEL,
-                                                   notify_channel, &len);
-                    len = sizeof(notify_chat_id);
-                    esp_err_t id_err = nvs_get_str(nvs, MIMI_NVS_KEY_BUDDY_NOTIFY_CHAT_ID,
-                                                   notify_chat_id, &len);
-                    if (ch_err != ESP_OK) {
-                        len = sizeof(notify_channel);
-                        if (nvs_get_str(nvs, MIMI_NVS_KEY_LAST_SRC_CHANNEL,
-                                        notify_channel, &len) != ESP_OK) {
-                            strncpy(notify_channel, MIMI_CHAN_SYSTEM, sizeof(notify_channel) - 1);
-                        }
-                    }
-                    if (id_err != ESP_OK) {
-                        len = sizeof(notify_chat_id);
-                        if (nvs_get_str(nvs, MIMI_NVS_KEY_LAST_SRC_CHAT_ID,
-                                        notify_chat_id, &len) != ESP_OK) {
-                            strncpy(notify_chat_id, "buddy", sizeof(notify_chat_id) - 1);
-                        }
-                    }
-                    nvs_close(nvs);
-                }
+            notify_channel[sizeof(notify_channel) - 1] = '\0';
+            notify_chat_id[sizeof(notify_chat_id) - 1] = '\0';
+            if (config_get_str(MIMI_NVS_FEATURE, MIMI_NVS_KEY_BUDDY_NOTIFY_CHANNEL,
+                               notify_channel, sizeof(notify_channel)) != ESP_OK) {
+                config_get_str(MIMI_NVS_FEATURE, MIMI_NVS_KEY_LAST_SRC_CHANNEL,
+                               notify_channel, sizeof(notify_channel));
+            }
+            if (config_get_str(MIMI_NVS_FEATURE, MIMI_NVS_KEY_BUDDY_NOTIFY_CHAT_ID,
+                               notify_chat_id, sizeof(notify_chat_id)) != ESP_OK) {
+                config_get_str(MIMI_NVS_FEATURE, MIMI_NVS_KEY_LAST_SRC_CHAT_ID,
+                               notify_chat_id, sizeof(notify_chat_id));
             }
 
             mimi_msg_t sys_msg = {0};
@@ -1,75 +1,119 @@
 #include "message_bus.h"
 #include "mimi_config.h"
+#include "metrics/metrics.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include <string.h>
+#include <stdlib.h>
 
 static const char *TAG = "bus";
 
-static QueueHandle_t s_inbound_queue;
-static QueueHandle_t s_outbound_queue;
+/* Queue element: the message plus its enqueue time for wait metrics */
+typedef struct {
+    mimi_msg_t msg;
+    int64_t enqueued_us;
+} bus_item_t;
 
-esp_err_t message_bus_init(void)
+/* Per-direction queue and metrics (0 = inbound, 1 = outbound) */
+typedef struct {
+    QueueHandle_t queue;
+    metric_t *depth;
+    metric_t *wait_ms;
+    metric_t *drops;
+} bus_queue_t;
+
+static bus_queue_t s_queues[2];
+
+static void bus_collect(void)
 {
-    s_inbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
-    s_outbound_queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(mimi_msg_t));
+    for (int i = 0; i < 2; i++) {
+        metric_set(s_queues[i].depth, (int32_t)uxQueueMessagesWaiting(s_queues[i].queue));
+    }
+}
 
-    if (!s_inbound_queue || !s_outbound_queue) {
-        ESP_LOGE(TAG, "Failed to create message queues");
-        return ESP_ERR_NO_MEM;
+esp_err_t message_bus_init(void)
+{
+    static const char *labels[2] = { "queue=\"inbound\"", "queue=\"outbound\"" };
+    for (int i = 0; i < 2; i++) {
+        bus_queue_t *q = &s_queues[i];
+        q->queue = xQueueCreate(MIMI_BUS_QUEUE_LEN, sizeof(bus_item_t));
+        if (!q->queue) {
+            ESP_LOGE(TAG, "Failed to create message queues");
+            return ESP_ERR_NO_MEM;
+        }
+        q->depth = metrics_gauge("mimi_bus_depth", "Messages waiting in the queue", labels[i]);
+        q->wait_ms = metrics_histogram("mimi_bus_wait_ms", "Time from push to pop", labels[i],
+                                       METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+        q->drops = metrics_counter("mimi_bus_drops_total", "Messages dropped on a full queue", labels[i]);
     }
+    metrics_register_collector(bus_collect);
 
     ESP_LOGI(TAG, "Message bus initialized (queue depth %d)", MIMI_BUS_QUEUE_LEN);
     return ESP_OK;
 }
 
-esp_err_t message_bus_push_inbound(const mimi_msg_t *msg)
+static esp_err_t bus_push(bus_queue_t *q, const mimi_msg_t *msg)
 {
-    if (xQueueSend(s_inbound_queue, msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Inbound queue full, dropping message");
+    bus_item_t item = { .msg = *msg, .enqueued_us = esp_timer_get_time() };
+    if (xQueueSend(q->queue, &item, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        metric_inc(q->drops);
         return ESP_ERR_NO_MEM;
     }
     return ESP_OK;
 }
 
-esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms)
+static esp_err_t bus_pop(bus_queue_t *q, mimi_msg_t *msg, uint32_t timeout_ms)
 {
     TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    if (xQueueReceive(s_inbound_queue, msg, ticks) != pdTRUE) {
+    bus_item_t item;
+    if (xQueueReceive(q->queue, &item, ticks) != pdTRUE) {
         return ESP_ERR_TIMEOUT;
     }
+    *msg = item.msg;
+    metric_observe_since(q->wait_ms, item.enqueued_us);
     return ESP_OK;
 }
 
-esp_err_t message_bus_push_outbound(const mimi_msg_t *msg)
+esp_err_t message_bus_push_inbound(const mimi_msg_t *msg)
 {
-    if (xQueueSend(s_outbound_queue, msg, pdMS_TO_TICKS(1000)) != pdTRUE) {
-        ESP_LOGW(TAG, "Outbound queue full, dropping message");
+    if (bus_push(&s_queues[0], msg) != ESP_OK) {
+        ESP_LOGW(TAG, "Inbound queue full, dropping message");
         return ESP_ERR_NO_MEM;
     }
     return ESP_OK;
 }
 
-esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms)
+esp_err_t message_bus_push_inbound_wait(const mimi_msg_t *msg, uint32_t timeout_ms)
 {
+    bus_item_t item = { .msg = *msg, .enqueued_us = esp_timer_get_time() };
     TickType_t ticks = (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
-    if (xQueueReceive(s_outbound_queue, msg, ticks) != pdTRUE) {
-        return ESP_ERR_TIMEOUT;
+    return xQueueSend(s_queues[0].queue, &item, ticks) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t message_bus_pop_inbound(mimi_msg_t *msg, uint32_t timeout_ms)
+{
+    return bus_pop(&s_queues[0], msg, timeout_ms);
+}
+
+esp_err_t message_bus_push_outbound(const mimi_msg_t *msg)
+{
+    if (bus_push(&s_queues[1], msg) != ESP_OK) {
+        ESP_LOGW(TAG, "Outbound queue full, dropping message");
+        return ESP_ERR_NO_MEM;
     }
     return ESP_OK;
 }
 
+esp_err_t message_bus_pop_outbound(mimi_msg_t *msg, uint32_t timeout_ms)
+{
+    return bus_pop(&s_queues[1], msg, timeout_ms);
+}
+
 esp_err_t mimi_msg_free(mimi_msg_t *msg)
 {
     if (!msg) return ESP_OK;
 
-    if (strcmp(msg->type, "text") == 0) {
-
-        if (msg->payload.text) {
-            free(msg->payload.text);
-            msg->payload.text = NULL;
-        }
-
-    } else if (strcmp(msg->type, "collapsible") == 0) {
+    if (strcmp(msg->type, "collapsible") == 0) {
 
         if (msg->payload.collapsible.title) {
             free(msg->payload.collapsible.title);
@@ -80,7 +124,15 @@ esp_err_t mimi_msg_free(mimi_msg_t *msg)
             free(msg->payload.collapsible.body);
             msg->payload.collapsible.body = NULL;
         }
+
+    } else {
+
+        /* "text", "stream", "stream_end" (and untyped inbound) carry text */
+        if (msg->payload.text) {
+            free(msg->payload.text);
+            msg->payload.text = NULL;
+        }
     }
 
     return ESP_OK;
-}
\ No newline at end of file
+}
@@ -8,15 +8,28 @@
 #define MIMI_CHAN_TELEGRAM   "telegram"
 #define MIMI_CHAN_FEISHU     "feishu"
 #define MIMI_CHAN_WEBSOCKET  "websocket"
+#define MIMI_CHAN_OPENAI     "openai"
 
 #define MIMI_CHAN_CLI        "cli"
 #define MIMI_CHAN_SYSTEM     "system"
+#define MIMI_CHAN_BENCH      "bench"      /* synthetic turns from bench_run() */
+
+/*
+ * Channel send result: accepted but not delivered yet (a final stream edit
+ * held until the edit interval allows it). The channel reports the outcome
+ * with offline_queue_outbound_done() once it sends.
+ */
+#define MIMI_SEND_PENDING    ((esp_err_t)0x7d01)
 
 /* Message types on the bus */
 typedef struct {
     char channel[16];       /* "telegram", "websocket", "cli" */
     char chat_id[96];       /* Telegram/Feishu chat_id, open_id, or WS client id */
-    char type[16];          /* "text" or "collapsible" */
+    char type[16];          /* "text", "collapsible", or "stream" / "stream_end"
+                               (in-progress reply snapshot / final reply that
+                               replaces the streamed placeholder) */
+    uint32_t seq;           /* Request id set by the channel that admitted the
+                               turn and echoed on its replies; 0 if unused */
 
     union {
         char *text;   // TEXT / MARKDOWN
@@ -41,6 +54,14 @@ esp_err_t message_bus_init(void);
  */
 esp_err_t message_bus_push_inbound(const mimi_msg_t *msg);
 
+/**
+ * Push to the inbound queue, waiting up to timeout_ms for room.
+ * For callers that apply backpressure themselves: a full queue returns
+ * ESP_ERR_TIMEOUT without being logged or counted as a drop, and the
+ * caller keeps ownership of msg->content.
+ */
+esp_err_t message_bus_push_inbound_wait(const mimi_msg_t *msg, uint32_t timeout_ms);
+
 /**
  * Pop a message from the inbound queue (blocking).
  * Caller must free msg->content when done.
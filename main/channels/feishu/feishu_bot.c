@@ -1,36 +1,54 @@
 #include "feishu_bot.h"
+#include "feishu_card.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "offline/offline_queue.h"
 #include "proxy/http_proxy.h"
+#include "config/config_registry.h"
+#include "metrics/metrics.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_random.h"
 #include "esp_http_client.h"
 #include "esp_websocket_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_timer.h"
 #include "esp_event.h"
-#include "nvs.h"
 #include "cJSON.h"
 
 static const char *TAG = "feishu";
 
 /* ── Feishu API endpoints ──────────────────────────────────── */
 #define FEISHU_API_BASE         "https://open.feishu.cn/open-apis"
-#define FEISHU_AUTH_URL         FEISHU_API_BASE "/auth/v3/tenant_access_token/internal"
-#define FEISHU_SEND_MSG_URL     FEISHU_API_BASE "/im/v1/messages"
-#define FEISHU_REPLY_MSG_URL    FEISHU_API_BASE "/im/v1/messages/%s/reply"
+#define FEISHU_AUTH_PATH        "/auth/v3/tenant_access_token/internal"
+#define FEISHU_SEND_MSG_PATH    "/im/v1/messages"
+#define FEISHU_REPLY_MSG_PATH   "/im/v1/messages/%s/reply"
+#define FEISHU_PATCH_MSG_PATH   "/im/v1/messages/%s"
 #define FEISHU_WS_CONFIG_URL    "https://open.feishu.cn/callback/ws/endpoint"
 
 /* ── Credentials & token state ─────────────────────────────── */
 static char s_app_id[64] = MIMI_SECRET_FEISHU_APP_ID;
 static char s_app_secret[128] = MIMI_SECRET_FEISHU_APP_SECRET;
 static char s_tenant_token[512] = {0};
-static int64_t s_token_expire_time = 0;
+static int64_t s_token_expire_time = 0;     /* absolute expiry, seconds since boot */
+static char s_api_base[128] = FEISHU_API_BASE;  /* feishu_set_api_base() */
+
+/* Background token refresher. The send path only copies the current token
+ * under s_token_lock; it fetches inline only when no valid token exists. */
+static SemaphoreHandle_t s_token_lock = NULL;
+static TaskHandle_t s_token_task = NULL;
+static uint32_t s_token_refreshes = 0;
+static uint32_t s_token_failures = 0;
+static uint32_t s_token_waits = 0;
+static metric_t *s_m_token_fetches[2];     /* result ok / error */
+static metric_t *s_m_token_waits = NULL;
+static metric_t *s_m_token_expires = NULL;
 
 /* ── Feishu WebSocket state ────────────────────────────────── */
 static esp_websocket_client_handle_t s_ws_client = NULL;
@@ -309,18 +327,15 @@ static int ws_send_frame(const ws_frame_t *f, const uint8_t *payload, size_t pay
 }
 
 /* ── Get / refresh tenant access token ─────────────────────── */
-static esp_err_t feishu_get_tenant_token(void)
+
+/* Request a new tenant token. Does not touch the cached token. */
+static esp_err_t feishu_fetch_tenant_token(char *out, size_t out_size, int *out_expire_s)
 {
     if (s_app_id[0] == '\0' || s_app_secret[0] == '\0') {
         ESP_LOGW(TAG, "No Feishu credentials configured");
         return ESP_ERR_INVALID_STATE;
     }
 
-    int64_t now = esp_timer_get_time() / 1000000LL;
-    if (s_tenant_token[0] != '\0' && s_token_expire_time > now + 300) {
-        return ESP_OK;
-    }
-
     cJSON *body = cJSON_CreateObject();
     cJSON_AddStringToObject(body, "app_id", s_app_id);
     cJSON_AddStringToObject(body, "app_secret", s_app_secret);
@@ -331,8 +346,11 @@ static esp_err_t feishu_get_tenant_token(void)
     http_resp_t resp = { .buf = calloc(1, 2048), .len = 0, .cap = 2048 };
     if (!resp.buf) { free(json_str); return ESP_ERR_NO_MEM; }
 
+    char url[192];
+    snprintf(url, sizeof(url), "%s" FEISHU_AUTH_PATH, s_api_base);
+
     esp_http_client_config_t config = {
-        .url = FEISHU_AUTH_URL,
+        .url = url,
         .event_handler = http_event_handler,
         .user_data = &resp,
         .timeout_ms = 10000,
@@ -371,22 +389,116 @@ static esp_err_t feishu_get_tenant_token(void)
 
     cJSON *token = cJSON_GetObjectItem(root, "tenant_access_token");
     cJSON *expire = cJSON_GetObjectItem(root, "expire");
-
-    if (token && cJSON_IsString(token)) {
-        strncpy(s_tenant_token, token->valuestring, sizeof(s_tenant_token) - 1);
-        s_token_expire_time = now + (expire ? expire->valueint : 7200) - 300;
-        ESP_LOGI(TAG, "Got tenant access token (expires in %ds)",
-                 expire ? expire->valueint : 7200);
+    if (!token || !cJSON_IsString(token)) {
+        cJSON_Delete(root);
+        return ESP_FAIL;
     }
 
+    strncpy(out, token->valuestring, out_size - 1);
+    out[out_size - 1] = '\0';
+    *out_expire_s = cJSON_IsNumber(expire) ? expire->valueint : 7200;
     cJSON_Delete(root);
     return ESP_OK;
 }
 
+/*
+ * Fetch a token and swap it in. Until the swap the previous token stays in
+ * use by the send path (Feishu keeps it valid until its own expiry).
+ */
+static esp_err_t feishu_refresh_tenant_token(void)
+{
+    char token[sizeof(s_tenant_token)];
+    int expire_s = 0;
+    int64_t now = esp_timer_get_time() / 1000000LL;
+
+    esp_err_t err = feishu_fetch_tenant_token(token, sizeof(token), &expire_s);
+    if (err != ESP_OK) {
+        s_token_failures++;
+        metric_inc(s_m_token_fetches[1]);
+        return err;
+    }
+
+    xSemaphoreTake(s_token_lock, portMAX_DELAY);
+    memcpy(s_tenant_token, token, sizeof(s_tenant_token));
+    s_token_expire_time = now + expire_s;
+    xSemaphoreGive(s_token_lock);
+
+    s_token_refreshes++;
+    metric_inc(s_m_token_fetches[0]);
+    ESP_LOGI(TAG, "Got tenant access token (expires in %ds)", expire_s);
+    return ESP_OK;
+}
+
+/* Copy the cached token if it is still valid. Never blocks on the network. */
+static bool feishu_copy_tenant_token(char *out, size_t out_size)
+{
+    int64_t now = esp_timer_get_time() / 1000000LL;
+    bool ok = false;
+
+    xSemaphoreTake(s_token_lock, portMAX_DELAY);
+    if (s_tenant_token[0] != '\0' && s_token_expire_time > now + MIMI_FEISHU_TOKEN_MIN_VALID_S) {
+        strncpy(out, s_tenant_token, out_size - 1);
+        out[out_size - 1] = '\0';
+        ok = true;
+    }
+    xSemaphoreGive(s_token_lock);
+    return ok;
+}
+
+static esp_err_t feishu_get_tenant_token(char *out, size_t out_size)
+{
+    if (feishu_copy_tenant_token(out, out_size)) {
+        return ESP_OK;
+    }
+
+    /* No usable token (boot, refresher failing, credentials changed) */
+    s_token_waits++;
+    metric_inc(s_m_token_waits);
+    esp_err_t err = feishu_refresh_tenant_token();
+    if (err != ESP_OK) {
+        return err;
+    }
+    return feishu_copy_tenant_token(out, out_size) ? ESP_OK : ESP_FAIL;
+}
+
+static void feishu_token_task(void *arg)
+{
+    int backoff_s = MIMI_FEISHU_TOKEN_RETRY_MIN_S;
+
+    while (1) {
+        int64_t now = esp_timer_get_time() / 1000000LL;
+        xSemaphoreTake(s_token_lock, portMAX_DELAY);
+        int64_t expire = s_tenant_token[0] ? s_token_expire_time : 0;
+        xSemaphoreGive(s_token_lock);
+
+        /* Renew well before expiry, spread by jitter */
+        int64_t wait_s = expire - now - MIMI_FEISHU_TOKEN_REFRESH_MARGIN_S
+                         - (int64_t)(esp_random() % (MIMI_FEISHU_TOKEN_JITTER_S + 1));
+        if (wait_s > 0) {
+            /* Woken early by feishu_set_credentials() */
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_s * 1000));
+            continue;
+        }
+
+        if (feishu_refresh_tenant_token() == ESP_OK) {
+            backoff_s = MIMI_FEISHU_TOKEN_RETRY_MIN_S;
+            continue;
+        }
+
+        ESP_LOGW(TAG, "Token refresh failed, retry in %ds", backoff_s);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(backoff_s * 1000));
+        backoff_s *= 2;
+        if (backoff_s > MIMI_FEISHU_TOKEN_RETRY_MAX_S) {
+            backoff_s = MIMI_FEISHU_TOKEN_RETRY_MAX_S;
+        }
+    }
+}
+
 /* ── Feishu API call helper ────────────────────────────────── */
 static char *feishu_api_call(const char *url, const char *method, const char *post_data)
 {
-    if (feishu_get_tenant_token() != ESP_OK) return NULL;
+    char token[sizeof(s_tenant_token)];
+    if (feishu_get_tenant_token(token, sizeof(token)) != ESP_OK) return NULL;
 
     http_resp_t resp = { .buf = calloc(1, 4096), .len = 0, .cap = 4096 };
     if (!resp.buf) return NULL;
@@ -405,7 +517,7 @@ static char *feishu_api_call(const char *url, const char *method, const char *po
     if (!client) { free(resp.buf); return NULL; }
 
     char auth_header[600];
-    snprintf(auth_header, sizeof(auth_header), "Bearer %s", s_tenant_token);
+    snprintf(auth_header, sizeof(auth_header), "Bearer %s", token);
     esp_http_client_set_header(client, "Authorization", auth_header);
     esp_http_client_set_header(client, "Content-Type", "application/json; charset=utf-8");
 
@@ -414,6 +526,11 @@ static char *feishu_api_call(const char *url, const char *method, const char *po
         if (post_data) {
             esp_http_client_set_post_field(client, post_data, strlen(post_data));
         }
+    } else if (strcmp(method, "PATCH") == 0) {
+        esp_http_client_set_method(client, HTTP_METHOD_PATCH);
+        if (post_data) {
+            esp_http_client_set_post_field(client, post_data, strlen(post_data));
+        }
     }
 
     esp_err_t err = feishu_http_perform_locked(client);
@@ -800,22 +917,44 @@ static void handle_message_event(cJSON *event)
 
 /* ── Public API ────────────────────────────────────────────── */
 
+static void feishu_metrics_collect(void)
+{
+    feishu_token_stats_t st;
+    feishu_get_token_stats(&st);
+    metric_set(s_m_token_expires, st.expires_in_s);
+}
+
+static void feishu_metrics_init(void)
+{
+    s_m_token_fetches[0] = metrics_counter("mimi_feishu_token_fetches_total",
+                                           "Tenant token requests", "result=\"ok\"");
+    s_m_token_fetches[1] = metrics_counter("mimi_feishu_token_fetches_total",
+                                           "Tenant token requests", "result=\"error\"");
+    s_m_token_waits = metrics_counter("mimi_feishu_token_waits_total",
+                                      "Sends that had to fetch a token inline", NULL);
+    s_m_token_expires = metrics_gauge("mimi_feishu_token_expires_in_seconds",
+                                      "Remaining lifetime of the cached tenant token", NULL);
+    metrics_register_collector(feishu_metrics_collect);
+}
+
 esp_err_t feishu_bot_init(void)
 {
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_FEISHU, NVS_READONLY, &nvs) == ESP_OK) {
-        char tmp_id[64] = {0};
-        char tmp_secret[128] = {0};
-        size_t len_id = sizeof(tmp_id);
-        size_t len_secret = sizeof(tmp_secret);
-
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_FEISHU_APP_ID, tmp_id, &len_id) == ESP_OK && tmp_id[0]) {
-            strncpy(s_app_id, tmp_id, sizeof(s_app_id) - 1);
-        }
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_FEISHU_APP_SECRET, tmp_secret, &len_secret) == ESP_OK && tmp_secret[0]) {
-            strncpy(s_app_secret, tmp_secret, sizeof(s_app_secret) - 1);
-        }
-        nvs_close(nvs);
+    feishu_metrics_init();
+
+    char tmp_id[64] = {0};
+    char tmp_secret[128] = {0};
+    if (config_get_str(MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_ID, tmp_id, sizeof(tmp_id)) == ESP_OK &&
+        tmp_id[0]) {
+        strncpy(s_app_id, tmp_id, sizeof(s_app_id) - 1);
+    }
+    if (config_get_str(MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_SECRET, tmp_secret,
+                       sizeof(tmp_secret)) == ESP_OK && tmp_secret[0]) {
+        strncpy(s_app_secret, tmp_secret, sizeof(s_app_secret) - 1);
+    }
+
+    if (!s_token_lock) {
+        s_token_lock = xSemaphoreCreateMutex();
+        if (!s_token_lock) return ESP_ERR_NO_MEM;
     }
 
     if (s_app_id[0] && s_app_secret[0]) {
@@ -837,6 +976,15 @@ esp_err_t feishu_bot_start(void)
         ESP_LOGW(TAG, "Feishu WebSocket task already running");
         return ESP_OK;
     }
+    if (!s_token_task &&
+        xTaskCreatePinnedToCore(feishu_token_task, "feishu_tok",
+                                MIMI_FEISHU_TOKEN_STACK, NULL,
+                                MIMI_FEISHU_POLL_PRIO, &s_token_task,
+                                MIMI_FEISHU_POLL_CORE) != pdPASS) {
+        /* Not fatal: the send path falls back to inline refresh */
+        s_token_task = NULL;
+        ESP_LOGW(TAG, "Token refresher task not started");
+    }
     BaseType_t ok = xTaskCreatePinnedToCore(
         feishu_ws_task,
         "feishu_ws",
@@ -853,181 +1001,318 @@ esp_err_t feishu_bot_start(void)
     return ESP_OK;
 }
 
-/* Build Feishu interactive card content string (schema 2.0, markdown element).
- * Returns a heap-allocated JSON string; caller must free(). */
-static char *feishu_build_card_content_text(const char *text)
-{
-    cJSON *card = cJSON_CreateObject();
-    if (!card) return NULL;
-    cJSON_AddStringToObject(card, "schema", "2.0");
-    cJSON *body = cJSON_CreateObject();
-    cJSON *elements = cJSON_CreateArray();
-    cJSON *md = cJSON_CreateObject();
-    cJSON_AddStringToObject(md, "tag", "markdown");
-    cJSON_AddStringToObject(md, "content", text);
-    cJSON_AddItemToArray(elements, md);
-    cJSON_AddItemToObject(body, "elements", elements);
-    cJSON_AddItemToObject(card, "body", body);
-    char *card_str = cJSON_PrintUnformatted(card);
-    cJSON_Delete(card);
-    return card_str;
-}
+/* Request bodies for the IM API. Only the outbound task sends, so one
+ * reusable buffer serves every card. */
+static feishu_card_buf_t s_card = {0};
+static uint32_t s_card_builds = 0;
+static int64_t s_card_build_us = 0;
 
-
-// build json content for non-markdown cards (e.g. image messages) where the content is already a JSON string
-static char *feishu_build_card_content_collapsible(const char *title, const char *body)
+static void feishu_card_built(int64_t start_us)
 {
-    cJSON *card = cJSON_CreateObject();
-    if (!card) return NULL;
-    cJSON_AddStringToObject(card, "schema", "2.0");
-    cJSON *card_body = cJSON_CreateObject();
-    cJSON *elements = cJSON_CreateArray();
-    cJSON *panel = cJSON_CreateObject();
-    cJSON_AddStringToObject(panel, "tag", "collapsible_panel");
-    cJSON_AddBoolToObject(panel, "expanded", false);
-    cJSON *header = cJSON_CreateObject();
-    cJSON *title_obj = cJSON_CreateObject();
-    cJSON_AddStringToObject(title_obj, "tag", "plain_text");
-    cJSON_AddStringToObject(title_obj, "content", title);
-    cJSON_AddItemToObject(header, "title", title_obj);
-    cJSON_AddItemToObject(panel, "header", header);
-    cJSON *body_obj = cJSON_CreateObject();
-    cJSON_AddStringToObject(body_obj, "tag", "markdown");
-    cJSON_AddStringToObject(body_obj, "content", body);
-    cJSON *panel_elements = cJSON_CreateArray();
-    cJSON_AddItemToArray(panel_elements, body_obj);
-    cJSON_AddItemToObject(panel, "elements", panel_elements);
-    cJSON_AddItemToArray(elements, panel);
-    cJSON_AddItemToObject(card_body, "elements", elements);
-    cJSON_AddItemToObject(card, "body", card_body);
-    char *card_str = cJSON_PrintUnformatted(card);
-    cJSON_Delete(card);
-    return card_str;
+    s_card_builds++;
+    s_card_build_us += esp_timer_get_time() - start_us;
 }
 
-/* content string example 
+/* Check an IM API response ("code" == 0), optionally returning data.message_id.
+ * Takes ownership of resp. */
+static esp_err_t feishu_check_response(char *resp, const char *what,
+                                       char *out_msg_id, size_t out_size)
 {
-    "schema": "2.0",
-    "body": {
-        "elements": [
-            {
-                "tag": "collapsible_panel",
-                "expanded": false,
-                "header": {
-                    "title": {
-                        "tag": "plain_text",
-                        "content": "本次调用了 4 个工具"
-                    }
-                },
-                "elements": [
-                    {
-                        "tag": "markdown",
-                        "content": "## 调用的工具列表\\n\\n- search_tool\\n- calculator\\n- weather_api\\n- database_query"
-                    }
-                ]
+    if (!resp) {
+        ESP_LOGE(TAG, "HTTP send failed");
+        return ESP_FAIL;
+    }
+
+    esp_err_t ret = ESP_OK;
+    cJSON *root = cJSON_Parse(resp);
+    if (root) {
+        cJSON *code = cJSON_GetObjectItem(root, "code");
+        if (code && code->valueint != 0) {
+            cJSON *msg_json = cJSON_GetObjectItem(root, "msg");
+            ESP_LOGW(TAG, "%s failed: code=%d, msg=%s", what,
+                     code->valueint,
+                     msg_json ? msg_json->valuestring : "unknown");
+            ret = ESP_FAIL;
+        } else if (out_msg_id && out_size > 0) {
+            cJSON *data = cJSON_GetObjectItem(root, "data");
+            cJSON *mid = data ? cJSON_GetObjectItem(data, "message_id") : NULL;
+            if (cJSON_IsString(mid)) {
+                strncpy(out_msg_id, mid->valuestring, out_size - 1);
+                out_msg_id[out_size - 1] = '\0';
             }
-        ]
+        }
+        cJSON_Delete(root);
     }
+    free(resp);
+    return ret;
 }
-*/
 
-esp_err_t feishu_send_message(const mimi_msg_t *msg)
+/* Send an interactive card; body comes from feishu_card_*_body() with receive_id */
+static esp_err_t feishu_post_card(const char *chat_id, const char *body,
+                                  char *out_msg_id, size_t out_size)
 {
-    if (!msg) return ESP_ERR_INVALID_ARG;
-
-    if (s_app_id[0] == '\0' || s_app_secret[0] == '\0') {
-        ESP_LOGW(TAG, "Cannot send: no credentials configured");
-        return ESP_ERR_INVALID_STATE;
-    }
-
     /* Determine receive_id_type */
     const char *id_type = "chat_id";
-    if (strncmp(msg->chat_id, "ou_", 3) == 0) {
+    if (strncmp(chat_id, "ou_", 3) == 0) {
         id_type = "open_id";
     }
 
     char url[256];
-    snprintf(url, sizeof(url), "%s?receive_id_type=%s",
-             FEISHU_SEND_MSG_URL, id_type);
+    snprintf(url, sizeof(url), "%s" FEISHU_SEND_MSG_PATH "?receive_id_type=%s",
+             s_api_base, id_type);
+
+    char *resp = feishu_api_call(url, "POST", body);
+    return feishu_check_response(resp, "Send", out_msg_id, out_size);
+}
+
+/* Replace the card content of an already-sent message (body without receive_id/msg_type) */
+static esp_err_t feishu_patch_card(const char *message_id, const char *body)
+{
+    char url[256];
+    snprintf(url, sizeof(url), "%s" FEISHU_PATCH_MSG_PATH, s_api_base, message_id);
+
+    char *resp = feishu_api_call(url, "PATCH", body);
+    return feishu_check_response(resp, "Patch", NULL, 0);
+}
 
+/*
+ * Send text as markdown cards, split at MIMI_FEISHU_MAX_MSG_LEN. If
+ * edit_msg_id is set, the first chunk patches that card instead.
+ */
+static esp_err_t feishu_send_text(const char *chat_id, const char *text, const char *edit_msg_id)
+{
+    size_t text_len = strlen(text);
+    size_t offset = 0;
     int all_ok = 1;
 
-    /* =========================
-     * TEXT 类型（支持分片）
-     * ========================= */
-    if (strcmp(msg->type, "text") == 0) {
+    while (offset < text_len) {
 
-        if (!msg->payload.text) return ESP_ERR_INVALID_ARG;
+        size_t chunk = text_len - offset;
+        if (chunk > MIMI_FEISHU_MAX_MSG_LEN) {
+            chunk = MIMI_FEISHU_MAX_MSG_LEN;
+        }
 
-        size_t text_len = strlen(msg->payload.text);
-        size_t offset = 0;
+        bool patch = (offset == 0 && edit_msg_id && edit_msg_id[0]);
+        int64_t start_us = esp_timer_get_time();
+        const char *body = patch
+            ? feishu_card_text_body(&s_card, NULL, NULL, text + offset, chunk)
+            : feishu_card_text_body(&s_card, chat_id, "interactive", text + offset, chunk);
+        if (!body) {
+            ESP_LOGE(TAG, "Failed to build text card");
+            all_ok = 0;
+            offset += chunk;
+            continue;
+        }
+        feishu_card_built(start_us);
 
-        /* 👉 用静态 buffer，避免 malloc 碎片 */
-        static char segment[MIMI_FEISHU_MAX_MSG_LEN + 1];
+        esp_err_t err = patch ? feishu_patch_card(edit_msg_id, body)
+                              : feishu_post_card(chat_id, body, NULL, 0);
 
-        while (offset < text_len) {
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Sent text chunk (%d bytes)", (int)chunk);
+        } else {
+            all_ok = 0;
+        }
 
-            size_t chunk = text_len - offset;
-            if (chunk > MIMI_FEISHU_MAX_MSG_LEN) {
-                chunk = MIMI_FEISHU_MAX_MSG_LEN;
-            }
+        offset += chunk;
+    }
 
-            memcpy(segment, msg->payload.text + offset, chunk);
-            segment[chunk] = '\0';
+    return all_ok ? ESP_OK : ESP_FAIL;
+}
 
-            /* build card */
-            char *content_str = feishu_build_card_content_text(segment);
-            if (!content_str) {
-                ESP_LOGE(TAG, "Failed to build text card");
-                all_ok = 0;
-                offset += chunk;
-                continue;
-            }
+/* ── Progressive replies (placeholder card + message patch) ─── */
 
-            /* build request body */
-            cJSON *body = cJSON_CreateObject();
-            cJSON_AddStringToObject(body, "receive_id", msg->chat_id);
-            cJSON_AddStringToObject(body, "msg_type", "interactive");
-            cJSON_AddStringToObject(body, "content", content_str);
+typedef struct {
+    bool active;
+    char chat_id[96];
+    char message_id[64];    /* placeholder card being patched, "" = not sent yet */
+    int64_t last_edit_us;
+    char *pending;          /* newest snapshot not yet shown (coalesced) */
+    char *final;            /* final reply held until the next patch is allowed */
+} feishu_stream_t;
+
+static feishu_stream_t s_streams[MIMI_STREAM_MAX_CHATS];
+
+static void feishu_stream_release(feishu_stream_t *st)
+{
+    free(st->pending);
+    free(st->final);
+    memset(st, 0, sizeof(*st));
+}
 
-            free(content_str);  // ✅ build函数必须malloc
+/* Patch the held final reply into the placeholder card and end the stream */
+static esp_err_t feishu_stream_finish(feishu_stream_t *st)
+{
+    char chat_id[sizeof(st->chat_id)];
+    char message_id[sizeof(st->message_id)];
+    memcpy(chat_id, st->chat_id, sizeof(chat_id));
+    memcpy(message_id, st->message_id, sizeof(message_id));
+    char *text = st->final;
+    st->final = NULL;
+    feishu_stream_release(st);
+
+    esp_err_t err = feishu_send_text(chat_id, text, message_id);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Final reply to %s failed: %s", chat_id, esp_err_to_name(err));
+    }
 
-            char *json_str = cJSON_PrintUnformatted(body);
-            cJSON_Delete(body);
+    /* The dispatcher got MIMI_SEND_PENDING for it: settle (or journal) it here */
+    mimi_msg_t msg = { .payload.text = text };
+    strncpy(msg.channel, MIMI_CHAN_FEISHU, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
+    strncpy(msg.type, "stream_end", sizeof(msg.type) - 1);
+    offline_queue_outbound_done(&msg, err);
+    free(text);
+    return err;
+}
 
-            if (!json_str) {
-                ESP_LOGE(TAG, "JSON encode failed");
-                all_ok = 0;
-                offset += chunk;
-                continue;
+static feishu_stream_t *feishu_stream_get(const char *chat_id, bool create)
+{
+    feishu_stream_t *slot = NULL;
+    for (int i = 0; i < MIMI_STREAM_MAX_CHATS; i++) {
+        if (s_streams[i].active && strcmp(s_streams[i].chat_id, chat_id) == 0) {
+            return &s_streams[i];
+        }
+        if (!s_streams[i].active && !slot) {
+            slot = &s_streams[i];
+        }
+    }
+    if (!create) return NULL;
+
+    if (!slot) {
+        /* Evict the stream that has been quiet the longest */
+        slot = &s_streams[0];
+        for (int i = 1; i < MIMI_STREAM_MAX_CHATS; i++) {
+            if (s_streams[i].last_edit_us < slot->last_edit_us) {
+                slot = &s_streams[i];
             }
+        }
+        if (slot->final) {
+            feishu_stream_finish(slot);
+        } else {
+            feishu_stream_release(slot);
+        }
+    }
+    slot->active = true;
+    strncpy(slot->chat_id, chat_id, sizeof(slot->chat_id) - 1);
+    return slot;
+}
 
-            char *resp = feishu_api_call(url, "POST", json_str);
-            cJSON_free(json_str);   // ✅ 推荐
-
-            if (resp) {
-                cJSON *root = cJSON_Parse(resp);
-                if (root) {
-                    cJSON *code = cJSON_GetObjectItem(root, "code");
-                    if (code && code->valueint != 0) {
-                        cJSON *msg_json = cJSON_GetObjectItem(root, "msg");
-                        ESP_LOGW(TAG, "Send failed: code=%d, msg=%s",
-                                 code->valueint,
-                                 msg_json ? msg_json->valuestring : "unknown");
-                        all_ok = 0;
-                    } else {
-                        ESP_LOGI(TAG, "Sent text chunk (%d bytes)", (int)chunk);
-                    }
-                    cJSON_Delete(root);
-                }
-                free(resp);
-            } else {
-                ESP_LOGE(TAG, "HTTP send failed");
-                all_ok = 0;
+static void feishu_stream_show(feishu_stream_t *st, const char *text)
+{
+    bool patch = st->message_id[0] != '\0';
+    int64_t start_us = esp_timer_get_time();
+    const char *body = patch
+        ? feishu_card_text_body(&s_card, NULL, NULL, text, strlen(text))
+        : feishu_card_text_body(&s_card, st->chat_id, "interactive", text, strlen(text));
+    if (!body) return;
+    feishu_card_built(start_us);
+
+    if (patch) {
+        feishu_patch_card(st->message_id, body);
+    } else {
+        feishu_post_card(st->chat_id, body, st->message_id, sizeof(st->message_id));
+    }
+    st->last_edit_us = esp_timer_get_time();
+}
+
+static esp_err_t feishu_stream_update(const char *chat_id, const char *text)
+{
+    feishu_stream_t *st = feishu_stream_get(chat_id, true);
+    int64_t now = esp_timer_get_time();
+
+    if (st->message_id[0] &&
+        now - st->last_edit_us < (int64_t)MIMI_FEISHU_STREAM_EDIT_INTERVAL_MS * 1000) {
+        /* Too soon for another patch: keep only the newest snapshot */
+        char *dup = strdup(text);
+        if (!dup) return ESP_ERR_NO_MEM;
+        free(st->pending);
+        st->pending = dup;
+        return ESP_OK;
+    }
+
+    free(st->pending);
+    st->pending = NULL;
+    feishu_stream_show(st, text);
+    return st->message_id[0] ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t feishu_stream_end(const char *chat_id, const char *text)
+{
+    char message_id[64] = {0};
+    feishu_stream_t *st = feishu_stream_get(chat_id, false);
+    if (st) {
+        strncpy(message_id, st->message_id, sizeof(message_id) - 1);
+        if (message_id[0] && esp_timer_get_time() - st->last_edit_us <
+                             (int64_t)MIMI_FEISHU_STREAM_EDIT_INTERVAL_MS * 1000) {
+            /* Too soon for the last patch: hold it for feishu_stream_flush()
+             * rather than stall the outbound dispatcher */
+            char *dup = strdup(text);
+            if (dup) {
+                free(st->pending);
+                st->pending = NULL;
+                free(st->final);
+                st->final = dup;
+                return MIMI_SEND_PENDING;
             }
+        }
+        feishu_stream_release(st);
+    }
+    return feishu_send_text(chat_id, text, message_id);
+}
 
-            offset += chunk;
+void feishu_stream_flush(void)
+{
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < MIMI_STREAM_MAX_CHATS; i++) {
+        feishu_stream_t *st = &s_streams[i];
+        if (!st->active || (!st->pending && !st->final)) continue;
+        if (now - st->last_edit_us < (int64_t)MIMI_FEISHU_STREAM_EDIT_INTERVAL_MS * 1000) continue;
+
+        if (st->final) {
+            feishu_stream_finish(st);
+            continue;
         }
+        char *text = st->pending;
+        st->pending = NULL;
+        feishu_stream_show(st, text);
+        free(text);
+    }
+}
+
+esp_err_t feishu_send_message(const mimi_msg_t *msg)
+{
+    if (!msg) return ESP_ERR_INVALID_ARG;
+
+    if (s_app_id[0] == '\0' || s_app_secret[0] == '\0') {
+        ESP_LOGW(TAG, "Cannot send: no credentials configured");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* A held final reply goes out before anything newer for the same chat */
+    feishu_stream_t *st = feishu_stream_get(msg->chat_id, false);
+    if (st && st->final) {
+        feishu_stream_finish(st);
+    }
+
+    /* =========================
+     * TEXT 类型（支持分片）
+     * ========================= */
+    if (strcmp(msg->type, "text") == 0) {
+        if (!msg->payload.text) return ESP_ERR_INVALID_ARG;
+        return feishu_send_text(msg->chat_id, msg->payload.text, NULL);
+    }
+
+    /* =========================
+     * STREAM 类型（占位卡片 + 原地更新）
+     * ========================= */
+    else if (strcmp(msg->type, "stream") == 0) {
+        if (!msg->payload.text) return ESP_ERR_INVALID_ARG;
+        return feishu_stream_update(msg->chat_id, msg->payload.text);
+    }
+    else if (strcmp(msg->type, "stream_end") == 0) {
+        if (!msg->payload.text) return ESP_ERR_INVALID_ARG;
+        return feishu_stream_end(msg->chat_id, msg->payload.text);
     }
 
     /* =========================
@@ -1040,64 +1325,29 @@ esp_err_t feishu_send_message(const mimi_msg_t *msg)
             return ESP_ERR_INVALID_ARG;
         }
 
-        char *content_str =
-            feishu_build_card_content_collapsible(
-                msg->payload.collapsible.title,
-                msg->payload.collapsible.body);
+        int64_t start_us = esp_timer_get_time();
+        const char *body = feishu_card_collapsible_body(
+            &s_card, msg->chat_id, "interactive",
+            msg->payload.collapsible.title,
+            msg->payload.collapsible.body);
 
-        if (!content_str) {
+        if (!body) {
             ESP_LOGE(TAG, "Failed to build collapsible card");
             return ESP_FAIL;
         }
+        feishu_card_built(start_us);
 
-        cJSON *body = cJSON_CreateObject();
-        cJSON_AddStringToObject(body, "receive_id", msg->chat_id);
-        cJSON_AddStringToObject(body, "msg_type", "interactive");
-        cJSON_AddStringToObject(body, "content", content_str);
-
-        free(content_str);
-
-        char *json_str = cJSON_PrintUnformatted(body);
-        cJSON_Delete(body);
-
-        if (!json_str) {
-            ESP_LOGE(TAG, "JSON encode failed");
-            return ESP_FAIL;
-        }
-
-        char *resp = feishu_api_call(url, "POST", json_str);
-        cJSON_free(json_str);
-
-        if (resp) {
-            cJSON *root = cJSON_Parse(resp);
-            if (root) {
-                cJSON *code = cJSON_GetObjectItem(root, "code");
-                if (code && code->valueint != 0) {
-                    cJSON *msg_json = cJSON_GetObjectItem(root, "msg");
-                    ESP_LOGW(TAG, "Send failed: code=%d, msg=%s",
-                             code->valueint,
-                             msg_json ? msg_json->valuestring : "unknown");
-                    cJSON_Delete(root);
-                    free(resp);
-                    return ESP_FAIL;
-                } else {
-                    ESP_LOGI(TAG, "Sent collapsible message");
-                }
-                cJSON_Delete(root);
-            }
-            free(resp);
-        } else {
-            ESP_LOGE(TAG, "HTTP send failed");
-            return ESP_FAIL;
+        esp_err_t err = feishu_post_card(msg->chat_id, body, NULL, 0);
+        if (err == ESP_OK) {
+            ESP_LOGI(TAG, "Sent collapsible message");
         }
+        return err;
     }
 
     else {
         ESP_LOGE(TAG, "Unsupported message type: %s", msg->type);
         return ESP_ERR_NOT_SUPPORTED;
     }
-
-    return all_ok ? ESP_OK : ESP_FAIL;
 }
 
 esp_err_t feishu_reply_message(const mimi_msg_t *msg)
@@ -1107,30 +1357,24 @@ esp_err_t feishu_reply_message(const mimi_msg_t *msg)
     }
 
     char url[256];
-    snprintf(url, sizeof(url), FEISHU_REPLY_MSG_URL, msg->chat_id);
-
-    /* Build interactive card content (schema 2.0, markdown) */
-    char *content_str = NULL;
-    if (strcmp(msg->type, "text") == 0) {
-       content_str = feishu_build_card_content_text(msg->payload.text);
+    snprintf(url, sizeof(url), "%s" FEISHU_REPLY_MSG_PATH, s_api_base, msg->chat_id);
+
+    /* Build interactive card request body (schema 2.0, markdown) */
+    int64_t start_us = esp_timer_get_time();
+    const char *body = NULL;
+    if (strcmp(msg->type, "collapsible") != 0) {
+        body = feishu_card_text_body(&s_card, NULL, "interactive",
+                                     msg->payload.text, strlen(msg->payload.text));
     }
     else {
-        /* For non-text types, just put the raw content string (e.g. image URL) */
-        content_str = feishu_build_card_content_collapsible(msg->payload.collapsible.title, msg->payload.collapsible.body);
+        body = feishu_card_collapsible_body(&s_card, NULL, "interactive",
+                                            msg->payload.collapsible.title,
+                                            msg->payload.collapsible.body);
     }
-    if (!content_str) return ESP_ERR_NO_MEM;
-
-    cJSON *body = cJSON_CreateObject();
-    cJSON_AddStringToObject(body, "msg_type", "interactive");
-    cJSON_AddStringToObject(body, "content", content_str);
-    free(content_str);
-
-    char *json_str = cJSON_PrintUnformatted(body);
-    cJSON_Delete(body);
-    if (!json_str) return ESP_ERR_NO_MEM;
+    if (!body) return ESP_ERR_NO_MEM;
+    feishu_card_built(start_us);
 
-    char *resp = feishu_api_call(url, "POST", json_str);
-    free(json_str);
+    char *resp = feishu_api_call(url, "POST", body);
 
     esp_err_t ret = ESP_FAIL;
     if (resp) {
@@ -1154,20 +1398,58 @@ esp_err_t feishu_reply_message(const mimi_msg_t *msg)
 
 esp_err_t feishu_set_credentials(const char *app_id, const char *app_secret)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_FEISHU, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_FEISHU_APP_ID, app_id));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_FEISHU_APP_SECRET, app_secret));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_err_t err = config_set_str(MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_ID, app_id);
+    if (err == ESP_OK) err = config_set_str(MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_SECRET, app_secret);
+    if (err != ESP_OK) return err;
 
     strncpy(s_app_id, app_id, sizeof(s_app_id) - 1);
     strncpy(s_app_secret, app_secret, sizeof(s_app_secret) - 1);
 
     /* Clear cached token to force re-auth */
+    if (s_token_lock) xSemaphoreTake(s_token_lock, portMAX_DELAY);
     s_tenant_token[0] = '\0';
     s_token_expire_time = 0;
+    if (s_token_lock) xSemaphoreGive(s_token_lock);
+    if (s_token_task) {
+        xTaskNotifyGive(s_token_task);
+    }
 
     ESP_LOGI(TAG, "Feishu credentials saved");
     return ESP_OK;
 }
+
+esp_err_t feishu_set_api_base(const char *base)
+{
+    const char *b = (base && base[0]) ? base : FEISHU_API_BASE;
+    if (strlen(b) >= sizeof(s_api_base)) return ESP_ERR_INVALID_ARG;
+
+    /* A token from one endpoint is no good at the other */
+    if (s_token_lock) xSemaphoreTake(s_token_lock, portMAX_DELAY);
+    strcpy(s_api_base, b);
+    s_tenant_token[0] = '\0';
+    s_token_expire_time = 0;
+    if (s_token_lock) xSemaphoreGive(s_token_lock);
+    if (s_token_task) {
+        xTaskNotifyGive(s_token_task);
+    }
+
+    ESP_LOGI(TAG, "Feishu API base: %s", s_api_base);
+    return ESP_OK;
+}
+
+void feishu_get_token_stats(feishu_token_stats_t *out)
+{
+    if (!out) return;
+    int64_t now = esp_timer_get_time() / 1000000LL;
+    out->refreshes = s_token_refreshes;
+    out->failures = s_token_failures;
+    out->waits = s_token_waits;
+    out->expires_in_s = (s_tenant_token[0] && s_token_expire_time > now)
+                        ? (int32_t)(s_token_expire_time - now) : 0;
+}
+
+void feishu_get_card_stats(uint32_t *builds, uint32_t *avg_us)
+{
+    if (builds) *builds = s_card_builds;
+    if (avg_us) *avg_us = s_card_builds ? (uint32_t)(s_card_build_us / s_card_builds) : 0;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include "esp_err.h"
 #include "bus/message_bus.h"
 
@@ -17,12 +18,25 @@ esp_err_t feishu_bot_start(void);
 /**
  * Send a text message to a Feishu chat.
  * Automatically splits messages longer than MIMI_FEISHU_MAX_MSG_LEN chars.
+ * Type "stream" posts a placeholder card once and patches it in place
+ * (rate-limited, intermediate snapshots coalesced); "stream_end" writes
+ * the final reply into that card, or, if the last edit was too recent,
+ * holds it for the stream flush instead of waiting and returns
+ * MIMI_SEND_PENDING; the flush settles the journal once it is written.
  * @param chat_id  Feishu chat ID (open_id or chat_id)
  * @param msg_type Message type ("text" or "json")
  * @param text     Message text
  */
 esp_err_t feishu_send_message(const mimi_msg_t *msg);
 
+/**
+ * Patch coalesced "stream" snapshots, and final replies held back by
+ * "stream_end", whose edit interval has elapsed. Called by the outbound
+ * dispatcher when its queue is idle and after each message it sends.
+ * A held final reply is reported with offline_queue_outbound_done().
+ */
+void feishu_stream_flush(void);
+
 /**
  * Reply to a specific message in a Feishu chat.
  * @param message_id  The message_id to reply to
@@ -36,3 +50,28 @@ esp_err_t feishu_reply_message(const mimi_msg_t *msg);
  * @param app_secret Feishu App Secret
  */
 esp_err_t feishu_set_credentials(const char *app_id, const char *app_secret);
+
+/**
+ * Point the IM API (token, send, reply, patch) at another base URL, e.g.
+ * the local mock in bench/chan_mock.h; NULL or "" restores
+ * https://open.feishu.cn/open-apis. Not persisted; drops the cached token.
+ * The WebSocket endpoint is unaffected.
+ */
+esp_err_t feishu_set_api_base(const char *base);
+
+typedef struct {
+    uint32_t refreshes;     /* successful token fetches */
+    uint32_t failures;      /* failed token fetches */
+    uint32_t waits;         /* sends that had to fetch a token inline */
+    int32_t expires_in_s;   /* remaining lifetime of the cached token */
+} feishu_token_stats_t;
+
+/**
+ * Get tenant token refresher counters since boot.
+ */
+void feishu_get_token_stats(feishu_token_stats_t *out);
+
+/**
+ * Get card body builds since boot and their average build time (us).
+ */
+void feishu_get_card_stats(uint32_t *builds, uint32_t *avg_us);
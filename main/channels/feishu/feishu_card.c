@@ -0,0 +1,187 @@
+#include "feishu_card.h"
+
+#include <string.h>
+#include <stdio.h>
+#include "esp_heap_caps.h"
+
+#define CARD_BUF_INITIAL   (6 * 1024)
+
+/* ── Output buffer ─────────────────────────────────────────── */
+
+static bool buf_reserve(feishu_card_buf_t *b, size_t n)
+{
+    if (b->oom) return false;
+    if (b->len + n + 1 <= b->cap) return true;
+
+    size_t new_cap = b->cap ? b->cap : CARD_BUF_INITIAL;
+    while (new_cap < b->len + n + 1) {
+        new_cap *= 2;
+    }
+    char *tmp = heap_caps_realloc(b->buf, new_cap, MALLOC_CAP_SPIRAM);
+    if (!tmp) {
+        b->oom = true;
+        return false;
+    }
+    b->buf = tmp;
+    b->cap = new_cap;
+    return true;
+}
+
+static void buf_put(feishu_card_buf_t *b, const char *s, size_t n)
+{
+    if (!buf_reserve(b, n)) return;
+    memcpy(b->buf + b->len, s, n);
+    b->len += n;
+    b->buf[b->len] = '\0';
+}
+
+static void buf_str(feishu_card_buf_t *b, const char *s)
+{
+    buf_put(b, s, strlen(s));
+}
+
+/* ── JSON string escaping (same rules as cJSON's printer) ──── */
+
+/* Escape one byte as it would appear inside a JSON string. Returns the
+ * escape length, or 0 if the byte is copied verbatim. */
+static size_t json_escape_byte(unsigned char c, char out[7])
+{
+    switch (c) {
+    case '"':  memcpy(out, "\\\"", 2); return 2;
+    case '\\': memcpy(out, "\\\\", 2); return 2;
+    case '\b': memcpy(out, "\\b", 2); return 2;
+    case '\f': memcpy(out, "\\f", 2); return 2;
+    case '\n': memcpy(out, "\\n", 2); return 2;
+    case '\r': memcpy(out, "\\r", 2); return 2;
+    case '\t': memcpy(out, "\\t", 2); return 2;
+    default:
+        if (c < 32) {
+            snprintf(out, 7, "\\u%04x", c);
+            return 6;
+        }
+        return 0;
+    }
+}
+
+/*
+ * Append s escaped `levels` times (1 = request-level string, 2 = text
+ * inside the card string). Bytes that need no escaping are copied in runs.
+ */
+static void buf_escaped(feishu_card_buf_t *b, const char *s, size_t n, int levels)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++) {
+        char esc[7];
+        size_t elen = json_escape_byte((unsigned char)s[i], esc);
+        if (elen == 0) continue;
+
+        buf_put(b, s + run, i - run);
+        if (levels == 1) {
+            buf_put(b, esc, elen);
+        } else {
+            /* The first-level escape is printable ASCII: only '\\' and '"' change */
+            for (size_t k = 0; k < elen; k++) {
+                if (esc[k] == '\\' || esc[k] == '"') buf_put(b, "\\", 1);
+                buf_put(b, &esc[k], 1);
+            }
+        }
+        run = i + 1;
+    }
+    buf_put(b, s + run, n - run);
+}
+
+/* Card JSON fragment: lives inside the "content" string, so escaped once */
+static void card_literal(feishu_card_buf_t *b, const char *s)
+{
+    buf_escaped(b, s, strlen(s), 1);
+}
+
+/* User text inside a card string value: escaped twice */
+static void card_text(feishu_card_buf_t *b, const char *s, size_t n)
+{
+    buf_escaped(b, s, n, 2);
+}
+
+/* Request fields before the card, up to the opening quote of "content" */
+static void body_begin(feishu_card_buf_t *b, const char *receive_id, const char *msg_type)
+{
+    b->len = 0;
+    b->oom = false;
+    buf_str(b, "{");
+    if (receive_id) {
+        buf_str(b, "\"receive_id\":\"");
+        buf_escaped(b, receive_id, strlen(receive_id), 1);
+        buf_str(b, "\",");
+    }
+    if (msg_type) {
+        buf_str(b, "\"msg_type\":\"");
+        buf_escaped(b, msg_type, strlen(msg_type), 1);
+        buf_str(b, "\",");
+    }
+    buf_str(b, "\"content\":\"");
+}
+
+static const char *body_end(feishu_card_buf_t *b)
+{
+    buf_str(b, "\"}");
+    return b->oom ? NULL : b->buf;
+}
+
+/* ── Public API ────────────────────────────────────────────── */
+
+const char *feishu_card_text_body(feishu_card_buf_t *b, const char *receive_id,
+                                  const char *msg_type, const char *text, size_t len)
+{
+    body_begin(b, receive_id, msg_type);
+    card_literal(b, "{\"schema\":\"2.0\",\"body\":{\"elements\":["
+                    "{\"tag\":\"markdown\",\"content\":\"");
+    card_text(b, text, len);
+    card_literal(b, "\"}]}}");
+    return body_end(b);
+}
+
+/* content string example
+{
+    "schema": "2.0",
+    "body": {
+        "elements": [
+            {
+                "tag": "collapsible_panel",
+                "expanded": false,
+                "header": {
+                    "title": {
+                        "tag": "plain_text",
+                        "content": "本次调用了 4 个工具"
+                    }
+                },
+                "elements": [
+                    {
+                        "tag": "markdown",
+                        "content": "## 调用的工具列表\\n\\n- search_tool\\n- calculator\\n- weather_api\\n- database_query"
+                    }
+                ]
+            }
+        ]
+    }
+}
+*/
+const char *feishu_card_collapsible_body(feishu_card_buf_t *b, const char *receive_id,
+                                         const char *msg_type, const char *title,
+                                         const char *body)
+{
+    body_begin(b, receive_id, msg_type);
+    card_literal(b, "{\"schema\":\"2.0\",\"body\":{\"elements\":["
+                    "{\"tag\":\"collapsible_panel\",\"expanded\":false,"
+                    "\"header\":{\"title\":{\"tag\":\"plain_text\",\"content\":\"");
+    card_text(b, title, strlen(title));
+    card_literal(b, "\"}},\"elements\":[{\"tag\":\"markdown\",\"content\":\"");
+    card_text(b, body, strlen(body));
+    card_literal(b, "\"}]}]}}");
+    return body_end(b);
+}
+
+void feishu_card_buf_free(feishu_card_buf_t *b)
+{
+    heap_caps_free(b->buf);
+    memset(b, 0, sizeof(*b));
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Single-pass writer for Feishu interactive card request bodies.
+ *
+ * The IM API wants the card JSON as an escaped string inside the request
+ * JSON ("content"). Instead of printing the card with cJSON and then
+ * printing it again as a string field, the writer emits the final request
+ * body directly, escaping user text twice on the fly. Output is
+ * byte-identical to the cJSON two-pass encoding.
+ *
+ * The buffer is kept between calls and only grows, so steady-state sends
+ * do not touch the heap.
+ */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool oom;
+} feishu_card_buf_t;
+
+/**
+ * Build a markdown card request body.
+ *
+ * @param b           Reusable output buffer (zero-initialised before first use)
+ * @param receive_id  Adds "receive_id" (send API); NULL to omit
+ * @param msg_type    Adds "msg_type" (send/reply API); NULL to omit (patch API)
+ * @param text        Markdown text (need not be NUL-terminated)
+ * @param len         Number of bytes of text
+ * @return b->buf on success, NULL on OOM
+ */
+const char *feishu_card_text_body(feishu_card_buf_t *b, const char *receive_id,
+                                  const char *msg_type, const char *text, size_t len);
+
+/**
+ * Build a collapsed panel card request body (plain-text title, markdown body).
+ * Parameters as for feishu_card_text_body().
+ */
+const char *feishu_card_collapsible_body(feishu_card_buf_t *b, const char *receive_id,
+                                         const char *msg_type, const char *title,
+                                         const char *body);
+
+/**
+ * Release the buffer memory.
+ */
+void feishu_card_buf_free(feishu_card_buf_t *b);
@@ -1,17 +1,30 @@
 #include "telegram_bot.h"
+#include "telegram_markdown.h"
 #include "mimi_config.h"
 #include "bus/message_bus.h"
+#include "offline/offline_queue.h"
 #include "proxy/http_proxy.h"
+#include "metrics/metrics.h"
+#include "config/config_registry.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "esp_http_client.h"
+#include "esp_http_server.h"
 #include "esp_crt_bundle.h"
-#include "nvs.h"
+#include "esp_random.h"
 #include "cJSON.h"
+#if CONFIG_ESP_HTTPS_SERVER_ENABLE
+#include "esp_https_server.h"
+#endif
 
 static const char *TAG = "telegram";
 
@@ -20,14 +33,57 @@ static int64_t s_update_offset = 0;
 static int64_t s_last_saved_offset = -1;
 static int64_t s_last_offset_save_us = 0;
 
+#define TG_API_BASE                  "https://api.telegram.org"
 #define TG_OFFSET_NVS_KEY            "update_offset"
+#define TG_WEBHOOK_URL_NVS_KEY       "webhook_url"
+#define TG_WEBHOOK_SECRET_NVS_KEY    "webhook_secret"
+#define TG_WEBHOOK_SECRET_HDR        "X-Telegram-Bot-Api-Secret-Token"
+#define TG_WEBHOOK_REGISTER_RETRY_MS 10000
 #define TG_DEDUP_CACHE_SIZE          64
 #define TG_OFFSET_SAVE_INTERVAL_US   (5LL * 1000 * 1000)
 #define TG_OFFSET_SAVE_STEP          10
 
+static char s_api_base[128] = TG_API_BASE;    /* telegram_set_api_base() */
+
 static uint64_t s_seen_msg_keys[TG_DEDUP_CACHE_SIZE] = {0};
 static size_t s_seen_msg_idx = 0;
 
+/* Webhook mode: public URL registered with setWebhook, and the shared secret
+ * Telegram echoes back in every request header. Empty URL = long polling. */
+static char s_webhook_url[256] = MIMI_SECRET_TG_WEBHOOK_URL;
+static char s_webhook_secret[65] = {0};
+static httpd_handle_t s_webhook_server = NULL;
+
+/* Webhook ingest counters; latency is handler entry -> inbound bus push */
+static uint32_t s_hook_updates = 0;
+static uint32_t s_hook_rejected = 0;
+static uint32_t s_hook_retried = 0;
+static int64_t s_hook_lat_last_us = 0;
+static int64_t s_hook_lat_max_us = 0;
+static int64_t s_hook_lat_sum_us = 0;
+
+typedef enum {
+    TG_INGEST_IGNORED = 0,      /* not a text message, stale or a duplicate */
+    TG_INGEST_PUSHED,
+    TG_INGEST_RETRY,            /* not taken (bus full, no memory): deliver it again */
+} tg_ingest_t;
+
+/*
+ * Replay harness (telegram_replay_bench) only: passed in place of the bus,
+ * it gets the push time of each message, and the update offset and
+ * duplicate filter are left alone
+ */
+typedef struct {
+    int64_t *pushed_us;
+    int npushed;
+    int cap;
+} tg_replay_sink_t;
+
+/* Send counters: chunks attempted, and chunks that needed the plain-text retry */
+static uint32_t s_chunks_sent = 0;
+static uint32_t s_fallback_sends = 0;
+static metric_t *s_fallback_metric = NULL;
+
 /* HTTP response accumulator */
 typedef struct {
     char *buf;
@@ -92,18 +148,10 @@ static void save_update_offset_if_needed(bool force)
         return;
     }
 
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_TG, NVS_READWRITE, &nvs) != ESP_OK) {
-        return;
+    if (config_set_i64(MIMI_NVS_TG, TG_OFFSET_NVS_KEY, s_update_offset) == ESP_OK) {
+        s_last_saved_offset = s_update_offset;
+        s_last_offset_save_us = now;
     }
-
-    if (nvs_set_i64(nvs, TG_OFFSET_NVS_KEY, s_update_offset) == ESP_OK) {
-        if (nvs_commit(nvs) == ESP_OK) {
-            s_last_saved_offset = s_update_offset;
-            s_last_offset_save_us = now;
-        }
-    }
-    nvs_close(nvs);
 }
 
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
@@ -198,8 +246,8 @@ static char *tg_api_call_via_proxy(const char *path, const char *post_data)
 
 static char *tg_api_call_direct(const char *method, const char *post_data)
 {
-    char url[256];
-    snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/%s", s_bot_token, method);
+    char url[sizeof(s_api_base) + sizeof(s_bot_token) + 32];
+    snprintf(url, sizeof(url), "%s/bot%s/%s", s_api_base, s_bot_token, method);
 
     http_resp_t resp = {
         .buf = calloc(1, 4096),
@@ -244,7 +292,8 @@ static char *tg_api_call_direct(const char *method, const char *post_data)
 
 static char *tg_api_call(const char *method, const char *post_data)
 {
-    if (http_proxy_is_enabled()) {
+    /* An overridden base (a local mock) is always reached directly */
+    if (http_proxy_is_enabled() && strcmp(s_api_base, TG_API_BASE) == 0) {
         return tg_api_call_via_proxy(method, post_data);
     }
     return tg_api_call_direct(method, post_data);
@@ -281,7 +330,112 @@ static bool tg_response_is_ok(const char *resp, const char **out_desc)
     return false;
 }
 
-static void process_updates(const char *json_str)
+static bool tg_webhook_enabled(void);
+
+/* The message of one update: pushed, ignored, or to be retried. *msg_key is
+ * set for a message to record as seen once it is taken. */
+static tg_ingest_t process_message(cJSON *update, int64_t uid, tg_replay_sink_t *replay,
+                                   uint64_t *msg_key)
+{
+    /* Extract message */
+    cJSON *message = cJSON_GetObjectItem(update, "message");
+    if (!message) return TG_INGEST_IGNORED;
+
+    cJSON *text = cJSON_GetObjectItem(message, "text");
+    if (!text || !cJSON_IsString(text)) return TG_INGEST_IGNORED;
+
+    cJSON *chat = cJSON_GetObjectItem(message, "chat");
+    if (!chat) return TG_INGEST_IGNORED;
+
+    cJSON *chat_id = cJSON_GetObjectItem(chat, "id");
+    if (!chat_id) return TG_INGEST_IGNORED;
+
+    int msg_id_val = -1;
+    cJSON *message_id = cJSON_GetObjectItem(message, "message_id");
+    if (cJSON_IsNumber(message_id)) {
+        msg_id_val = (int)message_id->valuedouble;
+    }
+
+    char chat_id_str[32];
+    if (cJSON_IsString(chat_id) && chat_id->valuestring) {
+        strncpy(chat_id_str, chat_id->valuestring, sizeof(chat_id_str) - 1);
+        chat_id_str[sizeof(chat_id_str) - 1] = '\0';
+    } else if (cJSON_IsNumber(chat_id)) {
+        snprintf(chat_id_str, sizeof(chat_id_str), "%.0f", chat_id->valuedouble);
+    } else {
+        return TG_INGEST_IGNORED;
+    }
+
+    if (msg_id_val >= 0) {
+        uint64_t key = make_msg_key(chat_id_str, msg_id_val);
+        if (seen_msg_contains(key) && !replay) {
+            ESP_LOGW(TAG, "Drop duplicate message update_id=%" PRId64 " chat=%s message_id=%d",
+                     uid, chat_id_str, msg_id_val);
+            return TG_INGEST_IGNORED;
+        }
+        *msg_key = key;
+    }
+
+    ESP_LOGI(TAG, "Message update_id=%" PRId64 " message_id=%d from chat %s: %.40s...",
+             uid, msg_id_val, chat_id_str, text->valuestring);
+
+    /* Push to inbound bus */
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
+    strncpy(msg.type, "text", sizeof(msg.type) - 1);
+    msg.payload.text = strdup(text->valuestring);
+    if (!msg.payload.text) {
+        return TG_INGEST_RETRY;
+    }
+    if (replay) {
+        /* Where the bus push would be; replayed text never reaches the agent */
+        if (replay->npushed < replay->cap) {
+            replay->pushed_us[replay->npushed++] = esp_timer_get_time();
+        }
+        free(msg.payload.text);
+        return TG_INGEST_PUSHED;
+    }
+    if (message_bus_push_inbound(&msg) != ESP_OK) {
+        ESP_LOGW(TAG, "Inbound queue full, telegram message not taken");
+        free(msg.payload.text);
+        return TG_INGEST_RETRY;
+    }
+    return TG_INGEST_PUSHED;
+}
+
+/*
+ * Handle one Update object; replay is NULL except under the replay harness.
+ * An update that was not taken is not recorded as seen, so a redelivery of
+ * it gets through. The offset only screens getUpdates results: webhook
+ * redeliveries can arrive after a later update.
+ */
+static tg_ingest_t process_update(cJSON *update, tg_replay_sink_t *replay)
+{
+    /* Track offset and skip stale/duplicate updates */
+    cJSON *update_id = cJSON_GetObjectItem(update, "update_id");
+    int64_t uid = -1;
+    if (cJSON_IsNumber(update_id)) {
+        uid = (int64_t)update_id->valuedouble;
+    }
+    if (uid >= 0 && !replay && uid < s_update_offset && !tg_webhook_enabled()) {
+        return TG_INGEST_IGNORED;
+    }
+
+    uint64_t msg_key = 0;
+    tg_ingest_t r = process_message(update, uid, replay, &msg_key);
+
+    if (!replay && r != TG_INGEST_RETRY) {
+        if (msg_key) seen_msg_insert(msg_key);
+        if (uid >= s_update_offset) {
+            s_update_offset = uid + 1;
+            save_update_offset_if_needed(false);
+        }
+    }
+    return r;
+}
+
+static void process_updates(const char *json_str, tg_replay_sink_t *replay)
 {
     cJSON *root = cJSON_Parse(json_str);
     if (!root) return;
@@ -300,76 +454,210 @@ static void process_updates(const char *json_str)
 
     cJSON *update;
     cJSON_ArrayForEach(update, result) {
-        /* Track offset and skip stale/duplicate updates */
-        cJSON *update_id = cJSON_GetObjectItem(update, "update_id");
-        int64_t uid = -1;
-        if (cJSON_IsNumber(update_id)) {
-            uid = (int64_t)update_id->valuedouble;
-        }
-        if (uid >= 0) {
-            if (uid < s_update_offset) {
-                continue;
-            }
-            s_update_offset = uid + 1;
-            save_update_offset_if_needed(false);
-        }
+        process_update(update, replay);
+    }
 
-        /* Extract message */
-        cJSON *message = cJSON_GetObjectItem(update, "message");
-        if (!message) continue;
+    cJSON_Delete(root);
+}
 
-        cJSON *text = cJSON_GetObjectItem(message, "text");
-        if (!text || !cJSON_IsString(text)) continue;
+/* ── Webhook mode ───────────────────────────────────────────── */
 
-        cJSON *chat = cJSON_GetObjectItem(message, "chat");
-        if (!chat) continue;
+static bool tg_webhook_enabled(void)
+{
+    return s_webhook_url[0] != '\0';
+}
 
-        cJSON *chat_id = cJSON_GetObjectItem(chat, "id");
-        if (!chat_id) continue;
+/* Telegram allows A-Z a-z 0-9 _ - in secret_token */
+static void tg_webhook_generate_secret(char *out, size_t out_size)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-";
+    size_t n = out_size - 1;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = alphabet[esp_random() % (sizeof(alphabet) - 1)];
+    }
+    out[n] = '\0';
+}
 
-        int msg_id_val = -1;
-        cJSON *message_id = cJSON_GetObjectItem(message, "message_id");
-        if (cJSON_IsNumber(message_id)) {
-            msg_id_val = (int)message_id->valuedouble;
-        }
+static bool tg_webhook_secret_ok(httpd_req_t *req)
+{
+    char hdr[sizeof(s_webhook_secret)] = {0};
+    if (httpd_req_get_hdr_value_str(req, TG_WEBHOOK_SECRET_HDR, hdr, sizeof(hdr)) != ESP_OK) {
+        return false;
+    }
 
-        char chat_id_str[32];
-        if (cJSON_IsString(chat_id) && chat_id->valuestring) {
-            strncpy(chat_id_str, chat_id->valuestring, sizeof(chat_id_str) - 1);
-            chat_id_str[sizeof(chat_id_str) - 1] = '\0';
-        } else if (cJSON_IsNumber(chat_id)) {
-            snprintf(chat_id_str, sizeof(chat_id_str), "%.0f", chat_id->valuedouble);
-        } else {
+    /* Constant-time compare over the full secret */
+    size_t len = strlen(s_webhook_secret);
+    if (len == 0 || strlen(hdr) != len) {
+        return false;
+    }
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) {
+        diff |= (uint8_t)(hdr[i] ^ s_webhook_secret[i]);
+    }
+    return diff == 0;
+}
+
+/* Handle one webhook body; replay as for process_update() */
+static tg_ingest_t tg_webhook_ingest(const char *body, tg_replay_sink_t *replay)
+{
+    /* One Update per request: no batch array to walk */
+    cJSON *update = cJSON_Parse(body);
+    if (!update) {
+        ESP_LOGW(TAG, "Webhook body is not valid JSON");
+        return TG_INGEST_IGNORED;
+    }
+    tg_ingest_t r = process_update(update, replay);
+    cJSON_Delete(update);
+    return r;
+}
+
+static esp_err_t tg_webhook_handler(httpd_req_t *req)
+{
+    int64_t t0 = esp_timer_get_time();
+
+    if (!tg_webhook_secret_ok(req)) {
+        s_hook_rejected++;
+        ESP_LOGW(TAG, "Webhook request with bad secret token rejected");
+        httpd_resp_set_status(req, "401 Unauthorized");
+        return httpd_resp_sendstr(req, "unauthorized");
+    }
+
+    if (req->content_len == 0 || req->content_len > MIMI_TG_WEBHOOK_MAX_BODY) {
+        s_hook_rejected++;
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        return httpd_resp_sendstr(req, "bad length");
+    }
+
+    char *body = malloc(req->content_len + 1);
+    if (!body) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no mem");
+    }
+
+    size_t received = 0;
+    while (received < req->content_len) {
+        int n = httpd_req_recv(req, body + received, req->content_len - received);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) {
             continue;
         }
+        if (n <= 0) {
+            free(body);
+            return ESP_FAIL;
+        }
+        received += n;
+    }
+    body[received] = '\0';
+
+    tg_ingest_t r = tg_webhook_ingest(body, NULL);
+    free(body);
+    if (r == TG_INGEST_RETRY) {
+        /* Non-2xx: Telegram delivers the update again later */
+        s_hook_retried++;
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_sendstr(req, "busy");
+    }
+    if (r == TG_INGEST_PUSHED) {
+        int64_t lat = esp_timer_get_time() - t0;
+        s_hook_updates++;
+        s_hook_lat_last_us = lat;
+        s_hook_lat_sum_us += lat;
+        if (lat > s_hook_lat_max_us) {
+            s_hook_lat_max_us = lat;
+        }
+    }
 
-        if (msg_id_val >= 0) {
-            uint64_t msg_key = make_msg_key(chat_id_str, msg_id_val);
-            if (seen_msg_contains(msg_key)) {
-                ESP_LOGW(TAG, "Drop duplicate message update_id=%" PRId64 " chat=%s message_id=%d",
-                         uid, chat_id_str, msg_id_val);
-                continue;
-            }
-            seen_msg_insert(msg_key);
+    /* 200 for pushed and deliberately ignored updates, otherwise Telegram retries */
+    return httpd_resp_sendstr(req, "ok");
+}
+
+static esp_err_t tg_webhook_server_start(void)
+{
+    httpd_uri_t hook_uri = {
+        .uri = MIMI_TG_WEBHOOK_PATH,
+        .method = HTTP_POST,
+        .handler = tg_webhook_handler,
+    };
+
+#if CONFIG_ESP_HTTPS_SERVER_ENABLE
+    static const char cert_pem[] = MIMI_SECRET_TG_WEBHOOK_TLS_CERT_PEM;
+    static const char key_pem[] = MIMI_SECRET_TG_WEBHOOK_TLS_KEY_PEM;
+    if (cert_pem[0] && key_pem[0]) {
+        httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
+        ssl_config.httpd.stack_size = MIMI_TG_WEBHOOK_STACK;
+        ssl_config.httpd.ctrl_port = MIMI_TG_WEBHOOK_PORT + 1;
+        ssl_config.httpd.max_open_sockets = 3;
+        ssl_config.port_secure = MIMI_TG_WEBHOOK_PORT;
+        ssl_config.servercert = (const uint8_t *)cert_pem;
+        ssl_config.servercert_len = sizeof(cert_pem);
+        ssl_config.prvtkey_pem = (const uint8_t *)key_pem;
+        ssl_config.prvtkey_len = sizeof(key_pem);
+
+        esp_err_t ret = httpd_ssl_start(&s_webhook_server, &ssl_config);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to start HTTPS webhook server: %s", esp_err_to_name(ret));
+            return ret;
         }
+        httpd_register_uri_handler(s_webhook_server, &hook_uri);
+        ESP_LOGI(TAG, "Telegram webhook (HTTPS) on port %d%s",
+                 MIMI_TG_WEBHOOK_PORT, MIMI_TG_WEBHOOK_PATH);
+        return ESP_OK;
+    }
+#endif
+
+    /* Plain HTTP: TLS is terminated by a reverse proxy / tunnel in front */
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = MIMI_TG_WEBHOOK_PORT;
+    config.ctrl_port = MIMI_TG_WEBHOOK_PORT + 1;
+    config.stack_size = MIMI_TG_WEBHOOK_STACK;
+    config.max_open_sockets = 3;
+
+    esp_err_t ret = httpd_start(&s_webhook_server, &config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start webhook server: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    httpd_register_uri_handler(s_webhook_server, &hook_uri);
+    ESP_LOGI(TAG, "Telegram webhook (HTTP) on port %d%s", MIMI_TG_WEBHOOK_PORT, MIMI_TG_WEBHOOK_PATH);
+    return ESP_OK;
+}
 
-        ESP_LOGI(TAG, "Message update_id=%" PRId64 " message_id=%d from chat %s: %.40s...",
-                 uid, msg_id_val, chat_id_str, text->valuestring);
+/* One-shot task: register the webhook URL with Telegram, retrying until it sticks */
+static void telegram_webhook_register_task(void *arg)
+{
+    while (s_bot_token[0] == '\0') {
+        vTaskDelay(pdMS_TO_TICKS(5000));
+    }
 
-        /* Push to inbound bus */
-        mimi_msg_t msg = {0};
-        strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
-        strncpy(msg.chat_id, chat_id_str, sizeof(msg.chat_id) - 1);
-        msg.payload.text = strdup(text->valuestring);
-        if (msg.payload.text) {
-            if (message_bus_push_inbound(&msg) != ESP_OK) {
-                ESP_LOGW(TAG, "Inbound queue full, drop telegram message");
-                free(msg.payload.text);
+    while (1) {
+        cJSON *body = cJSON_CreateObject();
+        cJSON_AddStringToObject(body, "url", s_webhook_url);
+        cJSON_AddStringToObject(body, "secret_token", s_webhook_secret);
+        cJSON_AddNumberToObject(body, "max_connections", 2);
+        cJSON *allowed = cJSON_AddArrayToObject(body, "allowed_updates");
+        cJSON_AddItemToArray(allowed, cJSON_CreateString("message"));
+        char *json_str = cJSON_PrintUnformatted(body);
+        cJSON_Delete(body);
+
+        bool ok = false;
+        if (json_str) {
+            char *resp = tg_api_call("setWebhook", json_str);
+            free(json_str);
+            const char *desc = NULL;
+            ok = tg_response_is_ok(resp, &desc);
+            if (!ok) {
+                ESP_LOGW(TAG, "setWebhook failed: %s", desc ? desc : "no response");
             }
+            free(resp);
         }
+
+        if (ok) {
+            ESP_LOGI(TAG, "Telegram webhook registered: %s", s_webhook_url);
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(TG_WEBHOOK_REGISTER_RETRY_MS));
     }
 
-    cJSON_Delete(root);
+    vTaskDelete(NULL);
 }
 
 static void telegram_poll_task(void *arg)
@@ -383,6 +671,10 @@ static void telegram_poll_task(void *arg)
         }
     }
 
+    /* getUpdates returns 409 while a webhook is set; drop any leftover one */
+    char *resp = tg_api_call("deleteWebhook", NULL);
+    free(resp);
+
     while (1) {
         char params[128];
         snprintf(params, sizeof(params),
@@ -391,7 +683,7 @@ static void telegram_poll_task(void *arg)
 
         char *resp = tg_api_call(params, NULL);
         if (resp) {
-            process_updates(resp);
+            process_updates(resp, NULL);
             free(resp);
         } else {
             /* Back off on error */
@@ -404,26 +696,39 @@ static void telegram_poll_task(void *arg)
 
 esp_err_t telegram_bot_init(void)
 {
+    s_fallback_metric = metrics_counter("mimi_channel_fallbacks_total",
+                                        "Chunks resent as plain text after a Markdown failure",
+                                        "channel=\"telegram\"");
+
     /* NVS overrides take highest priority (set via CLI) */
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_TG, NVS_READONLY, &nvs) == ESP_OK) {
-        char tmp[128] = {0};
-        size_t len = sizeof(tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_TG_TOKEN, tmp, &len) == ESP_OK && tmp[0]) {
-            strncpy(s_bot_token, tmp, sizeof(s_bot_token) - 1);
-        }
+    char tmp[128] = {0};
+    if (config_get_str(MIMI_NVS_TG, MIMI_NVS_KEY_TG_TOKEN, tmp, sizeof(tmp)) == ESP_OK && tmp[0]) {
+        strncpy(s_bot_token, tmp, sizeof(s_bot_token) - 1);
+    }
 
-        int64_t offset = 0;
-        if (nvs_get_i64(nvs, TG_OFFSET_NVS_KEY, &offset) == ESP_OK && offset > 0) {
-            s_update_offset = offset;
-            s_last_saved_offset = offset;
-            ESP_LOGI(TAG, "Loaded Telegram update offset: %" PRId64, s_update_offset);
-        }
-        nvs_close(nvs);
+    char url[sizeof(s_webhook_url)] = {0};
+    if (config_get_str(MIMI_NVS_TG, TG_WEBHOOK_URL_NVS_KEY, url, sizeof(url)) == ESP_OK && url[0]) {
+        strncpy(s_webhook_url, url, sizeof(s_webhook_url) - 1);
+    }
+    if (config_get_str(MIMI_NVS_TG, TG_WEBHOOK_SECRET_NVS_KEY, s_webhook_secret,
+                       sizeof(s_webhook_secret)) != ESP_OK) {
+        s_webhook_secret[0] = '\0';
+    }
+
+    int64_t offset = 0;
+    if (config_get_i64(MIMI_NVS_TG, TG_OFFSET_NVS_KEY, &offset) == ESP_OK && offset > 0) {
+        s_update_offset = offset;
+        s_last_saved_offset = offset;
+        ESP_LOGI(TAG, "Loaded Telegram update offset: %" PRId64, s_update_offset);
     }
 
     /* s_bot_token is already initialized from MIMI_SECRET_TG_TOKEN as fallback */
 
+    if (tg_webhook_enabled() && s_webhook_secret[0] == '\0') {
+        tg_webhook_generate_secret(s_webhook_secret, 33);
+        config_set_str(MIMI_NVS_TG, TG_WEBHOOK_SECRET_NVS_KEY, s_webhook_secret);
+    }
+
     if (s_bot_token[0]) {
         ESP_LOGI(TAG, "Telegram bot token loaded (len=%d)", (int)strlen(s_bot_token));
     } else {
@@ -434,6 +739,17 @@ esp_err_t telegram_bot_init(void)
 
 esp_err_t telegram_bot_start(void)
 {
+    if (tg_webhook_enabled()) {
+        /* Webhook mode: no poll task, updates arrive on the HTTP server */
+        esp_err_t err = tg_webhook_server_start();
+        if (err != ESP_OK) {
+            return err;
+        }
+        BaseType_t ret = xTaskCreate(telegram_webhook_register_task, "tg_hook",
+                                     4096, NULL, MIMI_TG_POLL_PRIO, NULL);
+        return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
+    }
+
     BaseType_t ret = xTaskCreatePinnedToCore(
         telegram_poll_task, "tg_poll",
         MIMI_TG_POLL_STACK, NULL,
@@ -442,123 +758,361 @@ esp_err_t telegram_bot_start(void)
     return (ret == pdPASS) ? ESP_OK : ESP_FAIL;
 }
 
-esp_err_t telegram_send_message(const mimi_msg_t *msg)
+/*
+ * Build the sendMessage / editMessageText body. message_id > 0 selects an
+ * edit of an existing message; parse_mode NULL sends plain text.
+ */
+static char *tg_build_text_body(const char *chat_id, int64_t message_id,
+                                const char *text, const char *parse_mode)
 {
-    if (s_bot_token[0] == '\0') {
-        ESP_LOGW(TAG, "Cannot send: no bot token");
-        return ESP_ERR_INVALID_STATE;
+    cJSON *body = cJSON_CreateObject();
+    cJSON_AddStringToObject(body, "chat_id", chat_id);
+    if (message_id > 0) {
+        cJSON_AddNumberToObject(body, "message_id", (double)message_id);
+    }
+    cJSON_AddStringToObject(body, "text", text);
+    if (parse_mode) {
+        cJSON_AddStringToObject(body, "parse_mode", parse_mode);
     }
+    char *json_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    return json_str;
+}
 
-    if (strcmp(msg->type , "text") == 0) {
-        /* Split long messages at 4096-char boundary */
-        size_t text_len = strlen(msg->payload.text);
-        size_t offset = 0;
-        int all_ok = 1;
-
-        while (offset < text_len) {
-            size_t chunk = text_len - offset;
-            if (chunk > MIMI_TG_MAX_MSG_LEN) {
-                chunk = MIMI_TG_MAX_MSG_LEN;
-            }
+/* Extract result.message_id from a sendMessage response (0 if absent) */
+static int64_t tg_response_message_id(const char *resp)
+{
+    cJSON *root = resp ? cJSON_Parse(resp) : NULL;
+    if (!root) return 0;
+    int64_t id = 0;
+    cJSON *result = cJSON_GetObjectItem(root, "result");
+    cJSON *mid = result ? cJSON_GetObjectItem(result, "message_id") : NULL;
+    if (cJSON_IsNumber(mid)) {
+        id = (int64_t)mid->valuedouble;
+    }
+    cJSON_Delete(root);
+    return id;
+}
 
-            /* Build JSON body */
-            cJSON *body = cJSON_CreateObject();
-            cJSON_AddStringToObject(body, "chat_id", msg->chat_id);
+/*
+ * POST one text body. Edits that leave the text unchanged are reported by
+ * Telegram as an error ("message is not modified") and count as success.
+ */
+static bool tg_post_text(const char *chat_id, int64_t message_id, const char *json_str,
+                         bool log_reject, int64_t *out_message_id)
+{
+    const char *method = (message_id > 0) ? "editMessageText" : "sendMessage";
+    char *resp = tg_api_call(method, json_str);
+    if (!resp) {
+        ESP_LOGE(TAG, "%s failed: no HTTP response", method);
+        return false;
+    }
 
-            /* Create null-terminated chunk */
-            char *segment = malloc(chunk + 1);
-            if (!segment) {
-                cJSON_Delete(body);
-                return ESP_ERR_NO_MEM;
+    const char *desc = NULL;
+    bool ok = tg_response_is_ok(resp, &desc);
+    if (!ok && message_id > 0 && desc && strstr(desc, "not modified")) {
+        ok = true;
+    }
+    if (!ok && log_reject) {
+        ESP_LOGW(TAG, "%s rejected for %s: %s", method, chat_id, desc ? desc : "unknown");
+    }
+    if (ok && out_message_id && message_id <= 0) {
+        *out_message_id = tg_response_message_id(resp);
+    }
+    free(resp);
+    return ok;
+}
+
+/*
+ * Deliver one chunk converted to Telegram HTML (new message, or edit when
+ * message_id > 0). The converter already escapes and balances entities, so
+ * the plain-text retry should only be needed for API quirks;
+ * s_fallback_sends tracks how often.
+ */
+static bool tg_deliver_chunk(const char *chat_id, int64_t message_id, const char *segment,
+                             bool *in_code, int64_t *out_message_id)
+{
+    s_chunks_sent++;
+
+    bool code_before = *in_code;
+    char *html = tg_markdown_to_html(segment, strlen(segment), in_code);
+    if (html) {
+        char *json_str = tg_build_text_body(chat_id, message_id, html, "HTML");
+        free(html);
+        if (json_str) {
+            bool ok = tg_post_text(chat_id, message_id, json_str, true, out_message_id);
+            free(json_str);
+            if (ok) {
+                return true;
             }
-            memcpy(segment, msg->payload.text + offset, chunk);
-            segment[chunk] = '\0';
+        }
+    } else {
+        *in_code = code_before;
+    }
+
+    s_fallback_sends++;
+    metric_inc(s_fallback_metric);
+    char *json_str = tg_build_text_body(chat_id, message_id, segment, NULL);
+    if (!json_str) {
+        ESP_LOGE(TAG, "Plain send failed: no JSON body");
+        return false;
+    }
+    bool ok = tg_post_text(chat_id, message_id, json_str, true, out_message_id);
+    free(json_str);
+    if (ok) {
+        ESP_LOGI(TAG, "Plain-text fallback succeeded for %s (fallbacks=%" PRIu32 "/%" PRIu32 ")",
+                 chat_id, s_fallback_sends, s_chunks_sent);
+    } else {
+        ESP_LOGE(TAG, "Plain send failed for %s", chat_id);
+    }
+    return ok;
+}
 
-            cJSON_AddStringToObject(body, "text", segment);
-            cJSON_AddStringToObject(body, "parse_mode", "Markdown");
+static bool tg_send_chunk(const char *chat_id, const char *segment, bool *in_code)
+{
+    return tg_deliver_chunk(chat_id, 0, segment, in_code, NULL);
+}
 
-            char *json_str = cJSON_PrintUnformatted(body);
-            cJSON_Delete(body);
-            free(segment);
+/*
+ * Send text split on paragraph/line/UTF-8 boundaries. If edit_message_id > 0
+ * the first chunk replaces that message's text instead of being sent anew.
+ */
+static esp_err_t tg_send_text(const char *chat_id, const char *text, int64_t edit_message_id)
+{
+    size_t text_len = strlen(text);
+    size_t offset = 0;
+    bool in_code = false;
+    int all_ok = 1;
+
+    char *segment = malloc(MIMI_TG_MAX_MSG_LEN + 1);
+    if (!segment) {
+        return ESP_ERR_NO_MEM;
+    }
 
-            if (!json_str) {
-                all_ok = 0;
-                offset += chunk;
-                continue;
-            }
+    while (offset < text_len) {
+        size_t chunk = tg_markdown_chunk_len(text + offset, text_len - offset,
+                                             MIMI_TG_MAX_MSG_LEN);
+        memcpy(segment, text + offset, chunk);
+        segment[chunk] = '\0';
 
-            ESP_LOGI(TAG, "Sending telegram chunk to %s (%d bytes)", msg->chat_id, (int)chunk);
-            char *resp = tg_api_call("sendMessage", json_str);
-            free(json_str);
+        ESP_LOGI(TAG, "Sending telegram chunk to %s (%d bytes)", chat_id, (int)chunk);
+        bool ok;
+        if (offset == 0 && edit_message_id > 0) {
+            ok = tg_deliver_chunk(chat_id, edit_message_id, segment, &in_code, NULL);
+        } else {
+            ok = tg_send_chunk(chat_id, segment, &in_code);
+        }
+        if (ok) {
+            ESP_LOGI(TAG, "Telegram send success to %s (%d bytes)", chat_id, (int)chunk);
+        } else {
+            all_ok = 0;
+        }
+        offset += chunk;
+    }
 
-            int sent_ok = 0;
-            bool markdown_failed = false;
-            if (resp) {
-                const char *desc = NULL;
-                sent_ok = tg_response_is_ok(resp, &desc);
-                if (!sent_ok) {
-                    markdown_failed = true;
-                    ESP_LOGI(TAG, "Markdown rejected by Telegram for %s: %s",
-                            msg->chat_id, desc ? desc : "unknown");
-                }
-            }
+    free(segment);
+    return all_ok ? ESP_OK : ESP_FAIL;
+}
 
-            if (!sent_ok) {
-                /* Retry without parse_mode */
-                cJSON *body2 = cJSON_CreateObject();
-                cJSON_AddStringToObject(body2, "chat_id", msg->chat_id);
-                char *seg2 = malloc(chunk + 1);
-                if (seg2) {
-                    memcpy(seg2, msg->payload.text + offset, chunk);
-                    seg2[chunk] = '\0';
-                    cJSON_AddStringToObject(body2, "text", seg2);
-                    free(seg2);
-                }
-                char *json2 = cJSON_PrintUnformatted(body2);
-                cJSON_Delete(body2);
-                if (json2) {
-                    char *resp2 = tg_api_call("sendMessage", json2);
-                    free(json2);
-                    if (resp2) {
-                        const char *desc2 = NULL;
-                        sent_ok = tg_response_is_ok(resp2, &desc2);
-                        if (!sent_ok) {
-                            ESP_LOGE(TAG, "Plain send failed: %s", desc2 ? desc2 : "unknown");
-                            ESP_LOGE(TAG, "Telegram raw response: %.300s", resp2);
-                        }
-                        free(resp2);
-                    } else {
-                        ESP_LOGE(TAG, "Plain send failed: no HTTP response");
-                    }
-                } else {
-                    ESP_LOGE(TAG, "Plain send failed: no JSON body");
-                }
+/* ── Progressive replies (placeholder + editMessageText) ────── */
+
+typedef struct {
+    bool active;
+    char chat_id[32];
+    int64_t message_id;     /* placeholder message being edited, 0 = not sent yet */
+    int64_t last_edit_us;
+    char *pending;          /* newest snapshot not yet shown (coalesced) */
+    char *final;            /* final reply held until the next edit is allowed */
+} tg_stream_t;
+
+static tg_stream_t s_streams[MIMI_STREAM_MAX_CHATS];
+
+static void tg_stream_release(tg_stream_t *st)
+{
+    free(st->pending);
+    free(st->final);
+    memset(st, 0, sizeof(*st));
+}
+
+/* Edit the held final reply into the placeholder and end the stream */
+static esp_err_t tg_stream_finish(tg_stream_t *st)
+{
+    char chat_id[sizeof(st->chat_id)];
+    memcpy(chat_id, st->chat_id, sizeof(chat_id));
+    int64_t message_id = st->message_id;
+    char *text = st->final;
+    st->final = NULL;
+    tg_stream_release(st);
+
+    esp_err_t err = tg_send_text(chat_id, text, message_id);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Final reply to %s failed: %s", chat_id, esp_err_to_name(err));
+    }
+
+    /* The dispatcher got MIMI_SEND_PENDING for it: settle (or journal) it here */
+    mimi_msg_t msg = { .payload.text = text };
+    strncpy(msg.channel, MIMI_CHAN_TELEGRAM, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
+    strncpy(msg.type, "stream_end", sizeof(msg.type) - 1);
+    offline_queue_outbound_done(&msg, err);
+    free(text);
+    return err;
+}
+
+static tg_stream_t *tg_stream_get(const char *chat_id, bool create)
+{
+    tg_stream_t *slot = NULL;
+    for (int i = 0; i < MIMI_STREAM_MAX_CHATS; i++) {
+        if (s_streams[i].active && strcmp(s_streams[i].chat_id, chat_id) == 0) {
+            return &s_streams[i];
+        }
+        if (!s_streams[i].active && !slot) {
+            slot = &s_streams[i];
+        }
+    }
+    if (!create) return NULL;
+
+    if (!slot) {
+        /* Evict the stream that has been quiet the longest */
+        slot = &s_streams[0];
+        for (int i = 1; i < MIMI_STREAM_MAX_CHATS; i++) {
+            if (s_streams[i].last_edit_us < slot->last_edit_us) {
+                slot = &s_streams[i];
             }
+        }
+        if (slot->final) {
+            tg_stream_finish(slot);
+        } else {
+            tg_stream_release(slot);
+        }
+    }
+    slot->active = true;
+    strncpy(slot->chat_id, chat_id, sizeof(slot->chat_id) - 1);
+    return slot;
+}
+
+/* Show a snapshot in the placeholder (first chunk only; the final reply
+ * carries the overflow as follow-up messages). */
+static void tg_stream_show(tg_stream_t *st, const char *text)
+{
+    size_t len = tg_markdown_chunk_len(text, strlen(text), MIMI_TG_MAX_MSG_LEN);
+    char *segment = strndup(text, len);
+    if (!segment) return;
+
+    bool in_code = false;
+    int64_t new_id = 0;
+    if (tg_deliver_chunk(st->chat_id, st->message_id, segment, &in_code, &new_id) &&
+        st->message_id <= 0) {
+        st->message_id = new_id;
+    }
+    free(segment);
+    st->last_edit_us = esp_timer_get_time();
+}
 
-            if (!sent_ok) {
-                all_ok = 0;
-            } else {
-                if (markdown_failed) {
-                    ESP_LOGI(TAG, "Plain-text fallback succeeded for %s", msg->chat_id);
-                }
-                ESP_LOGI(TAG, "Telegram send success to %s (%d bytes)", msg->chat_id, (int)chunk);
+static esp_err_t tg_stream_update(const char *chat_id, const char *text)
+{
+    tg_stream_t *st = tg_stream_get(chat_id, true);
+    int64_t now = esp_timer_get_time();
+
+    if (st->message_id > 0 &&
+        now - st->last_edit_us < (int64_t)MIMI_TG_STREAM_EDIT_INTERVAL_MS * 1000) {
+        /* Too soon for another edit: keep only the newest snapshot */
+        char *dup = strdup(text);
+        if (!dup) return ESP_ERR_NO_MEM;
+        free(st->pending);
+        st->pending = dup;
+        return ESP_OK;
+    }
+
+    free(st->pending);
+    st->pending = NULL;
+    tg_stream_show(st, text);
+    return st->message_id > 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t tg_stream_end(const char *chat_id, const char *text)
+{
+    tg_stream_t *st = tg_stream_get(chat_id, false);
+    int64_t message_id = 0;
+    if (st) {
+        message_id = st->message_id;
+        if (message_id > 0 && esp_timer_get_time() - st->last_edit_us <
+                              (int64_t)MIMI_TG_STREAM_EDIT_INTERVAL_MS * 1000) {
+            /* Too soon for the last edit: hold it for telegram_stream_flush()
+             * rather than stall the outbound dispatcher */
+            char *dup = strdup(text);
+            if (dup) {
+                free(st->pending);
+                st->pending = NULL;
+                free(st->final);
+                st->final = dup;
+                return MIMI_SEND_PENDING;
             }
+        }
+        tg_stream_release(st);
+    }
+    return tg_send_text(chat_id, text, message_id);
+}
 
-            free(resp);
-            offset += chunk;
+void telegram_stream_flush(void)
+{
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < MIMI_STREAM_MAX_CHATS; i++) {
+        tg_stream_t *st = &s_streams[i];
+        if (!st->active || (!st->pending && !st->final)) continue;
+        if (now - st->last_edit_us < (int64_t)MIMI_TG_STREAM_EDIT_INTERVAL_MS * 1000) continue;
+
+        if (st->final) {
+            tg_stream_finish(st);
+            continue;
         }
-        return all_ok ? ESP_OK : ESP_FAIL; 
+        char *text = st->pending;
+        st->pending = NULL;
+        tg_stream_show(st, text);
+        free(text);
+    }
+}
+
+esp_err_t telegram_send_message(const mimi_msg_t *msg)
+{
+    if (s_bot_token[0] == '\0') {
+        ESP_LOGW(TAG, "Cannot send: no bot token");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    /* A held final reply goes out before anything newer for the same chat */
+    tg_stream_t *st = tg_stream_get(msg->chat_id, false);
+    if (st && st->final) {
+        tg_stream_finish(st);
+    }
+
+    if (strcmp(msg->type , "text") == 0) {
+        return tg_send_text(msg->chat_id, msg->payload.text, 0);
+    }
+    else if (strcmp(msg->type, "stream") == 0) {
+        return tg_stream_update(msg->chat_id, msg->payload.text);
+    }
+    else if (strcmp(msg->type, "stream_end") == 0) {
+        return tg_stream_end(msg->chat_id, msg->payload.text);
     }
     else if (strcmp(msg->type , "collapsible") == 0) {
         /* For collapsible, send title and body together */
-        char combined[4096];
-        snprintf(combined, sizeof(combined), "*%s*\n\n%s", msg->payload.collapsible.title, msg->payload.collapsible.body);
+        const char *title = msg->payload.collapsible.title ? msg->payload.collapsible.title : "";
+        const char *body = msg->payload.collapsible.body ? msg->payload.collapsible.body : "";
+        size_t combined_len = strlen(title) + strlen(body) + 8;
+        char *combined = malloc(combined_len);
+        if (!combined) {
+            return ESP_ERR_NO_MEM;
+        }
+        snprintf(combined, combined_len, "**%s**\n\n%s", title, body);
+
         mimi_msg_t text_msg = {0};
         strncpy(text_msg.channel, msg->channel, sizeof(text_msg.channel) - 1);
         strncpy(text_msg.chat_id, msg->chat_id, sizeof(text_msg.chat_id) - 1);
-        text_msg.type[0] = '\0';
+        strncpy(text_msg.type, "text", sizeof(text_msg.type) - 1);
         text_msg.payload.text = combined;
         esp_err_t err = telegram_send_message(&text_msg);
+        free(combined);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to send collapsible message to %s: %s", msg->chat_id, esp_err_to_name(err));
             return err;
@@ -572,15 +1126,233 @@ esp_err_t telegram_send_message(const mimi_msg_t *msg)
     return ESP_OK;
 }
 
+void telegram_get_send_stats(uint32_t *chunks_sent, uint32_t *fallback_sends)
+{
+    if (chunks_sent) *chunks_sent = s_chunks_sent;
+    if (fallback_sends) *fallback_sends = s_fallback_sends;
+}
+
+void telegram_get_webhook_stats(telegram_webhook_stats_t *out)
+{
+    if (!out) return;
+    out->enabled = tg_webhook_enabled();
+    out->updates = s_hook_updates;
+    out->rejected = s_hook_rejected;
+    out->retried = s_hook_retried;
+    out->latency_last_us = s_hook_lat_last_us;
+    out->latency_max_us = s_hook_lat_max_us;
+    out->latency_avg_us = s_hook_updates ? s_hook_lat_sum_us / s_hook_updates : 0;
+}
+
+esp_err_t telegram_set_webhook(const char *url)
+{
+    esp_err_t err;
+    if (url && url[0]) {
+        err = config_set_str(MIMI_NVS_TG, TG_WEBHOOK_URL_NVS_KEY, url);
+    } else {
+        err = config_erase(MIMI_NVS_TG, TG_WEBHOOK_URL_NVS_KEY);
+        if (err == ESP_ERR_NOT_FOUND) err = ESP_OK;
+    }
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Telegram webhook %s (restart to apply)", (url && url[0]) ? "set" : "cleared");
+    }
+    return err;
+}
+
+esp_err_t telegram_set_api_base(const char *base)
+{
+    const char *b = (base && base[0]) ? base : TG_API_BASE;
+    if (strlen(b) >= sizeof(s_api_base)) return ESP_ERR_INVALID_ARG;
+    strcpy(s_api_base, b);
+    ESP_LOGI(TAG, "Telegram API base: %s", s_api_base);
+    return ESP_OK;
+}
+
 esp_err_t telegram_set_token(const char *token)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_TG, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_TG_TOKEN, token));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_err_t err = config_set_str(MIMI_NVS_TG, MIMI_NVS_KEY_TG_TOKEN, token);
+    if (err != ESP_OK) return err;
 
     strncpy(s_bot_token, token, sizeof(s_bot_token) - 1);
     ESP_LOGI(TAG, "Telegram bot token saved");
     return ESP_OK;
 }
+
+/* ── Replay harness ─────────────────────────────────────────── */
+
+/* Read a recording into printed Update objects; returns how many, or -1 */
+static int tg_replay_load(FILE *f, char **updates, int max, int *skipped)
+{
+    char *line = heap_caps_malloc(MIMI_TG_WEBHOOK_MAX_BODY + 2, MALLOC_CAP_SPIRAM);
+    if (!line) return -1;
+
+    int n = 0;
+    *skipped = 0;
+    while (n < max && fgets(line, MIMI_TG_WEBHOOK_MAX_BODY + 2, f)) {
+        size_t len = strlen(line);
+        if (len > MIMI_TG_WEBHOOK_MAX_BODY) {
+            /* Longer than the webhook accepts: drop the rest of the line */
+            int c;
+            while ((c = fgetc(f)) != EOF && c != '\n') {}
+            (*skipped)++;
+            continue;
+        }
+
+        cJSON *root = cJSON_Parse(line);
+        if (!root) {
+            if (strspn(line, " \t\r\n") != len) (*skipped)++;
+            continue;
+        }
+
+        /* A getUpdates response is expanded into its Updates */
+        cJSON *result = cJSON_GetObjectItem(root, "result");
+        if (cJSON_IsArray(result)) {
+            cJSON *update;
+            cJSON_ArrayForEach(update, result) {
+                if (n == max) break;
+                updates[n] = cJSON_PrintUnformatted(update);
+                if (updates[n]) n++;
+            }
+        } else if (cJSON_GetObjectItem(root, "update_id")) {
+            updates[n] = cJSON_PrintUnformatted(root);
+            if (updates[n]) n++;
+        } else {
+            (*skipped)++;
+        }
+        cJSON_Delete(root);
+    }
+
+    free(line);
+    return n;
+}
+
+/* getUpdates response carrying updates[0..count) */
+static char *tg_replay_batch_body(char **updates, int count)
+{
+    static const char head[] = "{\"ok\":true,\"result\":[";
+    size_t len = sizeof(head) + 2;
+    for (int i = 0; i < count; i++) len += strlen(updates[i]) + 1;
+
+    char *body = malloc(len);
+    if (!body) return NULL;
+    char *p = body;
+    memcpy(p, head, sizeof(head) - 1);
+    p += sizeof(head) - 1;
+    for (int i = 0; i < count; i++) {
+        if (i) *p++ = ',';
+        size_t l = strlen(updates[i]);
+        memcpy(p, updates[i], l);
+        p += l;
+    }
+    strcpy(p, "]}");
+    return body;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void add_latency(cJSON *parent, const char *key, int64_t *lat, int n)
+{
+    qsort(lat, n, sizeof(int64_t), cmp_i64);
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++) sum += lat[i];
+
+    cJSON *o = cJSON_AddObjectToObject(parent, key);
+    cJSON_AddNumberToObject(o, "p50", n ? (double)lat[(n - 1) * 50 / 100] : 0);
+    cJSON_AddNumberToObject(o, "p95", n ? (double)lat[(n - 1) * 95 / 100] : 0);
+    cJSON_AddNumberToObject(o, "p99", n ? (double)lat[(n - 1) * 99 / 100] : 0);
+    cJSON_AddNumberToObject(o, "max", n ? (double)lat[n - 1] : 0);
+    cJSON_AddNumberToObject(o, "mean", n ? (double)sum / n : 0);
+}
+
+esp_err_t telegram_replay_bench(const char *path, int batch, char **report_json)
+{
+    *report_json = NULL;
+    if (!path || batch < 1 || batch > MIMI_TG_REPLAY_MAX_UPDATES) return ESP_ERR_INVALID_ARG;
+
+    FILE *f = fopen(path, "r");
+    if (!f) return ESP_ERR_NOT_FOUND;
+
+    const int max = MIMI_TG_REPLAY_MAX_UPDATES;
+    char **updates = heap_caps_calloc(max, sizeof(char *), MALLOC_CAP_SPIRAM);
+    int64_t *pushed_us = heap_caps_malloc(max * sizeof(int64_t), MALLOC_CAP_SPIRAM);
+    int64_t *hook_lat = heap_caps_malloc(max * sizeof(int64_t), MALLOC_CAP_SPIRAM);
+    int64_t *poll_lat = heap_caps_malloc(max * sizeof(int64_t), MALLOC_CAP_SPIRAM);
+    int skipped = 0;
+    int n = -1;
+    if (updates && pushed_us && hook_lat && poll_lat) {
+        n = tg_replay_load(f, updates, max, &skipped);
+    }
+    fclose(f);
+
+    esp_err_t err = ESP_OK;
+    if (n < 0) {
+        err = ESP_ERR_NO_MEM;
+        goto done;
+    }
+    if (n == 0) {
+        err = ESP_ERR_INVALID_SIZE;
+        goto done;
+    }
+
+    tg_replay_sink_t sink = { .pushed_us = pushed_us, .cap = max };
+
+    /* Webhook path: one body per update, timed from body in hand to push */
+    int hook_n = 0;
+    for (int i = 0; i < n; i++) {
+        sink.npushed = 0;
+        int64_t t0 = esp_timer_get_time();
+        if (tg_webhook_ingest(updates[i], &sink) == TG_INGEST_PUSHED && sink.npushed) {
+            hook_lat[hook_n++] = sink.pushed_us[0] - t0;
+        }
+    }
+
+    /* Poll path: getUpdates responses of `batch` updates, timed from the
+     * response in hand to each push; the long-poll wait itself is excluded */
+    int poll_n = 0;
+    for (int i = 0; i < n && err == ESP_OK; i += batch) {
+        int count = (n - i < batch) ? n - i : batch;
+        char *body = tg_replay_batch_body(updates + i, count);
+        if (!body) {
+            err = ESP_ERR_NO_MEM;
+            break;
+        }
+        sink.npushed = 0;
+        int64_t t0 = esp_timer_get_time();
+        process_updates(body, &sink);
+        for (int j = 0; j < sink.npushed; j++) {
+            poll_lat[poll_n++] = sink.pushed_us[j] - t0;
+        }
+        free(body);
+    }
+
+    if (err != ESP_OK) goto done;
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "updates", n);
+    cJSON_AddNumberToObject(root, "skipped_lines", skipped);
+    cJSON *hook = cJSON_AddObjectToObject(root, "webhook");
+    cJSON_AddNumberToObject(hook, "pushed", hook_n);
+    add_latency(hook, "latency_us", hook_lat, hook_n);
+    cJSON *poll = cJSON_AddObjectToObject(root, "poll");
+    cJSON_AddNumberToObject(poll, "batch", batch);
+    cJSON_AddNumberToObject(poll, "pushed", poll_n);
+    add_latency(poll, "latency_us", poll_lat, poll_n);
+    *report_json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!*report_json) err = ESP_ERR_NO_MEM;
+
+done:
+    if (updates) {
+        for (int i = 0; i < max; i++) cJSON_free(updates[i]);
+    }
+    free(updates);
+    free(pushed_us);
+    free(hook_lat);
+    free(poll_lat);
+    return err;
+}
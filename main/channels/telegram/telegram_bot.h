@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "bus/message_bus.h"
 
@@ -9,18 +11,93 @@
 esp_err_t telegram_bot_init(void);
 
 /**
- * Start the Telegram polling task (long polling on Core 0).
+ * Start Telegram ingestion.
+ * Long polling task on Core 0 by default; if a webhook URL is configured,
+ * starts the webhook HTTP server on MIMI_TG_WEBHOOK_PORT instead and
+ * registers the URL with Telegram (no poll task).
  */
 esp_err_t telegram_bot_start(void);
 
 /**
  * Send a text message to a Telegram chat.
- * Automatically splits messages longer than 4096 chars.
+ * Markdown is converted locally to Telegram HTML before sending, and
+ * messages longer than 4096 bytes are split on line/UTF-8 boundaries.
+ * Type "stream" posts a placeholder once and then edits it in place
+ * (rate-limited, intermediate snapshots coalesced); "stream_end" writes
+ * the final reply into that placeholder, or, if the last edit was too recent,
+ * holds it for the stream flush instead of waiting and returns
+ * MIMI_SEND_PENDING; the flush settles the journal once it is written.
  * @param chat_id  Telegram chat ID (numeric string)
  * @param text     Message text (supports Markdown)
  */
 esp_err_t telegram_send_message(const mimi_msg_t *msg);
 
+/**
+ * Push coalesced "stream" snapshots, and final replies held back by
+ * "stream_end", whose edit interval has elapsed. Called by the outbound
+ * dispatcher when its queue is idle and after each message it sends.
+ * A held final reply is reported with offline_queue_outbound_done().
+ */
+void telegram_stream_flush(void);
+
+/**
+ * Get send counters since boot: chunks sent, and chunks that were rejected
+ * as HTML and had to be resent as plain text. Either pointer may be NULL.
+ */
+void telegram_get_send_stats(uint32_t *chunks_sent, uint32_t *fallback_sends);
+
+typedef struct {
+    bool enabled;
+    uint32_t updates;           /* updates pushed to the inbound bus */
+    uint32_t rejected;          /* bad secret token / body size */
+    uint32_t retried;           /* not taken (bus full), answered 503 for redelivery */
+    int64_t latency_last_us;    /* handler entry -> inbound bus push */
+    int64_t latency_avg_us;
+    int64_t latency_max_us;
+} telegram_webhook_stats_t;
+
+/**
+ * Get webhook ingest counters since boot.
+ */
+void telegram_get_webhook_stats(telegram_webhook_stats_t *out);
+
+/**
+ * Save the public webhook URL to NVS (empty/NULL clears it and returns to
+ * long polling). The URL path must reach MIMI_TG_WEBHOOK_PATH on the device.
+ * Takes effect after restart. An update the inbound bus has no room for is
+ * answered 503, so Telegram delivers it again.
+ */
+esp_err_t telegram_set_webhook(const char *url);
+
+/**
+ * Point Bot API calls at another base URL, e.g. the local mock in
+ * bench/chan_mock.h; NULL or "" restores https://api.telegram.org. Not
+ * persisted. An overridden base is reached directly, never through the
+ * HTTP proxy.
+ */
+esp_err_t telegram_set_api_base(const char *base);
+
+/**
+ * Replay a recording of Telegram updates through both ingest paths and
+ * report the ingest-to-bus latency distribution of each.
+ *
+ * The file at `path` holds one JSON document per line: a single Update (a
+ * webhook body) or a whole getUpdates response, whose "result" is expanded;
+ * the first MIMI_TG_REPLAY_MAX_UPDATES updates are kept. Each update is fed
+ * to the webhook handler's ingest as its own body, then the same updates are
+ * fed to the poll path wrapped in getUpdates responses of `batch`. Latency
+ * runs from the body in hand to the point of the bus push, so the poll
+ * figures leave out the long-poll wait. Replayed messages are stamped and
+ * dropped at that point: they never reach the agent, and the update offset
+ * and duplicate filter are left untouched.
+ *
+ * @param batch        updates per getUpdates response, 1..MIMI_TG_REPLAY_MAX_UPDATES
+ * @param report_json  out: single-line JSON report, caller frees
+ * @return ESP_ERR_NOT_FOUND if the file cannot be opened, ESP_ERR_INVALID_SIZE
+ *         if it holds no updates
+ */
+esp_err_t telegram_replay_bench(const char *path, int batch, char **report_json);
+
 /**
  * Save the Telegram bot token to NVS.
  */
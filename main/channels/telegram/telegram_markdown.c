@@ -0,0 +1,417 @@
+#include "telegram_markdown.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#define MD_MAX_DEPTH   8
+
+typedef enum {
+    MD_TAG_BOLD = 0,
+    MD_TAG_ITALIC,
+    MD_TAG_STRIKE,
+    MD_TAG_HEADING,
+    MD_TAG_HEADING_BOLD,    /* bold inside a heading: already bold, no tags */
+} md_tag_t;
+
+static const char *s_open_tags[]  = { "<b>", "<i>", "<s>", "<b>", "" };
+static const char *s_close_tags[] = { "</b>", "</i>", "</s>", "</b>", "" };
+
+/* Growable output buffer */
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool oom;
+    md_tag_t stack[MD_MAX_DEPTH];
+    int depth;
+} md_out_t;
+
+static void out_put(md_out_t *o, const char *s, size_t n)
+{
+    if (o->oom) return;
+    if (o->len + n + 1 > o->cap) {
+        size_t new_cap = o->cap * 2;
+        if (new_cap < o->len + n + 1) {
+            new_cap = o->len + n + 1;
+        }
+        char *tmp = realloc(o->buf, new_cap);
+        if (!tmp) {
+            o->oom = true;
+            return;
+        }
+        o->buf = tmp;
+        o->cap = new_cap;
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+    o->buf[o->len] = '\0';
+}
+
+static void out_str(md_out_t *o, const char *s)
+{
+    out_put(o, s, strlen(s));
+}
+
+static void out_escaped(md_out_t *o, const char *s, size_t n, bool attr)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++) {
+        const char *rep = NULL;
+        switch (s[i]) {
+        case '&': rep = "&amp;"; break;
+        case '<': rep = "&lt;"; break;
+        case '>': rep = "&gt;"; break;
+        case '"': rep = attr ? "&quot;" : NULL; break;
+        default: break;
+        }
+        if (rep) {
+            out_put(o, s + run, i - run);
+            out_str(o, rep);
+            run = i + 1;
+        }
+    }
+    out_put(o, s + run, n - run);
+}
+
+/* ── Tag stack ─────────────────────────────────────────────── */
+
+static bool tag_is_open(const md_out_t *o, md_tag_t tag)
+{
+    for (int i = 0; i < o->depth; i++) {
+        if (o->stack[i] == tag) return true;
+    }
+    return false;
+}
+
+static bool tag_push(md_out_t *o, md_tag_t tag)
+{
+    if (o->depth >= MD_MAX_DEPTH) return false;
+    o->stack[o->depth++] = tag;
+    out_str(o, s_open_tags[tag]);
+    return true;
+}
+
+static void tag_close_all(md_out_t *o)
+{
+    while (o->depth > 0) {
+        out_str(o, s_close_tags[o->stack[--o->depth]]);
+    }
+}
+
+/* ── Scanning helpers ──────────────────────────────────────── */
+
+static bool is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || (unsigned char)c >= 0x80;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static size_t line_end(const char *md, size_t len, size_t i)
+{
+    while (i < len && md[i] != '\n') i++;
+    return i;
+}
+
+static bool is_fence(const char *md, size_t len, size_t i)
+{
+    return i + 3 <= len && md[i] == '`' && md[i + 1] == '`' && md[i + 2] == '`';
+}
+
+/*
+ * Look for a closing emphasis marker on the same line. The closer must
+ * follow a non-space character; single '*' must not be half of "**", and
+ * '_' must not be glued to a following word (snake_case identifiers).
+ */
+static bool has_closer(const char *md, size_t len, size_t from,
+                       const char *marker, size_t mlen)
+{
+    size_t end = line_end(md, len, from);
+    for (size_t j = from; j + mlen <= end; j++) {
+        if (md[j] == '`') {
+            /* Skip inline code spans, markers inside them are literal */
+            size_t k = j + 1;
+            while (k < end && md[k] != '`') k++;
+            if (k < end) {
+                j = k;
+                continue;
+            }
+        }
+        if (memcmp(md + j, marker, mlen) != 0) continue;
+        if (j == from || is_space(md[j - 1])) continue;
+        if (mlen == 1) {
+            if (md[j - 1] == marker[0]) continue;
+            if (j + 1 < end && md[j + 1] == marker[0]) continue;
+        }
+        if (marker[0] == '_' && j + mlen < end && is_word_char(md[j + mlen])) continue;
+        return true;
+    }
+    return false;
+}
+
+/* Toggle an emphasis tag. Returns false when the marker must stay literal. */
+static bool try_emphasis(md_out_t *o, const char *md, size_t len, size_t i,
+                         const char *marker, size_t mlen, md_tag_t tag)
+{
+    if (tag_is_open(o, tag)) {
+        if (o->stack[o->depth - 1] != tag || i == 0 || is_space(md[i - 1])) {
+            return false;
+        }
+        o->depth--;
+        out_str(o, s_close_tags[tag]);
+        return true;
+    }
+
+    if (i + mlen >= len || is_space(md[i + mlen])) return false;
+    if (marker[0] == '_' && i > 0 && is_word_char(md[i - 1])) return false;
+    if (!has_closer(md, len, i + mlen, marker, mlen)) return false;
+    return tag_push(o, tag);
+}
+
+/* Accept only URL schemes Telegram renders; anything else is sent as text. */
+static bool is_safe_url(const char *url, size_t n)
+{
+    static const char *schemes[] = { "http://", "https://", "tg://", "mailto:" };
+    for (size_t s = 0; s < sizeof(schemes) / sizeof(schemes[0]); s++) {
+        size_t sl = strlen(schemes[s]);
+        if (n > sl && strncmp(url, schemes[s], sl) == 0) {
+            for (size_t i = 0; i < n; i++) {
+                if (is_space(url[i])) return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+/* [label](url) — returns bytes consumed, or 0 if not a well-formed link */
+static size_t try_link(md_out_t *o, const char *md, size_t len, size_t i)
+{
+    size_t end = line_end(md, len, i);
+    size_t close_br = i + 1;
+    while (close_br < end && md[close_br] != ']') close_br++;
+    if (close_br >= end || close_br == i + 1) return 0;
+    if (close_br + 1 >= end || md[close_br + 1] != '(') return 0;
+
+    size_t url_start = close_br + 2;
+    size_t close_par = url_start;
+    while (close_par < end && md[close_par] != ')') close_par++;
+    if (close_par >= end) return 0;
+    if (!is_safe_url(md + url_start, close_par - url_start)) return 0;
+
+    out_str(o, "<a href=\"");
+    out_escaped(o, md + url_start, close_par - url_start, true);
+    out_str(o, "\">");
+    out_escaped(o, md + i + 1, close_br - i - 1, false);
+    out_str(o, "</a>");
+    return close_par + 1 - i;
+}
+
+/* Block-level prefixes: headings and bullets. Returns bytes consumed. */
+static size_t convert_line_start(md_out_t *o, const char *md, size_t len, size_t i)
+{
+    size_t p = i;
+    while (p < len && p - i < 4 && md[p] == ' ') p++;
+
+    size_t hashes = 0;
+    while (p + hashes < len && md[p + hashes] == '#' && hashes < 6) hashes++;
+    if (hashes > 0 && p + hashes < len && md[p + hashes] == ' ') {
+        tag_push(o, MD_TAG_HEADING);
+        return p + hashes + 1 - i;
+    }
+
+    if (p + 1 < len && (md[p] == '-' || md[p] == '*' || md[p] == '+') && md[p + 1] == ' ') {
+        out_put(o, md + i, p - i);
+        out_str(o, "\xE2\x80\xA2 ");
+        return p + 2 - i;
+    }
+    return 0;
+}
+
+/* ── Public API ────────────────────────────────────────────── */
+
+char *tg_markdown_to_html(const char *md, size_t len, bool *in_code)
+{
+    md_out_t o = {
+        .buf = malloc(len + len / 4 + 64),
+        .len = 0,
+        .cap = len + len / 4 + 64,
+    };
+    if (!o.buf) return NULL;
+    o.buf[0] = '\0';
+
+    bool code = in_code ? *in_code : false;
+    bool line_start = true;
+    size_t i = 0;
+
+    if (code) {
+        out_str(&o, "<pre>");
+    }
+
+    while (i < len && !o.oom) {
+        if (line_start) {
+            line_start = false;
+            if (is_fence(md, len, i)) {
+                tag_close_all(&o);
+                out_str(&o, code ? "</pre>" : "<pre>");
+                code = !code;
+                i = line_end(md, len, i);
+                if (i < len) i++;   /* fence line's newline is not content */
+                line_start = true;
+                continue;
+            }
+            if (!code) {
+                size_t n = convert_line_start(&o, md, len, i);
+                if (n > 0) {
+                    i += n;
+                    continue;
+                }
+            }
+        }
+
+        char c = md[i];
+
+        if (code) {
+            if (c == '\n') line_start = true;
+            out_escaped(&o, &c, 1, false);
+            i++;
+            continue;
+        }
+
+        if (c == '\n') {
+            tag_close_all(&o);
+            out_put(&o, "\n", 1);
+            line_start = true;
+            i++;
+            continue;
+        }
+
+        if (c == '\\' && i + 1 < len && ispunct((unsigned char)md[i + 1])) {
+            out_escaped(&o, md + i + 1, 1, false);
+            i += 2;
+            continue;
+        }
+
+        if (c == '`') {
+            size_t end = line_end(md, len, i);
+            size_t j = i + 1;
+            while (j < end && md[j] != '`') j++;
+            if (j < end && j > i + 1) {
+                out_str(&o, "<code>");
+                out_escaped(&o, md + i + 1, j - i - 1, false);
+                out_str(&o, "</code>");
+                i = j + 1;
+                continue;
+            }
+        }
+
+        if (c == '[') {
+            size_t n = try_link(&o, md, len, i);
+            if (n > 0) {
+                i += n;
+                continue;
+            }
+        }
+
+        if (i + 1 < len && ((c == '*' && md[i + 1] == '*') || (c == '_' && md[i + 1] == '_'))) {
+            const char *marker = (c == '*') ? "**" : "__";
+            md_tag_t bold = tag_is_open(&o, MD_TAG_HEADING) ? MD_TAG_HEADING_BOLD : MD_TAG_BOLD;
+            if (!try_emphasis(&o, md, len, i, marker, 2, bold)) {
+                out_put(&o, md + i, 2);
+            }
+            i += 2;
+            continue;
+        }
+
+        if (i + 1 < len && c == '~' && md[i + 1] == '~') {
+            if (!try_emphasis(&o, md, len, i, "~~", 2, MD_TAG_STRIKE)) {
+                out_put(&o, md + i, 2);
+            }
+            i += 2;
+            continue;
+        }
+
+        if (c == '*' || c == '_') {
+            const char *marker = (c == '*') ? "*" : "_";
+            if (!try_emphasis(&o, md, len, i, marker, 1, MD_TAG_ITALIC)) {
+                out_put(&o, md + i, 1);
+            }
+            i++;
+            continue;
+        }
+
+        out_escaped(&o, &c, 1, false);
+        i++;
+    }
+
+    tag_close_all(&o);
+    if (code) {
+        out_str(&o, "</pre>");
+    }
+    if (in_code) {
+        *in_code = code;
+    }
+
+    if (o.oom) {
+        free(o.buf);
+        return NULL;
+    }
+    return o.buf;
+}
+
+size_t tg_markdown_chunk_len(const char *md, size_t len, size_t max_len)
+{
+    if (len <= max_len) return len;
+    if (max_len == 0) return len > 0 ? 1 : 0;
+
+    size_t min_cut = max_len / 2;
+    size_t para_cut = 0, line_cut = 0, space_cut = 0;
+    bool in_fence = false;
+    bool in_code_span = false;
+    bool in_bold = false;
+    bool line_start = true;
+
+    for (size_t i = 0; i < max_len; i++) {
+        char c = md[i];
+        if (line_start && is_fence(md, len, i)) {
+            in_fence = !in_fence;
+        }
+        line_start = false;
+
+        if (c == '\n') {
+            in_code_span = false;
+            in_bold = false;
+            line_start = true;
+            if (i + 1 >= min_cut) {
+                line_cut = i + 1;
+                if (!in_fence && i > 0 && md[i - 1] == '\n') {
+                    para_cut = i + 1;
+                }
+            }
+            continue;
+        }
+        if (in_fence) continue;
+
+        if (c == '`') {
+            in_code_span = !in_code_span;
+        } else if (c == '*' && i + 1 < len && md[i + 1] == '*' && !in_code_span) {
+            in_bold = !in_bold;
+            i++;
+        } else if (c == ' ' && !in_code_span && !in_bold && i + 1 >= min_cut) {
+            space_cut = i + 1;
+        }
+    }
+
+    if (para_cut) return para_cut;
+    if (line_cut) return line_cut;
+    if (space_cut) return space_cut;
+
+    /* No natural break: back off to the start of a UTF-8 sequence */
+    size_t cut = max_len;
+    while (cut > 0 && ((unsigned char)md[cut] & 0xC0) == 0x80) cut--;
+    return cut > 0 ? cut : max_len;
+}
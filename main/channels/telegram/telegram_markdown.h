@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Convert LLM-style Markdown into Telegram HTML (parse_mode "HTML").
+ *
+ * Handles fenced/inline code, bold, italic, strikethrough, links, headings
+ * and bullets; bold inside a heading, already bold, adds no second <b>.
+ * Markers without a matching closer on the same line are kept as literal
+ * text, and every opened tag is closed before the output ends, so the
+ * result is always accepted by the Bot API entity parser.
+ *
+ * @param md       Markdown source (need not be NUL-terminated)
+ * @param len      Number of bytes of md to convert
+ * @param in_code  In: source starts inside a ``` fence (continuation chunk).
+ *                 Out: fence state at the end of the source. May be NULL.
+ * @return heap-allocated HTML string (caller frees), or NULL on OOM
+ */
+char *tg_markdown_to_html(const char *md, size_t len, bool *in_code);
+
+/**
+ * Pick the length of the next chunk of md that fits in max_len bytes.
+ * Prefers paragraph breaks, then line breaks, then spaces outside inline
+ * code/bold spans, and never splits a UTF-8 sequence.
+ *
+ * @return number of bytes to take (always > 0 when len > 0)
+ */
+size_t tg_markdown_chunk_len(const char *md, size_t len, size_t max_len);
@@ -14,17 +14,28 @@
 #include "heartbeat/heartbeat.h"
 #include "skills/skill_loader.h"
 #include "buddy/buddy.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+#include "heapprof/heap_prof.h"
+#include "arena/turn_arena.h"
+#include "bench/llm_mock.h"
+#include "bench/chan_mock.h"
+#include "bench/bench.h"
+#include "config/config_registry.h"
+#include "offline/offline_queue.h"
+#include "lua/lua_runner.h"
+#include "lua/lua_json_lib.h"
+#include "lua/lua_gpio_lib.h"
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <dirent.h>
 #include "esp_log.h"
 #include "esp_console.h"
 #include "esp_system.h"
 #include "esp_heap_caps.h"
-#include "nvs_flash.h"
-#include "nvs.h"
 #include "argtable3/argtable3.h"
 
 static const char *TAG = "cli";
@@ -100,6 +111,61 @@ static int cmd_tg_send(int argc, char **argv)
     return (err == ESP_OK) ? 0 : 1;
 }
 
+/* --- tg_stats command --- */
+static int cmd_tg_stats(int argc, char **argv)
+{
+    uint32_t chunks = 0, fallbacks = 0;
+    telegram_get_send_stats(&chunks, &fallbacks);
+    printf("Chunks sent:    %u\n", (unsigned)chunks);
+    printf("Plain fallback: %u\n", (unsigned)fallbacks);
+
+    telegram_webhook_stats_t hook;
+    telegram_get_webhook_stats(&hook);
+    printf("Ingest mode:    %s\n", hook.enabled ? "webhook" : "long poll");
+    if (hook.enabled) {
+        printf("Webhook updates:  %u (rejected %u, retried %u)\n",
+               (unsigned)hook.updates, (unsigned)hook.rejected, (unsigned)hook.retried);
+        printf("Ingest->bus (us): last=%lld avg=%lld max=%lld\n",
+               (long long)hook.latency_last_us, (long long)hook.latency_avg_us,
+               (long long)hook.latency_max_us);
+    }
+    return 0;
+}
+
+/* --- set_tg_webhook command --- */
+static struct {
+    struct arg_str *url;
+    struct arg_end *end;
+} tg_webhook_args;
+
+static int cmd_set_tg_webhook(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&tg_webhook_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, tg_webhook_args.end, argv[0]);
+        return 1;
+    }
+    esp_err_t err = telegram_set_webhook(tg_webhook_args.url->sval[0]);
+    if (err != ESP_OK) {
+        printf("Failed to save webhook URL: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("Webhook URL saved. Restart to apply.\n");
+    return 0;
+}
+
+/* --- clear_tg_webhook command --- */
+static int cmd_clear_tg_webhook(int argc, char **argv)
+{
+    esp_err_t err = telegram_set_webhook(NULL);
+    if (err != ESP_OK) {
+        printf("Failed to clear webhook URL: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("Webhook cleared, long polling after restart.\n");
+    return 0;
+}
+
 /* --- set_feishu_creds command --- */
 static struct {
     struct arg_str *app_id;
@@ -145,6 +211,21 @@ static int cmd_feishu_send(int argc, char **argv)
     return (err == ESP_OK) ? 0 : 1;
 }
 
+/* --- feishu_stats command --- */
+static int cmd_feishu_stats(int argc, char **argv)
+{
+    feishu_token_stats_t st;
+    feishu_get_token_stats(&st);
+    printf("Token refreshes: %u (failed %u)\n", (unsigned)st.refreshes, (unsigned)st.failures);
+    printf("Inline waits:    %u\n", (unsigned)st.waits);
+    printf("Token expires:   %lds\n", (long)st.expires_in_s);
+
+    uint32_t builds = 0, avg_us = 0;
+    feishu_get_card_stats(&builds, &avg_us);
+    printf("Card bodies:     %u (avg %u us)\n", (unsigned)builds, (unsigned)avg_us);
+    return 0;
+}
+
 /* --- set_api_key command --- */
 static struct {
     struct arg_str *key;
@@ -199,6 +280,29 @@ static int cmd_set_model_provider(int argc, char **argv)
     return 0;
 }
 
+/* --- set_api_url command --- */
+static struct {
+    struct arg_str *url;
+    struct arg_end *end;
+} api_url_args;
+
+static int cmd_set_api_url(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&api_url_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, api_url_args.end, argv[0]);
+        return 1;
+    }
+    const char *url = api_url_args.url->sval[0];
+    if (strcmp(url, "default") == 0) url = NULL;
+    if (llm_set_api_url(url) != ESP_OK) {
+        printf("Invalid URL.\n");
+        return 1;
+    }
+    printf(url ? "API URL set.\n" : "API URL reset to provider default.\n");
+    return 0;
+}
+
 /* --- memory_read command --- */
 static int cmd_memory_read(int argc, char **argv)
 {
@@ -272,6 +376,408 @@ static int cmd_heap_info(int argc, char **argv)
            (int)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
     printf("Total free:    %d bytes\n",
            (int)esp_get_free_heap_size());
+    printf("PSRAM largest: %d bytes\n",
+           (int)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+
+    turn_arena_stats_t arena;
+    turn_arena_get_stats(&arena);
+    printf("Turn arena:    %u blocks, last %u / peak %u bytes, %u heap fallbacks over %u turns\n",
+           (unsigned)arena.blocks, (unsigned)arena.last_bytes, (unsigned)arena.peak_bytes,
+           (unsigned)arena.fallback_allocs, (unsigned)arena.turns);
+    return 0;
+}
+
+/* --- metrics command --- */
+static int cmd_metrics(int argc, char **argv)
+{
+    char *text = metrics_render();
+    if (!text) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    fputs(text, stdout);
+    free(text);
+    return 0;
+}
+
+/* --- trace command --- */
+static struct {
+    struct arg_str *action;
+    struct arg_end *end;
+} trace_args;
+
+static int cmd_trace(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&trace_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, trace_args.end, argv[0]);
+        return 1;
+    }
+    const char *action = trace_args.action->count ? trace_args.action->sval[0] : "stats";
+
+    if (strcmp(action, "on") == 0 || strcmp(action, "off") == 0) {
+        trace_set_enabled(strcmp(action, "on") == 0);
+    } else if (strcmp(action, "clear") == 0) {
+        trace_clear();
+    } else if (strcmp(action, "dump") == 0) {
+        char *json = trace_export_json();
+        if (!json) {
+            printf("Out of memory.\n");
+            return 1;
+        }
+        fputs(json, stdout);
+        free(json);
+        return 0;
+    } else if (strcmp(action, "stats") != 0) {
+        printf("Usage: trace [on|off|clear|dump|stats]\n");
+        return 1;
+    }
+
+    uint32_t count = 0, capacity = 0, lost = 0;
+    trace_get_stats(&count, &capacity, &lost);
+    printf("Tracing %s: %u/%u events, %u lost\n",
+           trace_is_enabled() ? "on" : "off",
+           (unsigned)count, (unsigned)capacity, (unsigned)lost);
+    return 0;
+}
+
+/* --- heap_prof command --- */
+static struct {
+    struct arg_str *action;
+    struct arg_end *end;
+} heap_prof_args;
+
+static int cmd_heap_prof(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&heap_prof_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, heap_prof_args.end, argv[0]);
+        return 1;
+    }
+    const char *action = heap_prof_args.action->count ? heap_prof_args.action->sval[0] : "report";
+
+    if (strcmp(action, "on") == 0 || strcmp(action, "off") == 0) {
+        heap_prof_set_enabled(strcmp(action, "on") == 0);
+        return 0;
+    } else if (strcmp(action, "reset") == 0) {
+        heap_prof_reset();
+        return 0;
+    } else if (strcmp(action, "snapshot") == 0) {
+        heap_region_snapshot_t snap[2];
+        heap_prof_get_snapshot(snap, true);
+    } else if (strcmp(action, "report") != 0) {
+        printf("Usage: heap_prof [report|snapshot|reset|on|off]\n");
+        return 1;
+    }
+
+    char *text = heap_prof_report();
+    if (!text) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+    fputs(text, stdout);
+    free(text);
+    return 0;
+}
+
+/* --- offline command --- */
+static struct {
+    struct arg_str *action;
+    struct arg_end *end;
+} offline_args;
+
+static int cmd_offline(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&offline_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, offline_args.end, argv[0]);
+        return 1;
+    }
+    const char *action = offline_args.action->count ? offline_args.action->sval[0] : "status";
+
+    if (strcmp(action, "down") == 0 || strcmp(action, "up") == 0) {
+        offline_queue_set_forced_down(strcmp(action, "down") == 0);
+    } else if (strcmp(action, "clear") == 0) {
+        offline_queue_clear();
+    } else if (strcmp(action, "status") != 0) {
+        printf("Usage: offline [status|down|up|clear]\n");
+        return 1;
+    }
+
+    static const char *names[OFFLINE_DIR_COUNT] = { "turns", "replies" };
+    printf("Link: %s\n", offline_queue_link_up() ? "up" : "down");
+    for (int d = 0; d < OFFLINE_DIR_COUNT; d++) {
+        offline_stats_t st;
+        offline_queue_get_stats((offline_dir_t)d, &st);
+        printf("  %-8s pending=%u replayed=%u expired=%u dropped=%u duplicates=%u\n",
+               names[d], (unsigned)st.pending, (unsigned)st.replayed, (unsigned)st.expired,
+               (unsigned)st.dropped, (unsigned)st.duplicates);
+    }
+    return 0;
+}
+
+/* --- llm_mock command --- */
+static struct {
+    struct arg_str *action;
+    struct arg_int *latency;
+    struct arg_int *chunks;
+    struct arg_int *chunk_ms;
+    struct arg_int *tools;
+    struct arg_int *errors;
+    struct arg_int *bytes;
+    struct arg_str *tool;
+    struct arg_end *end;
+} llm_mock_args;
+
+static int cmd_llm_mock(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&llm_mock_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, llm_mock_args.end, argv[0]);
+        return 1;
+    }
+    const char *action = llm_mock_args.action->count ? llm_mock_args.action->sval[0] : "status";
+
+    llm_mock_config_t cfg;
+    uint32_t requests = 0, errors = 0;
+    bool running = llm_mock_get_status(&cfg, &requests, &errors);
+
+    if (strcmp(action, "start") == 0) {
+        if (!running) llm_mock_default_config(&cfg);
+        if (llm_mock_args.latency->count) cfg.latency_ms = llm_mock_args.latency->ival[0];
+        if (llm_mock_args.chunks->count) cfg.chunks = llm_mock_args.chunks->ival[0];
+        if (llm_mock_args.chunk_ms->count) cfg.chunk_ms = llm_mock_args.chunk_ms->ival[0];
+        if (llm_mock_args.tools->count) cfg.tool_rounds = llm_mock_args.tools->ival[0];
+        if (llm_mock_args.errors->count) cfg.error_pct = llm_mock_args.errors->ival[0];
+        if (llm_mock_args.bytes->count) cfg.reply_bytes = llm_mock_args.bytes->ival[0];
+        if (llm_mock_args.tool->count) {
+            strncpy(cfg.tool_name, llm_mock_args.tool->sval[0], sizeof(cfg.tool_name) - 1);
+            cfg.tool_name[sizeof(cfg.tool_name) - 1] = '\0';
+        }
+        if (llm_mock_start(&cfg) != ESP_OK) {
+            printf("Failed to start mock server.\n");
+            return 1;
+        }
+        running = llm_mock_get_status(&cfg, &requests, &errors);
+        printf("Use: set_api_url http://127.0.0.1:%d/v1/messages (anthropic) or "
+               ".../v1/chat/completions (openai)\n", MIMI_LLM_MOCK_PORT);
+    } else if (strcmp(action, "stop") == 0) {
+        llm_mock_stop();
+        printf("Mock stopped. Restore the provider with: set_api_url default\n");
+        return 0;
+    } else if (strcmp(action, "status") != 0) {
+        printf("Usage: llm_mock [start|stop|status] [options]\n");
+        return 1;
+    }
+
+    if (!running) {
+        printf("Mock LLM: stopped\n");
+        return 0;
+    }
+    printf("Mock LLM on port %d: latency=%ums chunks=%u/%ums tool_rounds=%u (%s) "
+           "errors=%u%% reply=%uB, %u requests, %u errors\n",
+           MIMI_LLM_MOCK_PORT, (unsigned)cfg.latency_ms, (unsigned)cfg.chunks,
+           (unsigned)cfg.chunk_ms, (unsigned)cfg.tool_rounds, cfg.tool_name,
+           (unsigned)cfg.error_pct, (unsigned)cfg.reply_bytes,
+           (unsigned)requests, (unsigned)errors);
+    return 0;
+}
+
+/* --- bench command --- */
+static struct {
+    struct arg_int *turns;
+    struct arg_int *concurrency;
+    struct arg_end *end;
+} bench_args;
+
+static int cmd_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bench_args.end, argv[0]);
+        return 1;
+    }
+    int turns = bench_args.turns->ival[0];
+    int concurrency = bench_args.concurrency->count ? bench_args.concurrency->ival[0] : 1;
+
+    char *report = NULL;
+    esp_err_t err = bench_run(turns, concurrency, 0, &report);
+    if (err != ESP_OK) {
+        printf("Benchmark failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("%s\n", report);
+    free(report);
+    return 0;
+}
+
+/* --- stream_bench command --- */
+static struct {
+    struct arg_str *channel;
+    struct arg_int *snapshots;
+    struct arg_int *gap_ms;
+    struct arg_end *end;
+} stream_bench_args;
+
+static int cmd_stream_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&stream_bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, stream_bench_args.end, argv[0]);
+        return 1;
+    }
+    const char *channel = stream_bench_args.channel->sval[0];
+    int snapshots = stream_bench_args.snapshots->count ? stream_bench_args.snapshots->ival[0] : 10;
+    int gap_ms = stream_bench_args.gap_ms->count ? stream_bench_args.gap_ms->ival[0] : 150;
+
+    bool telegram = strcmp(channel, MIMI_CHAN_TELEGRAM) == 0;
+    if (!telegram && strcmp(channel, MIMI_CHAN_FEISHU) != 0) {
+        printf("Usage: stream_bench <telegram|feishu> [snapshots] [gap_ms]\n");
+        return 1;
+    }
+    if (chan_mock_start() != ESP_OK) {
+        printf("Failed to start mock server.\n");
+        return 1;
+    }
+
+    /* Point the channel at the mock for the run only */
+    char base[64];
+    if (telegram) {
+        snprintf(base, sizeof(base), "http://127.0.0.1:%d", MIMI_CHAN_MOCK_PORT);
+        telegram_set_api_base(base);
+    } else {
+        snprintf(base, sizeof(base), "http://127.0.0.1:%d/open-apis", MIMI_CHAN_MOCK_PORT);
+        feishu_set_api_base(base);
+    }
+
+    char *report = NULL;
+    esp_err_t err = chan_mock_stream_bench(channel, snapshots, gap_ms, &report);
+
+    if (telegram) {
+        telegram_set_api_base(NULL);
+    } else {
+        feishu_set_api_base(NULL);
+    }
+    chan_mock_stop();
+
+    if (report) {
+        printf("%s\n", report);
+        free(report);
+    }
+    if (err != ESP_OK) {
+        printf("Stream benchmark failed: %s (channel enabled, credentials set, link up?)\n",
+               esp_err_to_name(err));
+        return 1;
+    }
+    return 0;
+}
+
+/* --- tg_replay command --- */
+static struct {
+    struct arg_str *path;
+    struct arg_int *batch;
+    struct arg_end *end;
+} tg_replay_args;
+
+static int cmd_tg_replay(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&tg_replay_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, tg_replay_args.end, argv[0]);
+        return 1;
+    }
+    const char *path = tg_replay_args.path->sval[0];
+    int batch = tg_replay_args.batch->count ? tg_replay_args.batch->ival[0]
+                                            : MIMI_TG_REPLAY_POLL_BATCH;
+
+    char *report = NULL;
+    esp_err_t err = telegram_replay_bench(path, batch, &report);
+    if (err != ESP_OK) {
+        printf("Replay failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("%s\n", report);
+    free(report);
+    return 0;
+}
+
+/* --- lua_bench command --- */
+static struct {
+    struct arg_int *runs;
+    struct arg_end *end;
+} lua_bench_args;
+
+static int cmd_lua_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&lua_bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, lua_bench_args.end, argv[0]);
+        return 1;
+    }
+    int runs = lua_bench_args.runs->count ? lua_bench_args.runs->ival[0] : 100;
+
+    char *report = NULL;
+    esp_err_t err = lua_runner_bench(runs, &report);
+    if (err != ESP_OK) {
+        printf("Lua benchmark failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("%s\n", report);
+    free(report);
+    return 0;
+}
+
+/* --- lua_json_bench command --- */
+static struct {
+    struct arg_int *iters;
+    struct arg_end *end;
+} lua_json_bench_args;
+
+static int cmd_lua_json_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&lua_json_bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, lua_json_bench_args.end, argv[0]);
+        return 1;
+    }
+    int iters = lua_json_bench_args.iters->count ? lua_json_bench_args.iters->ival[0] : 100;
+
+    char *report = NULL;
+    esp_err_t err = lua_json_bench(iters, &report);
+    if (err != ESP_OK) {
+        printf("JSON benchmark failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("%s\n", report);
+    free(report);
+    return 0;
+}
+
+/* --- lua_gpio_bench command --- */
+static struct {
+    struct arg_int *pin;
+    struct arg_int *iters;
+    struct arg_end *end;
+} lua_gpio_bench_args;
+
+static int cmd_lua_gpio_bench(int argc, char **argv)
+{
+    int nerrors = arg_parse(argc, argv, (void **)&lua_gpio_bench_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, lua_gpio_bench_args.end, argv[0]);
+        return 1;
+    }
+    int pin = lua_gpio_bench_args.pin->ival[0];
+    int iters = lua_gpio_bench_args.iters->count ? lua_gpio_bench_args.iters->ival[0] : 10000;
+
+    char *report = NULL;
+    esp_err_t err = lua_gpio_bench(pin, iters, &report);
+    if (err != ESP_OK) {
+        printf("GPIO benchmark failed: %s\n", esp_err_to_name(err));
+        return 1;
+    }
+    printf("%s\n", report);
+    free(report);
     return 0;
 }
 
@@ -527,14 +1033,9 @@ static void print_config(const char *label, const char *ns, const char *key,
     const char *display = "(empty)";
 
     /* NVS takes highest priority */
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
-        size_t len = sizeof(nvs_val);
-        if (nvs_get_str(nvs, key, nvs_val, &len) == ESP_OK && nvs_val[0]) {
-            source = "NVS";
-            display = nvs_val;
-        }
-        nvs_close(nvs);
+    if (config_get_str(ns, key, nvs_val, sizeof(nvs_val)) == ESP_OK && nvs_val[0]) {
+        source = "NVS";
+        display = nvs_val;
     }
 
     /* Fall back to build-time value */
@@ -556,14 +1057,10 @@ static void print_config_int(const char *label, const char *ns, const char *nvs_
     strncpy(value, default_val, sizeof(value) - 1);
     const char *source = "build";
 
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
-        int32_t temp;
-        if (nvs_get_i32(nvs, nvs_key, &temp) == ESP_OK) {
-            snprintf(value, sizeof(value), "%d", (int)temp);
-            source = "NVS";
-        }
-        nvs_close(nvs);
+    int32_t temp;
+    if (config_get_i32(ns, nvs_key, &temp) == ESP_OK) {
+        snprintf(value, sizeof(value), "%d", (int)temp);
+        source = "NVS";
     }
 
     if (strcmp(source, "not set") == 0) {
@@ -580,14 +1077,10 @@ static void print_config_bool(const char *label, const char *ns, const char *key
     bool value = build_val;
 
     /* NVS takes highest priority */
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
-        uint8_t bool_val = 0;
-        if (nvs_get_u8(nvs, key, &bool_val) == ESP_OK) {
-            source = "NVS";
-            value = bool_val ? true : false;
-        }
-        nvs_close(nvs);
+    uint8_t bool_val = 0;
+    if (config_get_u8(ns, key, &bool_val) == ESP_OK) {
+        source = "NVS";
+        value = bool_val ? true : false;
     }
 
     /* Fall back to build-time value */
@@ -660,6 +1153,11 @@ static int cmd_config_show(int argc, char **argv)
     print_config_bool("Telegram Bot",  MIMI_NVS_FEATURE, MIMI_NVS_KEY_TELEGRAM_BOT,    MIMI_FEATURE_TELEGRAM_BOT);
     print_config_bool("Feishu Bot",    MIMI_NVS_FEATURE, MIMI_NVS_KEY_FEISHU_BOT,      MIMI_FEATURE_FEISHU_BOT);
 
+    config_stats_t cs;
+    config_get_stats(&cs);
+    printf("\n%u keys set, %u changes, %u NVS writes, %u pending\n",
+           (unsigned)cs.keys, (unsigned)cs.sets, (unsigned)cs.nvs_writes, (unsigned)cs.pending);
+
     printf("=============================\n");
     return 0;
 }
@@ -671,13 +1169,9 @@ static int cmd_config_reset(int argc, char **argv)
         MIMI_NVS_WIFI, MIMI_NVS_TG, MIMI_NVS_FEISHU, MIMI_NVS_LLM, MIMI_NVS_PROXY, MIMI_NVS_SEARCH, MIMI_NVS_FEATURE
     };
     for (int i = 0; i < 7; i++) {
-        nvs_handle_t nvs;
-        if (nvs_open(namespaces[i], NVS_READWRITE, &nvs) == ESP_OK) {
-            nvs_erase_all(nvs);
-            nvs_commit(nvs);
-            nvs_close(nvs);
-        }
+        config_erase_ns(namespaces[i]);
     }
+    config_flush();
     printf("All NVS config cleared. Build-time defaults will be used on restart.\n");
     return 0;
 }
@@ -956,6 +1450,33 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&tg_send_cmd);
 
+    /* tg_stats */
+    esp_console_cmd_t tg_stats_cmd = {
+        .command = "tg_stats",
+        .help = "Show Telegram send counters (chunks, plain-text fallbacks)",
+        .func = &cmd_tg_stats,
+    };
+    esp_console_cmd_register(&tg_stats_cmd);
+
+    /* set_tg_webhook */
+    tg_webhook_args.url = arg_str1(NULL, NULL, "<url>", "Public HTTPS URL routed to " MIMI_TG_WEBHOOK_PATH);
+    tg_webhook_args.end = arg_end(1);
+    esp_console_cmd_t tg_webhook_cmd = {
+        .command = "set_tg_webhook",
+        .help = "Receive Telegram updates via webhook instead of long polling",
+        .func = &cmd_set_tg_webhook,
+        .argtable = &tg_webhook_args,
+    };
+    esp_console_cmd_register(&tg_webhook_cmd);
+
+    /* clear_tg_webhook */
+    esp_console_cmd_t tg_webhook_clear_cmd = {
+        .command = "clear_tg_webhook",
+        .help = "Remove Telegram webhook URL (back to long polling)",
+        .func = &cmd_clear_tg_webhook,
+    };
+    esp_console_cmd_register(&tg_webhook_clear_cmd);
+
     /* set_feishu_creds */
     feishu_creds_args.app_id = arg_str1(NULL, NULL, "<app_id>", "Feishu App ID");
     feishu_creds_args.app_secret = arg_str1(NULL, NULL, "<app_secret>", "Feishu App Secret");
@@ -980,6 +1501,14 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&feishu_send_cmd);
 
+    /* feishu_stats */
+    esp_console_cmd_t feishu_stats_cmd = {
+        .command = "feishu_stats",
+        .help = "Show Feishu token refresh and card build stats",
+        .func = &cmd_feishu_stats,
+    };
+    esp_console_cmd_register(&feishu_stats_cmd);
+
     /* set_api_key */
     api_key_args.key = arg_str1(NULL, NULL, "<key>", "LLM API key");
     api_key_args.end = arg_end(1);
@@ -1002,6 +1531,17 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&model_cmd);
 
+    /* set_api_url */
+    api_url_args.url = arg_str1(NULL, NULL, "<url|default>", "Endpoint override, e.g. http://192.168.1.10:8080/v1/messages");
+    api_url_args.end = arg_end(1);
+    esp_console_cmd_t api_url_cmd = {
+        .command = "set_api_url",
+        .help = "Point the LLM client at another endpoint (mock server, gateway)",
+        .func = &cmd_set_api_url,
+        .argtable = &api_url_args,
+    };
+    esp_console_cmd_register(&api_url_cmd);
+
     /* set_model_provider */
     provider_args.provider = arg_str1(NULL, NULL, "<provider>", "Model provider (anthropic|openai)");
     provider_args.end = arg_end(1);
@@ -1089,6 +1629,138 @@ esp_err_t serial_cli_init(void)
     };
     esp_console_cmd_register(&heap_cmd);
 
+    /* metrics */
+    esp_console_cmd_t metrics_cmd = {
+        .command = "metrics",
+        .help = "Dump metrics in Prometheus text format (same as GET /metrics)",
+        .func = &cmd_metrics,
+    };
+    esp_console_cmd_register(&metrics_cmd);
+
+    /* trace */
+    trace_args.action = arg_str0(NULL, NULL, "<on|off|clear|dump|stats>", "Action (default: stats)");
+    trace_args.end = arg_end(1);
+    esp_console_cmd_t trace_cmd = {
+        .command = "trace",
+        .help = "Span tracing; dump prints Chrome trace JSON for Perfetto",
+        .func = &cmd_trace,
+        .argtable = &trace_args,
+    };
+    esp_console_cmd_register(&trace_cmd);
+
+    /* heap_prof */
+    heap_prof_args.action = arg_str0(NULL, NULL, "<report|snapshot|reset|on|off>",
+                                     "Action (default: report)");
+    heap_prof_args.end = arg_end(1);
+    esp_console_cmd_t heap_prof_cmd = {
+        .command = "heap_prof",
+        .help = "Heap use by subsystem and free-block distribution; snapshot re-walks the heap",
+        .func = &cmd_heap_prof,
+        .argtable = &heap_prof_args,
+    };
+    esp_console_cmd_register(&heap_prof_cmd);
+
+    /* offline */
+    offline_args.action = arg_str0(NULL, NULL, "<status|down|up|clear>",
+                                   "Action (default: status); down simulates an outage");
+    offline_args.end = arg_end(1);
+    esp_console_cmd_t offline_cmd = {
+        .command = "offline",
+        .help = "Offline journals of deferred turns and replies",
+        .func = &cmd_offline,
+        .argtable = &offline_args,
+    };
+    esp_console_cmd_register(&offline_cmd);
+
+    /* llm_mock */
+    llm_mock_args.action = arg_str0(NULL, NULL, "<start|stop|status>", "Action (default: status)");
+    llm_mock_args.latency = arg_int0("l", "latency", "<ms>", "Delay before each response");
+    llm_mock_args.chunks = arg_int0("c", "chunks", "<n>", "Send each body in n chunks");
+    llm_mock_args.chunk_ms = arg_int0("g", "gap", "<ms>", "Delay between chunks");
+    llm_mock_args.tools = arg_int0("t", "tools", "<n>", "Tool-call rounds before the final reply");
+    llm_mock_args.errors = arg_int0("e", "errors", "<pct>", "Percent of requests answered 529/429");
+    llm_mock_args.bytes = arg_int0("b", "bytes", "<n>", "Final reply length");
+    llm_mock_args.tool = arg_str0("n", "tool", "<name>", "Tool to call (default: get_current_time)");
+    llm_mock_args.end = arg_end(3);
+    esp_console_cmd_t llm_mock_cmd = {
+        .command = "llm_mock",
+        .help = "Local mock LLM provider for benchmarks (see set_api_url)",
+        .func = &cmd_llm_mock,
+        .argtable = &llm_mock_args,
+    };
+    esp_console_cmd_register(&llm_mock_cmd);
+
+    /* bench */
+    bench_args.turns = arg_int1(NULL, NULL, "<turns>", "Number of agent turns");
+    bench_args.concurrency = arg_int0(NULL, NULL, "<concurrency>", "Turns in flight (default: 1)");
+    bench_args.end = arg_end(2);
+    esp_console_cmd_t bench_cmd = {
+        .command = "bench",
+        .help = "Run synthetic agent turns and print a latency report (JSON)",
+        .func = &cmd_bench,
+        .argtable = &bench_args,
+    };
+    esp_console_cmd_register(&bench_cmd);
+
+    /* stream_bench */
+    stream_bench_args.channel = arg_str1(NULL, NULL, "<telegram|feishu>", "Channel to stream through");
+    stream_bench_args.snapshots = arg_int0(NULL, NULL, "<snapshots>", "In-progress snapshots (default: 10)");
+    stream_bench_args.gap_ms = arg_int0(NULL, NULL, "<gap_ms>", "Delay between snapshots (default: 150)");
+    stream_bench_args.end = arg_end(3);
+    esp_console_cmd_t stream_bench_cmd = {
+        .command = "stream_bench",
+        .help = "Stream a reply to a local mock Telegram/Feishu API and time the edits (JSON)",
+        .func = &cmd_stream_bench,
+        .argtable = &stream_bench_args,
+    };
+    esp_console_cmd_register(&stream_bench_cmd);
+
+    /* tg_replay */
+    tg_replay_args.path = arg_str1(NULL, NULL, "<path>", "Recorded updates, one JSON per line");
+    tg_replay_args.batch = arg_int0(NULL, NULL, "<batch>", "Updates per getUpdates response (default: 8)");
+    tg_replay_args.end = arg_end(2);
+    esp_console_cmd_t tg_replay_cmd = {
+        .command = "tg_replay",
+        .help = "Replay recorded Telegram updates via webhook and poll ingest, report latency (JSON)",
+        .func = &cmd_tg_replay,
+        .argtable = &tg_replay_args,
+    };
+    esp_console_cmd_register(&tg_replay_cmd);
+
+    /* lua_bench */
+    lua_bench_args.runs = arg_int0(NULL, NULL, "<runs>", "Runs per mode (default: 100)");
+    lua_bench_args.end = arg_end(1);
+    esp_console_cmd_t lua_bench_cmd = {
+        .command = "lua_bench",
+        .help = "Time a short Lua script cold vs on the warm pool (JSON)",
+        .func = &cmd_lua_bench,
+        .argtable = &lua_bench_args,
+    };
+    esp_console_cmd_register(&lua_bench_cmd);
+
+    /* lua_json_bench */
+    lua_json_bench_args.iters = arg_int0(NULL, NULL, "<iters>", "Calls per implementation (default: 100)");
+    lua_json_bench_args.end = arg_end(1);
+    esp_console_cmd_t lua_json_bench_cmd = {
+        .command = "lua_json_bench",
+        .help = "Time the native json library against pure Lua (JSON)",
+        .func = &cmd_lua_json_bench,
+        .argtable = &lua_json_bench_args,
+    };
+    esp_console_cmd_register(&lua_json_bench_cmd);
+
+    /* lua_gpio_bench */
+    lua_gpio_bench_args.pin = arg_int1(NULL, NULL, "<pin>", "Free GPIO to toggle");
+    lua_gpio_bench_args.iters = arg_int0(NULL, NULL, "<iters>", "Calls per operation (default: 10000)");
+    lua_gpio_bench_args.end = arg_end(2);
+    esp_console_cmd_t lua_gpio_bench_cmd = {
+        .command = "lua_gpio_bench",
+        .help = "Time Lua gpio calls, cached vs reconfiguring (JSON)",
+        .func = &cmd_lua_gpio_bench,
+        .argtable = &lua_gpio_bench_args,
+    };
+    esp_console_cmd_register(&lua_gpio_bench_cmd);
+
     /* set_search_key */
     search_key_args.key = arg_str1(NULL, NULL, "<key>", "Search API key (Tavily or Brave)");
     search_key_args.end = arg_end(1);
@@ -0,0 +1,600 @@
+#include "config_registry.h"
+#include "mimi_config.h"
+#include "metrics/metrics.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "config";
+
+typedef enum {
+    CONFIG_TYPE_STR = 0,
+    CONFIG_TYPE_U8,
+    CONFIG_TYPE_U16,
+    CONFIG_TYPE_I32,
+    CONFIG_TYPE_I64,
+} config_type_t;
+
+typedef struct {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint8_t type;
+    bool present;           /* false: erased, slot kept for reuse */
+    bool dirty;             /* RAM differs from NVS */
+    bool retyped;           /* NVS holds the key under another type */
+    union {
+        int64_t num;
+        char *str;
+    } v;
+} config_entry_t;
+
+typedef struct {
+    char ns[NVS_KEY_NAME_MAX_SIZE];     /* "" = every namespace */
+    config_change_cb_t cb;
+    void *arg;
+} config_sub_t;
+
+/* Namespaces loaded at boot; others are created on first set */
+static const char *s_namespaces[] = {
+    MIMI_NVS_WIFI, MIMI_NVS_TG, MIMI_NVS_FEISHU, MIMI_NVS_LLM,
+    MIMI_NVS_PROXY, MIMI_NVS_SEARCH, MIMI_NVS_FEATURE,
+};
+
+/* Slots are only appended, never moved, so indices stay valid unlocked */
+static config_entry_t *s_entries = NULL;
+static volatile int s_count = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static SemaphoreHandle_t s_flush_lock = NULL;
+static TaskHandle_t s_flush_task = NULL;
+
+static config_sub_t s_subs[MIMI_CONFIG_MAX_SUBSCRIBERS];
+static volatile int s_sub_count = 0;
+
+static uint32_t s_sets = 0;
+static uint32_t s_nvs_writes = 0;
+static metric_t *s_m_sets;
+static metric_t *s_m_writes;
+
+/* ── Entries ───────────────────────────────────────────────── */
+
+static bool valid_name(const char *s)
+{
+    return s && s[0] && strlen(s) < NVS_KEY_NAME_MAX_SIZE;
+}
+
+/* Caller holds s_lock. Returns the slot for ns/key, present or not, or -1 */
+static int find_entry(const char *ns, const char *key)
+{
+    for (int i = 0; i < s_count; i++) {
+        if (strcmp(s_entries[i].key, key) == 0 && strcmp(s_entries[i].ns, ns) == 0) return i;
+    }
+    return -1;
+}
+
+/* Caller holds s_lock */
+static config_entry_t *get_or_add(const char *ns, const char *key)
+{
+    int i = find_entry(ns, key);
+    if (i >= 0) return &s_entries[i];
+    if (s_count >= MIMI_CONFIG_MAX_ENTRIES) return NULL;
+
+    config_entry_t *e = &s_entries[s_count];
+    memset(e, 0, sizeof(*e));
+    strncpy(e->ns, ns, sizeof(e->ns) - 1);
+    strncpy(e->key, key, sizeof(e->key) - 1);
+    s_count++;
+    return e;
+}
+
+static char *ps_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *copy = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (copy) memcpy(copy, s, len);
+    return copy;
+}
+
+static void release_value(config_entry_t *e)
+{
+    if (e->type == CONFIG_TYPE_STR) {
+        free(e->v.str);
+        e->v.str = NULL;
+    }
+}
+
+/* ── Notification and write-behind ─────────────────────────── */
+
+static void notify(const char *ns, const char *key)
+{
+    int n = s_sub_count;
+    for (int i = 0; i < n; i++) {
+        if (!s_subs[i].ns[0] || strcmp(s_subs[i].ns, ns) == 0) {
+            s_subs[i].cb(ns, key, s_subs[i].arg);
+        }
+    }
+}
+
+static void schedule_flush(void)
+{
+    if (s_flush_task) xTaskNotifyGive(s_flush_task);
+}
+
+static void flush_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* Wait for a quiet period so bursts of changes cost one write each */
+        int64_t first_us = esp_timer_get_time();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MIMI_CONFIG_FLUSH_DELAY_MS)) > 0 &&
+               esp_timer_get_time() - first_us < (int64_t)MIMI_CONFIG_FLUSH_MAX_MS * 1000) {
+        }
+        config_flush();
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void flush_on_shutdown(void)
+{
+    config_flush();
+}
+#endif
+
+/* ── Setters ───────────────────────────────────────────────── */
+
+static esp_err_t set_value(const char *ns, const char *key, config_type_t type,
+                           int64_t num, const char *str)
+{
+    if (!valid_name(ns) || !valid_name(key) || (type == CONFIG_TYPE_STR && !str)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_entries) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    config_entry_t *e = get_or_add(ns, key);
+    if (!e) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGE(TAG, "Registry full (%d keys), %s/%s not set", MIMI_CONFIG_MAX_ENTRIES, ns, key);
+        return ESP_ERR_NO_MEM;
+    }
+    if (e->present && e->type == type &&
+        (type == CONFIG_TYPE_STR ? strcmp(e->v.str, str) == 0 : e->v.num == num)) {
+        xSemaphoreGive(s_lock);
+        return ESP_OK;      /* unchanged: no write, no event */
+    }
+
+    char *copy = NULL;
+    if (type == CONFIG_TYPE_STR && !(copy = ps_strdup(str))) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    if (e->present && e->type != type) e->retyped = true;
+    release_value(e);
+    e->type = type;
+    if (type == CONFIG_TYPE_STR) {
+        e->v.str = copy;
+    } else {
+        e->v.num = num;
+    }
+    e->present = true;
+    e->dirty = true;
+    s_sets++;
+    xSemaphoreGive(s_lock);
+
+    metric_inc(s_m_sets);
+    notify(ns, key);
+    schedule_flush();
+    return ESP_OK;
+}
+
+esp_err_t config_set_str(const char *ns, const char *key, const char *value)
+{
+    return set_value(ns, key, CONFIG_TYPE_STR, 0, value);
+}
+
+esp_err_t config_set_u8(const char *ns, const char *key, uint8_t value)
+{
+    return set_value(ns, key, CONFIG_TYPE_U8, value, NULL);
+}
+
+esp_err_t config_set_u16(const char *ns, const char *key, uint16_t value)
+{
+    return set_value(ns, key, CONFIG_TYPE_U16, value, NULL);
+}
+
+esp_err_t config_set_i32(const char *ns, const char *key, int32_t value)
+{
+    return set_value(ns, key, CONFIG_TYPE_I32, value, NULL);
+}
+
+esp_err_t config_set_i64(const char *ns, const char *key, int64_t value)
+{
+    return set_value(ns, key, CONFIG_TYPE_I64, value, NULL);
+}
+
+esp_err_t config_erase(const char *ns, const char *key)
+{
+    if (!valid_name(ns) || !valid_name(key)) return ESP_ERR_INVALID_ARG;
+    if (!s_entries) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int i = find_entry(ns, key);
+    if (i < 0 || !s_entries[i].present) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    release_value(&s_entries[i]);
+    s_entries[i].present = false;
+    s_entries[i].dirty = true;
+    s_sets++;
+    xSemaphoreGive(s_lock);
+
+    metric_inc(s_m_sets);
+    notify(ns, key);
+    schedule_flush();
+    return ESP_OK;
+}
+
+esp_err_t config_erase_ns(const char *ns)
+{
+    if (!valid_name(ns)) return ESP_ERR_INVALID_ARG;
+    if (!s_entries) return ESP_ERR_INVALID_STATE;
+
+    int erased = 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_count; i++) {
+        config_entry_t *e = &s_entries[i];
+        if (!e->present || strcmp(e->ns, ns) != 0) continue;
+        release_value(e);
+        e->present = false;
+        e->dirty = true;
+        erased++;
+    }
+    s_sets += erased;
+    xSemaphoreGive(s_lock);
+
+    if (erased) {
+        metric_add(s_m_sets, erased);
+        notify(ns, NULL);
+        schedule_flush();
+    }
+    return ESP_OK;
+}
+
+/* ── Getters ───────────────────────────────────────────────── */
+
+/* Caller holds s_lock */
+static const config_entry_t *lookup(const char *ns, const char *key, config_type_t type)
+{
+    if (!s_entries || !ns || !key) return NULL;
+    int i = find_entry(ns, key);
+    if (i < 0 || !s_entries[i].present || s_entries[i].type != type) return NULL;
+    return &s_entries[i];
+}
+
+esp_err_t config_get_str(const char *ns, const char *key, char *out, size_t size)
+{
+    if (!out || size == 0) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) return ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const config_entry_t *e = lookup(ns, key, CONFIG_TYPE_STR);
+    if (e) {
+        strncpy(out, e->v.str, size - 1);
+        out[size - 1] = '\0';
+    }
+    xSemaphoreGive(s_lock);
+    return e ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t get_num(const char *ns, const char *key, config_type_t type, int64_t *out)
+{
+    if (!s_lock) return ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    const config_entry_t *e = lookup(ns, key, type);
+    if (e) *out = e->v.num;
+    xSemaphoreGive(s_lock);
+    return e ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t config_get_u8(const char *ns, const char *key, uint8_t *out)
+{
+    int64_t v;
+    esp_err_t err = get_num(ns, key, CONFIG_TYPE_U8, &v);
+    if (err == ESP_OK) *out = (uint8_t)v;
+    return err;
+}
+
+esp_err_t config_get_u16(const char *ns, const char *key, uint16_t *out)
+{
+    int64_t v;
+    esp_err_t err = get_num(ns, key, CONFIG_TYPE_U16, &v);
+    if (err == ESP_OK) *out = (uint16_t)v;
+    return err;
+}
+
+esp_err_t config_get_i32(const char *ns, const char *key, int32_t *out)
+{
+    int64_t v;
+    esp_err_t err = get_num(ns, key, CONFIG_TYPE_I32, &v);
+    if (err == ESP_OK) *out = (int32_t)v;
+    return err;
+}
+
+esp_err_t config_get_i64(const char *ns, const char *key, int64_t *out)
+{
+    return get_num(ns, key, CONFIG_TYPE_I64, out);
+}
+
+bool config_get_bool(const char *ns, const char *key, bool def)
+{
+    uint8_t v;
+    return config_get_u8(ns, key, &v) == ESP_OK ? v != 0 : def;
+}
+
+/* ── Subscriptions and stats ───────────────────────────────── */
+
+esp_err_t config_subscribe(const char *ns, config_change_cb_t cb, void *arg)
+{
+    if (!cb || (ns && !valid_name(ns))) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_sub_count >= MIMI_CONFIG_MAX_SUBSCRIBERS) {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    config_sub_t *sub = &s_subs[s_sub_count];
+    memset(sub, 0, sizeof(*sub));
+    if (ns) strncpy(sub->ns, ns, sizeof(sub->ns) - 1);
+    sub->cb = cb;
+    sub->arg = arg;
+    s_sub_count++;      /* published last: notify() reads without the lock */
+    xSemaphoreGive(s_lock);
+    return ESP_OK;
+}
+
+void config_get_stats(config_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s_lock) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < s_count; i++) {
+        if (s_entries[i].present) out->keys++;
+        if (s_entries[i].dirty) out->pending++;
+    }
+    out->sets = s_sets;
+    out->nvs_writes = s_nvs_writes;
+    xSemaphoreGive(s_lock);
+}
+
+/* ── Flush ─────────────────────────────────────────────────── */
+
+typedef struct {
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    nvs_handle_t handle;
+} open_ns_t;
+
+static esp_err_t open_ns(open_ns_t *open, int *n_open, const char *ns, nvs_handle_t *out)
+{
+    for (int i = 0; i < *n_open; i++) {
+        if (strcmp(open[i].ns, ns) == 0) {
+            *out = open[i].handle;
+            return ESP_OK;
+        }
+    }
+    if (*n_open >= MIMI_CONFIG_MAX_NAMESPACES) return ESP_ERR_NO_MEM;
+    esp_err_t err = nvs_open(ns, NVS_READWRITE, out);
+    if (err != ESP_OK) return err;
+    strncpy(open[*n_open].ns, ns, sizeof(open[0].ns) - 1);
+    open[*n_open].ns[sizeof(open[0].ns) - 1] = '\0';
+    open[*n_open].handle = *out;
+    (*n_open)++;
+    return ESP_OK;
+}
+
+static esp_err_t write_entry(nvs_handle_t nvs, const config_entry_t *e)
+{
+    if (!e->present || e->retyped) {
+        esp_err_t err = nvs_erase_key(nvs, e->key);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) return err;
+        if (!e->present) return ESP_OK;
+    }
+    switch (e->type) {
+    case CONFIG_TYPE_STR: return nvs_set_str(nvs, e->key, e->v.str);
+    case CONFIG_TYPE_U8:  return nvs_set_u8(nvs, e->key, (uint8_t)e->v.num);
+    case CONFIG_TYPE_U16: return nvs_set_u16(nvs, e->key, (uint16_t)e->v.num);
+    case CONFIG_TYPE_I32: return nvs_set_i32(nvs, e->key, (int32_t)e->v.num);
+    default:              return nvs_set_i64(nvs, e->key, e->v.num);
+    }
+}
+
+esp_err_t config_flush(void)
+{
+    if (!s_flush_lock) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_flush_lock, portMAX_DELAY);
+    open_ns_t open[MIMI_CONFIG_MAX_NAMESPACES];
+    int n_open = 0;
+    uint32_t written = 0;
+    esp_err_t result = ESP_OK;
+
+    int count = s_count;
+    for (int i = 0; i < count; i++) {
+        /* Take a private copy so setters never wait on flash */
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        config_entry_t snap = s_entries[i];
+        if (!snap.dirty) {
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+        if (snap.present && snap.type == CONFIG_TYPE_STR) snap.v.str = strdup(snap.v.str);
+        s_entries[i].dirty = false;
+        s_entries[i].retyped = false;
+        xSemaphoreGive(s_lock);
+
+        nvs_handle_t nvs;
+        esp_err_t err = (snap.present && snap.type == CONFIG_TYPE_STR && !snap.v.str)
+                        ? ESP_ERR_NO_MEM : open_ns(open, &n_open, snap.ns, &nvs);
+        if (err == ESP_OK) err = write_entry(nvs, &snap);
+        if (snap.present && snap.type == CONFIG_TYPE_STR) free(snap.v.str);
+
+        if (err == ESP_OK) {
+            written++;
+        } else {
+            ESP_LOGW(TAG, "Write %s/%s failed: %s", snap.ns, snap.key, esp_err_to_name(err));
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s_entries[i].dirty = true;      /* retried on the next flush */
+            s_entries[i].retyped |= snap.retyped;
+            xSemaphoreGive(s_lock);
+            result = err;
+        }
+    }
+
+    for (int i = 0; i < n_open; i++) {
+        esp_err_t err = nvs_commit(open[i].handle);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Commit %s failed: %s", open[i].ns, esp_err_to_name(err));
+            result = err;
+        }
+        nvs_close(open[i].handle);
+    }
+
+    if (written) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_nvs_writes += written;
+        xSemaphoreGive(s_lock);
+        metric_add(s_m_writes, written);
+        ESP_LOGD(TAG, "Flushed %u keys", (unsigned)written);
+    }
+    xSemaphoreGive(s_flush_lock);
+    return result;
+}
+
+/* ── Init ──────────────────────────────────────────────────── */
+
+static void load_entry(nvs_handle_t nvs, const nvs_entry_info_t *info)
+{
+    config_entry_t *e = &s_entries[s_count];
+    memset(e, 0, sizeof(*e));
+    strncpy(e->ns, info->namespace_name, sizeof(e->ns) - 1);
+    strncpy(e->key, info->key, sizeof(e->key) - 1);
+
+    esp_err_t err;
+    switch (info->type) {
+    case NVS_TYPE_STR: {
+        size_t len = 0;
+        err = nvs_get_str(nvs, info->key, NULL, &len);
+        if (err == ESP_OK) {
+            e->v.str = heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+            err = e->v.str ? nvs_get_str(nvs, info->key, e->v.str, &len) : ESP_ERR_NO_MEM;
+        }
+        e->type = CONFIG_TYPE_STR;
+        break;
+    }
+    case NVS_TYPE_U8: {
+        uint8_t v = 0;
+        err = nvs_get_u8(nvs, info->key, &v);
+        e->type = CONFIG_TYPE_U8;
+        e->v.num = v;
+        break;
+    }
+    case NVS_TYPE_U16: {
+        uint16_t v = 0;
+        err = nvs_get_u16(nvs, info->key, &v);
+        e->type = CONFIG_TYPE_U16;
+        e->v.num = v;
+        break;
+    }
+    case NVS_TYPE_I32: {
+        int32_t v = 0;
+        err = nvs_get_i32(nvs, info->key, &v);
+        e->type = CONFIG_TYPE_I32;
+        e->v.num = v;
+        break;
+    }
+    case NVS_TYPE_I64:
+        err = nvs_get_i64(nvs, info->key, &e->v.num);
+        e->type = CONFIG_TYPE_I64;
+        break;
+    default:
+        ESP_LOGW(TAG, "Skipping %s/%s: unsupported NVS type", info->namespace_name, info->key);
+        return;
+    }
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Read %s/%s failed: %s", info->namespace_name, info->key, esp_err_to_name(err));
+        release_value(e);
+        return;
+    }
+    e->present = true;
+    s_count++;
+}
+
+static void load_namespace(const char *ns)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(ns, NVS_READONLY, &nvs) != ESP_OK) return;     /* never written */
+
+    nvs_iterator_t it = NULL;
+    esp_err_t res = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns, NVS_TYPE_ANY, &it);
+    while (res == ESP_OK) {
+        nvs_entry_info_t info;
+        nvs_entry_info(it, &info);
+        if (s_count >= MIMI_CONFIG_MAX_ENTRIES) {
+            ESP_LOGE(TAG, "Registry full, %s/%s not loaded", ns, info.key);
+        } else if (find_entry(ns, info.key) >= 0) {
+            ESP_LOGW(TAG, "Duplicate key %s/%s under another type, first kept", ns, info.key);
+        } else {
+            load_entry(nvs, &info);
+        }
+        res = nvs_entry_next(&it);
+    }
+    nvs_release_iterator(it);
+    nvs_close(nvs);
+}
+
+esp_err_t config_init(void)
+{
+    if (s_entries) return ESP_OK;
+
+    s_entries = heap_caps_calloc(MIMI_CONFIG_MAX_ENTRIES, sizeof(config_entry_t), MALLOC_CAP_SPIRAM);
+    s_lock = xSemaphoreCreateMutex();
+    s_flush_lock = xSemaphoreCreateMutex();
+    if (!s_entries || !s_lock || !s_flush_lock) {
+        ESP_LOGE(TAG, "Out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_m_sets = metrics_counter("mimi_config_sets_total", "Config changes accepted", NULL);
+    s_m_writes = metrics_counter("mimi_config_nvs_writes_total", "Config keys written to NVS", NULL);
+
+    int64_t start_us = esp_timer_get_time();
+    for (size_t i = 0; i < sizeof(s_namespaces) / sizeof(s_namespaces[0]); i++) {
+        load_namespace(s_namespaces[i]);
+    }
+
+    if (xTaskCreate(flush_task, "cfg_flush", MIMI_CONFIG_FLUSH_STACK, NULL,
+                    MIMI_CONFIG_FLUSH_PRIO, &s_flush_task) != pdPASS) {
+        ESP_LOGW(TAG, "Write-behind task not started; changes are written on config_flush()");
+    }
+#if !CONFIG_IDF_TARGET_LINUX
+    esp_register_shutdown_handler(flush_on_shutdown);
+#endif
+
+    ESP_LOGI(TAG, "Config registry: %d keys loaded in %d ms", s_count,
+             (int)((esp_timer_get_time() - start_us) / 1000));
+    return ESP_OK;
+}
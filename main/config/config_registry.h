@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Runtime configuration registry: every MIMI_NVS_* namespace loaded into
+ * RAM once at boot, with typed accessors and change notification.
+ *
+ * Reads never touch NVS. Writes update RAM immediately, notify
+ * subscribers, and are written back by a background task once the key has
+ * been quiet for MIMI_CONFIG_FLUSH_DELAY_MS (at most
+ * MIMI_CONFIG_FLUSH_MAX_MS after the first pending change). Setting a key
+ * to its current value is a no-op, so per-turn bookkeeping costs no flash
+ * writes. esp_restart() flushes through a shutdown handler; a reset or
+ * power loss inside the window loses the pending changes.
+ *
+ * Keys keep the NVS types already in use (str, u8, u16, i32, i64); a get with
+ * the wrong type behaves like a missing key, as in NVS. Build-time secrets
+ * still take priority where modules apply them.
+ */
+
+/**
+ * Load all config namespaces from NVS and start the write-behind task.
+ * Call after nvs_flash_init() and before any module reads config.
+ */
+esp_err_t config_init(void);
+
+/**
+ * Copy a string into out (truncated to size). ESP_ERR_NOT_FOUND if unset.
+ */
+esp_err_t config_get_str(const char *ns, const char *key, char *out, size_t size);
+esp_err_t config_get_u8(const char *ns, const char *key, uint8_t *out);
+esp_err_t config_get_u16(const char *ns, const char *key, uint16_t *out);
+esp_err_t config_get_i32(const char *ns, const char *key, int32_t *out);
+esp_err_t config_get_i64(const char *ns, const char *key, int64_t *out);
+
+/** u8 flag, or def when unset. */
+bool config_get_bool(const char *ns, const char *key, bool def);
+
+esp_err_t config_set_str(const char *ns, const char *key, const char *value);
+esp_err_t config_set_u8(const char *ns, const char *key, uint8_t value);
+esp_err_t config_set_u16(const char *ns, const char *key, uint16_t value);
+esp_err_t config_set_i32(const char *ns, const char *key, int32_t value);
+esp_err_t config_set_i64(const char *ns, const char *key, int64_t value);
+
+/** Remove a key (ESP_ERR_NOT_FOUND if unset). */
+esp_err_t config_erase(const char *ns, const char *key);
+
+/** Remove every key of a namespace. */
+esp_err_t config_erase_ns(const char *ns);
+
+/**
+ * Change callback, run synchronously in the task that made the change,
+ * after the new value is visible. key is NULL for config_erase_ns().
+ */
+typedef void (*config_change_cb_t)(const char *ns, const char *key, void *arg);
+
+/** Subscribe to changes in ns (NULL: every namespace). */
+esp_err_t config_subscribe(const char *ns, config_change_cb_t cb, void *arg);
+
+/** Write every pending change to NVS now. */
+esp_err_t config_flush(void);
+
+typedef struct {
+    uint32_t keys;              /* keys currently set */
+    uint32_t sets;              /* changes accepted (no-op sets excluded) */
+    uint32_t nvs_writes;        /* keys written or erased in NVS */
+    uint32_t pending;           /* changes not yet written */
+} config_stats_t;
+
+void config_get_stats(config_stats_t *out);
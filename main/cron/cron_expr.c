@@ -0,0 +1,328 @@
+#include "cron/cron_expr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+
+/* Long enough for Feb 29 on a given weekday to come round again */
+#define SEARCH_YEARS  28
+
+static const char *const s_month_names[] = {
+    "jan", "feb", "mar", "apr", "may", "jun",
+    "jul", "aug", "sep", "oct", "nov", "dec",
+};
+
+static const char *const s_weekday_names[] = {
+    "sun", "mon", "tue", "wed", "thu", "fri", "sat",
+};
+
+static const struct {
+    const char *name;
+    const char *expr;
+} s_macros[] = {
+    { "@yearly",   "0 0 1 1 *" },
+    { "@annually", "0 0 1 1 *" },
+    { "@monthly",  "0 0 1 * *" },
+    { "@weekly",   "0 0 * * 0" },
+    { "@daily",    "0 0 * * *" },
+    { "@midnight", "0 0 * * *" },
+    { "@hourly",   "0 * * * *" },
+};
+
+/* ── Parsing ──────────────────────────────────────────────────── */
+
+typedef struct {
+    const char *label;
+    int lo, hi;
+    const char *const *names;   /* names[i] stands for lo + i */
+    int name_count;
+} field_def_t;
+
+static const field_def_t s_fields[5] = {
+    { "minute",       0, 59, NULL,            0 },
+    { "hour",         0, 23, NULL,            0 },
+    { "day of month", 1, 31, NULL,            0 },
+    { "month",        1, 12, s_month_names,   12 },
+    { "day of week",  0, 7,  s_weekday_names, 7 },
+};
+
+/* A number or, where the field has them, a three-letter name */
+static bool parse_value(const char **p, const field_def_t *f, int *out)
+{
+    const char *s = *p;
+    if (isdigit((unsigned char)*s)) {
+        long v = 0;
+        while (isdigit((unsigned char)*s) && v <= f->hi) v = v * 10 + (*s++ - '0');
+        if (isdigit((unsigned char)*s)) return false;
+        *out = (int)v;
+    } else if (f->names) {
+        int i;
+        for (i = 0; i < f->name_count; i++) {
+            if (strncasecmp(s, f->names[i], 3) == 0 && !isalpha((unsigned char)s[3])) break;
+        }
+        if (i == f->name_count) return false;
+        *out = f->lo + i;
+        s += 3;
+    } else {
+        return false;
+    }
+    if (*out < f->lo || *out > f->hi) return false;
+    *p = s;
+    return true;
+}
+
+/* One comma-separated field: *, N, N-M, each with an optional /step */
+static bool parse_field(const char *text, const field_def_t *f, uint64_t *bits)
+{
+    const char *p = text;
+    *bits = 0;
+    for (;;) {
+        int lo, hi, step = 1;
+        bool single = false;
+        if (*p == '*') {
+            lo = f->lo;
+            hi = f->hi;
+            p++;
+        } else {
+            if (!parse_value(&p, f, &lo)) return false;
+            hi = lo;
+            single = true;
+            if (*p == '-') {
+                p++;
+                if (!parse_value(&p, f, &hi) || hi < lo) return false;
+                single = false;
+            }
+        }
+        if (*p == '/') {
+            p++;
+            if (!isdigit((unsigned char)*p)) return false;
+            long v = 0;
+            while (isdigit((unsigned char)*p) && v <= f->hi) v = v * 10 + (*p++ - '0');
+            if (v < 1 || v > f->hi) return false;
+            step = (int)v;
+            /* "N/step" runs from N to the end of the range */
+            if (single) hi = f->hi;
+        }
+        for (int v = lo; v <= hi; v += step) *bits |= 1ULL << v;
+        if (*p == '\0') return true;
+        if (*p++ != ',') return false;
+    }
+}
+
+esp_err_t cron_expr_parse(const char *text, cron_expr_t *out, char *err, size_t err_size)
+{
+    if (!text || !out) {
+        snprintf(err, err_size, "empty expression");
+        return ESP_ERR_INVALID_ARG;
+    }
+    while (isspace((unsigned char)*text)) text++;
+
+    if (*text == '@') {
+        for (size_t i = 0; i < sizeof(s_macros) / sizeof(s_macros[0]); i++) {
+            size_t n = strlen(s_macros[i].name);
+            if (strncasecmp(text, s_macros[i].name, n) == 0 &&
+                (text[n] == '\0' || isspace((unsigned char)text[n]))) {
+                return cron_expr_parse(s_macros[i].expr, out, err, err_size);
+            }
+        }
+        snprintf(err, err_size, "unknown shorthand '%s'", text);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char buf[96];
+    if (strlen(text) >= sizeof(buf)) {
+        snprintf(err, err_size, "expression too long");
+        return ESP_ERR_INVALID_ARG;
+    }
+    strcpy(buf, text);
+
+    char *fields[6];
+    int n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(buf, " \t", &save); tok && n < 6; tok = strtok_r(NULL, " \t", &save)) {
+        fields[n++] = tok;
+    }
+    if (n != 5) {
+        snprintf(err, err_size, "expected 5 fields (minute hour day month weekday), got %d", n);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint64_t bits[5];
+    for (int i = 0; i < 5; i++) {
+        if (!parse_field(fields[i], &s_fields[i], &bits[i])) {
+            snprintf(err, err_size, "bad %s field '%s' (%d-%d)",
+                     s_fields[i].label, fields[i], s_fields[i].lo, s_fields[i].hi);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    memset(out, 0, sizeof(*out));
+    out->minutes = bits[0];
+    out->hours = (uint32_t)bits[1];
+    out->days = (uint32_t)bits[2];
+    out->months = (uint16_t)bits[3];
+    out->weekdays = (uint8_t)((bits[4] | (bits[4] >> 7)) & 0x7f);   /* 7 is Sunday too */
+    out->dom_any = fields[2][0] == '*';
+    out->dow_any = fields[4][0] == '*';
+    return ESP_OK;
+}
+
+/* ── Next fire time ───────────────────────────────────────────── */
+
+/* Lowest set bit at or above from, or -1 */
+static int next_bit(uint64_t bits, int from)
+{
+    if (from >= 64) return -1;
+    bits >>= from;
+    return bits ? from + __builtin_ctzll(bits) : -1;
+}
+
+static int days_in_month(int year, int month)
+{
+    static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap ? 29 : days[month - 1];
+}
+
+/* 0 = Sunday (Sakamoto) */
+static int weekday(int year, int month, int day)
+{
+    static const uint8_t t[12] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+    if (month < 3) year--;
+    return (year + year / 4 - year / 100 + year / 400 + t[month - 1] + day) % 7;
+}
+
+/* Days of the month that match, as bits 1-31 */
+static uint32_t month_day_bits(const cron_expr_t *e, int year, int month)
+{
+    int dim = days_in_month(year, month);
+    uint32_t valid = (uint32_t)(((1ULL << dim) - 1) << 1);
+
+    uint32_t by_dow = 0;
+    int wd = weekday(year, month, 1);
+    for (int d = 1; d <= dim; d++) {
+        if (e->weekdays & (1u << wd)) by_dow |= 1u << d;
+        wd = wd == 6 ? 0 : wd + 1;
+    }
+    /* A field starting with '*' only narrows the other; two restricted fields widen */
+    if (e->dom_any || e->dow_any) return e->days & by_dow & valid;
+    return (e->days | by_dow) & valid;
+}
+
+/* Comparable key of a local minute */
+static int64_t local_key(int year, int month, int day, int hour, int minute)
+{
+    return ((((int64_t)year * 13 + month) * 32 + day) * 24 + hour) * 60 + minute;
+}
+
+static int64_t key_of(time_t t)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    return local_key(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min);
+}
+
+/*
+ * The instant a local minute starts: its first occurrence when the clock
+ * falls back, or the jump itself when a DST gap skips it.
+ */
+static int64_t local_to_epoch(int year, int month, int day, int hour, int minute)
+{
+    int64_t want = local_key(year, month, day, hour, minute);
+    int64_t found = 0, lo = 0, hi = 0;
+
+    for (int isdst = 0; isdst <= 1; isdst++) {
+        struct tm tm = {
+            .tm_year = year - 1900, .tm_mon = month - 1, .tm_mday = day,
+            .tm_hour = hour, .tm_min = minute, .tm_isdst = isdst,
+        };
+        time_t t = mktime(&tm);
+        if (t == (time_t)-1) continue;
+        if (key_of(t) == want) {
+            if (!found || t < found) found = t;
+        }
+        if (!lo || t < lo) lo = t;
+        if (!hi || t > hi) hi = t;
+    }
+    if (found || lo == hi) return found;
+
+    /* In a gap: the two readings straddle the jump, find its first minute */
+    while (hi - lo > 60) {
+        int64_t mid = lo + (hi - lo) / 2;
+        mid -= mid % 60;
+        if (mid <= lo) break;
+        if (key_of((time_t)mid) >= want) hi = mid;
+        else lo = mid;
+    }
+    return hi;
+}
+
+int64_t cron_expr_next(const cron_expr_t *e, int64_t after)
+{
+    time_t start = (time_t)after;
+    struct tm tm;
+    localtime_r(&start, &tm);
+
+    int year = tm.tm_year + 1900, month = tm.tm_mon + 1, day = tm.tm_mday;
+    int hour = tm.tm_hour, minute = tm.tm_min + 1;
+    int last_year = year + SEARCH_YEARS;
+    int mask_year = 0, mask_month = 0;
+    uint32_t day_bits = 0;
+
+    while (year <= last_year) {
+        int m = next_bit(e->months, month);
+        if (m < 0) {
+            year++;
+            month = 1, day = 1, hour = 0, minute = 0;
+            continue;
+        }
+        if (m != month) {
+            month = m;
+            day = 1, hour = 0, minute = 0;
+        }
+
+        if (year != mask_year || month != mask_month) {
+            day_bits = month_day_bits(e, year, month);
+            mask_year = year;
+            mask_month = month;
+        }
+        int d = next_bit(day_bits, day);
+        if (d < 0) {
+            month++;
+            day = 1, hour = 0, minute = 0;
+            continue;
+        }
+        if (d != day) {
+            day = d;
+            hour = 0, minute = 0;
+        }
+
+        int h = next_bit(e->hours, hour);
+        if (h < 0) {
+            day++;
+            hour = 0, minute = 0;
+            continue;
+        }
+        if (h != hour) {
+            hour = h;
+            minute = 0;
+        }
+
+        int mi = next_bit(e->minutes, minute);
+        if (mi < 0) {
+            hour++;
+            minute = 0;
+            continue;
+        }
+        minute = mi;
+
+        int64_t t = local_to_epoch(year, month, day, hour, minute);
+        if (t > after) return t;
+        /* Already passed: the second pass of a repeated hour, or a jump we are past */
+        minute++;
+    }
+    return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Standard 5-field cron expressions: "minute hour day-of-month month
+ * day-of-week", evaluated in local time (TZ, set to MIMI_TIMEZONE by the
+ * cron service). Each field takes *, N, N-M, lists and /step; months and
+ * weekdays also take names (jan, mon) and weekday 7 is Sunday. @hourly,
+ * @daily, @weekly, @monthly and @yearly are shorthands. As in Vixie cron,
+ * when both day fields are restricted a day matching either one fires;
+ * when either starts with '*' a day must match both.
+ *
+ * Each field is kept as a bitset, so the next fire time is found by
+ * jumping to the next set bit of each field instead of probing minutes.
+ */
+
+typedef struct {
+    uint64_t minutes;   /* bits 0-59 */
+    uint32_t hours;     /* bits 0-23 */
+    uint32_t days;      /* bits 1-31 */
+    uint16_t months;    /* bits 1-12 */
+    uint8_t  weekdays;  /* bits 0-6, Sunday = 0 */
+    bool     dom_any;   /* day-of-month field starts with '*' */
+    bool     dow_any;   /* day-of-week field starts with '*' */
+} cron_expr_t;
+
+/**
+ * Parse text into *out.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG with the reason in err
+ */
+esp_err_t cron_expr_parse(const char *text, cron_expr_t *out, char *err, size_t err_size);
+
+/**
+ * First local minute after `after` (unix seconds) that matches, as unix
+ * seconds. A time skipped by a DST jump fires at the jump; a time repeated
+ * when the clock falls back fires at its first occurrence only.
+ * @return the fire time, or 0 if nothing matches within 28 years
+ */
+int64_t cron_expr_next(const cron_expr_t *expr, int64_t after);
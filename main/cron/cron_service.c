@@ -6,22 +6,49 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "cron";
 
 #define MAX_CRON_JOBS  MIMI_CRON_MAX_JOBS
 
-static cron_job_t s_jobs[MAX_CRON_JOBS];
+/* Wall clock below this has not been synced yet: nothing is scheduled */
+#define CLOCK_VALID_EPOCH   1600000000
+
+static cron_job_t *s_jobs = NULL;       /* MAX_CRON_JOBS, in PSRAM; never moves */
 static int s_job_count = 0;
 static TaskHandle_t s_cron_task = NULL;
+static uint32_t s_generation = 0;       /* bumped by cron_service_stop() */
+static SemaphoreHandle_t s_lock = NULL; /* s_jobs and the heap */
+
+/* Min-heap of the indices of scheduled jobs, ordered by next_run */
+static uint16_t *s_heap = NULL;
+static int s_heap_len = 0;
+
+static bool s_clock_valid = false;
+static int64_t s_clock_offset_us = 0;   /* wall clock minus esp_timer at the last wake */
+static bool s_dirty = false;            /* last_run/next_run changed since the last save */
+static time_t s_last_save = 0;
 
 static esp_err_t cron_save_jobs(void);
 
+static const char *cron_kind_name(cron_kind_t kind)
+{
+    switch (kind) {
+    case CRON_KIND_EVERY: return "every";
+    case CRON_KIND_AT:    return "at";
+    default:              return "cron";
+    }
+}
+
 static bool cron_sanitize_destination(cron_job_t *job)
 {
     bool changed = false;
@@ -72,7 +99,7 @@ static esp_err_t cron_load_jobs(void)
     long fsize = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    if (fsize <= 0 || fsize > 8192) {
+    if (fsize <= 0 || fsize > MIMI_CRON_FILE_MAX) {
         ESP_LOGW(TAG, "Cron file invalid size: %ld", fsize);
         fclose(f);
         s_job_count = 0;
@@ -151,6 +178,15 @@ static esp_err_t cron_load_jobs(void)
             cJSON *at_epoch = cJSON_GetObjectItem(item, "at_epoch");
             job->at_epoch = (at_epoch && cJSON_IsNumber(at_epoch))
                             ? (int64_t)at_epoch->valuedouble : 0;
+        } else if (strcmp(kind_str, "cron") == 0) {
+            job->kind = CRON_KIND_CRON;
+            const char *expr = cJSON_GetStringValue(cJSON_GetObjectItem(item, "expr"));
+            char err[96];
+            if (!expr || cron_expr_parse(expr, &job->spec, err, sizeof(err)) != ESP_OK) {
+                ESP_LOGW(TAG, "Skipping cron job %s: %s", id, expr ? err : "no expr");
+                continue;
+            }
+            strncpy(job->expr, expr, sizeof(job->expr) - 1);
         } else {
             continue; /* Unknown kind, skip */
         }
@@ -186,13 +222,14 @@ static esp_err_t cron_save_jobs(void)
         cJSON_AddStringToObject(item, "id", job->id);
         cJSON_AddStringToObject(item, "name", job->name);
         cJSON_AddBoolToObject(item, "enabled", job->enabled);
-        cJSON_AddStringToObject(item, "kind",
-            job->kind == CRON_KIND_EVERY ? "every" : "at");
+        cJSON_AddStringToObject(item, "kind", cron_kind_name(job->kind));
 
         if (job->kind == CRON_KIND_EVERY) {
             cJSON_AddNumberToObject(item, "interval_s", job->interval_s);
-        } else {
+        } else if (job->kind == CRON_KIND_AT) {
             cJSON_AddNumberToObject(item, "at_epoch", (double)job->at_epoch);
+        } else {
+            cJSON_AddStringToObject(item, "expr", job->expr);
         }
 
         cJSON_AddStringToObject(item, "message", job->message);
@@ -218,136 +255,317 @@ static esp_err_t cron_save_jobs(void)
     FILE *f = fopen(MIMI_CRON_FILE, "w");
     if (!f) {
         ESP_LOGE(TAG, "Failed to open %s for writing", MIMI_CRON_FILE);
-        free(json_str);
+        cJSON_free(json_str);
         return ESP_FAIL;
     }
 
     size_t len = strlen(json_str);
     size_t written = fwrite(json_str, 1, len, f);
     fclose(f);
-    free(json_str);
+    cJSON_free(json_str);
 
     if (written != len) {
         ESP_LOGE(TAG, "Cron save incomplete: %d/%d bytes", (int)written, (int)len);
         return ESP_FAIL;
     }
 
+    s_dirty = false;
+    s_last_save = time(NULL);
     ESP_LOGI(TAG, "Saved %d cron jobs to %s", s_job_count, MIMI_CRON_FILE);
     return ESP_OK;
 }
 
-/* ── Due-job processing ───────────────────────────────────────── */
+/* ── Heap of next runs ────────────────────────────────────────── */
 
-static void cron_process_due_jobs(void)
+static bool cron_is_scheduled(const cron_job_t *job)
 {
-    time_t now = time(NULL);
+    if (!job->enabled || job->next_run <= 0) return false;
+    return job->kind != CRON_KIND_EVERY || job->interval_s > 0;
+}
 
-    bool changed = false;
+static bool heap_before(int a, int b)
+{
+    return s_jobs[s_heap[a]].next_run < s_jobs[s_heap[b]].next_run;
+}
+
+static void heap_swap(int a, int b)
+{
+    uint16_t t = s_heap[a];
+    s_heap[a] = s_heap[b];
+    s_heap[b] = t;
+}
+
+static void heap_sift_up(int i)
+{
+    while (i > 0 && heap_before(i, (i - 1) / 2)) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void heap_sift_down(int i)
+{
+    for (;;) {
+        int first = i;
+        int l = 2 * i + 1, r = l + 1;
+        if (l < s_heap_len && heap_before(l, first)) first = l;
+        if (r < s_heap_len && heap_before(r, first)) first = r;
+        if (first == i) return;
+        heap_swap(i, first);
+        i = first;
+    }
+}
+
+static void heap_push(int job_idx)
+{
+    s_heap[s_heap_len] = (uint16_t)job_idx;
+    heap_sift_up(s_heap_len++);
+}
+
+static void heap_pop(void)
+{
+    s_heap[0] = s_heap[--s_heap_len];
+    heap_sift_down(0);
+}
+
+/* After anything that moved jobs in s_jobs or changed many next_run values */
+static void heap_rebuild(void)
+{
+    s_heap_len = 0;
+    for (int i = 0; i < s_job_count; i++) {
+        if (cron_is_scheduled(&s_jobs[i])) s_heap[s_heap_len++] = (uint16_t)i;
+    }
+    for (int i = s_heap_len / 2 - 1; i >= 0; i--) {
+        heap_sift_down(i);
+    }
+}
+
+static void cron_delete_at(int idx)
+{
+    for (int j = idx; j < s_job_count - 1; j++) {
+        s_jobs[j] = s_jobs[j + 1];
+    }
+    s_job_count--;
+    heap_rebuild();
+}
+
+/* ── Clock ────────────────────────────────────────────────────── */
+
+static int64_t wall_clock_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
 
+/* First run of a job added or loaded without one */
+static void compute_initial_next_run(cron_job_t *job, time_t now)
+{
+    if (job->kind == CRON_KIND_EVERY) {
+        job->next_run = now + job->interval_s;
+    } else if (job->kind == CRON_KIND_AT) {
+        if (job->at_epoch > now) {
+            job->next_run = job->at_epoch;
+        } else {
+            /* Already in the past */
+            job->next_run = 0;
+            job->enabled = false;
+        }
+    } else {
+        job->next_run = cron_expr_next(&job->spec, now);
+        if (job->next_run == 0) job->enabled = false;   /* never matches */
+    }
+}
+
+/* The clock became valid: schedule what was waiting for it */
+static void cron_arm_jobs(time_t now)
+{
     for (int i = 0; i < s_job_count; i++) {
         cron_job_t *job = &s_jobs[i];
         if (!job->enabled) continue;
-        if (job->next_run <= 0) continue;
-        if (job->next_run > now) continue;
-
-        /* Job is due — fire it */
-        ESP_LOGI(TAG, "Cron job firing: %s (%s)", job->name, job->id);
-
-        /* Push message to inbound queue */
-        mimi_msg_t msg;
-        memset(&msg, 0, sizeof(msg));
-        strncpy(msg.channel, job->channel, sizeof(msg.channel) - 1);
-        strncpy(msg.chat_id, job->chat_id, sizeof(msg.chat_id) - 1);
-        msg.payload.text = strdup(job->message);
-
-        if (msg.payload.text) {
-            esp_err_t err = message_bus_push_inbound(&msg);
-            if (err != ESP_OK) {
-                ESP_LOGW(TAG, "Failed to push cron message: %s", esp_err_to_name(err));
-                free(msg.payload.text);
+        if (job->next_run <= 0) {
+            compute_initial_next_run(job, now);
+        } else if (job->kind == CRON_KIND_EVERY && job->next_run > now + job->interval_s) {
+            /* Saved under a clock that was ahead */
+            job->next_run = now + job->interval_s;
+        } else if (job->kind == CRON_KIND_CRON) {
+            int64_t next = cron_expr_next(&job->spec, now);
+            if (next > 0 && job->next_run > next) job->next_run = next;
+        }
+    }
+    heap_rebuild();
+}
+
+/*
+ * Compare the wall clock with esp_timer to notice SNTP setting it. An
+ * interval is a duration, so "every" jobs move with a step; "at" and
+ * "cron" jobs are wall-clock times and fire once if the step carried the
+ * clock past them. A step back re-plans "cron" jobs from the new time,
+ * or they would wait out the matches the clock now has to pass again.
+ */
+static void cron_check_clock(time_t now)
+{
+    int64_t offset = wall_clock_us() - esp_timer_get_time();
+    if (now < CLOCK_VALID_EPOCH) {
+        s_clock_valid = false;
+    } else if (!s_clock_valid) {
+        ESP_LOGI(TAG, "Clock valid, scheduling %d jobs", s_job_count);
+        s_clock_valid = true;
+        cron_arm_jobs(now);
+    } else {
+        int64_t step_s = (offset - s_clock_offset_us) / 1000000;
+        if (step_s >= MIMI_CRON_CLOCK_STEP_S || step_s <= -MIMI_CRON_CLOCK_STEP_S) {
+            ESP_LOGI(TAG, "Clock stepped by %llds, rescheduling jobs", (long long)step_s);
+            for (int i = 0; i < s_job_count; i++) {
+                cron_job_t *job = &s_jobs[i];
+                if (!cron_is_scheduled(job)) continue;
+                if (job->kind == CRON_KIND_EVERY) {
+                    job->next_run += step_s;
+                } else if (job->kind == CRON_KIND_CRON) {
+                    int64_t next = cron_expr_next(&job->spec, now);
+                    if (next > 0 && job->next_run > next) job->next_run = next;
+                }
             }
+            heap_rebuild();
+            s_dirty = true;
+        }
+    }
+    s_clock_offset_us = offset;
+}
+
+/* ── Due-job processing ───────────────────────────────────────── */
+
+static void cron_fire(const cron_job_t *job)
+{
+    ESP_LOGI(TAG, "Cron job firing: %s (%s)", job->name, job->id);
+
+    /* Push message to inbound queue */
+    mimi_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    strncpy(msg.channel, job->channel, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, job->chat_id, sizeof(msg.chat_id) - 1);
+    msg.payload.text = strdup(job->message);
+
+    if (msg.payload.text) {
+        esp_err_t err = message_bus_push_inbound(&msg);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to push cron message: %s", esp_err_to_name(err));
+            free(msg.payload.text);
         }
+    }
+}
 
-        /* Update state */
+/* Fire every job whose next_run has come, earliest first */
+static void cron_process_due_jobs(time_t now)
+{
+    bool removed = false;
+
+    while (s_heap_len > 0) {
+        int idx = s_heap[0];
+        cron_job_t *job = &s_jobs[idx];
+        if (job->next_run > now) break;
+
+        cron_fire(job);
         job->last_run = now;
+        s_dirty = true;
 
         if (job->kind == CRON_KIND_AT) {
             /* One-shot: disable or delete */
             if (job->delete_after_run) {
-                /* Remove by shifting array */
                 ESP_LOGI(TAG, "Deleting one-shot job: %s", job->name);
-                for (int j = i; j < s_job_count - 1; j++) {
-                    s_jobs[j] = s_jobs[j + 1];
-                }
-                s_job_count--;
-                i--; /* Re-check this index */
+                cron_delete_at(idx);
+                removed = true;
             } else {
                 job->enabled = false;
                 job->next_run = 0;
+                heap_pop();
+            }
+        } else if (job->kind == CRON_KIND_CRON) {
+            /* The next match after now: missed runs fire once, as for "every" */
+            job->next_run = cron_expr_next(&job->spec, now);
+            if (job->next_run == 0) {
+                job->enabled = false;
+                heap_pop();
+            } else {
+                heap_sift_down(0);
             }
         } else {
-            /* Recurring: compute next run */
-            job->next_run = now + job->interval_s;
+            /* Missed runs (downtime, a clock step) fire once, not as a burst; keep the phase */
+            int64_t next = job->next_run + job->interval_s;
+            if (next <= now) {
+                next += ((now - next) / job->interval_s + 1) * job->interval_s;
+            }
+            job->next_run = next;
+            heap_sift_down(0);
         }
-
-        changed = true;
     }
 
-    if (changed) {
+    /* A fast job must not write SPIFFS every time it fires */
+    if (removed || (s_dirty && now - s_last_save >= MIMI_CRON_SAVE_MIN_S)) {
         cron_save_jobs();
     }
 }
 
-static void cron_task_main(void *arg)
+/* Until the next job is due or a deferred save is owed, capped at MIMI_CRON_MAX_SLEEP_S */
+static TickType_t cron_ticks_to_wake(void)
 {
-    (void)arg;
-    time_t now = time(NULL);
-
-    /* Recompute next_run for all enabled jobs that don't have one */
-    for (int i = 0; i < s_job_count; i++) {
-        cron_job_t *job = &s_jobs[i];
-        if (job->enabled && job->next_run <= 0) {
-            if (job->kind == CRON_KIND_EVERY) {
-                job->next_run = now + job->interval_s;
-            } else if (job->kind == CRON_KIND_AT && job->at_epoch > now) {
-                job->next_run = job->at_epoch;
-            } else if (job->kind == CRON_KIND_AT) {
-                /* at_epoch already in the past — disable the job */
-                job->enabled  = false;
-                job->next_run = 0;
-            }
+    int64_t now_us = wall_clock_us();
+    int64_t wait_us = (int64_t)MIMI_CRON_MAX_SLEEP_S * 1000000;
+    if (s_clock_valid) {
+        if (s_heap_len == 0 && !s_dirty) return portMAX_DELAY;
+        if (s_heap_len > 0) {
+            int64_t due = (int64_t)s_jobs[s_heap[0]].next_run * 1000000 - now_us;
+            if (due < wait_us) wait_us = due;
+        }
+        if (s_dirty) {
+            int64_t flush = (int64_t)(s_last_save + MIMI_CRON_SAVE_MIN_S) * 1000000 - now_us;
+            if (flush < wait_us) wait_us = flush;
         }
     }
+    if (wait_us <= 0) return 0;
+    /* Round up so the wakeup is not a tick early */
+    return pdMS_TO_TICKS((wait_us + 999) / 1000) + 1;
+}
 
-    while (1) {
-        vTaskDelay(pdMS_TO_TICKS(MIMI_CRON_CHECK_INTERVAL_MS));
-        cron_process_due_jobs();
+static void cron_task_main(void *arg)
+{
+    uint32_t generation = (uint32_t)(uintptr_t)arg;
+    s_clock_valid = false;      /* arms the jobs on the first pass */
+
+    while (generation == s_generation) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        time_t now = time(NULL);
+        cron_check_clock(now);
+        if (s_clock_valid) cron_process_due_jobs(now);
+        TickType_t wait = cron_ticks_to_wake();
+        xSemaphoreGive(s_lock);
+
+        /* Job changes and SNTP syncs notify; a timeout means a job is due */
+        ulTaskNotifyTake(pdTRUE, wait);
     }
+    vTaskDelete(NULL);
 }
 
-/* ── Compute initial next_run for a new job ───────────────────── */
-
-static void compute_initial_next_run(cron_job_t *job)
+static void cron_wake_task(void)
 {
-    time_t now = time(NULL);
-
-    if (job->kind == CRON_KIND_EVERY) {
-        job->next_run = now + job->interval_s;
-    } else if (job->kind == CRON_KIND_AT) {
-        if (job->at_epoch > now) {
-            job->next_run = job->at_epoch;
-        } else {
-            /* Already in the past */
-            job->next_run = 0;
-            job->enabled = false;
-        }
-    }
+    TaskHandle_t task = s_cron_task;
+    if (task) xTaskNotifyGive(task);
 }
 
 /* ── Public API ───────────────────────────────────────────────── */
 
 esp_err_t cron_service_init(void)
 {
+    /* "cron" jobs match in local time */
+    setenv("TZ", MIMI_TIMEZONE, 1);
+    tzset();
+
+    if (!s_jobs) {
+        s_jobs = heap_caps_calloc(MAX_CRON_JOBS, sizeof(cron_job_t), MALLOC_CAP_SPIRAM);
+        s_heap = heap_caps_calloc(MAX_CRON_JOBS, sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_jobs || !s_heap || !s_lock) return ESP_ERR_NO_MEM;
+    }
     return cron_load_jobs();
 }
 
@@ -362,7 +580,7 @@ esp_err_t cron_service_start(void)
         cron_task_main,
         "cron",
         4096,
-        NULL,
+        (void *)(uintptr_t)s_generation,
         4,
         &s_cron_task
     );
@@ -371,23 +589,32 @@ esp_err_t cron_service_start(void)
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "Cron service started (%d jobs, check every %ds)",
-             s_job_count, MIMI_CRON_CHECK_INTERVAL_MS / 1000);
+    ESP_LOGI(TAG, "Cron service started (%d jobs)", s_job_count);
     return ESP_OK;
 }
 
 void cron_service_stop(void)
 {
     if (s_cron_task) {
-        vTaskDelete(s_cron_task);
+        /* The task exits at its next wake, outside the lock */
+        s_generation++;
+        cron_wake_task();
         s_cron_task = NULL;
         ESP_LOGI(TAG, "Cron service stopped");
     }
 }
 
+void cron_service_clock_changed(void)
+{
+    cron_wake_task();
+}
+
 esp_err_t cron_add_job(cron_job_t *job)
 {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
     if (s_job_count >= MAX_CRON_JOBS) {
+        xSemaphoreGive(s_lock);
         ESP_LOGW(TAG, "Max cron jobs reached (%d)", MAX_CRON_JOBS);
         return ESP_ERR_NO_MEM;
     }
@@ -398,47 +625,57 @@ esp_err_t cron_add_job(cron_job_t *job)
     /* Validate/sanitize channel and chat_id before storing. */
     cron_sanitize_destination(job);
 
-    /* Compute initial next_run */
+    /* Compute initial next_run; before SNTP interval and cron jobs wait for the clock */
     job->enabled = true;
     job->last_run = 0;
-    compute_initial_next_run(job);
+    job->next_run = 0;
+    time_t now = time(NULL);
+    if (now >= CLOCK_VALID_EPOCH) {
+        compute_initial_next_run(job, now);
+    } else if (job->kind == CRON_KIND_AT) {
+        job->next_run = job->at_epoch;
+    }
 
-    /* Copy into static array */
     s_jobs[s_job_count] = *job;
+    if (s_clock_valid && cron_is_scheduled(job)) heap_push(s_job_count);
     s_job_count++;
 
     cron_save_jobs();
+    xSemaphoreGive(s_lock);
+    cron_wake_task();
 
     ESP_LOGI(TAG, "Added cron job: %s (%s) kind=%s next_run=%lld",
-             job->name, job->id,
-             job->kind == CRON_KIND_EVERY ? "every" : "at",
+             job->name, job->id, cron_kind_name(job->kind),
              (long long)job->next_run);
     return ESP_OK;
 }
 
 esp_err_t cron_remove_job(const char *job_id)
 {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
     for (int i = 0; i < s_job_count; i++) {
         if (strcmp(s_jobs[i].id, job_id) == 0) {
             ESP_LOGI(TAG, "Removing cron job: %s (%s)", s_jobs[i].name, job_id);
-
-            /* Shift remaining jobs down */
-            for (int j = i; j < s_job_count - 1; j++) {
-                s_jobs[j] = s_jobs[j + 1];
-            }
-            s_job_count--;
-
+            cron_delete_at(i);
             cron_save_jobs();
+            xSemaphoreGive(s_lock);
+            cron_wake_task();
             return ESP_OK;
         }
     }
+    xSemaphoreGive(s_lock);
 
     ESP_LOGW(TAG, "Cron job not found: %s", job_id);
     return ESP_ERR_NOT_FOUND;
 }
 
-void cron_list_jobs(const cron_job_t **jobs, int *count)
+int cron_list_jobs(cron_job_t *jobs, int max)
 {
-    *jobs = s_jobs;
-    *count = s_job_count;
+    if (!s_lock) return 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int count = s_job_count;
+    if (jobs && max > 0) memcpy(jobs, s_jobs, (size_t)(count < max ? count : max) * sizeof(*jobs));
+    xSemaphoreGive(s_lock);
+    return count;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "esp_err.h"
+#include "cron/cron_expr.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -8,6 +9,7 @@
 typedef enum {
     CRON_KIND_EVERY = 0,   /* Recurring interval in seconds */
     CRON_KIND_AT    = 1,   /* One-shot at unix timestamp */
+    CRON_KIND_CRON  = 2,   /* 5-field cron expression in MIMI_TIMEZONE local time */
 } cron_kind_t;
 
 /* A single cron job */
@@ -18,6 +20,8 @@ typedef struct {
     cron_kind_t kind;
     uint32_t interval_s;   /* For EVERY: interval in seconds */
     int64_t at_epoch;      /* For AT: unix timestamp */
+    char expr[64];         /* For CRON: expression as given */
+    cron_expr_t spec;      /* For CRON: parsed expr (not persisted) */
     char message[256];     /* Message to inject into inbound queue */
     char channel[16];      /* Reply channel (default "system") */
     char chat_id[96];      /* Reply chat_id/open_id (default "cron") */
@@ -26,6 +30,15 @@ typedef struct {
     bool delete_after_run; /* Remove job after firing (for AT jobs) */
 } cron_job_t;
 
+/*
+ * Jobs sit in a min-heap ordered by next_run; the cron task sleeps until
+ * the earliest one is due and is woken by a task notification when jobs
+ * are added or removed. Nothing is scheduled until the wall clock has been
+ * set. When SNTP steps the clock, "every" jobs move with it; "at" and
+ * "cron" jobs keep their wall-clock times, and a run the step skipped
+ * fires once.
+ */
+
 /**
  * Initialize the cron service. Loads jobs from SPIFFS.
  */
@@ -41,9 +54,15 @@ esp_err_t cron_service_start(void);
  */
 void cron_service_stop(void);
 
+/**
+ * Wake the cron task to re-read the wall clock (call after SNTP sets it).
+ */
+void cron_service_clock_changed(void);
+
 /**
  * Add a new cron job.
- * @param job  Pointer to job struct (id will be generated)
+ * @param job  Pointer to job struct (id will be generated; CRON jobs
+ *             need expr and spec filled in)
  * @return ESP_OK on success, ESP_ERR_NO_MEM if max jobs reached
  */
 esp_err_t cron_add_job(cron_job_t *job);
@@ -56,8 +75,10 @@ esp_err_t cron_add_job(cron_job_t *job);
 esp_err_t cron_remove_job(const char *job_id);
 
 /**
- * List all cron jobs.
- * @param jobs      Output array of job pointers
- * @param count     Output: number of jobs
+ * Copy out the cron jobs, taken under the service lock so a job being
+ * added, removed or fired is never seen half-written.
+ * @param jobs      Output array of at least max entries (may be NULL)
+ * @param max       Capacity of jobs; MIMI_CRON_MAX_JOBS holds them all
+ * @return          Number of jobs (may exceed max; only max are copied)
  */
-void cron_list_jobs(const cron_job_t **jobs, int *count);
+int cron_list_jobs(cron_job_t *jobs, int max);
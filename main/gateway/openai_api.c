@@ -0,0 +1,469 @@
+#include "openai_api.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "cJSON.h"
+
+static const char *TAG = "openai_api";
+
+#define OA_MODEL_DEFAULT   "mimiclaw"
+#define OA_REPLY_QUEUE_LEN 8
+
+static httpd_handle_t s_server = NULL;
+
+/* Requests accepted by the HTTP server, waiting for a worker */
+static QueueHandle_t s_req_queue = NULL;
+
+/*
+ * One slot per worker. A slot owns a chat_id while its request is in
+ * flight, and at most one request per chat_id is in flight. Each admitted
+ * request gets a sequence number that the agent echoes on its replies
+ * (mimi_msg_t.seq): a turn whose request already timed out keeps running,
+ * and its late reply must not answer the next request on the same chat_id.
+ */
+typedef struct {
+    bool active;
+    char chat_id[96];
+    uint32_t seq;               /* of the request in flight */
+    QueueHandle_t replies;      /* mimi_msg_t from openai_api_deliver() */
+} oa_slot_t;
+
+static oa_slot_t s_slots[MIMI_OPENAI_MAX_INFLIGHT];
+static SemaphoreHandle_t s_slots_lock = NULL;
+static uint32_t s_completion_seq = 0;
+
+/* ── Slots ─────────────────────────────────────────────────── */
+
+static void slot_drain(oa_slot_t *slot)
+{
+    mimi_msg_t msg;
+    while (xQueueReceive(slot->replies, &msg, 0) == pdTRUE) {
+        mimi_msg_free(&msg);
+    }
+}
+
+/*
+ * Claim slot for chat_id and number the request, waiting up to wait_ms
+ * while another request uses the same session. Returns 0 on timeout.
+ */
+static uint32_t slot_acquire(oa_slot_t *slot, const char *chat_id, uint32_t wait_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)wait_ms * 1000;
+    while (1) {
+        bool busy = false;
+        uint32_t seq = 0;
+        xSemaphoreTake(s_slots_lock, portMAX_DELAY);
+        for (int i = 0; i < MIMI_OPENAI_MAX_INFLIGHT; i++) {
+            if (s_slots[i].active && strcmp(s_slots[i].chat_id, chat_id) == 0) {
+                busy = true;
+                break;
+            }
+        }
+        if (!busy) {
+            slot_drain(slot);
+            strncpy(slot->chat_id, chat_id, sizeof(slot->chat_id) - 1);
+            slot->chat_id[sizeof(slot->chat_id) - 1] = '\0';
+            if (++s_completion_seq == 0) s_completion_seq = 1;
+            seq = slot->seq = s_completion_seq;
+            slot->active = true;
+        }
+        xSemaphoreGive(s_slots_lock);
+        if (!busy) return seq;
+        if (esp_timer_get_time() > deadline_us) return 0;
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+}
+
+static void slot_release(oa_slot_t *slot)
+{
+    xSemaphoreTake(s_slots_lock, portMAX_DELAY);
+    slot->active = false;
+    slot_drain(slot);
+    xSemaphoreGive(s_slots_lock);
+}
+
+esp_err_t openai_api_deliver(mimi_msg_t *msg)
+{
+    if (!s_slots_lock || !msg) return ESP_ERR_INVALID_STATE;
+
+    QueueHandle_t replies = NULL;
+    xSemaphoreTake(s_slots_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_OPENAI_MAX_INFLIGHT; i++) {
+        if (s_slots[i].active && s_slots[i].seq == msg->seq &&
+            strcmp(s_slots[i].chat_id, msg->chat_id) == 0) {
+            replies = s_slots[i].replies;
+            break;
+        }
+    }
+    xSemaphoreGive(s_slots_lock);
+
+    if (!replies) {
+        /* Usually the tail of a turn whose request timed out */
+        ESP_LOGW(TAG, "No request %u waiting on %s, reply dropped", (unsigned)msg->seq, msg->chat_id);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /*
+     * Progress snapshots are disposable; the final reply must get through.
+     * The slot may be released and taken by a new request before this send
+     * lands: that request drops replies whose seq is not its own.
+     */
+    bool final = strcmp(msg->type, "stream") != 0;
+    if (xQueueSend(replies, msg, final ? pdMS_TO_TICKS(1000) : 0) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    msg->payload.text = NULL;   /* now owned by the waiting request */
+    return ESP_OK;
+}
+
+/* ── Request parsing ───────────────────────────────────────── */
+
+static char *read_body(httpd_req_t *req)
+{
+    if (req->content_len == 0 || req->content_len > MIMI_OPENAI_MAX_BODY) {
+        return NULL;
+    }
+
+    char *buf = malloc(req->content_len + 1);
+    if (!buf) return NULL;
+
+    size_t received = 0;
+    while (received < req->content_len) {
+        int n = httpd_req_recv(req, buf + received, req->content_len - received);
+        if (n == HTTPD_SOCK_ERR_TIMEOUT) continue;
+        if (n <= 0) {
+            free(buf);
+            return NULL;
+        }
+        received += n;
+    }
+    buf[received] = '\0';
+    return buf;
+}
+
+/* Text of the last user message; content may be a string or text parts */
+static char *last_user_text(cJSON *messages)
+{
+    cJSON *last = NULL;
+    cJSON *m;
+    cJSON_ArrayForEach(m, messages) {
+        cJSON *role = cJSON_GetObjectItem(m, "role");
+        if (cJSON_IsString(role) && strcmp(role->valuestring, "user") == 0) {
+            last = m;
+        }
+    }
+    if (!last) return NULL;
+
+    cJSON *content = cJSON_GetObjectItem(last, "content");
+    if (cJSON_IsString(content)) {
+        return strdup(content->valuestring);
+    }
+    if (!cJSON_IsArray(content)) return NULL;
+
+    size_t total = 0;
+    cJSON *part;
+    cJSON_ArrayForEach(part, content) {
+        cJSON *text = cJSON_GetObjectItem(part, "text");
+        if (cJSON_IsString(text)) total += strlen(text->valuestring) + 1;
+    }
+    char *out = calloc(1, total + 1);
+    if (!out) return NULL;
+    cJSON_ArrayForEach(part, content) {
+        cJSON *text = cJSON_GetObjectItem(part, "text");
+        if (!cJSON_IsString(text)) continue;
+        if (out[0]) strcat(out, "\n");
+        strcat(out, text->valuestring);
+    }
+    return out;
+}
+
+/* ── Responses ─────────────────────────────────────────────── */
+
+static void send_status(httpd_req_t *req, const char *status, const char *message)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *err = cJSON_AddObjectToObject(root, "error");
+    cJSON_AddStringToObject(err, "message", message);
+    cJSON_AddStringToObject(err, "type", "server_error");
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json_str ? json_str : "{}");
+    cJSON_free(json_str);
+}
+
+static cJSON *completion_object(const char *id, const char *object, const char *model)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "id", id);
+    cJSON_AddStringToObject(root, "object", object);
+    cJSON_AddNumberToObject(root, "created", (double)time(NULL));
+    cJSON_AddStringToObject(root, "model", model);
+    return root;
+}
+
+/* One "data: {chat.completion.chunk}" event. Any of the fields may be NULL. */
+static esp_err_t sse_send_chunk(httpd_req_t *req, const char *id, const char *model,
+                                const char *role, const char *content, const char *finish)
+{
+    cJSON *root = completion_object(id, "chat.completion.chunk", model);
+    cJSON *choices = cJSON_AddArrayToObject(root, "choices");
+    cJSON *choice = cJSON_CreateObject();
+    cJSON_AddNumberToObject(choice, "index", 0);
+    cJSON *delta = cJSON_AddObjectToObject(choice, "delta");
+    if (role) cJSON_AddStringToObject(delta, "role", role);
+    if (content) cJSON_AddStringToObject(delta, "content", content);
+    if (finish) {
+        cJSON_AddStringToObject(choice, "finish_reason", finish);
+    } else {
+        cJSON_AddNullToObject(choice, "finish_reason");
+    }
+    cJSON_AddItemToArray(choices, choice);
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_str) return ESP_ERR_NO_MEM;
+
+    esp_err_t err = httpd_resp_sendstr_chunk(req, "data: ");
+    if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, json_str);
+    if (err == ESP_OK) err = httpd_resp_sendstr_chunk(req, "\n\n");
+    cJSON_free(json_str);
+    return err;
+}
+
+static void send_completion(httpd_req_t *req, const char *id, const char *model, const char *text)
+{
+    cJSON *root = completion_object(id, "chat.completion", model);
+    cJSON *choices = cJSON_AddArrayToObject(root, "choices");
+    cJSON *choice = cJSON_CreateObject();
+    cJSON_AddNumberToObject(choice, "index", 0);
+    cJSON *message = cJSON_AddObjectToObject(choice, "message");
+    cJSON_AddStringToObject(message, "role", "assistant");
+    cJSON_AddStringToObject(message, "content", text);
+    cJSON_AddStringToObject(choice, "finish_reason", "stop");
+    cJSON_AddItemToArray(choices, choice);
+
+    char *json_str = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json_str) {
+        send_status(req, "500 Internal Server Error", "out of memory");
+        return;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_sendstr(req, json_str);
+    cJSON_free(json_str);
+}
+
+/* ── Worker ────────────────────────────────────────────────── */
+
+/* Push to the agent, waiting while the inbound queue is full (backpressure, not a drop) */
+static esp_err_t admit_to_agent(const char *chat_id, uint32_t seq, char *text, int64_t deadline_us)
+{
+    mimi_msg_t msg = {0};
+    strncpy(msg.channel, MIMI_CHAN_OPENAI, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
+    strncpy(msg.type, "text", sizeof(msg.type) - 1);
+    msg.seq = seq;
+    msg.payload.text = text;
+
+    int64_t left_ms = (deadline_us - esp_timer_get_time()) / 1000;
+    if (left_ms < 0) left_ms = 0;
+    if (message_bus_push_inbound_wait(&msg, (uint32_t)left_ms) != ESP_OK) {
+        free(text);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static void handle_completion(httpd_req_t *req, oa_slot_t *slot)
+{
+    char *body = read_body(req);
+    if (!body) {
+        send_status(req, "400 Bad Request", "missing or oversized body");
+        return;
+    }
+    cJSON *root = cJSON_Parse(body);
+    free(body);
+    cJSON *messages = root ? cJSON_GetObjectItem(root, "messages") : NULL;
+    char *prompt = cJSON_IsArray(messages) ? last_user_text(messages) : NULL;
+    if (!prompt || !prompt[0]) {
+        free(prompt);
+        cJSON_Delete(root);
+        send_status(req, "400 Bad Request", "no user message");
+        return;
+    }
+
+    cJSON *model_json = cJSON_GetObjectItem(root, "model");
+    cJSON *user_json = cJSON_GetObjectItem(root, "user");
+    bool stream = cJSON_IsTrue(cJSON_GetObjectItem(root, "stream"));
+    char model[64];
+    char chat_id[96];
+    strncpy(model, cJSON_IsString(model_json) ? model_json->valuestring : OA_MODEL_DEFAULT,
+            sizeof(model) - 1);
+    model[sizeof(model) - 1] = '\0';
+    snprintf(chat_id, sizeof(chat_id), "oa_%.40s",
+             cJSON_IsString(user_json) && user_json->valuestring[0] ? user_json->valuestring : "default");
+    cJSON_Delete(root);
+
+    uint32_t seq = slot_acquire(slot, chat_id, MIMI_OPENAI_SESSION_WAIT_MS);
+    if (!seq) {
+        free(prompt);
+        ESP_LOGW(TAG, "%s busy with an earlier request, rejected", chat_id);
+        send_status(req, "429 Too Many Requests", "a previous request for this user is still running");
+        return;
+    }
+
+    char id[32];
+    snprintf(id, sizeof(id), "chatcmpl-mimi%08x", (unsigned)seq);
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)MIMI_OPENAI_REPLY_TIMEOUT_MS * 1000;
+    ESP_LOGI(TAG, "%s -> %s (%s, %d bytes)", id, chat_id, stream ? "stream" : "blocking",
+             (int)strlen(prompt));
+
+    if (admit_to_agent(chat_id, seq, prompt, deadline_us) != ESP_OK) {
+        slot_release(slot);
+        ESP_LOGW(TAG, "%s rejected: agent queue full", id);
+        send_status(req, "503 Service Unavailable", "agent queue full");
+        return;
+    }
+
+    bool client_ok = true;
+    if (stream) {
+        httpd_resp_set_type(req, "text/event-stream");
+        httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+        client_ok = sse_send_chunk(req, id, model, "assistant", NULL, NULL) == ESP_OK;
+    }
+
+    /* Wait for the final reply; "stream" snapshots only mean tools are running */
+    char *final_text = NULL;
+    while (!final_text) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0) break;
+        int64_t wait_ms = left_us / 1000;
+        if (wait_ms > MIMI_OPENAI_KEEPALIVE_MS) wait_ms = MIMI_OPENAI_KEEPALIVE_MS;
+
+        mimi_msg_t msg;
+        if (xQueueReceive(slot->replies, &msg, pdMS_TO_TICKS(wait_ms)) == pdTRUE) {
+            if (msg.seq != seq) {
+                /* A late reply of the slot's previous request, sent after it gave up */
+                ESP_LOGW(TAG, "%s: dropped a reply for request %u", id, (unsigned)msg.seq);
+            } else if (strcmp(msg.type, "stream") != 0) {
+                final_text = msg.payload.text;
+                msg.payload.text = NULL;
+            }
+            mimi_msg_free(&msg);
+        }
+        if (!final_text && stream && client_ok) {
+            /* SSE comment: keeps proxies and client read timeouts happy */
+            client_ok = httpd_resp_sendstr_chunk(req, ": working\n\n") == ESP_OK;
+        }
+    }
+    slot_release(slot);
+
+    if (!final_text) {
+        ESP_LOGW(TAG, "%s timed out waiting for the agent", id);
+    }
+
+    if (stream) {
+        if (client_ok) {
+            if (final_text) sse_send_chunk(req, id, model, NULL, final_text, NULL);
+            sse_send_chunk(req, id, model, NULL, NULL, final_text ? "stop" : "length");
+            httpd_resp_sendstr_chunk(req, "data: [DONE]\n\n");
+            httpd_resp_send_chunk(req, NULL, 0);
+        }
+    } else if (final_text) {
+        send_completion(req, id, model, final_text);
+    } else {
+        send_status(req, "504 Gateway Timeout", "agent did not reply in time");
+    }
+    free(final_text);
+}
+
+static void openai_worker_task(void *arg)
+{
+    oa_slot_t *slot = (oa_slot_t *)arg;
+
+    while (1) {
+        httpd_req_t *req = NULL;
+        if (xQueueReceive(s_req_queue, &req, portMAX_DELAY) != pdTRUE) continue;
+        handle_completion(req, slot);
+        httpd_req_async_handler_complete(req);
+    }
+}
+
+/* ── HTTP server ───────────────────────────────────────────── */
+
+static esp_err_t completions_handler(httpd_req_t *req)
+{
+    httpd_req_t *async_req = NULL;
+    if (httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+        send_status(req, "500 Internal Server Error", "async handler unavailable");
+        return ESP_OK;
+    }
+
+    /* Backpressure: wait for a worker slot instead of rejecting right away */
+    if (xQueueSend(s_req_queue, &async_req, pdMS_TO_TICKS(MIMI_OPENAI_ADMIT_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "Request backlog full");
+        send_status(async_req, "503 Service Unavailable", "too many pending requests");
+        httpd_req_async_handler_complete(async_req);
+    }
+    return ESP_OK;
+}
+
+esp_err_t openai_api_start(void)
+{
+    if (s_server) return ESP_OK;
+
+    if (!s_slots_lock) {
+        s_slots_lock = xSemaphoreCreateMutex();
+        s_req_queue = xQueueCreate(MIMI_OPENAI_BACKLOG, sizeof(httpd_req_t *));
+        if (!s_slots_lock || !s_req_queue) return ESP_ERR_NO_MEM;
+
+        for (int i = 0; i < MIMI_OPENAI_MAX_INFLIGHT; i++) {
+            s_slots[i].replies = xQueueCreate(OA_REPLY_QUEUE_LEN, sizeof(mimi_msg_t));
+            if (!s_slots[i].replies) return ESP_ERR_NO_MEM;
+
+            char name[16];
+            snprintf(name, sizeof(name), "oa_worker%d", i);
+            if (xTaskCreatePinnedToCore(openai_worker_task, name, MIMI_OPENAI_WORKER_STACK,
+                                        &s_slots[i], MIMI_OPENAI_WORKER_PRIO, NULL,
+                                        MIMI_OPENAI_WORKER_CORE) != pdPASS) {
+                ESP_LOGE(TAG, "Failed to create %s", name);
+                return ESP_FAIL;
+            }
+        }
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = MIMI_OPENAI_PORT;
+    config.ctrl_port = MIMI_OPENAI_PORT + 1;
+    /* In-flight + queued requests each hold a socket */
+    config.max_open_sockets = MIMI_OPENAI_MAX_INFLIGHT + MIMI_OPENAI_BACKLOG + 1;
+    config.lru_purge_enable = false;
+
+    esp_err_t ret = httpd_start(&s_server, &config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start OpenAI API server: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    httpd_uri_t completions_uri = {
+        .uri = "/v1/chat/completions",
+        .method = HTTP_POST,
+        .handler = completions_handler,
+    };
+    httpd_register_uri_handler(s_server, &completions_uri);
+
+    ESP_LOGI(TAG, "OpenAI-compatible API on port %d (/v1/chat/completions)", MIMI_OPENAI_PORT);
+    return ESP_OK;
+}
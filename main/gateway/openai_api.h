@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+#include "bus/message_bus.h"
+
+/**
+ * Start the OpenAI-compatible chat endpoint on MIMI_OPENAI_PORT.
+ *
+ *   POST /v1/chat/completions
+ *   {"model":"...","messages":[...,{"role":"user","content":"hi"}],
+ *    "stream":true,"user":"alice"}
+ *
+ * The last user message is fed to the agent loop through the inbound bus
+ * as channel "openai", chat_id "oa_<user>" (or "oa_default"), so it runs
+ * with that session's history, memory, skills and tools. Earlier request
+ * messages are not replayed: the device keeps its own session history.
+ *
+ * Up to MIMI_OPENAI_MAX_INFLIGHT requests wait on the agent at once;
+ * further requests queue (backpressure) instead of being rejected. A
+ * request still waiting behind one for the same user after
+ * MIMI_OPENAI_SESSION_WAIT_MS gets 429.
+ * With "stream":true the reply is sent as SSE chat.completion.chunk events
+ * with keepalive comments while tools run.
+ */
+esp_err_t openai_api_start(void);
+
+/**
+ * Hand an outbound "openai" message to the request waiting on its chat_id
+ * and seq. Takes ownership of msg->payload.text (set to NULL on success);
+ * ESP_ERR_NOT_FOUND for a reply to a request that already ended.
+ */
+esp_err_t openai_api_deliver(mimi_msg_t *msg);
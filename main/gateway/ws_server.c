@@ -4,7 +4,14 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_http_server.h"
 #include "cJSON.h"
 
@@ -12,14 +19,32 @@ static const char *TAG = "ws";
 
 static httpd_handle_t s_server = NULL;
 
+/* Frame waiting in a client's send queue (json is heap-allocated) */
+typedef struct {
+    int fd;
+    uint32_t gen;               /* connection it was queued for */
+    char *json;
+    size_t len;
+} ws_frame_item_t;
+
 /* Simple client tracking */
 typedef struct {
     int fd;
     char chat_id[32];
     bool active;
+    bool subscribed;            /* receives agent events */
+    char event_filter[32];      /* only events for this chat_id, "" = all */
+    QueueHandle_t tx_queue;     /* bounded, drained by the ws_tx task */
+    uint32_t dropped;           /* events dropped because the queue was full */
+    uint32_t gen;               /* bumped per connection: lwIP reuses fds */
+    int64_t blocked_since_us;   /* ws_tx only: socket full since, or 0 */
 } ws_client_t;
 
 static ws_client_t s_clients[MIMI_WS_MAX_CLIENTS];
+static SemaphoreHandle_t s_clients_lock = NULL;
+static TaskHandle_t s_tx_task = NULL;
+static int s_subscribers = 0;
+static uint32_t s_next_gen = 0;
 
 static ws_client_t *find_client_by_fd(int fd)
 {
@@ -41,32 +66,208 @@ static ws_client_t *find_client_by_chat_id(const char *chat_id)
     return NULL;
 }
 
-static ws_client_t *add_client(int fd)
+static void drain_queue(ws_client_t *c)
 {
+    ws_frame_item_t item;
+    while (xQueueReceive(c->tx_queue, &item, 0) == pdTRUE) {
+        free(item.json);
+    }
+}
+
+static void recount_subscribers(void)
+{
+    int n = 0;
     for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+        if (s_clients[i].active && s_clients[i].subscribed) n++;
+    }
+    s_subscribers = n;
+}
+
+static ws_client_t *add_client(int fd)
+{
+    ws_client_t *client = NULL;
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    client = find_client_by_fd(fd);
+    for (int i = 0; !client && i < MIMI_WS_MAX_CLIENTS; i++) {
         if (!s_clients[i].active) {
-            s_clients[i].fd = fd;
-            snprintf(s_clients[i].chat_id, sizeof(s_clients[i].chat_id), "ws_%d", fd);
-            s_clients[i].active = true;
-            ESP_LOGI(TAG, "Client connected: %s (fd=%d)", s_clients[i].chat_id, fd);
-            return &s_clients[i];
+            client = &s_clients[i];
+            drain_queue(client);
+            client->fd = fd;
+            snprintf(client->chat_id, sizeof(client->chat_id), "ws_%d", fd);
+            client->subscribed = false;
+            client->event_filter[0] = '\0';
+            client->dropped = 0;
+            if (++s_next_gen == 0) s_next_gen = 1;     /* 0 is "any" to remove_client() */
+            client->gen = s_next_gen;
+            client->blocked_since_us = 0;
+            client->active = true;
+            ESP_LOGI(TAG, "Client connected: %s (fd=%d)", client->chat_id, fd);
         }
     }
-    ESP_LOGW(TAG, "Max clients reached, rejecting fd=%d", fd);
-    return NULL;
+    xSemaphoreGive(s_clients_lock);
+
+    if (!client) {
+        ESP_LOGW(TAG, "Max clients reached, rejecting fd=%d", fd);
+    }
+    return client;
 }
 
-static void remove_client(int fd)
+/* gen 0: whichever client holds fd; otherwise only that connection */
+static void remove_client(int fd, uint32_t gen)
 {
-    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
-        if (s_clients[i].active && s_clients[i].fd == fd) {
-            ESP_LOGI(TAG, "Client disconnected: %s", s_clients[i].chat_id);
-            s_clients[i].active = false;
-            return;
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    ws_client_t *client = find_client_by_fd(fd);
+    if (client && (gen == 0 || client->gen == gen)) {
+        ESP_LOGI(TAG, "Client disconnected: %s (dropped %u events)",
+                 client->chat_id, (unsigned)client->dropped);
+        client->active = false;
+        drain_queue(client);
+        recount_subscribers();
+    }
+    xSemaphoreGive(s_clients_lock);
+}
+
+/* ── Asynchronous per-client send ──────────────────────────── */
+
+/*
+ * Queue a frame for a client. Caller holds s_clients_lock. Takes ownership
+ * of json. Never blocks: a full queue means the client is not keeping up.
+ */
+static bool enqueue_frame(ws_client_t *c, char *json, size_t len)
+{
+    ws_frame_item_t item = { .fd = c->fd, .gen = c->gen, .json = json, .len = len };
+    if (xQueueSend(c->tx_queue, &item, 0) != pdTRUE) {
+        free(json);
+        c->dropped++;
+        return false;
+    }
+    return true;
+}
+
+/* Still the connection the frame was queued for */
+static bool client_current(const ws_client_t *c, uint32_t gen)
+{
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    bool current = c->active && c->gen == gen;
+    xSemaphoreGive(s_clients_lock);
+    return current;
+}
+
+/* Room in the socket's send buffer, without waiting for it */
+static bool socket_writable(int fd)
+{
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+    struct timeval tv = { 0 };
+    return select(fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
+
+/* The client has not read for MIMI_WS_STALL_MS: drop what is queued for it */
+static void drop_backlog(ws_client_t *c, uint32_t gen)
+{
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    if (c->active && c->gen == gen) {
+        UBaseType_t n = uxQueueMessagesWaiting(c->tx_queue);
+        c->dropped += n;
+        drain_queue(c);
+        ESP_LOGW(TAG, "%s not reading, dropped %u queued frames", c->chat_id, (unsigned)n);
+    }
+    xSemaphoreGive(s_clients_lock);
+}
+
+typedef enum { TX_IDLE, TX_SENT, TX_BLOCKED } tx_result_t;
+
+/* Send the client's next frame if its socket has room */
+static tx_result_t tx_one(ws_client_t *c)
+{
+    ws_frame_item_t item;
+    if (xQueuePeek(c->tx_queue, &item, 0) != pdTRUE) {
+        c->blocked_since_us = 0;
+        return TX_IDLE;
+    }
+
+    /* A backed-up client is skipped rather than waited on in this shared loop */
+    if (client_current(c, item.gen) && !socket_writable(item.fd)) {
+        int64_t now = esp_timer_get_time();
+        if (!c->blocked_since_us) {
+            c->blocked_since_us = now;
+        } else if (now - c->blocked_since_us >= (int64_t)MIMI_WS_STALL_MS * 1000) {
+            drop_backlog(c, item.gen);
+            c->blocked_since_us = 0;
+            return TX_IDLE;
+        }
+        return TX_BLOCKED;
+    }
+    c->blocked_since_us = 0;
+
+    /* Not the peeked copy: remove_client() may have drained the queue since */
+    if (xQueueReceive(c->tx_queue, &item, 0) != pdTRUE) return TX_IDLE;
+    if (!client_current(c, item.gen)) {
+        free(item.json);        /* for a connection that has gone */
+        return TX_SENT;
+    }
+
+    httpd_ws_frame_t ws_pkt = {
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)item.json,
+        .len = item.len,
+    };
+    esp_err_t ret = s_server
+        ? httpd_ws_send_frame_async(s_server, item.fd, &ws_pkt)
+        : ESP_ERR_INVALID_STATE;
+    free(item.json);
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send to fd=%d: %s", item.fd, esp_err_to_name(ret));
+        remove_client(item.fd, item.gen);
+    }
+    return TX_SENT;
+}
+
+static void ws_tx_task(void *arg)
+{
+    bool backed_up = false;
+    while (1) {
+        /* Poll while a client is backed up, otherwise sleep until notified */
+        ulTaskNotifyTake(pdTRUE, backed_up ? pdMS_TO_TICKS(MIMI_WS_TX_RETRY_MS) : portMAX_DELAY);
+
+        /* Round-robin one frame per client so one slow socket
+         * cannot starve the others */
+        bool more = true;
+        backed_up = false;
+        while (more) {
+            more = false;
+            for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+                tx_result_t r = tx_one(&s_clients[i]);
+                if (r == TX_SENT) more = true;
+                if (r == TX_BLOCKED) backed_up = true;
+            }
         }
     }
 }
 
+static void ws_close_fn(httpd_handle_t hd, int sockfd)
+{
+    remove_client(sockfd, 0);
+    close(sockfd);
+}
+
+/* ── Inbound frames ────────────────────────────────────────── */
+
+static void send_ack(ws_client_t *client, const char *type)
+{
+    cJSON *ack = cJSON_CreateObject();
+    cJSON_AddStringToObject(ack, "type", type);
+    cJSON_AddStringToObject(ack, "chat_id", client->chat_id);
+    char *json_str = cJSON_PrintUnformatted(ack);
+    cJSON_Delete(ack);
+    if (!json_str) return;
+
+    enqueue_frame(client, json_str, strlen(json_str));
+    xTaskNotifyGive(s_tx_task);
+}
+
 static esp_err_t ws_handler(httpd_req_t *req)
 {
     if (req->method == HTTP_GET) {
@@ -96,7 +297,6 @@ static esp_err_t ws_handler(httpd_req_t *req)
     }
 
     int fd = httpd_req_to_sockfd(req);
-    ws_client_t *client = find_client_by_fd(fd);
 
     /* Parse JSON message */
     cJSON *root = cJSON_Parse((char *)ws_pkt.payload);
@@ -109,20 +309,25 @@ static esp_err_t ws_handler(httpd_req_t *req)
 
     cJSON *type = cJSON_GetObjectItem(root, "type");
     cJSON *content = cJSON_GetObjectItem(root, "content");
+    const char *type_str = cJSON_IsString(type) ? type->valuestring : "";
 
-    if (type && cJSON_IsString(type) && strcmp(type->valuestring, "message") == 0
-        && content && cJSON_IsString(content)) {
+    if (strcmp(type_str, "message") == 0 && content && cJSON_IsString(content)) {
 
         /* Determine chat_id */
-        const char *chat_id = client ? client->chat_id : "ws_unknown";
+        char chat_id[32] = "ws_unknown";
         cJSON *cid = cJSON_GetObjectItem(root, "chat_id");
+        xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+        ws_client_t *client = find_client_by_fd(fd);
         if (cid && cJSON_IsString(cid)) {
-            chat_id = cid->valuestring;
             /* Update client's chat_id if provided */
             if (client) {
-                strncpy(client->chat_id, chat_id, sizeof(client->chat_id) - 1);
+                strncpy(client->chat_id, cid->valuestring, sizeof(client->chat_id) - 1);
             }
+            strncpy(chat_id, cid->valuestring, sizeof(chat_id) - 1);
+        } else if (client) {
+            memcpy(chat_id, client->chat_id, sizeof(chat_id));
         }
+        xSemaphoreGive(s_clients_lock);
 
         ESP_LOGI(TAG, "WS message from %s: %.40s...", chat_id, content->valuestring);
 
@@ -130,11 +335,35 @@ static esp_err_t ws_handler(httpd_req_t *req)
         mimi_msg_t msg = {0};
         strncpy(msg.channel, MIMI_CHAN_WEBSOCKET, sizeof(msg.channel) - 1);
         strncpy(msg.chat_id, chat_id, sizeof(msg.chat_id) - 1);
+        strncpy(msg.type, "text", sizeof(msg.type) - 1);
         msg.payload.text = strdup(content->valuestring);
         if (msg.payload.text) {
             message_bus_push_inbound(&msg);
         }
+        cJSON_Delete(root);
+        return ESP_OK;
+    }
+
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    ws_client_t *client = find_client_by_fd(fd);
+    if (client && strcmp(type_str, "subscribe") == 0) {
+        /* {"type":"subscribe","chat_id":"..."} — chat_id filter is optional */
+        cJSON *filter = cJSON_GetObjectItem(root, "chat_id");
+        client->subscribed = true;
+        client->event_filter[0] = '\0';
+        if (cJSON_IsString(filter)) {
+            strncpy(client->event_filter, filter->valuestring, sizeof(client->event_filter) - 1);
+        }
+        recount_subscribers();
+        ESP_LOGI(TAG, "%s subscribed to agent events (filter=%s)",
+                 client->chat_id, client->event_filter[0] ? client->event_filter : "*");
+        send_ack(client, "subscribed");
+    } else if (client && strcmp(type_str, "unsubscribe") == 0) {
+        client->subscribed = false;
+        recount_subscribers();
+        send_ack(client, "unsubscribed");
     }
+    xSemaphoreGive(s_clients_lock);
 
     cJSON_Delete(root);
     return ESP_OK;
@@ -142,12 +371,27 @@ static esp_err_t ws_handler(httpd_req_t *req)
 
 esp_err_t ws_server_start(void)
 {
-    memset(s_clients, 0, sizeof(s_clients));
+    if (!s_clients_lock) {
+        memset(s_clients, 0, sizeof(s_clients));
+        s_clients_lock = xSemaphoreCreateMutex();
+        if (!s_clients_lock) return ESP_ERR_NO_MEM;
+        for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+            s_clients[i].tx_queue = xQueueCreate(MIMI_WS_CLIENT_QUEUE_LEN, sizeof(ws_frame_item_t));
+            if (!s_clients[i].tx_queue) return ESP_ERR_NO_MEM;
+        }
+        if (xTaskCreatePinnedToCore(ws_tx_task, "ws_tx", MIMI_WS_TX_STACK, NULL,
+                                    MIMI_WS_TX_PRIO, &s_tx_task, MIMI_WS_TX_CORE) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create ws_tx task");
+            return ESP_FAIL;
+        }
+    }
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = MIMI_WS_PORT;
     config.ctrl_port = MIMI_WS_PORT + 1;
     config.max_open_sockets = MIMI_WS_MAX_CLIENTS;
+    config.send_wait_timeout = MIMI_WS_SEND_WAIT_S;
+    config.close_fn = ws_close_fn;
 
     esp_err_t ret = httpd_start(&s_server, &config);
     if (ret != ESP_OK) {
@@ -172,12 +416,6 @@ esp_err_t ws_server_send(const char *chat_id, const char *text)
 {
     if (!s_server) return ESP_ERR_INVALID_STATE;
 
-    ws_client_t *client = find_client_by_chat_id(chat_id);
-    if (!client) {
-        ESP_LOGW(TAG, "No WS client with chat_id=%s", chat_id);
-        return ESP_ERR_NOT_FOUND;
-    }
-
     /* Build response JSON */
     cJSON *resp = cJSON_CreateObject();
     cJSON_AddStringToObject(resp, "type", "response");
@@ -189,21 +427,68 @@ esp_err_t ws_server_send(const char *chat_id, const char *text)
 
     if (!json_str) return ESP_ERR_NO_MEM;
 
-    httpd_ws_frame_t ws_pkt = {
-        .type = HTTPD_WS_TYPE_TEXT,
-        .payload = (uint8_t *)json_str,
-        .len = strlen(json_str),
-    };
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    ws_client_t *client = find_client_by_chat_id(chat_id);
+    esp_err_t ret = ESP_OK;
+    if (!client) {
+        free(json_str);
+        ret = ESP_ERR_NOT_FOUND;
+    } else if (!enqueue_frame(client, json_str, strlen(json_str))) {
+        ret = ESP_ERR_TIMEOUT;
+    }
+    xSemaphoreGive(s_clients_lock);
 
-    esp_err_t ret = httpd_ws_send_frame_async(s_server, client->fd, &ws_pkt);
-    free(json_str);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "No WS client with chat_id=%s", chat_id);
+    } else if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Send queue full for %s, response dropped", chat_id);
+    } else {
+        xTaskNotifyGive(s_tx_task);
+    }
+    return ret;
+}
 
-    if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to send to %s: %s", chat_id, esp_err_to_name(ret));
-        remove_client(client->fd);
+bool ws_server_has_subscribers(void)
+{
+    return s_server && s_subscribers > 0;
+}
+
+void ws_server_publish_event(cJSON *event)
+{
+    if (!event) return;
+    if (!ws_server_has_subscribers()) {
+        cJSON_Delete(event);
+        return;
     }
 
-    return ret;
+    char event_chat[96] = "";
+    cJSON *cid = cJSON_GetObjectItem(event, "chat_id");
+    if (cJSON_IsString(cid)) {
+        strncpy(event_chat, cid->valuestring, sizeof(event_chat) - 1);
+    }
+    char *json_str = cJSON_PrintUnformatted(event);
+    cJSON_Delete(event);
+    if (!json_str) return;
+    size_t len = strlen(json_str);
+
+    bool queued = false;
+    xSemaphoreTake(s_clients_lock, portMAX_DELAY);
+    for (int i = 0; i < MIMI_WS_MAX_CLIENTS; i++) {
+        ws_client_t *c = &s_clients[i];
+        if (!c->active || !c->subscribed) continue;
+        if (c->event_filter[0] && strcmp(c->event_filter, event_chat) != 0) continue;
+
+        char *copy = malloc(len + 1);
+        if (!copy) break;
+        memcpy(copy, json_str, len + 1);
+        queued |= enqueue_frame(c, copy, len);
+    }
+    xSemaphoreGive(s_clients_lock);
+    cJSON_free(json_str);
+
+    if (queued) {
+        xTaskNotifyGive(s_tx_task);
+    }
 }
 
 esp_err_t ws_server_stop(void)
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
 #include "esp_err.h"
+#include "cJSON.h"
 
 /**
  * Initialize and start the WebSocket server on MIMI_WS_PORT.
@@ -9,16 +11,40 @@
  * Protocol:
  *   Inbound:  {"type":"message","content":"hello","chat_id":"ws_client1"}
  *   Outbound: {"type":"response","content":"Hi!","chat_id":"ws_client1"}
+ *
+ * Agent events (opt-in, optional chat_id filter):
+ *   Inbound:  {"type":"subscribe","chat_id":"ws_client1"} / {"type":"unsubscribe"}
+ *   Outbound: {"type":"event","event":"turn_start","turn":7,"channel":"telegram",
+ *              "chat_id":"123","t_ms":52311,...}
+ *   Events: turn_start, llm_request, first_token, text_delta, tool_start,
+ *           tool_end, turn_end (see agent_loop.c for per-event fields).
+ *
+ * All outbound frames go through a bounded per-client queue drained by a
+ * sender task; events for a client whose queue is full are dropped.
  */
 esp_err_t ws_server_start(void);
 
 /**
  * Send a text message to a specific WebSocket client by chat_id.
+ * Queued for the sender task; does not wait for the socket.
  * @param chat_id  Client identifier (assigned on connection)
  * @param text     Message text
+ * @return ESP_ERR_NOT_FOUND if no such client, ESP_ERR_TIMEOUT if its queue is full
  */
 esp_err_t ws_server_send(const char *chat_id, const char *text);
 
+/**
+ * True if at least one client subscribed to agent events. Lets producers
+ * skip building events nobody will see.
+ */
+bool ws_server_has_subscribers(void);
+
+/**
+ * Queue an agent event object to every matching subscriber.
+ * Takes ownership of event (deleted here). Never blocks on the network.
+ */
+void ws_server_publish_event(cJSON *event);
+
 /**
  * Stop the WebSocket server.
  */
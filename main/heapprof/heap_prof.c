@@ -0,0 +1,517 @@
+#include "heap_prof.h"
+#include "mimi_config.h"
+#include "metrics/metrics.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+#include <pthread.h>
+#else
+#include "esp_attr.h"
+#include "esp_memory_utils.h"
+#include "esp_private/cache_utils.h"
+#endif
+
+static const char *TAG = "heap_prof";
+
+/* Live allocation: one open-addressing slot per tracked pointer */
+typedef struct {
+    void *ptr;
+    uint32_t size;
+    uint8_t tag;
+    uint8_t external;
+} heap_entry_t;
+
+typedef struct {
+    TaskHandle_t task;
+    uint8_t tag;
+} heap_scope_t;
+
+static heap_entry_t *s_table = NULL;
+static uint32_t s_table_count = 0;
+static uint32_t s_untracked = 0;        /* not recorded: table at its load limit */
+static volatile bool s_enabled = MIMI_HEAP_PROF_ENABLED_DEFAULT;
+static heap_tag_stats_t s_stats[HEAP_TAG_COUNT];
+static heap_scope_t s_scopes[MIMI_HEAP_PROF_MAX_SCOPES];
+
+static heap_region_snapshot_t s_snap[2];
+static int64_t s_snap_us = 0;
+
+/* Hooks run in any task; device hooks from an ISR are skipped (see below) */
+#if CONFIG_IDF_TARGET_LINUX
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+#define PROF_LOCK()    pthread_mutex_lock(&s_lock)
+#define PROF_UNLOCK()  pthread_mutex_unlock(&s_lock)
+#else
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+#define PROF_LOCK()    portENTER_CRITICAL_SAFE(&s_lock)
+#define PROF_UNLOCK()  portEXIT_CRITICAL_SAFE(&s_lock)
+#endif
+
+#define TABLE_MASK      (MIMI_HEAP_PROF_TRACK_MAX - 1)
+#define TABLE_LIMIT     (MIMI_HEAP_PROF_TRACK_MAX / 4 * 3)
+
+static const char *s_tag_names[HEAP_TAG_COUNT] = {
+    "other", "agent", "llm", "tools", "telegram", "feishu", "lua", "buddy", "camera",
+};
+
+/* Task name prefix → tag, for tasks without an open scope */
+static const struct {
+    const char *prefix;
+    heap_tag_t tag;
+} s_task_tags[] = {
+    { "agent",  HEAP_TAG_AGENT },
+    { "tg_",    HEAP_TAG_TELEGRAM },
+    { "feishu", HEAP_TAG_FEISHU },
+    { "lua",    HEAP_TAG_LUA },
+    { "buddy",  HEAP_TAG_BUDDY },
+    { "nimble", HEAP_TAG_BUDDY },
+    { "cam",    HEAP_TAG_CAMERA },
+};
+
+static const uint32_t s_bucket_bounds[HEAP_PROF_BUCKETS - 1] = {
+    32, 128, 512, 2048, 8192, 32768, 131072,
+};
+
+static int size_bucket(uint32_t size)
+{
+    int b = 0;
+    while (b < HEAP_PROF_BUCKETS - 1 && size > s_bucket_bounds[b]) b++;
+    return b;
+}
+
+const char *heap_prof_tag_name(heap_tag_t tag)
+{
+    return tag < HEAP_TAG_COUNT ? s_tag_names[tag] : "?";
+}
+
+/* Caller holds the lock */
+static heap_tag_t current_tag(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (!task) return HEAP_TAG_OTHER;
+
+    for (int i = 0; i < MIMI_HEAP_PROF_MAX_SCOPES; i++) {
+        if (s_scopes[i].task == task) return (heap_tag_t)s_scopes[i].tag;
+    }
+    const char *name = pcTaskGetName(task);
+    if (!name) return HEAP_TAG_OTHER;
+    for (size_t i = 0; i < sizeof(s_task_tags) / sizeof(s_task_tags[0]); i++) {
+        if (strncmp(name, s_task_tags[i].prefix, strlen(s_task_tags[i].prefix)) == 0) {
+            return s_task_tags[i].tag;
+        }
+    }
+    return HEAP_TAG_OTHER;
+}
+
+static inline uint32_t slot_of(const void *ptr)
+{
+    return (uint32_t)(((uintptr_t)ptr >> 3) * 2654435761u) & TABLE_MASK;
+}
+
+/* ── Tracking ──────────────────────────────────────────────── */
+
+void heap_prof_on_alloc(void *ptr, size_t size, bool external)
+{
+    if (!s_table || !s_enabled || !ptr) return;
+
+    PROF_LOCK();
+    if (s_table_count >= TABLE_LIMIT) {
+        s_untracked++;
+        PROF_UNLOCK();
+        return;
+    }
+    heap_tag_t tag = current_tag();
+    uint32_t i = slot_of(ptr);
+    while (s_table[i].ptr && s_table[i].ptr != ptr) i = (i + 1) & TABLE_MASK;
+    if (s_table[i].ptr == ptr) {
+        /* Missed free (e.g. freed before tracking resumed): drop the stale entry */
+        heap_tag_stats_t *old = &s_stats[s_table[i].tag];
+        old->live_bytes[s_table[i].external] -= s_table[i].size;
+        old->live_allocs--;
+        s_table_count--;
+    }
+    s_table[i].ptr = ptr;
+    s_table[i].size = (uint32_t)size;
+    s_table[i].tag = tag;
+    s_table[i].external = external ? 1 : 0;
+    s_table_count++;
+
+    heap_tag_stats_t *st = &s_stats[tag];
+    st->live_bytes[external ? 1 : 0] += (uint32_t)size;
+    uint32_t live = st->live_bytes[0] + st->live_bytes[1];
+    if (live > st->peak_bytes) st->peak_bytes = live;
+    st->live_allocs++;
+    st->allocs++;
+    st->size_hist[size_bucket((uint32_t)size)]++;
+    PROF_UNLOCK();
+}
+
+void heap_prof_on_free(void *ptr)
+{
+    if (!s_table || !ptr) return;
+
+    PROF_LOCK();
+    uint32_t i = slot_of(ptr);
+    while (s_table[i].ptr && s_table[i].ptr != ptr) i = (i + 1) & TABLE_MASK;
+    if (!s_table[i].ptr) {
+        PROF_UNLOCK();
+        return;     /* allocated before init or while the table was full */
+    }
+
+    heap_tag_stats_t *st = &s_stats[s_table[i].tag];
+    st->live_bytes[s_table[i].external] -= s_table[i].size;
+    st->live_allocs--;
+    st->frees++;
+    s_table_count--;
+
+    /* Backward-shift deletion keeps probe chains intact without tombstones */
+    uint32_t hole = i;
+    uint32_t j = i;
+    while (1) {
+        j = (j + 1) & TABLE_MASK;
+        if (!s_table[j].ptr) break;
+        uint32_t home = slot_of(s_table[j].ptr);
+        if (((j - home) & TABLE_MASK) >= ((j - hole) & TABLE_MASK)) {
+            s_table[hole] = s_table[j];
+            hole = j;
+        }
+    }
+    s_table[hole].ptr = NULL;
+    PROF_UNLOCK();
+}
+
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_HEAP_USE_HOOKS
+/*
+ * Called by heap_caps_* for every allocation and free (CONFIG_HEAP_USE_HOOKS),
+ * including from ISRs and while the flash cache is off (flash writes, IRAM-safe
+ * drivers). The hooks themselves live in IRAM; the tracking code and the PSRAM
+ * table are reachable only with the cache on, and the table walk is too long
+ * for an ISR, so those calls are skipped. A free skipped here leaves a stale
+ * entry that heap_prof_on_alloc() drops when the address is handed out again.
+ */
+static inline bool IRAM_ATTR hook_can_track(void)
+{
+    return spi_flash_cache_enabled() && !xPortInIsrContext();
+}
+
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (!hook_can_track()) return;
+    heap_prof_on_alloc(ptr, size, esp_ptr_external_ram(ptr));
+}
+
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+    if (!hook_can_track()) return;
+    heap_prof_on_free(ptr);
+}
+#endif
+
+/* ── Scopes and control ────────────────────────────────────── */
+
+heap_tag_t heap_prof_scope_begin(heap_tag_t tag)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    heap_tag_t prev = HEAP_TAG_COUNT;   /* no scope open */
+    int free_slot = -1;
+
+    PROF_LOCK();
+    for (int i = 0; i < MIMI_HEAP_PROF_MAX_SCOPES; i++) {
+        if (s_scopes[i].task == task) {
+            prev = (heap_tag_t)s_scopes[i].tag;
+            s_scopes[i].tag = tag;
+            PROF_UNLOCK();
+            return prev;
+        }
+        if (!s_scopes[i].task && free_slot < 0) free_slot = i;
+    }
+    if (free_slot >= 0) {
+        s_scopes[free_slot].task = task;
+        s_scopes[free_slot].tag = tag;
+    }
+    PROF_UNLOCK();
+    return prev;
+}
+
+void heap_prof_scope_end(heap_tag_t prev)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    PROF_LOCK();
+    for (int i = 0; i < MIMI_HEAP_PROF_MAX_SCOPES; i++) {
+        if (s_scopes[i].task != task) continue;
+        if (prev == HEAP_TAG_COUNT) {
+            s_scopes[i].task = NULL;
+        } else {
+            s_scopes[i].tag = prev;
+        }
+        break;
+    }
+    PROF_UNLOCK();
+}
+
+void heap_prof_set_enabled(bool enabled)
+{
+    s_enabled = enabled;
+    ESP_LOGI(TAG, "Heap tagging %s", enabled ? "enabled" : "paused");
+}
+
+bool heap_prof_is_enabled(void)
+{
+    return s_enabled;
+}
+
+void heap_prof_get_tag(heap_tag_t tag, heap_tag_stats_t *out)
+{
+    if (tag >= HEAP_TAG_COUNT) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    PROF_LOCK();
+    *out = s_stats[tag];
+    PROF_UNLOCK();
+}
+
+void heap_prof_reset(void)
+{
+    PROF_LOCK();
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        heap_tag_stats_t *st = &s_stats[t];
+        st->peak_bytes = st->live_bytes[0] + st->live_bytes[1];
+        st->allocs = 0;
+        st->frees = 0;
+        memset(st->size_hist, 0, sizeof(st->size_hist));
+    }
+    s_untracked = 0;
+    PROF_UNLOCK();
+}
+
+/* ── Free-block snapshots ──────────────────────────────────── */
+
+#if CONFIG_IDF_TARGET_LINUX
+/* glibc only reports totals: free bytes and free chunk count */
+static void take_snapshot(heap_region_snapshot_t snap[2])
+{
+    memset(snap, 0, 2 * sizeof(heap_region_snapshot_t));
+    struct mallinfo2 mi = mallinfo2();
+    snap[0].free_bytes = (uint32_t)mi.fordblks;
+    snap[0].free_blocks = (uint32_t)mi.ordblks;
+}
+#else
+static bool walk_free_block(walker_heap_into_t heap, walker_block_info_t block, void *arg)
+{
+    heap_region_snapshot_t *snap = arg;
+    if (block.used) return true;
+    uint32_t size = (uint32_t)block.size;
+    snap->free_bytes += size;
+    snap->free_blocks++;
+    if (size > snap->largest_free) snap->largest_free = size;
+    snap->block_hist[size_bucket(size)]++;
+    return true;
+}
+
+static void take_snapshot(heap_region_snapshot_t snap[2])
+{
+    static const uint32_t caps[2] = { MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM };
+    memset(snap, 0, 2 * sizeof(heap_region_snapshot_t));
+    for (int r = 0; r < 2; r++) {
+        heap_caps_walk(caps[r], walk_free_block, &snap[r]);
+    }
+}
+#endif
+
+static void refresh_snapshot(void)
+{
+    heap_region_snapshot_t snap[2];
+    take_snapshot(snap);
+    PROF_LOCK();
+    memcpy(s_snap, snap, sizeof(s_snap));
+    s_snap_us = esp_timer_get_time();
+    PROF_UNLOCK();
+}
+
+uint32_t heap_prof_get_snapshot(heap_region_snapshot_t out[2], bool refresh)
+{
+    if (refresh || !s_snap_us) refresh_snapshot();
+    PROF_LOCK();
+    memcpy(out, s_snap, sizeof(s_snap));
+    int64_t at = s_snap_us;
+    PROF_UNLOCK();
+    return (uint32_t)((esp_timer_get_time() - at) / 1000);
+}
+
+static void snapshot_timer_cb(TimerHandle_t timer)
+{
+    refresh_snapshot();
+}
+
+/* ── Metrics ───────────────────────────────────────────────── */
+
+static metric_t *s_m_live[HEAP_TAG_COUNT][2];
+static metric_t *s_m_peak[HEAP_TAG_COUNT];
+static metric_t *s_m_free_blocks[2];
+static metric_t *s_m_frag[2];
+
+static void collect_heap_prof(void)
+{
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        heap_tag_stats_t st;
+        heap_prof_get_tag((heap_tag_t)t, &st);
+        metric_set(s_m_live[t][0], (int32_t)st.live_bytes[0]);
+        metric_set(s_m_live[t][1], (int32_t)st.live_bytes[1]);
+        metric_set(s_m_peak[t], (int32_t)st.peak_bytes);
+    }
+
+    heap_region_snapshot_t snap[2];
+    heap_prof_get_snapshot(snap, false);
+    for (int r = 0; r < 2; r++) {
+        metric_set(s_m_free_blocks[r], (int32_t)snap[r].free_blocks);
+        /* Share of free memory not usable for the largest request (0 when unknown) */
+        int32_t frag = snap[r].free_bytes && snap[r].largest_free
+                       ? (int32_t)(100 - (uint64_t)snap[r].largest_free * 100 / snap[r].free_bytes)
+                       : 0;
+        metric_set(s_m_frag[r], frag);
+    }
+}
+
+static void metrics_setup(void)
+{
+    static const char *regions[2] = { "internal", "psram" };
+    char labels[48];
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        for (int r = 0; r < 2; r++) {
+            snprintf(labels, sizeof(labels), "tag=\"%s\",region=\"%s\"", s_tag_names[t], regions[r]);
+            s_m_live[t][r] = metrics_gauge("mimi_heap_tag_live_bytes",
+                                           "Live heap bytes by subsystem", labels);
+        }
+        snprintf(labels, sizeof(labels), "tag=\"%s\"", s_tag_names[t]);
+        s_m_peak[t] = metrics_gauge("mimi_heap_tag_peak_bytes", "Peak live heap bytes by subsystem", labels);
+    }
+    for (int r = 0; r < 2; r++) {
+        snprintf(labels, sizeof(labels), "region=\"%s\"", regions[r]);
+        s_m_free_blocks[r] = metrics_gauge("mimi_heap_free_blocks", "Free heap blocks (last snapshot)", labels);
+        s_m_frag[r] = metrics_gauge("mimi_heap_fragmentation_pct",
+                                    "100 - largest free block / free bytes (last snapshot)", labels);
+    }
+    metrics_register_collector(collect_heap_prof);
+}
+
+/* ── Report ────────────────────────────────────────────────── */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} report_buf_t;
+
+static void report_printf(report_buf_t *r, const char *fmt, ...)
+{
+    if (!r->buf || r->len >= r->cap) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(r->buf + r->len, r->cap - r->len, fmt, ap);
+    va_end(ap);
+    if (n > 0) r->len += n;
+    if (r->len >= r->cap) r->len = r->cap - 1;
+}
+
+static void report_hist(report_buf_t *r, const uint32_t *hist)
+{
+    for (int b = 0; b < HEAP_PROF_BUCKETS; b++) {
+        report_printf(r, " %7u", (unsigned)hist[b]);
+    }
+    report_printf(r, "\n");
+}
+
+char *heap_prof_report(void)
+{
+    report_buf_t r = { .cap = 4096 };
+    r.buf = heap_caps_malloc(r.cap, MALLOC_CAP_SPIRAM);
+    if (!r.buf) return NULL;
+    r.buf[0] = '\0';
+
+    heap_tag_stats_t stats[HEAP_TAG_COUNT];
+    PROF_LOCK();
+    memcpy(stats, s_stats, sizeof(stats));
+    uint32_t tracked = s_table_count, untracked = s_untracked;
+    PROF_UNLOCK();
+
+    report_printf(&r, "Heap by subsystem (%s, %u live allocations tracked, %u untracked)\n",
+                  s_enabled ? "on" : "paused", (unsigned)tracked, (unsigned)untracked);
+    report_printf(&r, "%-9s %10s %10s %10s %8s %8s %8s\n",
+                  "tag", "internal", "psram", "peak", "live", "allocs", "frees");
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        const heap_tag_stats_t *st = &stats[t];
+        report_printf(&r, "%-9s %10u %10u %10u %8u %8u %8u\n", s_tag_names[t],
+                      (unsigned)st->live_bytes[0], (unsigned)st->live_bytes[1],
+                      (unsigned)st->peak_bytes, (unsigned)st->live_allocs,
+                      (unsigned)st->allocs, (unsigned)st->frees);
+    }
+
+    static const char *bucket_labels[HEAP_PROF_BUCKETS] = {
+        "<=32", "<=128", "<=512", "<=2K", "<=8K", "<=32K", "<=128K", ">128K",
+    };
+    report_printf(&r, "\nAllocations by size\n%-9s", "tag");
+    for (int b = 0; b < HEAP_PROF_BUCKETS; b++) report_printf(&r, " %7s", bucket_labels[b]);
+    report_printf(&r, "\n");
+    for (int t = 0; t < HEAP_TAG_COUNT; t++) {
+        report_printf(&r, "%-9s", s_tag_names[t]);
+        report_hist(&r, stats[t].size_hist);
+    }
+
+    heap_region_snapshot_t snap[2];
+    uint32_t age_ms = heap_prof_get_snapshot(snap, false);
+    static const char *regions[2] = { "internal", "psram" };
+    report_printf(&r, "\nFree blocks (snapshot %u ms old)\n", (unsigned)age_ms);
+    for (int i = 0; i < 2; i++) {
+        report_printf(&r, "%-9s free %u, largest %u, %u blocks\n         ", regions[i],
+                      (unsigned)snap[i].free_bytes, (unsigned)snap[i].largest_free,
+                      (unsigned)snap[i].free_blocks);
+        report_hist(&r, snap[i].block_hist);
+    }
+    return r.buf;
+}
+
+/* ── Init ──────────────────────────────────────────────────── */
+
+esp_err_t heap_prof_init(void)
+{
+    if (s_table) return ESP_OK;
+
+#if !CONFIG_IDF_TARGET_LINUX && !CONFIG_HEAP_USE_HOOKS
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS is off: free-block snapshots only, no tagging");
+#endif
+
+    heap_entry_t *table = heap_caps_calloc(MIMI_HEAP_PROF_TRACK_MAX, sizeof(heap_entry_t),
+                                           MALLOC_CAP_SPIRAM);
+    if (!table) {
+        ESP_LOGE(TAG, "No PSRAM for %d tracking slots", MIMI_HEAP_PROF_TRACK_MAX);
+        return ESP_ERR_NO_MEM;
+    }
+    metrics_setup();
+    refresh_snapshot();
+
+    TimerHandle_t timer = xTimerCreate("heap_prof", pdMS_TO_TICKS(MIMI_HEAP_PROF_SNAPSHOT_MS),
+                                       pdTRUE, NULL, snapshot_timer_cb);
+    if (!timer || xTimerStart(timer, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Snapshot timer not started; snapshots on demand only");
+    }
+
+    /* Publish last: hooks start recording from here */
+    s_table = table;
+    ESP_LOGI(TAG, "Heap profiler: %d slots (%u bytes PSRAM), snapshot every %d s",
+             MIMI_HEAP_PROF_TRACK_MAX, (unsigned)(MIMI_HEAP_PROF_TRACK_MAX * sizeof(heap_entry_t)),
+             MIMI_HEAP_PROF_SNAPSHOT_MS / 1000);
+    return ESP_OK;
+}
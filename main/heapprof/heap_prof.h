@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Heap allocation tagging and fragmentation profiler.
+ *
+ * Every heap allocation is attributed to a subsystem tag and tracked until
+ * it is freed, giving live bytes (split internal / PSRAM), peak, counts and
+ * a size histogram per tag. The tag comes from the allocating task's name
+ * (tg_* = telegram, lua_* = lua, ...) unless the task opened a scope with
+ * heap_prof_scope_begin(), e.g. the agent loop around LLM calls and tool
+ * execution.
+ *
+ * On the device the allocator hooks (CONFIG_HEAP_USE_HOOKS) feed the
+ * tracker, except for allocations made from an ISR or with the flash
+ * cache disabled, which go untracked; a periodic timer snapshots the free-block distribution of
+ * each region. The host build wraps malloc/free at link time instead
+ * (host/host_heap.c) for leak regression runs.
+ */
+
+typedef enum {
+    HEAP_TAG_OTHER = 0,
+    HEAP_TAG_AGENT,
+    HEAP_TAG_LLM,
+    HEAP_TAG_TOOLS,
+    HEAP_TAG_TELEGRAM,
+    HEAP_TAG_FEISHU,
+    HEAP_TAG_LUA,
+    HEAP_TAG_BUDDY,
+    HEAP_TAG_CAMERA,
+    HEAP_TAG_COUNT,
+} heap_tag_t;
+
+/* Size histogram bounds: <=32, 128, 512, 2K, 8K, 32K, 128K, larger */
+#define HEAP_PROF_BUCKETS 8
+
+typedef struct {
+    uint32_t live_bytes[2];     /* [0] internal, [1] PSRAM */
+    uint32_t peak_bytes;        /* highest live total since reset */
+    uint32_t live_allocs;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t size_hist[HEAP_PROF_BUCKETS];  /* allocations by request size */
+} heap_tag_stats_t;
+
+typedef struct {
+    uint32_t free_bytes;
+    uint32_t largest_free;
+    uint32_t free_blocks;
+    uint32_t block_hist[HEAP_PROF_BUCKETS]; /* free blocks by size */
+} heap_region_snapshot_t;
+
+/**
+ * Allocate the tracking table and start the snapshot timer.
+ * Allocations made before this are not tracked (their frees are ignored).
+ */
+esp_err_t heap_prof_init(void);
+
+/** Pause or resume tracking of new allocations. */
+void heap_prof_set_enabled(bool enabled);
+bool heap_prof_is_enabled(void);
+
+/**
+ * Attribute the calling task's allocations to tag until
+ * heap_prof_scope_end(). Returns the previous tag to pass to scope_end.
+ */
+heap_tag_t heap_prof_scope_begin(heap_tag_t tag);
+void heap_prof_scope_end(heap_tag_t prev);
+
+const char *heap_prof_tag_name(heap_tag_t tag);
+
+/** Per-tag counters. */
+void heap_prof_get_tag(heap_tag_t tag, heap_tag_stats_t *out);
+
+/** Reset peaks, counts and histograms; live bytes are kept. */
+void heap_prof_reset(void);
+
+/**
+ * Latest free-block snapshot: [0] internal, [1] PSRAM.
+ * With refresh, take a new one first. Returns the snapshot age in ms.
+ */
+uint32_t heap_prof_get_snapshot(heap_region_snapshot_t out[2], bool refresh);
+
+/** Text report for the CLI and the host build (caller frees). */
+char *heap_prof_report(void);
+
+/* Allocator hook entry points (device hooks, host link-time wrappers) */
+void heap_prof_on_alloc(void *ptr, size_t size, bool external);
+void heap_prof_on_free(void *ptr);
@@ -0,0 +1,194 @@
+#include "host/host_fs.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "esp_log.h"
+
+static const char *TAG = "host_fs";
+
+#define HOST_PATH_MAX 512
+
+static char s_root[256] = {0};
+
+/* Real libc entry points, resolved by the linker's --wrap */
+FILE *__real_fopen(const char *path, const char *mode);
+DIR *__real_opendir(const char *path);
+int __real_remove(const char *path);
+int __real_rename(const char *from, const char *to);
+int __real_unlink(const char *path);
+int __real_stat(const char *path, struct stat *st);
+int __real_mkdir(const char *path, mode_t mode);
+
+/* ── Path mapping ──────────────────────────────────────────── */
+
+/* Map "/spiffs/..." into the host root; other paths pass through */
+static const char *map_path(const char *path, char *buf, size_t size)
+{
+    size_t base_len = strlen(MIMI_SPIFFS_BASE);
+    if (!s_root[0] || !path || strncmp(path, MIMI_SPIFFS_BASE, base_len) != 0 ||
+        (path[base_len] != '\0' && path[base_len] != '/')) {
+        return path;
+    }
+    snprintf(buf, size, "%s%s", s_root, path);
+    return buf;
+}
+
+/* mkdir -p for the directory part of a mapped path */
+static void make_parents(const char *mapped)
+{
+    char dir[HOST_PATH_MAX];
+    strncpy(dir, mapped, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+
+    char *slash = strrchr(dir, '/');
+    if (!slash || slash == dir) return;
+    *slash = '\0';
+
+    for (char *p = dir + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            __real_mkdir(dir, 0755);
+            *p = '/';
+        }
+    }
+    __real_mkdir(dir, 0755);
+}
+
+/* ── Wrapped libc calls ────────────────────────────────────── */
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+    char buf[HOST_PATH_MAX];
+    const char *mapped = map_path(path, buf, sizeof(buf));
+    if (mapped != path && mode && (mode[0] == 'w' || mode[0] == 'a')) {
+        make_parents(mapped);
+    }
+    return __real_fopen(mapped, mode);
+}
+
+DIR *__wrap_opendir(const char *path)
+{
+    char buf[HOST_PATH_MAX];
+    return __real_opendir(map_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_remove(const char *path)
+{
+    char buf[HOST_PATH_MAX];
+    return __real_remove(map_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_rename(const char *from, const char *to)
+{
+    char buf_from[HOST_PATH_MAX], buf_to[HOST_PATH_MAX];
+    const char *mapped_to = map_path(to, buf_to, sizeof(buf_to));
+    if (mapped_to != to) make_parents(mapped_to);
+    return __real_rename(map_path(from, buf_from, sizeof(buf_from)), mapped_to);
+}
+
+int __wrap_unlink(const char *path)
+{
+    char buf[HOST_PATH_MAX];
+    return __real_unlink(map_path(path, buf, sizeof(buf)));
+}
+
+int __wrap_stat(const char *path, struct stat *st)
+{
+    char buf[HOST_PATH_MAX];
+    return __real_stat(map_path(path, buf, sizeof(buf)), st);
+}
+
+int __wrap_mkdir(const char *path, mode_t mode)
+{
+    char buf[HOST_PATH_MAX];
+    return __real_mkdir(map_path(path, buf, sizeof(buf)), mode);
+}
+
+/* ── Seeding ───────────────────────────────────────────────── */
+
+static void copy_file(const char *from, const char *to)
+{
+    FILE *in = __real_fopen(from, "rb");
+    if (!in) return;
+    make_parents(to);
+    FILE *out = __real_fopen(to, "wb");
+    if (out) {
+        char chunk[1024];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+            fwrite(chunk, 1, n, out);
+        }
+        fclose(out);
+    }
+    fclose(in);
+}
+
+/* Copy seed/rel recursively to <root>/spiffs/rel, keeping existing files */
+static void seed_dir(const char *seed, const char *rel)
+{
+    char src[HOST_PATH_MAX];
+    snprintf(src, sizeof(src), "%s%s", seed, rel);
+    DIR *dir = __real_opendir(src);
+    if (!dir) return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        char child_rel[HOST_PATH_MAX / 2];
+        snprintf(child_rel, sizeof(child_rel), "%s/%s", rel, ent->d_name);
+        char child_src[HOST_PATH_MAX], child_dst[HOST_PATH_MAX];
+        snprintf(child_src, sizeof(child_src), "%s%s", seed, child_rel);
+        snprintf(child_dst, sizeof(child_dst), "%s%s%s", s_root, MIMI_SPIFFS_BASE, child_rel);
+
+        struct stat st;
+        if (__real_stat(child_src, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            seed_dir(seed, child_rel);
+        } else if (__real_stat(child_dst, &st) != 0) {
+            copy_file(child_src, child_dst);
+        }
+    }
+    closedir(dir);
+}
+
+/* ── Public API ────────────────────────────────────────────── */
+
+esp_err_t host_fs_init(void)
+{
+    const char *root = getenv("MIMI_HOST_ROOT");
+    if (root && root[0]) {
+        strncpy(s_root, root, sizeof(s_root) - 1);
+        __real_mkdir(s_root, 0755);
+    } else {
+        strncpy(s_root, "/tmp/mimiclaw-XXXXXX", sizeof(s_root) - 1);
+        if (!mkdtemp(s_root)) {
+            ESP_LOGE(TAG, "mkdtemp failed: %s", strerror(errno));
+            s_root[0] = '\0';
+            return ESP_FAIL;
+        }
+    }
+
+    char base[HOST_PATH_MAX];
+    snprintf(base, sizeof(base), "%s%s", s_root, MIMI_SPIFFS_BASE);
+    __real_mkdir(base, 0755);
+
+    const char *seed = getenv("MIMI_HOST_SEED");
+    if (seed && seed[0]) {
+        seed_dir(seed, "");
+    }
+
+    ESP_LOGI(TAG, "%s backed by %s", MIMI_SPIFFS_BASE, base);
+    return ESP_OK;
+}
+
+const char *host_fs_root(void)
+{
+    return s_root;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "esp_err.h"
+
+/**
+ * Back the /spiffs namespace with a host directory (linux target only).
+ *
+ * fopen/opendir/remove/rename/unlink/stat/mkdir are wrapped at link time
+ * (-Wl,--wrap) so paths under MIMI_SPIFFS_BASE resolve to <root>/spiffs/...
+ * while every module keeps using the on-device paths. Like SPIFFS, writing
+ * a file creates its parent directories.
+ *
+ * root comes from $MIMI_HOST_ROOT, or a fresh mkdtemp() directory under
+ * /tmp. If $MIMI_HOST_SEED names a directory (e.g. spiffs_data), its files
+ * are copied in on first use.
+ */
+esp_err_t host_fs_init(void);
+
+/** Host directory currently backing /spiffs (valid after host_fs_init). */
+const char *host_fs_root(void);
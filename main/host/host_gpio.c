@@ -0,0 +1,171 @@
+/*
+ * Mock GPIO / LEDC driver for the host build, see host/host_gpio.h.
+ */
+#include "host/host_gpio.h"
+
+#include <string.h>
+
+typedef struct {
+    gpio_mode_t     mode;
+    bool            pull_up;
+    bool            pull_down;
+    gpio_int_type_t intr;
+    uint8_t         out;        /* level the pin drives */
+    int8_t          ext;        /* level applied by host_gpio_drive(), -1 none */
+    gpio_isr_t      isr;
+    void           *isr_arg;
+} mock_pin_t;
+
+static mock_pin_t s_pins[GPIO_NUM_MAX];
+static bool s_init = false;
+
+static bool valid(gpio_num_t pin)
+{
+    if (!s_init) {
+        for (int i = 0; i < GPIO_NUM_MAX; i++) s_pins[i].ext = -1;
+        s_init = true;
+    }
+    return pin >= 0 && pin < GPIO_NUM_MAX;
+}
+
+static bool drives(const mock_pin_t *p)
+{
+    return p->mode == GPIO_MODE_OUTPUT || p->mode == GPIO_MODE_OUTPUT_OD ||
+           p->mode == GPIO_MODE_INPUT_OUTPUT || p->mode == GPIO_MODE_INPUT_OUTPUT_OD;
+}
+
+static int level_of(const mock_pin_t *p)
+{
+    if (p->mode == GPIO_MODE_OUTPUT || p->mode == GPIO_MODE_INPUT_OUTPUT) return p->out;
+    /* Open drain: released high unless something pulls it low */
+    if (p->mode == GPIO_MODE_INPUT_OUTPUT_OD && p->out == 0) return 0;
+    if (p->ext >= 0) return p->ext;
+    if (p->mode == GPIO_MODE_INPUT_OUTPUT_OD || p->pull_up) return 1;
+    return 0;
+}
+
+/* Run the pin's handler when a change of level matches its interrupt type */
+static void changed(mock_pin_t *p, int before)
+{
+    int after = level_of(p);
+    if (after == before || !p->isr || p->intr == GPIO_INTR_DISABLE) return;
+    if (p->intr == GPIO_INTR_ANYEDGE ||
+        (p->intr == GPIO_INTR_POSEDGE && after) ||
+        (p->intr == GPIO_INTR_NEGEDGE && !after)) {
+        p->isr(p->isr_arg);
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *cfg)
+{
+    if (!cfg || cfg->pin_bit_mask == 0 || cfg->pin_bit_mask >> GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+    for (int pin = 0; pin < GPIO_NUM_MAX; pin++) {
+        if (!valid(pin) || !(cfg->pin_bit_mask & (1ULL << pin))) continue;
+        mock_pin_t *p = &s_pins[pin];
+        int before = level_of(p);
+        p->mode = cfg->mode;
+        p->pull_up = cfg->pull_up_en == GPIO_PULLUP_ENABLE;
+        p->pull_down = cfg->pull_down_en == GPIO_PULLDOWN_ENABLE;
+        p->intr = cfg->intr_type;
+        changed(p, before);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+    int8_t ext = s_pins[pin].ext;
+    memset(&s_pins[pin], 0, sizeof(s_pins[pin]));
+    s_pins[pin].ext = ext;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+    mock_pin_t *p = &s_pins[pin];
+    int before = level_of(p);
+    p->out = level ? 1 : 0;
+    if (drives(p)) changed(p, before);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    if (!valid(pin)) return 0;
+    const mock_pin_t *p = &s_pins[pin];
+    /* Like the hardware, a pin without its input enabled reads 0 */
+    if (p->mode == GPIO_MODE_OUTPUT || p->mode == GPIO_MODE_OUTPUT_OD) return 0;
+    return level_of(p);
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type)
+{
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+    s_pins[pin].intr = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    (void)flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t fn, void *arg)
+{
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+    s_pins[pin].isr = fn;
+    s_pins[pin].isr_arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+    if (!valid(pin)) return ESP_ERR_INVALID_ARG;
+    s_pins[pin].isr = NULL;
+    s_pins[pin].isr_arg = NULL;
+    return ESP_OK;
+}
+
+void host_gpio_drive(int pin, int level)
+{
+    if (!valid(pin)) return;
+    mock_pin_t *p = &s_pins[pin];
+    int before = level_of(p);
+    p->ext = level ? 1 : 0;
+    changed(p, before);
+}
+
+/* ── LEDC ─────────────────────────────────────────────────── */
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *cfg)
+{
+    return cfg && cfg->freq_hz > 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *cfg)
+{
+    return cfg && valid(cfg->gpio_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t ch, uint32_t duty)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t ch)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t tmr, uint32_t freq)
+{
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t mode, ledc_channel_t ch, uint32_t idle_level)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * Mock GPIO / LEDC driver for the host build (linux target), standing in
+ * for driver/gpio.h and driver/ledc.h so lua/lua_gpio_lib runs unchanged.
+ *
+ * Pins live in memory: outputs keep their level, inputs read what
+ * host_gpio_drive() last applied (or their pull), and a level change on a
+ * pin with an interrupt type calls its handler on the calling thread.
+ * LEDC calls are accepted and do nothing.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define GPIO_NUM_MAX 49
+
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_OUTPUT_OD,
+    GPIO_MODE_INPUT_OUTPUT_OD,
+    GPIO_MODE_INPUT_OUTPUT,
+} gpio_mode_t;
+
+typedef enum { GPIO_PULLUP_DISABLE = 0, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE } gpio_pulldown_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t        pin_bit_mask;
+    gpio_mode_t     mode;
+    gpio_pullup_t   pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void *arg);
+
+esp_err_t gpio_config(const gpio_config_t *cfg);
+esp_err_t gpio_reset_pin(gpio_num_t pin);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type);
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t fn, void *arg);
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin);
+
+/** Apply an external level to pin, as a wire on the header would. */
+void host_gpio_drive(int pin, int level);
+
+/* ── LEDC ─────────────────────────────────────────────────── */
+
+typedef int ledc_channel_t;
+typedef int ledc_timer_t;
+typedef enum { LEDC_LOW_SPEED_MODE = 0 } ledc_mode_t;
+typedef enum { LEDC_TIMER_13_BIT = 13 } ledc_timer_bit_t;
+typedef enum { LEDC_AUTO_CLK = 0 } ledc_clk_cfg_t;
+typedef enum { LEDC_INTR_DISABLE = 0 } ledc_intr_type_t;
+
+typedef struct {
+    ledc_mode_t      speed_mode;
+    ledc_timer_t     timer_num;
+    ledc_timer_bit_t duty_resolution;
+    uint32_t         freq_hz;
+    ledc_clk_cfg_t   clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+    ledc_mode_t      speed_mode;
+    ledc_channel_t   channel;
+    ledc_timer_t     timer_sel;
+    ledc_intr_type_t intr_type;
+    int              gpio_num;
+    uint32_t         duty;
+    int              hpoint;
+} ledc_channel_config_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *cfg);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *cfg);
+esp_err_t ledc_set_duty(ledc_mode_t mode, ledc_channel_t ch, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t mode, ledc_channel_t ch);
+esp_err_t ledc_set_freq(ledc_mode_t mode, ledc_timer_t tmr, uint32_t freq);
+esp_err_t ledc_stop(ledc_mode_t mode, ledc_channel_t ch, uint32_t idle_level);
@@ -0,0 +1,58 @@
+/*
+ * Host build: malloc/free wrapped at link time (-Wl,--wrap) so the heap
+ * profiler sees every allocation the way the allocator hooks do on the
+ * device. Tagging, leak and fragmentation reports are heapprof/heap_prof.c.
+ */
+#include "heapprof/heap_prof.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+/* Real libc entry points, resolved by the linker's --wrap */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+    void *p = __real_malloc(size);
+    heap_prof_on_alloc(p, size, false);
+    return p;
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    void *p = __real_calloc(n, size);
+    heap_prof_on_alloc(p, n * size, false);
+    return p;
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    /* Untrack first: once realloc returns, another thread may get ptr back */
+    heap_prof_on_free(ptr);
+    void *p = __real_realloc(ptr, size);
+    if (p) {
+        heap_prof_on_alloc(p, size, false);
+    } else if (ptr && size) {
+        heap_prof_on_alloc(ptr, malloc_usable_size(ptr), false);    /* still valid */
+    }
+    return p;
+}
+
+void __wrap_free(void *ptr)
+{
+    heap_prof_on_free(ptr);
+    __real_free(ptr);
+}
+
+/* libc's strdup allocates internally, out of reach of the malloc wrap */
+char *__wrap_strdup(const char *s)
+{
+    char *p = __real_strdup(s);
+    if (p) heap_prof_on_alloc(p, strlen(p) + 1, false);
+    return p;
+}
@@ -0,0 +1,276 @@
+/*
+ * Host entry point (ESP-IDF linux target): the agent core, built from the
+ * firmware sources, with /spiffs backed by a temp directory, NVS backed by
+ * the linux NVS file, and stdin/stdout standing in for a chat channel.
+ *
+ *   idf.py --preview set-target linux && idf.py build
+ *   MIMI_LLM_URL=http://127.0.0.1:8080/v1/messages MIMI_LLM_API_KEY=test \
+ *       MIMI_HOST_SEED=spiffs_data ./build/mimiclaw.elf
+ *
+ * Each stdin line is one inbound message on channel "cli", chat "host".
+ * Lines starting with '/' are host commands: /metrics, /trace, /quit,
+ * /mock [stop] (local mock provider, see bench/llm_mock.h),
+ * /bench <turns> [concurrency], /heap [reset] (allocations by
+ * subsystem, see heapprof/heap_prof.h; also printed at /quit),
+ * /offline [down|up|clear] (simulated outage, see offline/offline_queue.h)
+ * /luabench [runs] (cold vs warm script_run, see lua/lua_runner.h),
+ * /jsonbench [iters] (native json vs pure Lua, see lua/lua_json_lib.h),
+ * /gpiobench [pin] [iters] (Lua gpio calls on the mock driver, see
+ * lua/lua_gpio_lib.h) and /gpio <pin> <0|1> (drive a mock input pin).
+ * A self-contained benchmark:
+ *
+ *   MIMI_LLM_URL=http://127.0.0.1:18782/v1/messages ./build/mimiclaw.elf
+ *   /mock
+ *   /bench 50 2
+ */
+#include "mimi_config.h"
+#include "host/host_fs.h"
+#include "bus/message_bus.h"
+#include "metrics/metrics.h"
+#include "config/config_registry.h"
+#include "trace/trace.h"
+#include "arena/turn_arena.h"
+#include "heapprof/heap_prof.h"
+#include "offline/offline_queue.h"
+#include "bench/llm_mock.h"
+#include "bench/bench.h"
+#include "llm/llm_proxy.h"
+#include "agent/agent_loop.h"
+#include "memory/memory_store.h"
+#include "memory/session_mgr.h"
+#include "tools/tool_registry.h"
+#include "lua/lua_runner.h"
+#include "lua/lua_daemon.h"
+#include "lua/lua_sched.h"
+#include "lua/lua_json_lib.h"
+#include "lua/lua_gpio_lib.h"
+#include "host/host_gpio.h"
+#include "cron/cron_service.h"
+#include "skills/skill_loader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_event.h"
+#include "nvs_flash.h"
+
+static const char *TAG = "host";
+
+#define HOST_CHAT_ID     "host"
+#define HOST_LINE_MAX    4096
+
+/* Apply MIMI_LLM_* environment overrides (persisted in the host NVS file) */
+static void apply_env_config(void)
+{
+    const char *v;
+    if ((v = getenv("MIMI_LLM_PROVIDER")) && v[0]) llm_set_provider(v);
+    if ((v = getenv("MIMI_LLM_MODEL")) && v[0]) llm_set_model(v);
+    if ((v = getenv("MIMI_LLM_API_KEY")) && v[0]) llm_set_api_key(v);
+    if ((v = getenv("MIMI_LLM_URL"))) llm_set_api_url(v);
+}
+
+/* Outbound "channel": print final replies, skip in-progress snapshots */
+static void host_outbound_task(void *arg)
+{
+    while (1) {
+        mimi_msg_t msg;
+        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
+
+        if (strcmp(msg.channel, MIMI_CHAN_BENCH) == 0) {
+            bench_deliver(&msg);
+        } else if (strcmp(msg.type, "collapsible") == 0) {
+            printf("[%s:%s] %s\n%s\n", msg.channel, msg.chat_id,
+                   msg.payload.collapsible.title ? msg.payload.collapsible.title : "",
+                   msg.payload.collapsible.body ? msg.payload.collapsible.body : "");
+        } else if (strcmp(msg.type, "stream") != 0 && msg.payload.text) {
+            printf("[%s:%s] %s\n", msg.channel, msg.chat_id, msg.payload.text);
+        }
+        fflush(stdout);
+        mimi_msg_free(&msg);
+    }
+}
+
+static void print_heap_report(void)
+{
+    char *text = heap_prof_report();
+    if (text) {
+        fputs(text, stdout);
+        free(text);
+    }
+}
+
+static void host_command(const char *line)
+{
+    if (strcmp(line, "/metrics") == 0) {
+        char *text = metrics_render();
+        if (text) {
+            fputs(text, stdout);
+            free(text);
+        }
+    } else if (strcmp(line, "/trace") == 0) {
+        char path[300];
+        snprintf(path, sizeof(path), "%s/trace.json", host_fs_root());
+        char *json = trace_export_json();
+        FILE *f = json ? fopen(path, "w") : NULL;
+        if (f) {
+            fputs(json, f);
+            fclose(f);
+            printf("Trace written to %s\n", path);
+        }
+        free(json);
+    } else if (strncmp(line, "/mock", 5) == 0) {
+        if (strcmp(line + 5, " stop") == 0) {
+            llm_mock_stop();
+        } else {
+            llm_mock_config_t cfg;
+            llm_mock_default_config(&cfg);
+            if (llm_mock_start(&cfg) == ESP_OK) {
+                printf("Mock LLM on port %d\n", MIMI_LLM_MOCK_PORT);
+            }
+        }
+    } else if (strncmp(line, "/bench", 6) == 0) {
+        int turns = 10, concurrency = 1;
+        sscanf(line + 6, "%d %d", &turns, &concurrency);
+        char *report = NULL;
+        esp_err_t err = bench_run(turns, concurrency, 0, &report);
+        if (err == ESP_OK) {
+            printf("%s\n", report);
+            free(report);
+        } else {
+            printf("Benchmark failed: %s\n", esp_err_to_name(err));
+        }
+    } else if (strncmp(line, "/luabench", 9) == 0) {
+        int runs = 100;
+        sscanf(line + 9, "%d", &runs);
+        char *report = NULL;
+        esp_err_t err = lua_runner_bench(runs, &report);
+        if (err == ESP_OK) {
+            printf("%s\n", report);
+            free(report);
+        } else {
+            printf("Lua benchmark failed: %s\n", esp_err_to_name(err));
+        }
+    } else if (strncmp(line, "/jsonbench", 10) == 0) {
+        int iters = 100;
+        sscanf(line + 10, "%d", &iters);
+        char *report = NULL;
+        esp_err_t err = lua_json_bench(iters, &report);
+        if (err == ESP_OK) {
+            printf("%s\n", report);
+            free(report);
+        } else {
+            printf("JSON benchmark failed: %s\n", esp_err_to_name(err));
+        }
+    } else if (strncmp(line, "/gpiobench", 10) == 0) {
+        int pin = 2, iters = 10000;
+        sscanf(line + 10, "%d %d", &pin, &iters);
+        char *report = NULL;
+        esp_err_t err = lua_gpio_bench(pin, iters, &report);
+        if (err == ESP_OK) {
+            printf("%s\n", report);
+            free(report);
+        } else {
+            printf("GPIO benchmark failed: %s\n", esp_err_to_name(err));
+        }
+    } else if (strncmp(line, "/gpio ", 6) == 0) {
+        int pin = -1, level = 0;
+        if (sscanf(line + 6, "%d %d", &pin, &level) == 2) {
+            host_gpio_drive(pin, level);
+        } else {
+            printf("Usage: /gpio <pin> <0|1>\n");
+        }
+    } else if (strncmp(line, "/heap", 5) == 0) {
+        if (strcmp(line + 5, " reset") == 0) {
+            heap_prof_reset();
+        } else {
+            print_heap_report();
+        }
+    } else if (strncmp(line, "/offline", 8) == 0) {
+        if (strcmp(line + 8, " down") == 0 || strcmp(line + 8, " up") == 0) {
+            offline_queue_set_forced_down(strcmp(line + 8, " down") == 0);
+        } else if (strcmp(line + 8, " clear") == 0) {
+            offline_queue_clear();
+        }
+        offline_stats_t in, out;
+        offline_queue_get_stats(OFFLINE_INBOUND, &in);
+        offline_queue_get_stats(OFFLINE_OUTBOUND, &out);
+        printf("Link %s; deferred turns %u (replayed %u, expired %u), replies %u\n",
+               offline_queue_link_up() ? "up" : "down", (unsigned)in.pending,
+               (unsigned)in.replayed, (unsigned)in.expired, (unsigned)out.pending);
+    } else if (strcmp(line, "/quit") == 0) {
+        config_flush();         /* exit() skips shutdown handlers */
+        print_heap_report();    /* live bytes left per tag: leak check */
+        exit(0);
+    } else {
+        printf("Host commands: /metrics, /trace, /mock [stop], /bench <turns> [concurrency], "
+               "/heap [reset], /offline [down|up|clear], /luabench [runs], /jsonbench [iters], "
+               "/gpiobench [pin] [iters], /gpio <pin> <0|1>, /quit\n");
+    }
+}
+
+void app_main(void)
+{
+    ESP_ERROR_CHECK(host_fs_init());
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    ESP_ERROR_CHECK(metrics_init());
+    ESP_ERROR_CHECK(config_init());    /* NVS config into RAM: before any module reads it */
+    heap_prof_init();       /* tracks allocations from here on */
+    trace_init();
+    turn_arena_init();      /* installs cJSON hooks: before other tasks start */
+    ESP_ERROR_CHECK(message_bus_init());
+    ESP_ERROR_CHECK(memory_store_init());
+    ESP_ERROR_CHECK(skill_loader_init());
+    ESP_ERROR_CHECK(session_mgr_init());
+    ESP_ERROR_CHECK(offline_queue_init());
+    ESP_ERROR_CHECK(llm_proxy_init());
+    apply_env_config();
+    ESP_ERROR_CHECK(tool_registry_init());
+    if (lua_runner_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Lua pool not started, scripts run cold");
+    }
+    if (lua_daemon_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Lua daemon task not started");
+    }
+    if (lua_sched_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Lua scheduler not started, no background scripts");
+    }
+    ESP_ERROR_CHECK(cron_service_init());
+    ESP_ERROR_CHECK(agent_loop_init());
+
+    ESP_ERROR_CHECK((xTaskCreate(host_outbound_task, "outbound", MIMI_OUTBOUND_STACK,
+                                 NULL, MIMI_OUTBOUND_PRIO, NULL) == pdPASS)
+                    ? ESP_OK : ESP_FAIL);
+    ESP_ERROR_CHECK(agent_loop_start());
+    cron_service_start();
+    ESP_ERROR_CHECK(offline_queue_start());
+
+    ESP_LOGI(TAG, "Host agent ready (files under %s)", host_fs_root());
+
+    static char line[HOST_LINE_MAX];
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
+        if (line[0] == '/') {
+            host_command(line);
+            continue;
+        }
+
+        mimi_msg_t msg = {0};
+        strncpy(msg.channel, MIMI_CHAN_CLI, sizeof(msg.channel) - 1);
+        strncpy(msg.chat_id, HOST_CHAT_ID, sizeof(msg.chat_id) - 1);
+        strncpy(msg.type, "text", sizeof(msg.type) - 1);
+        msg.payload.text = strdup(line);
+        if (!msg.payload.text || message_bus_push_inbound(&msg) != ESP_OK) {
+            ESP_LOGW(TAG, "Inbound queue full, message dropped");
+            free(msg.payload.text);
+        }
+    }
+
+    /* stdin closed: let queued turns finish before the process exits */
+    vTaskDelay(portMAX_DELAY);
+}
@@ -0,0 +1,92 @@
+/*
+ * Stand-ins for modules left out of the host build (linux target): the
+ * HTTP CONNECT proxy, the WebSocket gateway and the tools that need the
+ * network stack or hardware. Everything else in the agent core is the
+ * firmware source, unchanged.
+ */
+#include "proxy/http_proxy.h"
+#include "gateway/ws_server.h"
+#include "tools/tool_web_search.h"
+#include "tools/tool_http_request.h"
+
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
+
+/* ── HTTP proxy: always direct, keep the shared request lock ── */
+
+static SemaphoreHandle_t s_http_lock = NULL;
+
+bool http_proxy_is_enabled(void)
+{
+    return false;
+}
+
+bool http_proxy_http_lock(int timeout_ms)
+{
+    if (!s_http_lock) {
+        s_http_lock = xSemaphoreCreateMutex();
+        if (!s_http_lock) return false;
+    }
+    return xSemaphoreTake(s_http_lock, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+void http_proxy_http_unlock(void)
+{
+    if (s_http_lock) xSemaphoreGive(s_http_lock);
+}
+
+proxy_conn_t *proxy_conn_open(const char *host, int port, int timeout_ms)
+{
+    return NULL;
+}
+
+int proxy_conn_write(proxy_conn_t *conn, const char *data, int len)
+{
+    return -1;
+}
+
+int proxy_conn_read(proxy_conn_t *conn, char *buf, int len, int timeout_ms)
+{
+    return -1;
+}
+
+void proxy_conn_close(proxy_conn_t *conn)
+{
+}
+
+/* ── WebSocket gateway: no subscribers ─────────────────────── */
+
+bool ws_server_has_subscribers(void)
+{
+    return false;
+}
+
+void ws_server_publish_event(cJSON *event)
+{
+    cJSON_Delete(event);
+}
+
+/* ── Network/hardware tools: registered but unavailable ────── */
+
+static esp_err_t host_tool_unavailable(char *output, size_t output_size)
+{
+    snprintf(output, output_size, "Error: tool not available in the host build");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t tool_web_search_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t output_size)
+{
+    return host_tool_unavailable(output, output_size);
+}
+
+esp_err_t tool_http_request_execute(const char *input_json, char *output, size_t output_size)
+{
+    return host_tool_unavailable(output, output_size);
+}
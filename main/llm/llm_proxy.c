@@ -1,6 +1,10 @@
 #include "llm_proxy.h"
 #include "mimi_config.h"
 #include "proxy/http_proxy.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+#include "arena/turn_arena.h"
+#include "config/config_registry.h"
 
 #include <string.h>
 #include <strings.h>
@@ -9,15 +13,16 @@
 #include "esp_http_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "nvs.h"
 #include "cJSON.h"
 
 static const char *TAG = "llm";
 
 #define LLM_API_KEY_MAX_LEN 320
 #define LLM_MODEL_MAX_LEN   64
+#define LLM_API_URL_MAX_LEN 192
 #define LLM_DUMP_MAX_BYTES   (16 * 1024)
 #define LLM_DUMP_CHUNK_BYTES 320
 #define LLM_HTTP_BUFFER_RX    1024
@@ -26,6 +31,7 @@ static const char *TAG = "llm";
 static char s_api_key[LLM_API_KEY_MAX_LEN] = {0};
 static char s_model[LLM_MODEL_MAX_LEN] = MIMI_LLM_DEFAULT_MODEL;
 static char s_provider[16] = MIMI_LLM_PROVIDER_DEFAULT;
+static char s_api_url[LLM_API_URL_MAX_LEN] = {0};  /* endpoint override, e.g. a local mock */
 
 typedef enum {
     LLM_PROVIDER_ANTHROPIC = 0,
@@ -57,6 +63,8 @@ static const provider_map_t k_provider_map[] = {
 
 static llm_provider_t s_llm_provider = LLM_PROVIDER_ANTHROPIC;
 
+static void llm_metrics_init(void);
+
 static llm_provider_t provider_parse(const char *str)
 {
     if (!str) return LLM_PROVIDER_UNKNOWN;
@@ -148,6 +156,8 @@ typedef struct {
     char *data;
     size_t len;
     size_t cap;
+    int64_t connected_us;   /* esp_timer time the TLS connection was up */
+    int64_t first_byte_us;  /* esp_timer time the first response byte arrived */
 } resp_buf_t;
 
 static esp_err_t resp_buf_init(resp_buf_t *rb, size_t initial_cap)
@@ -156,11 +166,16 @@ static esp_err_t resp_buf_init(resp_buf_t *rb, size_t initial_cap)
     if (!rb->data) return ESP_ERR_NO_MEM;
     rb->len = 0;
     rb->cap = initial_cap;
+    rb->connected_us = 0;
+    rb->first_byte_us = 0;
     return ESP_OK;
 }
 
 static esp_err_t resp_buf_append(resp_buf_t *rb, const char *data, size_t len)
 {
+    if (rb->first_byte_us == 0 && len > 0) {
+        rb->first_byte_us = esp_timer_get_time();
+    }
     if (rb->len + len > MIMI_LLM_RESP_MAX_BYTES) {
         ESP_LOGE(TAG, "Response too large (>%u bytes), aborting", MIMI_LLM_RESP_MAX_BYTES);
         return ESP_ERR_NO_MEM;
@@ -197,6 +212,8 @@ static void resp_buf_reset(resp_buf_t *rb)
     }
     rb->len = 0;
     rb->data[0] = '\0';
+    rb->connected_us = 0;
+    rb->first_byte_us = 0;
 }
 
 
@@ -253,7 +270,9 @@ static void resp_buf_decode_chunked(resp_buf_t *rb)
 static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 {
     resp_buf_t *rb = (resp_buf_t *)evt->user_data;
-    if (evt->event_id == HTTP_EVENT_ON_DATA) {
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED) {
+        rb->connected_us = esp_timer_get_time();
+    } else if (evt->event_id == HTTP_EVENT_ON_DATA) {
         if (resp_buf_append(rb, (const char *)evt->data, evt->data_len) != ESP_OK) {
             return ESP_FAIL;
         }
@@ -263,21 +282,20 @@ static esp_err_t http_event_handler(esp_http_client_event_t *evt)
 
 /* ── Provider helpers ──────────────────────────────────────────── */
 
-static const char *llm_api_url(void)  { return provider_entry()->url;  }
+static const char *llm_api_url(void)  { return s_api_url[0] ? s_api_url : provider_entry()->url; }
 static const char *llm_api_host(void) { return provider_entry()->host; }
 static const char *llm_api_path(void) { return provider_entry()->path; }
 
 /* ── Init ─────────────────────────────────────────────────────── */
 
-esp_err_t llm_proxy_init(void)
+/* Build-time defaults, then registry overrides (highest priority, set via CLI) */
+static void load_config(void)
 {
-    /* Start with build-time defaults */
-    if (MIMI_SECRET_API_KEY[0] != '\0') {
-        safe_copy(s_api_key, sizeof(s_api_key), MIMI_SECRET_API_KEY);
-    }
-    if (MIMI_SECRET_MODEL[0] != '\0') {
-        safe_copy(s_model, sizeof(s_model), MIMI_SECRET_MODEL);
-    }
+    safe_copy(s_api_key, sizeof(s_api_key), MIMI_SECRET_API_KEY);
+    safe_copy(s_model, sizeof(s_model),
+              MIMI_SECRET_MODEL[0] != '\0' ? MIMI_SECRET_MODEL : MIMI_LLM_DEFAULT_MODEL);
+    safe_copy(s_provider, sizeof(s_provider), MIMI_LLM_PROVIDER_DEFAULT);
+    s_llm_provider = LLM_PROVIDER_ANTHROPIC;
     if (MIMI_SECRET_MODEL_PROVIDER[0] != '\0') {
         safe_copy(s_provider, sizeof(s_provider), MIMI_SECRET_MODEL_PROVIDER);
         s_llm_provider = provider_parse(s_provider);
@@ -287,33 +305,46 @@ esp_err_t llm_proxy_init(void)
         }
     }
 
-    /* NVS overrides take highest priority (set via CLI) */
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_LLM, NVS_READONLY, &nvs) == ESP_OK) {
-        char tmp[LLM_API_KEY_MAX_LEN] = {0};
-        size_t len = sizeof(tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_API_KEY, tmp, &len) == ESP_OK && tmp[0]) {
-            safe_copy(s_api_key, sizeof(s_api_key), tmp);
-        }
-        char model_tmp[LLM_MODEL_MAX_LEN] = {0};
-        len = sizeof(model_tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_MODEL, model_tmp, &len) == ESP_OK && model_tmp[0]) {
-            safe_copy(s_model, sizeof(s_model), model_tmp);
-        }
-        char provider_tmp[16] = {0};
-        len = sizeof(provider_tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_PROVIDER, provider_tmp, &len) == ESP_OK && provider_tmp[0]) {
-            llm_provider_t parsed = provider_parse(provider_tmp);
-            if (parsed == LLM_PROVIDER_UNKNOWN) {
-                ESP_LOGW(TAG, "Unknown provider '%s' in NVS; keeping current provider", provider_tmp);
-            } else {
-                safe_copy(s_provider, sizeof(s_provider), provider_tmp);
-                s_llm_provider = parsed;
-            }
+    char tmp[LLM_API_KEY_MAX_LEN] = {0};
+    if (config_get_str(MIMI_NVS_LLM, MIMI_NVS_KEY_API_KEY, tmp, sizeof(tmp)) == ESP_OK && tmp[0]) {
+        safe_copy(s_api_key, sizeof(s_api_key), tmp);
+    }
+    char model_tmp[LLM_MODEL_MAX_LEN] = {0};
+    if (config_get_str(MIMI_NVS_LLM, MIMI_NVS_KEY_MODEL, model_tmp, sizeof(model_tmp)) == ESP_OK &&
+        model_tmp[0]) {
+        safe_copy(s_model, sizeof(s_model), model_tmp);
+    }
+    if (config_get_str(MIMI_NVS_LLM, MIMI_NVS_KEY_API_URL, s_api_url, sizeof(s_api_url)) != ESP_OK) {
+        s_api_url[0] = '\0';
+    }
+    char provider_tmp[16] = {0};
+    if (config_get_str(MIMI_NVS_LLM, MIMI_NVS_KEY_PROVIDER, provider_tmp, sizeof(provider_tmp)) == ESP_OK &&
+        provider_tmp[0]) {
+        llm_provider_t parsed = provider_parse(provider_tmp);
+        if (parsed == LLM_PROVIDER_UNKNOWN) {
+            ESP_LOGW(TAG, "Unknown provider '%s' in NVS; keeping current provider", provider_tmp);
+        } else {
+            safe_copy(s_provider, sizeof(s_provider), provider_tmp);
+            s_llm_provider = parsed;
         }
-        nvs_close(nvs);
     }
+}
 
+/* Setters, the admin portal and config resets all land here */
+static void on_llm_config_changed(const char *ns, const char *key, void *arg)
+{
+    load_config();
+}
+
+esp_err_t llm_proxy_init(void)
+{
+    llm_metrics_init();
+    load_config();
+    config_subscribe(MIMI_NVS_LLM, on_llm_config_changed, NULL);
+
+    if (s_api_url[0]) {
+        ESP_LOGW(TAG, "LLM endpoint overridden: %s", s_api_url);
+    }
     if (s_api_key[0]) {
         ESP_LOGI(TAG, "LLM proxy initialized (provider: %s, model: %s)", s_provider, s_model);
     } else {
@@ -365,6 +396,7 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
 {
     proxy_conn_t *conn = proxy_conn_open(llm_api_host(), 443, 30000);
     if (!conn) return ESP_ERR_HTTP_CONNECT;
+    rb->connected_us = esp_timer_get_time();
 
     int body_len = strlen(post_data);
     char header[1024];
@@ -435,16 +467,93 @@ static esp_err_t llm_http_via_proxy(const char *post_data, resp_buf_t *rb, int *
 
 /* ── Shared HTTP dispatch ─────────────────────────────────────── */
 
+static metric_t *s_m_latency;
+static metric_t *s_m_req_bytes;
+static metric_t *s_m_resp_bytes;
+static metric_t *s_m_retries;
+static metric_t *s_m_status[5];     /* 2xx, 4xx, 5xx, other, transport error */
+
+/* Plain totals behind llm_get_stats(), for callers that diff snapshots */
+static llm_stats_t s_stats = {0};
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void llm_metrics_init(void)
+{
+    static const char *classes[5] = {
+        "code=\"2xx\"", "code=\"4xx\"", "code=\"5xx\"", "code=\"other\"", "code=\"error\"",
+    };
+    s_m_latency = metrics_histogram("mimi_llm_request_ms", "LLM HTTP round trip", NULL,
+                                    METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+    s_m_req_bytes = metrics_counter("mimi_llm_request_bytes_total", "LLM request body bytes", NULL);
+    s_m_resp_bytes = metrics_counter("mimi_llm_response_bytes_total", "LLM response body bytes", NULL);
+    s_m_retries = metrics_counter("mimi_llm_retries_total", "LLM requests retried after a transient failure", NULL);
+    for (int i = 0; i < 5; i++) {
+        s_m_status[i] = metrics_counter("mimi_llm_responses_total", "LLM responses by status class", classes[i]);
+    }
+}
+
+static void llm_metrics_record(esp_err_t err, int status, size_t req_len, size_t resp_len, int64_t start_us)
+{
+    int cls = 3;
+    if (err != ESP_OK) cls = 4;
+    else if (status >= 200 && status < 300) cls = 0;
+    else if (status >= 400 && status < 500) cls = 1;
+    else if (status >= 500 && status < 600) cls = 2;
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_stats.requests++;
+    if (cls != 0) s_stats.errors++;
+    s_stats.req_bytes += req_len;
+    s_stats.resp_bytes += resp_len;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    metric_inc(s_m_status[cls]);
+    metric_observe_since(s_m_latency, start_us);
+    metric_add(s_m_req_bytes, (uint32_t)req_len);
+    metric_add(s_m_resp_bytes, (uint32_t)resp_len);
+}
+
+void llm_get_stats(llm_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    strncpy(out->provider, provider_entry()->name, sizeof(out->provider) - 1);
+    out->provider[sizeof(out->provider) - 1] = '\0';
+    strncpy(out->url, llm_api_url(), sizeof(out->url) - 1);
+    out->url[sizeof(out->url) - 1] = '\0';
+}
+
+/* Split an LLM round trip into connect (DNS + TCP + TLS), wait (request
+ * upload + model time to first byte) and receive spans. After a retry the
+ * phases cover the final attempt only. */
+static void llm_trace_phases(const resp_buf_t *rb, int64_t start_us)
+{
+    int64_t end_us = esp_timer_get_time();
+    const char *provider = provider_entry()->name;
+    trace_record("llm_http", provider, start_us, end_us);
+    if (!rb->connected_us) return;
+    trace_record("llm_connect", NULL, start_us, rb->connected_us);
+    int64_t first_us = rb->first_byte_us ? rb->first_byte_us : end_us;
+    trace_record("llm_wait", NULL, rb->connected_us, first_us);
+    if (rb->first_byte_us) {
+        trace_record("llm_recv", NULL, rb->first_byte_us, end_us);
+    }
+}
+
 static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_status)
 {
+    int64_t start_us = esp_timer_get_time();
     if (!http_proxy_http_lock(10000)) {
         ESP_LOGE(TAG, "HTTP lock timeout before LLM request");
         return ESP_ERR_TIMEOUT;
     }
+    int64_t locked_us = esp_timer_get_time();
+    trace_record("http_lock_wait", NULL, start_us, locked_us);
 
-
+    /* An endpoint override (local mock, self-hosted gateway) is reached directly */
     esp_err_t ret = ESP_FAIL;
-    if (http_proxy_is_enabled()) {
+    if (http_proxy_is_enabled() && !s_api_url[0]) {
         ret = llm_http_via_proxy(post_data, rb, out_status);
     } else {
         esp_err_t err = llm_http_direct(post_data, rb, out_status);
@@ -456,6 +565,7 @@ static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_s
                      esp_err_to_name(err),
                      (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
                      (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+            metric_inc(s_m_retries);
             resp_buf_reset(rb);
             if (out_status) {
                 *out_status = 0;
@@ -468,6 +578,8 @@ static esp_err_t llm_http_call(const char *post_data, resp_buf_t *rb, int *out_s
     }
 
     http_proxy_http_unlock();
+    llm_trace_phases(rb, locked_us);
+    llm_metrics_record(ret, out_status ? *out_status : 0, strlen(post_data), rb->len, start_us);
     return ret;
 }
 
@@ -612,7 +724,7 @@ static cJSON *convert_messages_openai(const char *system_prompt, cJSON *messages
                         char *args = cJSON_PrintUnformatted(input);
                         if (args) {
                             cJSON_AddStringToObject(func, "arguments", args);
-                            free(args);
+                            cJSON_free(args);
                         }
                     }
                     cJSON_AddItemToObject(tc, "function", func);
@@ -763,14 +875,14 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
 
     resp_buf_t rb;
     if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
+        cJSON_free(post_data);
         snprintf(response_buf, buf_size, "Error: Out of memory");
         return ESP_ERR_NO_MEM;
     }
 
     int status = 0;
     esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    cJSON_free(post_data);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
@@ -820,11 +932,11 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
 
 void llm_response_free(llm_response_t *resp)
 {
-    free(resp->text);
+    turn_arena_free(resp->text);
     resp->text = NULL;
     resp->text_len = 0;
     for (int i = 0; i < resp->call_count; i++) {
-        free(resp->calls[i].input);
+        turn_arena_free(resp->calls[i].input);
         resp->calls[i].input = NULL;
     }
     resp->call_count = 0;
@@ -887,13 +999,13 @@ esp_err_t llm_chat_tools(const char *system_prompt,
     /* HTTP call */
     resp_buf_t rb;
     if (resp_buf_init(&rb, MIMI_LLM_STREAM_BUF_SIZE) != ESP_OK) {
-        free(post_data);
+        cJSON_free(post_data);
         return ESP_ERR_NO_MEM;
     }
 
     int status = 0;
     esp_err_t err = llm_http_call(post_data, &rb, &status);
-    free(post_data);
+    cJSON_free(post_data);
 
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP request failed: %s", esp_err_to_name(err));
@@ -911,6 +1023,7 @@ esp_err_t llm_chat_tools(const char *system_prompt,
     }
 
     /* Parse full JSON response */
+    resp->first_byte_us = rb.first_byte_us;
     cJSON *root = cJSON_Parse(rb.data);
     resp_buf_free(&rb);
 
@@ -919,6 +1032,16 @@ esp_err_t llm_chat_tools(const char *system_prompt,
         return ESP_FAIL;
     }
 
+    /* Token usage: Anthropic input/output_tokens, OpenAI prompt/completion_tokens */
+    cJSON *usage = cJSON_GetObjectItem(root, "usage");
+    if (usage) {
+        bool anthropic = (s_llm_provider == LLM_PROVIDER_ANTHROPIC);
+        cJSON *in = cJSON_GetObjectItem(usage, anthropic ? "input_tokens" : "prompt_tokens");
+        cJSON *out = cJSON_GetObjectItem(usage, anthropic ? "output_tokens" : "completion_tokens");
+        if (cJSON_IsNumber(in)) resp->input_tokens = in->valueint;
+        if (cJSON_IsNumber(out)) resp->output_tokens = out->valueint;
+    }
+
     if (s_llm_provider != LLM_PROVIDER_ANTHROPIC) {
         cJSON *choices = cJSON_GetObjectItem(root, "choices");
         cJSON *choice0 = choices && cJSON_IsArray(choices) ? cJSON_GetArrayItem(choices, 0) : NULL;
@@ -933,9 +1056,9 @@ esp_err_t llm_chat_tools(const char *system_prompt,
                 cJSON *content = cJSON_GetObjectItem(message, "content");
                 if (content && cJSON_IsString(content)) {
                     size_t tlen = strlen(content->valuestring);
-                    resp->text = calloc(1, tlen + 1);
+                    resp->text = turn_arena_alloc(tlen + 1);
                     if (resp->text) {
-                        memcpy(resp->text, content->valuestring, tlen);
+                        memcpy(resp->text, content->valuestring, tlen + 1);
                         resp->text_len = tlen;
                     }
                 }
@@ -958,7 +1081,7 @@ esp_err_t llm_chat_tools(const char *system_prompt,
                                 strncpy(call->name, name->valuestring, sizeof(call->name) - 1);
                             }
                             if (args && cJSON_IsString(args)) {
-                                call->input = strdup(args->valuestring);
+                                call->input = turn_arena_strdup(args->valuestring);
                                 if (call->input) {
                                     call->input_len = strlen(call->input);
                                 }
@@ -997,7 +1120,7 @@ esp_err_t llm_chat_tools(const char *system_prompt,
 
             /* Allocate and copy text */
             if (total_text > 0) {
-                resp->text = calloc(1, total_text + 1);
+                resp->text = turn_arena_alloc(total_text + 1);
                 if (resp->text) {
                     cJSON_ArrayForEach(block, content) {
                         cJSON *btype = cJSON_GetObjectItem(block, "type");
@@ -1057,26 +1180,16 @@ esp_err_t llm_chat_tools(const char *system_prompt,
 
 esp_err_t llm_set_api_key(const char *api_key)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_API_KEY, api_key));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
-
-    safe_copy(s_api_key, sizeof(s_api_key), api_key);
+    esp_err_t err = config_set_str(MIMI_NVS_LLM, MIMI_NVS_KEY_API_KEY, api_key);
+    if (err != ESP_OK) return err;
     ESP_LOGI(TAG, "API key saved");
     return ESP_OK;
 }
 
 esp_err_t llm_set_model(const char *model)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_MODEL, model));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
-
-    safe_copy(s_model, sizeof(s_model), model);
+    esp_err_t err = config_set_str(MIMI_NVS_LLM, MIMI_NVS_KEY_MODEL, model);
+    if (err != ESP_OK) return err;
     ESP_LOGI(TAG, "Model set to: %s", s_model);
     return ESP_OK;
 }
@@ -1089,14 +1202,27 @@ esp_err_t llm_set_provider(const char *provider)
         return ESP_ERR_INVALID_ARG;
     }
 
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_LLM, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_PROVIDER, provider));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
-
-    safe_copy(s_provider, sizeof(s_provider), provider);
-    s_llm_provider = provider_parse(s_provider);
+    esp_err_t err = config_set_str(MIMI_NVS_LLM, MIMI_NVS_KEY_PROVIDER, provider);
+    if (err != ESP_OK) return err;
     ESP_LOGI(TAG, "Provider set to: %s", s_provider);
     return ESP_OK;
 }
+
+esp_err_t llm_set_api_url(const char *url)
+{
+    if (url && url[0] && strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0) {
+        ESP_LOGE(TAG, "API URL must start with http:// or https://");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (url && strlen(url) >= sizeof(s_api_url)) {
+        ESP_LOGE(TAG, "API URL too long (max %d)", (int)sizeof(s_api_url) - 1);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t err = (url && url[0])
+                    ? config_set_str(MIMI_NVS_LLM, MIMI_NVS_KEY_API_URL, url)
+                    : config_erase(MIMI_NVS_LLM, MIMI_NVS_KEY_API_URL);
+    if (err != ESP_OK && err != ESP_ERR_NOT_FOUND) return err;
+    ESP_LOGI(TAG, "API URL set to: %s", s_api_url[0] ? s_api_url : provider_entry()->url);
+    return ESP_OK;
+}
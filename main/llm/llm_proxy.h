@@ -4,6 +4,7 @@
 #include "cJSON.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "mimi_config.h"
 
@@ -33,6 +34,14 @@ esp_err_t llm_set_provider(const char *provider);
  */
 esp_err_t llm_set_model(const char *model);
 
+/**
+ * Save an endpoint URL override to NVS, replacing the provider's default
+ * URL (e.g. a local mock server or self-hosted gateway). The provider still
+ * selects the request dialect. NULL or "" restores the default. Overridden
+ * endpoints are always reached directly, never through the HTTP proxy.
+ */
+esp_err_t llm_set_api_url(const char *url);
+
 /**
  * Send a chat completion request to the configured LLM API (non-streaming).
  *
@@ -50,16 +59,19 @@ esp_err_t llm_chat(const char *system_prompt, const char *messages_json,
 typedef struct {
     char id[64];        /* "toolu_xxx" */
     char name[32];      /* "web_search" */
-    char *input;        /* heap-allocated JSON string */
+    char *input;        /* JSON string, turn-scoped (turn_arena.h) */
     size_t input_len;
 } llm_tool_call_t;
 
 typedef struct {
-    char *text;                                  /* accumulated text blocks */
+    char *text;                                  /* accumulated text blocks, turn-scoped */
     size_t text_len;
     llm_tool_call_t calls[MIMI_MAX_TOOL_CALLS];
     int call_count;
     bool tool_use;                               /* stop_reason == "tool_use" */
+    int input_tokens;                            /* usage, 0 if not reported */
+    int output_tokens;
+    int64_t first_byte_us;                       /* esp_timer time of first response byte */
 } llm_response_t;
 
 void llm_response_free(llm_response_t *resp);
@@ -77,3 +89,19 @@ esp_err_t llm_chat_tools(const char *system_prompt,
                          cJSON *messages,
                          const char *tools_json,
                          llm_response_t *resp);
+
+/* ── Statistics ────────────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t requests;          /* HTTP round trips, including retries */
+    uint32_t errors;            /* transport failures and non-2xx responses */
+    uint64_t req_bytes;         /* request bodies sent */
+    uint64_t resp_bytes;        /* response bodies received */
+    char provider[16];          /* active provider and endpoint */
+    char url[192];
+} llm_stats_t;
+
+/**
+ * Cumulative request counters since boot plus the active endpoint.
+ */
+void llm_get_stats(llm_stats_t *out);
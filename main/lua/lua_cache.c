@@ -0,0 +1,313 @@
+#include "lua/lua_cache.h"
+#include "mimi_config.h"
+#include "metrics/metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "lauxlib.h"
+
+static const char *TAG = "lua_cache";
+
+#define CACHE_MAGIC      0x43424C4D  /* "MLBC" */
+#define CACHE_VERSION    ((1u << 16) | LUA_VERSION_NUM)
+#define CACHE_PATH_MAX   (256 + sizeof(MIMI_LUA_CACHE_SUFFIX))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;       /* entry format + Lua version */
+    uint32_t path_hash;
+    uint32_t src_size;
+    int64_t  src_mtime;
+    uint32_t src_hash;
+    uint32_t compile_us;
+    uint32_t code_size;
+    uint32_t reserved;
+} cache_hdr_t;
+
+typedef struct {
+    char  *buf;
+    size_t len;
+    size_t cap;
+} dump_buf_t;
+
+static lua_cache_stats_t s_stats;
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static metric_t *s_m_lookups[2];    /* [0] miss, [1] hit */
+static metric_t *s_m_saved_us;
+
+static uint32_t fnv1a32(const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool cache_path(const char *path, char *out, size_t size)
+{
+    return snprintf(out, size, "%s" MIMI_LUA_CACHE_SUFFIX, path) < (int)size;
+}
+
+static void register_metrics(void)
+{
+    if (s_m_saved_us) return;
+    s_m_lookups[0] = metrics_counter("mimi_lua_cache_lookups_total", "Bytecode cache lookups",
+                                     "result=\"miss\"");
+    s_m_lookups[1] = metrics_counter("mimi_lua_cache_lookups_total", "Bytecode cache lookups",
+                                     "result=\"hit\"");
+    s_m_saved_us = metrics_counter("mimi_lua_compile_saved_us_total",
+                                   "Compile time avoided by cache hits, net of loading", NULL);
+}
+
+static void count_lookup(const lua_cache_result_t *res, bool wrote)
+{
+    uint32_t saved = (res->hit && res->compile_us > res->load_us)
+                     ? res->compile_us - res->load_us : 0;
+    portENTER_CRITICAL(&s_stats_lock);
+    if (res->hit) s_stats.hits++; else s_stats.misses++;
+    if (wrote) s_stats.writes++;
+    s_stats.saved_us += saved;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    metric_inc(s_m_lookups[res->hit]);
+    metric_add(s_m_saved_us, saved);
+}
+
+/* Read a whole file into PSRAM; NULL when missing, unreadable or too large */
+static char *read_file(const char *path, size_t expect, size_t max)
+{
+    if (expect == 0 || expect > max) return NULL;
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    int64_t start_us = esp_timer_get_time();
+    char *buf = heap_caps_malloc(expect, MALLOC_CAP_SPIRAM);
+    size_t n = buf ? fread(buf, 1, expect, f) : 0;
+    bool extra = buf && fgetc(f) != EOF;
+    fclose(f);
+    metrics_spiffs_io(false, n, start_us);
+
+    if (!buf || n != expect || extra) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+/* ── Write ────────────────────────────────────────────────── */
+
+static int dump_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+    (void)L;
+    dump_buf_t *d = (dump_buf_t *)ud;
+    if (d->len + sz > d->cap) {
+        size_t cap = d->cap ? d->cap * 2 : 1024;
+        while (cap < d->len + sz) cap *= 2;
+        if (cap > MIMI_LUA_CACHE_MAX_BYTES) return 1;
+        char *nb = heap_caps_realloc(d->buf, cap, MALLOC_CAP_SPIRAM);
+        if (!nb) return 1;
+        d->buf = nb;
+        d->cap = cap;
+    }
+    memcpy(d->buf + d->len, p, sz);
+    d->len += sz;
+    return 0;
+}
+
+/* Dump the function on top of the stack into a cache entry for path */
+static bool store(lua_State *L, const char *path, const cache_hdr_t *key)
+{
+    dump_buf_t d = {0};
+    if (lua_dump(L, dump_writer, &d, MIMI_LUA_CACHE_STRIP) != 0 || d.len == 0) {
+        free(d.buf);
+        return false;
+    }
+
+    char cpath[CACHE_PATH_MAX];
+    FILE *f = cache_path(path, cpath, sizeof(cpath)) ? fopen(cpath, "wb") : NULL;
+    if (!f) {
+        free(d.buf);
+        return false;
+    }
+
+    cache_hdr_t hdr = *key;
+    hdr.code_size = (uint32_t)d.len;
+    int64_t start_us = esp_timer_get_time();
+    size_t n = fwrite(&hdr, 1, sizeof(hdr), f);
+    n += fwrite(d.buf, 1, d.len, f);
+    bool ok = (fclose(f) == 0) && n == sizeof(hdr) + d.len;
+    metrics_spiffs_io(true, n, start_us);
+    free(d.buf);
+
+    if (!ok) {
+        ESP_LOGW(TAG, "Failed to write %s", cpath);
+        remove(cpath);
+    }
+    return ok;
+}
+
+/* ── Load ─────────────────────────────────────────────────── */
+
+/* Push the cached chunk when the entry still matches key */
+static bool load_cached(lua_State *L, const char *path, const cache_hdr_t *key,
+                        uint32_t *compile_us)
+{
+    char cpath[CACHE_PATH_MAX];
+    if (!cache_path(path, cpath, sizeof(cpath))) return false;
+
+    struct stat st;
+    if (stat(cpath, &st) != 0 || (size_t)st.st_size <= sizeof(cache_hdr_t)) return false;
+
+    char *buf = read_file(cpath, (size_t)st.st_size, sizeof(cache_hdr_t) + MIMI_LUA_CACHE_MAX_BYTES);
+    if (!buf) return false;
+
+    cache_hdr_t hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    bool match = hdr.magic == key->magic && hdr.version == key->version &&
+                 hdr.path_hash == key->path_hash && hdr.src_size == key->src_size &&
+                 hdr.src_mtime == key->src_mtime && hdr.src_hash == key->src_hash &&
+                 sizeof(hdr) + hdr.code_size == (size_t)st.st_size;
+
+    /* Binary mode only: a chunk that fails the undump checks is stale */
+    if (match && luaL_loadbufferx(L, buf + sizeof(hdr), hdr.code_size, path, "b") == LUA_OK) {
+        *compile_us = hdr.compile_us;
+        free(buf);
+        return true;
+    }
+    if (match) lua_pop(L, 1);
+    free(buf);
+    return false;
+}
+
+int lua_cache_load(lua_State *L, const char *path, lua_cache_result_t *res)
+{
+    lua_cache_result_t local;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return luaL_loadfilex(L, path, "t");   /* pushes the usual "cannot open" */
+    }
+    if (strcmp(path, MIMI_LUA_TEMP_SCRIPT) == 0) {
+        /* Rewritten for every run: an entry would never be hit again */
+        return luaL_loadfilex(L, path, "t");
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    char *src = read_file(path, (size_t)st.st_size, MIMI_LUA_CACHE_MAX_BYTES);
+    if (!src) {
+        /* Empty or too large to cache: plain compile */
+        return luaL_loadfilex(L, path, "t");
+    }
+
+    cache_hdr_t key = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .path_hash = fnv1a32(path, strlen(path)),
+        .src_size = (uint32_t)st.st_size,
+        .src_mtime = (int64_t)st.st_mtime,
+        .src_hash = fnv1a32(src, (size_t)st.st_size),
+    };
+
+    uint32_t recorded_us = 0;
+    if (load_cached(L, path, &key, &recorded_us)) {
+        free(src);
+        res->hit = true;
+        res->compile_us = recorded_us;
+        res->load_us = (uint32_t)(esp_timer_get_time() - t0);
+        count_lookup(res, false);
+        return LUA_OK;
+    }
+
+    /* Miss: compile the source, chunk name as luaL_loadfile would set it */
+    char chunkname[CACHE_PATH_MAX];
+    snprintf(chunkname, sizeof(chunkname), "@%s", path);
+    int64_t c0 = esp_timer_get_time();
+    int rc = luaL_loadbufferx(L, src, (size_t)st.st_size, chunkname, "t");
+    res->compile_us = (uint32_t)(esp_timer_get_time() - c0);
+    free(src);
+    if (rc != LUA_OK) return rc;
+
+    key.compile_us = res->compile_us;
+    count_lookup(res, store(L, path, &key));
+    return LUA_OK;
+}
+
+/* ── require() ────────────────────────────────────────────── */
+
+/* package.searchers[2] replacement; upvalue 1 is the package table */
+static int l_cached_searcher(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_getfield(L, lua_upvalueindex(1), "searchpath");
+    lua_pushstring(L, name);
+    lua_getfield(L, lua_upvalueindex(1), "path");
+    if (lua_type(L, -1) != LUA_TSTRING) {
+        return luaL_error(L, "'package.path' must be a string");
+    }
+    lua_call(L, 2, 2);
+    if (lua_isnil(L, -2)) return 1;     /* searchpath's "no file" message */
+
+    const char *filename = lua_tostring(L, -2);
+    if (lua_cache_load(L, filename, NULL) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s",
+                          name, filename, lua_tostring(L, -1));
+    }
+    lua_pushstring(L, filename);        /* second argument to the loader */
+    return 2;
+}
+
+void lua_cache_install(lua_State *L)
+{
+    register_metrics();
+
+    lua_getglobal(L, "package");
+    if (!lua_istable(L, -1)) {
+        lua_pop(L, 1);
+        return;
+    }
+    lua_getfield(L, -1, "searchers");
+    if (lua_istable(L, -1)) {
+        lua_pushvalue(L, -2);
+        lua_pushcclosure(L, l_cached_searcher, 1);
+        lua_rawseti(L, -2, 2);
+    }
+    lua_pop(L, 2);
+}
+
+/* ── Maintenance ──────────────────────────────────────────── */
+
+void lua_cache_invalidate(const char *path)
+{
+    char cpath[CACHE_PATH_MAX];
+    if (path && cache_path(path, cpath, sizeof(cpath)) && remove(cpath) == 0) {
+        ESP_LOGD(TAG, "Dropped %s", cpath);
+    }
+}
+
+bool lua_cache_is_cache_path(const char *path)
+{
+    size_t len = path ? strlen(path) : 0;
+    size_t slen = strlen(MIMI_LUA_CACHE_SUFFIX);
+    return len >= slen && strcmp(path + len - slen, MIMI_LUA_CACHE_SUFFIX) == 0;
+}
+
+void lua_cache_get_stats(lua_cache_stats_t *out)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "lua.h"
+
+/*
+ * Bytecode cache for SPIFFS scripts.
+ *
+ * Compiling a script stores its stripped lua_dump() next to the source
+ * (blink.lua -> blink.lua.bc), behind a header recording the source size,
+ * mtime and FNV-1a hash, a hash of the path and how long the compile took.
+ * A later load reuses the chunk when all of them still match; any mismatch,
+ * a truncated file or a chunk from another Lua build falls back to
+ * compiling the source and rewrites the entry. Stripped chunks carry no
+ * line info, so errors from a cached script read "?:" where a fresh compile
+ * would name the line; the first run after a rewrite always compiles.
+ * MIMI_LUA_TEMP_SCRIPT is rewritten for every run and is never cached.
+ */
+
+typedef struct {
+    bool     hit;               /* chunk came from the cache */
+    uint32_t compile_us;        /* source compile (miss) or the recorded one (hit) */
+    uint32_t load_us;           /* cache read + undump (hit) */
+} lua_cache_result_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;            /* no entry, or one that no longer matched */
+    uint32_t writes;
+    uint64_t saved_us;          /* compile time avoided by hits, net of loading */
+} lua_cache_stats_t;
+
+/**
+ * Push the compiled chunk for the script at path, like luaL_loadfile().
+ * res may be NULL. Returns a Lua status; on error the message is pushed.
+ */
+int lua_cache_load(lua_State *L, const char *path, lua_cache_result_t *res);
+
+/** Route require() through the cache (replaces the Lua file searcher). */
+void lua_cache_install(lua_State *L);
+
+/** Drop the entry of a script that was rewritten or removed. */
+void lua_cache_invalidate(const char *path);
+
+/** True for a path the cache owns (writes to it must be refused). */
+bool lua_cache_is_cache_path(const char *path);
+
+void lua_cache_get_stats(lua_cache_stats_t *out);
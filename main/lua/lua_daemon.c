@@ -0,0 +1,920 @@
+#include "lua/lua_daemon.h"
+#include "lua/lua_runner.h"
+#include "lua/lua_cache.h"
+#include "bus/message_bus.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+#include "lua/lua_gpio_lib.h"
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#if CONFIG_MIMI_TOOL_BLE_ENABLED
+#include "lua_modulo_ble.h"
+#endif
+
+#if CONFIG_MIMI_TOOL_CAMERA_ENABLED
+#include "lua_modulo_camera.h"
+#endif
+#endif /* !CONFIG_IDF_TARGET_LINUX */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "cJSON.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+
+static const char *TAG = "lua_daemon";
+
+/* ── Types ────────────────────────────────────────────────── */
+
+typedef enum {
+    SUB_TIMER = 0,
+    SUB_GPIO,
+    SUB_BLE,
+    SUB_CAMERA,
+    SUB_KIND_COUNT,
+} sub_kind_t;
+
+static const char *s_sub_names[SUB_KIND_COUNT] = { "timer", "gpio", "ble", "camera" };
+
+typedef struct {
+    bool      used;
+    bool      stopping;         /* daemon.stop() or too many errors */
+    char      name[32];
+    char      path[128];
+    char      channel[16];
+    char      chat_id[96];
+    lua_State *L;
+    int64_t   started_us;
+    int64_t   last_notify_us;
+    uint32_t  callbacks;
+    uint32_t  errors;
+    uint32_t  notifies;
+    uint32_t  error_streak;
+    uint64_t  instructions;
+    char      last_error[96];
+} daemon_t;
+
+typedef struct {
+    bool      used;
+    uint8_t   kind;             /* sub_kind_t */
+    uint8_t   daemon;           /* index into s_daemons */
+    int16_t   pin;              /* SUB_GPIO */
+    uint8_t   edge;             /* SUB_GPIO: EDGE_* */
+    int       id;
+    int       ref;              /* callback, in the daemon state's registry */
+    uint32_t  period_ms;        /* timers and camera; 0: one-shot timer */
+    int64_t   due_us;
+    int64_t   last_us;          /* last GPIO delivery, for the debounce */
+} daemon_sub_t;
+
+enum { EDGE_RISING = 0, EDGE_FALLING, EDGE_ANY };
+
+typedef enum { CMD_START = 0, CMD_STOP, CMD_LIST } cmd_kind_t;
+
+/*
+ * A request from another task, run on the daemon task. Heap allocated: a
+ * caller that gives up waiting marks it abandoned and the task frees it.
+ */
+typedef struct {
+    cmd_kind_t        kind;
+    char              name[32];
+    char              path[128];
+    char              channel[16];
+    char              chat_id[96];
+    esp_err_t         result;
+    char              error[128];
+    int               count;
+    lua_daemon_info_t list[MIMI_LUA_DAEMON_MAX];
+    SemaphoreHandle_t done;
+    bool              abandoned;
+} daemon_cmd_t;
+
+typedef enum { EV_CMD = 0, EV_GPIO, EV_BLE } event_kind_t;
+
+typedef struct {
+    uint8_t       kind;         /* event_kind_t */
+    int8_t        level;
+    int16_t       pin;
+    int64_t       time_us;
+    daemon_cmd_t *cmd;
+} daemon_event_t;
+
+static daemon_t s_daemons[MIMI_LUA_DAEMON_MAX];
+static daemon_sub_t s_subs[MIMI_LUA_DAEMON_MAX_SUBS];
+static int s_next_id = 1;
+static QueueHandle_t s_queue = NULL;
+static portMUX_TYPE s_cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool s_ble_pending = false;
+static volatile uint32_t s_isr_dropped = 0;
+
+static metric_t *s_m_running;
+static metric_t *s_m_callbacks[SUB_KIND_COUNT];
+static metric_t *s_m_callback_ms;
+static metric_t *s_m_errors;
+static metric_t *s_m_notifies;
+static metric_t *s_m_dropped;
+
+static void register_metrics(void)
+{
+    static const char *labels[SUB_KIND_COUNT] = {
+        "source=\"timer\"", "source=\"gpio\"", "source=\"ble\"", "source=\"camera\"",
+    };
+    s_m_running = metrics_gauge("mimi_lua_daemons", "Lua daemons running", NULL);
+    for (int i = 0; i < SUB_KIND_COUNT; i++) {
+        s_m_callbacks[i] = metrics_counter("mimi_lua_daemon_callbacks_total",
+                                           "Lua daemon callbacks run", labels[i]);
+    }
+    s_m_callback_ms = metrics_histogram("mimi_lua_daemon_callback_ms", "Lua daemon callback latency",
+                                        NULL, METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+    s_m_errors = metrics_counter("mimi_lua_daemon_errors_total", "Lua daemon callbacks that failed", NULL);
+    s_m_notifies = metrics_counter("mimi_lua_daemon_notifies_total",
+                                   "Agent turns started by daemon.notify()", NULL);
+    s_m_dropped = metrics_counter("mimi_lua_daemon_events_dropped_total",
+                                  "Device events lost to a full daemon queue", NULL);
+}
+
+/* ── Helpers ──────────────────────────────────────────────── */
+
+static daemon_t *find_daemon(const char *name)
+{
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX; i++) {
+        if (s_daemons[i].used && strcmp(s_daemons[i].name, name) == 0) return &s_daemons[i];
+    }
+    return NULL;
+}
+
+static int count_subs(const daemon_t *d)
+{
+    int n = 0;
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        if (s_subs[i].used && &s_daemons[s_subs[i].daemon] == d) n++;
+    }
+    return n;
+}
+
+static int running_count(void)
+{
+    int n = 0;
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX; i++) n += s_daemons[i].used;
+    return n;
+}
+
+static daemon_t *upvalue_daemon(lua_State *L)
+{
+    return (daemon_t *)lua_touserdata(L, lua_upvalueindex(1));
+}
+
+/* Log what a callback printed, line by line, under the daemon's name */
+static void log_output(const daemon_t *d, char *out)
+{
+    for (char *line = strtok(out, "\n"); line; line = strtok(NULL, "\n")) {
+        ESP_LOGI(TAG, "[%s] %s", d->name, line);
+    }
+}
+
+static esp_err_t push_turn(const daemon_t *d, const char *text)
+{
+    size_t len = strnlen(text, MIMI_LUA_DAEMON_NOTIFY_MAX);
+    size_t size = len + strlen(d->name) + 16;
+    mimi_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    strncpy(msg.channel, d->channel, sizeof(msg.channel) - 1);
+    strncpy(msg.chat_id, d->chat_id, sizeof(msg.chat_id) - 1);
+    msg.payload.text = malloc(size);
+    if (!msg.payload.text) return ESP_ERR_NO_MEM;
+    snprintf(msg.payload.text, size, "[daemon %s] %.*s", d->name, (int)len, text);
+
+    esp_err_t err = message_bus_push_inbound(&msg);
+    if (err != ESP_OK) free(msg.payload.text);
+    return err;
+}
+
+/* ── Persistence ──────────────────────────────────────────── */
+
+static void save_daemons(void)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *arr = cJSON_AddArrayToObject(root, "daemons");
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX; i++) {
+        const daemon_t *d = &s_daemons[i];
+        if (!d->used || d->stopping) continue;
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", d->name);
+        cJSON_AddStringToObject(item, "path", d->path);
+        cJSON_AddStringToObject(item, "channel", d->channel);
+        cJSON_AddStringToObject(item, "chat_id", d->chat_id);
+        cJSON_AddItemToArray(arr, item);
+    }
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) return;
+
+    FILE *f = fopen(MIMI_LUA_DAEMON_FILE, "w");
+    if (f) {
+        fputs(json, f);
+        fclose(f);
+    } else {
+        ESP_LOGW(TAG, "Failed to write %s", MIMI_LUA_DAEMON_FILE);
+    }
+    cJSON_free(json);
+}
+
+/* ── Subscriptions ────────────────────────────────────────── */
+
+/* Register the function at fn_idx; raises when every slot is taken */
+static daemon_sub_t *add_sub(lua_State *L, sub_kind_t kind, int fn_idx, int pin, uint32_t period_ms)
+{
+    daemon_t *d = upvalue_daemon(L);
+    luaL_checktype(L, fn_idx, LUA_TFUNCTION);
+
+    daemon_sub_t *sub = NULL;
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        if (!s_subs[i].used) {
+            sub = &s_subs[i];
+            break;
+        }
+    }
+    if (!sub) {
+        luaL_error(L, "daemon: all %d callback slots in use", MIMI_LUA_DAEMON_MAX_SUBS);
+        return NULL;
+    }
+
+    lua_pushvalue(L, fn_idx);
+    memset(sub, 0, sizeof(*sub));
+    sub->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    sub->used = true;
+    sub->kind = kind;
+    sub->daemon = (uint8_t)(d - s_daemons);
+    sub->pin = (int16_t)pin;
+    sub->id = s_next_id++;
+    sub->period_ms = period_ms;
+    if (kind == SUB_TIMER || kind == SUB_CAMERA) {
+        sub->due_us = esp_timer_get_time() + (int64_t)period_ms * 1000;
+    }
+    return sub;
+}
+
+static bool pin_watched(int pin, const daemon_sub_t *except)
+{
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        const daemon_sub_t *s = &s_subs[i];
+        if (s != except && s->used && s->kind == SUB_GPIO && s->pin == pin) return true;
+    }
+    return false;
+}
+
+static void drop_sub(daemon_sub_t *sub, bool unref)
+{
+    if (sub->kind == SUB_GPIO && !pin_watched(sub->pin, sub)) {
+        lua_gpio_unwatch(sub->pin);
+    }
+    if (unref) luaL_unref(s_daemons[sub->daemon].L, LUA_REGISTRYINDEX, sub->ref);
+    sub->used = false;
+}
+
+/* ── `daemon` library ─────────────────────────────────────── */
+
+static uint32_t check_period(lua_State *L, int idx, uint32_t min_ms)
+{
+    lua_Integer ms = luaL_checkinteger(L, idx);
+    luaL_argcheck(L, ms >= (lua_Integer)min_ms, idx, "period too short");
+    return (uint32_t)ms;
+}
+
+/* daemon.every(ms, fn) -> id */
+static int l_every(lua_State *L)
+{
+    uint32_t ms = check_period(L, 1, MIMI_LUA_DAEMON_MIN_PERIOD_MS);
+    lua_pushinteger(L, add_sub(L, SUB_TIMER, 2, -1, ms)->id);
+    return 1;
+}
+
+/* daemon.after(ms, fn) -> id: a one-shot timer */
+static int l_after(lua_State *L)
+{
+    lua_Integer ms = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, ms >= 0, 1, "negative delay");
+    daemon_sub_t *sub = add_sub(L, SUB_TIMER, 2, -1, 0);
+    sub->due_us = esp_timer_get_time() + (int64_t)ms * 1000;
+    lua_pushinteger(L, sub->id);
+    return 1;
+}
+
+/* daemon.on_gpio(pin, "rising"|"falling"|"any", fn [, "up"|"down"]) -> id */
+static int l_on_gpio(lua_State *L)
+{
+    int pin = (int)luaL_checkinteger(L, 1);
+    static const char *const edges[] = { "rising", "falling", "any", NULL };
+    static const char *const pulls[] = { "none", "up", "down", NULL };
+    int edge = luaL_checkoption(L, 2, NULL, edges);
+    int pull = luaL_checkoption(L, 4, "none", pulls);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    /* The pin interrupts on both edges; the pull of its first watcher sticks */
+    if (!pin_watched(pin, NULL)) {
+        esp_err_t err = lua_gpio_watch(pin, (lua_gpio_pull_t)pull);
+        if (err != ESP_OK) {
+            return luaL_error(L, "daemon.on_gpio: pin %d: %s", pin, esp_err_to_name(err));
+        }
+    }
+    daemon_sub_t *sub = add_sub(L, SUB_GPIO, 3, pin, 0);
+    sub->edge = (uint8_t)edge;
+    lua_pushinteger(L, sub->id);
+    return 1;
+}
+
+/* daemon.on_ble(fn) -> id: fn(reading) after each new BTHome reading */
+static int l_on_ble(lua_State *L)
+{
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_BLE_ENABLED
+    lua_pushinteger(L, add_sub(L, SUB_BLE, 1, -1, 0)->id);
+    return 1;
+#else
+    return luaL_error(L, "daemon.on_ble: BLE is not available in this build");
+#endif
+}
+
+/* daemon.on_camera(ms, fn) -> id: fn(frame) every ms */
+static int l_on_camera(lua_State *L)
+{
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_CAMERA_ENABLED
+    uint32_t ms = check_period(L, 1, MIMI_LUA_DAEMON_CAMERA_MIN_MS);
+    lua_pushinteger(L, add_sub(L, SUB_CAMERA, 2, -1, ms)->id);
+    return 1;
+#else
+    return luaL_error(L, "daemon.on_camera: camera is not available in this build");
+#endif
+}
+
+/* daemon.cancel(id) -> true if it was subscribed by this daemon */
+static int l_cancel(lua_State *L)
+{
+    daemon_t *d = upvalue_daemon(L);
+    int id = (int)luaL_checkinteger(L, 1);
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        daemon_sub_t *s = &s_subs[i];
+        if (s->used && s->id == id && &s_daemons[s->daemon] == d) {
+            drop_sub(s, true);
+            lua_pushboolean(L, 1);
+            return 1;
+        }
+    }
+    lua_pushboolean(L, 0);
+    return 1;
+}
+
+/* daemon.notify(text) -> true | false, reason */
+static int l_notify(lua_State *L)
+{
+    daemon_t *d = upvalue_daemon(L);
+    const char *text = luaL_checkstring(L, 1);
+    int64_t now = esp_timer_get_time();
+    if (d->last_notify_us &&
+        now - d->last_notify_us < (int64_t)MIMI_LUA_DAEMON_NOTIFY_MIN_MS * 1000) {
+        lua_pushboolean(L, 0);
+        lua_pushliteral(L, "rate limited");
+        return 2;
+    }
+    esp_err_t err = push_turn(d, text);
+    if (err != ESP_OK) {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, esp_err_to_name(err));
+        return 2;
+    }
+    d->last_notify_us = now;
+    d->notifies++;
+    metric_inc(s_m_notifies);
+    ESP_LOGI(TAG, "[%s] notify: %.80s", d->name, text);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/* daemon.stop(): stop once the current callback returns */
+static int l_stop(lua_State *L)
+{
+    upvalue_daemon(L)->stopping = true;
+    return 0;
+}
+
+static void open_daemon_lib(lua_State *L, daemon_t *d)
+{
+    static const luaL_Reg funcs[] = {
+        {"every", l_every},
+        {"after", l_after},
+        {"on_gpio", l_on_gpio},
+        {"on_ble", l_on_ble},
+        {"on_camera", l_on_camera},
+        {"cancel", l_cancel},
+        {"notify", l_notify},
+        {"stop", l_stop},
+        {NULL, NULL},
+    };
+    luaL_newlibtable(L, funcs);
+    lua_pushlightuserdata(L, d);
+    luaL_setfuncs(L, funcs, 1);
+    lua_pushstring(L, d->name);
+    lua_setfield(L, -2, "name");
+    lua_setglobal(L, "daemon");
+}
+
+/* ── Callbacks ────────────────────────────────────────────── */
+
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_BLE_ENABLED
+/* Protected trampoline: fn(ble.latest()) */
+static int l_deliver_ble(lua_State *L)
+{
+    lua_getglobal(L, "ble");
+    lua_getfield(L, -1, "latest");
+    lua_call(L, 0, 1);
+    lua_remove(L, -2);
+    lua_call(L, 1, 0);
+    return 0;
+}
+
+static void ble_listener(void *arg)
+{
+    (void)arg;
+    if (s_ble_pending) return;      /* one pending reading is enough */
+    daemon_event_t ev = { .kind = EV_BLE, .time_us = esp_timer_get_time() };
+    s_ble_pending = true;
+    if (xQueueSend(s_queue, &ev, 0) != pdTRUE) {
+        s_ble_pending = false;
+        s_isr_dropped++;
+    }
+}
+#endif
+
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_CAMERA_ENABLED
+/* Protected trampoline: fn(frame) */
+static int l_deliver_camera(lua_State *L)
+{
+    lua_modulo_camera_push_frame(L);
+    lua_call(L, 1, 0);
+    return 0;
+}
+#endif
+
+/* Run the callback of sub with nargs arguments already pushed above it */
+static void run_callback(daemon_sub_t *sub, int nargs)
+{
+    daemon_t *d = &s_daemons[sub->daemon];
+    sub_kind_t kind = sub->kind;
+    char *out = NULL;
+    lua_run_stats_t stats;
+
+    trace_span_t span = trace_begin("lua_daemon", d->name);
+    int rc = lua_runner_state_call(d->L, nargs, MIMI_LUA_DAEMON_CALLBACK_MS, &out, &stats);
+    trace_end(&span);
+
+    d->callbacks++;
+    d->instructions += stats.instructions;
+    metric_inc(s_m_callbacks[kind]);
+    metric_observe(s_m_callback_ms, stats.duration_us / 1000);
+
+    if (rc == LUA_OK) {
+        d->error_streak = 0;
+        if (out) log_output(d, out);
+    } else {
+        d->errors++;
+        d->error_streak++;
+        metric_inc(s_m_errors);
+        const char *msg = out ? out : "error";
+        const char *last = strrchr(msg, '\n');
+        snprintf(d->last_error, sizeof(d->last_error), "%s", last && last[1] ? last + 1 : msg);
+        ESP_LOGW(TAG, "[%s] %s callback failed (%u in a row): %s", d->name,
+                 s_sub_names[kind], (unsigned)d->error_streak, d->last_error);
+        if (d->error_streak >= MIMI_LUA_DAEMON_MAX_ERRORS && !d->stopping) {
+            char text[160];
+            snprintf(text, sizeof(text), "stopped after %d failed callbacks: %s",
+                     MIMI_LUA_DAEMON_MAX_ERRORS, d->last_error);
+            push_turn(d, text);
+            d->stopping = true;
+        }
+    }
+    free(out);
+}
+
+/* Push the callback of sub (and trampoline) and run it */
+static void deliver(daemon_sub_t *sub, const daemon_event_t *ev)
+{
+    lua_State *L = s_daemons[sub->daemon].L;
+    switch (sub->kind) {
+    case SUB_GPIO:
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sub->ref);
+        lua_pushinteger(L, ev->pin);
+        lua_pushinteger(L, ev->level);
+        lua_pushinteger(L, ev->time_us / 1000);
+        run_callback(sub, 3);
+        break;
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_BLE_ENABLED
+    case SUB_BLE:
+        lua_pushcfunction(L, l_deliver_ble);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sub->ref);
+        run_callback(sub, 1);
+        break;
+#endif
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_CAMERA_ENABLED
+    case SUB_CAMERA:
+        lua_pushcfunction(L, l_deliver_camera);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sub->ref);
+        run_callback(sub, 1);
+        break;
+#endif
+    default:
+        lua_rawgeti(L, LUA_REGISTRYINDEX, sub->ref);
+        run_callback(sub, 0);
+        break;
+    }
+}
+
+/* ── Lifecycle (daemon task only) ─────────────────────────── */
+
+static void teardown(daemon_t *d, const char *why)
+{
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        if (s_subs[i].used && &s_daemons[s_subs[i].daemon] == d) {
+            drop_sub(&s_subs[i], false);    /* the state goes with its refs */
+        }
+    }
+    lua_runner_state_close(d->L);
+    ESP_LOGI(TAG, "Daemon %s stopped (%s)", d->name, why);
+    memset(d, 0, sizeof(*d));
+    metric_set(s_m_running, running_count());
+}
+
+static esp_err_t start_daemon(const char *name, const char *path,
+                              const char *channel, const char *chat_id,
+                              char *err, size_t err_size)
+{
+    if (find_daemon(name)) {
+        snprintf(err, err_size, "a daemon named '%s' is already running", name);
+        return ESP_ERR_INVALID_STATE;
+    }
+    daemon_t *d = NULL;
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX && !d; i++) {
+        if (!s_daemons[i].used) d = &s_daemons[i];
+    }
+    if (!d) {
+        snprintf(err, err_size, "all %d daemon slots in use", MIMI_LUA_DAEMON_MAX);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(d, 0, sizeof(*d));
+    d->L = lua_runner_state_new();
+    if (!d->L) {
+        snprintf(err, err_size, "out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+    d->used = true;
+    d->started_us = esp_timer_get_time();
+    strncpy(d->name, name, sizeof(d->name) - 1);
+    strncpy(d->path, path, sizeof(d->path) - 1);
+    strncpy(d->channel, channel && channel[0] ? channel : MIMI_CHAN_SYSTEM, sizeof(d->channel) - 1);
+    strncpy(d->chat_id, chat_id && chat_id[0] ? chat_id : "daemon", sizeof(d->chat_id) - 1);
+    open_daemon_lib(d->L, d);
+
+    /* The top level subscribes; it runs under the sandbox like a callback */
+    char *out = NULL;
+    int rc = lua_cache_load(d->L, path, NULL);
+    if (rc != LUA_OK) {
+        snprintf(err, err_size, "%s", lua_tostring(d->L, -1));
+        teardown(d, "load failed");
+        return ESP_FAIL;
+    }
+    rc = lua_runner_state_call(d->L, 0, MIMI_LUA_DAEMON_START_MS, &out, NULL);
+    if (rc != LUA_OK) {
+        snprintf(err, err_size, "%s", out ? out : "error");
+        free(out);
+        teardown(d, "top level failed");
+        return ESP_FAIL;
+    }
+    if (out) log_output(d, out);
+    free(out);
+
+    if (count_subs(d) == 0 || d->stopping) {
+        snprintf(err, err_size, "the script subscribed no callbacks "
+                 "(use daemon.every / after / on_gpio / on_ble / on_camera)");
+        teardown(d, "nothing to do");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    metric_set(s_m_running, running_count());
+    ESP_LOGI(TAG, "Daemon %s started from %s (%d callbacks)", d->name, d->path, count_subs(d));
+    return ESP_OK;
+}
+
+static void fill_info(const daemon_t *d, lua_daemon_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    strncpy(info->name, d->name, sizeof(info->name) - 1);
+    strncpy(info->path, d->path, sizeof(info->path) - 1);
+    strncpy(info->channel, d->channel, sizeof(info->channel) - 1);
+    strncpy(info->chat_id, d->chat_id, sizeof(info->chat_id) - 1);
+    strncpy(info->last_error, d->last_error, sizeof(info->last_error) - 1);
+    info->subscriptions = count_subs(d);
+    info->callbacks = d->callbacks;
+    info->errors = d->errors;
+    info->notifies = d->notifies;
+    info->instructions = d->instructions;
+    info->uptime_s = (uint32_t)((esp_timer_get_time() - d->started_us) / 1000000);
+}
+
+static void run_command(daemon_cmd_t *cmd)
+{
+    cmd->result = ESP_OK;
+    switch (cmd->kind) {
+    case CMD_START:
+        cmd->result = start_daemon(cmd->name, cmd->path, cmd->channel, cmd->chat_id,
+                                   cmd->error, sizeof(cmd->error));
+        if (cmd->result == ESP_OK) save_daemons();
+        break;
+    case CMD_STOP: {
+        daemon_t *d = find_daemon(cmd->name);
+        if (!d) {
+            cmd->result = ESP_ERR_NOT_FOUND;
+            break;
+        }
+        teardown(d, "stopped by request");
+        save_daemons();
+        break;
+    }
+    case CMD_LIST:
+        cmd->count = 0;
+        for (int i = 0; i < MIMI_LUA_DAEMON_MAX; i++) {
+            if (s_daemons[i].used) fill_info(&s_daemons[i], &cmd->list[cmd->count++]);
+        }
+        break;
+    }
+
+    portENTER_CRITICAL(&s_cmd_lock);
+    bool abandoned = cmd->abandoned;
+    portEXIT_CRITICAL(&s_cmd_lock);
+    if (abandoned) {
+        vSemaphoreDelete(cmd->done);
+        free(cmd);
+    } else {
+        xSemaphoreGive(cmd->done);
+    }
+}
+
+/* Restart the daemons that were running before the reboot */
+static void restore_daemons(void)
+{
+    FILE *f = fopen(MIMI_LUA_DAEMON_FILE, "r");
+    if (!f) return;
+    char buf[2048];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    cJSON *root = cJSON_Parse(buf);
+    cJSON *item;
+    int started = 0;
+    cJSON_ArrayForEach(item, cJSON_GetObjectItem(root, "daemons")) {
+        const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(item, "name"));
+        const char *path = cJSON_GetStringValue(cJSON_GetObjectItem(item, "path"));
+        if (!name || !path) continue;
+        char err[128];
+        if (start_daemon(name, path,
+                         cJSON_GetStringValue(cJSON_GetObjectItem(item, "channel")),
+                         cJSON_GetStringValue(cJSON_GetObjectItem(item, "chat_id")),
+                         err, sizeof(err)) == ESP_OK) {
+            started++;
+        } else {
+            ESP_LOGW(TAG, "Daemon %s not restored: %s", name, err);
+        }
+    }
+    cJSON_Delete(root);
+    save_daemons();     /* forget the ones that no longer start */
+    ESP_LOGI(TAG, "Restored %d daemons", started);
+}
+
+/* ── Scheduler ────────────────────────────────────────────── */
+
+static void handle_event(const daemon_event_t *ev)
+{
+    if (ev->kind == EV_CMD) {
+        run_command(ev->cmd);
+        return;
+    }
+    if (ev->kind == EV_BLE) s_ble_pending = false;
+
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        daemon_sub_t *sub = &s_subs[i];
+        if (!sub->used || s_daemons[sub->daemon].stopping) continue;
+        if (ev->kind == EV_GPIO) {
+            if (sub->kind != SUB_GPIO || sub->pin != ev->pin) continue;
+            if ((sub->edge == EDGE_RISING && !ev->level) ||
+                (sub->edge == EDGE_FALLING && ev->level)) {
+                continue;
+            }
+            if (sub->last_us && ev->time_us - sub->last_us < MIMI_LUA_DAEMON_DEBOUNCE_MS * 1000) {
+                continue;
+            }
+            sub->last_us = ev->time_us;
+        } else if (sub->kind != SUB_BLE) {
+            continue;
+        }
+        deliver(sub, ev);
+    }
+}
+
+static void run_due(void)
+{
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        daemon_sub_t *sub = &s_subs[i];
+        if (!sub->used || (sub->kind != SUB_TIMER && sub->kind != SUB_CAMERA)) continue;
+        int64_t now = esp_timer_get_time();
+        if (sub->due_us > now || s_daemons[sub->daemon].stopping) continue;
+
+        int id = sub->id;
+        if (sub->period_ms) {
+            /* Skip missed periods rather than firing a burst */
+            sub->due_us += (int64_t)sub->period_ms * 1000;
+            if (sub->due_us <= now) sub->due_us = now + (int64_t)sub->period_ms * 1000;
+        }
+        daemon_event_t ev = { .time_us = now };
+        deliver(sub, &ev);
+        if (!sub->period_ms && sub->used && sub->id == id) drop_sub(sub, true);
+    }
+}
+
+static void reap_stopped(void)
+{
+    bool changed = false;
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX; i++) {
+        daemon_t *d = &s_daemons[i];
+        if (!d->used) continue;
+        if (d->stopping || count_subs(d) == 0) {
+            teardown(d, d->error_streak >= MIMI_LUA_DAEMON_MAX_ERRORS ? "too many errors"
+                        : d->stopping ? "daemon.stop()" : "no callbacks left");
+            changed = true;
+        }
+    }
+    if (changed) save_daemons();
+}
+
+static TickType_t ticks_to_next_due(void)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < MIMI_LUA_DAEMON_MAX_SUBS; i++) {
+        const daemon_sub_t *s = &s_subs[i];
+        if (s->used && (s->kind == SUB_TIMER || s->kind == SUB_CAMERA) && s->due_us < next) {
+            next = s->due_us;
+        }
+    }
+    if (next == INT64_MAX) return portMAX_DELAY;
+    int64_t wait_us = next - esp_timer_get_time();
+    if (wait_us <= 0) return 0;
+    /* Round up so the wakeup is not a tick early */
+    return pdMS_TO_TICKS((wait_us + 999) / 1000) + 1;
+}
+
+static void daemon_task(void *arg)
+{
+    (void)arg;
+    restore_daemons();
+
+    while (1) {
+        daemon_event_t ev;
+        if (xQueueReceive(s_queue, &ev, ticks_to_next_due()) == pdTRUE) {
+            handle_event(&ev);
+        }
+        run_due();
+        reap_stopped();
+
+        uint32_t dropped = s_isr_dropped;
+        if (dropped) {
+            s_isr_dropped = 0;
+            metric_add(s_m_dropped, dropped);
+        }
+    }
+}
+
+/* ── Public API ───────────────────────────────────────────── */
+
+esp_err_t lua_daemon_init(void)
+{
+    if (s_queue) return ESP_OK;
+    register_metrics();
+    s_queue = xQueueCreate(MIMI_LUA_DAEMON_QUEUE_LEN, sizeof(daemon_event_t));
+    if (!s_queue) return ESP_ERR_NO_MEM;
+
+#if !CONFIG_IDF_TARGET_LINUX && CONFIG_MIMI_TOOL_BLE_ENABLED
+    lua_modulo_ble_set_listener(ble_listener, NULL);
+#endif
+
+    if (xTaskCreatePinnedToCore(daemon_task, "lua_daemon", MIMI_LUA_DAEMON_STACK, NULL,
+                                MIMI_LUA_DAEMON_PRIO, NULL, tskNO_AFFINITY) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create daemon task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Hand cmd to the daemon task and wait; false when it did not answer in time */
+static bool send_command(daemon_cmd_t *cmd)
+{
+    cmd->done = xSemaphoreCreateBinary();
+    if (!cmd->done) return false;
+    daemon_event_t ev = { .kind = EV_CMD, .cmd = cmd };
+    if (xQueueSend(s_queue, &ev, pdMS_TO_TICKS(MIMI_LUA_DAEMON_CMD_WAIT_MS)) != pdTRUE) {
+        vSemaphoreDelete(cmd->done);
+        return false;
+    }
+    if (xSemaphoreTake(cmd->done, pdMS_TO_TICKS(MIMI_LUA_DAEMON_CMD_WAIT_MS)) == pdTRUE) {
+        vSemaphoreDelete(cmd->done);
+        return true;
+    }
+
+    /* Still running (or about to give): the task frees it once abandoned */
+    portENTER_CRITICAL(&s_cmd_lock);
+    cmd->abandoned = true;
+    portEXIT_CRITICAL(&s_cmd_lock);
+    if (xSemaphoreTake(cmd->done, 0) == pdTRUE) {
+        vSemaphoreDelete(cmd->done);
+        return true;
+    }
+    return false;
+}
+
+esp_err_t lua_daemon_start(const char *name, const char *path,
+                           const char *channel, const char *chat_id,
+                           char *err, size_t err_size)
+{
+    if (!s_queue) return ESP_ERR_INVALID_STATE;
+    if (!name || !name[0] || !path || strlen(name) >= 32 || strlen(path) >= 128) {
+        snprintf(err, err_size, "name (1-31 chars) and path (< 128 chars) required");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    daemon_cmd_t *cmd = calloc(1, sizeof(daemon_cmd_t));
+    if (!cmd) return ESP_ERR_NO_MEM;
+    cmd->kind = CMD_START;
+    strncpy(cmd->name, name, sizeof(cmd->name) - 1);
+    strncpy(cmd->path, path, sizeof(cmd->path) - 1);
+    if (channel) strncpy(cmd->channel, channel, sizeof(cmd->channel) - 1);
+    if (chat_id) strncpy(cmd->chat_id, chat_id, sizeof(cmd->chat_id) - 1);
+
+    if (!send_command(cmd)) {
+        snprintf(err, err_size, "daemon task did not answer");
+        return ESP_ERR_TIMEOUT;     /* cmd is the task's to free now */
+    }
+    esp_err_t ret = cmd->result;
+    snprintf(err, err_size, "%s", cmd->error);
+    free(cmd);
+    return ret;
+}
+
+esp_err_t lua_daemon_stop(const char *name)
+{
+    if (!s_queue) return ESP_ERR_INVALID_STATE;
+    if (!name) return ESP_ERR_INVALID_ARG;
+    daemon_cmd_t *cmd = calloc(1, sizeof(daemon_cmd_t));
+    if (!cmd) return ESP_ERR_NO_MEM;
+    cmd->kind = CMD_STOP;
+    strncpy(cmd->name, name, sizeof(cmd->name) - 1);
+    if (!send_command(cmd)) return ESP_ERR_TIMEOUT;
+    esp_err_t ret = cmd->result;
+    free(cmd);
+    return ret;
+}
+
+int lua_daemon_list(lua_daemon_info_t *out, int max)
+{
+    if (!s_queue) return 0;
+    daemon_cmd_t *cmd = calloc(1, sizeof(daemon_cmd_t));
+    if (!cmd) return 0;
+    cmd->kind = CMD_LIST;
+    if (!send_command(cmd)) return 0;
+    int n = cmd->count < max ? cmd->count : max;
+    memcpy(out, cmd->list, n * sizeof(lua_daemon_info_t));
+    free(cmd);
+    return n;
+}
+
+void lua_daemon_post_gpio_isr(int pin, int level)
+{
+    if (!s_queue) return;
+    daemon_event_t ev = {
+        .kind = EV_GPIO,
+        .pin = (int16_t)pin,
+        .level = (int8_t)level,
+        .time_us = esp_timer_get_time(),
+    };
+    BaseType_t woken = pdFALSE;
+    if (xQueueSendFromISR(s_queue, &ev, &woken) != pdTRUE) {
+        s_isr_dropped++;
+    }
+    portYIELD_FROM_ISR(woken);
+}
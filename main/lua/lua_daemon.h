@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mimi_config.h"
+
+/*
+ * Lua daemons: long-lived scripts from /spiffs/scripts/ that react to
+ * events locally instead of through agent turns.
+ *
+ * All daemons run on one "lua_daemon" task, each in its own sandboxed
+ * lua_State (lua_runner_state_new). A daemon script's top level subscribes
+ * callbacks through the `daemon` library (timers, GPIO edges, BTHome
+ * readings, camera frames) and returns; the task then sleeps until the next
+ * timer or device event and runs the matching callbacks one at a time,
+ * each limited to MIMI_LUA_DAEMON_CALLBACK_MS. daemon.notify() pushes an
+ * inbound message that starts an agent turn, at most once per
+ * MIMI_LUA_DAEMON_NOTIFY_MIN_MS per daemon. A daemon whose callbacks fail
+ * MIMI_LUA_DAEMON_MAX_ERRORS times in a row is stopped and reported.
+ *
+ * Running daemons are saved to MIMI_LUA_DAEMON_FILE and restarted at boot.
+ */
+
+typedef struct {
+    char     name[32];
+    char     path[128];
+    char     channel[16];
+    char     chat_id[96];
+    int      subscriptions;
+    uint32_t callbacks;
+    uint32_t errors;
+    uint32_t notifies;
+    uint64_t instructions;      /* across all callbacks */
+    uint32_t uptime_s;
+    char     last_error[96];
+} lua_daemon_info_t;
+
+/** Start the daemon task; it restarts the daemons saved in MIMI_LUA_DAEMON_FILE. */
+esp_err_t lua_daemon_init(void);
+
+/**
+ * Load the script at path and run its top level as daemon `name`.
+ * channel / chat_id (NULL: "system" / "daemon") receive its notify() turns.
+ * On failure err gets the reason (script error, no callbacks subscribed).
+ */
+esp_err_t lua_daemon_start(const char *name, const char *path,
+                           const char *channel, const char *chat_id,
+                           char *err, size_t err_size);
+
+/** Stop a daemon by name. ESP_ERR_NOT_FOUND when none runs under it. */
+esp_err_t lua_daemon_stop(const char *name);
+
+/** Fill up to max entries (MIMI_LUA_DAEMON_MAX suffices); returns the count. */
+int lua_daemon_list(lua_daemon_info_t *out, int max);
+
+/** GPIO edge from lua_gpio_lib's ISR. */
+void lua_daemon_post_gpio_isr(int pin, int level);
@@ -1,17 +1,33 @@
 #include "lua/lua_gpio_lib.h"
+#include "lua/lua_runner.h"
+#include "lua/lua_daemon.h"
+#include "lua/lua_cache.h"
+#include "mimi_config.h"
+#include "sdkconfig.h"
 
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if CONFIG_IDF_TARGET_LINUX
+#include "host/host_gpio.h"
+#else
 #include "driver/gpio.h"
 #include "driver/ledc.h"
+#endif
+#if CONFIG_IDF_TARGET_ESP32S3
+#include "soc/gpio_struct.h"
+#endif
+
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "cJSON.h"
 
 #include "lua.h"
 #include "lauxlib.h"
@@ -26,8 +42,23 @@ typedef enum {
     PIN_FREE = 0,
     PIN_GPIO,
     PIN_PWM,
+    PIN_WATCH,          /* input with an edge interrupt for lua_daemon */
+    PIN_EDGE,           /* input with an edge interrupt for gpio.wait_edge() */
 } pin_usage_t;
 
+/* Configuration last applied to a PIN_GPIO pin; reads and writes that
+ * find the right mode here skip gpio_config() */
+typedef enum {
+    MODE_NONE = 0,
+    MODE_IN,
+    MODE_IN_UP,
+    MODE_IN_DOWN,
+    MODE_OUT,           /* push-pull, input kept on so gpio.read() sees the level */
+    MODE_OD,            /* open drain with pull-up, likewise readable */
+} pin_mode_t;
+
+static const char *const s_mode_names[] = { "off", "in", "in_up", "in_down", "out", "od", NULL };
+
 typedef struct {
     int pin;
     ledc_channel_t channel;
@@ -35,11 +66,23 @@ typedef struct {
     bool active;
 } pwm_entry_t;
 
+typedef struct {
+    uint8_t pin;
+    uint8_t level;
+    int64_t time_us;
+} edge_event_t;
+
 static pin_usage_t s_pin_usage[GPIO_PIN_MAX];
+static pin_mode_t s_pin_mode[GPIO_PIN_MAX];
 static SemaphoreHandle_t s_mutex = NULL;
 
 static pwm_entry_t s_pwm[MAX_PWM_CHANNELS];
 static int s_pwm_count = 0;
+static bool s_isr_service = false;
+
+static QueueHandle_t s_edges = NULL;
+static void *s_edge_owner[GPIO_PIN_MAX];   /* allocator ud of the watching state */
+static lua_gpio_stats_t s_stats;
 
 static bool pin_valid(int pin)
 {
@@ -64,75 +107,476 @@ static void pin_release(int pin)
 {
     if (pin_valid(pin)) {
         s_pin_usage[pin] = PIN_FREE;
+        s_pin_mode[pin] = MODE_NONE;
+    }
+}
+
+static bool pin_is_output(int pin)
+{
+    return s_pin_mode[pin] == MODE_OUT || s_pin_mode[pin] == MODE_OD;
+}
+
+static esp_err_t pin_configure(int pin, pin_mode_t mode, gpio_int_type_t intr)
+{
+    static const gpio_mode_t modes[] = {
+        [MODE_IN] = GPIO_MODE_INPUT,
+        [MODE_IN_UP] = GPIO_MODE_INPUT,
+        [MODE_IN_DOWN] = GPIO_MODE_INPUT,
+        [MODE_OUT] = GPIO_MODE_INPUT_OUTPUT,
+        [MODE_OD] = GPIO_MODE_INPUT_OUTPUT_OD,
+    };
+    gpio_config_t cfg = {
+        .pin_bit_mask = (1ULL << pin),
+        .mode = modes[mode],
+        .pull_up_en = (mode == MODE_IN_UP || mode == MODE_OD) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = mode == MODE_IN_DOWN ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE,
+        .intr_type = intr,
+    };
+    esp_err_t err = gpio_config(&cfg);
+    if (err == ESP_OK) {
+        s_pin_mode[pin] = mode;
+        s_stats.configs++;
+    }
+    return err;
+}
+
+/* Claim pin for gpio and configure it, unless it already is in that mode */
+static void pin_set_mode(lua_State *L, int pin, pin_mode_t mode, const char *who)
+{
+    if (s_pin_mode[pin] == mode && s_pin_usage[pin] == PIN_GPIO) {
+        return;
+    }
+    if (!pin_claim(pin, PIN_GPIO)) {
+        luaL_error(L, "%s: pin %d is already in use", who, pin);
+    }
+    esp_err_t err = pin_configure(pin, mode, GPIO_INTR_DISABLE);
+    if (err != ESP_OK) {
+        luaL_error(L, "%s: gpio_config failed: %s", who, esp_err_to_name(err));
     }
 }
 
+static int check_pin(lua_State *L, int arg, const char *who)
+{
+    lua_Integer pin = luaL_checkinteger(L, arg);
+    if (!pin_valid((int)pin)) {
+        luaL_error(L, "%s: invalid pin %d", who, (int)pin);
+    }
+    return (int)pin;
+}
+
+/* ── Port access ──────────────────────────────────────────── */
+
+/* Drive the pins in set high and those in clear low; on the S3 one
+ * register write per 32-pin bank, so a bank's pins change together */
+static void port_write(uint64_t set, uint64_t clear)
+{
+#if CONFIG_IDF_TARGET_ESP32S3
+    if ((uint32_t)clear) GPIO.out_w1tc = (uint32_t)clear;
+    if ((uint32_t)set) GPIO.out_w1ts = (uint32_t)set;
+    if (clear >> 32) GPIO.out1_w1tc.data = (uint32_t)(clear >> 32);
+    if (set >> 32) GPIO.out1_w1ts.data = (uint32_t)(set >> 32);
+#else
+    for (int pin = 0; pin < GPIO_PIN_MAX; pin++) {
+        uint64_t bit = 1ULL << pin;
+        if (set & bit) {
+            gpio_set_level((gpio_num_t)pin, 1);
+        } else if (clear & bit) {
+            gpio_set_level((gpio_num_t)pin, 0);
+        }
+    }
+#endif
+}
+
+/* Input levels of the pins in mask */
+static uint64_t port_read(uint64_t mask)
+{
+#if CONFIG_IDF_TARGET_ESP32S3
+    return (GPIO.in | ((uint64_t)GPIO.in1.data << 32)) & mask;
+#else
+    uint64_t levels = 0;
+    for (int pin = 0; pin < GPIO_PIN_MAX; pin++) {
+        if ((mask & (1ULL << pin)) && gpio_get_level((gpio_num_t)pin)) {
+            levels |= 1ULL << pin;
+        }
+    }
+    return levels;
+#endif
+}
+
 /* ── gpio module ──────────────────────────────────────────── */
 
+/* gpio.mode(pin [, "in"|"in_up"|"in_down"|"out"|"od"|"off"]) -> previous mode or nil */
+static int l_gpio_mode(lua_State *L)
+{
+    int pin = check_pin(L, 1, "gpio.mode");
+    pin_mode_t prev = s_pin_mode[pin];
+    if (prev == MODE_NONE) {
+        lua_pushnil(L);
+    } else {
+        lua_pushstring(L, s_mode_names[prev]);
+    }
+    if (lua_isnoneornil(L, 2)) {
+        return 1;
+    }
+
+    pin_mode_t mode = (pin_mode_t)luaL_checkoption(L, 2, NULL, s_mode_names);
+    if (mode != MODE_NONE) {
+        pin_set_mode(L, pin, mode, "gpio.mode");
+    } else if (s_pin_usage[pin] == PIN_GPIO) {
+        gpio_reset_pin((gpio_num_t)pin);
+        pin_release(pin);
+    }
+    return 1;
+}
+
 static int l_gpio_write(lua_State *L)
 {
-    int pin = (int)luaL_checkinteger(L, 1);
+    int pin = check_pin(L, 1, "gpio.write");
     int val = (int)luaL_checkinteger(L, 2);
 
-    if (!pin_valid(pin)) {
-        return luaL_error(L, "gpio.write: invalid pin %d", pin);
+    /* Fast path: configured as an output by an earlier call */
+    if (!pin_is_output(pin)) {
+        pin_set_mode(L, pin, MODE_OUT, "gpio.write");
     }
-    if (!pin_claim(pin, PIN_GPIO)) {
-        return luaL_error(L, "gpio.write: pin %d is already in use", pin);
+    gpio_set_level((gpio_num_t)pin, val ? 1 : 0);
+    return 0;
+}
+
+static int l_gpio_read(lua_State *L)
+{
+    int pin = check_pin(L, 1, "gpio.read");
+
+    /* Any configured mode reads, including daemon and edge inputs */
+    if (s_pin_mode[pin] == MODE_NONE) {
+        pin_set_mode(L, pin, MODE_IN, "gpio.read");
     }
+    lua_pushinteger(L, gpio_get_level((gpio_num_t)pin) ? 1 : 0);
+    return 1;
+}
 
-    gpio_config_t cfg = {
-        .pin_bit_mask = (1ULL << pin),
-        .mode = GPIO_MODE_OUTPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
-    };
+/* Pins in mask as outputs, configuring those that are not yet */
+static void outputs_for(lua_State *L, uint64_t mask, const char *who)
+{
+    for (int pin = 0; pin < GPIO_PIN_MAX; pin++) {
+        if ((mask & (1ULL << pin)) && !pin_is_output(pin)) {
+            pin_set_mode(L, pin, MODE_OUT, who);
+        }
+    }
+}
 
-    esp_err_t err = gpio_config(&cfg);
-    if (err != ESP_OK) {
-        return luaL_error(L, "gpio.write: gpio_config failed: %s", esp_err_to_name(err));
+static uint64_t check_mask(lua_State *L, int arg, const char *who)
+{
+    uint64_t mask = (uint64_t)luaL_checkinteger(L, arg);
+    if (mask >> GPIO_PIN_MAX) {
+        luaL_error(L, "%s: mask has bits past pin %d", who, GPIO_PIN_MAX - 1);
     }
+    return mask;
+}
 
-    err = gpio_set_level((gpio_num_t)pin, val ? 1 : 0);
-    if (err != ESP_OK) {
-        return luaL_error(L, "gpio.write: gpio_set_level failed: %s", esp_err_to_name(err));
+/* gpio.write_many({[pin] = level, ...}): every pin set in one port write */
+static int l_gpio_write_many(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    uint64_t set = 0, clear = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        lua_Integer pin = lua_isinteger(L, -2) ? lua_tointeger(L, -2) : -1;
+        if (!pin_valid((int)pin)) {
+            return luaL_error(L, "gpio.write_many: invalid pin %s", luaL_tolstring(L, -2, NULL));
+        }
+        bool high = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : luaL_checkinteger(L, -1) != 0;
+        if (high) {
+            set |= 1ULL << pin;
+        } else {
+            clear |= 1ULL << pin;
+        }
+        lua_pop(L, 1);
     }
+    outputs_for(L, set | clear, "gpio.write_many");
+    port_write(set, clear);
+    return 0;
+}
 
+/* gpio.write_mask(mask, levels): pins in mask take their bit of levels */
+static int l_gpio_write_mask(lua_State *L)
+{
+    uint64_t mask = check_mask(L, 1, "gpio.write_mask");
+    uint64_t levels = (uint64_t)luaL_checkinteger(L, 2);
+    outputs_for(L, mask, "gpio.write_mask");
+    port_write(levels & mask, ~levels & mask);
     return 0;
 }
 
-static int l_gpio_read(lua_State *L)
+/* gpio.read_mask(mask) -> levels of the pins in mask as bits */
+static int l_gpio_read_mask(lua_State *L)
 {
-    int pin = (int)luaL_checkinteger(L, 1);
+    uint64_t mask = check_mask(L, 1, "gpio.read_mask");
+    for (int pin = 0; pin < GPIO_PIN_MAX; pin++) {
+        if ((mask & (1ULL << pin)) && s_pin_mode[pin] == MODE_NONE) {
+            pin_set_mode(L, pin, MODE_IN, "gpio.read_mask");
+        }
+    }
+    lua_pushinteger(L, (lua_Integer)port_read(mask));
+    return 1;
+}
 
-    if (!pin_valid(pin)) {
-        return luaL_error(L, "gpio.read: invalid pin %d", pin);
+/*
+ * gpio.pulse_train(pin, {us, us, ...} [, start]): hold start (default 1)
+ * for the first duration, the other level for the next and so on, then
+ * leave the pin at the other level. Timed against absolute deadlines in C,
+ * so the train does not drift; interrupts still add jitter.
+ */
+static int l_gpio_pulse_train(lua_State *L)
+{
+    int pin = check_pin(L, 1, "gpio.pulse_train");
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int start = (int)luaL_optinteger(L, 3, 1) ? 1 : 0;
+
+    lua_Integer n = (lua_Integer)lua_rawlen(L, 2);
+    if (n < 1 || n > MIMI_LUA_GPIO_PULSE_MAX) {
+        return luaL_error(L, "gpio.pulse_train: 1..%d durations", MIMI_LUA_GPIO_PULSE_MAX);
     }
-    if (!pin_claim(pin, PIN_GPIO)) {
-        return luaL_error(L, "gpio.read: pin %d is already in use", pin);
+    uint32_t *us = lua_newuserdatauv(L, (size_t)n * sizeof(uint32_t), 0);
+    uint64_t total = 0;
+    for (lua_Integer i = 0; i < n; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        lua_Integer d = luaL_checkinteger(L, -1);
+        lua_pop(L, 1);
+        if (d < 1) {
+            return luaL_error(L, "gpio.pulse_train: duration %d is not positive", (int)(i + 1));
+        }
+        us[i] = (uint32_t)d;
+        total += (uint64_t)d;
+    }
+    /* Busy-waits below the instruction hook: bound it */
+    if (total > MIMI_LUA_GPIO_PULSE_MAX_US) {
+        return luaL_error(L, "gpio.pulse_train: %d us exceeds %d us", (int)total,
+                          MIMI_LUA_GPIO_PULSE_MAX_US);
+    }
+    if (!pin_is_output(pin)) {
+        pin_set_mode(L, pin, MODE_OUT, "gpio.pulse_train");
     }
 
-    gpio_config_t cfg = {
-        .pin_bit_mask = (1ULL << pin),
-        .mode = GPIO_MODE_INPUT,
-        .pull_up_en = GPIO_PULLUP_DISABLE,
-        .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
+    uint64_t bit = 1ULL << pin;
+    int level = start;
+    int64_t t = esp_timer_get_time();
+    for (lua_Integer i = 0; i < n; i++) {
+        port_write(level ? bit : 0, level ? 0 : bit);
+        t += us[i];
+        while (esp_timer_get_time() < t) {
+        }
+        level ^= 1;
+    }
+    port_write(start ? 0 : bit, start ? bit : 0);
+    return 0;
+}
+
+/* ── Edge subscriptions (gpio.watch / gpio.wait_edge) ─────── */
+
+static void edge_isr(void *arg)
+{
+    int pin = (int)(intptr_t)arg;
+    edge_event_t ev = {
+        .pin = (uint8_t)pin,
+        .level = (uint8_t)(gpio_get_level((gpio_num_t)pin) ? 1 : 0),
+        .time_us = esp_timer_get_time(),
     };
+    BaseType_t woken = pdFALSE;
+    if (xQueueSendFromISR(s_edges, &ev, &woken) == pdTRUE) {
+        s_stats.edges++;
+    } else {
+        s_stats.edges_dropped++;
+    }
+    portYIELD_FROM_ISR(woken);
+}
 
-    esp_err_t err = gpio_config(&cfg);
+static esp_err_t isr_service(void)
+{
+    if (s_isr_service) return ESP_OK;
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err == ESP_ERR_INVALID_STATE) err = ESP_OK;     /* installed elsewhere */
+    s_isr_service = err == ESP_OK;
+    return err;
+}
+
+/* Call with s_mutex held */
+static void edge_unwatch(int pin)
+{
+    gpio_isr_handler_remove((gpio_num_t)pin);
+    gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_DISABLE);
+    pin_release(pin);
+    s_edge_owner[pin] = NULL;
+
+    /* Queued edges belong to the run that watched; drop them with the last pin */
+    for (int i = 0; i < GPIO_PIN_MAX; i++) {
+        if (s_pin_usage[i] == PIN_EDGE) return;
+    }
+    xQueueReset(s_edges);
+}
+
+/*
+ * lua_runner_defer: watches end with the run that started them. Only the
+ * owner registers this and the owner's unwatch untracks it, so when it
+ * runs the pin is still the owner's.
+ */
+static void edge_release_cb(void *arg)
+{
+    int pin = (int)(intptr_t)arg;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_pin_usage[pin] == PIN_EDGE) {
+        edge_unwatch(pin);
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+typedef enum { EDGE_CLAIMED, EDGE_OWNED, EDGE_OTHER, EDGE_BUSY } edge_claim_t;
+
+/* Claim pin for owner's watch; states run side by side, so under s_mutex */
+static edge_claim_t edge_claim(int pin, void *owner)
+{
+    edge_claim_t r;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_pin_usage[pin] == PIN_EDGE) {
+        r = s_edge_owner[pin] == owner ? EDGE_OWNED : EDGE_OTHER;
+    } else if (pin_claim(pin, PIN_EDGE)) {
+        s_edge_owner[pin] = owner;
+        r = EDGE_CLAIMED;
+    } else {
+        r = EDGE_BUSY;
+    }
+    xSemaphoreGive(s_mutex);
+    return r;
+}
+
+/* gpio.watch(pin [, "up"|"down"]): queue the pin's edges until the script ends */
+static int l_gpio_watch(lua_State *L)
+{
+    int pin = check_pin(L, 1, "gpio.watch");
+    static const char *const pulls[] = { "none", "up", "down", NULL };
+    int pull = luaL_checkoption(L, 2, "none", pulls);
+    void *owner;
+    lua_getallocf(L, &owner);
+    if (!s_edges) {
+        return luaL_error(L, "gpio.watch: no edge queue");
+    }
+    switch (edge_claim(pin, owner)) {
+    case EDGE_OWNED:
+        return 0;
+    case EDGE_OTHER:
+        return luaL_error(L, "gpio.watch: pin %d is watched by another script", pin);
+    case EDGE_BUSY:
+        return luaL_error(L, "gpio.watch: pin %d is already in use", pin);
+    case EDGE_CLAIMED:
+        break;
+    }
+    if (!lua_runner_defer(L, edge_release_cb, (void *)(intptr_t)pin)) {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        s_edge_owner[pin] = NULL;
+        pin_release(pin);
+        xSemaphoreGive(s_mutex);
+        return luaL_error(L, "gpio.watch: too many resources held by this script");
+    }
+
+    static const pin_mode_t modes[] = { MODE_IN, MODE_IN_UP, MODE_IN_DOWN };
+    esp_err_t err = pin_configure(pin, modes[pull], GPIO_INTR_ANYEDGE);
+    if (err == ESP_OK) err = isr_service();
+    if (err == ESP_OK) err = gpio_isr_handler_add((gpio_num_t)pin, edge_isr, (void *)(intptr_t)pin);
     if (err != ESP_OK) {
-        return luaL_error(L, "gpio.read: gpio_config failed: %s", esp_err_to_name(err));
+        lua_runner_untrack(L, edge_release_cb, (void *)(intptr_t)pin);
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        edge_unwatch(pin);
+        xSemaphoreGive(s_mutex);
+        return luaL_error(L, "gpio.watch: pin %d: %s", pin, esp_err_to_name(err));
     }
+    return 0;
+}
 
-    lua_pushinteger(L, gpio_get_level((gpio_num_t)pin) ? 1 : 0);
-    return 1;
+static int l_gpio_unwatch(lua_State *L)
+{
+    int pin = check_pin(L, 1, "gpio.unwatch");
+    void *owner;
+    lua_getallocf(L, &owner);
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool other = s_pin_usage[pin] == PIN_EDGE && s_edge_owner[pin] != owner;
+    if (s_pin_usage[pin] == PIN_EDGE && !other) {
+        lua_runner_untrack(L, edge_release_cb, (void *)(intptr_t)pin);
+        edge_unwatch(pin);
+    }
+    xSemaphoreGive(s_mutex);
+    if (other) {
+        return luaL_error(L, "gpio.unwatch: pin %d is watched by another script", pin);
+    }
+    return 0;
+}
+
+/*
+ * Next queued edge of a pin the calling state watches. Scripts run side by
+ * side (pool workers, lua_sched), so edges of other states' pins go back
+ * to the queue for their owners; those of pins no longer watched are dropped.
+ */
+static bool take_edge(lua_State *L, edge_event_t *ev)
+{
+    void *owner;
+    lua_getallocf(L, &owner);
+    for (UBaseType_t n = uxQueueMessagesWaiting(s_edges); n > 0; n--) {
+        if (xQueueReceive(s_edges, ev, 0) != pdTRUE) break;
+        if (s_edge_owner[ev->pin] == owner) return true;
+        if (s_edge_owner[ev->pin]) xQueueSend(s_edges, ev, 0);
+    }
+    return false;
+}
+
+/* Stack: 1 timeout_ms, 2 deadline in esp_timer microseconds */
+static int wait_edge_k(lua_State *L, int status, lua_KContext kctx)
+{
+    (void)status;
+    (void)kctx;
+    int64_t until = (int64_t)lua_tointeger(L, 2);
+    edge_event_t ev;
+
+    for (;;) {
+        if (take_edge(L, &ev)) {
+            lua_pushinteger(L, ev.pin);
+            lua_pushinteger(L, ev.level);
+            lua_pushinteger(L, (lua_Integer)ev.time_us);
+            return 3;
+        }
+        int64_t left_ms = (until - esp_timer_get_time()) / 1000;
+        if (left_ms <= 0) {
+            lua_pushnil(L);
+            return 1;
+        }
+        uint32_t ms = left_ms < MIMI_LUA_GPIO_EDGE_POLL_MS ? (uint32_t)left_ms : MIMI_LUA_GPIO_EDGE_POLL_MS;
+        if (lua_runner_can_pause(L)) {
+            return lua_runner_pause(L, ms, 0, wait_edge_k);     /* lua_sched runs others meanwhile */
+        }
+        lua_runner_sleep(L, ms);    /* raises once the run is past its deadline */
+    }
+}
+
+/* gpio.wait_edge([timeout_ms]) -> pin, level, time_us, or nil on timeout */
+static int l_gpio_wait_edge(lua_State *L)
+{
+    lua_Integer timeout_ms = luaL_optinteger(L, 1, 0);
+    if (!s_edges) {
+        return luaL_error(L, "gpio.wait_edge: no edge queue");
+    }
+    lua_settop(L, 1);
+    lua_pushinteger(L, (lua_Integer)(esp_timer_get_time() + (int64_t)timeout_ms * 1000));
+    return wait_edge_k(L, LUA_OK, 0);
 }
 
 static const luaL_Reg gpio_lib[] = {
     {"write", l_gpio_write},
     {"read", l_gpio_read},
+    {"mode", l_gpio_mode},
+    {"write_many", l_gpio_write_many},
+    {"write_mask", l_gpio_write_mask},
+    {"read_mask", l_gpio_read_mask},
+    {"pulse_train", l_gpio_pulse_train},
+    {"watch", l_gpio_watch},
+    {"unwatch", l_gpio_unwatch},
+    {"wait_edge", l_gpio_wait_edge},
     {NULL, NULL},
 };
 
@@ -148,6 +592,34 @@ static int pwm_find(int pin)
     return -1;
 }
 
+/* First stopped slot, else a new one; -1 when all channels run */
+static int pwm_alloc(void)
+{
+    for (int i = 0; i < s_pwm_count; i++) {
+        if (!s_pwm[i].active) {
+            return i;
+        }
+    }
+    return s_pwm_count < MAX_PWM_CHANNELS ? s_pwm_count : -1;
+}
+
+static void pwm_release(int idx)
+{
+    ledc_stop(LEDC_LOW_SPEED_MODE, s_pwm[idx].channel, 0);
+    s_pwm[idx].active = false;
+    pin_release(s_pwm[idx].pin);
+}
+
+/* lua_runner release: a failed or stopped run does not leave PWM running */
+static void pwm_release_cb(void *arg)
+{
+    int idx = (int)(intptr_t)arg;
+    if (s_pwm[idx].active) {
+        ESP_LOGI(TAG, "Releasing PWM on pin %d after failed run", s_pwm[idx].pin);
+        pwm_release(idx);
+    }
+}
+
 static int l_pwm_start(lua_State *L)
 {
     int pin = (int)luaL_checkinteger(L, 1);
@@ -157,15 +629,19 @@ static int l_pwm_start(lua_State *L)
     if (!pin_valid(pin)) {
         return luaL_error(L, "pwm.start: invalid pin %d", pin);
     }
-    if (!pin_claim(pin, PIN_PWM)) {
-        return luaL_error(L, "pwm.start: pin %d is already in use", pin);
+    if (pwm_find(pin) >= 0) {
+        return luaL_error(L, "pwm.start: PWM already active on pin %d", pin);
     }
-    if (s_pwm_count >= MAX_PWM_CHANNELS) {
+    int idx = pwm_alloc();
+    if (idx < 0) {
         return luaL_error(L, "pwm.start: no free PWM channel");
     }
+    if (!pin_claim(pin, PIN_PWM)) {
+        return luaL_error(L, "pwm.start: pin %d is already in use", pin);
+    }
 
-    ledc_channel_t ch = (ledc_channel_t)s_pwm_count;
-    ledc_timer_t tmr = (ledc_timer_t)(s_pwm_count / 2);
+    ledc_channel_t ch = (ledc_channel_t)idx;
+    ledc_timer_t tmr = (ledc_timer_t)(idx / 2);
 
     ledc_timer_config_t tcfg = {
         .speed_mode = LEDC_LOW_SPEED_MODE,
@@ -176,6 +652,7 @@ static int l_pwm_start(lua_State *L)
     };
     esp_err_t err = ledc_timer_config(&tcfg);
     if (err != ESP_OK) {
+        pin_release(pin);
         return luaL_error(L, "ledc_timer_config failed: %s", esp_err_to_name(err));
     }
 
@@ -191,14 +668,20 @@ static int l_pwm_start(lua_State *L)
     };
     err = ledc_channel_config(&ccfg);
     if (err != ESP_OK) {
+        pin_release(pin);
         return luaL_error(L, "ledc_channel_config failed: %s", esp_err_to_name(err));
     }
 
-    s_pwm[s_pwm_count].pin = pin;
-    s_pwm[s_pwm_count].channel = ch;
-    s_pwm[s_pwm_count].timer = tmr;
-    s_pwm[s_pwm_count].active = true;
-    s_pwm_count++;
+    s_pwm[idx].pin = pin;
+    s_pwm[idx].channel = ch;
+    s_pwm[idx].timer = tmr;
+    s_pwm[idx].active = true;
+    if (idx == s_pwm_count) {
+        s_pwm_count++;
+    }
+    if (!lua_runner_track(L, pwm_release_cb, (void *)(intptr_t)idx)) {
+        ESP_LOGW(TAG, "pwm.start: pin %d not tracked for release", pin);
+    }
 
     return 0;
 }
@@ -239,9 +722,8 @@ static int l_pwm_stop(lua_State *L)
         return luaL_error(L, "pwm.stop: PWM not active on pin %d", pin);
     }
 
-    ledc_stop(LEDC_LOW_SPEED_MODE, s_pwm[idx].channel, 0);
-    s_pwm[idx].active = false;
-    pin_release(pin);
+    lua_runner_untrack(L, pwm_release_cb, (void *)(intptr_t)idx);
+    pwm_release(idx);
     return 0;
 }
 
@@ -253,13 +735,61 @@ static const luaL_Reg pwm_lib[] = {
     {NULL, NULL},
 };
 
+/* ── Edge watches (lua_daemon) ────────────────────────────── */
+
+static void watch_isr(void *arg)
+{
+    int pin = (int)(intptr_t)arg;
+    lua_daemon_post_gpio_isr(pin, gpio_get_level((gpio_num_t)pin));
+}
+
+esp_err_t lua_gpio_watch(int pin, lua_gpio_pull_t pull)
+{
+    if (!pin_valid(pin)) return ESP_ERR_INVALID_ARG;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    bool watched = s_pin_usage[pin] == PIN_WATCH;
+    bool claimed = !watched && pin_claim(pin, PIN_WATCH);
+    xSemaphoreGive(s_mutex);
+    if (watched) return ESP_OK;
+    if (!claimed) return ESP_ERR_INVALID_STATE;
+
+    static const pin_mode_t modes[] = {
+        [LUA_GPIO_PULL_NONE] = MODE_IN,
+        [LUA_GPIO_PULL_UP] = MODE_IN_UP,
+        [LUA_GPIO_PULL_DOWN] = MODE_IN_DOWN,
+    };
+    esp_err_t err = pin_configure(pin, modes[pull], GPIO_INTR_ANYEDGE);
+    if (err == ESP_OK) {
+        err = isr_service();
+    }
+    if (err == ESP_OK) {
+        err = gpio_isr_handler_add((gpio_num_t)pin, watch_isr, (void *)(intptr_t)pin);
+    }
+    if (err != ESP_OK) {
+        pin_release(pin);
+        ESP_LOGW(TAG, "Failed to watch pin %d: %s", pin, esp_err_to_name(err));
+    }
+    return err;
+}
+
+void lua_gpio_unwatch(int pin)
+{
+    if (!pin_valid(pin) || s_pin_usage[pin] != PIN_WATCH) return;
+    gpio_isr_handler_remove((gpio_num_t)pin);
+    gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_DISABLE);
+    pin_release(pin);
+}
+
 /* ── sleep module ─────────────────────────────────────────── */
 
 static int l_sleep_ms(lua_State *L)
 {
     int ms = (int)luaL_checkinteger(L, 1);
-    vTaskDelay(pdMS_TO_TICKS(ms));
-    return 0;
+    if (ms <= 0) {
+        return 0;
+    }
+    /* Under lua_sched the script yields and other scripts run meanwhile */
+    return lua_runner_pause(L, (uint32_t)ms, 0, NULL);
 }
 
 static const luaL_Reg sleep_lib[] = {
@@ -272,6 +802,9 @@ void lua_open_gpio_libs(lua_State *L)
     if (!s_mutex) {
         s_mutex = xSemaphoreCreateMutex();
     }
+    if (!s_edges) {
+        s_edges = xQueueCreate(MIMI_LUA_GPIO_EDGE_QUEUE_LEN, sizeof(edge_event_t));
+    }
 
     luaL_newlib(L, gpio_lib);
     lua_setglobal(L, "gpio");
@@ -282,3 +815,85 @@ void lua_open_gpio_libs(lua_State *L)
 
     ESP_LOGI(TAG, "Lua hardware libraries registered");
 }
+
+void lua_gpio_get_stats(lua_gpio_stats_t *out)
+{
+    *out = s_stats;
+}
+
+/* ── Benchmark ────────────────────────────────────────────── */
+
+/* Each op's loop, run once with N iterations and once with N = 0 */
+static const char BENCH_BODY[] =
+    "gpio.mode(PIN, 'out')\n"
+    "if OP == 'write' then\n"
+    "  for i = 1, N do gpio.write(PIN, i & 1) end\n"
+    "elseif OP == 'reconfig' then\n"
+    "  -- what every gpio.write cost before pin modes were cached\n"
+    "  for i = 1, N do gpio.mode(PIN, 'off') gpio.write(PIN, i & 1) end\n"
+    "elseif OP == 'read' then\n"
+    "  local v\n"
+    "  for i = 1, N do v = gpio.read(PIN) end\n"
+    "elseif OP == 'write_many' then\n"
+    "  local t = {}\n"
+    "  for i = 1, N do t[PIN] = i & 1 gpio.write_many(t) end\n"
+    "elseif OP == 'write_mask' then\n"
+    "  local m = 1 << PIN\n"
+    "  for i = 1, N do gpio.write_mask(m, (i & 1) * m) end\n"
+    "end\n"
+    "gpio.mode(PIN, 'off')\n";
+
+static const char *const s_bench_ops[] = { "write", "reconfig", "read", "write_many", "write_mask" };
+#define BENCH_OPS (int)(sizeof(s_bench_ops) / sizeof(s_bench_ops[0]))
+
+static int64_t bench_run(int pin, int iters, const char *op, uint32_t *configs)
+{
+    char prelude[64], out[64];
+    snprintf(prelude, sizeof(prelude), "local N, PIN, OP = %d, %d, '%s'\n", iters, pin, op);
+    uint32_t before = s_stats.configs;
+    int64_t us = lua_runner_time_script(MIMI_LUA_GPIO_BENCH_SCRIPT, prelude, BENCH_BODY,
+                                        MIMI_LUA_BENCH_TIMEOUT_MS, out, sizeof(out));
+    *configs = s_stats.configs - before;
+    return us;
+}
+
+esp_err_t lua_gpio_bench(int pin, int iters, char **report_json)
+{
+    *report_json = NULL;
+    if (!pin_valid(pin) || iters < 1 || iters > MIMI_LUA_GPIO_BENCH_MAX_ITERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "pin", pin);
+    cJSON_AddNumberToObject(root, "iters", iters);
+    cJSON *ops = cJSON_AddObjectToObject(root, "ops");
+    double per_call[BENCH_OPS] = {0};
+    int errors = 0;
+
+    for (int op = 0; op < BENCH_OPS; op++) {
+        uint32_t base_cfg = 0, cfg = 0;
+        int64_t base = bench_run(pin, 0, s_bench_ops[op], &base_cfg);
+        int64_t total = bench_run(pin, iters, s_bench_ops[op], &cfg);
+        if (base < 0 || total < 0) {
+            errors++;
+            continue;
+        }
+        per_call[op] = total > base ? (double)(total - base) / iters : 0;
+        cJSON *o = cJSON_AddObjectToObject(ops, s_bench_ops[op]);
+        cJSON_AddNumberToObject(o, "us", per_call[op]);
+        cJSON_AddNumberToObject(o, "configs", cfg > base_cfg ? (double)(cfg - base_cfg) / iters : 0);
+    }
+    remove(MIMI_LUA_GPIO_BENCH_SCRIPT);
+    lua_cache_invalidate(MIMI_LUA_GPIO_BENCH_SCRIPT);
+
+    /* s_bench_ops[0] is the cached write, [1] the reconfiguring one */
+    cJSON_AddNumberToObject(root, "write_speedup", per_call[0] > 0 ? per_call[1] / per_call[0] : 0);
+    cJSON_AddNumberToObject(root, "errors", errors);
+
+    *report_json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!*report_json) return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Bench: %s", *report_json);
+    return ESP_OK;
+}
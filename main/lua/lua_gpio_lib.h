@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+#include "esp_err.h"
 #include "lua.h"
 
 /**
@@ -7,8 +9,52 @@
  *
  * Registers the following globals:
  *   gpio.write(pin, val)       gpio.read(pin)
+ *   gpio.mode(pin [, mode])    "in", "in_up", "in_down", "out", "od" or "off"
+ *   gpio.write_many({[pin]=val})  gpio.write_mask(mask, vals)  gpio.read_mask(mask)
+ *   gpio.pulse_train(pin, {us, ...} [, start])
+ *   gpio.watch(pin [, pull])   gpio.unwatch(pin)   gpio.wait_edge([timeout_ms])
  *   rgb.fill(pin,n,r,g,b)     rgb.show(pin,n)  (when CONFIG_MIMI_TOOL_RGB_ENABLED)
  *   pwm.start(pin,freq,duty)
  *   sleep.ms(ms)
+ *
+ * A pin's mode is remembered across calls and runs: read and write only
+ * call gpio_config() when the pin is not already configured for them.
+ * Masks are 49-bit pin sets (bit n = GPIO n); on the S3 the pins of one
+ * 32-pin bank change in a single register write. Edges of watched pins
+ * queue up to MIMI_LUA_GPIO_EDGE_QUEUE_LEN until wait_edge() takes them;
+ * watches end with the run. The host build runs against host/host_gpio.
  */
 void lua_open_gpio_libs(lua_State *L);
+
+typedef enum {
+    LUA_GPIO_PULL_NONE = 0,
+    LUA_GPIO_PULL_UP,
+    LUA_GPIO_PULL_DOWN,
+} lua_gpio_pull_t;
+
+/**
+ * Configure pin as an input whose edges (both directions) are posted to
+ * lua_daemon from the ISR. The pin stays readable through gpio.read().
+ */
+esp_err_t lua_gpio_watch(int pin, lua_gpio_pull_t pull);
+
+/** Remove the edge interrupt and free the pin. */
+void lua_gpio_unwatch(int pin);
+
+typedef struct {
+    uint32_t configs;           /* gpio_config() calls made */
+    uint32_t edges;             /* edges queued for gpio.wait_edge() */
+    uint32_t edges_dropped;     /* edges lost to a full queue */
+} lua_gpio_stats_t;
+
+void lua_gpio_get_stats(lua_gpio_stats_t *out);
+
+/**
+ * Time gpio.write (cached and reconfiguring every call), gpio.read,
+ * gpio.write_many and gpio.write_mask on pin, `iters` calls each, and
+ * report microseconds and gpio_config() calls per call. Toggles the pin.
+ *
+ * @param iters        1..MIMI_LUA_GPIO_BENCH_MAX_ITERS
+ * @param report_json  out: single-line JSON report, caller frees
+ */
+esp_err_t lua_gpio_bench(int pin, int iters, char **report_json);
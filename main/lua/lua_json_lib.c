@@ -0,0 +1,619 @@
+#include "lua/lua_json_lib.h"
+#include "lua/lua_runner.h"
+#include "lua/lua_cache.h"
+#include "mimi_config.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "cJSON.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+
+static const char *TAG = "lua_json";
+
+#define JSON_TREE_MT   "mimi.json.tree"
+#define JSON_BUF_INIT  256      /* json.encode's first buffer */
+#define JSON_STAGE     256      /* json.print batches writes to the capture */
+
+/*
+ * Encoder output: a growing userdata at stack slot `slot` (json.encode; the
+ * state's allocator and its cap see every byte) or, with slot 0, a small
+ * C buffer flushed into the run's output (json.print).
+ */
+typedef struct {
+    lua_State *L;
+    int        slot;
+    char      *buf;
+    size_t     len;
+    size_t     cap;
+} json_out_t;
+
+/* ── Encode ───────────────────────────────────────────────── */
+
+static void out_flush(json_out_t *o)
+{
+    if (o->slot == 0 && o->len > 0) {
+        lua_runner_write_output(o->L, o->buf, o->len);
+        o->len = 0;
+    }
+}
+
+static void out_write(json_out_t *o, const char *s, size_t n)
+{
+    if (o->len + n > o->cap) {
+        if (o->slot == 0) {
+            out_flush(o);
+            if (n > o->cap) {
+                lua_runner_write_output(o->L, s, n);
+                return;
+            }
+        } else {
+            size_t cap = o->cap * 2;
+            while (cap < o->len + n) cap *= 2;
+            /* Balanced push + replace: callers' stack layout is unchanged */
+            char *nb = lua_newuserdatauv(o->L, cap, 0);
+            memcpy(nb, o->buf, o->len);
+            lua_replace(o->L, o->slot);
+            o->buf = nb;
+            o->cap = cap;
+        }
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+
+static void out_char(json_out_t *o, char c)
+{
+    if (o->len < o->cap) {
+        o->buf[o->len++] = c;
+    } else {
+        out_write(o, &c, 1);
+    }
+}
+
+/* Number text as cJSON prints it; 0 for NaN / infinity */
+static int format_number(lua_State *L, int idx, char *num, size_t size)
+{
+    if (lua_isinteger(L, idx)) {
+        return snprintf(num, size, "%lld", (long long)lua_tointeger(L, idx));
+    }
+    double d = lua_tonumber(L, idx);
+    if (isnan(d) || isinf(d)) return 0;
+    int n = snprintf(num, size, "%1.15g", d);
+    if (strtod(num, NULL) != d) n = snprintf(num, size, "%1.17g", d);
+    return n;
+}
+
+static void encode_string(json_out_t *o, const char *s, size_t len)
+{
+    out_char(o, '"');
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out_write(o, s + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"':  out_write(o, "\\\"", 2); break;
+        case '\\': out_write(o, "\\\\", 2); break;
+        case '\b': out_write(o, "\\b", 2); break;
+        case '\f': out_write(o, "\\f", 2); break;
+        case '\n': out_write(o, "\\n", 2); break;
+        case '\r': out_write(o, "\\r", 2); break;
+        case '\t': out_write(o, "\\t", 2); break;
+        default: {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out_write(o, esc, 6);
+        }
+        }
+    }
+    out_write(o, s + run, len - run);
+    out_char(o, '"');
+}
+
+/* Items of the table at idx when it encodes as an array, else -1 */
+static lua_Integer array_length(lua_State *L, int idx)
+{
+    lua_Integer n = (lua_Integer)lua_rawlen(L, idx);
+    if (lua_getmetatable(L, idx)) {
+        bool marked = lua_rawequal(L, -1, lua_upvalueindex(1));
+        lua_pop(L, 1);
+        if (marked) return n;
+    }
+    if (n == 0) return -1;
+
+    /* Exactly the keys 1..n */
+    lua_Integer count = 0;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        lua_pop(L, 1);
+        lua_Integer k = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+        if (k < 1 || k > n) {
+            lua_pop(L, 1);
+            return -1;
+        }
+        count++;
+    }
+    return count == n ? n : -1;
+}
+
+static void encode_value(json_out_t *o, int idx, int depth);
+
+static void encode_key(json_out_t *o, int idx)
+{
+    lua_State *L = o->L;
+    if (lua_type(L, idx) == LUA_TSTRING) {
+        size_t len;
+        const char *s = lua_tolstring(L, idx, &len);
+        encode_string(o, s, len);
+        return;
+    }
+    char num[32];
+    int n = lua_type(L, idx) == LUA_TNUMBER ? format_number(L, idx, num, sizeof(num)) : 0;
+    if (n <= 0) {
+        luaL_error(L, "json: cannot encode a %s key", luaL_typename(L, idx));
+    }
+    encode_string(o, num, (size_t)n);
+}
+
+static void encode_table(json_out_t *o, int idx, int depth)
+{
+    lua_State *L = o->L;
+    if (depth >= MIMI_LUA_JSON_MAX_DEPTH) {
+        luaL_error(L, "json: nesting deeper than %d (cycle?)", MIMI_LUA_JSON_MAX_DEPTH);
+    }
+    luaL_checkstack(L, 3, "json: nesting too deep");
+
+    lua_Integer n = array_length(L, idx);
+    if (n >= 0) {
+        out_char(o, '[');
+        for (lua_Integer i = 1; i <= n; i++) {
+            if (i > 1) out_char(o, ',');
+            lua_rawgeti(L, idx, i);
+            encode_value(o, lua_gettop(L), depth + 1);
+            lua_pop(L, 1);
+        }
+        out_char(o, ']');
+        return;
+    }
+
+    out_char(o, '{');
+    bool first = true;
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        if (!first) out_char(o, ',');
+        first = false;
+        encode_key(o, lua_gettop(L) - 1);
+        out_char(o, ':');
+        encode_value(o, lua_gettop(L), depth + 1);
+        lua_pop(L, 1);
+    }
+    out_char(o, '}');
+}
+
+static void encode_value(json_out_t *o, int idx, int depth)
+{
+    lua_State *L = o->L;
+    switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+        out_write(o, "null", 4);
+        break;
+    case LUA_TBOOLEAN:
+        if (lua_toboolean(L, idx)) {
+            out_write(o, "true", 4);
+        } else {
+            out_write(o, "false", 5);
+        }
+        break;
+    case LUA_TNUMBER: {
+        char num[32];
+        int n = format_number(L, idx, num, sizeof(num));
+        if (n > 0) {
+            out_write(o, num, (size_t)n);
+        } else {
+            out_write(o, "null", 4);    /* as cJSON prints NaN and infinity */
+        }
+        break;
+    }
+    case LUA_TSTRING: {
+        size_t len;
+        const char *s = lua_tolstring(L, idx, &len);
+        encode_string(o, s, len);
+        break;
+    }
+    case LUA_TTABLE:
+        encode_table(o, idx, depth);
+        break;
+    default:
+        if (lua_type(L, idx) == LUA_TLIGHTUSERDATA && lua_touserdata(L, idx) == NULL) {
+            out_write(o, "null", 4);    /* json.null */
+            break;
+        }
+        luaL_error(L, "json: cannot encode a %s", luaL_typename(L, idx));
+    }
+}
+
+static int l_encode(lua_State *L)
+{
+    luaL_checkany(L, 1);
+    lua_settop(L, 1);
+    json_out_t o = { .L = L, .slot = 2, .cap = JSON_BUF_INIT };
+    o.buf = lua_newuserdatauv(L, o.cap, 0);
+    encode_value(&o, 1, 0);
+    lua_pushlstring(L, o.buf, o.len);
+    return 1;
+}
+
+static int l_print(lua_State *L)
+{
+    luaL_checkany(L, 1);
+    lua_settop(L, 1);
+    char stage[JSON_STAGE];
+    json_out_t o = { .L = L, .slot = 0, .buf = stage, .cap = sizeof(stage) };
+    encode_value(&o, 1, 0);
+    out_char(&o, '\n');
+    out_flush(&o);
+    return 0;
+}
+
+/* ── Decode ───────────────────────────────────────────────── */
+
+/* cJSON recurses once per level (up to 1000) on the worker's small stack */
+static bool nesting_ok(const char *p, size_t n, size_t *at)
+{
+    int depth = 0;
+    bool in_str = false;
+    for (size_t i = 0; i < n; i++) {
+        char c = p[i];
+        if (in_str) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                in_str = false;
+            }
+        } else if (c == '"') {
+            in_str = true;
+        } else if (c == '[' || c == '{') {
+            if (++depth > MIMI_LUA_JSON_MAX_DEPTH) {
+                *at = i;
+                return false;
+            }
+        } else if (c == ']' || c == '}') {
+            depth--;
+        }
+    }
+    return true;
+}
+
+static void push_node(lua_State *L, const cJSON *node)
+{
+    luaL_checkstack(L, 2, "json: nesting too deep");
+
+    if (cJSON_IsNull(node)) {
+        lua_pushlightuserdata(L, NULL);
+    } else if (cJSON_IsBool(node)) {
+        lua_pushboolean(L, cJSON_IsTrue(node));
+    } else if (cJSON_IsNumber(node)) {
+        /* cJSON keeps only the double: whole values come back as integers */
+        double d = node->valuedouble;
+        lua_Integer i;
+        if (d == floor(d) && lua_numbertointeger(d, &i)) {
+            lua_pushinteger(L, i);
+        } else {
+            lua_pushnumber(L, d);
+        }
+    } else if (cJSON_IsString(node)) {
+        lua_pushstring(L, node->valuestring);
+    } else if (cJSON_IsArray(node)) {
+        int n = 0;
+        for (const cJSON *c = node->child; c; c = c->next) n++;
+        lua_createtable(L, n, 0);
+        lua_Integer i = 0;
+        for (const cJSON *c = node->child; c; c = c->next) {
+            push_node(L, c);
+            lua_rawseti(L, -2, ++i);
+        }
+        lua_pushvalue(L, lua_upvalueindex(1));
+        lua_setmetatable(L, -2);
+    } else {
+        int n = 0;
+        for (const cJSON *c = node->child; c; c = c->next) n++;
+        lua_createtable(L, 0, n);
+        for (const cJSON *c = node->child; c; c = c->next) {
+            push_node(L, c);
+            lua_setfield(L, -2, c->string);
+        }
+    }
+}
+
+static int decode_fail(lua_State *L, const char *what, size_t byte)
+{
+    lua_pushnil(L);
+    lua_pushfstring(L, "json: %s at byte %d", what, (int)byte);
+    return 2;
+}
+
+static int l_decode(lua_State *L)
+{
+    size_t len;
+    const char *s = luaL_checklstring(L, 1, &len);
+    lua_Integer i = luaL_optinteger(L, 2, 1);
+    lua_Integer j = luaL_optinteger(L, 3, -1);
+
+    /* Slice bounds as string.sub takes them */
+    if (i < 0) i = (lua_Integer)len + i + 1;
+    if (i < 1) i = 1;
+    if (j < 0) j = (lua_Integer)len + j + 1;
+    if (j > (lua_Integer)len) j = (lua_Integer)len;
+    if (i > j) return decode_fail(L, "no value", (size_t)i);
+
+    const char *p = s + i - 1;
+    size_t n = (size_t)(j - i + 1);
+    if (n > MIMI_LUA_JSON_MAX_DECODE) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "json: text longer than %d bytes", (int)MIMI_LUA_JSON_MAX_DECODE);
+        return 2;
+    }
+    size_t at;
+    if (!nesting_ok(p, n, &at)) {
+        return decode_fail(L, "nesting too deep", (size_t)i + at);
+    }
+
+    /* The tree is owned by a userdata until converted, so an error raised
+     * while building the tables (memory cap) cannot leak it */
+    cJSON **box = lua_newuserdatauv(L, sizeof(cJSON *), 0);
+    *box = NULL;
+    luaL_setmetatable(L, JSON_TREE_MT);
+
+    const char *end = NULL;
+    *box = cJSON_ParseWithLengthOpts(p, n, &end, false);
+    if (!*box) {
+        return decode_fail(L, "syntax error", end ? (size_t)(end - s) + 1 : (size_t)i);
+    }
+    while (end < p + n && (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')) end++;
+    if (end < p + n) {
+        return decode_fail(L, "unexpected text", (size_t)(end - s) + 1);
+    }
+
+    push_node(L, *box);
+    cJSON_Delete(*box);
+    *box = NULL;
+    return 1;
+}
+
+static int l_tree_gc(lua_State *L)
+{
+    cJSON **box = lua_touserdata(L, 1);
+    if (box && *box) {
+        cJSON_Delete(*box);
+        *box = NULL;
+    }
+    return 0;
+}
+
+/* ── Registration ─────────────────────────────────────────── */
+
+void lua_open_json_lib(lua_State *L)
+{
+    luaL_newmetatable(L, JSON_TREE_MT);
+    lua_pushcfunction(L, l_tree_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_pop(L, 1);
+
+    static const luaL_Reg funcs[] = {
+        {"encode", l_encode},
+        {"print",  l_print},
+        {"decode", l_decode},
+        {NULL, NULL},
+    };
+    lua_newtable(L);
+    lua_newtable(L);                    /* json.array, upvalue of every function */
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, "array");
+    luaL_setfuncs(L, funcs, 1);
+    lua_pushlightuserdata(L, NULL);
+    lua_setfield(L, -2, "null");
+    lua_setglobal(L, "json");
+}
+
+/* ── Benchmark ────────────────────────────────────────────── */
+
+/*
+ * Runs with `local N, IMPL, OP = ...` prepended: builds a ~1.5 KB sensor
+ * report, encodes or decodes it N times with json or the pure-Lua
+ * reference, and prints the text's length and that of a round trip.
+ */
+static const char BENCH_BODY[] =
+    "-- Pure-Lua reference: the usual recursive encoder / descent parser\n"
+    "local escmap = { ['\"'] = '\\\\\"', ['\\\\'] = '\\\\\\\\', ['\\b'] = '\\\\b', ['\\f'] = '\\\\f',\n"
+    "                 ['\\n'] = '\\\\n', ['\\r'] = '\\\\r', ['\\t'] = '\\\\t' }\n"
+    "local function esc(s)\n"
+    "  return (s:gsub('[%c\"\\\\]', function(c) return escmap[c] or string.format('\\\\u%04x', c:byte()) end))\n"
+    "end\n"
+    "local function lenc(v, out)\n"
+    "  local t = type(v)\n"
+    "  if t == 'table' then\n"
+    "    local n = #v\n"
+    "    if n > 0 then\n"
+    "      out[#out + 1] = '['\n"
+    "      for i = 1, n do\n"
+    "        if i > 1 then out[#out + 1] = ',' end\n"
+    "        lenc(v[i], out)\n"
+    "      end\n"
+    "      out[#out + 1] = ']'\n"
+    "    else\n"
+    "      out[#out + 1] = '{'\n"
+    "      local first = true\n"
+    "      for k, x in pairs(v) do\n"
+    "        if not first then out[#out + 1] = ',' end\n"
+    "        first = false\n"
+    "        out[#out + 1] = '\"' .. esc(tostring(k)) .. '\":'\n"
+    "        lenc(x, out)\n"
+    "      end\n"
+    "      out[#out + 1] = '}'\n"
+    "    end\n"
+    "  elseif t == 'string' then\n"
+    "    out[#out + 1] = '\"' .. esc(v) .. '\"'\n"
+    "  elseif t == 'number' then\n"
+    "    out[#out + 1] = math.type(v) == 'integer' and tostring(v) or string.format('%.15g', v)\n"
+    "  elseif t == 'boolean' then\n"
+    "    out[#out + 1] = tostring(v)\n"
+    "  else\n"
+    "    out[#out + 1] = 'null'\n"
+    "  end\n"
+    "end\n"
+    "local unesc = { b = '\\b', f = '\\f', n = '\\n', r = '\\r', t = '\\t', ['\"'] = '\"', ['\\\\'] = '\\\\', ['/'] = '/' }\n"
+    "local function skip(s, i) return s:find('[^ \\t\\r\\n]', i) or #s + 1 end\n"
+    "local function lstr(s, i)\n"
+    "  local j, parts = i + 1, {}\n"
+    "  while true do\n"
+    "    local k = s:find('[\"\\\\]', j)\n"
+    "    if not k then error('unterminated string') end\n"
+    "    parts[#parts + 1] = s:sub(j, k - 1)\n"
+    "    if s:byte(k) == 34 then return table.concat(parts), k + 1 end\n"
+    "    local c = s:sub(k + 1, k + 1)\n"
+    "    if c == 'u' then\n"
+    "      parts[#parts + 1] = utf8.char(tonumber(s:sub(k + 2, k + 5), 16))\n"
+    "      j = k + 6\n"
+    "    else\n"
+    "      parts[#parts + 1] = unesc[c]\n"
+    "      j = k + 2\n"
+    "    end\n"
+    "  end\n"
+    "end\n"
+    "local ldec\n"
+    "ldec = function(s, i)\n"
+    "  i = skip(s, i)\n"
+    "  local c = s:sub(i, i)\n"
+    "  if c == '{' then\n"
+    "    local t = {}\n"
+    "    i = skip(s, i + 1)\n"
+    "    if s:sub(i, i) == '}' then return t, i + 1 end\n"
+    "    while true do\n"
+    "      local k\n"
+    "      k, i = lstr(s, skip(s, i))\n"
+    "      t[k], i = ldec(s, skip(s, i) + 1)\n"
+    "      i = skip(s, i)\n"
+    "      c = s:sub(i, i)\n"
+    "      i = i + 1\n"
+    "      if c == '}' then return t, i end\n"
+    "    end\n"
+    "  elseif c == '[' then\n"
+    "    local t, n = {}, 0\n"
+    "    i = skip(s, i + 1)\n"
+    "    if s:sub(i, i) == ']' then return t, i + 1 end\n"
+    "    while true do\n"
+    "      n = n + 1\n"
+    "      t[n], i = ldec(s, i)\n"
+    "      i = skip(s, i)\n"
+    "      c = s:sub(i, i)\n"
+    "      i = i + 1\n"
+    "      if c == ']' then return t, i end\n"
+    "    end\n"
+    "  elseif c == '\"' then\n"
+    "    return lstr(s, i)\n"
+    "  elseif s:sub(i, i + 3) == 'true' then\n"
+    "    return true, i + 4\n"
+    "  elseif s:sub(i, i + 4) == 'false' then\n"
+    "    return false, i + 5\n"
+    "  elseif s:sub(i, i + 3) == 'null' then\n"
+    "    return nil, i + 4\n"
+    "  end\n"
+    "  local num = s:match('^-?%d+%.?%d*[eE]?[-+]?%d*', i)\n"
+    "  return math.tointeger(tonumber(num)) or tonumber(num), i + #num\n"
+    "end\n"
+    "\n"
+    "-- Sample: a sensor report like the ones scripts hand back to the model\n"
+    "local doc = { device = 'mimiclaw', fw = '1.4.2', uptime_s = 86400, ok = true,\n"
+    "              note = 'room \"A\"\\tnorth wall', readings = {} }\n"
+    "for i = 1, 20 do\n"
+    "  doc.readings[i] = { ts = 1700000000 + i * 60, temp = 20 + i * 0.25, hum = 40 + i,\n"
+    "                      pin = i % 8, label = 'probe-' .. i, alarm = i % 5 == 0 }\n"
+    "end\n"
+    "\n"
+    "local enc, dec\n"
+    "if IMPL == 'native' then\n"
+    "  enc, dec = json.encode, json.decode\n"
+    "else\n"
+    "  enc = function(v) local out = {} lenc(v, out) return table.concat(out) end\n"
+    "  dec = function(s) return (ldec(s, 1)) end\n"
+    "end\n"
+    "local text = enc(doc)\n"
+    "for _ = 1, N do\n"
+    "  if OP == 'encode' then enc(doc) else dec(text) end\n"
+    "end\n"
+    "print(#text, #enc(dec(text)))\n"
+    ;
+
+static const char *const s_impls[2] = {"native", "lua"};
+static const char *const s_ops[2] = {"encode", "decode"};
+
+/* Duration of one run in microseconds, -1 on failure; out gets its output */
+static int64_t bench_run(int iters, const char *impl, const char *op, char *out, size_t out_size)
+{
+    char prelude[64];
+    snprintf(prelude, sizeof(prelude), "local N, IMPL, OP = %d, '%s', '%s'\n", iters, impl, op);
+    return lua_runner_time_script(MIMI_LUA_JSON_BENCH_SCRIPT, prelude, BENCH_BODY,
+                                  MIMI_LUA_JSON_BENCH_TIMEOUT_MS, out, out_size);
+}
+
+esp_err_t lua_json_bench(int iters, char **report_json)
+{
+    *report_json = NULL;
+    if (iters < 1 || iters > MIMI_LUA_BENCH_MAX_RUNS) return ESP_ERR_INVALID_ARG;
+
+    double per_call[2][2] = {{0}};     /* [op][impl] */
+    int errors = 0;
+    bool match = true;
+    char first[32] = "", out[32];
+
+    for (int op = 0; op < 2; op++) {
+        for (int impl = 0; impl < 2; impl++) {
+            /* The same script with N = 0 times everything but the loop */
+            int64_t base = bench_run(0, s_impls[impl], s_ops[op], out, sizeof(out));
+            int64_t total = bench_run(iters, s_impls[impl], s_ops[op], out, sizeof(out));
+            if (base < 0 || total < 0) {
+                errors++;
+                continue;
+            }
+            per_call[op][impl] = total > base ? (double)(total - base) / iters : 0;
+            /* Both implementations agree on the sizes of text and round trip */
+            if (!first[0]) {
+                snprintf(first, sizeof(first), "%s", out);
+            } else if (strcmp(first, out) != 0) {
+                match = false;
+            }
+        }
+    }
+    remove(MIMI_LUA_JSON_BENCH_SCRIPT);
+    lua_cache_invalidate(MIMI_LUA_JSON_BENCH_SCRIPT);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "iters", iters);
+    cJSON_AddNumberToObject(root, "doc_bytes", atoi(first));
+    for (int op = 0; op < 2; op++) {
+        char key[16];
+        snprintf(key, sizeof(key), "%s_us", s_ops[op]);
+        cJSON *o = cJSON_AddObjectToObject(root, key);
+        cJSON_AddNumberToObject(o, "native", per_call[op][0]);
+        cJSON_AddNumberToObject(o, "lua", per_call[op][1]);
+        cJSON_AddNumberToObject(o, "speedup",
+                                per_call[op][0] > 0 ? per_call[op][1] / per_call[op][0] : 0);
+    }
+    cJSON_AddBoolToObject(root, "outputs_match", match && errors == 0);
+    cJSON_AddNumberToObject(root, "errors", errors);
+
+    *report_json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!*report_json) return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Bench: %s", *report_json);
+    return ESP_OK;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "esp_err.h"
+#include "lua.h"
+
+/*
+ * Native `json` library for scripts.
+ *
+ *   json.encode(v)          compact JSON text, as cJSON_PrintUnformatted
+ *                           would print it
+ *   json.print(v)           encode straight into the run's output, then "\n"
+ *   json.decode(s [,i [,j]]) value of s, or of the slice s:sub(i, j) without
+ *                           copying it; nil, "json: ... at byte N" when the
+ *                           text is not JSON
+ *   json.null               JSON null inside decoded tables (nil also encodes
+ *                           as null)
+ *   json.array              metatable of decoded arrays; setmetatable(t,
+ *                           json.array) makes an empty table encode as []
+ *
+ * Decoding parses with cJSON in place, on the Lua string's own bytes.
+ * Tables whose keys are exactly 1..n encode as arrays, others as objects
+ * (integer keys become strings). Nesting is limited to
+ * MIMI_LUA_JSON_MAX_DEPTH both ways and decode input to
+ * MIMI_LUA_JSON_MAX_DECODE bytes.
+ */
+void lua_open_json_lib(lua_State *L);
+
+/**
+ * Time json.encode / json.decode of a sample document against a pure-Lua
+ * implementation, `iters` times each on the warm pool, and report the
+ * microseconds per call and the speedup.
+ *
+ * @param iters        1..MIMI_LUA_BENCH_MAX_RUNS
+ * @param report_json  out: single-line JSON report, caller frees
+ */
+esp_err_t lua_json_bench(int iters, char **report_json);
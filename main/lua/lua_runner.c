@@ -1,6 +1,14 @@
 #include "lua/lua_runner.h"
+#include "lua/lua_cache.h"
+#include "lua/lua_json_lib.h"
 #include "lua/lua_gpio_lib.h"
+#include "lua/lua_sandbox.h"
+#include "mimi_config.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+#include "sdkconfig.h"
 
+#if !CONFIG_IDF_TARGET_LINUX
 #if CONFIG_MIMI_TOOL_RGB_ENABLED
 #include "lua_modulo_rgb.h"
 #endif
@@ -12,15 +20,19 @@
 #if CONFIG_MIMI_TOOL_BLE_ENABLED
 #include "lua_modulo_ble.h"
 #endif
+#endif /* !CONFIG_IDF_TARGET_LINUX */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "cJSON.h"
 
 #include "lua.h"
 #include "lualib.h"
@@ -28,96 +40,317 @@
 
 static const char *TAG = "lua_runner";
 
-/* ── Capture buffer for print() output ────────────────────── */
-
-#define CAPTURE_BUF_MAX  4096
 #define LUA_TASK_STACK   8192
+#define LUA_PATH_MAX     256
+
+/* Registry keys of a pooled state's pristine snapshot */
+#define SNAPSHOT_KEY     "_pool_snapshot"   /* table -> shallow copy */
+#define SNAPSHOT_MT_KEY  "_pool_snapshot_mt" /* table -> metatable */
+
+/* Sandbox limit that stopped a run */
+typedef enum {
+    LIMIT_NONE = 0,
+    LIMIT_TIME,
+    LIMIT_INSTRUCTIONS,
+    LIMIT_MEMORY,
+    LIMIT_COUNT,
+} run_limit_t;
+
+static const char *s_limit_names[LIMIT_COUNT] = { NULL, "time", "instructions", "memory" };
 
 typedef struct {
-    char  buf[CAPTURE_BUF_MAX];
-    size_t len;
+    lua_release_fn_t fn;
+    void            *arg;
+    bool             always;    /* lua_runner_defer(): also after a clean run */
+} release_t;
+
+/* print() output: a list of fixed PSRAM chunks, appended to only */
+typedef struct capture_chunk {
+    struct capture_chunk *next;
+    char data[MIMI_LUA_CAPTURE_CHUNK];
+} capture_chunk_t;
+
+/* Per-state run context; also the allocator's ud, so it outlives the state */
+typedef struct {
+    capture_chunk_t first;  /* inline: short outputs need no allocation */
+    capture_chunk_t *tail;
+    size_t len;             /* bytes captured, published after they are written */
+    size_t dropped;         /* bytes past MIMI_LUA_CAPTURE_MAX or lost to OOM */
+    int64_t start_us;
+    int64_t deadline_us;    /* 0: no deadline */
+    int timeout_ms;
+    run_limit_t limit;
+    uint64_t instructions;  /* counted in MIMI_LUA_HOOK_COUNT steps */
+    size_t mem_used;        /* live bytes of the state */
+    size_t mem_peak;        /* high-water mark since begin_run() */
+    bool mem_capped;        /* cap enforced: set up and reset run uncapped */
+    bool mem_refused;       /* an allocation would have passed MIMI_LUA_MEM_CAP */
+    release_t release[MIMI_LUA_MAX_RELEASES];
+    int n_release;
+    lua_cache_result_t load;
+    lua_State *co;          /* sliced run (lua_sched): the script's coroutine */
+    int co_ref;             /* keeps co alive in the registry */
+    int32_t slice_left;     /* instructions before the hook yields co */
+    int64_t wake_us;        /* when a paused co wants to run again */
 } capture_ctx_t;
 
-/* ── PSRAM allocator for Lua state ────────────────────────── */
+/* ── PSRAM allocator with a per-state cap ─────────────────── */
 
 static void *lua_psram_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 {
-    (void)ud;
-    (void)osize;
+    capture_ctx_t *ctx = (capture_ctx_t *)ud;
+    size_t old = ptr ? osize : 0;   /* osize is a type tag for new blocks */
     if (nsize == 0) {
         free(ptr);
+        ctx->mem_used -= old;
+        return NULL;
+    }
+    /* Only growth is refused; Lua collects and retries once before raising */
+    if (ctx->mem_capped && nsize > old && ctx->mem_used - old + nsize > MIMI_LUA_MEM_CAP) {
+        ctx->mem_refused = true;
         return NULL;
     }
-    return heap_caps_realloc(ptr, nsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    void *p = heap_caps_realloc(ptr, nsize, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p) {
+        ctx->mem_used = ctx->mem_used - old + nsize;
+        if (ctx->mem_used > ctx->mem_peak) ctx->mem_peak = ctx->mem_used;
+    }
+    return p;
 }
 
-/* ── Replacement print() that writes to the capture buffer ── */
+static capture_ctx_t *get_capture_ctx(lua_State *L)
+{
+    void *ud = NULL;
+    lua_getallocf(L, &ud);
+    return (capture_ctx_t *)ud;
+}
+
+/* ── Capture of print() output ────────────────────────────── */
+
+/*
+ * One task writes (the script's), another may read concurrently (the
+ * caller streaming output): bytes and chunk links are stored before len
+ * is published with release order, and chunks are only freed by
+ * capture_reset() between runs.
+ */
+
+static size_t capture_len(const capture_ctx_t *ctx)
+{
+    return __atomic_load_n(&ctx->len, __ATOMIC_ACQUIRE);
+}
+
+static void capture_reset(capture_ctx_t *ctx)
+{
+    capture_chunk_t *c = ctx->first.next;
+    while (c) {
+        capture_chunk_t *next = c->next;
+        free(c);
+        c = next;
+    }
+    ctx->first.next = NULL;
+    ctx->tail = &ctx->first;
+    ctx->dropped = 0;
+    __atomic_store_n(&ctx->len, 0, __ATOMIC_RELEASE);
+}
+
+static void capture_write(capture_ctx_t *ctx, const char *s, size_t n)
+{
+    size_t len = ctx->len;
+    if (len + n > MIMI_LUA_CAPTURE_MAX) {
+        size_t fit = MIMI_LUA_CAPTURE_MAX - len;
+        ctx->dropped += n - fit;
+        n = fit;
+    }
+    while (n > 0) {
+        size_t off = len % MIMI_LUA_CAPTURE_CHUNK;
+        if (off == 0 && len > 0) {
+            capture_chunk_t *c = heap_caps_malloc(sizeof(capture_chunk_t), MALLOC_CAP_SPIRAM);
+            if (!c) {
+                ctx->dropped += n;
+                return;
+            }
+            c->next = NULL;
+            ctx->tail->next = c;
+            ctx->tail = c;
+        }
+        size_t copy = MIMI_LUA_CAPTURE_CHUNK - off;
+        if (copy > n) copy = n;
+        memcpy(ctx->tail->data + off, s, copy);
+        s += copy;
+        n -= copy;
+        len += copy;
+        __atomic_store_n(&ctx->len, len, __ATOMIC_RELEASE);
+    }
+}
+
+/* Copy bytes [*pos, end) into dst, following chunks from *chunk */
+static void capture_read(const capture_ctx_t *ctx, const capture_chunk_t **chunk,
+                         size_t *pos, size_t end, char *dst)
+{
+    const capture_chunk_t *c = *chunk ? *chunk : &ctx->first;
+    while (*pos < end) {
+        size_t off = *pos % MIMI_LUA_CAPTURE_CHUNK;
+        if (off == 0 && *pos > 0 && *chunk) c = c->next;
+        *chunk = c;
+        size_t copy = MIMI_LUA_CAPTURE_CHUNK - off;
+        if (copy > end - *pos) copy = end - *pos;
+        memcpy(dst, c->data + off, copy);
+        dst += copy;
+        *pos += copy;
+    }
+}
+
+/* The whole capture as one heap string with room for extra more bytes */
+static char *capture_flatten(const capture_ctx_t *ctx, size_t extra, size_t *len_out)
+{
+    size_t len = capture_len(ctx);
+    char *out = malloc(len + extra + 1);
+    if (!out) return NULL;
+    const capture_chunk_t *chunk = NULL;
+    size_t pos = 0;
+    capture_read(ctx, &chunk, &pos, len, out);
+    out[len] = '\0';
+    *len_out = len;
+    return out;
+}
 
 static int l_capture_print(lua_State *L)
 {
-    capture_ctx_t *ctx;
-    lua_getfield(L, LUA_REGISTRYINDEX, "_capture_ctx");
-    ctx = (capture_ctx_t *)lua_touserdata(L, -1);
-    lua_pop(L, 1);
+    capture_ctx_t *ctx = get_capture_ctx(L);
     if (!ctx) return 0;
 
     int n = lua_gettop(L);
     for (int i = 1; i <= n; i++) {
-        if (i > 1 && ctx->len < CAPTURE_BUF_MAX - 1) {
-            ctx->buf[ctx->len++] = '\t';
-        }
+        if (i > 1) capture_write(ctx, "\t", 1);
         size_t slen;
         const char *s = luaL_tolstring(L, i, &slen);
-        if (s) {
-            size_t avail = CAPTURE_BUF_MAX - 1 - ctx->len;
-            size_t copy = (slen < avail) ? slen : avail;
-            memcpy(ctx->buf + ctx->len, s, copy);
-            ctx->len += copy;
-        }
+        if (s) capture_write(ctx, s, slen);
         lua_pop(L, 1); /* pop the tostring result */
     }
-    if (ctx->len < CAPTURE_BUF_MAX - 1) {
-        ctx->buf[ctx->len++] = '\n';
-    }
+    capture_write(ctx, "\n", 1);
     return 0;
 }
 
-/* ── Task wrapper for executing Lua with a timeout ────────── */
+/* ── Sandbox: limits, uncatchable once tripped ────────────── */
 
-typedef struct {
-    lua_State        *L;
-    const char       *script_path;
-    int               result;
-    SemaphoreHandle_t done_sem;
-} lua_task_ctx_t;
+static int raise_limit(lua_State *L, capture_ctx_t *ctx)
+{
+    switch (ctx->limit) {
+    case LIMIT_TIME:
+        return luaL_error(L, "script exceeded %d ms", ctx->timeout_ms);
+    case LIMIT_INSTRUCTIONS:
+        return luaL_error(L, "script exceeded %u instructions", (unsigned)MIMI_LUA_INSTR_BUDGET);
+    default:
+        return luaL_error(L, "script exceeded the %u KB memory cap",
+                          (unsigned)(MIMI_LUA_MEM_CAP / 1024));
+    }
+}
 
-static void lua_exec_task(void *arg)
+/* Count hook: CPU budget, wall-clock deadline and the slice of a sliced run */
+static void l_sandbox_hook(lua_State *L, lua_Debug *ar)
 {
-    lua_task_ctx_t *tc = (lua_task_ctx_t *)arg;
-    tc->result = luaL_dofile(tc->L, tc->script_path);
-    xSemaphoreGive(tc->done_sem);
-    vTaskDelete(NULL);
+    (void)ar;
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    ctx->instructions += MIMI_LUA_HOOK_COUNT;
+    if (ctx->limit == LIMIT_NONE) {
+        if (ctx->deadline_us && esp_timer_get_time() > ctx->deadline_us) {
+            ctx->limit = LIMIT_TIME;
+        } else if (MIMI_LUA_INSTR_BUDGET && ctx->instructions > MIMI_LUA_INSTR_BUDGET) {
+            ctx->limit = LIMIT_INSTRUCTIONS;
+        } else {
+            /* Only the script's own coroutine yields to lua_sched, never one it resumed */
+            if (L == ctx->co && (ctx->slice_left -= MIMI_LUA_HOOK_COUNT) <= 0 &&
+                lua_isyieldable(L)) {
+                lua_yield(L, 0);    /* takes effect when the hook returns */
+            }
+            return;
+        }
+    }
+    raise_limit(L, ctx);
 }
 
-/* ── Public API ───────────────────────────────────────────── */
+static bool is_memory_error(lua_State *L, int idx)
+{
+    const char *msg = lua_type(L, idx) == LUA_TSTRING ? lua_tostring(L, idx) : NULL;
+    return msg && strcmp(msg, "not enough memory") == 0;
+}
 
-esp_err_t lua_runner_exec(const char *script_path, int timeout_ms,
-                          char **out_buf)
+/* Results of the wrapped catcher are at 1..top, status first */
+static int catch_finish(lua_State *L, int status, lua_KContext kctx)
 {
-    if (!script_path || !out_buf) return ESP_ERR_INVALID_ARG;
+    (void)status;
+    (void)kctx;
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    if (!lua_toboolean(L, 1)) {
+        if (ctx->limit == LIMIT_NONE && ctx->mem_refused && is_memory_error(L, 2)) {
+            ctx->limit = LIMIT_MEMORY;
+        }
+        if (ctx->limit != LIMIT_NONE) {
+            lua_settop(L, 2);
+            return lua_error(L);    /* a script cannot swallow a limit */
+        }
+    }
+    return lua_gettop(L);
+}
 
-    *out_buf = NULL;
+/* pcall / xpcall / coroutine.resume wrapper; upvalue 1 is the original */
+static int l_sandbox_catch(lua_State *L)
+{
+    int n = lua_gettop(L);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_callk(L, n, LUA_MULTRET, 0, catch_finish);
+    return catch_finish(L, LUA_OK, 0);
+}
 
-    /* Create a fresh Lua state with PSRAM allocator */
-    lua_State *L = lua_newstate(lua_psram_alloc, NULL);
-    if (!L) {
-        *out_buf = strdup("Failed to create Lua state (out of memory)");
-        return ESP_FAIL;
+static void wrap_catcher(lua_State *L, const char *lib, const char *name)
+{
+    if (lib) {
+        if (lua_getglobal(L, lib) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            return;
+        }
+    } else {
+        lua_pushglobaltable(L);
+    }
+    lua_getfield(L, -1, name);
+    lua_pushcclosure(L, l_sandbox_catch, 1);
+    lua_setfield(L, -2, name);
+    lua_pop(L, 1);
+}
+
+/* Settle the limit of a finished run and drop or fire its releases */
+static void finish_run(capture_ctx_t *ctx, int rc)
+{
+    ctx->mem_capped = false;
+    if (rc == LUA_ERRMEM && ctx->mem_refused && ctx->limit == LIMIT_NONE) {
+        ctx->limit = LIMIT_MEMORY;
+    }
+    /* LIFO; a run that succeeded keeps what it set up (a PWM output, say) */
+    while (ctx->n_release > 0) {
+        release_t r = ctx->release[--ctx->n_release];
+        if (r.always || rc != LUA_OK || ctx->limit != LIMIT_NONE) r.fn(r.arg);
     }
+}
+
+/* ── State setup ──────────────────────────────────────────── */
+
+/* Fresh state with the sandboxed libraries open and print() bound to ctx */
+static lua_State *new_state(capture_ctx_t *ctx)
+{
+    ctx->mem_used = 0;
+    ctx->mem_peak = 0;
+    ctx->mem_capped = false;
+    ctx->n_release = 0;
+    capture_reset(ctx);
+    lua_State *L = lua_newstate(lua_psram_alloc, ctx);
+    if (!L) return NULL;
 
-    luaL_openlibs(L);
-    lua_open_gpio_libs(L);
+    lua_sandbox_open_libs(L);   /* no debug library, text chunks only */
+    lua_open_json_lib(L);
+    lua_open_gpio_libs(L);      /* host build: against host/host_gpio */
 
+#if !CONFIG_IDF_TARGET_LINUX
 #if CONFIG_MIMI_TOOL_RGB_ENABLED
     lua_register_modulo_rgb_lib(L);
 #endif
@@ -129,34 +362,488 @@ esp_err_t lua_runner_exec(const char *script_path, int timeout_ms,
 #if CONFIG_MIMI_TOOL_BLE_ENABLED
     lua_register_modulo_ble_lib(L);
 #endif
-
-    /* Set up capture context */
-    capture_ctx_t *ctx = calloc(1, sizeof(capture_ctx_t));
-    if (!ctx) {
-        lua_close(L);
-        *out_buf = strdup("Failed to allocate capture buffer");
-        return ESP_ERR_NO_MEM;
-    }
-
-    lua_pushlightuserdata(L, ctx);
-    lua_setfield(L, LUA_REGISTRYINDEX, "_capture_ctx");
+#endif /* !CONFIG_IDF_TARGET_LINUX */
 
     /* Replace print() */
     lua_pushcfunction(L, l_capture_print);
     lua_setglobal(L, "print");
 
     /* Set Lua package search path to SPIFFS scripts directory */
-    if (luaL_dostring(L, "package.path = '/spiffs/scripts/?.lua'") != LUA_OK) {
+    if (luaL_dostring(L, "package.path = '" MIMI_LUA_SCRIPTS_DIR "/?.lua'") != LUA_OK) {
         ESP_LOGW(TAG, "Failed to set package.path: %s",
                  lua_tostring(L, -1));
         lua_pop(L, 1);
     }
 
+    wrap_catcher(L, NULL, "pcall");
+    wrap_catcher(L, NULL, "xpcall");
+    wrap_catcher(L, "coroutine", "resume");
+    lua_cache_install(L);
+    /* Coroutines inherit the hook from the thread that creates them */
+    lua_sethook(L, l_sandbox_hook, LUA_MASKCOUNT, MIMI_LUA_HOOK_COUNT);
+    return L;
+}
+
+/* Load the script through the bytecode cache, run it and settle the run */
+static int run_script(lua_State *L, const char *path)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    int rc = lua_cache_load(L, path, &ctx->load);
+    if (rc == LUA_OK) rc = lua_pcall(L, 0, LUA_MULTRET, 0);
+    finish_run(ctx, rc);
+    return rc;
+}
+
+/*
+ * Captured output, then a truncation marker when output was dropped, then
+ * the error or the limit hit; heap allocated
+ */
+static char *format_result(capture_ctx_t *ctx, int rc, const char *err)
+{
+    char tail[96];
+    const char *err_msg = (rc != LUA_OK && ctx->limit == LIMIT_NONE)
+                          ? (err ? err : "unknown error") : NULL;
+    if (ctx->limit == LIMIT_TIME) {
+        snprintf(tail, sizeof(tail), "[Timeout: script exceeded %d ms]", ctx->timeout_ms);
+    } else if (ctx->limit == LIMIT_INSTRUCTIONS) {
+        snprintf(tail, sizeof(tail), "[Limit: script exceeded %u instructions]",
+                 (unsigned)MIMI_LUA_INSTR_BUDGET);
+    } else if (ctx->limit == LIMIT_MEMORY) {
+        snprintf(tail, sizeof(tail), "[Limit: script exceeded the %u KB memory cap]",
+                 (unsigned)(MIMI_LUA_MEM_CAP / 1024));
+    }
+    const char *end_msg = ctx->limit != LIMIT_NONE ? tail : err_msg;
+
+    char marker[96] = "";
+    if (ctx->dropped) {
+        snprintf(marker, sizeof(marker), "[Output truncated: %u bytes dropped past %u KB]\n",
+                 (unsigned)ctx->dropped, (unsigned)(MIMI_LUA_CAPTURE_MAX / 1024));
+    }
+
+    size_t mlen = strlen(marker);
+    size_t elen = end_msg ? strlen(end_msg) : 0;
+    size_t len;
+    char *result = capture_flatten(ctx, mlen + elen + 2, &len);
+    if (!result) return strdup(end_msg ? end_msg : "Out of memory");
+
+    if (mlen) {
+        if (len > 0 && result[len - 1] != '\n') result[len++] = '\n';
+        memcpy(result + len, marker, mlen);
+        len += mlen;
+        if (!end_msg) len--;                /* no trailing newline */
+    } else if (end_msg && (len > 0 || ctx->limit != LIMIT_NONE)) {
+        result[len++] = '\n';               /* limits always start a line */
+    }
+    memcpy(result + len, end_msg ? end_msg : "", elen);
+    result[len + elen] = '\0';
+    return result;
+}
+
+static void begin_run(capture_ctx_t *ctx, int timeout_ms)
+{
+    capture_reset(ctx);
+    ctx->limit = LIMIT_NONE;
+    ctx->instructions = 0;
+    ctx->mem_peak = ctx->mem_used;
+    ctx->mem_capped = MIMI_LUA_MEM_CAP > 0;
+    ctx->mem_refused = false;
+    memset(&ctx->load, 0, sizeof(ctx->load));
+    ctx->timeout_ms = timeout_ms;
+    ctx->start_us = esp_timer_get_time();
+    ctx->deadline_us = ctx->start_us + (int64_t)timeout_ms * 1000;
+}
+
+/* What a finished (or killed) run reports back */
+typedef struct {
+    lua_run_stats_t    stats;
+    lua_cache_result_t load;
+} run_report_t;
+
+static void report_run(const capture_ctx_t *ctx, run_report_t *rep)
+{
+    rep->stats.instructions = ctx->instructions;
+    rep->stats.peak_bytes = (uint32_t)ctx->mem_peak;
+    rep->stats.duration_us = (uint32_t)(esp_timer_get_time() - ctx->start_us);
+    rep->stats.limit = s_limit_names[ctx->limit];
+    rep->load = ctx->load;
+}
+
+/* ── Metrics ──────────────────────────────────────────────── */
+
+enum { RUN_WARM = 0, RUN_COLD, RUN_MODE_COUNT };
+
+static metric_t *s_m_runs[RUN_MODE_COUNT];
+static metric_t *s_m_exec_ms[RUN_MODE_COUNT];
+static metric_t *s_m_restarts;
+static metric_t *s_m_limits[LIMIT_COUNT];
+
+static void register_metrics(void)
+{
+    static const char *labels[RUN_MODE_COUNT] = { "mode=\"warm\"", "mode=\"cold\"" };
+    for (int i = 0; i < RUN_MODE_COUNT; i++) {
+        s_m_runs[i] = metrics_counter("mimi_lua_runs_total", "Lua scripts executed", labels[i]);
+        s_m_exec_ms[i] = metrics_histogram("mimi_lua_exec_ms", "Lua script latency incl. setup",
+                                           labels[i], METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+    }
+    s_m_restarts = metrics_counter("mimi_lua_worker_restarts_total",
+                                   "Pool workers torn down after a hard timeout", NULL);
+    static const char *limit_labels[LIMIT_COUNT] = {
+        NULL, "limit=\"time\"", "limit=\"instructions\"", "limit=\"memory\"",
+    };
+    for (int i = LIMIT_TIME; i < LIMIT_COUNT; i++) {
+        s_m_limits[i] = metrics_counter("mimi_lua_limit_hits_total",
+                                        "Lua runs stopped by a sandbox limit", limit_labels[i]);
+    }
+}
+
+/* ── Pristine snapshot of a pooled state ──────────────────── */
+
+/* Record copy[k] = t[k] for the table at idx under its identity in snap */
+static void snapshot_table(lua_State *L, int idx, int snap, int snap_mt)
+{
+    idx = lua_absindex(L, idx);
+    lua_pushvalue(L, idx);
+    if (lua_rawget(L, snap) != LUA_TNIL) {      /* already recorded */
+        lua_pop(L, 1);
+        return;
+    }
+    lua_pop(L, 1);
+
+    lua_pushvalue(L, idx);
+    lua_newtable(L);
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, -4);
+    }
+    lua_rawset(L, snap);
+
+    lua_pushvalue(L, idx);
+    if (lua_getmetatable(L, idx)) {
+        lua_rawset(L, snap_mt);
+    } else {
+        lua_pop(L, 1);
+    }
+}
+
+/*
+ * Snapshot _G, every table reachable from it in two steps (library tables,
+ * package.loaded / preload / searchers) and the string metatable. Values
+ * are copied shallowly: a run that mutates any of these tables is undone by
+ * restore_snapshot(); tables a script creates simply become garbage.
+ */
+static void take_snapshot(lua_State *L)
+{
+    lua_newtable(L);
+    int snap = lua_gettop(L);
+    lua_newtable(L);
+    int snap_mt = lua_gettop(L);
+
+    lua_pushglobaltable(L);
+    int g = lua_gettop(L);
+    snapshot_table(L, g, snap, snap_mt);
+
+    lua_pushnil(L);
+    while (lua_next(L, g)) {
+        if (lua_type(L, -1) == LUA_TTABLE) {
+            int lib = lua_gettop(L);
+            snapshot_table(L, lib, snap, snap_mt);
+            lua_pushnil(L);
+            while (lua_next(L, lib)) {
+                if (lua_type(L, -1) == LUA_TTABLE) snapshot_table(L, -1, snap, snap_mt);
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    lua_pushliteral(L, "");
+    if (lua_getmetatable(L, -1)) snapshot_table(L, -1, snap, snap_mt);
+    lua_settop(L, snap_mt);
+
+    lua_setfield(L, LUA_REGISTRYINDEX, SNAPSHOT_MT_KEY);
+    lua_setfield(L, LUA_REGISTRYINDEX, SNAPSHOT_KEY);
+}
+
+/* Put every snapshotted table back to its recorded contents and metatable */
+static void restore_snapshot(lua_State *L)
+{
+    lua_settop(L, 0);
+    lua_getfield(L, LUA_REGISTRYINDEX, SNAPSHOT_KEY);
+    lua_getfield(L, LUA_REGISTRYINDEX, SNAPSHOT_MT_KEY);
+    int snap = 1, snap_mt = 2;
+
+    lua_pushnil(L);
+    while (lua_next(L, snap)) {
+        int t = lua_gettop(L) - 1, copy = lua_gettop(L);
+
+        /* Clear keys added since the snapshot (clearing during lua_next is allowed) */
+        lua_pushnil(L);
+        while (lua_next(L, t)) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            if (lua_rawget(L, copy) == LUA_TNIL) {
+                lua_pushvalue(L, -2);
+                lua_pushnil(L);
+                lua_rawset(L, t);
+            }
+            lua_pop(L, 1);
+        }
+
+        /* Put back the recorded values */
+        lua_pushnil(L);
+        while (lua_next(L, copy)) {
+            lua_pushvalue(L, -2);
+            lua_insert(L, -2);
+            lua_rawset(L, t);
+        }
+
+        lua_pushvalue(L, t);
+        lua_rawget(L, snap_mt);
+        lua_setmetatable(L, t);     /* nil clears one a script added */
+
+        lua_pop(L, 1);              /* copy; keep t for lua_next */
+    }
+    lua_settop(L, 0);
+}
+
+/* ── Streaming output to the caller ───────────────────────── */
+
+typedef struct {
+    lua_output_fn_t        fn;          /* NULL: no streaming */
+    void                  *arg;
+    const capture_chunk_t *chunk;       /* read position */
+    size_t                 pos;         /* bytes already passed on */
+} stream_t;
+
+/* Pass the output captured since the last flush to the caller's callback */
+static void stream_flush(stream_t *st, const capture_ctx_t *ctx)
+{
+    size_t end = capture_len(ctx);
+    if (!st->fn || end <= st->pos) return;
+    size_t n = end - st->pos;
+    char *text = heap_caps_malloc(n + 1, MALLOC_CAP_SPIRAM);
+    if (!text) return;
+    capture_read(ctx, &st->chunk, &st->pos, end, text);
+    text[n] = '\0';
+    st->fn(text, n, st->arg);
+    free(text);
+}
+
+/*
+ * Wait up to wait ticks for done. While streaming, wake every
+ * MIMI_LUA_STREAM_INTERVAL_MS to pass on new output; a run that streamed
+ * anything also gets its last output flushed when it ends.
+ */
+static bool wait_run(SemaphoreHandle_t done, const capture_ctx_t *ctx,
+                     TickType_t wait, stream_t *st)
+{
+    if (!st || !st->fn) return xSemaphoreTake(done, wait) == pdTRUE;
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t step = pdMS_TO_TICKS(MIMI_LUA_STREAM_INTERVAL_MS);
+    while (1) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        TickType_t left = elapsed < wait ? wait - elapsed : 0;
+        if (xSemaphoreTake(done, left < step ? left : step) == pdTRUE) {
+            if (st->pos > 0) stream_flush(st, ctx);
+            return true;
+        }
+        if (left <= step) return false;
+        stream_flush(st, ctx);
+    }
+}
+
+/* ── Warm pool: persistent workers, each owning a state ───── */
+
+typedef struct {
+    int               index;
+    TaskHandle_t      task;
+    lua_State        *L;
+    capture_ctx_t    *ctx;
+    SemaphoreHandle_t start;        /* job handed over */
+    SemaphoreHandle_t done;         /* result ready */
+    bool              ready;        /* state built and idle */
+    bool              busy;         /* claimed by a caller */
+    char              path[LUA_PATH_MAX];
+    int               rc;
+    char             *out;
+} lua_worker_t;
+
+static lua_worker_t s_workers[MIMI_LUA_POOL_SIZE];
+static bool s_pool_started = false;
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void lua_worker_task(void *arg)
+{
+    lua_worker_t *w = (lua_worker_t *)arg;
+
+    /* Built here so the state is attributed to this (lua_*) task */
+    w->L = new_state(w->ctx);
+    if (!w->L) {
+        /* Never becomes ready, so it is never claimed; callers run cold */
+        ESP_LOGE(TAG, "Worker %d: failed to create Lua state", w->index);
+        vTaskDelete(NULL);
+        return;
+    }
+    take_snapshot(w->L);
+    lua_gc(w->L, LUA_GCCOLLECT, 0);
+
+    portENTER_CRITICAL(&s_pool_lock);
+    w->busy = false;
+    w->ready = true;
+    portEXIT_CRITICAL(&s_pool_lock);
+
+    while (1) {
+        xSemaphoreTake(w->start, portMAX_DELAY);
+
+        trace_span_t span = trace_begin("lua_run", NULL);
+        w->rc = run_script(w->L, w->path);
+        trace_end(&span);
+        w->ctx->deadline_us = 0;
+        w->out = format_result(w->ctx, w->rc,
+                               w->rc == LUA_OK ? NULL : lua_tostring(w->L, -1));
+        xSemaphoreGive(w->done);
+
+        /* Reset off the caller's clock: globals, libraries, package cache */
+        restore_snapshot(w->L);
+        lua_gc(w->L, LUA_GCCOLLECT, 0);
+
+        portENTER_CRITICAL(&s_pool_lock);
+        w->busy = false;
+        portEXIT_CRITICAL(&s_pool_lock);
+    }
+}
+
+static esp_err_t spawn_worker(lua_worker_t *w)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "lua_w%d", w->index);
+    w->ready = false;
+    w->busy = true;         /* until the state is built */
+    if (xTaskCreatePinnedToCore(lua_worker_task, name, MIMI_LUA_WORKER_STACK, w,
+                                MIMI_LUA_WORKER_PRIO, &w->task, tskNO_AFFINITY) != pdPASS) {
+        w->task = NULL;
+        ESP_LOGE(TAG, "Failed to create %s", name);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Claim an idle worker, or NULL when every worker is busy */
+static lua_worker_t *claim_worker(void)
+{
+    lua_worker_t *w = NULL;
+    portENTER_CRITICAL(&s_pool_lock);
+    for (int i = 0; s_pool_started && i < MIMI_LUA_POOL_SIZE; i++) {
+        if (s_workers[i].task && s_workers[i].ready && !s_workers[i].busy) {
+            w = &s_workers[i];
+            w->busy = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_pool_lock);
+    return w;
+}
+
+/*
+ * The script ignored the deadline hook (blocked in a C function or
+ * swallowing the error): delete the worker like the cold path deletes its
+ * task. The caller still owns it and respawns it once the output is taken.
+ */
+static void kill_worker(lua_worker_t *w)
+{
+    ESP_LOGW(TAG, "Worker %d stuck past its deadline, restarting", w->index);
+    portENTER_CRITICAL(&s_pool_lock);
+    w->ready = false;
+    portEXIT_CRITICAL(&s_pool_lock);
+
+    vTaskDelete(w->task);
+    w->task = NULL;
+    finish_run(w->ctx, LUA_ERRRUN);     /* releases the script still held */
+    lua_close(w->L);
+    w->L = NULL;
+    free(w->out);
+    w->out = NULL;
+    xSemaphoreTake(w->done, 0);     /* a result given right before the kill */
+    metric_inc(s_m_restarts);
+}
+
+static esp_err_t exec_warm(lua_worker_t *w, const char *script_path, int timeout_ms,
+                           stream_t *st, char **out_buf, run_report_t *rep)
+{
+    strncpy(w->path, script_path, sizeof(w->path) - 1);
+    w->path[sizeof(w->path) - 1] = '\0';
+    w->out = NULL;
+    begin_run(w->ctx, timeout_ms);
+    xSemaphoreGive(w->start);
+
+    TickType_t wait = pdMS_TO_TICKS(timeout_ms + MIMI_LUA_KILL_GRACE_MS);
+    bool timed_out = !wait_run(w->done, w->ctx, wait, st);
+    if (timed_out && xSemaphoreTake(w->done, 0) == pdTRUE) {
+        timed_out = false;      /* finished right at the end of the grace */
+    }
+    if (timed_out) {
+        ESP_LOGW(TAG, "Lua script timed out after %d ms", timeout_ms);
+        w->ctx->limit = LIMIT_TIME;
+        kill_worker(w);
+        report_run(w->ctx, rep);
+        *out_buf = format_result(w->ctx, LUA_ERRRUN, NULL);
+        spawn_worker(w);
+        return ESP_FAIL;
+    }
+
+    report_run(w->ctx, rep);
+    *out_buf = w->out;
+    w->out = NULL;
+    return (w->rc == LUA_OK) ? ESP_OK : ESP_FAIL;
+}
+
+/* ── Cold path: a throwaway state and task per script ─────── */
+
+typedef struct {
+    lua_State        *L;
+    const char       *script_path;
+    int               result;
+    SemaphoreHandle_t done_sem;
+} lua_task_ctx_t;
+
+static void lua_exec_task(void *arg)
+{
+    lua_task_ctx_t *tc = (lua_task_ctx_t *)arg;
+    trace_span_t span = trace_begin("lua_run", NULL);
+    tc->result = run_script(tc->L, tc->script_path);
+    trace_end(&span);
+    xSemaphoreGive(tc->done_sem);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t exec_cold(const char *script_path, int timeout_ms, stream_t *st,
+                           char **out_buf, run_report_t *rep, int64_t start_us)
+{
+    /* Set up capture context */
+    capture_ctx_t *ctx = calloc(1, sizeof(capture_ctx_t));
+    if (!ctx) {
+        *out_buf = strdup("Failed to allocate capture buffer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Create a fresh Lua state with PSRAM allocator */
+    lua_State *L = new_state(ctx);
+    if (!L) {
+        free(ctx);
+        *out_buf = strdup("Failed to create Lua state (out of memory)");
+        return ESP_FAIL;
+    }
+    begin_run(ctx, timeout_ms);
+
     /* Run the script in a separate FreeRTOS task with timeout */
     SemaphoreHandle_t done_sem = xSemaphoreCreateBinary();
     if (!done_sem) {
-        free(ctx);
         lua_close(L);
+        free(ctx);
         *out_buf = strdup("Failed to create semaphore");
         return ESP_FAIL;
     }
@@ -186,7 +873,7 @@ esp_err_t lua_runner_exec(const char *script_path, int timeout_ms,
             lua_exec_task, "lua_exec", stack_size, &tc,
             tskIDLE_PRIORITY + 1, &task_handle, tskNO_AFFINITY);
         if (created == pdPASS) {
-            ESP_LOGI(TAG, "Lua task created with stack size %u bytes", (unsigned)stack_size);
+            ESP_LOGD(TAG, "Lua task created with stack size %u bytes", (unsigned)stack_size);
             break;
         }
         ESP_LOGW(TAG, "Failed to create Lua task with stack %u bytes, retrying...", (unsigned)stack_size);
@@ -194,58 +881,465 @@ esp_err_t lua_runner_exec(const char *script_path, int timeout_ms,
 
     if (created != pdPASS) {
         vSemaphoreDelete(done_sem);
-        free(ctx);
         lua_close(L);
+        free(ctx);
         *out_buf = strdup("Failed to create Lua execution task (out of memory)");
         return ESP_FAIL;
     }
 
-    /* Wait for the task to signal completion or timeout */
-    bool timed_out = (xSemaphoreTake(done_sem, pdMS_TO_TICKS(timeout_ms)) != pdTRUE);
+    trace_record("lua_setup", NULL, start_us, esp_timer_get_time());
+
+    /*
+     * Past the deadline the hook unwinds the script and run_script() runs
+     * its cleanups; give it the same grace as a warm worker before the
+     * task is deleted from under it.
+     */
+    TickType_t wait = pdMS_TO_TICKS(timeout_ms + MIMI_LUA_KILL_GRACE_MS);
+    bool timed_out = !wait_run(done_sem, ctx, wait, st);
+    if (timed_out && xSemaphoreTake(done_sem, 0) == pdTRUE) {
+        timed_out = false;      /* finished right at the end of the grace */
+    }
     if (timed_out) {
-        ESP_LOGW(TAG, "Lua script timed out after %d ms", timeout_ms);
+        ESP_LOGW(TAG, "Lua script stuck past its deadline, killing it");
         vTaskDelete(task_handle);
+        ctx->limit = LIMIT_TIME;
+        finish_run(ctx, LUA_ERRRUN);
     }
     vSemaphoreDelete(done_sem);
 
-    /* Flush capture buffer */
-    ctx->buf[ctx->len] = '\0';
+    report_run(ctx, rep);
+    *out_buf = format_result(ctx, tc.result,
+                             (timed_out || tc.result == LUA_OK) ? NULL : lua_tostring(L, -1));
 
-    if (timed_out) {
-        size_t needed = ctx->len + 64;
-        char *result = malloc(needed);
-        if (result) {
-            snprintf(result, needed, "%s\n[Timeout: script exceeded %d ms]",
-                     ctx->buf, timeout_ms);
+    lua_close(L);
+    capture_reset(ctx);
+    free(ctx);      /* after lua_close: the allocator still counts into it */
+    return (!timed_out && tc.result == LUA_OK) ? ESP_OK : ESP_FAIL;
+}
+
+/* ── Public API ───────────────────────────────────────────── */
+
+static bool add_release(lua_State *L, lua_release_fn_t fn, void *arg, bool always)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    if (!fn || ctx->n_release >= MIMI_LUA_MAX_RELEASES) return false;
+    ctx->release[ctx->n_release].fn = fn;
+    ctx->release[ctx->n_release].arg = arg;
+    ctx->release[ctx->n_release].always = always;
+    ctx->n_release++;
+    return true;
+}
+
+bool lua_runner_track(lua_State *L, lua_release_fn_t fn, void *arg)
+{
+    return add_release(L, fn, arg, false);
+}
+
+bool lua_runner_defer(lua_State *L, lua_release_fn_t fn, void *arg)
+{
+    return add_release(L, fn, arg, true);
+}
+
+void lua_runner_untrack(lua_State *L, lua_release_fn_t fn, void *arg)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    for (int i = ctx->n_release - 1; i >= 0; i--) {
+        if (ctx->release[i].fn == fn && ctx->release[i].arg == arg) {
+            memmove(&ctx->release[i], &ctx->release[i + 1],
+                    (ctx->n_release - i - 1) * sizeof(release_t));
+            ctx->n_release--;
+            return;
         }
-        *out_buf = result ? result : strdup("[Timeout]");
-        free(ctx);
-        lua_close(L);
-        return ESP_FAIL;
     }
+}
 
-    if (tc.result == LUA_OK) {
-        *out_buf = strdup(ctx->buf);
-    } else {
-        const char *err = lua_tostring(L, -1);
-        const char *err_msg = err ? err : "unknown error";
-        size_t err_len = strlen(err_msg);
-        size_t needed = ctx->len + err_len + 2;
-        char *result = malloc(needed);
-        if (result) {
-            if (ctx->len > 0) {
-                memcpy(result, ctx->buf, ctx->len);
-                result[ctx->len] = '\n';
-                memcpy(result + ctx->len + 1, err_msg, err_len + 1);
-            } else {
-                memcpy(result, err_msg, err_len + 1);
-            }
+void lua_runner_write_output(lua_State *L, const char *s, size_t n)
+{
+    capture_write(get_capture_ctx(L), s, n);
+}
+
+void lua_runner_sleep(lua_State *L, uint32_t ms)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    if (ctx->deadline_us) {
+        int64_t left_us = ctx->deadline_us - esp_timer_get_time();
+        if (left_us < (int64_t)ms * 1000) {
+            /* Sleep only up to the deadline, then stop like the hook would */
+            if (left_us > 0) vTaskDelay(pdMS_TO_TICKS(left_us / 1000 + 1));
+            ctx->limit = LIMIT_TIME;
+            raise_limit(L, ctx);
         }
-        *out_buf = result ? result : strdup("Lua error");
     }
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
 
-    free(ctx);
+bool lua_runner_can_pause(lua_State *L)
+{
+    return L == get_capture_ctx(L)->co && lua_isyieldable(L);
+}
+
+int lua_runner_pause(lua_State *L, uint32_t ms, lua_KContext kctx, lua_KFunction k)
+{
+    if (!lua_runner_can_pause(L)) {
+        lua_runner_sleep(L, ms);
+        return k ? k(L, LUA_OK, kctx) : 0;
+    }
+    get_capture_ctx(L)->wake_us = esp_timer_get_time() + (int64_t)ms * 1000;
+    return lua_yieldk(L, 0, kctx, k);
+}
+
+esp_err_t lua_runner_init(void)
+{
+    if (s_pool_started) return ESP_OK;
+    register_metrics();
+
+    for (int i = 0; i < MIMI_LUA_POOL_SIZE; i++) {
+        lua_worker_t *w = &s_workers[i];
+        w->index = i;
+        w->ctx = calloc(1, sizeof(capture_ctx_t));
+        w->start = xSemaphoreCreateBinary();
+        w->done = xSemaphoreCreateBinary();
+        if (!w->ctx || !w->start || !w->done) return ESP_ERR_NO_MEM;
+        spawn_worker(w);
+    }
+    s_pool_started = true;
+
+    ESP_LOGI(TAG, "Lua pool: %d workers, %d-byte stacks",
+             MIMI_LUA_POOL_SIZE, MIMI_LUA_WORKER_STACK);
+    return ESP_OK;
+}
+
+esp_err_t lua_runner_exec(const char *script_path, int timeout_ms,
+                          char **out_buf, lua_run_stats_t *stats)
+{
+    return lua_runner_exec_stream(script_path, timeout_ms, NULL, NULL, out_buf, stats);
+}
+
+esp_err_t lua_runner_exec_stream(const char *script_path, int timeout_ms,
+                                 lua_output_fn_t on_output, void *arg,
+                                 char **out_buf, lua_run_stats_t *stats)
+{
+    if (!script_path || !out_buf) return ESP_ERR_INVALID_ARG;
+    *out_buf = NULL;
+    if (strlen(script_path) >= LUA_PATH_MAX) return ESP_ERR_INVALID_ARG;
+
+    run_report_t rep = {0};
+    lua_worker_t *w = claim_worker();
+    int mode = w ? RUN_WARM : RUN_COLD;
+    trace_span_t span = trace_begin("lua_exec", w ? "warm" : "cold");
+    int64_t start_us = span.start_us;
+    stream_t st = { .fn = on_output, .arg = arg };
+    esp_err_t err = w ? exec_warm(w, script_path, timeout_ms, &st, out_buf, &rep)
+                      : exec_cold(script_path, timeout_ms, &st, out_buf, &rep, start_us);
+    trace_end(&span);
+
+    metric_inc(s_m_runs[mode]);
+    metric_observe_since(s_m_exec_ms[mode], start_us);
+    for (int i = LIMIT_TIME; i < LIMIT_COUNT; i++) {
+        if (rep.stats.limit == s_limit_names[i]) metric_inc(s_m_limits[i]);
+    }
+    if (stats) *stats = rep.stats;
+
+    const char *status = rep.stats.limit ? rep.stats.limit : (err == ESP_OK ? "ok" : "error");
+    if (rep.load.hit) {
+        ESP_LOGI(TAG, "Script %s finished (%s, %s, %lld us, %llu instr, %u B peak; "
+                 "bytecode cached, load %u us vs compile %u us)", script_path,
+                 status, mode == RUN_WARM ? "warm" : "cold",
+                 (long long)(esp_timer_get_time() - start_us),
+                 (unsigned long long)rep.stats.instructions, (unsigned)rep.stats.peak_bytes,
+                 (unsigned)rep.load.load_us, (unsigned)rep.load.compile_us);
+    } else {
+        ESP_LOGI(TAG, "Script %s finished (%s, %s, %lld us, %llu instr, %u B peak; "
+                 "compiled in %u us)", script_path,
+                 status, mode == RUN_WARM ? "warm" : "cold",
+                 (long long)(esp_timer_get_time() - start_us),
+                 (unsigned long long)rep.stats.instructions, (unsigned)rep.stats.peak_bytes,
+                 (unsigned)rep.load.compile_us);
+    }
+    return err;
+}
+
+/* ── Hosted states (lua_daemon) ───────────────────────────── */
+
+lua_State *lua_runner_state_new(void)
+{
+    capture_ctx_t *ctx = heap_caps_calloc(1, sizeof(capture_ctx_t), MALLOC_CAP_SPIRAM);
+    if (!ctx) return NULL;
+    lua_State *L = new_state(ctx);
+    if (!L) {
+        free(ctx);
+        return NULL;
+    }
+    return L;
+}
+
+void lua_runner_state_close(lua_State *L)
+{
+    if (!L) return;
+    capture_ctx_t *ctx = get_capture_ctx(L);
     lua_close(L);
-    ESP_LOGI(TAG, "Script %s finished (rc=%d)", script_path, tc.result);
-    return (tc.result == LUA_OK) ? ESP_OK : ESP_FAIL;
+    capture_reset(ctx);
+    free(ctx);
+}
+
+int lua_runner_state_call(lua_State *L, int nargs, int timeout_ms,
+                          char **out, lua_run_stats_t *stats)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    begin_run(ctx, timeout_ms);
+    int rc = lua_pcall(L, nargs, 0, 0);
+    ctx->deadline_us = 0;
+    finish_run(ctx, rc);
+
+    run_report_t rep;
+    report_run(ctx, &rep);
+    if (stats) *stats = rep.stats;
+    if (out) {
+        bool quiet = rc == LUA_OK && capture_len(ctx) == 0;
+        *out = quiet ? NULL : format_result(ctx, rc, rc == LUA_OK ? NULL : lua_tostring(L, -1));
+    }
+    if (rc != LUA_OK) lua_pop(L, 1);
+    return rc;
+}
+
+/* ── Sliced runs (lua_sched) ──────────────────────────────── */
+
+int lua_runner_state_load(lua_State *L, const char *path, int timeout_ms, char **err)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    begin_run(ctx, timeout_ms);
+    lua_State *co = lua_newthread(L);
+    int rc = lua_cache_load(co, path, &ctx->load);
+    if (rc != LUA_OK) {
+        const char *msg = lua_tostring(co, -1);
+        *err = strdup(msg ? msg : "load failed");
+        lua_pop(L, 1);
+        ctx->deadline_us = 0;
+        finish_run(ctx, rc);
+        return rc;
+    }
+    ctx->co_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    ctx->co = co;
+    return LUA_OK;
+}
+
+/* Settle a sliced run that ended (or was stopped) and drop its coroutine */
+static int end_sliced(lua_State *L, capture_ctx_t *ctx, int rc, const char *err,
+                      char **out, lua_run_stats_t *stats)
+{
+    ctx->deadline_us = 0;
+    finish_run(ctx, rc);
+    run_report_t rep;
+    report_run(ctx, &rep);
+    if (stats) *stats = rep.stats;
+    if (out) *out = format_result(ctx, rc, err);
+
+    /* err lives on co's stack: close it only now */
+    lua_closethread(ctx->co, L);
+    luaL_unref(L, LUA_REGISTRYINDEX, ctx->co_ref);
+    ctx->co = NULL;
+    return rc;
+}
+
+int lua_runner_state_resume(lua_State *L, uint32_t slice, int64_t *wake_us,
+                            char **out, lua_run_stats_t *stats)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    if (!ctx->co) return LUA_ERRRUN;
+    if (ctx->deadline_us && esp_timer_get_time() > ctx->deadline_us) {
+        ctx->limit = LIMIT_TIME;    /* ran out while paused */
+        return end_sliced(L, ctx, LUA_ERRRUN, NULL, out, stats);
+    }
+
+    int nres = 0;
+    ctx->slice_left = (int32_t)slice;
+    ctx->wake_us = 0;
+    int rc = lua_resume(ctx->co, L, 0, &nres);
+    if (rc == LUA_YIELD) {
+        /* Slice used up, lua_runner_pause() or a plain coroutine.yield() */
+        lua_pop(ctx->co, nres);
+        int64_t wake = ctx->wake_us;
+        if (ctx->deadline_us && wake > ctx->deadline_us) wake = ctx->deadline_us + 1;
+        *wake_us = wake;
+        return LUA_YIELD;
+    }
+    return end_sliced(L, ctx, rc, rc == LUA_OK ? NULL : lua_tostring(ctx->co, -1), out, stats);
+}
+
+void lua_runner_state_stop(lua_State *L, const char *why, char **out, lua_run_stats_t *stats)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    if (ctx->co) end_sliced(L, ctx, LUA_ERRRUN, why, out, stats);
+}
+
+void lua_runner_state_abandon(lua_State *L, const char *why, char **out, lua_run_stats_t *stats)
+{
+    capture_ctx_t *ctx = get_capture_ctx(L);
+    if (!ctx->co) return;
+    /* co was running on the deleted task: not resumable or closable, lua_close() frees it */
+    ctx->deadline_us = 0;
+    finish_run(ctx, LUA_ERRRUN);
+    run_report_t rep;
+    report_run(ctx, &rep);
+    if (stats) *stats = rep.stats;
+    if (out) *out = format_result(ctx, LUA_ERRRUN, why);
+    ctx->co = NULL;
+}
+
+size_t lua_runner_state_output(lua_State *L, char *buf, size_t size, lua_run_stats_t *stats)
+{
+    const capture_ctx_t *ctx = get_capture_ctx(L);
+    if (stats) {
+        run_report_t rep;
+        report_run(ctx, &rep);
+        *stats = rep.stats;
+    }
+    size_t end = capture_len(ctx);
+    size_t pos = end > size - 1 ? end - (size - 1) : 0;
+    size_t n = end - pos;
+
+    /* capture_read() steps on at a chunk boundary: start from the chunk before */
+    const capture_chunk_t *chunk = &ctx->first;
+    for (size_t skip = pos ? (pos - 1) / MIMI_LUA_CAPTURE_CHUNK : 0; skip > 0; skip--) {
+        chunk = chunk->next;
+    }
+    capture_read(ctx, &chunk, &pos, end, buf);
+    buf[n] = '\0';
+    return n;
+}
+
+/* ── Benchmark ────────────────────────────────────────────── */
+
+static const char BENCH_SCRIPT[] =
+    "local t = {}\n"
+    "for i = 1, 64 do t[#t + 1] = i * i end\n"
+    "counter = (counter or 0) + 1\n"
+    "print('n', #t, 'last', t[#t], 'counter', counter)\n";
+
+int64_t lua_runner_time_script(const char *path, const char *prelude, const char *body,
+                               int timeout_ms, char *out, size_t out_size)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fputs(prelude, f);
+    fputs(body, f);
+    fclose(f);
+
+    char *res = NULL;
+    lua_run_stats_t stats = {0};
+    esp_err_t err = lua_runner_exec(path, timeout_ms, &res, &stats);
+    snprintf(out, out_size, "%s", res ? res : "");
+    out[strcspn(out, "\n")] = '\0';
+    if (err != ESP_OK) ESP_LOGW(TAG, "Bench script %s: %s", path, out);
+    free(res);
+    return err == ESP_OK ? (int64_t)stats.duration_us : -1;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void add_latency(cJSON *parent, const char *key, int64_t *lat, int n)
+{
+    qsort(lat, n, sizeof(int64_t), cmp_i64);
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++) sum += lat[i];
+
+    cJSON *o = cJSON_AddObjectToObject(parent, key);
+    cJSON_AddNumberToObject(o, "p50", n ? (double)lat[(n - 1) * 50 / 100] : 0);
+    cJSON_AddNumberToObject(o, "p95", n ? (double)lat[(n - 1) * 95 / 100] : 0);
+    cJSON_AddNumberToObject(o, "max", n ? (double)lat[n - 1] : 0);
+    cJSON_AddNumberToObject(o, "mean", n ? (double)sum / n : 0);
+}
+
+esp_err_t lua_runner_bench(int runs, char **report_json)
+{
+    *report_json = NULL;
+    if (runs < 1 || runs > MIMI_LUA_BENCH_MAX_RUNS) return ESP_ERR_INVALID_ARG;
+    if (!s_pool_started) return ESP_ERR_INVALID_STATE;
+
+    FILE *f = fopen(MIMI_LUA_BENCH_SCRIPT, "w");
+    if (!f) return ESP_FAIL;
+    fwrite(BENCH_SCRIPT, 1, sizeof(BENCH_SCRIPT) - 1, f);
+    fclose(f);
+    lua_cache_invalidate(MIMI_LUA_BENCH_SCRIPT);
+
+    int64_t *cold = calloc(runs, sizeof(int64_t));
+    int64_t *warm = calloc(runs, sizeof(int64_t));
+    if (!cold || !warm) {
+        free(cold);
+        free(warm);
+        remove(MIMI_LUA_BENCH_SCRIPT);
+        return ESP_ERR_NO_MEM;
+    }
+
+    int errors = 0;
+    char *out = NULL;
+    run_report_t rep;
+    lua_cache_stats_t c0, c1;
+    lua_cache_get_stats(&c0);
+    char first_warm[64] = "", last_warm[64] = "";
+
+    for (int i = 0; i < runs; i++) {
+        int64_t t0 = esp_timer_get_time();
+        if (exec_cold(MIMI_LUA_BENCH_SCRIPT, MIMI_LUA_BENCH_TIMEOUT_MS, NULL, &out, &rep, t0) != ESP_OK) {
+            errors++;
+        }
+        cold[i] = esp_timer_get_time() - t0;
+        free(out);
+        out = NULL;
+    }
+
+    for (int i = 0; i < runs; i++) {
+        /* Wait out the previous run's reset; only the run itself is timed */
+        lua_worker_t *w;
+        while (!(w = claim_worker())) vTaskDelay(1);
+
+        int64_t t0 = esp_timer_get_time();
+        if (exec_warm(w, MIMI_LUA_BENCH_SCRIPT, MIMI_LUA_BENCH_TIMEOUT_MS, NULL, &out, &rep) != ESP_OK) {
+            errors++;
+        }
+        warm[i] = esp_timer_get_time() - t0;
+        if (out) {
+            /* Identical output on every run shows globals did not leak */
+            out[strcspn(out, "\n")] = '\0';
+            snprintf(last_warm, sizeof(last_warm), "%s", out);
+            if (i == 0) snprintf(first_warm, sizeof(first_warm), "%s", out);
+        }
+        free(out);
+        out = NULL;
+    }
+    remove(MIMI_LUA_BENCH_SCRIPT);
+    lua_cache_invalidate(MIMI_LUA_BENCH_SCRIPT);
+    lua_cache_get_stats(&c1);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "runs", runs);
+    cJSON_AddNumberToObject(root, "pool_size", MIMI_LUA_POOL_SIZE);
+    cJSON_AddNumberToObject(root, "errors", errors);
+    cJSON_AddBoolToObject(root, "isolated",
+                          runs == 1 || strcmp(first_warm, last_warm) == 0);
+    add_latency(root, "cold_us", cold, runs);
+    add_latency(root, "warm_us", warm, runs);
+    double cold_p50 = (double)cold[(runs - 1) / 2], warm_p50 = (double)warm[(runs - 1) / 2];
+    cJSON_AddNumberToObject(root, "speedup_p50", warm_p50 > 0 ? cold_p50 / warm_p50 : 0);
+
+    /* First run compiles, every later one should load the cached chunk */
+    uint32_t hits = c1.hits - c0.hits;
+    cJSON *cache = cJSON_AddObjectToObject(root, "bytecode_cache");
+    cJSON_AddNumberToObject(cache, "hits", hits);
+    cJSON_AddNumberToObject(cache, "misses", c1.misses - c0.misses);
+    cJSON_AddNumberToObject(cache, "compile_us", rep.load.compile_us);
+    cJSON_AddNumberToObject(cache, "saved_us_per_hit",
+                            hits ? (double)(c1.saved_us - c0.saved_us) / hits : 0);
+    free(cold);
+    free(warm);
+
+    *report_json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!*report_json) return ESP_ERR_NO_MEM;
+    ESP_LOGI(TAG, "Bench: %s", *report_json);
+    return ESP_OK;
 }
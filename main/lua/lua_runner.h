@@ -2,19 +2,171 @@
 
 #include "esp_err.h"
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "lua.h"
+
+/*
+ * Lua script runner.
+ *
+ * Scripts normally run warm: MIMI_LUA_POOL_SIZE persistent worker tasks
+ * (fixed MIMI_LUA_WORKER_STACK stacks) each own a lua_State, heap allocated
+ * from PSRAM, with the standard and hardware libraries already open and
+ * print() redirected to a capture list of PSRAM chunks (MIMI_LUA_CAPTURE_MAX
+ * bytes per run; output past it is dropped and a marker says how much). After every run the worker puts
+ * the state back to a snapshot taken right after setup: globals, library
+ * tables, package.loaded and the string metatable are restored, so nothing
+ * a script defines is visible to the next one. When every worker is busy
+ * the script runs cold on a throwaway state and task instead.
+ *
+ * Every run is sandboxed: a count hook enforces the timeout and a budget of
+ * MIMI_LUA_INSTR_BUDGET VM instructions, and the state's allocator refuses
+ * to grow past MIMI_LUA_MEM_CAP bytes. A tripped limit unwinds the script
+ * with a Lua error that pcall, xpcall and coroutine.resume re-raise, so it
+ * cannot be swallowed. Resources a C binding registers with
+ * lua_runner_track() are released when the run fails or is stopped.
+ */
+
+/** Accounting of one run, returned to the caller. */
+typedef struct {
+    uint64_t    instructions;   /* VM instructions, counted in MIMI_LUA_HOOK_COUNT steps */
+    uint32_t    peak_bytes;     /* high-water mark of the state's heap during the run */
+    uint32_t    duration_us;    /* script run, without cold state setup */
+    const char *limit;          /* NULL, or "time" / "instructions" / "memory" */
+} lua_run_stats_t;
+
+typedef void (*lua_release_fn_t)(void *arg);
+
+/** Start the warm pool. Without it every script runs cold. */
+esp_err_t lua_runner_init(void);
 
 /**
  * Execute a Lua script from SPIFFS.
  *
- * Creates a fresh lua_State per invocation (heap allocated from PSRAM),
- * opens standard + hardware libraries, redirects print() to a capture
- * buffer, and runs the file at @p script_path.
- *
  * @param script_path  Absolute path, e.g. "/spiffs/scripts/blink.lua"
- * @param timeout_ms   Maximum execution time (enforced via FreeRTOS watchdog)
+ * @param timeout_ms   Maximum execution time. A count hook raises an error
+ *                     in the script once it is exceeded; a script still
+ *                     running MIMI_LUA_KILL_GRACE_MS later (blocked in C) is
+ *                     deleted (a warm worker is then respawned).
  * @param out_buf      On return, heap-allocated string with captured output
  *                     (caller must free).  On error contains the error message.
- * @return ESP_OK on success, ESP_FAIL on Lua error
+ * @param stats        Optional; instructions, peak heap, duration, limit hit
+ * @return ESP_OK on success, ESP_FAIL on Lua error or timeout
  */
 esp_err_t lua_runner_exec(const char *script_path, int timeout_ms,
-                          char **out_buf);
+                          char **out_buf, lua_run_stats_t *stats);
+
+/**
+ * Output a script printed since the previous call, passed on the task that
+ * called lua_runner_exec_stream(); text is NUL-terminated and only valid
+ * during the call.
+ */
+typedef void (*lua_output_fn_t)(const char *text, size_t len, void *arg);
+
+/**
+ * lua_runner_exec(), calling on_output with new output every
+ * MIMI_LUA_STREAM_INTERVAL_MS while the script runs, and once more with the
+ * rest when it ends if anything was streamed. Scripts that finish within
+ * one interval stream nothing. out_buf still gets the whole output.
+ */
+esp_err_t lua_runner_exec_stream(const char *script_path, int timeout_ms,
+                                 lua_output_fn_t on_output, void *arg,
+                                 char **out_buf, lua_run_stats_t *stats);
+
+/**
+ * For C bindings: call fn(arg) when the running script ends in an error,
+ * hits a limit or is killed. A run that succeeds keeps what it set up.
+ * Returns false when MIMI_LUA_MAX_RELEASES are already tracked.
+ */
+bool lua_runner_track(lua_State *L, lua_release_fn_t fn, void *arg);
+
+/** The script released the resource itself. */
+void lua_runner_untrack(lua_State *L, lua_release_fn_t fn, void *arg);
+
+/**
+ * lua_runner_track(), but fn(arg) also runs when the script succeeds: for
+ * what must never outlive the run (an edge subscription, say). Untracked
+ * the same way.
+ */
+bool lua_runner_defer(lua_State *L, lua_release_fn_t fn, void *arg);
+
+/** For C bindings: append to the run's output as print() does, without the newline. */
+void lua_runner_write_output(lua_State *L, const char *s, size_t n);
+
+/** Block the script for ms, or raise its timeout if the deadline comes first. */
+void lua_runner_sleep(lua_State *L, uint32_t ms);
+
+/** True when L is a sliced run's coroutine that may yield here (see lua_runner_pause). */
+bool lua_runner_can_pause(lua_State *L);
+
+/**
+ * For C bindings that wait: in a sliced run, yield to lua_sched for ms and
+ * continue in k (NULL: return to the script with no results); otherwise
+ * lua_runner_sleep() for ms, then call k. Use as `return lua_runner_pause(...)`.
+ */
+int lua_runner_pause(lua_State *L, uint32_t ms, lua_KContext kctx, lua_KFunction k);
+
+/*
+ * Hosted states, for long-lived scripts (lua_daemon): a sandboxed state
+ * like a pool worker's, with no snapshot reset, owned by the caller's task.
+ */
+lua_State *lua_runner_state_new(void);
+void lua_runner_state_close(lua_State *L);
+
+/**
+ * Call the function below nargs arguments on L's stack under the sandbox
+ * limits, discarding results. *out (may be NULL) gets the output printed
+ * during the call plus any error, heap allocated, or NULL when there was
+ * neither. Returns the Lua status.
+ */
+int lua_runner_state_call(lua_State *L, int nargs, int timeout_ms,
+                          char **out, lua_run_stats_t *stats);
+
+/*
+ * Sliced runs, for lua_sched: the script at path becomes a coroutine of
+ * hosted state L, resumed a slice at a time under one set of sandbox
+ * limits; its timeout counts from the load.
+ */
+
+/** Load path as L's sliced run. On failure *err gets the message, heap allocated. */
+int lua_runner_state_load(lua_State *L, const char *path, int timeout_ms, char **err);
+
+/**
+ * Run the script for up to slice instructions. LUA_YIELD while it is
+ * unfinished, *wake_us then being when it wants to run again (0: at once).
+ * Otherwise the run ended: its status, with *out (output plus any error or
+ * limit, heap allocated) and stats as lua_runner_state_call() gives them.
+ */
+int lua_runner_state_resume(lua_State *L, uint32_t slice, int64_t *wake_us,
+                            char **out, lua_run_stats_t *stats);
+
+/** End an unfinished sliced run as failed with reason why; releases fire. */
+void lua_runner_state_stop(lua_State *L, const char *why, char **out, lua_run_stats_t *stats);
+
+/**
+ * Settle a sliced run whose task was deleted in the middle of a slice, as
+ * lua_runner_state_stop() does; the coroutine is left for
+ * lua_runner_state_close().
+ */
+void lua_runner_state_abandon(lua_State *L, const char *why, char **out, lua_run_stats_t *stats);
+
+/** Up to size - 1 of the last bytes the run printed so far; stats (may be NULL) so far. */
+size_t lua_runner_state_output(lua_State *L, char *buf, size_t size, lua_run_stats_t *stats);
+
+/**
+ * Run a short command-style script `runs` times cold, then `runs` times on
+ * the warm pool, and report latency percentiles (microseconds) for both.
+ * "isolated" is true when no warm run saw a global left by the one before.
+ *
+ * @param runs         1..MIMI_LUA_BENCH_MAX_RUNS
+ * @param report_json  out: single-line JSON report, caller frees
+ */
+esp_err_t lua_runner_bench(int runs, char **report_json);
+
+/**
+ * For library benchmarks: write prelude then body to path, run it with
+ * lua_runner_exec() and return the run's duration_us, or -1 when it failed.
+ * out gets the first line of its output (or of the error).
+ */
+int64_t lua_runner_time_script(const char *path, const char *prelude, const char *body,
+                               int timeout_ms, char *out, size_t out_size);
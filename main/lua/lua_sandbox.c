@@ -0,0 +1,67 @@
+#include "lua/lua_sandbox.h"
+
+#include <stddef.h>
+
+#include "lua.h"
+#include "lualib.h"
+#include "lauxlib.h"
+
+/* load / loadfile with the mode argument forced to "t"; upvalue 1 is the
+ * original function, upvalue 2 the position of its mode argument */
+static int l_load_text(lua_State *L)
+{
+    int mode_arg = (int)lua_tointeger(L, lua_upvalueindex(2));
+    if (lua_gettop(L) < mode_arg) {
+        lua_settop(L, mode_arg);    /* env, after mode, stays absent */
+    }
+    lua_pushliteral(L, "t");
+    lua_replace(L, mode_arg);
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+static int dofile_cont(lua_State *L, int status, lua_KContext kctx)
+{
+    (void)status;
+    (void)kctx;
+    return lua_gettop(L) - 1;
+}
+
+/* dofile([filename]) as in lbaselib, text chunks only */
+static int l_dofile_text(lua_State *L)
+{
+    const char *fname = luaL_optstring(L, 1, NULL);
+    lua_settop(L, 1);
+    if (luaL_loadfilex(L, fname, "t") != LUA_OK) {
+        return lua_error(L);
+    }
+    lua_callk(L, 0, LUA_MULTRET, 0, dofile_cont);
+    return dofile_cont(L, LUA_OK, 0);
+}
+
+static void wrap_load(lua_State *L, const char *name, int mode_arg)
+{
+    lua_getglobal(L, name);
+    lua_pushinteger(L, mode_arg);
+    lua_pushcclosure(L, l_load_text, 2);
+    lua_setglobal(L, name);
+}
+
+void lua_sandbox_open_libs(lua_State *L)
+{
+    luaL_openlibs(L);
+
+    lua_pushnil(L);
+    lua_setglobal(L, LUA_DBLIBNAME);
+    luaL_getsubtable(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
+    lua_pushnil(L);
+    lua_setfield(L, -2, LUA_DBLIBNAME);
+    lua_pop(L, 1);
+
+    wrap_load(L, "load", 3);
+    wrap_load(L, "loadfile", 2);
+    lua_pushcfunction(L, l_dofile_text);
+    lua_setglobal(L, "dofile");
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "lua.h"
+
+/*
+ * Standard libraries for an untrusted script: luaL_openlibs() minus what
+ * reaches past the sandbox.
+ *
+ *   debug                  removed (also from package.loaded), so a script
+ *                          cannot replace the count hook with debug.sethook
+ *                          or reach the registry and other metatables
+ *   load, loadfile, dofile text chunks only, whatever mode is asked for;
+ *                          malformed bytecode never reaches the VM
+ *
+ * string.dump stays: it only writes bytecode, nothing can load it back.
+ */
+void lua_sandbox_open_libs(lua_State *L);
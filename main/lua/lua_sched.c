@@ -0,0 +1,519 @@
+#include "lua/lua_sched.h"
+#include "lua/lua_runner.h"
+#include "metrics/metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "lua.h"
+
+static const char *TAG = "lua_sched";
+
+/* ── Types ────────────────────────────────────────────────── */
+
+typedef enum {
+    SCRIPT_FREE = 0,
+    SCRIPT_READY,
+    SCRIPT_SLEEPING,
+    SCRIPT_DONE,
+    SCRIPT_FAILED,
+    SCRIPT_KILLED,
+} script_status_t;
+
+static const char *s_status_names[] = { "free", "ready", "sleeping", "done", "failed", "killed" };
+
+typedef struct {
+    script_status_t status;
+    int             id;
+    char            path[128];
+    lua_State      *L;          /* NULL once ended */
+    int64_t         started_us;
+    int64_t         ended_us;
+    int64_t         wake_us;    /* SCRIPT_SLEEPING */
+    int64_t         run_us;
+    uint32_t        slices;
+    lua_run_stats_t stats;      /* final, once ended */
+    char            tail[MIMI_LUA_SCHED_TAIL];
+} script_t;
+
+typedef enum { CMD_SPAWN = 0, CMD_KILL, CMD_LIST } cmd_kind_t;
+
+/*
+ * A request from another task, run on the scheduler task between slices.
+ * Heap allocated: a caller that gives up waiting marks it abandoned and
+ * the task frees it.
+ */
+typedef struct {
+    cmd_kind_t        kind;
+    char              path[128];
+    int               timeout_ms;
+    int               id;
+    esp_err_t         result;
+    char              error[128];
+    int               count;
+    lua_sched_info_t  list[MIMI_LUA_SCHED_MAX];
+    SemaphoreHandle_t done;
+    bool              abandoned;
+} sched_cmd_t;
+
+static script_t *s_scripts = NULL;      /* MIMI_LUA_SCHED_MAX, in PSRAM */
+static int s_next_id = 1;
+static QueueHandle_t s_queue = NULL;
+static portMUX_TYPE s_cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Watchdog view of the slice in progress, under s_cmd_lock */
+static TaskHandle_t s_task = NULL;
+static script_t *s_slice_script = NULL;
+static int64_t s_slice_start_us = 0;
+static script_t *s_stuck = NULL;        /* killed mid-slice, settled by the next task */
+
+static metric_t *s_m_running;
+static metric_t *s_m_slices;
+static metric_t *s_m_ended[3];          /* done, failed, killed */
+static metric_t *s_m_restarts;
+
+static void register_metrics(void)
+{
+    s_m_running = metrics_gauge("mimi_lua_sched_scripts", "Background Lua scripts running", NULL);
+    s_m_slices = metrics_counter("mimi_lua_sched_slices_total",
+                                 "Instruction slices run for background Lua scripts", NULL);
+    s_m_ended[0] = metrics_counter("mimi_lua_sched_ended_total",
+                                   "Background Lua scripts ended", "status=\"done\"");
+    s_m_ended[1] = metrics_counter("mimi_lua_sched_ended_total",
+                                   "Background Lua scripts ended", "status=\"failed\"");
+    s_m_ended[2] = metrics_counter("mimi_lua_sched_ended_total",
+                                   "Background Lua scripts ended", "status=\"killed\"");
+    s_m_restarts = metrics_counter("mimi_lua_sched_restarts_total",
+                                   "Scheduler tasks deleted over a stuck slice", NULL);
+}
+
+/* ── Helpers ──────────────────────────────────────────────── */
+
+static bool is_running(const script_t *s)
+{
+    return s->status == SCRIPT_READY || s->status == SCRIPT_SLEEPING;
+}
+
+static int running_count(void)
+{
+    int n = 0;
+    for (int i = 0; i < MIMI_LUA_SCHED_MAX; i++) n += is_running(&s_scripts[i]);
+    return n;
+}
+
+static script_t *find_script(int id)
+{
+    for (int i = 0; i < MIMI_LUA_SCHED_MAX; i++) {
+        if (s_scripts[i].status != SCRIPT_FREE && s_scripts[i].id == id) return &s_scripts[i];
+    }
+    return NULL;
+}
+
+/* A free slot, else the one that ended longest ago */
+static script_t *take_slot(void)
+{
+    script_t *oldest = NULL;
+    for (int i = 0; i < MIMI_LUA_SCHED_MAX; i++) {
+        script_t *s = &s_scripts[i];
+        if (s->status == SCRIPT_FREE) return s;
+        if (!is_running(s) && (!oldest || s->ended_us < oldest->ended_us)) oldest = s;
+    }
+    return oldest;
+}
+
+/* Keep the last bytes of text for script_ps */
+static void keep_tail(script_t *s, const char *text)
+{
+    size_t len = text ? strlen(text) : 0;
+    size_t from = len > sizeof(s->tail) - 1 ? len - (sizeof(s->tail) - 1) : 0;
+    memcpy(s->tail, text ? text + from : "", len - from);
+    s->tail[len - from] = '\0';
+}
+
+/* ── Lifecycle (scheduler task only) ──────────────────────── */
+
+/* Settle a script that ended with status; out is its full result */
+static void end_script(script_t *s, script_status_t status, char *out, const lua_run_stats_t *stats)
+{
+    s->status = status;
+    s->stats = *stats;
+    s->ended_us = esp_timer_get_time();
+    keep_tail(s, out);
+    free(out);
+    lua_runner_state_close(s->L);
+    s->L = NULL;
+
+    metric_inc(s_m_ended[status - SCRIPT_DONE]);
+    metric_set(s_m_running, running_count());
+    ESP_LOGI(TAG, "#%d %s %s after %u slices, %llu instructions%s%s", s->id, s->path,
+             s_status_names[status], (unsigned)s->slices,
+             (unsigned long long)stats->instructions,
+             stats->limit ? ", limit: " : "", stats->limit ? stats->limit : "");
+}
+
+static esp_err_t spawn_script(const char *path, int timeout_ms, int *id,
+                              char *err, size_t err_size)
+{
+    script_t *s = take_slot();
+    if (!s) {
+        snprintf(err, err_size, "all %d background script slots are running", MIMI_LUA_SCHED_MAX);
+        return ESP_ERR_NO_MEM;
+    }
+
+    lua_State *L = lua_runner_state_new();
+    if (!L) {
+        snprintf(err, err_size, "out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+    char *load_err = NULL;
+    if (lua_runner_state_load(L, path, timeout_ms, &load_err) != LUA_OK) {
+        snprintf(err, err_size, "%s", load_err ? load_err : "load failed");
+        free(load_err);
+        lua_runner_state_close(L);
+        return ESP_FAIL;
+    }
+
+    memset(s, 0, sizeof(*s));
+    s->status = SCRIPT_READY;
+    s->id = s_next_id++;
+    s->L = L;
+    s->started_us = esp_timer_get_time();
+    strncpy(s->path, path, sizeof(s->path) - 1);
+    *id = s->id;
+
+    metric_set(s_m_running, running_count());
+    ESP_LOGI(TAG, "#%d %s started (limit %d ms)", s->id, s->path, timeout_ms);
+    return ESP_OK;
+}
+
+static void fill_info(script_t *s, lua_sched_info_t *info)
+{
+    memset(info, 0, sizeof(*info));
+    lua_run_stats_t stats = s->stats;
+    if (s->L) {
+        lua_runner_state_output(s->L, info->output, sizeof(info->output), &stats);
+    } else {
+        memcpy(info->output, s->tail, sizeof(info->output));
+    }
+    int64_t until = s->L ? esp_timer_get_time() : s->ended_us;
+
+    info->id = s->id;
+    strncpy(info->path, s->path, sizeof(info->path) - 1);
+    strncpy(info->status, s_status_names[s->status], sizeof(info->status) - 1);
+    info->uptime_ms = (uint32_t)((until - s->started_us) / 1000);
+    info->run_ms = (uint32_t)(s->run_us / 1000);
+    info->slices = s->slices;
+    info->instructions = stats.instructions;
+    info->peak_bytes = stats.peak_bytes;
+    if (stats.limit && !s->L) strncpy(info->limit, stats.limit, sizeof(info->limit) - 1);
+}
+
+static void run_command(sched_cmd_t *cmd)
+{
+    cmd->result = ESP_OK;
+    switch (cmd->kind) {
+    case CMD_SPAWN:
+        cmd->result = spawn_script(cmd->path, cmd->timeout_ms, &cmd->id,
+                                   cmd->error, sizeof(cmd->error));
+        break;
+    case CMD_KILL: {
+        script_t *s = find_script(cmd->id);
+        if (!s) {
+            cmd->result = ESP_ERR_NOT_FOUND;
+        } else if (!is_running(s)) {
+            cmd->result = ESP_ERR_INVALID_STATE;
+        } else {
+            char *out = NULL;
+            lua_run_stats_t stats;
+            lua_runner_state_stop(s->L, "killed by script_kill", &out, &stats);
+            end_script(s, SCRIPT_KILLED, out, &stats);
+        }
+        break;
+    }
+    case CMD_LIST:
+        /* Oldest first: ids only grow */
+        cmd->count = 0;
+        for (int next = 0;;) {
+            script_t *pick = NULL;
+            for (int i = 0; i < MIMI_LUA_SCHED_MAX; i++) {
+                script_t *s = &s_scripts[i];
+                if (s->status != SCRIPT_FREE && s->id > next && (!pick || s->id < pick->id)) pick = s;
+            }
+            if (!pick) break;
+            fill_info(pick, &cmd->list[cmd->count++]);
+            next = pick->id;
+        }
+        break;
+    }
+
+    portENTER_CRITICAL(&s_cmd_lock);
+    bool abandoned = cmd->abandoned;
+    portEXIT_CRITICAL(&s_cmd_lock);
+    if (abandoned) {
+        vSemaphoreDelete(cmd->done);
+        free(cmd);
+    } else {
+        xSemaphoreGive(cmd->done);
+    }
+}
+
+/* ── Scheduler ────────────────────────────────────────────── */
+
+static void run_slice(script_t *s)
+{
+    int64_t wake_us = 0;
+    char *out = NULL;
+    lua_run_stats_t stats;
+    int64_t start = esp_timer_get_time();
+    portENTER_CRITICAL(&s_cmd_lock);
+    s_slice_script = s;
+    s_slice_start_us = start;
+    portEXIT_CRITICAL(&s_cmd_lock);
+
+    int rc = lua_runner_state_resume(s->L, MIMI_LUA_SCHED_SLICE, &wake_us, &out, &stats);
+
+    portENTER_CRITICAL(&s_cmd_lock);
+    s_slice_script = NULL;
+    portEXIT_CRITICAL(&s_cmd_lock);
+    int64_t now = esp_timer_get_time();
+    s->run_us += now - start;
+    s->slices++;
+    metric_inc(s_m_slices);
+
+    if (rc == LUA_YIELD) {
+        s->wake_us = wake_us;
+        s->status = wake_us > now ? SCRIPT_SLEEPING : SCRIPT_READY;
+        return;
+    }
+    end_script(s, rc == LUA_OK ? SCRIPT_DONE : SCRIPT_FAILED, out, &stats);
+}
+
+/* One slice for every script that can run, in slot order */
+static void run_round(void)
+{
+    for (int i = 0; i < MIMI_LUA_SCHED_MAX; i++) {
+        script_t *s = &s_scripts[i];
+        if (s->status == SCRIPT_SLEEPING && s->wake_us <= esp_timer_get_time()) {
+            s->status = SCRIPT_READY;
+        }
+        if (s->status == SCRIPT_READY) run_slice(s);
+    }
+}
+
+static TickType_t ticks_to_next_wake(void)
+{
+    int64_t next = INT64_MAX;
+    for (int i = 0; i < MIMI_LUA_SCHED_MAX; i++) {
+        const script_t *s = &s_scripts[i];
+        if (s->status == SCRIPT_READY) return 0;
+        if (s->status == SCRIPT_SLEEPING && s->wake_us < next) next = s->wake_us;
+    }
+    if (next == INT64_MAX) return portMAX_DELAY;
+    int64_t wait_us = next - esp_timer_get_time();
+    if (wait_us <= 0) return 0;
+    /* Round up so the wakeup is not a tick early */
+    return pdMS_TO_TICKS((wait_us + 999) / 1000) + 1;
+}
+
+/* End the script whose slice the watchdog killed along with the last task */
+static void settle_stuck(void)
+{
+    script_t *s = s_stuck;
+    s_stuck = NULL;
+    char *out = NULL;
+    lua_run_stats_t stats;
+    char why[64];
+    snprintf(why, sizeof(why), "stuck in one slice for over %d ms, killed",
+             MIMI_LUA_SCHED_SLICE_MAX_MS);
+    lua_runner_state_abandon(s->L, why, &out, &stats);
+    s->run_us += esp_timer_get_time() - s_slice_start_us;
+    s->slices++;
+    end_script(s, SCRIPT_KILLED, out, &stats);
+}
+
+static void sched_task(void *arg)
+{
+    (void)arg;
+    int64_t busy_since = 0;     /* start of the current run of rounds without a wait */
+    if (s_stuck) settle_stuck();
+
+    while (1) {
+        sched_cmd_t *cmd;
+        TickType_t wait = ticks_to_next_wake();
+        if (wait > 0) busy_since = 0;
+        if (xQueueReceive(s_queue, &cmd, wait) == pdTRUE) {
+            run_command(cmd);
+        }
+        run_round();
+
+        /* Scripts that never sleep would keep IDLE (and its watchdog) off this core */
+        int64_t now = esp_timer_get_time();
+        if (!busy_since) {
+            busy_since = now;
+        } else if (now - busy_since > (int64_t)MIMI_LUA_SCHED_BUSY_MS * 1000) {
+            vTaskDelay(1);
+            busy_since = esp_timer_get_time();
+        }
+    }
+}
+
+static esp_err_t start_sched_task(void)
+{
+    if (xTaskCreatePinnedToCore(sched_task, "lua_sched", MIMI_LUA_SCHED_STACK, NULL,
+                                MIMI_LUA_SCHED_PRIO, &s_task, tskNO_AFFINITY) != pdPASS) {
+        s_task = NULL;
+        ESP_LOGE(TAG, "Failed to create scheduler task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/*
+ * The hook only preempts Lua code: a slice blocked in a C call holds up
+ * every script and every command. Past MIMI_LUA_SCHED_SLICE_MAX_MS the
+ * scheduler task is deleted, as pool workers are, and a new one ends the
+ * stuck script before resuming the others.
+ */
+static void watchdog_task(void *arg)
+{
+    (void)arg;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(MIMI_LUA_SCHED_WD_MS));
+
+        portENTER_CRITICAL(&s_cmd_lock);
+        script_t *s = s_slice_script;
+        int64_t since = s_slice_start_us;
+        portEXIT_CRITICAL(&s_cmd_lock);
+        if (!s || esp_timer_get_time() - since < (int64_t)MIMI_LUA_SCHED_SLICE_MAX_MS * 1000) {
+            continue;
+        }
+
+        /* Suspended, the task cannot finish the slice behind our back */
+        vTaskSuspend(s_task);
+        portENTER_CRITICAL(&s_cmd_lock);
+        bool still = s_slice_script == s && s_slice_start_us == since;
+        if (still) s_slice_script = NULL;
+        portEXIT_CRITICAL(&s_cmd_lock);
+        if (!still) {
+            vTaskResume(s_task);
+            continue;
+        }
+
+        ESP_LOGW(TAG, "#%d %s stuck in a slice past %d ms, restarting the scheduler",
+                 s->id, s->path, MIMI_LUA_SCHED_SLICE_MAX_MS);
+        vTaskDelete(s_task);
+        s_stuck = s;
+        metric_inc(s_m_restarts);
+        start_sched_task();
+    }
+}
+
+/* ── Public API ───────────────────────────────────────────── */
+
+esp_err_t lua_sched_init(void)
+{
+    if (s_queue) return ESP_OK;
+    s_scripts = heap_caps_calloc(MIMI_LUA_SCHED_MAX, sizeof(script_t), MALLOC_CAP_SPIRAM);
+    if (!s_scripts) return ESP_ERR_NO_MEM;
+    register_metrics();
+    s_queue = xQueueCreate(MIMI_LUA_SCHED_QUEUE_LEN, sizeof(sched_cmd_t *));
+    if (!s_queue) return ESP_ERR_NO_MEM;
+
+    if (start_sched_task() != ESP_OK) return ESP_FAIL;
+    if (xTaskCreatePinnedToCore(watchdog_task, "lua_sched_wd", MIMI_LUA_SCHED_WD_STACK, NULL,
+                                MIMI_LUA_SCHED_WD_PRIO, NULL, tskNO_AFFINITY) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create scheduler watchdog");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/* Hand cmd to the scheduler task and wait; false when it did not answer in time */
+static bool send_command(sched_cmd_t *cmd)
+{
+    cmd->done = xSemaphoreCreateBinary();
+    if (!cmd->done) return false;
+    if (xQueueSend(s_queue, &cmd, pdMS_TO_TICKS(MIMI_LUA_SCHED_CMD_WAIT_MS)) != pdTRUE) {
+        vSemaphoreDelete(cmd->done);
+        return false;
+    }
+    if (xSemaphoreTake(cmd->done, pdMS_TO_TICKS(MIMI_LUA_SCHED_CMD_WAIT_MS)) == pdTRUE) {
+        vSemaphoreDelete(cmd->done);
+        return true;
+    }
+
+    /* Still running (or about to give): the task frees it once abandoned */
+    portENTER_CRITICAL(&s_cmd_lock);
+    cmd->abandoned = true;
+    portEXIT_CRITICAL(&s_cmd_lock);
+    if (xSemaphoreTake(cmd->done, 0) == pdTRUE) {
+        vSemaphoreDelete(cmd->done);
+        return true;
+    }
+    return false;
+}
+
+esp_err_t lua_sched_spawn(const char *path, int timeout_ms, int *id,
+                          char *err, size_t err_size)
+{
+    if (!s_queue) return ESP_ERR_INVALID_STATE;
+    if (!path || !id || strlen(path) >= 128) {
+        snprintf(err, err_size, "path (< 128 chars) required");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timeout_ms <= 0 || timeout_ms > MIMI_LUA_SCHED_MAX_TIMEOUT_MS) {
+        snprintf(err, err_size, "timeout_ms must be 1..%d", MIMI_LUA_SCHED_MAX_TIMEOUT_MS);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sched_cmd_t *cmd = calloc(1, sizeof(sched_cmd_t));
+    if (!cmd) return ESP_ERR_NO_MEM;
+    cmd->kind = CMD_SPAWN;
+    cmd->timeout_ms = timeout_ms;
+    strncpy(cmd->path, path, sizeof(cmd->path) - 1);
+
+    if (!send_command(cmd)) {
+        snprintf(err, err_size, "scheduler task did not answer");
+        return ESP_ERR_TIMEOUT;     /* cmd is the task's to free now */
+    }
+    esp_err_t ret = cmd->result;
+    *id = cmd->id;
+    snprintf(err, err_size, "%s", cmd->error);
+    free(cmd);
+    return ret;
+}
+
+esp_err_t lua_sched_kill(int id)
+{
+    if (!s_queue) return ESP_ERR_INVALID_STATE;
+    sched_cmd_t *cmd = calloc(1, sizeof(sched_cmd_t));
+    if (!cmd) return ESP_ERR_NO_MEM;
+    cmd->kind = CMD_KILL;
+    cmd->id = id;
+    if (!send_command(cmd)) return ESP_ERR_TIMEOUT;
+    esp_err_t ret = cmd->result;
+    free(cmd);
+    return ret;
+}
+
+int lua_sched_list(lua_sched_info_t *out, int max)
+{
+    if (!s_queue) return 0;
+    sched_cmd_t *cmd = calloc(1, sizeof(sched_cmd_t));
+    if (!cmd) return 0;
+    cmd->kind = CMD_LIST;
+    if (!send_command(cmd)) return 0;
+    int n = cmd->count < max ? cmd->count : max;
+    memcpy(out, cmd->list, n * sizeof(lua_sched_info_t));
+    free(cmd);
+    return n;
+}
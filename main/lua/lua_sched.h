@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mimi_config.h"
+
+/*
+ * Background scripts: script_run with "background": true.
+ *
+ * All of them share one "lua_sched" task. Each script gets its own
+ * sandboxed lua_State (lua_runner_state_new) and runs as a coroutine of
+ * it (lua_runner_state_load), resumed round-robin for
+ * MIMI_LUA_SCHED_SLICE VM instructions at a time. sleep.ms() and
+ * gpio.wait_edge() yield instead of blocking, so a sleeping script costs
+ * no CPU and no task stack. C calls that block (camera capture, say) still
+ * hold up every background script until they return. So does work inside
+ * a coroutine the script resumes itself: only the script's own coroutine
+ * is preempted, and sleep.ms() blocks there. A slice still running after
+ * MIMI_LUA_SCHED_SLICE_MAX_MS is killed by the "lua_sched_wd" watchdog,
+ * which deletes the task and starts a new one; that script ends "killed".
+ *
+ * Each script keeps the sandbox limits of a foreground run: timeout_ms
+ * (default MIMI_LUA_SCHED_TIMEOUT_MS) counts from the spawn, sleeping
+ * included. Finished scripts stay listed, with their output tail, until
+ * their slot is needed again. Nothing is restored at boot (see lua_daemon).
+ */
+
+typedef struct {
+    int      id;
+    char     path[128];
+    char     status[12];        /* ready, sleeping, done, failed, killed */
+    uint32_t uptime_ms;         /* since the spawn, or until the end */
+    uint32_t run_ms;            /* spent in slices */
+    uint32_t slices;
+    uint64_t instructions;
+    uint32_t peak_bytes;
+    char     limit[16];         /* sandbox limit that ended it, if any */
+    char     output[MIMI_LUA_SCHED_TAIL];   /* last output, error included */
+} lua_sched_info_t;
+
+/** Start the scheduler task. */
+esp_err_t lua_sched_init(void);
+
+/**
+ * Load the script at path and queue it. *id identifies it to
+ * lua_sched_kill(); on failure err gets the reason (load error, no slot).
+ */
+esp_err_t lua_sched_spawn(const char *path, int timeout_ms, int *id,
+                          char *err, size_t err_size);
+
+/**
+ * Stop a running script; its resource releases fire as on a failed run.
+ * ESP_ERR_NOT_FOUND for an unknown id, ESP_ERR_INVALID_STATE once it ended.
+ */
+esp_err_t lua_sched_kill(int id);
+
+/** Fill up to max entries (MIMI_LUA_SCHED_MAX suffices), oldest first; returns the count. */
+int lua_sched_list(lua_sched_info_t *out, int max);
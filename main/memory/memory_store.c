@@ -1,11 +1,13 @@
 #include "memory_store.h"
 #include "mimi_config.h"
+#include "metrics/metrics.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include <sys/stat.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 
 static const char *TAG = "memory";
 
@@ -29,6 +31,7 @@ esp_err_t memory_store_init(void)
 
 esp_err_t memory_read_long_term(char *buf, size_t size)
 {
+    int64_t start_us = esp_timer_get_time();
     FILE *f = fopen(MIMI_MEMORY_FILE, "r");
     if (!f) {
         buf[0] = '\0';
@@ -38,11 +41,13 @@ esp_err_t memory_read_long_term(char *buf, size_t size)
     size_t n = fread(buf, 1, size - 1, f);
     buf[n] = '\0';
     fclose(f);
+    metrics_spiffs_io(false, n, start_us);
     return ESP_OK;
 }
 
 esp_err_t memory_write_long_term(const char *content)
 {
+    int64_t start_us = esp_timer_get_time();
     FILE *f = fopen(MIMI_MEMORY_FILE, "w");
     if (!f) {
         ESP_LOGE(TAG, "Cannot write %s", MIMI_MEMORY_FILE);
@@ -50,6 +55,7 @@ esp_err_t memory_write_long_term(const char *content)
     }
     fputs(content, f);
     fclose(f);
+    metrics_spiffs_io(true, strlen(content), start_us);
     ESP_LOGI(TAG, "Long-term memory updated (%d bytes)", (int)strlen(content));
     return ESP_OK;
 }
@@ -62,6 +68,7 @@ esp_err_t memory_append_today(const char *note)
     char path[64];
     snprintf(path, sizeof(path), "%s/%s.md", MIMI_SPIFFS_MEMORY_DIR, date_str);
 
+    int64_t start_us = esp_timer_get_time();
     FILE *f = fopen(path, "a");
     if (!f) {
         /* Try creating — if file doesn't exist yet, write header */
@@ -75,6 +82,7 @@ esp_err_t memory_append_today(const char *note)
 
     fprintf(f, "%s\n", note);
     fclose(f);
+    metrics_spiffs_io(true, strlen(note) + 1, start_us);
     return ESP_OK;
 }
 
@@ -90,6 +98,7 @@ esp_err_t memory_read_recent(char *buf, size_t size, int days)
         char path[64];
         snprintf(path, sizeof(path), "%s/%s.md", MIMI_SPIFFS_MEMORY_DIR, date_str);
 
+        int64_t start_us = esp_timer_get_time();
         FILE *f = fopen(path, "r");
         if (!f) continue;
 
@@ -101,6 +110,7 @@ esp_err_t memory_read_recent(char *buf, size_t size, int days)
         offset += n;
         buf[offset] = '\0';
         fclose(f);
+        metrics_spiffs_io(false, n, start_us);
     }
 
     return ESP_OK;
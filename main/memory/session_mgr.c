@@ -1,5 +1,6 @@
 #include "session_mgr.h"
 #include "mimi_config.h"
+#include "metrics/metrics.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 #include <dirent.h>
 #include <time.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "cJSON.h"
 
 static const char *TAG = "session";
@@ -27,6 +29,7 @@ esp_err_t session_append(const char *chat_id, const char *role, const char *cont
     char path[64];
     session_path(chat_id, path, sizeof(path));
 
+    int64_t start_us = esp_timer_get_time();
     FILE *f = fopen(path, "a");
     if (!f) {
         ESP_LOGE(TAG, "Cannot open session file %s", path);
@@ -41,12 +44,15 @@ esp_err_t session_append(const char *chat_id, const char *role, const char *cont
     char *line = cJSON_PrintUnformatted(obj);
     cJSON_Delete(obj);
 
+    size_t written = 0;
     if (line) {
-        fprintf(f, "%s\n", line);
-        free(line);
+        int n = fprintf(f, "%s\n", line);
+        if (n > 0) written = (size_t)n;
+        cJSON_free(line);
     }
 
     fclose(f);
+    metrics_spiffs_io(true, written, start_us);
     return ESP_OK;
 }
 
@@ -55,6 +61,7 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     char path[64];
     session_path(chat_id, path, sizeof(path));
 
+    int64_t start_us = esp_timer_get_time();
     FILE *f = fopen(path, "r");
     if (!f) {
         /* No history yet */
@@ -68,9 +75,11 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     int write_idx = 0;
 
     char line[2048];
+    size_t bytes_read = 0;
     while (fgets(line, sizeof(line), f)) {
         /* Strip newline */
         size_t len = strlen(line);
+        bytes_read += len;
         if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
         if (line[0] == '\0') continue;
 
@@ -86,6 +95,7 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
         if (count < max_msgs) count++;
     }
     fclose(f);
+    metrics_spiffs_io(false, bytes_read, start_us);
 
     /* Build JSON array with only role + content */
     cJSON *arr = cJSON_CreateArray();
@@ -117,7 +127,7 @@ esp_err_t session_get_history_json(const char *chat_id, char *buf, size_t size,
     if (json_str) {
         strncpy(buf, json_str, size - 1);
         buf[size - 1] = '\0';
-        free(json_str);
+        cJSON_free(json_str);
     } else {
         snprintf(buf, size, "[]");
     }
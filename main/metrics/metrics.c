@@ -0,0 +1,359 @@
+#include "metrics.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "metrics";
+
+#define METRICS_MAX_BUCKETS  12
+#define METRICS_LABELS_LEN   48
+
+typedef enum {
+    METRIC_COUNTER = 0,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM,
+} metric_type_t;
+
+struct metric {
+    atomic_bool ready;              /* set last, after the fields below */
+    metric_type_t type;
+    const char *name;
+    const char *help;
+    char labels[METRICS_LABELS_LEN];
+    const uint32_t *bounds;
+    int n_bounds;
+    atomic_int_least32_t value;     /* counter (as unsigned) or gauge */
+    atomic_uint_least32_t buckets[METRICS_MAX_BUCKETS + 1];  /* last = +Inf */
+    atomic_uint_least32_t sum;
+};
+
+const uint32_t METRICS_MS_BUCKETS[] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000,
+};
+const int METRICS_MS_BUCKETS_N = sizeof(METRICS_MS_BUCKETS) / sizeof(METRICS_MS_BUCKETS[0]);
+
+const uint32_t METRICS_BYTES_BUCKETS[] = {
+    256, 1024, 4096, 16384, 65536, 262144,
+};
+const int METRICS_BYTES_BUCKETS_N = sizeof(METRICS_BYTES_BUCKETS) / sizeof(METRICS_BYTES_BUCKETS[0]);
+
+static metric_t s_pool[MIMI_METRICS_MAX];
+static atomic_int s_pool_used = 0;
+static portMUX_TYPE s_register_lock = portMUX_INITIALIZER_UNLOCKED;  /* find + claim */
+
+static void (*s_collectors[MIMI_METRICS_MAX_COLLECTORS])(void);
+static atomic_int s_collector_count = 0;
+
+/* ── Registration ──────────────────────────────────────────── */
+
+static metric_t *metric_find(const char *name, const char *labels)
+{
+    int used = atomic_load(&s_pool_used);
+    if (used > MIMI_METRICS_MAX) used = MIMI_METRICS_MAX;
+    for (int i = 0; i < used; i++) {
+        metric_t *m = &s_pool[i];
+        if (atomic_load(&m->ready) && strcmp(m->name, name) == 0 &&
+            strcmp(m->labels, labels ? labels : "") == 0) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Lookup and slot claim run under one lock, so two tasks registering the
+ * same series at once get the same metric. Updates and rendering stay
+ * lock-free: a slot is published (ready, then s_pool_used) only once filled.
+ */
+static metric_t *metric_register(metric_type_t type, const char *name, const char *help,
+                                 const char *labels, const uint32_t *bounds, int n_bounds)
+{
+    portENTER_CRITICAL(&s_register_lock);
+    metric_t *m = metric_find(name, labels);
+    int idx = atomic_load(&s_pool_used);
+    if (!m && idx < MIMI_METRICS_MAX) {
+        m = &s_pool[idx];
+        m->type = type;
+        m->name = name;
+        m->help = help;
+        strncpy(m->labels, labels ? labels : "", sizeof(m->labels) - 1);
+        if (n_bounds > METRICS_MAX_BUCKETS) n_bounds = METRICS_MAX_BUCKETS;
+        m->bounds = bounds;
+        m->n_bounds = n_bounds;
+        atomic_store(&m->ready, true);
+        atomic_store(&s_pool_used, idx + 1);
+    }
+    portEXIT_CRITICAL(&s_register_lock);
+
+    if (!m) {
+        ESP_LOGW(TAG, "Metric pool full, %s not registered", name);
+    }
+    return m;
+}
+
+metric_t *metrics_counter(const char *name, const char *help, const char *labels)
+{
+    return metric_register(METRIC_COUNTER, name, help, labels, NULL, 0);
+}
+
+metric_t *metrics_gauge(const char *name, const char *help, const char *labels)
+{
+    return metric_register(METRIC_GAUGE, name, help, labels, NULL, 0);
+}
+
+metric_t *metrics_histogram(const char *name, const char *help, const char *labels,
+                            const uint32_t *bounds, int n_bounds)
+{
+    return metric_register(METRIC_HISTOGRAM, name, help, labels, bounds, n_bounds);
+}
+
+esp_err_t metrics_register_collector(void (*collect)(void))
+{
+    int idx = atomic_fetch_add(&s_collector_count, 1);
+    if (idx >= MIMI_METRICS_MAX_COLLECTORS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_collectors[idx] = collect;
+    return ESP_OK;
+}
+
+/* ── Updates ───────────────────────────────────────────────── */
+
+void metric_add(metric_t *m, uint32_t n)
+{
+    if (!m) return;
+    atomic_fetch_add_explicit(&m->value, (int32_t)n, memory_order_relaxed);
+}
+
+void metric_inc(metric_t *m)
+{
+    metric_add(m, 1);
+}
+
+void metric_set(metric_t *m, int32_t value)
+{
+    if (!m) return;
+    atomic_store_explicit(&m->value, value, memory_order_relaxed);
+}
+
+void metric_observe(metric_t *m, uint32_t value)
+{
+    if (!m) return;
+    int b = 0;
+    while (b < m->n_bounds && value > m->bounds[b]) b++;
+    atomic_fetch_add_explicit(&m->buckets[b], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->sum, value, memory_order_relaxed);
+}
+
+void metric_observe_since(metric_t *m, int64_t start_us)
+{
+    int64_t ms = (esp_timer_get_time() - start_us) / 1000;
+    metric_observe(m, ms > 0 ? (uint32_t)ms : 0);
+}
+
+/* ── SPIFFS I/O ────────────────────────────────────────────── */
+
+static metric_t *s_spiffs_bytes[2];
+static metric_t *s_spiffs_ms[2];
+
+void metrics_spiffs_io(bool write, size_t bytes, int64_t start_us)
+{
+    metric_add(s_spiffs_bytes[write], (uint32_t)bytes);
+    metric_observe_since(s_spiffs_ms[write], start_us);
+}
+
+/* ── System collector (heap, stacks, uptime) ───────────────── */
+
+/* Long-running tasks whose stack high-water mark is exported */
+static const char *s_watched_tasks[] = {
+    "agent_loop", "outbound", "tg_poll", "tg_hook", "feishu_ws", "feishu_tok",
+    "ws_tx", "oa_worker0", "oa_worker1", "lua_exec", "lua_w0", "lua_w1", "lua_daemon",
+    "lua_sched", "lua_sched_wd", "buddy_contact",
+};
+
+#define WATCHED_TASKS  (sizeof(s_watched_tasks) / sizeof(s_watched_tasks[0]))
+
+static metric_t *s_task_stack_free[WATCHED_TASKS];
+static metric_t *s_heap_free[2];
+static metric_t *s_heap_largest[2];
+static metric_t *s_heap_min_free[2];
+static metric_t *s_uptime;
+
+static void collect_system(void)
+{
+    static const uint32_t caps[2] = { MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM };
+    for (int i = 0; i < 2; i++) {
+        metric_set(s_heap_free[i], (int32_t)heap_caps_get_free_size(caps[i]));
+        metric_set(s_heap_largest[i], (int32_t)heap_caps_get_largest_free_block(caps[i]));
+        metric_set(s_heap_min_free[i], (int32_t)heap_caps_get_minimum_free_size(caps[i]));
+    }
+    metric_set(s_uptime, (int32_t)(esp_timer_get_time() / 1000000LL));
+
+    for (size_t i = 0; i < WATCHED_TASKS; i++) {
+        TaskHandle_t task = xTaskGetHandle(s_watched_tasks[i]);
+        metric_set(s_task_stack_free[i], task ? (int32_t)uxTaskGetStackHighWaterMark(task) : -1);
+    }
+}
+
+esp_err_t metrics_init(void)
+{
+    static const char *regions[2] = { "region=\"internal\"", "region=\"psram\"" };
+    for (int i = 0; i < 2; i++) {
+        s_heap_free[i] = metrics_gauge("mimi_heap_free_bytes", "Free heap", regions[i]);
+        s_heap_largest[i] = metrics_gauge("mimi_heap_largest_free_block_bytes",
+                                          "Largest allocatable block", regions[i]);
+        s_heap_min_free[i] = metrics_gauge("mimi_heap_min_free_bytes",
+                                           "Lowest free heap since boot", regions[i]);
+    }
+    s_uptime = metrics_gauge("mimi_uptime_seconds", "Seconds since boot", NULL);
+
+    for (size_t i = 0; i < WATCHED_TASKS; i++) {
+        char labels[METRICS_LABELS_LEN];
+        snprintf(labels, sizeof(labels), "task=\"%s\"", s_watched_tasks[i]);
+        s_task_stack_free[i] = metrics_gauge("mimi_task_stack_free_bytes",
+                                             "Minimum free stack ever seen (high-water mark), "
+                                             "-1 while the task is not running", labels);
+        metric_set(s_task_stack_free[i], -1);
+    }
+
+    static const char *ops[2] = { "op=\"read\"", "op=\"write\"" };
+    for (int i = 0; i < 2; i++) {
+        s_spiffs_bytes[i] = metrics_counter("mimi_spiffs_bytes_total", "SPIFFS bytes transferred", ops[i]);
+        s_spiffs_ms[i] = metrics_histogram("mimi_spiffs_op_ms", "SPIFFS operation latency",
+                                           ops[i], METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+    }
+
+    return metrics_register_collector(collect_system);
+}
+
+/* ── Text exposition ───────────────────────────────────────── */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool oom;
+} render_buf_t;
+
+static void out_printf(render_buf_t *o, const char *fmt, ...)
+{
+    if (o->oom) return;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            o->oom = true;
+            return;
+        }
+        if (o->len + n < o->cap) {
+            o->len += n;
+            return;
+        }
+        size_t new_cap = o->cap * 2 + n;
+        char *tmp = heap_caps_realloc(o->buf, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) {
+            o->oom = true;
+            return;
+        }
+        o->buf = tmp;
+        o->cap = new_cap;
+    }
+}
+
+/* Label set with an optional extra label, e.g. {tool="x",le="50"} */
+static void out_labels(render_buf_t *o, const char *labels, const char *extra)
+{
+    bool has = labels[0] != '\0';
+    if (!has && !extra) return;
+    out_printf(o, "{%s%s%s}", labels, (has && extra) ? "," : "", extra ? extra : "");
+}
+
+static void render_metric(render_buf_t *o, const metric_t *m)
+{
+    if (m->type != METRIC_HISTOGRAM) {
+        out_printf(o, "%s", m->name);
+        out_labels(o, m->labels, NULL);
+        int32_t v = atomic_load_explicit(&m->value, memory_order_relaxed);
+        if (m->type == METRIC_COUNTER) {
+            out_printf(o, " %u\n", (unsigned)v);
+        } else {
+            out_printf(o, " %d\n", (int)v);
+        }
+        return;
+    }
+
+    uint32_t cumulative = 0;
+    char le[24];
+    for (int b = 0; b <= m->n_bounds; b++) {
+        cumulative += atomic_load_explicit(&m->buckets[b], memory_order_relaxed);
+        if (b < m->n_bounds) {
+            snprintf(le, sizeof(le), "le=\"%u\"", (unsigned)m->bounds[b]);
+        } else {
+            strcpy(le, "le=\"+Inf\"");
+        }
+        out_printf(o, "%s_bucket", m->name);
+        out_labels(o, m->labels, le);
+        out_printf(o, " %u\n", (unsigned)cumulative);
+    }
+    out_printf(o, "%s_sum", m->name);
+    out_labels(o, m->labels, NULL);
+    out_printf(o, " %u\n", (unsigned)atomic_load_explicit(&m->sum, memory_order_relaxed));
+    out_printf(o, "%s_count", m->name);
+    out_labels(o, m->labels, NULL);
+    out_printf(o, " %u\n", (unsigned)cumulative);
+}
+
+char *metrics_render(void)
+{
+    int collectors = atomic_load(&s_collector_count);
+    if (collectors > MIMI_METRICS_MAX_COLLECTORS) collectors = MIMI_METRICS_MAX_COLLECTORS;
+    for (int i = 0; i < collectors; i++) {
+        if (s_collectors[i]) s_collectors[i]();
+    }
+
+    render_buf_t o = { .cap = 8 * 1024 };
+    o.buf = heap_caps_malloc(o.cap, MALLOC_CAP_SPIRAM);
+    if (!o.buf) return NULL;
+    o.buf[0] = '\0';
+
+    static const char *type_names[] = { "counter", "gauge", "histogram" };
+    int used = atomic_load(&s_pool_used);
+    if (used > MIMI_METRICS_MAX) used = MIMI_METRICS_MAX;
+
+    /* One HELP/TYPE header per family, then every label set of that family */
+    for (int i = 0; i < used; i++) {
+        const metric_t *m = &s_pool[i];
+        if (!atomic_load(&m->ready)) continue;
+
+        bool seen = false;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = atomic_load(&s_pool[j].ready) && strcmp(s_pool[j].name, m->name) == 0;
+        }
+        if (seen) continue;
+
+        out_printf(&o, "# HELP %s %s\n# TYPE %s %s\n",
+                   m->name, m->help ? m->help : "", m->name, type_names[m->type]);
+        for (int j = i; j < used; j++) {
+            if (atomic_load(&s_pool[j].ready) && strcmp(s_pool[j].name, m->name) == 0) {
+                render_metric(&o, &s_pool[j]);
+            }
+        }
+    }
+
+    if (o.oom) {
+        free(o.buf);
+        return NULL;
+    }
+    return o.buf;
+}
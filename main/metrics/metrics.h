@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Lightweight metrics registry: counters, gauges and fixed-bucket
+ * histograms rendered in Prometheus text exposition format.
+ *
+ * Metrics live in a static pool and are registered once (typically from a
+ * module's init), then updated with relaxed atomics from any task without
+ * locking. Registration is serialized, so registering the same name +
+ * labels twice, from any task, returns the existing metric. All update functions accept NULL (pool exhausted) as a no-op.
+ */
+
+typedef struct metric metric_t;
+
+/* Default histogram buckets */
+extern const uint32_t METRICS_MS_BUCKETS[];     /* latency in milliseconds */
+extern const int METRICS_MS_BUCKETS_N;
+extern const uint32_t METRICS_BYTES_BUCKETS[];  /* payload sizes */
+extern const int METRICS_BYTES_BUCKETS_N;
+
+/**
+ * Register metrics. name must be a string literal (kept by pointer);
+ * labels is copied, e.g. "tool=\"web_search\"" or NULL.
+ */
+metric_t *metrics_counter(const char *name, const char *help, const char *labels);
+metric_t *metrics_gauge(const char *name, const char *help, const char *labels);
+metric_t *metrics_histogram(const char *name, const char *help, const char *labels,
+                            const uint32_t *bounds, int n_bounds);
+
+void metric_add(metric_t *m, uint32_t n);
+void metric_inc(metric_t *m);
+void metric_set(metric_t *m, int32_t value);
+void metric_observe(metric_t *m, uint32_t value);
+
+/** Observe the milliseconds elapsed since start_us (esp_timer_get_time()). */
+void metric_observe_since(metric_t *m, int64_t start_us);
+
+/**
+ * Register a callback run before each render, used to sample gauges
+ * (queue depths, heap, stack watermarks).
+ */
+esp_err_t metrics_register_collector(void (*collect)(void));
+
+/** Record a SPIFFS read or write of `bytes` that started at start_us. */
+void metrics_spiffs_io(bool write, size_t bytes, int64_t start_us);
+
+/**
+ * Register system metrics (heap, task stacks, uptime). Call early in boot.
+ */
+esp_err_t metrics_init(void);
+
+/**
+ * Render all metrics as Prometheus text exposition (version 0.0.4).
+ * @return heap-allocated string (caller frees), or NULL on OOM
+ */
+char *metrics_render(void);
@@ -6,12 +6,20 @@
 #include "esp_event.h"
 #include "esp_system.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_spiffs.h"
 #include "nvs_flash.h"
 
 #include "mimi_config.h"
 #include "onboard/wifi_onboard.h"
 #include "bus/message_bus.h"
+#include "metrics/metrics.h"
+#include "config/config_registry.h"
+#include "trace/trace.h"
+#include "arena/turn_arena.h"
+#include "heapprof/heap_prof.h"
+#include "bench/bench.h"
+#include "offline/offline_queue.h"
 #include "wifi/wifi_manager.h"
 #include "channels/telegram/telegram_bot.h"
 #include "channels/feishu/feishu_bot.h"
@@ -21,9 +29,13 @@
 #include "memory/memory_store.h"
 #include "memory/session_mgr.h"
 #include "gateway/ws_server.h"
+#include "gateway/openai_api.h"
 #include "cli/serial_cli.h"
 #include "proxy/http_proxy.h"
 #include "tools/tool_registry.h"
+#include "lua/lua_runner.h"
+#include "lua/lua_daemon.h"
+#include "lua/lua_sched.h"
 #include "cron/cron_service.h"
 #include "heartbeat/heartbeat.h"
 #include "skills/skill_loader.h"
@@ -67,39 +79,114 @@ static esp_err_t init_spiffs(void)
     return ESP_OK;
 }
 
+/* Per-channel send latency and failures for the outbound dispatcher */
+enum { SEND_TELEGRAM, SEND_FEISHU, SEND_WEBSOCKET, SEND_CHANNELS };
+static metric_t *s_send_ms[SEND_CHANNELS];
+static metric_t *s_send_errors[SEND_CHANNELS];
+
+static void send_metrics_init(void)
+{
+    static const char *labels[SEND_CHANNELS] = {
+        "channel=\"telegram\"", "channel=\"feishu\"", "channel=\"websocket\"",
+    };
+    for (int i = 0; i < SEND_CHANNELS; i++) {
+        s_send_ms[i] = metrics_histogram("mimi_channel_send_ms", "Outbound channel send latency",
+                                         labels[i], METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+        s_send_errors[i] = metrics_counter("mimi_channel_send_errors_total",
+                                           "Outbound channel send failures", labels[i]);
+    }
+}
+
+static void send_metrics_record(int ch, esp_err_t err, int64_t start_us)
+{
+    static const char *channels[SEND_CHANNELS] = {
+        MIMI_CHAN_TELEGRAM, MIMI_CHAN_FEISHU, MIMI_CHAN_WEBSOCKET,
+    };
+    trace_record("channel_send", channels[ch], start_us, esp_timer_get_time());
+    metric_observe_since(s_send_ms[ch], start_us);
+    if (err != ESP_OK && err != MIMI_SEND_PENDING) metric_inc(s_send_errors[ch]);
+}
+
+/* A chat send that failed because the link went down is journaled for
+ * replay; any other outcome settles the message (a replay leaves the journal).
+ * A held final reply is settled by its channel once the flush sends it. */
+static void outbound_done(const mimi_msg_t *msg, esp_err_t err)
+{
+    if (err == MIMI_SEND_PENDING) return;
+    offline_queue_outbound_done(msg, err);
+}
+
+/* Push coalesced in-progress reply edits and held final replies that are now due */
+static void stream_flush_due(void)
+{
+    if (offline_queue_link_up()) {
+        telegram_stream_flush();
+        feishu_stream_flush();
+    }
+}
+
 /* Outbound dispatch task: reads from outbound queue and routes to channels */
 static void outbound_dispatch_task(void *arg)
 {
     ESP_LOGI(TAG, "Outbound dispatch started");
+    send_metrics_init();
 
     while (1) {
         mimi_msg_t msg;
-        if (message_bus_pop_outbound(&msg, UINT32_MAX) != ESP_OK) continue;
+        if (message_bus_pop_outbound(&msg, MIMI_OUTBOUND_IDLE_FLUSH_MS) != ESP_OK) {
+            stream_flush_due();
+            continue;
+        }
+
+        /* No link: journal chat replies for replay instead of losing them */
+        if (!offline_queue_link_up() && offline_queue_defer(OFFLINE_OUTBOUND, &msg) == ESP_OK) {
+            ESP_LOGW(TAG, "Offline, %s message for %s deferred", msg.channel, msg.chat_id);
+            mimi_msg_free(&msg);
+            continue;
+        }
 
         ESP_LOGI(TAG, "Dispatching response to %s:%s", msg.channel, msg.chat_id);
 
         if (strcmp(msg.channel, MIMI_CHAN_TELEGRAM) == 0) {
             if (mimi_feature_telegram_bot_enabled()) {
+                int64_t start_us = esp_timer_get_time();
                 esp_err_t send_err = telegram_send_message(&msg);
-                if (send_err != ESP_OK) {
+                send_metrics_record(SEND_TELEGRAM, send_err, start_us);
+                if (send_err == MIMI_SEND_PENDING) {
+                    ESP_LOGI(TAG, "Telegram final reply for %s held for the next edit", msg.chat_id);
+                } else if (send_err != ESP_OK) {
                     ESP_LOGE(TAG, "Telegram send failed for %s: %s", msg.chat_id, esp_err_to_name(send_err));
                 } else {
-                    ESP_LOGI(TAG, "Telegram send success for %s (%d bytes)", msg.chat_id, (int)strlen(msg.payload.text));
+                    ESP_LOGI(TAG, "Telegram send success for %s", msg.chat_id);
                 }
+                outbound_done(&msg, send_err);
             } else {
                 ESP_LOGW(TAG, "Telegram bot disabled, message not sent");
+                offline_queue_settle(OFFLINE_OUTBOUND, &msg);
             }
         } else if (strcmp(msg.channel, MIMI_CHAN_FEISHU) == 0) {
             if (mimi_feature_feishu_bot_enabled()) {
+                int64_t start_us = esp_timer_get_time();
                 esp_err_t send_err = feishu_send_message(&msg);
-                if (send_err != ESP_OK) {
+                send_metrics_record(SEND_FEISHU, send_err, start_us);
+                if (send_err != ESP_OK && send_err != MIMI_SEND_PENDING) {
                     ESP_LOGE(TAG, "Feishu send failed for %s: %s", msg.chat_id, esp_err_to_name(send_err));
                 }
+                outbound_done(&msg, send_err);
             } else {
                 ESP_LOGW(TAG, "Feishu bot disabled, message not sent");
+                offline_queue_settle(OFFLINE_OUTBOUND, &msg);
             }
+        } else if (strcmp(msg.channel, MIMI_CHAN_OPENAI) == 0) {
+            openai_api_deliver(&msg);
+        } else if (strcmp(msg.channel, MIMI_CHAN_BENCH) == 0) {
+            bench_deliver(&msg);
+        } else if (strcmp(msg.type, "stream") == 0) {
+            /* Only chat channels render in-progress replies */
         } else if (strcmp(msg.channel, MIMI_CHAN_WEBSOCKET) == 0) {
+            int64_t start_us = esp_timer_get_time();
             esp_err_t ws_err = ws_server_send(msg.chat_id, msg.payload.text);
+            send_metrics_record(SEND_WEBSOCKET, ws_err, start_us);
             if (ws_err != ESP_OK) {
                 ESP_LOGW(TAG, "WS send failed for %s: %s", msg.chat_id, esp_err_to_name(ws_err));
             }
@@ -111,6 +198,9 @@ static void outbound_dispatch_task(void *arg)
 
         /* Free message content after dispatch */
         mimi_msg_free(&msg);
+
+        /* A busy queue must not starve held edits of other chats */
+        stream_flush_due();
     }
 }
 
@@ -135,10 +225,16 @@ void app_main(void)
     ESP_ERROR_CHECK(init_spiffs());
 
     /* Initialize subsystems */
+    ESP_ERROR_CHECK(metrics_init());
+    ESP_ERROR_CHECK(config_init());    /* NVS config into RAM: before any module reads it */
+    heap_prof_init();       /* tracks allocations from here on */
+    trace_init();
+    turn_arena_init();      /* installs cJSON hooks: before other tasks start */
     ESP_ERROR_CHECK(message_bus_init());
     ESP_ERROR_CHECK(memory_store_init());
     ESP_ERROR_CHECK(skill_loader_init());
     ESP_ERROR_CHECK(session_mgr_init());
+    ESP_ERROR_CHECK(offline_queue_init());
     ESP_ERROR_CHECK(wifi_manager_init());
     ESP_ERROR_CHECK(http_proxy_init());
     if (mimi_feature_telegram_bot_enabled()) {
@@ -149,6 +245,15 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(llm_proxy_init());
     ESP_ERROR_CHECK(tool_registry_init());
+    if (lua_runner_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Lua pool not started, scripts run cold");
+    }
+    if (lua_daemon_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Lua daemon task not started");
+    }
+    if (lua_sched_init() != ESP_OK) {
+        ESP_LOGW(TAG, "Lua scheduler not started, no background scripts");
+    }
     ESP_ERROR_CHECK(cron_service_init());
     ESP_ERROR_CHECK(heartbeat_init());
     ESP_ERROR_CHECK(agent_loop_init());
@@ -206,7 +311,11 @@ void app_main(void)
         }
         cron_service_start();
         heartbeat_start();
+        ESP_ERROR_CHECK(offline_queue_start());   /* after the agent and outbound tasks */
         ESP_ERROR_CHECK(ws_server_start());
+        if (openai_api_start() != ESP_OK) {
+            ESP_LOGW(TAG, "OpenAI-compatible API not started");
+        }
 
 #if MIMI_FEATURE_BUDDY_ENABLED
         ESP_ERROR_CHECK(buddy_start());
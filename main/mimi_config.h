@@ -32,6 +32,15 @@
 #ifndef MIMI_SECRET_TG_TOKEN
 #define MIMI_SECRET_TG_TOKEN        ""
 #endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_URL
+#define MIMI_SECRET_TG_WEBHOOK_URL  ""
+#endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_TLS_CERT_PEM
+#define MIMI_SECRET_TG_WEBHOOK_TLS_CERT_PEM ""
+#endif
+#ifndef MIMI_SECRET_TG_WEBHOOK_TLS_KEY_PEM
+#define MIMI_SECRET_TG_WEBHOOK_TLS_KEY_PEM  ""
+#endif
 #ifndef MIMI_SECRET_FEISHU_APP_ID
 #define MIMI_SECRET_FEISHU_APP_ID   ""
 #endif
@@ -91,6 +100,13 @@
 #define MIMI_TG_POLL_CORE            0
 #define MIMI_TG_CARD_SHOW_MS         3000
 #define MIMI_TG_CARD_BODY_SCALE      3
+#define MIMI_TG_WEBHOOK_PORT         8443
+#define MIMI_TG_WEBHOOK_PATH         "/telegram/webhook"
+#define MIMI_TG_WEBHOOK_MAX_BODY     (16 * 1024)
+#define MIMI_TG_WEBHOOK_STACK        (6 * 1024)
+#define MIMI_TG_STREAM_EDIT_INTERVAL_MS 1000  /* editMessageText: ~1/s per chat */
+#define MIMI_TG_REPLAY_MAX_UPDATES   1000    /* tg_replay: updates kept from a recording */
+#define MIMI_TG_REPLAY_POLL_BATCH    8       /* tg_replay: updates per getUpdates response */
 
 /* Feishu Bot */
 #define MIMI_FEISHU_MAX_MSG_LEN      4096
@@ -100,6 +116,13 @@
 #define MIMI_FEISHU_WEBHOOK_PORT     18790
 #define MIMI_FEISHU_WEBHOOK_PATH     "/feishu/events"
 #define MIMI_FEISHU_WEBHOOK_MAX_BODY (16 * 1024)
+#define MIMI_FEISHU_STREAM_EDIT_INTERVAL_MS 400  /* message patch: 5 QPS per message */
+#define MIMI_FEISHU_TOKEN_STACK      (6 * 1024)
+#define MIMI_FEISHU_TOKEN_REFRESH_MARGIN_S 900   /* renew 15 min before expiry */
+#define MIMI_FEISHU_TOKEN_JITTER_S   120
+#define MIMI_FEISHU_TOKEN_MIN_VALID_S 30         /* below this, send path refreshes inline */
+#define MIMI_FEISHU_TOKEN_RETRY_MIN_S 5
+#define MIMI_FEISHU_TOKEN_RETRY_MAX_S 300
 
 /* Agent Loop */
 #define MIMI_AGENT_STACK             (24 * 1024)
@@ -109,6 +132,7 @@
 #define MIMI_AGENT_MAX_TOOL_ITER     12
 #define MIMI_MAX_TOOL_CALLS          4
 #define MIMI_AGENT_SEND_WORKING_STATUS 1
+#define MIMI_AGENT_TOOL_TAIL         512   /* last bytes of a running tool's output in the placeholder */
 
 /* Timezone (POSIX TZ format) */
 #define MIMI_TIMEZONE                "CST-8"  /* China Standard Time (UTC+8) */
@@ -134,6 +158,8 @@
 #define MIMI_OUTBOUND_STACK          (12 * 1024)
 #define MIMI_OUTBOUND_PRIO           5
 #define MIMI_OUTBOUND_CORE           0
+#define MIMI_OUTBOUND_IDLE_FLUSH_MS  250   /* flush coalesced stream edits when idle */
+#define MIMI_STREAM_MAX_CHATS        4     /* concurrent in-progress replies per channel */
 
 /* Memory / SPIFFS */
 #define MIMI_SPIFFS_BASE             "/spiffs"
@@ -148,8 +174,11 @@
 
 /* Cron / Heartbeat */
 #define MIMI_CRON_FILE               MIMI_SPIFFS_BASE "/cron.json"
-#define MIMI_CRON_MAX_JOBS           16
-#define MIMI_CRON_CHECK_INTERVAL_MS  (60 * 1000)
+#define MIMI_CRON_MAX_JOBS           128
+#define MIMI_CRON_FILE_MAX           (96 * 1024) /* larger cron.json files are ignored */
+#define MIMI_CRON_MAX_SLEEP_S        3600  /* backstop wake for clock changes nobody reported */
+#define MIMI_CRON_CLOCK_STEP_S       2     /* wall clock vs esp_timer drift taken as a step */
+#define MIMI_CRON_SAVE_MIN_S         60    /* run times of fast jobs are saved at most this often */
 #define MIMI_HEARTBEAT_FILE          MIMI_SPIFFS_BASE "/HEARTBEAT.md"
 #define MIMI_HEARTBEAT_INTERVAL_MS   (30 * 60 * 1000)
 
@@ -159,6 +188,61 @@
 /* WebSocket Gateway */
 #define MIMI_WS_PORT                 18789
 #define MIMI_WS_MAX_CLIENTS          4
+#define MIMI_WS_CLIENT_QUEUE_LEN     16    /* frames buffered per client */
+#define MIMI_WS_SEND_WAIT_S          2     /* socket send timeout for slow clients */
+#define MIMI_WS_TX_RETRY_MS          20    /* ws_tx recheck while a client's socket is full */
+#define MIMI_WS_STALL_MS             2000  /* socket full this long: drop its queued frames */
+#define MIMI_WS_TX_STACK             (4 * 1024)
+#define MIMI_WS_TX_PRIO              4
+#define MIMI_WS_TX_CORE              0
+
+/* OpenAI-compatible API (POST /v1/chat/completions) */
+#define MIMI_OPENAI_PORT             18780
+#define MIMI_OPENAI_MAX_INFLIGHT     2     /* requests waiting on the agent at once */
+#define MIMI_OPENAI_BACKLOG          4     /* accepted requests waiting for a slot */
+#define MIMI_OPENAI_ADMIT_TIMEOUT_MS (30 * 1000)
+#define MIMI_OPENAI_SESSION_WAIT_MS  (30 * 1000) /* then 429 while the user's previous request runs */
+#define MIMI_OPENAI_REPLY_TIMEOUT_MS (5 * 60 * 1000)
+#define MIMI_OPENAI_KEEPALIVE_MS     (10 * 1000)
+#define MIMI_OPENAI_MAX_BODY         (32 * 1024)
+#define MIMI_OPENAI_WORKER_STACK     (6 * 1024)
+#define MIMI_OPENAI_WORKER_PRIO      4
+#define MIMI_OPENAI_WORKER_CORE      0
+
+/* Metrics (GET /metrics, CLI `metrics`) */
+#define MIMI_METRICS_MAX             160   /* registered series incl. labels */
+#define MIMI_METRICS_MAX_COLLECTORS  8
+
+/* Tracing (GET /trace, CLI `trace`) */
+#define MIMI_TRACE_RING_EVENTS       2048  /* ~40 bytes each, PSRAM */
+#define MIMI_TRACE_ENABLED_DEFAULT   1
+
+/* Per-turn arena: cJSON + turn-scoped strings of the agent task (PSRAM) */
+#define MIMI_TURN_ARENA_BLOCK_SIZE   (64 * 1024)
+#define MIMI_TURN_ARENA_MAX_BLOCKS   8     /* allocated on demand, kept for reuse */
+#define MIMI_TURN_ARENA_MAX_ALLOC    (16 * 1024) /* larger requests go to the heap */
+
+/* Heap profiler (CLI `heap_prof`; device needs CONFIG_HEAP_USE_HOOKS) */
+#define MIMI_HEAP_PROF_TRACK_MAX     16384 /* live allocations, power of 2, 12 B each in PSRAM */
+#define MIMI_HEAP_PROF_MAX_SCOPES    8     /* tasks with an open heap_prof scope */
+#define MIMI_HEAP_PROF_SNAPSHOT_MS   (60 * 1000)
+#define MIMI_HEAP_PROF_ENABLED_DEFAULT 1
+
+/* Mock LLM endpoint and turn benchmark (CLI `llm_mock`, `bench`) */
+#define MIMI_LLM_MOCK_PORT           18782 /* ctrl port is +1 */
+#define MIMI_LLM_MOCK_MAX_BODY       (128 * 1024)
+#define MIMI_LLM_MOCK_STACK          (8 * 1024)
+#define MIMI_BENCH_MAX_CONCURRENCY   8
+#define MIMI_BENCH_MAX_TURNS         10000 /* long enough for a soak run */
+#define MIMI_BENCH_TURN_TIMEOUT_MS   (60 * 1000)
+
+/* Mock Telegram/Feishu APIs and stream benchmark (CLI `stream_bench`) */
+#define MIMI_CHAN_MOCK_PORT          18784 /* ctrl port is +1 */
+#define MIMI_CHAN_MOCK_MAX_BODY      (16 * 1024)
+#define MIMI_CHAN_MOCK_STACK         (6 * 1024)
+#define MIMI_CHAN_MOCK_MAX_CALLS     256
+#define MIMI_CHAN_MOCK_MAX_SNAPSHOTS 100
+#define MIMI_CHAN_MOCK_WAIT_MS       (10 * 1000)
 
 /* Camera Debug Server */
 #define MIMI_CAMERA_SERVER_PORT      18787
@@ -168,6 +252,95 @@
 #define MIMI_CLI_PRIO                3
 #define MIMI_CLI_CORE                0
 
+/* Config registry: NVS namespaces cached in RAM, write-behind */
+#define MIMI_CONFIG_MAX_ENTRIES      96
+#define MIMI_CONFIG_MAX_SUBSCRIBERS  8
+#define MIMI_CONFIG_MAX_NAMESPACES   8     /* namespaces touched by one flush */
+#define MIMI_CONFIG_FLUSH_DELAY_MS   2000  /* quiet period before writing */
+#define MIMI_CONFIG_FLUSH_MAX_MS     10000 /* upper bound under constant changes */
+#define MIMI_CONFIG_FLUSH_STACK      (4 * 1024)
+#define MIMI_CONFIG_FLUSH_PRIO       2
+
+/* Offline queueing: deferred turns and undelivered replies, replayed on reconnect */
+#define MIMI_OFFLINE_DIR             MIMI_SPIFFS_BASE "/offline"
+#define MIMI_OFFLINE_INBOUND_FILE    MIMI_OFFLINE_DIR "/inbound.jsonl"
+#define MIMI_OFFLINE_OUTBOUND_FILE   MIMI_OFFLINE_DIR "/outbound.jsonl"
+#define MIMI_OFFLINE_MAX_ENTRIES     32    /* per journal; the oldest is dropped when full */
+#define MIMI_OFFLINE_MAX_TEXT        (8 * 1024)  /* longer payloads are truncated */
+#define MIMI_OFFLINE_CHAT_TTL_S      (6 * 3600)  /* deadline of a deferred chat turn */
+#define MIMI_OFFLINE_SYSTEM_TTL_S    3600        /* cron / heartbeat turns */
+#define MIMI_OFFLINE_OUTBOUND_TTL_S  (24 * 3600)
+#define MIMI_OFFLINE_GRACE_MS        (5 * 1000)  /* link up this long before replay starts */
+#define MIMI_OFFLINE_REPLAY_GAP_MS   (3 * 1000)  /* min gap between replays per journal */
+#define MIMI_OFFLINE_INFLIGHT_MS     (10 * 60 * 1000) /* replay never settled: dropped */
+#define MIMI_OFFLINE_POLL_MS         1000
+#define MIMI_OFFLINE_STACK           (4 * 1024)
+#define MIMI_OFFLINE_PRIO            3
+
+/* Lua scripts (script_run): warm VM pool on persistent workers */
+#define MIMI_LUA_SCRIPTS_DIR         MIMI_SPIFFS_BASE "/scripts"
+#define MIMI_LUA_POOL_SIZE           2
+#define MIMI_LUA_WORKER_STACK        (8 * 1024)
+#define MIMI_LUA_WORKER_PRIO         1
+#define MIMI_LUA_HOOK_COUNT          1000  /* VM instructions between deadline checks */
+#define MIMI_LUA_KILL_GRACE_MS       500   /* past the timeout before a worker is deleted */
+#define MIMI_LUA_BENCH_SCRIPT        MIMI_LUA_SCRIPTS_DIR "/_bench.lua"
+#define MIMI_LUA_BENCH_MAX_RUNS      1000
+#define MIMI_LUA_BENCH_TIMEOUT_MS    5000
+#define MIMI_LUA_CACHE_SUFFIX        ".bc" /* bytecode next to the source: blink.lua.bc */
+#define MIMI_LUA_CACHE_MAX_BYTES     (64 * 1024) /* larger sources compile every run */
+#define MIMI_LUA_CACHE_STRIP         1     /* drop debug info from cached chunks */
+#define MIMI_LUA_TEMP_SCRIPT         MIMI_LUA_SCRIPTS_DIR "/tmp.lua" /* script_write_and_run, never cached */
+#define MIMI_LUA_INSTR_BUDGET        50000000 /* VM instructions per run, 0 = unlimited */
+#define MIMI_LUA_MEM_CAP             (512 * 1024) /* heap per lua_State during a run, 0 = unlimited */
+#define MIMI_LUA_MAX_RELEASES        8     /* resources tracked per run (lua_runner_track) */
+#define MIMI_LUA_CAPTURE_CHUNK       2048  /* print() output is kept in PSRAM chunks of this size */
+#define MIMI_LUA_CAPTURE_MAX         (32 * 1024) /* output kept per run; the rest is dropped and marked */
+#define MIMI_LUA_STREAM_INTERVAL_MS  1000  /* partial output of a running script to chat / WS */
+#define MIMI_LUA_JSON_MAX_DEPTH      32    /* nesting json.encode / json.decode accept */
+#define MIMI_LUA_JSON_MAX_DECODE     (64 * 1024) /* longest text json.decode parses */
+#define MIMI_LUA_JSON_BENCH_SCRIPT   MIMI_LUA_SCRIPTS_DIR "/_json_bench.lua"
+#define MIMI_LUA_JSON_BENCH_TIMEOUT_MS 30000
+#define MIMI_LUA_GPIO_PULSE_MAX      256   /* durations per gpio.pulse_train */
+#define MIMI_LUA_GPIO_PULSE_MAX_US   (100 * 1000) /* a train busy-waits: total length cap */
+#define MIMI_LUA_GPIO_EDGE_QUEUE_LEN 64    /* edges pending for gpio.wait_edge */
+#define MIMI_LUA_GPIO_EDGE_POLL_MS   10    /* gpio.wait_edge checks the queue this often */
+#define MIMI_LUA_GPIO_BENCH_SCRIPT   MIMI_LUA_SCRIPTS_DIR "/_gpio_bench.lua"
+#define MIMI_LUA_GPIO_BENCH_MAX_ITERS 100000
+
+/* Lua daemons: long-lived scripts reacting to timers and device events */
+#define MIMI_LUA_DAEMON_FILE         MIMI_SPIFFS_BASE "/daemons.json"
+#define MIMI_LUA_DAEMON_MAX          4
+#define MIMI_LUA_DAEMON_MAX_SUBS     16    /* callbacks across all daemons */
+#define MIMI_LUA_DAEMON_QUEUE_LEN    32    /* pending device events */
+#define MIMI_LUA_DAEMON_START_MS     2000  /* limit of a daemon script's top level */
+#define MIMI_LUA_DAEMON_CALLBACK_MS  200   /* limit of one callback */
+#define MIMI_LUA_DAEMON_CMD_WAIT_MS  (MIMI_LUA_DAEMON_START_MS + 3000)
+#define MIMI_LUA_DAEMON_MAX_ERRORS   5     /* failed callbacks in a row before a stop */
+#define MIMI_LUA_DAEMON_MIN_PERIOD_MS 10
+#define MIMI_LUA_DAEMON_CAMERA_MIN_MS 1000
+#define MIMI_LUA_DAEMON_DEBOUNCE_MS  20    /* GPIO edges closer than this are dropped */
+#define MIMI_LUA_DAEMON_NOTIFY_MIN_MS (60 * 1000) /* per daemon, between agent turns */
+#define MIMI_LUA_DAEMON_NOTIFY_MAX   512   /* longer notify() texts are truncated */
+#define MIMI_LUA_DAEMON_STACK        (8 * 1024)
+#define MIMI_LUA_DAEMON_PRIO         1
+
+/* Background Lua scripts (lua_sched): coroutines on one shared task */
+#define MIMI_LUA_SCHED_MAX           12    /* scripts kept, running or finished */
+#define MIMI_LUA_SCHED_SLICE         10000 /* VM instructions per turn, a multiple of MIMI_LUA_HOOK_COUNT */
+#define MIMI_LUA_SCHED_TIMEOUT_MS    (10 * 60 * 1000)   /* default limit of a background script */
+#define MIMI_LUA_SCHED_MAX_TIMEOUT_MS (24 * 3600 * 1000)
+#define MIMI_LUA_SCHED_TAIL          256   /* output kept per script for script_ps */
+#define MIMI_LUA_SCHED_BUSY_MS       100   /* scripts that never sleep give up a tick this often */
+#define MIMI_LUA_SCHED_QUEUE_LEN     8
+#define MIMI_LUA_SCHED_CMD_WAIT_MS   5000
+#define MIMI_LUA_SCHED_STACK         (8 * 1024)
+#define MIMI_LUA_SCHED_PRIO          1
+#define MIMI_LUA_SCHED_SLICE_MAX_MS  5000  /* a slice blocked longer (in a C call) is killed */
+#define MIMI_LUA_SCHED_WD_MS         1000  /* watchdog check period */
+#define MIMI_LUA_SCHED_WD_STACK      (3 * 1024)
+#define MIMI_LUA_SCHED_WD_PRIO       2     /* above lua_sched, so it runs while a slice spins */
+
 /* NVS Namespaces */
 #define MIMI_NVS_WIFI                "wifi_config"
 #define MIMI_NVS_TG                  "tg_config"
@@ -214,6 +387,7 @@
 #define MIMI_NVS_KEY_API_KEY         "api_key"
 #define MIMI_NVS_KEY_MODEL           "model"
 #define MIMI_NVS_KEY_PROVIDER        "provider"
+#define MIMI_NVS_KEY_API_URL         "api_url"
 #define MIMI_NVS_KEY_SYSTEM_PROMPT   "system_prompt"
 #define MIMI_NVS_KEY_TAVILY_KEY      "tavily_key"
 #define MIMI_NVS_KEY_PROXY_HOST      "host"
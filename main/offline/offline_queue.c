@@ -0,0 +1,691 @@
+#include "offline_queue.h"
+#include "mimi_config.h"
+#include "metrics/metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "cJSON.h"
+#include "sdkconfig.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "wifi/wifi_manager.h"
+#endif
+
+static const char *TAG = "offline";
+
+/* Wall clock below this has not been synced yet: entries get no deadline */
+#define CLOCK_VALID_EPOCH   1600000000
+/*
+ * Longest journal line: a collapsible's title and body, each clipped to
+ * MIMI_OFFLINE_MAX_TEXT, with every byte a control character that cJSON
+ * writes as "\u00XX"; the rest covers chat_id escaped the same way and the
+ * other fields.
+ */
+#define LINE_MAX_BYTES      (MIMI_OFFLINE_MAX_TEXT * 2 * 6 + 2048)
+
+typedef struct {
+    uint32_t id;            /* journal sequence number, replay order */
+    uint32_t key;           /* dedup key, see msg_key() */
+    int64_t deadline;       /* epoch seconds, 0 = none */
+    int64_t inflight_us;    /* replay handed to the bus at, 0 = pending */
+    mimi_msg_t msg;         /* heap copies owned by the journal */
+} journal_entry_t;
+
+typedef struct {
+    const char *name;
+    const char *path;
+    journal_entry_t *entries;   /* oldest first; only entries[0] is ever in flight */
+    int count;
+    uint32_t next_id;
+    int done_records;           /* settled entries still in the file */
+    int64_t last_replay_us;
+    offline_stats_t stats;
+    metric_t *m_pending;
+    metric_t *m_replayed;
+    metric_t *m_expired;
+    metric_t *m_dropped;
+} journal_t;
+
+static journal_t s_journals[OFFLINE_DIR_COUNT] = {
+    [OFFLINE_INBOUND]  = { .name = "inbound",  .path = MIMI_OFFLINE_INBOUND_FILE },
+    [OFFLINE_OUTBOUND] = { .name = "outbound", .path = MIMI_OFFLINE_OUTBOUND_FILE },
+};
+
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+static volatile bool s_forced_down = false;
+
+/* ── Messages ──────────────────────────────────────────────── */
+
+/* Journaled payload length: capped, cut on a UTF-8 boundary */
+static size_t clip_len(const char *s)
+{
+    size_t n = strnlen(s, MIMI_OFFLINE_MAX_TEXT + 1);
+    if (n > MIMI_OFFLINE_MAX_TEXT) {
+        n = MIMI_OFFLINE_MAX_TEXT;
+        while (n > 0 && ((unsigned char)s[n] & 0xC0) == 0x80) n--;
+    }
+    return n;
+}
+
+static char *clip_dup(const char *s)
+{
+    if (!s) return NULL;
+    size_t n = clip_len(s);
+    char *out = malloc(n + 1);
+    if (out) {
+        memcpy(out, s, n);
+        out[n] = '\0';
+    }
+    return out;
+}
+
+static bool is_collapsible(const mimi_msg_t *msg)
+{
+    return strcmp(msg->type, "collapsible") == 0;
+}
+
+/* A final streamed reply is replayed as a plain message: the placeholder it
+ * would replace is long gone, and a live stream in that chat must not end */
+static const char *journal_type(const mimi_msg_t *msg)
+{
+    return strcmp(msg->type, "stream_end") == 0 ? "text" : msg->type;
+}
+
+/* FNV-1a over one field, terminator included */
+static uint32_t hash_field(uint32_t h, const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+    }
+    return h * 16777619u;
+}
+
+static uint32_t hash_str(uint32_t h, const char *s)
+{
+    return s ? hash_field(h, s, clip_len(s)) : hash_field(h, "", 0);
+}
+
+/* Same key for the original message and its (clipped) replay */
+static uint32_t msg_key(const mimi_msg_t *msg)
+{
+    uint32_t h = 2166136261u;
+    h = hash_str(h, msg->channel);
+    h = hash_str(h, msg->chat_id);
+    h = hash_str(h, journal_type(msg));
+    if (is_collapsible(msg)) {
+        h = hash_str(h, msg->payload.collapsible.title);
+        h = hash_str(h, msg->payload.collapsible.body);
+    } else {
+        h = hash_str(h, msg->payload.text);
+    }
+    return h;
+}
+
+static bool journaled(offline_dir_t dir, const mimi_msg_t *msg)
+{
+    if (dir == OFFLINE_INBOUND) {
+        /* HTTP callers and benchmark runs wait on the reply, and WebSocket
+         * clients are gone by the time the link is back */
+        return msg->payload.text &&
+               strcmp(msg->channel, MIMI_CHAN_OPENAI) != 0 &&
+               strcmp(msg->channel, MIMI_CHAN_BENCH) != 0 &&
+               strcmp(msg->channel, MIMI_CHAN_WEBSOCKET) != 0;
+    }
+    /* Only remote chats can take a reply later; snapshots are superseded */
+    if (strcmp(msg->channel, MIMI_CHAN_TELEGRAM) != 0 &&
+        strcmp(msg->channel, MIMI_CHAN_FEISHU) != 0) {
+        return false;
+    }
+    return strcmp(msg->type, "stream") != 0;
+}
+
+static int64_t msg_deadline(offline_dir_t dir, const mimi_msg_t *msg)
+{
+    time_t now = time(NULL);
+    if (now < CLOCK_VALID_EPOCH) return 0;
+    if (dir == OFFLINE_OUTBOUND) return (int64_t)now + MIMI_OFFLINE_OUTBOUND_TTL_S;
+    if (strcmp(msg->channel, MIMI_CHAN_SYSTEM) == 0) return (int64_t)now + MIMI_OFFLINE_SYSTEM_TTL_S;
+    return (int64_t)now + MIMI_OFFLINE_CHAT_TTL_S;
+}
+
+/* Heap copy of a message, payload clipped to MIMI_OFFLINE_MAX_TEXT */
+static esp_err_t msg_copy(mimi_msg_t *dst, const mimi_msg_t *src)
+{
+    memset(dst, 0, sizeof(*dst));
+    strncpy(dst->channel, src->channel, sizeof(dst->channel) - 1);
+    strncpy(dst->chat_id, src->chat_id, sizeof(dst->chat_id) - 1);
+    strncpy(dst->type, journal_type(src), sizeof(dst->type) - 1);
+    if (is_collapsible(src)) {
+        dst->payload.collapsible.title = clip_dup(src->payload.collapsible.title ?
+                                                  src->payload.collapsible.title : "");
+        dst->payload.collapsible.body = clip_dup(src->payload.collapsible.body ?
+                                                 src->payload.collapsible.body : "");
+        if (!dst->payload.collapsible.title || !dst->payload.collapsible.body) {
+            mimi_msg_free(dst);
+            return ESP_ERR_NO_MEM;
+        }
+    } else {
+        dst->payload.text = clip_dup(src->payload.text ? src->payload.text : "");
+        if (!dst->payload.text) return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* ── Journal files ─────────────────────────────────────────── */
+
+static cJSON *add_record(const journal_entry_t *e)
+{
+    cJSON *obj = cJSON_CreateObject();
+    if (!obj) return NULL;
+    cJSON_AddStringToObject(obj, "op", "add");
+    cJSON_AddNumberToObject(obj, "id", e->id);
+    cJSON_AddNumberToObject(obj, "key", e->key);
+    cJSON_AddNumberToObject(obj, "deadline", (double)e->deadline);
+    cJSON_AddStringToObject(obj, "channel", e->msg.channel);
+    cJSON_AddStringToObject(obj, "chat_id", e->msg.chat_id);
+    cJSON_AddStringToObject(obj, "type", e->msg.type);
+    if (is_collapsible(&e->msg)) {
+        cJSON_AddStringToObject(obj, "title", e->msg.payload.collapsible.title);
+        cJSON_AddStringToObject(obj, "body", e->msg.payload.collapsible.body);
+    } else {
+        cJSON_AddStringToObject(obj, "text", e->msg.payload.text);
+    }
+    return obj;
+}
+
+static size_t write_record(FILE *f, cJSON *obj)
+{
+    size_t written = 0;
+    char *line = obj ? cJSON_PrintUnformatted(obj) : NULL;
+    cJSON_Delete(obj);
+    if (line) {
+        int n = fprintf(f, "%s\n", line);
+        if (n > 0) written = (size_t)n;
+        cJSON_free(line);
+    }
+    return written;
+}
+
+/* Caller holds s_lock */
+static void journal_append(journal_t *j, cJSON *obj)
+{
+    int64_t start_us = esp_timer_get_time();
+    FILE *f = fopen(j->path, "a");
+    if (!f) {
+        ESP_LOGW(TAG, "Cannot append to %s; kept in RAM only", j->path);
+        cJSON_Delete(obj);
+        return;
+    }
+    size_t written = write_record(f, obj);
+    fclose(f);
+    metrics_spiffs_io(true, written, start_us);
+}
+
+/* Caller holds s_lock. Rewrite the file with the live entries only */
+static void journal_compact(journal_t *j)
+{
+    j->done_records = 0;
+    if (j->count == 0) {
+        remove(j->path);
+        return;
+    }
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", j->path);
+    int64_t start_us = esp_timer_get_time();
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        ESP_LOGW(TAG, "Cannot compact %s", j->path);
+        return;
+    }
+    size_t written = 0;
+    for (int i = 0; i < j->count; i++) {
+        written += write_record(f, add_record(&j->entries[i]));
+    }
+    fclose(f);
+    metrics_spiffs_io(true, written, start_us);
+
+    /* SPIFFS rename does not replace; load() recovers a lone .tmp */
+    remove(j->path);
+    if (rename(tmp, j->path) != 0) {
+        ESP_LOGW(TAG, "Cannot replace %s", j->path);
+    }
+}
+
+/* ── Entries (caller holds s_lock) ─────────────────────────── */
+
+static void update_pending(journal_t *j)
+{
+    j->stats.pending = (uint32_t)j->count;
+    metric_set(j->m_pending, j->count);
+}
+
+static int find_key(const journal_t *j, uint32_t key)
+{
+    for (int i = 0; i < j->count; i++) {
+        if (j->entries[i].key == key) return i;
+    }
+    return -1;
+}
+
+static int find_id(const journal_t *j, uint32_t id)
+{
+    for (int i = 0; i < j->count; i++) {
+        if (j->entries[i].id == id) return i;
+    }
+    return -1;
+}
+
+static void entry_remove(journal_t *j, int idx)
+{
+    mimi_msg_free(&j->entries[idx].msg);
+    memmove(&j->entries[idx], &j->entries[idx + 1],
+            (size_t)(j->count - idx - 1) * sizeof(journal_entry_t));
+    j->count--;
+    update_pending(j);
+}
+
+/* Remove an entry and record it in the file */
+static void entry_settle(journal_t *j, int idx, bool persist)
+{
+    uint32_t id = j->entries[idx].id;
+    entry_remove(j, idx);
+    if (!persist) return;
+
+    if (j->count == 0 || ++j->done_records >= MIMI_OFFLINE_MAX_ENTRIES) {
+        journal_compact(j);
+        return;
+    }
+    cJSON *obj = cJSON_CreateObject();
+    if (!obj) return;
+    cJSON_AddStringToObject(obj, "op", "done");
+    cJSON_AddNumberToObject(obj, "id", id);
+    journal_append(j, obj);
+}
+
+/* Make room for one more entry: the oldest one not in flight goes */
+static void make_room(journal_t *j, bool persist)
+{
+    if (j->count < MIMI_OFFLINE_MAX_ENTRIES) return;
+    int idx = j->entries[0].inflight_us ? 1 : 0;
+    ESP_LOGW(TAG, "%s journal full, dropping %s:%s", j->name,
+             j->entries[idx].msg.channel, j->entries[idx].msg.chat_id);
+    j->stats.dropped++;
+    metric_inc(j->m_dropped);
+    entry_settle(j, idx, persist);
+}
+
+/* Takes ownership of msg's payload */
+static journal_entry_t *entry_push(journal_t *j, uint32_t id, uint32_t key,
+                                   int64_t deadline, mimi_msg_t *msg, bool persist)
+{
+    make_room(j, persist);
+    journal_entry_t *e = &j->entries[j->count++];
+    memset(e, 0, sizeof(*e));
+    e->id = id;
+    e->key = key;
+    e->deadline = deadline;
+    e->msg = *msg;
+    if (id >= j->next_id) j->next_id = id + 1;
+    update_pending(j);
+    return e;
+}
+
+static void expire_entries(journal_t *j)
+{
+    time_t now = time(NULL);
+    if (now < CLOCK_VALID_EPOCH) return;
+    for (int i = j->count - 1; i >= 0; i--) {
+        journal_entry_t *e = &j->entries[i];
+        if (e->inflight_us || !e->deadline || e->deadline >= (int64_t)now) continue;
+        ESP_LOGW(TAG, "Deferred %s message for %s:%s expired", j->name,
+                 e->msg.channel, e->msg.chat_id);
+        j->stats.expired++;
+        metric_inc(j->m_expired);
+        entry_settle(j, i, true);
+    }
+}
+
+/* ── Load ──────────────────────────────────────────────────── */
+
+static void load_record(journal_t *j, const char *line)
+{
+    cJSON *obj = cJSON_Parse(line);
+    if (!obj) return;
+
+    const char *op = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "op"));
+    cJSON *id = cJSON_GetObjectItem(obj, "id");
+    if (!op || !cJSON_IsNumber(id)) {
+        cJSON_Delete(obj);
+        return;
+    }
+
+    if (strcmp(op, "done") == 0) {
+        int idx = find_id(j, (uint32_t)id->valuedouble);
+        if (idx >= 0) entry_remove(j, idx);
+    } else if (strcmp(op, "add") == 0) {
+        mimi_msg_t src = {0};
+        const char *s;
+        if ((s = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "channel")))) {
+            strncpy(src.channel, s, sizeof(src.channel) - 1);
+        }
+        if ((s = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "chat_id")))) {
+            strncpy(src.chat_id, s, sizeof(src.chat_id) - 1);
+        }
+        if ((s = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "type")))) {
+            strncpy(src.type, s, sizeof(src.type) - 1);
+        }
+        if (is_collapsible(&src)) {
+            src.payload.collapsible.title = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "title"));
+            src.payload.collapsible.body = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "body"));
+        } else {
+            src.payload.text = cJSON_GetStringValue(cJSON_GetObjectItem(obj, "text"));
+        }
+
+        mimi_msg_t copy;
+        if (src.channel[0] && msg_copy(&copy, &src) == ESP_OK) {
+            cJSON *key = cJSON_GetObjectItem(obj, "key");
+            cJSON *deadline = cJSON_GetObjectItem(obj, "deadline");
+            entry_push(j, (uint32_t)id->valuedouble,
+                       cJSON_IsNumber(key) ? (uint32_t)key->valuedouble : msg_key(&copy),
+                       cJSON_IsNumber(deadline) ? (int64_t)deadline->valuedouble : 0,
+                       &copy, false);
+        }
+    }
+    cJSON_Delete(obj);
+}
+
+static void journal_load(journal_t *j, char *line)
+{
+    FILE *f = fopen(j->path, "r");
+    if (!f) {
+        /* Interrupted compaction: the rewritten file is complete */
+        char tmp[64];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", j->path);
+        if (rename(tmp, j->path) == 0) f = fopen(j->path, "r");
+        if (!f) return;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    size_t bytes_read = 0;
+    while (fgets(line, LINE_MAX_BYTES, f)) {
+        size_t len = strlen(line);
+        bytes_read += len;
+        if (len > 0 && line[len - 1] == '\n') {
+            line[len - 1] = '\0';
+        } else if (!feof(f)) {
+            /* Overlong record: skip the rest of it */
+            int c;
+            while ((c = fgetc(f)) != EOF && c != '\n') bytes_read++;
+            continue;
+        }
+        if (line[0]) load_record(j, line);
+    }
+    fclose(f);
+    metrics_spiffs_io(false, bytes_read, start_us);
+
+    journal_compact(j);
+    if (j->count > 0) {
+        ESP_LOGI(TAG, "%d deferred %s message(s) from before restart", j->count, j->name);
+    }
+}
+
+/* ── Replay ────────────────────────────────────────────────── */
+
+/* Hand the head of a journal to the bus once the previous replay settled */
+static void replay_next(offline_dir_t dir, int64_t now_us)
+{
+    journal_t *j = &s_journals[dir];
+    mimi_msg_t copy;
+    uint32_t id = 0;
+    bool send = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    expire_entries(j);
+    if (j->count > 0) {
+        journal_entry_t *e = &j->entries[0];
+        if (e->inflight_us) {
+            if (now_us - e->inflight_us > (int64_t)MIMI_OFFLINE_INFLIGHT_MS * 1000) {
+                ESP_LOGW(TAG, "Replayed %s message for %s:%s never settled, dropping",
+                         j->name, e->msg.channel, e->msg.chat_id);
+                j->stats.dropped++;
+                metric_inc(j->m_dropped);
+                entry_settle(j, 0, true);
+            }
+        } else if (now_us - j->last_replay_us >= (int64_t)MIMI_OFFLINE_REPLAY_GAP_MS * 1000 &&
+                   msg_copy(&copy, &e->msg) == ESP_OK) {
+            e->inflight_us = now_us;
+            j->last_replay_us = now_us;
+            id = e->id;
+            send = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (!send) return;
+
+    ESP_LOGI(TAG, "Replaying %s message for %s:%s", j->name, copy.channel, copy.chat_id);
+    esp_err_t err = (dir == OFFLINE_INBOUND) ? message_bus_push_inbound(&copy)
+                                             : message_bus_push_outbound(&copy);
+    if (err != ESP_OK) {
+        /* Queue full: retry after the next gap */
+        mimi_msg_free(&copy);
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        int idx = find_id(j, id);
+        if (idx >= 0) j->entries[idx].inflight_us = 0;
+        xSemaphoreGive(s_lock);
+    }
+}
+
+static void wait_for_link(void)
+{
+#if !CONFIG_IDF_TARGET_LINUX
+    if (!s_forced_down) {
+        /* wifi_manager sets the bit as soon as the station has an IP */
+        xEventGroupWaitBits(wifi_manager_get_event_group(), WIFI_CONNECTED_BIT,
+                            pdFALSE, pdFALSE, pdMS_TO_TICKS(MIMI_OFFLINE_POLL_MS));
+        return;
+    }
+#endif
+    vTaskDelay(pdMS_TO_TICKS(MIMI_OFFLINE_POLL_MS));
+}
+
+static void replay_task(void *arg)
+{
+    int64_t up_since_us = 0;
+
+    while (1) {
+        if (!offline_queue_link_up()) {
+            up_since_us = 0;
+            wait_for_link();
+            continue;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (!up_since_us) {
+            up_since_us = now_us;
+            if (s_journals[OFFLINE_INBOUND].count || s_journals[OFFLINE_OUTBOUND].count) {
+                ESP_LOGI(TAG, "Link up, replaying %d turn(s) and %d reply(ies) in %d ms",
+                         s_journals[OFFLINE_INBOUND].count, s_journals[OFFLINE_OUTBOUND].count,
+                         MIMI_OFFLINE_GRACE_MS);
+            }
+        }
+        if (now_us - up_since_us >= (int64_t)MIMI_OFFLINE_GRACE_MS * 1000) {
+            /* Replies first: their turns already ran */
+            replay_next(OFFLINE_OUTBOUND, now_us);
+            replay_next(OFFLINE_INBOUND, now_us);
+        }
+
+        /* Woken early by defer/settle; sleeps for good once both drain */
+        bool idle = !s_journals[OFFLINE_INBOUND].count && !s_journals[OFFLINE_OUTBOUND].count;
+        ulTaskNotifyTake(pdTRUE, idle ? portMAX_DELAY : pdMS_TO_TICKS(MIMI_OFFLINE_POLL_MS));
+    }
+}
+
+static void wake_replay(void)
+{
+    if (s_task) xTaskNotifyGive(s_task);
+}
+
+/* ── Public API ────────────────────────────────────────────── */
+
+esp_err_t offline_queue_init(void)
+{
+    if (s_lock) return ESP_OK;
+
+    s_lock = xSemaphoreCreateMutex();
+    char *line = heap_caps_malloc(LINE_MAX_BYTES, MALLOC_CAP_SPIRAM);
+    if (!s_lock || !line) {
+        ESP_LOGE(TAG, "Out of memory");
+        free(line);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int d = 0; d < OFFLINE_DIR_COUNT; d++) {
+        journal_t *j = &s_journals[d];
+        j->entries = heap_caps_calloc(MIMI_OFFLINE_MAX_ENTRIES, sizeof(journal_entry_t),
+                                      MALLOC_CAP_SPIRAM);
+        if (!j->entries) {
+            free(line);
+            return ESP_ERR_NO_MEM;
+        }
+        j->next_id = 1;
+
+        char labels[24];
+        snprintf(labels, sizeof(labels), "journal=\"%s\"", j->name);
+        j->m_pending = metrics_gauge("mimi_offline_pending", "Deferred messages awaiting replay", labels);
+        j->m_replayed = metrics_counter("mimi_offline_replayed_total", "Deferred messages replayed", labels);
+        j->m_expired = metrics_counter("mimi_offline_expired_total", "Deferred messages past their deadline", labels);
+        j->m_dropped = metrics_counter("mimi_offline_dropped_total", "Deferred messages dropped on overflow", labels);
+
+        journal_load(j, line);
+    }
+    free(line);
+
+    ESP_LOGI(TAG, "Offline journals: %d turn(s), %d reply(ies) pending",
+             s_journals[OFFLINE_INBOUND].count, s_journals[OFFLINE_OUTBOUND].count);
+    return ESP_OK;
+}
+
+esp_err_t offline_queue_start(void)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    if (s_task) return ESP_OK;
+    if (xTaskCreate(replay_task, "offline_replay", MIMI_OFFLINE_STACK, NULL,
+                    MIMI_OFFLINE_PRIO, &s_task) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create replay task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+bool offline_queue_link_up(void)
+{
+    if (s_forced_down) return false;
+#if CONFIG_IDF_TARGET_LINUX
+    return true;
+#else
+    return wifi_manager_is_connected();
+#endif
+}
+
+void offline_queue_set_forced_down(bool down)
+{
+    s_forced_down = down;
+    ESP_LOGI(TAG, "Simulated outage %s", down ? "on" : "off");
+    wake_replay();
+}
+
+esp_err_t offline_queue_defer(offline_dir_t dir, const mimi_msg_t *msg)
+{
+    if (!msg || dir >= OFFLINE_DIR_COUNT || !journaled(dir, msg)) return ESP_ERR_NOT_SUPPORTED;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+
+    journal_t *j = &s_journals[dir];
+    uint32_t key = msg_key(msg);
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_key(j, key);
+    if (idx >= 0 && j->entries[idx].inflight_us) {
+        /* The replay failed again: back to pending, still at the head */
+        j->entries[idx].inflight_us = 0;
+    } else if (idx >= 0) {
+        j->stats.duplicates++;
+        ESP_LOGI(TAG, "Duplicate %s message for %s:%s absorbed", j->name, msg->channel, msg->chat_id);
+    } else {
+        mimi_msg_t copy;
+        err = msg_copy(&copy, msg);
+        if (err == ESP_OK) {
+            journal_entry_t *e = entry_push(j, j->next_id, key, msg_deadline(dir, msg), &copy, true);
+            journal_append(j, add_record(e));
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (err == ESP_OK) wake_replay();
+    return err;
+}
+
+void offline_queue_settle(offline_dir_t dir, const mimi_msg_t *msg)
+{
+    if (!msg || dir >= OFFLINE_DIR_COUNT || !s_lock) return;
+    journal_t *j = &s_journals[dir];
+    if (j->count == 0) return;      /* nothing in flight: a live message */
+
+    uint32_t key = msg_key(msg);
+    bool settled = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int idx = find_key(j, key);
+    if (idx >= 0 && j->entries[idx].inflight_us) {
+        j->stats.replayed++;
+        metric_inc(j->m_replayed);
+        entry_settle(j, idx, true);
+        settled = true;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (settled) wake_replay();
+}
+
+bool offline_queue_outbound_done(const mimi_msg_t *msg, esp_err_t err)
+{
+    if (err != ESP_OK && !offline_queue_link_up() &&
+        offline_queue_defer(OFFLINE_OUTBOUND, msg) == ESP_OK) {
+        ESP_LOGW(TAG, "Link lost, %s message for %s deferred", msg->channel, msg->chat_id);
+        return true;
+    }
+    offline_queue_settle(OFFLINE_OUTBOUND, msg);
+    return false;
+}
+
+void offline_queue_get_stats(offline_dir_t dir, offline_stats_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (dir >= OFFLINE_DIR_COUNT || !s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_journals[dir].stats;
+    xSemaphoreGive(s_lock);
+}
+
+esp_err_t offline_queue_clear(void)
+{
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int d = 0; d < OFFLINE_DIR_COUNT; d++) {
+        journal_t *j = &s_journals[d];
+        while (j->count > 0) entry_remove(j, j->count - 1);
+        journal_compact(j);
+    }
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Offline journals cleared");
+    return ESP_OK;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "bus/message_bus.h"
+
+/*
+ * Offline queueing: durable journals of inbound turns that could not run
+ * and replies that could not be delivered while the link was down,
+ * replayed once wifi_manager reports the station connected again.
+ *
+ * Each journal is an append-only JSON lines file on SPIFFS: an "add"
+ * record per deferred message, a "done" record once its replay settled.
+ * Journals are compacted at boot and whenever they drain. Entries carry a
+ * deadline (chat turns MIMI_OFFLINE_CHAT_TTL_S, cron and heartbeat turns
+ * MIMI_OFFLINE_SYSTEM_TTL_S, replies MIMI_OFFLINE_OUTBOUND_TTL_S; none
+ * while the clock is unsynced) and a dedup key over channel, chat, type and
+ * payload. A message identical to a pending one is absorbed, so a long
+ * outage costs one heartbeat turn rather than one per interval.
+ *
+ * Replay drains each journal in order, one message at a time: the next
+ * entry goes out once the previous one settled, at least
+ * MIMI_OFFLINE_REPLAY_GAP_MS later and MIMI_OFFLINE_GRACE_MS after the link
+ * came back, so recovery does not stampede the provider. Replies go before
+ * turns. A replay that fails again for lack of a link keeps its place at
+ * the head.
+ */
+
+typedef enum {
+    OFFLINE_INBOUND = 0,    /* agent turns */
+    OFFLINE_OUTBOUND,       /* chat channel replies */
+    OFFLINE_DIR_COUNT,
+} offline_dir_t;
+
+typedef struct {
+    uint32_t pending;       /* entries in the journal, incl. the one in flight */
+    uint32_t replayed;      /* replays settled */
+    uint32_t expired;       /* dropped past their deadline */
+    uint32_t dropped;       /* dropped on overflow or a replay that never settled */
+    uint32_t duplicates;    /* deferrals absorbed by a pending entry */
+} offline_stats_t;
+
+/** Load the journals from SPIFFS. Call after the filesystem is mounted. */
+esp_err_t offline_queue_init(void);
+
+/** Start the replay task. Call once the agent loop and outbound dispatch run. */
+esp_err_t offline_queue_start(void);
+
+/** True when the station has an IP and no outage is simulated. */
+bool offline_queue_link_up(void);
+
+/** Simulate an outage (CLI / host `/offline`): the link reads as down. */
+void offline_queue_set_forced_down(bool down);
+
+/**
+ * Journal a message for replay. The journal keeps its own copy; the caller
+ * still owns msg. ESP_ERR_NOT_SUPPORTED for messages that are not replayed
+ * (OpenAI and benchmark requests, WebSocket clients, in-progress snapshots).
+ * A replayed message deferred again goes back to the head of its journal.
+ */
+esp_err_t offline_queue_defer(offline_dir_t dir, const mimi_msg_t *msg);
+
+/**
+ * The message was handled, successfully or for good. If it was a replay,
+ * its entry leaves the journal and the next one may go out.
+ */
+void offline_queue_settle(offline_dir_t dir, const mimi_msg_t *msg);
+
+/**
+ * Outcome of a chat channel send: a failure while the link is down
+ * journals the reply for replay (returns true), anything else settles it.
+ * A channel whose send returned MIMI_SEND_PENDING calls this itself once
+ * the message went out or failed.
+ */
+bool offline_queue_outbound_done(const mimi_msg_t *msg, esp_err_t err);
+
+void offline_queue_get_stats(offline_dir_t dir, offline_stats_t *out);
+
+/** Drop every journaled message. */
+esp_err_t offline_queue_clear(void);
@@ -3,6 +3,9 @@
 #include "mimi_config.h"
 #include "wifi/wifi_manager.h"
 #include "buddy/buddy.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+#include "config/config_registry.h"
 #include "sdkconfig.h"
 
 #include <stdint.h>
@@ -14,7 +17,6 @@
 #include "esp_mac.h"
 #include "esp_http_server.h"
 #include "esp_system.h"
-#include "nvs.h"
 #include "cJSON.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -30,18 +32,8 @@ static void json_add_effective_config(cJSON *root, const char *json_key,
                                       const char *build_val)
 {
     char value[256] = {0};
-    bool found = false;
 
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
-        size_t len = sizeof(value);
-        if (nvs_get_str(nvs, nvs_key, value, &len) == ESP_OK) {
-            found = true;
-        }
-        nvs_close(nvs);
-    }
-
-    if (!found && build_val) {
+    if (config_get_str(ns, nvs_key, value, sizeof(value)) != ESP_OK && build_val) {
         strlcpy(value, build_val, sizeof(value));
     }
 
@@ -53,19 +45,11 @@ static void json_add_effective_config_u16(cJSON *root, const char *json_key,
                                           const char *build_val)
 {
     char value[16] = {0};
-    bool found = false;
-
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
-        uint16_t port = 0;
-        if (nvs_get_u16(nvs, nvs_key, &port) == ESP_OK && port > 0) {
-            snprintf(value, sizeof(value), "%u", (unsigned)port);
-            found = true;
-        }
-        nvs_close(nvs);
-    }
+    uint16_t port = 0;
 
-    if (!found && build_val) {
+    if (config_get_u16(ns, nvs_key, &port) == ESP_OK && port > 0) {
+        snprintf(value, sizeof(value), "%u", (unsigned)port);
+    } else if (build_val) {
         strlcpy(value, build_val, sizeof(value));
     }
 
@@ -76,101 +60,36 @@ static void json_add_effective_config_bool(cJSON *root, const char *json_key,
                                            const char *ns, const char *nvs_key,
                                            bool build_val)
 {
-    bool value = build_val;
-
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READONLY, &nvs) == ESP_OK) {
-        uint8_t bool_val = 0;
-        if (nvs_get_u8(nvs, nvs_key, &bool_val) == ESP_OK) {
-            value = bool_val ? true : false;
-        }
-        nvs_close(nvs);
-    }
-
-    cJSON_AddBoolToObject(root, json_key, value);
+    cJSON_AddBoolToObject(root, json_key, config_get_bool(ns, nvs_key, build_val));
 }
 
 static bool get_feature_bool(const char *nvs_key, bool default_val)
 {
-    bool value = default_val;
-
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_FEATURE, NVS_READONLY, &nvs) == ESP_OK) {
-        uint8_t bool_val = 0;
-        if (nvs_get_u8(nvs, nvs_key, &bool_val) == ESP_OK) {
-            value = bool_val ? true : false;
-        }
-        nvs_close(nvs);
-    }
-
-    return value;
+    return config_get_bool(MIMI_NVS_FEATURE, nvs_key, default_val);
 }
 
 static esp_err_t set_feature_bool(const char *nvs_key, bool value)
 {
-    nvs_handle_t nvs;
-    esp_err_t err = nvs_open(MIMI_NVS_FEATURE, NVS_READWRITE, &nvs);
-    if (err != ESP_OK) {
-        return err;
-    }
-
-    err = nvs_set_u8(nvs, nvs_key, value ? 1 : 0);
-    if (err == ESP_OK) {
-        err = nvs_commit(nvs);
-    }
-
-    nvs_close(nvs);
-    return err;
+    return config_set_u8(MIMI_NVS_FEATURE, nvs_key, value ? 1 : 0);
 }
 
 static const char *get_feature_str(const char *nvs_key, const char *default_val)
 {
     static char value[18] = {0};
-    strlcpy(value, default_val, sizeof(value));
-
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_FEATURE, NVS_READONLY, &nvs) == ESP_OK) {
-        size_t len = sizeof(value);
-        if (nvs_get_str(nvs, nvs_key, value, &len) == ESP_OK) {
-        }
-        nvs_close(nvs);
+    if (config_get_str(MIMI_NVS_FEATURE, nvs_key, value, sizeof(value)) != ESP_OK) {
+        strlcpy(value, default_val, sizeof(value));
     }
-
     return value;
 }
 
 static esp_err_t set_feature_str(const char *nvs_key, const char *value)
 {
-    nvs_handle_t nvs;
-    esp_err_t err = nvs_open(MIMI_NVS_FEATURE, NVS_READWRITE, &nvs);
-    if (err != ESP_OK) {
-        return err;
-    }
-
-    err = nvs_set_str(nvs, nvs_key, value);
-    if (err == ESP_OK) {
-        err = nvs_commit(nvs);
-    }
-
-    nvs_close(nvs);
-    return err;
+    return config_set_str(MIMI_NVS_FEATURE, nvs_key, value);
 }
 
 static esp_err_t set_feature_i32(const char *nvs_key, int value)
 {
-    nvs_handle_t nvs;
-    esp_err_t err = nvs_open(MIMI_NVS_FEATURE, NVS_READWRITE, &nvs);
-    if (err != ESP_OK) {
-        return err;
-    }
-
-    err = nvs_set_i32(nvs, nvs_key, (int32_t)value);
-    if (err == ESP_OK) {
-        err = nvs_commit(nvs);
-    }
-
-    nvs_close(nvs);
-    return err;
+    return config_set_i32(MIMI_NVS_FEATURE, nvs_key, (int32_t)value);
 }
 
 bool mimi_feature_telegram_bot_enabled(void)
@@ -305,6 +224,37 @@ static esp_err_t http_captive_redirect(httpd_req_t *req)
     return httpd_resp_send(req, NULL, 0);
 }
 
+/* Prometheus scrape target */
+static esp_err_t http_get_metrics(httpd_req_t *req)
+{
+    char *text = metrics_render();
+    if (!text) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    esp_err_t err = httpd_resp_send(req, text, HTTPD_RESP_USE_STRLEN);
+    free(text);
+    return err;
+}
+
+/* Chrome trace_event JSON of recent spans, for ui.perfetto.dev */
+static esp_err_t http_get_trace(httpd_req_t *req)
+{
+    char *json = trace_export_json();
+    if (!json) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"mimiclaw-trace.json\"");
+    esp_err_t err = httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    free(json);
+    return err;
+}
+
 static esp_err_t http_get_scan(httpd_req_t *req)
 {
     wifi_scan_config_t scan_cfg = {
@@ -398,26 +348,17 @@ static esp_err_t http_get_config(httpd_req_t *req)
 
     /* Buddy notification config */
     {
-        char value[128] = {0};
-        nvs_handle_t nvs;
-        if (nvs_open(MIMI_NVS_FEATURE, NVS_READONLY, &nvs) == ESP_OK) {
-            size_t len = sizeof(value);
-            if (nvs_get_str(nvs, MIMI_NVS_KEY_LAST_SRC_CHANNEL, value, &len) == ESP_OK) {
-                cJSON_AddStringToObject(root, "last_src_channel", value);
-            }
-            len = sizeof(value); value[0] = '\0';
-            if (nvs_get_str(nvs, MIMI_NVS_KEY_LAST_SRC_CHAT_ID, value, &len) == ESP_OK) {
-                cJSON_AddStringToObject(root, "last_src_chat_id", value);
-            }
-            len = sizeof(value); value[0] = '\0';
-            if (nvs_get_str(nvs, MIMI_NVS_KEY_BUDDY_NOTIFY_CHANNEL, value, &len) == ESP_OK) {
-                cJSON_AddStringToObject(root, "buddy_notify_channel", value);
-            }
-            len = sizeof(value); value[0] = '\0';
-            if (nvs_get_str(nvs, MIMI_NVS_KEY_BUDDY_NOTIFY_CHAT_ID, value, &len) == ESP_OK) {
-                cJSON_AddStringToObject(root, "buddy_notify_chat_id", value);
+        static const struct { const char *json_key; const char *nvs_key; } notify_keys[] = {
+            { "last_src_channel",     MIMI_NVS_KEY_LAST_SRC_CHANNEL },
+            { "last_src_chat_id",     MIMI_NVS_KEY_LAST_SRC_CHAT_ID },
+            { "buddy_notify_channel", MIMI_NVS_KEY_BUDDY_NOTIFY_CHANNEL },
+            { "buddy_notify_chat_id", MIMI_NVS_KEY_BUDDY_NOTIFY_CHAT_ID },
+        };
+        char value[128];
+        for (size_t i = 0; i < sizeof(notify_keys) / sizeof(notify_keys[0]); i++) {
+            if (config_get_str(MIMI_NVS_FEATURE, notify_keys[i].nvs_key, value, sizeof(value)) == ESP_OK) {
+                cJSON_AddStringToObject(root, notify_keys[i].json_key, value);
             }
-            nvs_close(nvs);
         }
     }
 
@@ -435,110 +376,89 @@ static esp_err_t http_get_config(httpd_req_t *req)
     return ret;
 }
 
+static void clear_field(const char *ns, const char *nvs_key)
+{
+    esp_err_t err = config_erase(ns, nvs_key);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Cleared %s/%s", ns, nvs_key);
+    } else if (err != ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "Failed clearing %s/%s: %s", ns, nvs_key, esp_err_to_name(err));
+    }
+}
+
 /*
- * Sync one JSON string field into NVS.
- * - missing field: leave current NVS value unchanged
- * - empty string: erase current NVS value
- * - non-empty string: save/update current NVS value
+ * Sync one JSON string field into the config registry.
+ * - missing field: leave current value unchanged
+ * - empty string: erase current value
+ * - non-empty string: save/update current value
  */
-static void nvs_sync_field(cJSON *root, const char *json_key,
-                           const char *ns, const char *nvs_key)
+static void sync_field(cJSON *root, const char *json_key,
+                       const char *ns, const char *nvs_key)
 {
     cJSON *item = cJSON_GetObjectItem(root, json_key);
     if (!item || !cJSON_IsString(item)) return;
 
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READWRITE, &nvs) == ESP_OK) {
-        if (item->valuestring[0] == '\0') {
-            esp_err_t err = nvs_erase_key(nvs, nvs_key);
-            if (err == ESP_OK) {
-                ESP_LOGI(TAG, "Cleared %s/%s", ns, nvs_key);
-            } else if (err != ESP_ERR_NVS_NOT_FOUND) {
-                ESP_LOGW(TAG, "Failed clearing %s/%s: %s", ns, nvs_key, esp_err_to_name(err));
-            }
-        } else {
-            nvs_set_str(nvs, nvs_key, item->valuestring);
-            ESP_LOGI(TAG, "Saved %s/%s", ns, nvs_key);
-        }
-        nvs_commit(nvs);
-        nvs_close(nvs);
+    if (item->valuestring[0] == '\0') {
+        clear_field(ns, nvs_key);
+    } else if (config_set_str(ns, nvs_key, item->valuestring) == ESP_OK) {
+        ESP_LOGI(TAG, "Saved %s/%s", ns, nvs_key);
     }
 }
 
-static void nvs_sync_u16_field(cJSON *root, const char *json_key,
-                               const char *ns, const char *nvs_key)
+static void sync_u16_field(cJSON *root, const char *json_key,
+                           const char *ns, const char *nvs_key)
 {
     cJSON *item = cJSON_GetObjectItem(root, json_key);
     if (!item || (!cJSON_IsString(item) && !cJSON_IsNumber(item))) return;
 
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READWRITE, &nvs) == ESP_OK) {
-        if (cJSON_IsString(item) && item->valuestring[0] == '\0') {
-            esp_err_t err = nvs_erase_key(nvs, nvs_key);
-            if (err == ESP_OK) {
-                ESP_LOGI(TAG, "Cleared %s/%s", ns, nvs_key);
-            } else if (err != ESP_ERR_NVS_NOT_FOUND) {
-                ESP_LOGW(TAG, "Failed clearing %s/%s: %s", ns, nvs_key, esp_err_to_name(err));
-            }
-        } else {
-            uint16_t value = 0;
-            bool valid = true;
-
-            if (cJSON_IsString(item)) {
-                char *end = NULL;
-                unsigned long ul_value = strtoul(item->valuestring, &end, 10);
-                if (end == item->valuestring || *end != '\0' || ul_value > UINT16_MAX) {
-                    ESP_LOGW(TAG, "Ignoring invalid %s value: %s", json_key, item->valuestring);
-                    valid = false;
-                } else {
-                    value = (uint16_t)ul_value;
-                }
-            } else if (cJSON_IsNumber(item)) {
-                if (item->valuedouble < 0 || item->valuedouble > UINT16_MAX) {
-                    ESP_LOGW(TAG, "Ignoring invalid %s value: %f", json_key, item->valuedouble);
-                    valid = false;
-                } else {
-                    value = (uint16_t)item->valuedouble;
-                }
-            }
+    if (cJSON_IsString(item) && item->valuestring[0] == '\0') {
+        clear_field(ns, nvs_key);
+        return;
+    }
 
-            if (valid) {
-                ESP_ERROR_CHECK(nvs_set_u16(nvs, nvs_key, value));
-                ESP_LOGI(TAG, "Saved %s/%s", ns, nvs_key);
-            }
+    uint16_t value = 0;
+    if (cJSON_IsString(item)) {
+        char *end = NULL;
+        unsigned long ul_value = strtoul(item->valuestring, &end, 10);
+        if (end == item->valuestring || *end != '\0' || ul_value > UINT16_MAX) {
+            ESP_LOGW(TAG, "Ignoring invalid %s value: %s", json_key, item->valuestring);
+            return;
         }
-        nvs_commit(nvs);
-        nvs_close(nvs);
+        value = (uint16_t)ul_value;
+    } else {
+        if (item->valuedouble < 0 || item->valuedouble > UINT16_MAX) {
+            ESP_LOGW(TAG, "Ignoring invalid %s value: %f", json_key, item->valuedouble);
+            return;
+        }
+        value = (uint16_t)item->valuedouble;
+    }
+
+    if (config_set_u16(ns, nvs_key, value) == ESP_OK) {
+        ESP_LOGI(TAG, "Saved %s/%s", ns, nvs_key);
     }
 }
 
-static void nvs_sync_bool_field(cJSON *root, const char *json_key,
-                               const char *ns, const char *nvs_key)
+static void sync_bool_field(cJSON *root, const char *json_key,
+                            const char *ns, const char *nvs_key)
 {
     cJSON *item = cJSON_GetObjectItem(root, json_key);
     if (!item) return;
 
-    nvs_handle_t nvs;
-    if (nvs_open(ns, NVS_READWRITE, &nvs) == ESP_OK) {
-        if (cJSON_IsBool(item)) {
-            ESP_ERROR_CHECK(nvs_set_u8(nvs, nvs_key, item->valueint ? 1 : 0));
-            ESP_LOGI(TAG, "Saved %s/%s: %s", ns, nvs_key, item->valueint ? "true" : "false");
-        } else if (cJSON_IsString(item)) {
-            if (item->valuestring[0] == '\0') {
-                esp_err_t err = nvs_erase_key(nvs, nvs_key);
-                if (err == ESP_OK) {
-                    ESP_LOGI(TAG, "Cleared %s/%s", ns, nvs_key);
-                } else if (err != ESP_ERR_NVS_NOT_FOUND) {
-                    ESP_LOGW(TAG, "Failed clearing %s/%s: %s", ns, nvs_key, esp_err_to_name(err));
-                }
-            } else {
-                bool value = (strcmp(item->valuestring, "true") == 0 || strcmp(item->valuestring, "1") == 0);
-                ESP_ERROR_CHECK(nvs_set_u8(nvs, nvs_key, value ? 1 : 0));
-                ESP_LOGI(TAG, "Saved %s/%s: %s", ns, nvs_key, value ? "true" : "false");
-            }
+    bool value;
+    if (cJSON_IsBool(item)) {
+        value = item->valueint;
+    } else if (cJSON_IsString(item)) {
+        if (item->valuestring[0] == '\0') {
+            clear_field(ns, nvs_key);
+            return;
         }
-        nvs_commit(nvs);
-        nvs_close(nvs);
+        value = (strcmp(item->valuestring, "true") == 0 || strcmp(item->valuestring, "1") == 0);
+    } else {
+        return;
+    }
+
+    if (config_set_u8(ns, nvs_key, value ? 1 : 0) == ESP_OK) {
+        ESP_LOGI(TAG, "Saved %s/%s: %s", ns, nvs_key, value ? "true" : "false");
     }
 }
 
@@ -575,38 +495,38 @@ static esp_err_t http_post_save(httpd_req_t *req)
     }
 
     /* WiFi (required) */
-    nvs_sync_field(root, "ssid",     MIMI_NVS_WIFI,   MIMI_NVS_KEY_SSID);
-    nvs_sync_field(root, "password", MIMI_NVS_WIFI,   MIMI_NVS_KEY_PASS);
+    sync_field(root, "ssid",     MIMI_NVS_WIFI,   MIMI_NVS_KEY_SSID);
+    sync_field(root, "password", MIMI_NVS_WIFI,   MIMI_NVS_KEY_PASS);
 
     /* LLM */
-    nvs_sync_field(root, "api_key",  MIMI_NVS_LLM,    MIMI_NVS_KEY_API_KEY);
-    nvs_sync_field(root, "model",    MIMI_NVS_LLM,    MIMI_NVS_KEY_MODEL);
-    nvs_sync_field(root, "provider", MIMI_NVS_LLM,    MIMI_NVS_KEY_PROVIDER);
-    nvs_sync_field(root, "system_prompt", MIMI_NVS_LLM, MIMI_NVS_KEY_SYSTEM_PROMPT);
+    sync_field(root, "api_key",  MIMI_NVS_LLM,    MIMI_NVS_KEY_API_KEY);
+    sync_field(root, "model",    MIMI_NVS_LLM,    MIMI_NVS_KEY_MODEL);
+    sync_field(root, "provider", MIMI_NVS_LLM,    MIMI_NVS_KEY_PROVIDER);
+    sync_field(root, "system_prompt", MIMI_NVS_LLM, MIMI_NVS_KEY_SYSTEM_PROMPT);
 
     /* Telegram */
-    nvs_sync_field(root, "tg_token", MIMI_NVS_TG,     MIMI_NVS_KEY_TG_TOKEN);
+    sync_field(root, "tg_token", MIMI_NVS_TG,     MIMI_NVS_KEY_TG_TOKEN);
 
     /* Feishu */
-    nvs_sync_field(root, "feishu_app_id",     MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_ID);
-    nvs_sync_field(root, "feishu_app_secret", MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_SECRET);
+    sync_field(root, "feishu_app_id",     MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_ID);
+    sync_field(root, "feishu_app_secret", MIMI_NVS_FEISHU, MIMI_NVS_KEY_FEISHU_APP_SECRET);
 
     /* Proxy */
-    nvs_sync_field(root, "proxy_host", MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_HOST);
-    nvs_sync_u16_field(root, "proxy_port", MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_PORT);
-    nvs_sync_field(root, "proxy_type", MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_TYPE);
+    sync_field(root, "proxy_host", MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_HOST);
+    sync_u16_field(root, "proxy_port", MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_PORT);
+    sync_field(root, "proxy_type", MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_TYPE);
 
     /* Search */
-    nvs_sync_field(root, "search_key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY);
-    nvs_sync_field(root, "tavily_key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_TAVILY_KEY);
+    sync_field(root, "search_key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY);
+    sync_field(root, "tavily_key", MIMI_NVS_SEARCH, MIMI_NVS_KEY_TAVILY_KEY);
 
     /* Feature toggles */
-    nvs_sync_bool_field(root, "telegram_bot", MIMI_NVS_FEATURE, MIMI_NVS_KEY_TELEGRAM_BOT);
-    nvs_sync_bool_field(root, "feishu_bot", MIMI_NVS_FEATURE, MIMI_NVS_KEY_FEISHU_BOT);
+    sync_bool_field(root, "telegram_bot", MIMI_NVS_FEATURE, MIMI_NVS_KEY_TELEGRAM_BOT);
+    sync_bool_field(root, "feishu_bot", MIMI_NVS_FEATURE, MIMI_NVS_KEY_FEISHU_BOT);
 
     /* Buddy notification */
-    nvs_sync_field(root, "buddy_notify_channel", MIMI_NVS_FEATURE, MIMI_NVS_KEY_BUDDY_NOTIFY_CHANNEL);
-    nvs_sync_field(root, "buddy_notify_chat_id", MIMI_NVS_FEATURE, MIMI_NVS_KEY_BUDDY_NOTIFY_CHAT_ID);
+    sync_field(root, "buddy_notify_channel", MIMI_NVS_FEATURE, MIMI_NVS_KEY_BUDDY_NOTIFY_CHANNEL);
+    sync_field(root, "buddy_notify_chat_id", MIMI_NVS_FEATURE, MIMI_NVS_KEY_BUDDY_NOTIFY_CHAT_ID);
 
     /* Buddy profile */
     {
@@ -644,6 +564,7 @@ static esp_err_t http_post_save(httpd_req_t *req)
     }
 
     cJSON_Delete(root);
+    config_flush();     /* persist before acknowledging */
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, "{\"ok\":true}", 11);
@@ -735,6 +656,16 @@ static httpd_handle_t start_http_server(bool captive)
     };
     httpd_register_uri_handler(s_server, &uri_config);
 
+    httpd_uri_t uri_metrics = {
+        .uri = "/metrics", .method = HTTP_GET, .handler = http_get_metrics,
+    };
+    httpd_register_uri_handler(s_server, &uri_metrics);
+
+    httpd_uri_t uri_trace = {
+        .uri = "/trace", .method = HTTP_GET, .handler = http_get_trace,
+    };
+    httpd_register_uri_handler(s_server, &uri_trace);
+
     /* WiFi scan */
     httpd_uri_t uri_scan = {
         .uri = "/scan", .method = HTTP_GET, .handler = http_get_scan,
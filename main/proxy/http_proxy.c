@@ -1,5 +1,6 @@
 #include "http_proxy.h"
 #include "mimi_config.h"
+#include "config/config_registry.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -9,7 +10,6 @@
 #include <unistd.h>
 
 #include "esp_log.h"
-#include "nvs.h"
 #include "esp_tls.h"
 #include "esp_crt_bundle.h"
 #include "freertos/FreeRTOS.h"
@@ -43,18 +43,13 @@ esp_err_t http_proxy_init(void)
     }
 
     /* NVS overrides take highest priority (set via CLI) */
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_PROXY, NVS_READONLY, &nvs) == ESP_OK) {
-        char tmp[64] = {0};
-        size_t len = sizeof(tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_PROXY_HOST, tmp, &len) == ESP_OK && tmp[0]) {
-            strncpy(s_proxy_host, tmp, sizeof(s_proxy_host) - 1);
-            uint16_t port = 0;
-            if (nvs_get_u16(nvs, MIMI_NVS_KEY_PROXY_PORT, &port) == ESP_OK && port) {
-                s_proxy_port = port;
-            }
+    char tmp[64] = {0};
+    if (config_get_str(MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_HOST, tmp, sizeof(tmp)) == ESP_OK && tmp[0]) {
+        strncpy(s_proxy_host, tmp, sizeof(s_proxy_host) - 1);
+        uint16_t port = 0;
+        if (config_get_u16(MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_PORT, &port) == ESP_OK && port) {
+            s_proxy_port = port;
         }
-        nvs_close(nvs);
     }
 
     if (s_proxy_host[0] && s_proxy_port) {
@@ -86,12 +81,9 @@ void http_proxy_http_unlock(void)
 
 esp_err_t http_proxy_set(const char *host, uint16_t port)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_PROXY, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_PROXY_HOST, host));
-    ESP_ERROR_CHECK(nvs_set_u16(nvs, MIMI_NVS_KEY_PROXY_PORT, port));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_err_t err = config_set_str(MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_HOST, host);
+    if (err == ESP_OK) err = config_set_u16(MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_PORT, port);
+    if (err != ESP_OK) return err;
 
     strncpy(s_proxy_host, host, sizeof(s_proxy_host) - 1);
     s_proxy_port = port;
@@ -101,12 +93,8 @@ esp_err_t http_proxy_set(const char *host, uint16_t port)
 
 esp_err_t http_proxy_clear(void)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_PROXY, NVS_READWRITE, &nvs));
-    nvs_erase_key(nvs, MIMI_NVS_KEY_PROXY_HOST);
-    nvs_erase_key(nvs, MIMI_NVS_KEY_PROXY_PORT);
-    nvs_commit(nvs);
-    nvs_close(nvs);
+    config_erase(MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_HOST);
+    config_erase(MIMI_NVS_PROXY, MIMI_NVS_KEY_PROXY_PORT);
 
     s_proxy_host[0] = '\0';
     s_proxy_port = 0;
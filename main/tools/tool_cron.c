@@ -1,10 +1,13 @@
 #include "tools/tool_cron.h"
 #include "cron/cron_service.h"
 #include "bus/message_bus.h"
+#include "mimi_config.h"
 
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include "esp_log.h"
+#include "esp_heap_caps.h"
 #include "cJSON.h"
 
 static const char *TAG = "tool_cron";
@@ -86,8 +89,30 @@ esp_err_t tool_cron_add_execute(const char *input_json, char *output, size_t out
         /* Default: delete one-shot jobs after run */
         cJSON *delete_j = cJSON_GetObjectItem(root, "delete_after_run");
         job.delete_after_run = delete_j ? cJSON_IsTrue(delete_j) : true;
+    } else if (strcmp(schedule_type, "cron") == 0) {
+        job.kind = CRON_KIND_CRON;
+        const char *expr = cJSON_GetStringValue(cJSON_GetObjectItem(root, "expr"));
+        if (!expr || strlen(expr) == 0 || strlen(expr) >= sizeof(job.expr)) {
+            snprintf(output, output_size,
+                     "Error: 'cron' schedule requires 'expr' (5 fields: minute hour day month weekday)");
+            cJSON_Delete(root);
+            return ESP_ERR_INVALID_ARG;
+        }
+        char err[96];
+        if (cron_expr_parse(expr, &job.spec, err, sizeof(err)) != ESP_OK) {
+            snprintf(output, output_size, "Error: invalid cron expression '%s': %s", expr, err);
+            cJSON_Delete(root);
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (cron_expr_next(&job.spec, time(NULL)) == 0) {
+            snprintf(output, output_size, "Error: cron expression '%s' never matches", expr);
+            cJSON_Delete(root);
+            return ESP_ERR_INVALID_ARG;
+        }
+        strncpy(job.expr, expr, sizeof(job.expr) - 1);
+        job.delete_after_run = false;
     } else {
-        snprintf(output, output_size, "Error: schedule_type must be 'every' or 'at'");
+        snprintf(output, output_size, "Error: schedule_type must be 'every', 'at' or 'cron'");
         cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
     }
@@ -105,6 +130,10 @@ esp_err_t tool_cron_add_execute(const char *input_json, char *output, size_t out
         snprintf(output, output_size,
                  "OK: Added recurring job '%s' (id=%s), runs every %lu seconds. Next run at epoch %lld.",
                  job.name, job.id, (unsigned long)job.interval_s, (long long)job.next_run);
+    } else if (job.kind == CRON_KIND_CRON) {
+        snprintf(output, output_size,
+                 "OK: Added cron job '%s' (id=%s), schedule '%s' in local time (%s). Next run at epoch %lld.",
+                 job.name, job.id, job.expr, MIMI_TIMEZONE, (long long)job.next_run);
     } else {
         snprintf(output, output_size,
                  "OK: Added one-shot job '%s' (id=%s), fires at epoch %lld.%s",
@@ -122,11 +151,16 @@ esp_err_t tool_cron_list_execute(const char *input_json, char *output, size_t ou
 {
     (void)input_json;
 
-    const cron_job_t *jobs;
-    int count;
-    cron_list_jobs(&jobs, &count);
+    cron_job_t *jobs = heap_caps_calloc(MIMI_CRON_MAX_JOBS, sizeof(cron_job_t), MALLOC_CAP_SPIRAM);
+    if (!jobs) {
+        snprintf(output, output_size, "Error: out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+    int count = cron_list_jobs(jobs, MIMI_CRON_MAX_JOBS);
+    if (count > MIMI_CRON_MAX_JOBS) count = MIMI_CRON_MAX_JOBS;
 
     if (count == 0) {
+        free(jobs);
         snprintf(output, output_size, "No cron jobs scheduled.");
         return ESP_OK;
     }
@@ -146,6 +180,13 @@ esp_err_t tool_cron_list_execute(const char *input_json, char *output, size_t ou
                 j->enabled ? "enabled" : "disabled",
                 (long long)j->next_run, (long long)j->last_run,
                 j->channel, j->chat_id);
+        } else if (j->kind == CRON_KIND_CRON) {
+            off += snprintf(output + off, output_size - off,
+                "  %d. [%s] \"%s\" — cron '%s', %s, next=%lld, last=%lld, ch=%s:%s\n",
+                i + 1, j->id, j->name, j->expr,
+                j->enabled ? "enabled" : "disabled",
+                (long long)j->next_run, (long long)j->last_run,
+                j->channel, j->chat_id);
         } else {
             off += snprintf(output + off, output_size - off,
                 "  %d. [%s] \"%s\" — at %lld, %s, last=%lld, ch=%s:%s%s\n",
@@ -157,6 +198,7 @@ esp_err_t tool_cron_list_execute(const char *input_json, char *output, size_t ou
                 j->delete_after_run ? " (auto-delete)" : "");
         }
     }
+    free(jobs);
 
     ESP_LOGI(TAG, "cron_list: %d jobs", count);
     return ESP_OK;
@@ -0,0 +1,133 @@
+#include "tools/tool_daemon.h"
+#include "lua/lua_daemon.h"
+#include "lua/lua_cache.h"
+#include "bus/message_bus.h"
+#include "mimi_config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "cJSON.h"
+
+static const char *TAG = "tool_daemon";
+
+#define SCRIPTS_PREFIX "/spiffs/scripts/"
+
+/* ── daemon_start ─────────────────────────────────────────────── */
+
+esp_err_t tool_daemon_start_execute(const char *input_json, char *output, size_t output_size)
+{
+    cJSON *root = cJSON_Parse(input_json);
+    if (!root) {
+        snprintf(output, output_size, "Error: invalid JSON input");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *path = cJSON_GetStringValue(cJSON_GetObjectItem(root, "path"));
+    if (!path || strncmp(path, SCRIPTS_PREFIX, strlen(SCRIPTS_PREFIX)) != 0 ||
+        strlen(path) <= strlen(SCRIPTS_PREFIX) || strstr(path, "..") ||
+        lua_cache_is_cache_path(path)) {
+        snprintf(output, output_size, "Error: path must be a script under %s", SCRIPTS_PREFIX);
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    /* Default name: file name without the .lua extension */
+    char name[32] = {0};
+    const char *name_in = cJSON_GetStringValue(cJSON_GetObjectItem(root, "name"));
+    if (name_in && name_in[0]) {
+        strncpy(name, name_in, sizeof(name) - 1);
+    } else {
+        const char *base = strrchr(path, '/') + 1;
+        size_t len = strlen(base);
+        if (len > 4 && strcmp(base + len - 4, ".lua") == 0) len -= 4;
+        if (len >= sizeof(name)) len = sizeof(name) - 1;
+        memcpy(name, base, len);
+    }
+
+    const char *channel = cJSON_GetStringValue(cJSON_GetObjectItem(root, "channel"));
+    const char *chat_id = cJSON_GetStringValue(cJSON_GetObjectItem(root, "chat_id"));
+    if (channel && strcmp(channel, MIMI_CHAN_TELEGRAM) == 0 && (!chat_id || !chat_id[0])) {
+        snprintf(output, output_size,
+                 "Error: daemon_start with channel='telegram' requires a valid chat_id");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char err_msg[160] = {0};
+    esp_err_t err = lua_daemon_start(name, path, channel, chat_id, err_msg, sizeof(err_msg));
+    if (err == ESP_OK) {
+        snprintf(output, output_size,
+                 "OK: Daemon '%s' running %s. Its notify() messages arrive as new turns.",
+                 name, path);
+    } else {
+        snprintf(output, output_size, "Error: daemon '%s' not started: %s",
+                 name, err_msg[0] ? err_msg : esp_err_to_name(err));
+    }
+    cJSON_Delete(root);
+
+    ESP_LOGI(TAG, "daemon_start: %s -> %s", name, esp_err_to_name(err));
+    return err;
+}
+
+/* ── daemon_stop ──────────────────────────────────────────────── */
+
+esp_err_t tool_daemon_stop_execute(const char *input_json, char *output, size_t output_size)
+{
+    cJSON *root = cJSON_Parse(input_json);
+    if (!root) {
+        snprintf(output, output_size, "Error: invalid JSON input");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char *name = cJSON_GetStringValue(cJSON_GetObjectItem(root, "name"));
+    if (!name || strlen(name) == 0) {
+        snprintf(output, output_size, "Error: missing 'name' field");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = lua_daemon_stop(name);
+    if (err == ESP_OK) {
+        snprintf(output, output_size, "OK: Stopped daemon '%s'", name);
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        snprintf(output, output_size, "Error: no daemon named '%s' is running", name);
+    } else {
+        snprintf(output, output_size, "Error: failed to stop daemon (%s)", esp_err_to_name(err));
+    }
+
+    ESP_LOGI(TAG, "daemon_stop: %s -> %s", name, esp_err_to_name(err));
+    cJSON_Delete(root);
+    return err;
+}
+
+/* ── daemon_list ──────────────────────────────────────────────── */
+
+esp_err_t tool_daemon_list_execute(const char *input_json, char *output, size_t output_size)
+{
+    (void)input_json;
+
+    lua_daemon_info_t list[MIMI_LUA_DAEMON_MAX];
+    int count = lua_daemon_list(list, MIMI_LUA_DAEMON_MAX);
+    if (count == 0) {
+        snprintf(output, output_size, "No daemons running.");
+        return ESP_OK;
+    }
+
+    size_t off = 0;
+    off += snprintf(output + off, output_size - off, "Running daemons (%d):\n", count);
+    for (int i = 0; i < count && off < output_size - 1; i++) {
+        const lua_daemon_info_t *d = &list[i];
+        off += snprintf(output + off, output_size - off,
+            "  %d. \"%s\" — %s, up %lus, %d callbacks subscribed, runs=%lu, errors=%lu, "
+            "notifies=%lu, instructions=%llu, ch=%s:%s%s%s\n",
+            i + 1, d->name, d->path, (unsigned long)d->uptime_s, d->subscriptions,
+            (unsigned long)d->callbacks, (unsigned long)d->errors,
+            (unsigned long)d->notifies, (unsigned long long)d->instructions,
+            d->channel, d->chat_id,
+            d->last_error[0] ? ", last error: " : "", d->last_error);
+    }
+
+    ESP_LOGI(TAG, "daemon_list: %d daemons", count);
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+
+/**
+ * Start a Lua daemon from a script in SPIFFS.
+ * Input JSON: { path, name?, channel?, chat_id? }
+ * name defaults to the script's file name without ".lua".
+ */
+esp_err_t tool_daemon_start_execute(const char *input_json, char *output, size_t output_size);
+
+/**
+ * Stop a running Lua daemon.
+ * Input JSON: { name }
+ */
+esp_err_t tool_daemon_stop_execute(const char *input_json, char *output, size_t output_size);
+
+/**
+ * List running Lua daemons with their counters.
+ * Input JSON: {} (no required fields)
+ */
+esp_err_t tool_daemon_list_execute(const char *input_json, char *output, size_t output_size);
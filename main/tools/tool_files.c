@@ -1,5 +1,6 @@
 #include "tools/tool_files.h"
 #include "mimi_config.h"
+#include "lua/lua_cache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -289,6 +290,7 @@ esp_err_t tool_write_file_execute(const char *input_json, char *output, size_t o
     }
 
     snprintf(output, output_size, "OK: wrote %d bytes to %s", (int)written, path);
+    lua_cache_invalidate(path);
     ESP_LOGI(TAG, "write_file: %s (%d bytes)", path, (int)written);
     cJSON_Delete(root);
     return ESP_OK;
@@ -392,6 +394,7 @@ esp_err_t tool_edit_file_execute(const char *input_json, char *output, size_t ou
     free(result);
 
     snprintf(output, output_size, "OK: edited %s (replaced %d bytes with %d bytes)", path, (int)old_len, (int)new_len);
+    lua_cache_invalidate(path);
     ESP_LOGI(TAG, "edit_file: %s", path);
     cJSON_Delete(root);
     return ESP_OK;
@@ -6,13 +6,21 @@
 #include "tools/tool_http_request.h"
 
 #include "tools/tool_script.h"
+#include "tools/tool_daemon.h"
 #include "sdkconfig.h"
 
 #include <string.h>
+#include <stdio.h>
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "cJSON.h"
 
 #include "mimi_config.h"
+#include "metrics/metrics.h"
+#include "trace/trace.h"
+#include "heapprof/heap_prof.h"
 #include "onboard/wifi_onboard.h"
 
 static const char *TAG = "tools";
@@ -20,15 +28,28 @@ static const char *TAG = "tools";
 #define MAX_TOOLS 20
 
 static mimi_tool_t s_tools[MAX_TOOLS];
+static metric_t *s_tool_ms[MAX_TOOLS];
+static metric_t *s_tool_errors[MAX_TOOLS];
 static int s_tool_count = 0;
 static char *s_tools_json = NULL;  /* cached JSON array string */
 
+/* Progress callback and the task whose tool calls it serves */
+static tool_progress_fn_t s_progress_fn = NULL;
+static void *s_progress_arg = NULL;
+static TaskHandle_t s_progress_task = NULL;
+
 static void register_tool(const mimi_tool_t *tool)
 {
     if (s_tool_count >= MAX_TOOLS) {
         ESP_LOGE(TAG, "Tool registry full");
         return;
     }
+    char labels[48];
+    snprintf(labels, sizeof(labels), "tool=\"%s\"", tool->name);
+    s_tool_ms[s_tool_count] = metrics_histogram("mimi_tool_duration_ms", "Tool execution latency",
+                                                labels, METRICS_MS_BUCKETS, METRICS_MS_BUCKETS_N);
+    s_tool_errors[s_tool_count] = metrics_counter("mimi_tool_errors_total",
+                                                  "Tool executions returning an error", labels);
     s_tools[s_tool_count++] = *tool;
     ESP_LOGI(TAG, "Registered tool: %s", tool->name);
 }
@@ -141,14 +162,15 @@ esp_err_t tool_registry_init(void)
     /* Register cron_add */
     mimi_tool_t ca = {
         .name = "cron_add",
-        .description = "Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires.",
+        .description = "Schedule a recurring or one-shot task. The message will trigger an agent turn when the job fires. Use schedule_type 'cron' for calendar schedules such as weekdays at 9:00 local time.",
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{"
             "\"name\":{\"type\":\"string\",\"description\":\"Short name for the job\"},"
-            "\"schedule_type\":{\"type\":\"string\",\"description\":\"'every' for recurring interval or 'at' for one-shot at a unix timestamp\"},"
+            "\"schedule_type\":{\"type\":\"string\",\"enum\":[\"every\",\"at\",\"cron\"],\"description\":\"'every' for recurring interval, 'at' for one-shot at a unix timestamp, 'cron' for a cron expression\"},"
             "\"interval_s\":{\"type\":\"integer\",\"description\":\"Interval in seconds (required for 'every')\"},"
             "\"at_epoch\":{\"type\":\"integer\",\"description\":\"Unix timestamp to fire at (required for 'at')\"},"
+            "\"expr\":{\"type\":\"string\",\"description\":\"Cron expression 'minute hour day month weekday' in device local time, e.g. '0 9 * * 1-5' (required for 'cron'). Supports *, lists, ranges, /step, jan-dec, sun-sat and @hourly/@daily/@weekly/@monthly/@yearly\"},"
             "\"message\":{\"type\":\"string\",\"description\":\"Message to inject when the job fires, triggering an agent turn\"},"
             "\"channel\":{\"type\":\"string\",\"description\":\"Optional reply channel (e.g. 'telegram' or 'feishu'). Defaults to 'system'\"},"
             "\"chat_id\":{\"type\":\"string\",\"description\":\"Optional reply chat_id. Defaults to 'cron'\"}"
@@ -218,12 +240,13 @@ esp_err_t tool_registry_init(void)
     /* Register script_run */
     mimi_tool_t sr = {
         .name = "script_run",
-        .description = "Execute a Lua script on the ESP32-S3 with component Lua libs pre-registered. Returns stdout output or error message.",
+        .description = "Execute a Lua script on the ESP32-S3 with component Lua libs pre-registered. Returns stdout output or error message, and stats (instructions, peak_bytes, duration_ms, limit when a sandbox limit stopped it). With background=true it returns an id at once and the script runs alongside others, sleep.ms yielding; follow it with script_ps, stop it with script_kill.",
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{"
             "\"path\":{\"type\":\"string\",\"description\":\"e.g. /spiffs/scripts/blink.lua\"},"
-            "\"timeout_ms\":{\"type\":\"integer\",\"description\":\"Max execution time in ms (default 5000)\"}"
+            "\"timeout_ms\":{\"type\":\"integer\",\"description\":\"Max execution time in ms (default 5000, 600000 in the background)\"},"
+            "\"background\":{\"type\":\"boolean\",\"description\":\"Run without waiting for the result (default false)\"}"
             "},"
             "\"required\":[\"path\"]}",
         .execute = tool_script_run_execute,
@@ -245,6 +268,71 @@ esp_err_t tool_registry_init(void)
     };
     register_tool(&swr);
 
+    /* Register daemon_start */
+    mimi_tool_t ds = {
+        .name = "daemon_start",
+        .description = "Start a long-lived Lua daemon from a script in /spiffs/scripts/. The script's top level subscribes callbacks with daemon.every/after/on_gpio/on_ble/on_camera and calls daemon.notify(text) to start a new turn only when something noteworthy happens. Daemons survive reboots until stopped.",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{"
+            "\"path\":{\"type\":\"string\",\"description\":\"e.g. /spiffs/scripts/door.lua\"},"
+            "\"name\":{\"type\":\"string\",\"description\":\"Daemon name (default: script file name)\"},"
+            "\"channel\":{\"type\":\"string\",\"description\":\"Channel for notify turns (e.g. telegram). Defaults to system\"},"
+            "\"chat_id\":{\"type\":\"string\",\"description\":\"Chat ID for notify turns. Required when channel='telegram'\"}"
+            "},"
+            "\"required\":[\"path\"]}",
+        .execute = tool_daemon_start_execute,
+    };
+    register_tool(&ds);
+
+    /* Register daemon_stop */
+    mimi_tool_t dst = {
+        .name = "daemon_stop",
+        .description = "Stop a running Lua daemon by name.",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{\"name\":{\"type\":\"string\",\"description\":\"Daemon name from daemon_list\"}},"
+            "\"required\":[\"name\"]}",
+        .execute = tool_daemon_stop_execute,
+    };
+    register_tool(&dst);
+
+    /* Register daemon_list */
+    mimi_tool_t dl = {
+        .name = "daemon_list",
+        .description = "List running Lua daemons with callback, error and notify counts.",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{},"
+            "\"required\":[]}",
+        .execute = tool_daemon_list_execute,
+    };
+    register_tool(&dl);
+
+    /* Register script_ps */
+    mimi_tool_t sps = {
+        .name = "script_ps",
+        .description = "List background Lua scripts (script_run with background=true): id, status (ready, sleeping, done, failed, killed), run time, instructions, peak memory and the tail of their output.",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{},"
+            "\"required\":[]}",
+        .execute = tool_script_ps_execute,
+    };
+    register_tool(&sps);
+
+    /* Register script_kill */
+    mimi_tool_t sk = {
+        .name = "script_kill",
+        .description = "Stop a running background Lua script by id; pins and PWM it claimed are released.",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{\"id\":{\"type\":\"integer\",\"description\":\"Script id from script_run or script_ps\"}},"
+            "\"required\":[\"id\"]}",
+        .execute = tool_script_kill_execute,
+    };
+    register_tool(&sk);
+
     // After registering all tools, build the JSON array string
     build_tools_json();
 
@@ -263,7 +351,14 @@ esp_err_t tool_registry_execute(const char *name, const char *input_json,
     for (int i = 0; i < s_tool_count; i++) {
         if (strcmp(s_tools[i].name, name) == 0) {
             ESP_LOGI(TAG, "Executing tool: %s", name);
-            return s_tools[i].execute(input_json, output, output_size);
+            int64_t start_us = esp_timer_get_time();
+            heap_tag_t heap_prev = heap_prof_scope_begin(HEAP_TAG_TOOLS);
+            esp_err_t err = s_tools[i].execute(input_json, output, output_size);
+            heap_prof_scope_end(heap_prev);
+            trace_record("tool", s_tools[i].name, start_us, esp_timer_get_time());
+            metric_observe_since(s_tool_ms[i], start_us);
+            if (err != ESP_OK) metric_inc(s_tool_errors[i]);
+            return err;
         }
     }
 
@@ -271,3 +366,19 @@ esp_err_t tool_registry_execute(const char *name, const char *input_json,
     snprintf(output, output_size, "Error: unknown tool '%s'", name);
     return ESP_ERR_NOT_FOUND;
 }
+
+void tool_registry_set_progress(tool_progress_fn_t fn, void *arg)
+{
+    s_progress_fn = NULL;
+    s_progress_arg = arg;
+    s_progress_task = fn ? xTaskGetCurrentTaskHandle() : NULL;
+    s_progress_fn = fn;
+}
+
+void tool_registry_progress(const char *text, size_t len)
+{
+    /* Tools run from the CLI on another task never reach the agent's chat */
+    if (!s_progress_fn || !text || len == 0) return;
+    if (xTaskGetCurrentTaskHandle() != s_progress_task) return;
+    s_progress_fn(text, len, s_progress_arg);
+}
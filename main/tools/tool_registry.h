@@ -32,3 +32,18 @@ const char *tool_registry_get_tools_json(void);
  */
 esp_err_t tool_registry_execute(const char *name, const char *input_json,
                                 char *output, size_t output_size);
+
+/** Partial output of a running tool, see tool_registry_progress(). */
+typedef void (*tool_progress_fn_t)(const char *text, size_t len, void *arg);
+
+/**
+ * Send progress reported by tools executing on the calling task to fn
+ * (NULL stops it). The agent loop sets this around each tool call.
+ */
+void tool_registry_set_progress(tool_progress_fn_t fn, void *arg);
+
+/**
+ * For tools: report partial output while still executing. Dropped unless
+ * the task running the tool set a progress callback.
+ */
+void tool_registry_progress(const char *text, size_t len);
@@ -1,5 +1,9 @@
 #include "tools/tool_script.h"
+#include "tools/tool_registry.h"
 #include "lua/lua_runner.h"
+#include "lua/lua_cache.h"
+#include "lua/lua_sched.h"
+#include "mimi_config.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,10 +15,17 @@
 static const char *TAG = "tool_script";
 
 #define SCRIPTS_PREFIX "/spiffs/scripts/"
-#define TEMP_SCRIPT_PATH "/spiffs/scripts/tmp.lua"
+#define TEMP_SCRIPT_PATH MIMI_LUA_TEMP_SCRIPT
 
 /* ── Helpers ──────────────────────────────────────────────── */
 
+/* Output of a script still running, on to the chat / WS gateway */
+static void stream_output(const char *text, size_t len, void *arg)
+{
+    (void)arg;
+    tool_registry_progress(text, len);
+}
+
 static bool validate_script_path(const char *path)
 {
     if (!path) return false;
@@ -22,9 +33,21 @@ static bool validate_script_path(const char *path)
     if (strstr(path, "..") != NULL) return false;
     /* Must have at least one character after the prefix */
     if (strlen(path) <= strlen(SCRIPTS_PREFIX)) return false;
+    /* Bytecode cache entries are written by the loader only */
+    if (lua_cache_is_cache_path(path)) return false;
     return true;
 }
 
+/* Sandbox accounting of the run, so the model sees what a script costs */
+static void add_run_stats(cJSON *resp, const lua_run_stats_t *stats)
+{
+    cJSON *s = cJSON_AddObjectToObject(resp, "stats");
+    cJSON_AddNumberToObject(s, "instructions", (double)stats->instructions);
+    cJSON_AddNumberToObject(s, "peak_bytes", stats->peak_bytes);
+    cJSON_AddNumberToObject(s, "duration_ms", stats->duration_us / 1000.0);
+    if (stats->limit) cJSON_AddStringToObject(s, "limit", stats->limit);
+}
+
 /* ── script_write ─────────────────────────────────────────── */
 
 esp_err_t tool_script_write_execute(const char *input_json,
@@ -41,7 +64,7 @@ esp_err_t tool_script_write_execute(const char *input_json,
 
     if (!validate_script_path(path)) {
         snprintf(output, output_size,
-                 "{\"ok\":false,\"error\":\"path must start with %s and must not contain '..'\"}",
+                 "{\"ok\":false,\"error\":\"path must start with %s, must not contain '..' and must not end in " MIMI_LUA_CACHE_SUFFIX "\"}",
                  SCRIPTS_PREFIX);
         cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
@@ -64,6 +87,7 @@ esp_err_t tool_script_write_execute(const char *input_json,
     size_t len = strlen(content);
     size_t written = fwrite(content, 1, len, f);
     fclose(f);
+    lua_cache_invalidate(path);
 
     if (written != len) {
         snprintf(output, output_size,
@@ -80,6 +104,35 @@ esp_err_t tool_script_write_execute(const char *input_json,
 
 /* ── script_run ───────────────────────────────────────────── */
 
+/* "background": true hands the script to lua_sched and answers at once */
+static esp_err_t run_background(const char *path, int timeout_ms,
+                                char *output, size_t output_size)
+{
+    int id = 0;
+    char err_msg[128] = {0};
+    esp_err_t err = lua_sched_spawn(path, timeout_ms, &id, err_msg, sizeof(err_msg));
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddBoolToObject(resp, "ok", err == ESP_OK);
+    if (err == ESP_OK) {
+        cJSON_AddNumberToObject(resp, "id", id);
+        cJSON_AddNumberToObject(resp, "timeout_ms", timeout_ms);
+    } else {
+        cJSON_AddStringToObject(resp, "error", err_msg[0] ? err_msg : esp_err_to_name(err));
+    }
+    char *json_str = cJSON_PrintUnformatted(resp);
+    if (json_str) {
+        snprintf(output, output_size, "%s", json_str);
+        cJSON_free(json_str);
+    } else {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"out of memory\"}");
+    }
+    cJSON_Delete(resp);
+
+    ESP_LOGI(TAG, "script_run: %s in the background → %s", path, esp_err_to_name(err));
+    return err;
+}
+
 esp_err_t tool_script_run_execute(const char *input_json,
                                   char *output, size_t output_size)
 {
@@ -90,7 +143,8 @@ esp_err_t tool_script_run_execute(const char *input_json,
     }
 
     const char *path = cJSON_GetStringValue(cJSON_GetObjectItem(root, "path"));
-    int timeout_ms = 5000;
+    bool background = cJSON_IsTrue(cJSON_GetObjectItem(root, "background"));
+    int timeout_ms = background ? MIMI_LUA_SCHED_TIMEOUT_MS : 5000;
     cJSON *jtimeout = cJSON_GetObjectItem(root, "timeout_ms");
     if (cJSON_IsNumber(jtimeout)) {
         timeout_ms = jtimeout->valueint;
@@ -98,7 +152,7 @@ esp_err_t tool_script_run_execute(const char *input_json,
 
     if (!validate_script_path(path)) {
         snprintf(output, output_size,
-                 "{\"ok\":false,\"error\":\"path must start with %s and must not contain '..'\"}",
+                 "{\"ok\":false,\"error\":\"path must start with %s, must not contain '..' and must not end in " MIMI_LUA_CACHE_SUFFIX "\"}",
                  SCRIPTS_PREFIX);
         cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
@@ -116,18 +170,25 @@ esp_err_t tool_script_run_execute(const char *input_json,
     memcpy(path_buf, path, path_len + 1);
     cJSON_Delete(root);
 
+    if (background) {
+        return run_background(path_buf, timeout_ms, output, output_size);
+    }
+
     char *lua_output = NULL;
-    esp_err_t err = lua_runner_exec(path_buf, timeout_ms, &lua_output);
+    lua_run_stats_t stats = {0};
+    esp_err_t err = lua_runner_exec_stream(path_buf, timeout_ms, stream_output, NULL,
+                                           &lua_output, &stats);
 
     if (err == ESP_OK) {
         /* Escape output for JSON */
         cJSON *resp = cJSON_CreateObject();
         cJSON_AddBoolToObject(resp, "ok", 1);
         cJSON_AddStringToObject(resp, "output", lua_output ? lua_output : "");
+        add_run_stats(resp, &stats);
         char *json_str = cJSON_PrintUnformatted(resp);
         if (json_str) {
             snprintf(output, output_size, "%s", json_str);
-            free(json_str);
+            cJSON_free(json_str);
         } else {
             snprintf(output, output_size, "{\"ok\":true,\"output\":\"\"}");
         }
@@ -136,10 +197,11 @@ esp_err_t tool_script_run_execute(const char *input_json,
         cJSON *resp = cJSON_CreateObject();
         cJSON_AddBoolToObject(resp, "ok", 0);
         cJSON_AddStringToObject(resp, "error", lua_output ? lua_output : "unknown error");
+        add_run_stats(resp, &stats);
         char *json_str = cJSON_PrintUnformatted(resp);
         if (json_str) {
             snprintf(output, output_size, "%s", json_str);
-            free(json_str);
+            cJSON_free(json_str);
         } else {
             snprintf(output, output_size, "{\"ok\":false,\"error\":\"unknown error\"}");
         }
@@ -214,3 +276,84 @@ esp_err_t tool_script_write_and_run_execute(const char *input_json,
              (err == ESP_OK) ? "ok" : "fail");
     return err;
 }
+
+/* ── script_ps ────────────────────────────────────────────── */
+
+esp_err_t tool_script_ps_execute(const char *input_json,
+                                 char *output, size_t output_size)
+{
+    (void)input_json;
+
+    lua_sched_info_t *list = calloc(MIMI_LUA_SCHED_MAX, sizeof(lua_sched_info_t));
+    if (!list) {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"out of memory\"}");
+        return ESP_ERR_NO_MEM;
+    }
+    int count = lua_sched_list(list, MIMI_LUA_SCHED_MAX);
+
+    cJSON *resp = cJSON_CreateObject();
+    cJSON_AddBoolToObject(resp, "ok", 1);
+    cJSON *arr = cJSON_AddArrayToObject(resp, "scripts");
+    for (int i = 0; i < count; i++) {
+        const lua_sched_info_t *info = &list[i];
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "id", info->id);
+        cJSON_AddStringToObject(item, "path", info->path);
+        cJSON_AddStringToObject(item, "status", info->status);
+        cJSON_AddNumberToObject(item, "uptime_ms", info->uptime_ms);
+        cJSON_AddNumberToObject(item, "run_ms", info->run_ms);
+        cJSON_AddNumberToObject(item, "slices", info->slices);
+        cJSON_AddNumberToObject(item, "instructions", (double)info->instructions);
+        cJSON_AddNumberToObject(item, "peak_bytes", info->peak_bytes);
+        if (info->limit[0]) cJSON_AddStringToObject(item, "limit", info->limit);
+        cJSON_AddStringToObject(item, "output", info->output);
+        cJSON_AddItemToArray(arr, item);
+    }
+    free(list);
+
+    char *json_str = cJSON_PrintUnformatted(resp);
+    if (json_str) {
+        snprintf(output, output_size, "%s", json_str);
+        cJSON_free(json_str);
+    } else {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"out of memory\"}");
+    }
+    cJSON_Delete(resp);
+
+    ESP_LOGI(TAG, "script_ps: %d scripts", count);
+    return ESP_OK;
+}
+
+/* ── script_kill ──────────────────────────────────────────── */
+
+esp_err_t tool_script_kill_execute(const char *input_json,
+                                   char *output, size_t output_size)
+{
+    cJSON *root = cJSON_Parse(input_json);
+    if (!root) {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"invalid JSON input\"}");
+        return ESP_ERR_INVALID_ARG;
+    }
+    cJSON *jid = cJSON_GetObjectItem(root, "id");
+    if (!cJSON_IsNumber(jid)) {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"missing 'id' field\"}");
+        cJSON_Delete(root);
+        return ESP_ERR_INVALID_ARG;
+    }
+    int id = jid->valueint;
+    cJSON_Delete(root);
+
+    esp_err_t err = lua_sched_kill(id);
+    if (err == ESP_OK) {
+        snprintf(output, output_size, "{\"ok\":true}");
+    } else if (err == ESP_ERR_NOT_FOUND) {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"no background script #%d\"}", id);
+    } else if (err == ESP_ERR_INVALID_STATE) {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"script #%d already ended\"}", id);
+    } else {
+        snprintf(output, output_size, "{\"ok\":false,\"error\":\"%s\"}", esp_err_to_name(err));
+    }
+
+    ESP_LOGI(TAG, "script_kill: #%d → %s", id, esp_err_to_name(err));
+    return err;
+}
@@ -13,7 +13,9 @@ esp_err_t tool_script_write_execute(const char *input_json,
 
 /**
  * Execute a Lua script from SPIFFS and return captured output.
- * Input JSON: {"path": "/spiffs/scripts/...", "timeout_ms": 5000}
+ * Input JSON: {"path": "/spiffs/scripts/...", "timeout_ms": 5000, "background": false}
+ * With "background": true it returns the script's id at once and the script
+ * runs on lua_sched (timeout_ms defaults to MIMI_LUA_SCHED_TIMEOUT_MS).
  */
 esp_err_t tool_script_run_execute(const char *input_json,
                                   char *output, size_t output_size);
@@ -24,3 +26,18 @@ esp_err_t tool_script_run_execute(const char *input_json,
  */
 esp_err_t tool_script_write_and_run_execute(const char *input_json,
                                        char *output, size_t output_size);
+
+/**
+ * List background scripts, running and recently ended, with their status,
+ * counters and output tail.
+ * Input JSON: {} (no required fields)
+ */
+esp_err_t tool_script_ps_execute(const char *input_json,
+                                 char *output, size_t output_size);
+
+/**
+ * Stop a running background script.
+ * Input JSON: {"id": 3}
+ */
+esp_err_t tool_script_kill_execute(const char *input_json,
+                                   char *output, size_t output_size);
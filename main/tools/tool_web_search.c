@@ -1,6 +1,7 @@
 #include "tool_web_search.h"
 #include "mimi_config.h"
 #include "proxy/http_proxy.h"
+#include "config/config_registry.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -8,7 +9,6 @@
 #include "esp_http_client.h"
 #include "esp_crt_bundle.h"
 #include "esp_heap_caps.h"
-#include "nvs.h"
 #include "cJSON.h"
 
 static const char *TAG = "web_search";
@@ -53,14 +53,10 @@ esp_err_t tool_web_search_init(void)
     }
 
     /* Provider: NVS override */
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_SEARCH, NVS_READONLY, &nvs) == ESP_OK) {
-        char tmp[16] = {0};
-        size_t len = sizeof(tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_SEARCH_PROVIDER, tmp, &len) == ESP_OK && tmp[0]) {
-            strncpy(s_search_provider, tmp, sizeof(s_search_provider) - 1);
-        }
-        nvs_close(nvs);
+    char provider[16] = {0};
+    if (config_get_str(MIMI_NVS_SEARCH, MIMI_NVS_KEY_SEARCH_PROVIDER, provider, sizeof(provider)) == ESP_OK &&
+        provider[0]) {
+        strncpy(s_search_provider, provider, sizeof(s_search_provider) - 1);
     }
 
     /* API key: build-time default */
@@ -69,13 +65,9 @@ esp_err_t tool_web_search_init(void)
     }
 
     /* API key: NVS override */
-    if (nvs_open(MIMI_NVS_SEARCH, NVS_READONLY, &nvs) == ESP_OK) {
-        char tmp[128] = {0};
-        size_t len = sizeof(tmp);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_API_KEY, tmp, &len) == ESP_OK && tmp[0]) {
-            strncpy(s_search_key, tmp, sizeof(s_search_key) - 1);
-        }
-        nvs_close(nvs);
+    char key[128] = {0};
+    if (config_get_str(MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY, key, sizeof(key)) == ESP_OK && key[0]) {
+        strncpy(s_search_key, key, sizeof(s_search_key) - 1);
     }
 
     if (s_search_key[0]) {
@@ -473,7 +465,7 @@ esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t o
         } else {
             err = tavily_search_direct(post_body, &sb);
         }
-        free(post_body);
+        cJSON_free(post_body);
 
         if (err != ESP_OK) {
             free(sb.data);
@@ -497,11 +489,8 @@ esp_err_t tool_web_search_execute(const char *input_json, char *output, size_t o
 
 esp_err_t tool_web_search_set_key(const char *api_key)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_SEARCH, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_API_KEY, api_key));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_err_t err = config_set_str(MIMI_NVS_SEARCH, MIMI_NVS_KEY_API_KEY, api_key);
+    if (err != ESP_OK) return err;
 
     strncpy(s_search_key, api_key, sizeof(s_search_key) - 1);
     ESP_LOGI(TAG, "Search API key saved");
@@ -515,11 +504,8 @@ esp_err_t tool_web_search_set_provider(const char *provider)
         return ESP_ERR_INVALID_ARG;
     }
 
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_SEARCH, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_SEARCH_PROVIDER, provider));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_err_t err = config_set_str(MIMI_NVS_SEARCH, MIMI_NVS_KEY_SEARCH_PROVIDER, provider);
+    if (err != ESP_OK) return err;
 
     strncpy(s_search_provider, provider, sizeof(s_search_provider) - 1);
     ESP_LOGI(TAG, "Search provider set to: %s", provider);
@@ -0,0 +1,264 @@
+#include "trace.h"
+#include "mimi_config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+static const char *TAG = "trace";
+
+#define TRACE_TASK_NAME_LEN  16
+#define TRACE_MAX_THREADS    32
+
+typedef struct {
+    const char *name;
+    const char *detail;
+    int64_t ts_us;
+    uint32_t dur_us;
+    char task[TRACE_TASK_NAME_LEN];
+} trace_event_t;
+
+static trace_event_t *s_ring = NULL;
+static uint32_t s_head = 0;       /* next slot to write */
+static uint32_t s_count = 0;
+static uint32_t s_lost = 0;
+static volatile bool s_enabled = MIMI_TRACE_ENABLED_DEFAULT;
+static volatile bool s_paused = false;
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t trace_init(void)
+{
+    if (s_ring) return ESP_OK;
+    s_ring = heap_caps_calloc(MIMI_TRACE_RING_EVENTS, sizeof(trace_event_t), MALLOC_CAP_SPIRAM);
+    if (!s_ring) {
+        ESP_LOGE(TAG, "No PSRAM for %d trace events", MIMI_TRACE_RING_EVENTS);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Trace ring: %d events (%u bytes), %s", MIMI_TRACE_RING_EVENTS,
+             (unsigned)(MIMI_TRACE_RING_EVENTS * sizeof(trace_event_t)),
+             s_enabled ? "enabled" : "disabled");
+    return ESP_OK;
+}
+
+/* ── Recording ─────────────────────────────────────────────── */
+
+trace_span_t trace_begin(const char *name, const char *detail)
+{
+    trace_span_t span = {
+        .name = name,
+        .detail = detail,
+        .start_us = s_enabled ? esp_timer_get_time() : 0,
+    };
+    return span;
+}
+
+void trace_end(const trace_span_t *span)
+{
+    if (!span->start_us) return;  /* began while disabled */
+    trace_record(span->name, span->detail, span->start_us, esp_timer_get_time());
+}
+
+void trace_record(const char *name, const char *detail, int64_t start_us, int64_t end_us)
+{
+    if (!s_ring || !s_enabled || start_us <= 0) return;
+
+    /* Copy the task name outside the lock; it never changes while running */
+    char task[TRACE_TASK_NAME_LEN];
+    const char *tn = pcTaskGetName(NULL);
+    strncpy(task, tn ? tn : "?", sizeof(task) - 1);
+    task[sizeof(task) - 1] = '\0';
+
+    int64_t dur = end_us - start_us;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_paused) {
+        s_lost++;
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    trace_event_t *ev = &s_ring[s_head];
+    ev->name = name;
+    ev->detail = detail;
+    ev->ts_us = start_us;
+    ev->dur_us = dur > 0 ? (uint32_t)dur : 0;
+    memcpy(ev->task, task, sizeof(task));
+    s_head = (s_head + 1) % MIMI_TRACE_RING_EVENTS;
+    if (s_count < MIMI_TRACE_RING_EVENTS) {
+        s_count++;
+    } else {
+        s_lost++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+/* ── Control ───────────────────────────────────────────────── */
+
+void trace_set_enabled(bool enabled)
+{
+    s_enabled = enabled;
+    ESP_LOGI(TAG, "Tracing %s", enabled ? "enabled" : "disabled");
+}
+
+bool trace_is_enabled(void)
+{
+    return s_enabled;
+}
+
+void trace_clear(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_head = 0;
+    s_count = 0;
+    s_lost = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void trace_get_stats(uint32_t *count, uint32_t *capacity, uint32_t *lost)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (count) *count = s_count;
+    if (lost) *lost = s_lost;
+    portEXIT_CRITICAL(&s_lock);
+    if (capacity) *capacity = MIMI_TRACE_RING_EVENTS;
+}
+
+/* ── Export ────────────────────────────────────────────────── */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool oom;
+} out_buf_t;
+
+static void out_printf(out_buf_t *o, const char *fmt, ...)
+{
+    if (o->oom) return;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            o->oom = true;
+            return;
+        }
+        if (o->len + n < o->cap) {
+            o->len += n;
+            return;
+        }
+        size_t new_cap = o->cap * 2 + n;
+        char *tmp = heap_caps_realloc(o->buf, new_cap, MALLOC_CAP_SPIRAM);
+        if (!tmp) {
+            o->oom = true;
+            return;
+        }
+        o->buf = tmp;
+        o->cap = new_cap;
+    }
+}
+
+/* Quoted JSON string; span names, details and task names are not trusted
+ * to be plain ASCII (tool and daemon names come from users) */
+static void out_json_str(out_buf_t *o, const char *s)
+{
+    out_printf(o, "\"");
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out_printf(o, "%.*s", (int)(s - run), run);
+        switch (c) {
+        case '"':  out_printf(o, "\\\""); break;
+        case '\\': out_printf(o, "\\\\"); break;
+        case '\b': out_printf(o, "\\b"); break;
+        case '\f': out_printf(o, "\\f"); break;
+        case '\n': out_printf(o, "\\n"); break;
+        case '\r': out_printf(o, "\\r"); break;
+        case '\t': out_printf(o, "\\t"); break;
+        default:   out_printf(o, "\\u%04x", c); break;
+        }
+        run = s + 1;
+    }
+    out_printf(o, "%s\"", run);
+}
+
+/* Thread id for a task name; ids are assigned in order of first use */
+static int thread_id(char (*threads)[TRACE_TASK_NAME_LEN], int *n_threads, const char *task)
+{
+    for (int i = 0; i < *n_threads; i++) {
+        if (strcmp(threads[i], task) == 0) return i + 1;
+    }
+    if (*n_threads >= TRACE_MAX_THREADS) return TRACE_MAX_THREADS;  /* shared overflow lane */
+    memcpy(threads[*n_threads], task, TRACE_TASK_NAME_LEN);
+    return ++*n_threads;
+}
+
+char *trace_export_json(void)
+{
+    out_buf_t o = { .cap = 16 * 1024 };
+    o.buf = heap_caps_malloc(o.cap, MALLOC_CAP_SPIRAM);
+    if (!o.buf) return NULL;
+    o.buf[0] = '\0';
+
+    char (*threads)[TRACE_TASK_NAME_LEN] = calloc(TRACE_MAX_THREADS, TRACE_TASK_NAME_LEN);
+    if (!threads) {
+        free(o.buf);
+        return NULL;
+    }
+    int n_threads = 0;
+
+    /* Pause writers; taking the lock once waits out any record in flight */
+    portENTER_CRITICAL(&s_lock);
+    s_paused = true;
+    uint32_t count = s_count;
+    uint32_t first = (s_head + MIMI_TRACE_RING_EVENTS - s_count) % MIMI_TRACE_RING_EVENTS;
+    portEXIT_CRITICAL(&s_lock);
+
+    out_printf(&o, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool comma = false;
+    for (uint32_t i = 0; s_ring && i < count; i++) {
+        const trace_event_t *ev = &s_ring[(first + i) % MIMI_TRACE_RING_EVENTS];
+        int tid = thread_id(threads, &n_threads, ev->task);
+        out_printf(&o, "%s\n{\"name\":", comma ? "," : "");
+        out_json_str(&o, ev->name);
+        out_printf(&o, ",\"cat\":\"mimi\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%u,\"pid\":1,\"tid\":%d",
+                   (long long)ev->ts_us, (unsigned)ev->dur_us, tid);
+        if (ev->detail) {
+            out_printf(&o, ",\"args\":{\"detail\":");
+            out_json_str(&o, ev->detail);
+            out_printf(&o, "}");
+        }
+        out_printf(&o, "}");
+        comma = true;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_paused = false;
+    portEXIT_CRITICAL(&s_lock);
+
+    /* Name each lane after its task */
+    out_printf(&o, "%s\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"mimiclaw\"}}",
+               comma ? "," : "");
+    for (int i = 0; i < n_threads; i++) {
+        out_printf(&o, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                       "\"args\":{\"name\":", i + 1);
+        out_json_str(&o, threads[i]);
+        out_printf(&o, "}}");
+    }
+    out_printf(&o, "\n]}\n");
+    free(threads);
+
+    if (o.oom) {
+        free(o.buf);
+        return NULL;
+    }
+    return o.buf;
+}
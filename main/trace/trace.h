@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/*
+ * Span tracing into a PSRAM ring buffer, exported as Chrome trace_event
+ * JSON (open in https://ui.perfetto.dev or chrome://tracing).
+ *
+ * A span is a name, an optional detail and a begin/end pair of
+ * esp_timer_get_time() stamps, recorded on end as one complete ("X")
+ * event tagged with the calling task. Recording is a timer read plus a
+ * ~40 byte copy under a spinlock, so tracing stays on in production; the
+ * oldest events are overwritten when the ring is full.
+ *
+ * name and detail are kept by pointer and must outlive the ring: string
+ * literals or registry-owned names (e.g. tool names), never stack buffers.
+ */
+
+typedef struct {
+    const char *name;
+    const char *detail;
+    int64_t start_us;
+} trace_span_t;
+
+/** Allocate the ring buffer (MIMI_TRACE_RING_EVENTS). Call early in boot. */
+esp_err_t trace_init(void);
+
+trace_span_t trace_begin(const char *name, const char *detail);
+void trace_end(const trace_span_t *span);
+
+/** Record a span whose timestamps were taken elsewhere. */
+void trace_record(const char *name, const char *detail, int64_t start_us, int64_t end_us);
+
+void trace_set_enabled(bool enabled);
+bool trace_is_enabled(void);
+void trace_clear(void);
+
+/** Events currently held, ring capacity, and events overwritten or dropped. */
+void trace_get_stats(uint32_t *count, uint32_t *capacity, uint32_t *lost);
+
+/**
+ * Render the ring as {"traceEvents":[...]} JSON, oldest first, with one
+ * thread per task name. Recording pauses while rendering.
+ * @return heap-allocated string (caller frees), or NULL on OOM
+ */
+char *trace_export_json(void);
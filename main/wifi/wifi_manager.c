@@ -1,5 +1,7 @@
 #include "wifi_manager.h"
 #include "mimi_config.h"
+#include "config/config_registry.h"
+#include "cron/cron_service.h"
 
 #include <string.h>
 #include <inttypes.h>
@@ -9,8 +11,6 @@
 #include "esp_wifi.h"
 #include "esp_netif.h"
 #include "esp_netif_sntp.h"
-#include "nvs_flash.h"
-#include "nvs.h"
 
 static const char *TAG = "wifi";
 
@@ -49,6 +49,7 @@ static void time_sync_notification_cb(struct timeval *tv)
     char buf[64];
     strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %Z", &timeinfo);
     ESP_LOGI(TAG, "SNTP synced: %s", buf);
+    cron_service_clock_changed();
 }
 
 static void sntp_sync_task(void *arg)
@@ -92,6 +93,8 @@ static void event_handler(void *arg, esp_event_base_t event_base,
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         s_connected = false;
         strlcpy(s_ip_str, "0.0.0.0", sizeof(s_ip_str));
+        /* Link-gated work (offline replay) waits for the bit to come back */
+        xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
         wifi_event_sta_disconnected_t *disc = (wifi_event_sta_disconnected_t *)event_data;
         if (disc) {
             ESP_LOGW(TAG, "Disconnected (reason=%d:%s)", disc->reason, wifi_reason_to_str(disc->reason));
@@ -151,15 +154,11 @@ esp_err_t wifi_manager_start(void)
     bool found = false;
 
     /* NVS overrides take highest priority (set via CLI) */
-    nvs_handle_t nvs;
-    if (nvs_open(MIMI_NVS_WIFI, NVS_READONLY, &nvs) == ESP_OK) {
-        size_t len = sizeof(wifi_cfg.sta.ssid);
-        if (nvs_get_str(nvs, MIMI_NVS_KEY_SSID, (char *)wifi_cfg.sta.ssid, &len) == ESP_OK) {
-            len = sizeof(wifi_cfg.sta.password);
-            nvs_get_str(nvs, MIMI_NVS_KEY_PASS, (char *)wifi_cfg.sta.password, &len);
-            found = true;
-        }
-        nvs_close(nvs);
+    if (config_get_str(MIMI_NVS_WIFI, MIMI_NVS_KEY_SSID, (char *)wifi_cfg.sta.ssid,
+                       sizeof(wifi_cfg.sta.ssid)) == ESP_OK) {
+        config_get_str(MIMI_NVS_WIFI, MIMI_NVS_KEY_PASS, (char *)wifi_cfg.sta.password,
+                       sizeof(wifi_cfg.sta.password));
+        found = true;
     }
 
     /* Fall back to build-time secrets */
@@ -210,12 +209,14 @@ const char *wifi_manager_get_ip(void)
 
 esp_err_t wifi_manager_set_credentials(const char *ssid, const char *password)
 {
-    nvs_handle_t nvs;
-    ESP_ERROR_CHECK(nvs_open(MIMI_NVS_WIFI, NVS_READWRITE, &nvs));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_SSID, ssid));
-    ESP_ERROR_CHECK(nvs_set_str(nvs, MIMI_NVS_KEY_PASS, password));
-    ESP_ERROR_CHECK(nvs_commit(nvs));
-    nvs_close(nvs);
+    esp_err_t err = config_set_str(MIMI_NVS_WIFI, MIMI_NVS_KEY_SSID, ssid);
+    if (err == ESP_OK) err = config_set_str(MIMI_NVS_WIFI, MIMI_NVS_KEY_PASS, password);
+    /* Written through: losing credentials to a reset would strand the device */
+    if (err == ESP_OK) err = config_flush();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Saving WiFi credentials failed: %s", esp_err_to_name(err));
+        return err;
+    }
     ESP_LOGI(TAG, "WiFi credentials saved for SSID: %s", ssid);
     return ESP_OK;
 }
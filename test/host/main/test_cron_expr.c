@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "unity.h"
+#include "cron/cron_expr.h"
+
+/*
+ * cron_expr against hand-worked dates (DST gaps and repeats, Feb 29,
+ * 31-day months, the day-of-month / day-of-week rule) and against a
+ * reference that walks every minute.
+ */
+
+#define TZ_NEW_YORK   "EST5EDT,M3.2.0,M11.1.0"
+#define TZ_BERLIN     "CET-1CEST,M3.5.0,M10.5.0/3"
+#define TZ_SHANGHAI   "CST-8"
+#define TZ_LORD_HOWE  "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0"     /* 30 min DST */
+#define TZ_AUCKLAND   "NZST-12NZDT,M9.5.0,M4.1.0/3"
+
+static void set_tz(const char *tz)
+{
+    setenv("TZ", tz, 1);
+    tzset();
+}
+
+static int64_t utc(int year, int month, int day, int hour, int minute)
+{
+    struct tm tm = {
+        .tm_year = year - 1900, .tm_mon = month - 1, .tm_mday = day,
+        .tm_hour = hour, .tm_min = minute,
+    };
+    return (int64_t)timegm(&tm);
+}
+
+static cron_expr_t parse(const char *text)
+{
+    cron_expr_t e;
+    char err[96] = "";
+    TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, cron_expr_parse(text, &e, err, sizeof(err)), err);
+    return e;
+}
+
+/* Expect the fire times after `after`, in order */
+static void expect_next(const char *text, int64_t after, const int64_t *want, int n)
+{
+    cron_expr_t e = parse(text);
+    for (int i = 0; i < n; i++) {
+        int64_t got = cron_expr_next(&e, after);
+        char msg[128];
+        snprintf(msg, sizeof(msg), "'%s' fire %d after %lld", text, i, (long long)after);
+        TEST_ASSERT_EQUAL_INT64_MESSAGE(want[i], got, msg);
+        after = got;
+    }
+}
+
+#define EXPECT_NEXT(text, after, ...) do { \
+    const int64_t want_[] = { __VA_ARGS__ }; \
+    expect_next(text, after, want_, sizeof(want_) / sizeof(want_[0])); \
+} while (0)
+
+/* ── Parsing ──────────────────────────────────────────────────── */
+
+TEST_CASE("cron_expr parses fields, names, steps and shorthands", "[cron]")
+{
+    cron_expr_t e = parse("10/20 * * * *");
+    TEST_ASSERT_EQUAL_UINT64((1ULL << 10) | (1ULL << 30) | (1ULL << 50), e.minutes);
+
+    e = parse("0 0 * * sun-sat");
+    TEST_ASSERT_EQUAL_HEX8(0x7f, e.weekdays);
+    e = parse("0 0 * * 5-7");                   /* 7 is Sunday */
+    TEST_ASSERT_EQUAL_HEX8(0x61, e.weekdays);
+    e = parse("0 0 1 jan,JUL *");
+    TEST_ASSERT_EQUAL_HEX16((1 << 1) | (1 << 7), e.months);
+    e = parse("  1,2,5-6 3 * * *");
+    TEST_ASSERT_EQUAL_UINT64(0x66, e.minutes);
+    TEST_ASSERT_EQUAL_HEX32(1 << 3, e.hours);
+    TEST_ASSERT_TRUE(e.dom_any && e.dow_any);
+
+    e = parse("@weekly");
+    TEST_ASSERT_EQUAL_HEX8(1, e.weekdays);
+    TEST_ASSERT_EQUAL_HEX32(1, e.hours);
+    TEST_ASSERT_EQUAL_UINT64(1, e.minutes);
+    e = parse("@HOURLY");
+    TEST_ASSERT_EQUAL_HEX32(0xffffff, e.hours);
+}
+
+TEST_CASE("cron_expr rejects malformed expressions", "[cron]")
+{
+    static const char *const bad[] = {
+        "60 * * * *", "* 24 * * *", "* * 0 * *", "* * 32 * *", "* * * 13 *",
+        "* * * * 8", "*/0 * * * *", "*/60 * * * *", "5-1 * * * *", "* * * *",
+        "* * * * * *", "a * * * *", "* * * foo *", "1,,2 * * * *", "1, * * * *",
+        "-1 * * * *", "99999999999 * * * *", "@often", "", "0 */6 L? * *",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        cron_expr_t e;
+        char err[96] = "";
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_ERR_INVALID_ARG, cron_expr_parse(bad[i], &e, err, sizeof(err)), bad[i]);
+        TEST_ASSERT_NOT_EQUAL_MESSAGE(0, strlen(err), bad[i]);
+    }
+}
+
+/* ── Calendar ─────────────────────────────────────────────────── */
+
+TEST_CASE("cron_expr finds Feb 29 across leap and century years", "[cron]")
+{
+    set_tz("UTC0");
+    EXPECT_NEXT("0 12 29 2 *", utc(2023, 6, 1, 0, 0),
+                utc(2024, 2, 29, 12, 0), utc(2028, 2, 29, 12, 0), utc(2032, 2, 29, 12, 0));
+    /* 2100 is not a leap year */
+    EXPECT_NEXT("0 0 29 2 *", utc(2096, 3, 1, 0, 0), utc(2104, 2, 29, 0, 0));
+
+    cron_expr_t e = parse("0 0 30 2 *");
+    TEST_ASSERT_EQUAL_INT64(0, cron_expr_next(&e, utc(2024, 1, 1, 0, 0)));
+    e = parse("0 0 31 4,6,9,11 *");
+    TEST_ASSERT_EQUAL_INT64(0, cron_expr_next(&e, utc(2024, 1, 1, 0, 0)));
+}
+
+TEST_CASE("cron_expr skips months without the day", "[cron]")
+{
+    set_tz("UTC0");
+    EXPECT_NEXT("0 0 31 * *", utc(2024, 1, 31, 0, 0),
+                utc(2024, 3, 31, 0, 0), utc(2024, 5, 31, 0, 0), utc(2024, 7, 31, 0, 0),
+                utc(2024, 8, 31, 0, 0), utc(2024, 10, 31, 0, 0), utc(2024, 12, 31, 0, 0),
+                utc(2025, 1, 31, 0, 0));
+    EXPECT_NEXT("0 0 30 * *", utc(2025, 1, 30, 0, 0), utc(2025, 3, 30, 0, 0));
+    /* Month and year roll over from the last minute */
+    EXPECT_NEXT("* * * * *", utc(2024, 12, 31, 23, 59), utc(2025, 1, 1, 0, 0));
+    EXPECT_NEXT("59 23 * * *", utc(2024, 2, 28, 23, 59), utc(2024, 2, 29, 23, 59));
+}
+
+TEST_CASE("cron_expr ORs restricted day fields and ANDs starred ones", "[cron]")
+{
+    set_tz("UTC0");
+    /* Sep 2024 starts on a Sunday; Oct 13 is a Sunday */
+    EXPECT_NEXT("0 9 13 * fri", utc(2024, 9, 1, 0, 0),
+                utc(2024, 9, 6, 9, 0), utc(2024, 9, 13, 9, 0), utc(2024, 9, 20, 9, 0),
+                utc(2024, 9, 27, 9, 0), utc(2024, 10, 4, 9, 0), utc(2024, 10, 11, 9, 0),
+                utc(2024, 10, 13, 9, 0), utc(2024, 10, 18, 9, 0));
+    EXPECT_NEXT("0 9 13 * *", utc(2024, 9, 1, 0, 0), utc(2024, 9, 13, 9, 0), utc(2024, 10, 13, 9, 0));
+    EXPECT_NEXT("0 9 * * fri", utc(2024, 9, 1, 0, 0), utc(2024, 9, 6, 9, 0), utc(2024, 9, 13, 9, 0));
+    /* Days 1, 11, 21 and 31 that fall on a Friday */
+    EXPECT_NEXT("0 0 */10 * fri", utc(2024, 9, 1, 0, 0),
+                utc(2024, 10, 11, 0, 0), utc(2024, 11, 1, 0, 0), utc(2025, 1, 31, 0, 0));
+    EXPECT_NEXT("0 0 1 * */7", utc(2024, 9, 1, 0, 0), utc(2024, 12, 1, 0, 0));
+}
+
+/* ── Daylight saving ──────────────────────────────────────────── */
+
+TEST_CASE("cron_expr fires skipped local times at the DST jump", "[cron]")
+{
+    set_tz(TZ_NEW_YORK);
+    /* 2024-03-10 02:00 EST jumps to 03:00 EDT (07:00 UTC) */
+    EXPECT_NEXT("30 2 * * *", utc(2024, 3, 10, 5, 0),
+                utc(2024, 3, 10, 7, 0), utc(2024, 3, 11, 6, 30));
+    EXPECT_NEXT("0 2 * * *", utc(2024, 3, 10, 5, 0), utc(2024, 3, 10, 7, 0));
+    /* The whole skipped hour fires once, then minutes go on from 03:01 */
+    EXPECT_NEXT("* * * * *", utc(2024, 3, 10, 6, 59),
+                utc(2024, 3, 10, 7, 0), utc(2024, 3, 10, 7, 1));
+    EXPECT_NEXT("15 1,2,3 * * *", utc(2024, 3, 10, 5, 0),
+                utc(2024, 3, 10, 6, 15), utc(2024, 3, 10, 7, 0), utc(2024, 3, 10, 7, 15));
+
+    set_tz(TZ_BERLIN);
+    /* 2024-03-31 02:00 CET jumps to 03:00 CEST (01:00 UTC) */
+    EXPECT_NEXT("30 2 * * *", utc(2024, 3, 30, 23, 0),
+                utc(2024, 3, 31, 1, 0), utc(2024, 4, 1, 0, 30));
+
+    set_tz(TZ_LORD_HOWE);
+    /* 2024-10-06 02:00 +1030 jumps to 02:30 +11 (15:30 UTC the day before) */
+    EXPECT_NEXT("15 2 * * *", utc(2024, 10, 5, 13, 30),
+                utc(2024, 10, 5, 15, 30), utc(2024, 10, 6, 15, 15));
+}
+
+TEST_CASE("cron_expr fires repeated local times once", "[cron]")
+{
+    set_tz(TZ_NEW_YORK);
+    /* 2024-11-03 02:00 EDT falls back to 01:00 EST: 01:xx happens twice */
+    EXPECT_NEXT("30 1 * * *", utc(2024, 11, 3, 4, 0),
+                utc(2024, 11, 3, 5, 30), utc(2024, 11, 4, 6, 30));
+    EXPECT_NEXT("*/30 * * * *", utc(2024, 11, 3, 5, 0),
+                utc(2024, 11, 3, 5, 30), utc(2024, 11, 3, 7, 0));
+    /* Asked from inside the second pass */
+    EXPECT_NEXT("15 1 * * *", utc(2024, 11, 3, 6, 10), utc(2024, 11, 4, 6, 15));
+    EXPECT_NEXT("45 1 * * *", utc(2024, 11, 3, 6, 10), utc(2024, 11, 4, 6, 45));
+
+    set_tz(TZ_AUCKLAND);
+    /* 2024-04-07 03:00 NZDT falls back to 02:00 NZST (14:00 UTC the day before) */
+    EXPECT_NEXT("30 2 * * *", utc(2024, 4, 6, 12, 0),
+                utc(2024, 4, 6, 13, 30), utc(2024, 4, 7, 14, 30));
+}
+
+/* ── Against a minute-by-minute reference ─────────────────────── */
+
+/* Local wall-clock minute number: contiguous, unlike the broken-down fields */
+static int64_t local_minute(int64_t t)
+{
+    time_t tt = (time_t)t;
+    struct tm tm;
+    localtime_r(&tt, &tm);
+    return (int64_t)timegm(&tm) / 60;
+}
+
+static bool ref_match(const cron_expr_t *e, int64_t local_min)
+{
+    time_t tt = (time_t)(local_min * 60);
+    struct tm tm;
+    gmtime_r(&tt, &tm);
+    if (!(e->months >> (tm.tm_mon + 1) & 1) || !(e->hours >> tm.tm_hour & 1) ||
+        !(e->minutes >> tm.tm_min & 1)) {
+        return false;
+    }
+    bool dom = e->days >> tm.tm_mday & 1;
+    bool dow = e->weekdays >> tm.tm_wday & 1;
+    return (e->dom_any || e->dow_any) ? (dom && dow) : (dom || dow);
+}
+
+/*
+ * Walk real minutes. A local minute already reached (the clock fell back)
+ * is skipped; minutes jumped over by a gap match at the jump.
+ */
+static int64_t ref_next(const cron_expr_t *e, int64_t after, int64_t limit)
+{
+    int64_t base = after - after % 60;
+    int64_t seen = 0;
+    for (int64_t t = base - 3 * 3600; t <= base; t += 60) {
+        int64_t m = local_minute(t);
+        if (m > seen) seen = m;
+    }
+    for (int64_t t = base + 60; t < limit; t += 60) {
+        int64_t m = local_minute(t);
+        if (m <= seen) continue;
+        bool fire = false;
+        for (int64_t k = seen + 1; k <= m && !fire; k++) fire = ref_match(e, k);
+        seen = m;
+        if (fire) return t;
+    }
+    return 0;
+}
+
+TEST_CASE("cron_expr agrees with a minute-by-minute scan", "[cron]")
+{
+    static const char *const tzs[] = {
+        "UTC0", TZ_SHANGHAI, TZ_BERLIN, TZ_NEW_YORK, TZ_LORD_HOWE, TZ_AUCKLAND,
+    };
+    static const struct {
+        const char *expr;
+        int fires;
+    } cases[] = {
+        { "* * * * *",                     240 },
+        { "*/7 * * * *",                   120 },
+        { "30 2 * * *",                    8 },
+        { "0 2 * * *",                     8 },
+        { "59 1 * * *",                    8 },
+        { "15 1,2,3 * * *",                12 },
+        { "0 0 31 * *",                    4 },
+        { "0 9 * * 1-5",                   10 },
+        { "0 9 13 * fri",                  6 },
+        { "0 0 */10 * fri",                3 },
+        { "*/15 0-3 * mar,oct,nov sun",    40 },
+        { "5 4 * * 7",                     4 },
+    };
+    /* Around the spring and autumn transitions of both hemispheres */
+    static const int64_t starts[] = {
+        1710000000, 1711670000, 1712300000, 1727600000, 1730600000, 1740000000,
+    };
+
+    for (size_t z = 0; z < sizeof(tzs) / sizeof(tzs[0]); z++) {
+        set_tz(tzs[z]);
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            cron_expr_t e = parse(cases[c].expr);
+            for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++) {
+                int64_t after = starts[s];
+                for (int i = 0; i < cases[c].fires; i++) {
+                    int64_t want = ref_next(&e, after, after + 400LL * 86400);
+                    int64_t got = cron_expr_next(&e, after);
+                    if (got != want) {
+                        char msg[160];
+                        snprintf(msg, sizeof(msg), "TZ=%s '%s' after %lld",
+                                 tzs[z], cases[c].expr, (long long)after);
+                        TEST_ASSERT_EQUAL_INT64_MESSAGE(want, got, msg);
+                    }
+                    after = got;
+                }
+            }
+        }
+    }
+    set_tz("UTC0");
+}
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "mimi_config.h"
+#include "bus/message_bus.h"
+
+/*
+ * The cron scheduler on a simulated clock: the service is compiled into
+ * this file with time(), gettimeofday() and esp_timer_get_time() reading
+ * sim_wall_us / sim_mono_us, and each pass of the cron task is run by
+ * hand. Time then jumps straight to the wakeup the task asked for, so a
+ * job firing late, early or by polling shows up exactly.
+ */
+
+static int64_t sim_wall_us;
+static int64_t sim_mono_us;
+
+static time_t sim_time(time_t *out)
+{
+    time_t t = (time_t)(sim_wall_us / 1000000);
+    if (out) *out = t;
+    return t;
+}
+
+static int sim_gettimeofday(struct timeval *tv, void *tz)
+{
+    (void)tz;
+    tv->tv_sec = (time_t)(sim_wall_us / 1000000);
+    tv->tv_usec = (suseconds_t)(sim_wall_us % 1000000);
+    return 0;
+}
+
+static int64_t sim_timer_get_time(void)
+{
+    return sim_mono_us;
+}
+
+#define time(out)               sim_time(out)
+#define gettimeofday(tv, tz)    sim_gettimeofday(tv, tz)
+#define esp_timer_get_time()    sim_timer_get_time()
+
+#undef MIMI_CRON_FILE
+#define MIMI_CRON_FILE          "/tmp/mimiclaw_test_cron.json"
+
+#include "cron/cron_service.c"
+
+#undef time
+#undef gettimeofday
+#undef esp_timer_get_time
+
+/* ── Harness ──────────────────────────────────────────────────── */
+
+#define T0          1760000400LL            /* a whole 10 minutes, UTC */
+#define MAX_FIRES   512
+
+typedef struct {
+    char name[32];
+    int64_t wall_us;
+} fire_t;
+
+static fire_t s_fires[MAX_FIRES];
+static int s_fire_count;
+static int s_wakes;
+
+/* Stands in for the bus: record what fired and when */
+esp_err_t message_bus_push_inbound(const mimi_msg_t *msg)
+{
+    if (s_fire_count < MAX_FIRES) {
+        fire_t *f = &s_fires[s_fire_count++];
+        strncpy(f->name, msg->payload.text, sizeof(f->name) - 1);
+        f->name[sizeof(f->name) - 1] = '\0';
+        f->wall_us = sim_wall_us;
+    }
+    free(msg->payload.text);
+    return ESP_OK;
+}
+
+static void sim_reset(void)
+{
+    remove(MIMI_CRON_FILE);
+    TEST_ASSERT_EQUAL(ESP_OK, cron_service_init());
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    s_job_count = 0;
+    s_heap_len = 0;
+    s_clock_valid = false;
+    s_clock_offset_us = 0;
+    s_dirty = false;
+    s_last_save = 0;
+    sim_wall_us = 1000LL * 1000000;     /* before SNTP */
+    sim_mono_us = 5LL * 1000000;
+    s_fire_count = 0;
+    s_wakes = 0;
+}
+
+/* One pass of cron_task_main; returns its sleep */
+static TickType_t sim_pass(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    time_t now = sim_time(NULL);
+    cron_check_clock(now);
+    if (s_clock_valid) cron_process_due_jobs(now);
+    TickType_t wait = cron_ticks_to_wake();
+    xSemaphoreGive(s_lock);
+    s_wakes++;
+    return wait;
+}
+
+static void sim_advance_us(int64_t us)
+{
+    sim_wall_us += us;
+    sim_mono_us += us;
+}
+
+/* Run the task loop, sleeping as it asks, until the wall clock reaches until_s */
+static void sim_run_until(int64_t until_s)
+{
+    for (;;) {
+        TickType_t wait = sim_pass();
+        int64_t left_us = until_s * 1000000 - sim_wall_us;
+        int64_t sleep_us = (wait == portMAX_DELAY) ? left_us : (int64_t)pdTICKS_TO_MS(wait) * 1000;
+        if (sleep_us >= left_us) {
+            sim_advance_us(left_us);
+            return;
+        }
+        sim_advance_us(sleep_us);
+    }
+}
+
+/* The clock is set (SNTP), and the task is woken for it */
+static void sim_set_clock(int64_t wall_s)
+{
+    sim_wall_us = wall_s * 1000000;
+}
+
+static void sim_step_clock(int64_t step_s)
+{
+    sim_wall_us += step_s * 1000000;
+}
+
+static const char *add_job(const char *name, cron_kind_t kind, uint32_t interval_s,
+                           int64_t at_epoch, const char *expr)
+{
+    static cron_job_t job;
+    memset(&job, 0, sizeof(job));
+    strncpy(job.name, name, sizeof(job.name) - 1);
+    strncpy(job.message, name, sizeof(job.message) - 1);
+    job.kind = kind;
+    job.interval_s = interval_s;
+    job.at_epoch = at_epoch;
+    job.delete_after_run = kind == CRON_KIND_AT;
+    if (expr) {
+        char err[96] = "";
+        strncpy(job.expr, expr, sizeof(job.expr) - 1);
+        TEST_ASSERT_EQUAL_MESSAGE(ESP_OK, cron_expr_parse(expr, &job.spec, err, sizeof(err)), err);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, cron_add_job(&job));
+    return job.id;
+}
+
+/* Fire times of one job, in seconds past T0, and how many there were */
+static int fires_of(const char *name, int64_t *at_s, int max)
+{
+    int n = 0;
+    for (int i = 0; i < s_fire_count; i++) {
+        if (strcmp(s_fires[i].name, name) != 0) continue;
+        if (n < max) at_s[n] = s_fires[i].wall_us / 1000000 - T0;
+        n++;
+    }
+    return n;
+}
+
+/* Every fire lands within two ticks of the start of its second */
+static void assert_on_time(void)
+{
+    int64_t slack_us = 2LL * portTICK_PERIOD_MS * 1000;
+    for (int i = 0; i < s_fire_count; i++) {
+        TEST_ASSERT_LESS_OR_EQUAL_INT64(slack_us, s_fires[i].wall_us % 1000000);
+    }
+}
+
+static void assert_heap_ordered(void)
+{
+    for (int i = 1; i < s_heap_len; i++) {
+        TEST_ASSERT_TRUE(s_jobs[s_heap[(i - 1) / 2]].next_run <= s_jobs[s_heap[i]].next_run);
+    }
+}
+
+/* ── Tests ────────────────────────────────────────────────────── */
+
+TEST_CASE("cron waits for the clock, then fires every jobs on time", "[cron]")
+{
+    sim_reset();
+    add_job("e5", CRON_KIND_EVERY, 5, 0, NULL);
+    add_job("e7", CRON_KIND_EVERY, 7, 0, NULL);
+
+    /* Unset clock: no job is armed, only the backstop wake */
+    TEST_ASSERT_EQUAL(pdMS_TO_TICKS(MIMI_CRON_MAX_SLEEP_S * 1000) + 1, sim_pass());
+    TEST_ASSERT_EQUAL(0, s_heap_len);
+
+    sim_set_clock(T0);
+    s_wakes = 0;
+    sim_run_until(T0 + 71);
+
+    int64_t at[16];
+    TEST_ASSERT_EQUAL(14, fires_of("e5", at, 16));
+    for (int i = 0; i < 14; i++) TEST_ASSERT_EQUAL_INT64(5 * (i + 1), at[i]);
+    TEST_ASSERT_EQUAL(10, fires_of("e7", at, 16));
+    for (int i = 0; i < 10; i++) TEST_ASSERT_EQUAL_INT64(7 * (i + 1), at[i]);
+    assert_on_time();
+
+    /* Woken for fires (two coincide at 35 and 70) and a deferred save, not polled */
+    TEST_ASSERT_LESS_OR_EQUAL(s_fire_count + 3, s_wakes);
+}
+
+TEST_CASE("cron fires an at job once and deletes it", "[cron]")
+{
+    sim_reset();
+    /* Added before SNTP, due before the clock is set: fires once it is */
+    add_job("late", CRON_KIND_AT, 0, T0 - 30, NULL);
+    sim_set_clock(T0);
+    add_job("at12", CRON_KIND_AT, 0, T0 + 12, NULL);
+    sim_run_until(T0 + 100);
+
+    int64_t at[4];
+    TEST_ASSERT_EQUAL(1, fires_of("late", at, 4));
+    TEST_ASSERT_EQUAL_INT64(0, at[0]);
+    TEST_ASSERT_EQUAL(1, fires_of("at12", at, 4));
+    TEST_ASSERT_EQUAL_INT64(12, at[0]);
+    TEST_ASSERT_EQUAL(0, s_job_count);
+    TEST_ASSERT_EQUAL(0, s_heap_len);
+    assert_on_time();
+}
+
+TEST_CASE("cron moves every jobs with a clock step, at jobs fire once", "[cron]")
+{
+    sim_reset();
+    sim_set_clock(T0);
+    add_job("e10", CRON_KIND_EVERY, 10, 0, NULL);
+    add_job("at50", CRON_KIND_AT, 0, T0 + 50, NULL);
+    sim_run_until(T0 + 25);
+
+    sim_step_clock(3600);                   /* carries the clock past at50 */
+    sim_run_until(T0 + 3600 + 35);
+
+    int64_t at[16];
+    TEST_ASSERT_EQUAL(3, fires_of("e10", at, 16));
+    TEST_ASSERT_EQUAL_INT64(10, at[0]);
+    TEST_ASSERT_EQUAL_INT64(20, at[1]);
+    TEST_ASSERT_EQUAL_INT64(3600 + 30, at[2]);     /* still 10 s after the last one */
+    TEST_ASSERT_EQUAL(1, fires_of("at50", at, 16));
+    TEST_ASSERT_EQUAL_INT64(3600 + 25, at[0]);
+
+    sim_step_clock(-600);                   /* now T0 + 3035 */
+    s_fire_count = 0;
+    sim_run_until(T0 + 3060);
+    TEST_ASSERT_EQUAL(2, fires_of("e10", at, 16));
+    TEST_ASSERT_EQUAL_INT64(3040, at[0]);
+    TEST_ASSERT_EQUAL_INT64(3050, at[1]);
+    assert_on_time();
+}
+
+TEST_CASE("cron re-plans cron jobs after the clock steps back", "[cron]")
+{
+    sim_reset();
+    sim_set_clock(T0);
+    add_job("c10", CRON_KIND_CRON, 0, 0, "*/10 * * * *");
+    sim_run_until(T0 + 1500);
+
+    int64_t at[16];
+    TEST_ASSERT_EQUAL(2, fires_of("c10", at, 16));
+    TEST_ASSERT_EQUAL_INT64(600, at[0]);
+    TEST_ASSERT_EQUAL_INT64(1200, at[1]);
+
+    /* Back an hour to T0 - 2100: the next match is 5 minutes away, not 65 */
+    sim_step_clock(-3600);
+    s_fire_count = 0;
+    sim_run_until(T0 - 1740);
+    TEST_ASSERT_EQUAL(1, fires_of("c10", at, 16));
+    TEST_ASSERT_EQUAL_INT64(-1800, at[0]);
+
+    /* Forward two hours to T0 + 5460: the skipped matches fire once, then on the grid */
+    sim_step_clock(7200);
+    s_fire_count = 0;
+    sim_run_until(T0 + 6060);
+    TEST_ASSERT_EQUAL(2, fires_of("c10", at, 16));
+    TEST_ASSERT_EQUAL_INT64(5460, at[0]);
+    TEST_ASSERT_EQUAL_INT64(6000, at[1]);
+    assert_on_time();
+}
+
+TEST_CASE("cron keeps the heap ordered up to the job limit", "[cron]")
+{
+    sim_reset();
+    sim_set_clock(T0);
+    sim_pass();
+    int added = 0;
+    for (int i = 0; i < MIMI_CRON_MAX_JOBS + 8; i++) {
+        cron_job_t job;
+        memset(&job, 0, sizeof(job));
+        snprintf(job.name, sizeof(job.name), "j%d", i);
+        strcpy(job.message, "m");
+        job.kind = CRON_KIND_EVERY;
+        job.interval_s = 60 + (i * 37) % 500;
+        if (cron_add_job(&job) == ESP_OK) added++;
+    }
+    TEST_ASSERT_EQUAL(MIMI_CRON_MAX_JOBS, added);
+    TEST_ASSERT_EQUAL(MIMI_CRON_MAX_JOBS, s_heap_len);
+    assert_heap_ordered();
+
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, cron_remove_job(s_jobs[(i * 7) % s_job_count].id));
+        assert_heap_ordered();
+    }
+    TEST_ASSERT_EQUAL(MIMI_CRON_MAX_JOBS - 20, s_heap_len);
+
+    /* Each fires on time and the earliest is always at the root */
+    sim_run_until(T0 + 1200);
+    assert_on_time();
+    assert_heap_ordered();
+    TEST_ASSERT_TRUE(s_fire_count > MIMI_CRON_MAX_JOBS);
+}
+
+TEST_CASE("cron_list_jobs copies the jobs out", "[cron]")
+{
+    sim_reset();
+    sim_set_clock(T0);
+    add_job("a", CRON_KIND_EVERY, 60, 0, NULL);
+    add_job("b", CRON_KIND_CRON, 0, 0, "@hourly");
+    add_job("c", CRON_KIND_AT, 0, T0 + 99, NULL);
+
+    cron_job_t jobs[2];
+    TEST_ASSERT_EQUAL(3, cron_list_jobs(NULL, 0));
+    TEST_ASSERT_EQUAL(3, cron_list_jobs(jobs, 2));
+    TEST_ASSERT_EQUAL_STRING("a", jobs[0].name);
+    TEST_ASSERT_EQUAL_STRING("b", jobs[1].name);
+    TEST_ASSERT_EQUAL_INT64(T0 + 3600, jobs[1].next_run);
+
+    /* A copy: later changes to the service do not show through */
+    TEST_ASSERT_EQUAL(ESP_OK, cron_remove_job(jobs[0].id));
+    TEST_ASSERT_EQUAL_STRING("a", jobs[0].name);
+    TEST_ASSERT_EQUAL(2, cron_list_jobs(jobs, 2));
+    TEST_ASSERT_EQUAL_STRING("b", jobs[0].name);
+}
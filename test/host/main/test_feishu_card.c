@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "cJSON.h"
+#include "esp_timer.h"
+#include "channels/feishu/feishu_card.h"
+
+/*
+ * feishu_card writes request bodies in one pass; it must stay byte-for-byte
+ * what the cJSON two-pass encoding it replaced produced (card printed with
+ * cJSON, then printed again as the request's "content" string). The old
+ * builders are kept here as the reference, and as the baseline for the
+ * benchmark at the end.
+ */
+
+/* ── Reference: the cJSON two-pass builders ───────────────────── */
+
+static char *ref_card_text(const char *text)
+{
+    cJSON *card = cJSON_CreateObject();
+    cJSON_AddStringToObject(card, "schema", "2.0");
+    cJSON *body = cJSON_CreateObject();
+    cJSON *elements = cJSON_CreateArray();
+    cJSON *md = cJSON_CreateObject();
+    cJSON_AddStringToObject(md, "tag", "markdown");
+    cJSON_AddStringToObject(md, "content", text);
+    cJSON_AddItemToArray(elements, md);
+    cJSON_AddItemToObject(body, "elements", elements);
+    cJSON_AddItemToObject(card, "body", body);
+    char *card_str = cJSON_PrintUnformatted(card);
+    cJSON_Delete(card);
+    return card_str;
+}
+
+static char *ref_card_collapsible(const char *title, const char *body)
+{
+    cJSON *card = cJSON_CreateObject();
+    cJSON_AddStringToObject(card, "schema", "2.0");
+    cJSON *card_body = cJSON_CreateObject();
+    cJSON *elements = cJSON_CreateArray();
+    cJSON *panel = cJSON_CreateObject();
+    cJSON_AddStringToObject(panel, "tag", "collapsible_panel");
+    cJSON_AddBoolToObject(panel, "expanded", false);
+    cJSON *header = cJSON_CreateObject();
+    cJSON *title_obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(title_obj, "tag", "plain_text");
+    cJSON_AddStringToObject(title_obj, "content", title);
+    cJSON_AddItemToObject(header, "title", title_obj);
+    cJSON_AddItemToObject(panel, "header", header);
+    cJSON *body_obj = cJSON_CreateObject();
+    cJSON_AddStringToObject(body_obj, "tag", "markdown");
+    cJSON_AddStringToObject(body_obj, "content", body);
+    cJSON *panel_elements = cJSON_CreateArray();
+    cJSON_AddItemToArray(panel_elements, body_obj);
+    cJSON_AddItemToObject(panel, "elements", panel_elements);
+    cJSON_AddItemToArray(elements, panel);
+    cJSON_AddItemToObject(card_body, "elements", elements);
+    cJSON_AddItemToObject(card, "body", card_body);
+    char *card_str = cJSON_PrintUnformatted(card);
+    cJSON_Delete(card);
+    return card_str;
+}
+
+/* Send ({receive_id, msg_type}), reply ({msg_type}) or patch ({}) request body */
+static char *ref_request(const char *receive_id, const char *msg_type, char *card_str)
+{
+    cJSON *body = cJSON_CreateObject();
+    if (receive_id) cJSON_AddStringToObject(body, "receive_id", receive_id);
+    if (msg_type) cJSON_AddStringToObject(body, "msg_type", msg_type);
+    cJSON_AddStringToObject(body, "content", card_str);
+    cJSON_free(card_str);
+    char *json_str = cJSON_PrintUnformatted(body);
+    cJSON_Delete(body);
+    return json_str;
+}
+
+/* ── Inputs ───────────────────────────────────────────────────── */
+
+static const char *const s_texts[] = {
+    "",
+    "hello",
+    "## 调用的工具列表\n\n- search_tool\n- calculator\n- weather_api",
+    "quote \" backslash \\ slash / both \\\" end",
+    "tabs\tcr\rlf\nff\fbs\b",
+    "\x01\x02\x1f\x7f control bytes and DEL",
+    "emoji 😀 and 3-byte ☃ and 2-byte é",
+    "```c\nprintf(\"%s\\n\", \"x\");\n```",
+    "trailing backslash \\",
+    "\\\\\\\"\"\"",
+};
+
+static const struct {
+    const char *receive_id;
+    const char *msg_type;
+} s_shapes[] = {
+    { "oc_0123456789abcdef", "interactive" },   /* send */
+    { NULL,                  "interactive" },   /* reply */
+    { NULL,                  NULL },            /* patch */
+    { "ou_\"odd\\id\"",      "interactive" },
+};
+
+#define N_TEXTS     (sizeof(s_texts) / sizeof(s_texts[0]))
+#define N_SHAPES    (sizeof(s_shapes) / sizeof(s_shapes[0]))
+
+/* Every byte 1-255 in a pseudo-random mix, NUL-terminated */
+static void random_text(char *out, size_t len, uint32_t *seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+        out[i] = (char)(1 + (*seed >> 16) % 255);
+    }
+    out[len] = '\0';
+}
+
+static void expect_text(feishu_card_buf_t *b, int shape, const char *text)
+{
+    char *want = ref_request(s_shapes[shape].receive_id, s_shapes[shape].msg_type,
+                             ref_card_text(text));
+    const char *got = feishu_card_text_body(b, s_shapes[shape].receive_id,
+                                            s_shapes[shape].msg_type, text, strlen(text));
+    TEST_ASSERT_NOT_NULL(want);
+    TEST_ASSERT_EQUAL_STRING(want, got);
+    TEST_ASSERT_EQUAL(strlen(want), b->len);
+    cJSON_free(want);
+}
+
+static void expect_collapsible(feishu_card_buf_t *b, int shape, const char *title, const char *body)
+{
+    char *want = ref_request(s_shapes[shape].receive_id, s_shapes[shape].msg_type,
+                             ref_card_collapsible(title, body));
+    const char *got = feishu_card_collapsible_body(b, s_shapes[shape].receive_id,
+                                                   s_shapes[shape].msg_type, title, body);
+    TEST_ASSERT_NOT_NULL(want);
+    TEST_ASSERT_EQUAL_STRING(want, got);
+    cJSON_free(want);
+}
+
+/* ── Tests ────────────────────────────────────────────────────── */
+
+TEST_CASE("feishu text card body matches the cJSON encoding", "[feishu]")
+{
+    feishu_card_buf_t b = { 0 };
+    for (size_t s = 0; s < N_SHAPES; s++) {
+        for (size_t t = 0; t < N_TEXTS; t++) {
+            expect_text(&b, (int)s, s_texts[t]);
+        }
+    }
+
+    uint32_t seed = 1;
+    static char text[5000];
+    for (int i = 0; i < 200; i++) {
+        random_text(text, (size_t)(i * 23) % sizeof(text), &seed);
+        expect_text(&b, i % (int)N_SHAPES, text);
+    }
+    feishu_card_buf_free(&b);
+}
+
+TEST_CASE("feishu text card body takes a length, not a terminator", "[feishu]")
+{
+    /* Long replies are sent in segments cut out of the full text */
+    const char *full = "first \"part\"\nsecond\\part";
+    char segment[16];
+    memcpy(segment, full, 12);
+    segment[12] = '\0';
+
+    feishu_card_buf_t b = { 0 };
+    char *want = ref_request(NULL, NULL, ref_card_text(segment));
+    TEST_ASSERT_EQUAL_STRING(want, feishu_card_text_body(&b, NULL, NULL, full, 12));
+    cJSON_free(want);
+    feishu_card_buf_free(&b);
+}
+
+TEST_CASE("feishu collapsible card body matches the cJSON encoding", "[feishu]")
+{
+    feishu_card_buf_t b = { 0 };
+    for (size_t s = 0; s < N_SHAPES; s++) {
+        for (size_t t = 0; t < N_TEXTS; t++) {
+            expect_collapsible(&b, (int)s, s_texts[t], s_texts[N_TEXTS - 1 - t]);
+        }
+    }
+
+    uint32_t seed = 7;
+    static char title[200], body[3000];
+    for (int i = 0; i < 100; i++) {
+        random_text(title, (size_t)i % sizeof(title), &seed);
+        random_text(body, (size_t)(i * 29) % sizeof(body), &seed);
+        expect_collapsible(&b, i % (int)N_SHAPES, title, body);
+    }
+    feishu_card_buf_free(&b);
+}
+
+TEST_CASE("feishu card buffer is reused and only grows", "[feishu]")
+{
+    feishu_card_buf_t b = { 0 };
+    static char big[20000];
+    memset(big, '"', sizeof(big) - 1);      /* worst case: 4 output bytes per input byte */
+    big[sizeof(big) - 1] = '\0';
+
+    TEST_ASSERT_NOT_NULL(feishu_card_text_body(&b, NULL, NULL, big, strlen(big)));
+    size_t cap = b.cap;
+    char *buf = b.buf;
+    TEST_ASSERT_TRUE(cap > 4 * strlen(big));
+
+    expect_text(&b, 0, "short");
+    TEST_ASSERT_EQUAL(cap, b.cap);
+    TEST_ASSERT_TRUE(buf == b.buf);
+    feishu_card_buf_free(&b);
+    TEST_ASSERT_NULL(b.buf);
+}
+
+/* Prints timings only; not asserted, host timings are too noisy */
+TEST_CASE("feishu card body: one pass vs cJSON two pass", "[feishu][bench]")
+{
+    enum { ITERS = 2000 };
+    static char text[4001];
+    uint32_t seed = 3;
+    random_text(text, sizeof(text) - 1, &seed);
+    for (size_t i = 0; i < sizeof(text) - 1; i++) {
+        if ((unsigned char)text[i] < 32 && text[i] != '\n') text[i] = 'x';   /* mostly prose */
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    size_t ref_bytes = 0;
+    for (int i = 0; i < ITERS; i++) {
+        char *s = ref_request("oc_0123456789abcdef", "interactive", ref_card_text(text));
+        ref_bytes += strlen(s);
+        cJSON_free(s);
+    }
+    int64_t t1 = esp_timer_get_time();
+
+    feishu_card_buf_t b = { 0 };
+    size_t one_bytes = 0;
+    for (int i = 0; i < ITERS; i++) {
+        feishu_card_text_body(&b, "oc_0123456789abcdef", "interactive", text, sizeof(text) - 1);
+        one_bytes += b.len;
+    }
+    int64_t t2 = esp_timer_get_time();
+    feishu_card_buf_free(&b);
+
+    TEST_ASSERT_EQUAL(ref_bytes, one_bytes);
+    printf("feishu card, %d x %u-byte text: cJSON %.2f us/op, one pass %.2f us/op\n",
+           ITERS, (unsigned)(sizeof(text) - 1),
+           (double)(t1 - t0) / ITERS, (double)(t2 - t1) / ITERS);
+}
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "unity.h"
+#include "lua.h"
+#include "lauxlib.h"
+#include "lua/lua_sandbox.h"
+
+/*
+ * The libraries every sandboxed state opens: a script must not be able to
+ * take the count hook off itself or hand the VM bytecode. The budget hook
+ * here stands in for lua_runner's, which raises the same way.
+ */
+
+#define BUDGET_STEPS    1000        /* hook calls, 100 instructions apart */
+
+static int s_steps;
+
+static void budget_hook(lua_State *L, lua_Debug *ar)
+{
+    (void)ar;
+    if (++s_steps > BUDGET_STEPS) {
+        luaL_error(L, "budget exceeded");
+    }
+}
+
+static lua_State *sandbox_state(void)
+{
+    lua_State *L = luaL_newstate();
+    TEST_ASSERT_NOT_NULL(L);
+    lua_sandbox_open_libs(L);
+    s_steps = 0;
+    lua_sethook(L, budget_hook, LUA_MASKCOUNT, 100);
+    return L;
+}
+
+/* Run src; its status, with the results or the error left on the stack */
+static int run(lua_State *L, const char *src)
+{
+    int rc = luaL_loadstring(L, src);
+    TEST_ASSERT_EQUAL_MESSAGE(LUA_OK, rc, lua_tostring(L, -1));
+    return lua_pcall(L, 0, LUA_MULTRET, 0);
+}
+
+TEST_CASE("lua sandbox: debug.sethook does not lift the budget", "[lua]")
+{
+    lua_State *L = sandbox_state();
+    int rc = run(L,
+                 "pcall(function() debug.sethook() end)\n"
+                 "pcall(function() require('debug').sethook() end)\n"
+                 "while true do end\n");
+    TEST_ASSERT_EQUAL(LUA_ERRRUN, rc);
+    TEST_ASSERT_NOT_NULL(strstr(lua_tostring(L, -1), "budget exceeded"));
+    lua_close(L);
+}
+
+TEST_CASE("lua sandbox: no debug library", "[lua]")
+{
+    lua_State *L = sandbox_state();
+    TEST_ASSERT_EQUAL(LUA_OK, run(L, "return debug == nil, (pcall(require, 'debug'))"));
+    TEST_ASSERT_TRUE(lua_toboolean(L, 1));
+    TEST_ASSERT_FALSE(lua_toboolean(L, 2));
+    lua_close(L);
+}
+
+TEST_CASE("lua sandbox: load takes text chunks only", "[lua]")
+{
+    lua_State *L = sandbox_state();
+    TEST_ASSERT_EQUAL(LUA_OK, run(L,
+        "local b = string.dump(function() return 1 end)\n"
+        "local f1, e1 = load(b)\n"
+        "local f2 = load(b, 'chunk', 'b')\n"
+        "local f3 = load(b, 'chunk', 'bt', {})\n"
+        "return f1 == nil and f2 == nil and f3 == nil, e1,\n"
+        "       load('return 41 + 1')(), load('return x', 'c', 't', { x = 7 })()\n"));
+    TEST_ASSERT_TRUE(lua_toboolean(L, 1));
+    TEST_ASSERT_NOT_NULL(strstr(lua_tostring(L, 2), "binary"));
+    TEST_ASSERT_EQUAL(42, lua_tointeger(L, 3));
+    TEST_ASSERT_EQUAL(7, lua_tointeger(L, 4));
+    lua_close(L);
+}
+
+TEST_CASE("lua sandbox: loadfile and dofile take text chunks only", "[lua]")
+{
+    lua_State *L = sandbox_state();
+    TEST_ASSERT_EQUAL(LUA_OK, run(L,
+        "local bin, txt = '/tmp/mimiclaw_test_chunk.luac', '/tmp/mimiclaw_test_chunk.lua'\n"
+        "local fh = io.open(bin, 'wb')\n"
+        "fh:write(string.dump(function() return 1 end))\n"
+        "fh:close()\n"
+        "fh = io.open(txt, 'w')\n"
+        "fh:write('return 1, 2')\n"
+        "fh:close()\n"
+        "local f = loadfile(bin, 'b')\n"
+        "local ok = pcall(dofile, bin)\n"
+        "local a, b = dofile(txt)\n"
+        "os.remove(bin)\n"
+        "os.remove(txt)\n"
+        "return f == nil, ok, a + b\n"));
+    TEST_ASSERT_TRUE(lua_toboolean(L, 1));
+    TEST_ASSERT_FALSE(lua_toboolean(L, 2));
+    TEST_ASSERT_EQUAL(3, lua_tointeger(L, 3));
+    lua_close(L);
+}
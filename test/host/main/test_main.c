@@ -0,0 +1,13 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "unity.h"
+
+/* Runs every TEST_CASE linked in; the exit code is the failure count for CI */
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    int failures = UNITY_END();
+    fflush(stdout);
+    exit(failures);
+}
@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "channels/telegram/telegram_markdown.h"
+
+/*
+ * tg_markdown_to_html() output goes to the Bot API with parse_mode "HTML",
+ * which rejects the whole message on one bad entity: tags must nest and
+ * close, and text outside tags must be escaped.
+ */
+
+static void expect_html(const char *md, const char *want)
+{
+    char *html = tg_markdown_to_html(md, strlen(md), NULL);
+    TEST_ASSERT_NOT_NULL(html);
+    TEST_ASSERT_EQUAL_STRING(want, html);
+    free(html);
+}
+
+TEST_CASE("markdown headings become one bold span", "[tg_markdown]")
+{
+    expect_html("# Title", "<b>Title</b>");
+    expect_html("### a & b", "<b>a &amp; b</b>");
+    expect_html("## **Bold** heading", "<b>Bold heading</b>");
+    expect_html("# __all__", "<b>all</b>");
+    expect_html("# *it* and **b**", "<b><i>it</i> and b</b>");
+    expect_html("# **A**\n**B**", "<b>A</b>\n<b>B</b>");
+    expect_html("#nospace", "#nospace");
+}
+
+TEST_CASE("markdown emphasis nests and closes in order", "[tg_markdown]")
+{
+    expect_html("**bold _it_**", "<b>bold <i>it</i></b>");
+    expect_html("~~gone~~ *it*", "<s>gone</s> <i>it</i>");
+    /* A closer that would cross the inner span stays literal */
+    expect_html("**a _b** c_", "<b>a <i>b** c</i></b>");
+    expect_html("- item **x**", "\xE2\x80\xA2 item <b>x</b>");
+}
+
+TEST_CASE("markdown code spans escape their contents", "[tg_markdown]")
+{
+    expect_html("`a<b> & c`", "<code>a&lt;b&gt; &amp; c</code>");
+    expect_html("`**x**` **y**", "<code>**x**</code> <b>y</b>");
+    expect_html("x < y && z > 1", "x &lt; y &amp;&amp; z &gt; 1");
+    expect_html("```\nif (a<b) {}\n```", "<pre>if (a&lt;b) {}\n</pre>");
+}
+
+TEST_CASE("markdown fence state carries across chunks", "[tg_markdown]")
+{
+    bool in_code = false;
+    const char *first = "```\nx<y\n";
+    char *html = tg_markdown_to_html(first, strlen(first), &in_code);
+    TEST_ASSERT_EQUAL_STRING("<pre>x&lt;y\n</pre>", html);
+    TEST_ASSERT_TRUE(in_code);
+    free(html);
+
+    const char *second = "z\n```\nafter";
+    html = tg_markdown_to_html(second, strlen(second), &in_code);
+    TEST_ASSERT_EQUAL_STRING("<pre>z\n</pre>after", html);
+    TEST_ASSERT_FALSE(in_code);
+    free(html);
+}
+
+TEST_CASE("markdown unclosed markers stay literal", "[tg_markdown]")
+{
+    expect_html("**bold", "**bold");
+    expect_html("a * b", "a * b");
+    expect_html("snake_case_name", "snake_case_name");
+    expect_html("`open", "`open");
+    expect_html("~~x", "~~x");
+    /* Closers are looked for on the same line only */
+    expect_html("**a\nb**", "**a\nb**");
+    expect_html("[x](javascript:alert(1))", "[x](javascript:alert(1))");
+    expect_html("[x](https://e.com/?a=1&b=\"2\")",
+                "<a href=\"https://e.com/?a=1&amp;b=&quot;2&quot;\">x</a>");
+}
+
+TEST_CASE("markdown chunks split outside bold and UTF-8", "[tg_markdown]")
+{
+    const char *bold = "ab **c d** efgh";
+    TEST_ASSERT_EQUAL(11, tg_markdown_chunk_len(bold, strlen(bold), 12));
+
+    const char *utf8 = "\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9";
+    TEST_ASSERT_EQUAL(4, tg_markdown_chunk_len(utf8, strlen(utf8), 5));
+
+    const char *para = "one two\n\nthree four";
+    TEST_ASSERT_EQUAL(9, tg_markdown_chunk_len(para, strlen(para), 15));
+}
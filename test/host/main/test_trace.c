@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "cJSON.h"
+#include "esp_timer.h"
+#include "trace/trace.h"
+
+/*
+ * trace_export_json() output must stay valid JSON whatever the span names
+ * and details hold: tool and daemon names reach the ring as details.
+ */
+
+/* The one non-metadata event in an export, or NULL */
+static cJSON *only_span(cJSON *root)
+{
+    cJSON *events = cJSON_GetObjectItem(root, "traceEvents");
+    cJSON *found = NULL;
+    cJSON *ev;
+    cJSON_ArrayForEach(ev, events) {
+        cJSON *ph = cJSON_GetObjectItem(ev, "ph");
+        if (cJSON_IsString(ph) && strcmp(ph->valuestring, "X") == 0) {
+            TEST_ASSERT_NULL(found);
+            found = ev;
+        }
+    }
+    return found;
+}
+
+static void expect_round_trip(const char *name, const char *detail)
+{
+    trace_clear();
+    int64_t now = esp_timer_get_time();
+    trace_record(name, detail, now > 0 ? now : 1, now + 1500);
+
+    char *json = trace_export_json();
+    TEST_ASSERT_NOT_NULL(json);
+    cJSON *root = cJSON_Parse(json);
+    TEST_ASSERT_NOT_NULL_MESSAGE(root, json);
+
+    cJSON *span = only_span(root);
+    TEST_ASSERT_NOT_NULL(span);
+    TEST_ASSERT_EQUAL_STRING(name, cJSON_GetObjectItem(span, "name")->valuestring);
+    cJSON *args = cJSON_GetObjectItem(span, "args");
+    if (detail) {
+        TEST_ASSERT_EQUAL_STRING(detail, cJSON_GetObjectItem(args, "detail")->valuestring);
+    } else {
+        TEST_ASSERT_NULL(args);
+    }
+    cJSON_Delete(root);
+    free(json);
+}
+
+TEST_CASE("trace export escapes span names and details", "[trace]")
+{
+    TEST_ASSERT_EQUAL(ESP_OK, trace_init());
+    trace_set_enabled(true);
+
+    expect_round_trip("tool", "web_search");
+    expect_round_trip("tool", NULL);
+    expect_round_trip("lua_daemon", "say \"hi\"");
+    expect_round_trip("lua_daemon", "C:\\scripts\\x.lua");
+    expect_round_trip("tab\there", "line\nbreak\r\n\b\f");
+    expect_round_trip("ctl", "\x01\x02\x1f end");
+    expect_round_trip("utf8", "温度 sensor ☃");
+    expect_round_trip("\"", "\\");
+    expect_round_trip("", "");
+}